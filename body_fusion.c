@@ -0,0 +1,543 @@
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "body_fusion.h"
+#include "body_slots.h"
+#include "platform.h"
+
+#define ROTATION_FLOOR_WEIGHT 0.01f// joints no camera observed still average
+
+void body_fusion_default_config(struct BodyFusionConfig* config)
+{
+    config->gateMm = 300.0f;
+    config->minCommonJoints = 6;
+    config->maxAgeUsec = 100000;
+    config->maxExtrapolateUsec = 50000;
+}
+
+void body_fusion_init(struct BodyFusion* fusion, const struct BodyFusionConfig* config)
+{
+    memset(fusion, 0, sizeof(*fusion));
+    fusion->config = *config;
+    fusion->nextPersonId = 1;
+    latency_stats_init(&fusion->fuseTime, "fusion time");
+    task_loop_init(&fusion->alignLoop, "fusion align", 1000);
+    task_loop_init(&fusion->mergeLoop, "fusion merge", 2000);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Assignment
+
+#define ASSIGN_MAX_ROWS MAX_FRAME_BODIES
+#define ASSIGN_MAX_COLS (BODY_FUSION_MAX_BODIES + MAX_FRAME_BODIES)
+
+// Minimum cost assignment of every row to a distinct column (rows <= cols),
+// Hungarian method with row and column potentials, O(rows^2 * cols)
+static void hungarian(const float cost[][ASSIGN_MAX_COLS], int rows, int cols, int* row_to_col)
+{
+    float u[ASSIGN_MAX_ROWS + 1] = { 0 };
+    float v[ASSIGN_MAX_COLS + 1] = { 0 };
+    int p[ASSIGN_MAX_COLS + 1] = { 0 };// row (1-based) assigned to each column
+    int way[ASSIGN_MAX_COLS + 1];
+    float min_v[ASSIGN_MAX_COLS + 1];
+    bool used[ASSIGN_MAX_COLS + 1];
+
+    for (int i = 1; i <= rows; i++)
+    {
+        p[0] = i;
+        int j0 = 0;
+        for (int j = 0; j <= cols; j++)
+        {
+            min_v[j] = FLT_MAX;
+            used[j] = false;
+        }
+        do
+        {
+            used[j0] = true;
+            int i0 = p[j0];
+            int j1 = 0;
+            float delta = FLT_MAX;
+            for (int j = 1; j <= cols; j++)
+            {
+                if (used[j])
+                    continue;
+                float cur = cost[i0 - 1][j - 1] - u[i0] - v[j];
+                if (cur < min_v[j])
+                {
+                    min_v[j] = cur;
+                    way[j] = j0;
+                }
+                if (min_v[j] < delta)
+                {
+                    delta = min_v[j];
+                    j1 = j;
+                }
+            }
+            for (int j = 0; j <= cols; j++)
+            {
+                if (used[j])
+                {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                }
+                else
+                    min_v[j] -= delta;
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+        do
+        {
+            int j1 = way[j0];
+            p[j0] = p[j1];
+            j0 = j1;
+        } while (j0 != 0);
+    }
+
+    for (int j = 1; j <= cols; j++)
+    {
+        if (p[j] != 0)
+            row_to_col[p[j] - 1] = j - 1;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Association
+
+static float joint_weight(uint8_t confidence)
+{
+    return (float)confidence;// NONE (out of range) does not count
+}
+
+// Mean distance of the joints a camera body and a person both observed, or
+// the gate if too few are shared
+static float association_cost(const struct BodyFusion* fusion, const struct FusionCluster* c, int k)
+{
+    const struct FusionSource* src = &fusion->sources[fusion->alignedSource[k]];
+    const uint8_t* confidence = src->frame.confidence[fusion->alignedBody[k]];
+    const vec3_t* p = fusion->aligned[k];
+
+    float total = 0.0f;
+    int common = 0;
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        if (confidence[j] == CONFIDENCE_NONE || c->weight[j] <= 0.0f)
+            continue;
+        vec3_t mean = vec3_scale(c->sum[j], 1.0f / c->weight[j]);
+        total += vec3_length(vec3_sub(mean, p[j]));
+        common++;
+    }
+    if (common < fusion->config.minCommonJoints)
+        return fusion->config.gateMm;
+    float cost = total / (float)common;
+    return cost < fusion->config.gateMm ? cost : fusion->config.gateMm;
+}
+
+static void cluster_add(struct BodyFusion* fusion, struct FusionCluster* c, int k)
+{
+    const struct FusionSource* src = &fusion->sources[fusion->alignedSource[k]];
+    const uint8_t* confidence = src->frame.confidence[fusion->alignedBody[k]];
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        float w = joint_weight(confidence[j]);
+        c->sum[j] = vec3_add(c->sum[j], vec3_scale(fusion->aligned[k][j], w));
+        c->weight[j] += w;
+    }
+    c->members[c->memberCount++] = (uint8_t)k;
+}
+
+static void cluster_start(struct BodyFusion* fusion, int k)
+{
+    struct FusionCluster* c = &fusion->clusters[fusion->clusterCount++];
+    memset(c, 0, sizeof(*c));
+    cluster_add(fusion, c, k);
+}
+
+// Camera bodies k in [first, end) all come from one source: assign them to
+// the persons built from the sources before, or start new persons
+static void associate_source(struct BodyFusion* fusion, int first, int end)
+{
+    float cost[ASSIGN_MAX_ROWS][ASSIGN_MAX_COLS];
+    int rows = end - first;
+    int persons = fusion->clusterCount;
+    if (persons == 0)
+    {
+        for (int k = first; k < end; k++)
+            cluster_start(fusion, k);
+        return;
+    }
+
+    // one "new person" column per body, at the gate, so every body can stay
+    // unassigned when no person is closer than that
+    int cols = persons + rows;
+    float gate = fusion->config.gateMm;
+    for (int r = 0; r < rows; r++)
+    {
+        for (int c = 0; c < persons; c++)
+            cost[r][c] = association_cost(fusion, &fusion->clusters[c], first + r);
+        for (int c = persons; c < cols; c++)
+            cost[r][c] = gate;
+    }
+
+    int row_to_col[ASSIGN_MAX_ROWS];
+    hungarian(cost, rows, cols, row_to_col);
+    for (int r = 0; r < rows; r++)
+    {
+        int c = row_to_col[r];
+        if (c < persons && cost[r][c] < gate)
+        {
+            cluster_add(fusion, &fusion->clusters[c], first + r);
+            fusion->associated++;
+        }
+        else
+            cluster_start(fusion, first + r);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Composition
+
+static uint32_t member_id(const struct BodyFusion* fusion, int k)
+{
+    return fusion->sources[fusion->alignedSource[k]].frame.bodyIds[fusion->alignedBody[k]];
+}
+
+// Person of the previous frame sharing the most members with c, -1 if none
+static int previous_by_members(const struct BodyFusion* fusion, const struct FusionCluster* c, int* shared)
+{
+    int best = -1;
+    *shared = 0;
+    for (int p = 0; p < fusion->personCount; p++)
+    {
+        const struct FusionPerson* person = &fusion->persons[p];
+        int n = 0;
+        for (int m = 0; m < c->memberCount; m++)
+        {
+            uint32_t id = member_id(fusion, c->members[m]);
+            for (int q = 0; q < person->memberCount; q++)
+                n += person->members[q] == id;
+        }
+        if (n > *shared)
+        {
+            *shared = n;
+            best = p;
+        }
+    }
+    return best;
+}
+
+static vec3_t cluster_joint(const struct BodyFusion* fusion, const struct FusionCluster* c, int j)
+{
+    if (c->weight[j] > 0.0f)
+        return vec3_scale(c->sum[j], 1.0f / c->weight[j]);
+    vec3_t sum = vec3_make(0.0f, 0.0f, 0.0f);
+    for (int m = 0; m < c->memberCount; m++)
+        sum = vec3_add(sum, fusion->aligned[c->members[m]][j]);
+    return vec3_scale(sum, 1.0f / (float)c->memberCount);
+}
+
+// Persons keep the id of the previous person they share members with, else
+// of the nearest unclaimed previous person within the gate
+static void assign_ids(struct BodyFusion* fusion, int count)
+{
+    bool claimed[BODY_FUSION_MAX_PERSONS] = { false };
+    int previous[BODY_FUSION_MAX_BODIES];
+    int shared[BODY_FUSION_MAX_BODIES];
+    for (int c = 0; c < count; c++)
+    {
+        fusion->clusters[c].id = 0;
+        previous[c] = previous_by_members(fusion, &fusion->clusters[c], &shared[c]);
+    }
+
+    // a person split in two: the part with more shared members keeps the id
+    for (;;)
+    {
+        int best = -1;
+        for (int c = 0; c < count; c++)
+        {
+            if (fusion->clusters[c].id == 0 && previous[c] >= 0 && !claimed[previous[c]] &&
+                (best < 0 || shared[c] > shared[best]))
+                best = c;
+        }
+        if (best < 0)
+            break;
+        claimed[previous[best]] = true;
+        fusion->clusters[best].id = fusion->persons[previous[best]].id;
+    }
+
+    float gate = fusion->config.gateMm;
+    for (int c = 0; c < count; c++)
+    {
+        struct FusionCluster* cluster = &fusion->clusters[c];
+        if (cluster->id != 0)
+            continue;
+        vec3_t pelvis = cluster_joint(fusion, cluster, JOINT_PELVIS);
+        int nearest = -1;
+        float nearest_distance = gate;
+        for (int p = 0; p < fusion->personCount; p++)
+        {
+            float d = vec3_length(vec3_sub(fusion->persons[p].pelvis, pelvis));
+            if (!claimed[p] && d < nearest_distance)
+            {
+                nearest = p;
+                nearest_distance = d;
+            }
+        }
+        if (nearest >= 0)
+        {
+            claimed[nearest] = true;
+            cluster->id = fusion->persons[nearest].id;
+        }
+        else
+        {
+            cluster->id = BODY_FUSION_ID_BASE | (fusion->nextPersonId & ~BODY_FUSION_ID_BASE);
+            fusion->nextPersonId++;
+        }
+    }
+}
+
+// Output body b from cluster b; persons are written concurrently
+static void write_person(struct BodyFusion* fusion, uint32_t b, struct SkeletonFrame* out)
+{
+    const struct FusionCluster* c = &fusion->clusters[b];
+    out->bodyIds[b] = c->id;
+    out->slots[b] = BODY_SLOT_NONE;
+
+    float best_total = -1.0f;
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        out->positions[b][j] = cluster_joint(fusion, c, j);
+        out->confidence[b][j] = CONFIDENCE_NONE;
+    }
+
+    // Rotations: confidence-weighted sum of unit quaternions on one hemisphere
+    quat_t sum[SKELETON_JOINT_COUNT];
+    memset(sum, 0, sizeof(sum));
+    for (int m = 0; m < c->memberCount; m++)
+    {
+        int k = c->members[m];
+        const struct SkeletonFrame* f = &fusion->sources[fusion->alignedSource[k]].frame;
+        uint32_t body = fusion->alignedBody[k];
+        float total = 0.0f;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            uint8_t confidence = f->confidence[body][j];
+            float w = joint_weight(confidence) + ROTATION_FLOOR_WEIGHT;
+            quat_t q = f->worldRotations[body][j];
+            if (quat_dot(sum[j], q) < 0.0f)
+                w = -w;
+            sum[j].w += q.w * w;
+            sum[j].x += q.x * w;
+            sum[j].y += q.y * w;
+            sum[j].z += q.z * w;
+            if (confidence > out->confidence[b][j])
+                out->confidence[b][j] = confidence;
+            total += joint_weight(confidence);
+        }
+        if (total > best_total)
+        {
+            best_total = total;
+            out->cameraPositions[b] = f->cameraPositions[body];
+        }
+    }
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        out->worldRotations[b][j] = quat_normalize(sum[j]);
+}
+
+// Remember the output persons, and for a while the ones nobody sees any more,
+// for the id continuity of the next frames
+static void keep_persons(struct BodyFusion* fusion, int count, int64_t now_usec)
+{
+    struct FusionPerson lost[BODY_FUSION_MAX_PERSONS];
+    int lost_count = 0;
+    for (int p = 0; p < fusion->personCount; p++)
+    {
+        const struct FusionPerson* person = &fusion->persons[p];
+        bool seen = false;
+        for (int c = 0; c < count && !seen; c++)
+            seen = fusion->clusters[c].id == person->id;
+        if (!seen && now_usec - person->lastSeenUsec <= fusion->config.maxAgeUsec)
+            lost[lost_count++] = *person;
+    }
+
+    for (int c = 0; c < count; c++)
+    {
+        const struct FusionCluster* cluster = &fusion->clusters[c];
+        struct FusionPerson* person = &fusion->persons[c];
+        person->id = cluster->id;
+        person->lastSeenUsec = now_usec;
+        person->pelvis = cluster_joint(fusion, cluster, JOINT_PELVIS);
+        person->memberCount = cluster->memberCount;
+        for (int m = 0; m < cluster->memberCount; m++)
+            person->members[m] = member_id(fusion, cluster->members[m]);
+    }
+    fusion->personCount = count;
+    for (int p = 0; p < lost_count && fusion->personCount < BODY_FUSION_MAX_PERSONS; p++)
+        fusion->persons[fusion->personCount++] = lost[p];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Sources
+
+static void store_source(struct BodyFusion* fusion, int source, const struct SkeletonFrame* frame)
+{
+    struct FusionSource* src = &fusion->sources[source];
+    const struct SkeletonFrame* prev = &src->frame;
+    int64_t dt = frame->timestampUsec - prev->timestampUsec;
+    bool moving = src->have && dt > 0 && dt <= fusion->config.maxAgeUsec;
+    float per_second = moving ? 1e6f / (float)dt : 0.0f;
+
+    for (uint32_t b = 0; b < frame->bodyCount; b++)
+    {
+        uint32_t p = 0;
+        while (moving && p < prev->bodyCount && prev->bodyIds[p] != frame->bodyIds[b])
+            p++;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            src->velocities[b][j] = (moving && p < prev->bodyCount)
+                ? vec3_scale(vec3_sub(frame->positions[b][j], prev->positions[p][j]), per_second)
+                : vec3_make(0.0f, 0.0f, 0.0f);
+        }
+    }
+
+    src->frame.frameNumber = frame->frameNumber;
+    src->frame.timestampUsec = frame->timestampUsec;
+    src->frame.bodyCount = frame->bodyCount;
+    size_t n = frame->bodyCount;
+    memcpy(src->frame.bodyIds, frame->bodyIds, n * sizeof(frame->bodyIds[0]));
+    memcpy(src->frame.cameraPositions, frame->cameraPositions, n * sizeof(frame->cameraPositions[0]));
+    memcpy(src->frame.positions, frame->positions, n * sizeof(frame->positions[0]));
+    memcpy(src->frame.worldRotations, frame->worldRotations, n * sizeof(frame->worldRotations[0]));
+    memcpy(src->frame.confidence, frame->confidence, n * sizeof(frame->confidence[0]));
+    src->have = true;
+}
+
+struct AlignTask
+{
+    struct BodyFusion* fusion;
+    int64_t t;
+    int sources[MAX_KINECTS];// fresh sources
+    int first[MAX_KINECTS];  // their first aligned index
+};
+
+static void align_source(void* context, int index)
+{
+    const struct AlignTask* task = (const struct AlignTask*)context;
+    struct BodyFusion* fusion = task->fusion;
+    const struct BodyFusionConfig* config = &fusion->config;
+    int s = task->sources[index];
+    const struct FusionSource* src = &fusion->sources[s];
+
+    int64_t dt = task->t - src->frame.timestampUsec;
+    if (dt > config->maxExtrapolateUsec)
+        dt = config->maxExtrapolateUsec;
+    if (dt < -config->maxExtrapolateUsec)
+        dt = -config->maxExtrapolateUsec;
+    float seconds = (float)dt * 1e-6f;
+    for (uint32_t b = 0; b < src->frame.bodyCount; b++)
+    {
+        int k = task->first[index] + (int)b;
+        fusion->alignedSource[k] = (uint8_t)s;
+        fusion->alignedBody[k] = (uint8_t)b;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+            fusion->aligned[k][j] = vec3_add(src->frame.positions[b][j], vec3_scale(src->velocities[b][j], seconds));
+    }
+}
+
+// Bodies of every fresh source, moved to time t along their joint velocities
+static void align_sources(struct BodyFusion* fusion, int64_t t, int* source_end)
+{
+    struct AlignTask task;
+    task.fusion = fusion;
+    task.t = t;
+    int fresh = 0;
+    fusion->alignedCount = 0;
+    for (int s = 0; s < MAX_KINECTS; s++)
+    {
+        const struct FusionSource* src = &fusion->sources[s];
+        if (src->have && t - src->frame.timestampUsec <= fusion->config.maxAgeUsec)
+        {
+            task.sources[fresh] = s;
+            task.first[fresh++] = fusion->alignedCount;
+            fusion->alignedCount += (int)src->frame.bodyCount;
+        }
+        source_end[s] = fusion->alignedCount;
+    }
+    task_pool_for(fusion->pool, &fusion->alignLoop, fresh, align_source, &task);
+}
+
+struct MergeTask
+{
+    struct BodyFusion* fusion;
+    struct SkeletonFrame* out;
+};
+
+static void merge_person(void* context, int index)
+{
+    struct MergeTask* task = (struct MergeTask*)context;
+    write_person(task->fusion, (uint32_t)index, task->out);
+}
+
+void body_fusion_push(struct BodyFusion* fusion, int source, const struct SkeletonFrame* frame,
+                      struct SkeletonFrame* out)
+{
+    int64_t start_usec = monotonic_usec();
+    if (source >= 0 && source < MAX_KINECTS)
+        store_source(fusion, source, frame);
+
+    int source_end[MAX_KINECTS];
+    align_sources(fusion, frame->timestampUsec, source_end);
+
+    fusion->clusterCount = 0;
+    int first = 0;
+    for (int s = 0; s < MAX_KINECTS; s++)
+    {
+        if (source_end[s] > first)
+            associate_source(fusion, first, source_end[s]);
+        first = source_end[s];
+    }
+
+    // more people than an output frame holds: the ones seen by most cameras
+    int count = fusion->clusterCount;
+    if (count > MAX_FRAME_BODIES)
+    {
+        for (int i = 1; i < count; i++)
+        {
+            struct FusionCluster c = fusion->clusters[i];
+            int k = i - 1;
+            for (; k >= 0 && fusion->clusters[k].memberCount < c.memberCount; k--)
+                fusion->clusters[k + 1] = fusion->clusters[k];
+            fusion->clusters[k + 1] = c;
+        }
+        count = MAX_FRAME_BODIES;
+    }
+    assign_ids(fusion, count);
+
+    out->frameNumber = ++fusion->outputFrames;
+    out->timestampUsec = frame->timestampUsec;
+    out->bodyCount = (uint32_t)count;
+    struct MergeTask merge = { fusion, out };
+    task_pool_for(fusion->pool, &fusion->mergeLoop, count, merge_person, &merge);
+    keep_persons(fusion, count, frame->timestampUsec);
+    fusion->frames++;
+    fusion->fused += (uint64_t)count;
+    latency_stats_add(&fusion->fuseTime, monotonic_usec() - start_usec);
+}
+
+void body_fusion_report(struct BodyFusion* fusion, int64_t now_usec, int64_t interval_usec)
+{
+    if (now_usec - fusion->lastReportUsec < interval_usec)
+        return;
+    if (fusion->lastReportUsec != 0 && fusion->frames > 0)
+    {
+        printf("fusion: %llu frames, %.1f persons per frame, %llu camera bodies matched across cameras\n",
+               (unsigned long long)fusion->frames, (double)fusion->fused / (double)fusion->frames,
+               (unsigned long long)fusion->associated);
+        latency_stats_print(&fusion->fuseTime);
+    }
+    fusion->frames = 0;
+    fusion->fused = 0;
+    fusion->associated = 0;
+    latency_stats_reset(&fusion->fuseTime);
+    fusion->lastReportUsec = now_usec;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+#include "latency_stats.h"
+#include "task_pool.h"
+
+// Cross-camera fusion: one person seen by several Kinects becomes one body.
+//
+// Every source frame is stored with per-joint velocities (from the previous
+// frame of the same source body) and every output frame is composed at the
+// time of the newest source frame: the bodies of the other cameras are first
+// extrapolated to that time, then associated camera by camera. Each camera's
+// bodies are assigned to the persons built so far by the Hungarian method on
+// the mean distance of the joints both sides observed; pairs farther apart
+// than the gate start a new person. Joints of the members are averaged with
+// their confidence as weight (positions and sign-aligned world rotations).
+//
+// Persons keep their id while any member (camera body id) carries over from
+// the previous output frame, or while a new member lands within the gate of
+// where the person last was, so a camera losing or re-acquiring someone
+// does not respawn them. Persons no camera sees are remembered for
+// maxAgeUsec. Fused ids have BODY_FUSION_ID_BASE set and never collide with
+// per-camera ids (KINECT_BODY_ID).
+
+#define BODY_FUSION_ID_BASE 0xFF000000u
+#define BODY_FUSION_MAX_MEMBERS MAX_KINECTS
+#define BODY_FUSION_MAX_PERSONS (2 * MAX_FRAME_BODIES)// output persons and recently lost ones
+#define BODY_FUSION_MAX_BODIES (MAX_KINECTS * MAX_FRAME_BODIES)
+
+struct BodyFusionConfig
+{
+    float gateMm;             // mean joint distance above which bodies are different people
+    int minCommonJoints;      // joints both bodies must observe to be compared
+    int64_t maxAgeUsec;       // source frames older than this are left out
+    int64_t maxExtrapolateUsec;// time alignment never extrapolates further
+};
+
+// Newest frame of one camera, with joint velocities for time alignment
+struct FusionSource
+{
+    bool have;
+    struct SkeletonFrame frame;
+    vec3_t velocities[MAX_FRAME_BODIES][SKELETON_JOINT_COUNT];// mm/s
+};
+
+// Person of an earlier output frame
+struct FusionPerson
+{
+    uint32_t id;
+    int64_t lastSeenUsec;
+    vec3_t pelvis;// mm, world
+    int memberCount;
+    uint32_t members[BODY_FUSION_MAX_MEMBERS];// camera body ids
+};
+
+// Person being built from the aligned camera bodies of one push
+struct FusionCluster
+{
+    int memberCount;
+    uint8_t members[BODY_FUSION_MAX_MEMBERS];// aligned body indices
+    vec3_t sum[SKELETON_JOINT_COUNT];        // confidence-weighted positions
+    float weight[SKELETON_JOINT_COUNT];
+    uint32_t id;
+};
+
+struct BodyFusion
+{
+    struct BodyFusionConfig config;
+    struct TaskPool* pool;// optional: cameras aligned and persons merged in parallel
+    struct TaskLoop alignLoop;
+    struct TaskLoop mergeLoop;
+    struct FusionSource sources[MAX_KINECTS];
+    uint32_t outputFrames;
+    uint32_t nextPersonId;
+
+    struct FusionPerson persons[BODY_FUSION_MAX_PERSONS];
+    int personCount;
+
+    // scratch of one push: camera bodies moved to the output time
+    vec3_t aligned[BODY_FUSION_MAX_BODIES][SKELETON_JOINT_COUNT];
+    uint8_t alignedSource[BODY_FUSION_MAX_BODIES];
+    uint8_t alignedBody[BODY_FUSION_MAX_BODIES];
+    int alignedCount;
+    struct FusionCluster clusters[BODY_FUSION_MAX_BODIES];
+    int clusterCount;
+
+    uint64_t frames;
+    uint64_t associated;// camera bodies merged into a person seen by another camera
+    uint64_t fused;     // output persons
+    struct LatencyStats fuseTime;// per push, us
+    int64_t lastReportUsec;
+};
+
+void body_fusion_default_config(struct BodyFusionConfig* config);
+void body_fusion_init(struct BodyFusion* fusion, const struct BodyFusionConfig* config);
+
+// Store the frame of one source and compose out from the newest frame of
+// every source: one body per person, with fused ids. out gets the next output
+// frame number and the timestamp of frame; the camera position of a person is
+// the one of its most confident member.
+void body_fusion_push(struct BodyFusion* fusion, int source, const struct SkeletonFrame* frame,
+                      struct SkeletonFrame* out);
+
+// Print and reset the statistics every interval_usec
+void body_fusion_report(struct BodyFusion* fusion, int64_t now_usec, int64_t interval_usec);
@@ -0,0 +1,120 @@
+#include <string.h>
+#include "body_slots.h"
+
+#define HASH_MASK (BODY_SLOT_HASH_SIZE - 1)
+
+static uint32_t hash_index(uint32_t body_id)
+{
+    // Fibonacci hashing spreads consecutive ids across the table
+    return (body_id * 2654435761u) >> (32 - BODY_SLOT_HASH_BITS);
+}
+
+void body_slots_init(struct BodySlotTable* table, int64_t grace_period_usec)
+{
+    memset(table, 0, sizeof(*table));
+    table->gracePeriodUsec = grace_period_usec;
+    memset(table->hash, BODY_SLOT_NONE, sizeof(table->hash));
+    for (int i = 0; i < MAX_BODY_SLOTS; i++)
+        table->freeSlots[i] = (uint8_t)i;
+    table->freeCount = MAX_BODY_SLOTS;
+}
+
+static void push_event(struct BodySlotTable* table, uint8_t type, uint8_t slot, uint32_t body_id)
+{
+    if (table->eventCount >= BODY_SLOT_MAX_EVENTS)
+    {
+        // consumer is not draining; keep the newest events
+        memmove(table->events, table->events + 1, sizeof(table->events[0]) * (BODY_SLOT_MAX_EVENTS - 1));
+        table->eventCount--;
+    }
+    struct BodySlotEvent* e = &table->events[table->eventCount++];
+    e->type = type;
+    e->slot = slot;
+    e->bodyId = body_id;
+}
+
+// Hash position holding body_id, or the empty position where it would go
+static uint32_t probe(const struct BodySlotTable* table, uint32_t body_id)
+{
+    uint32_t h = hash_index(body_id);
+    while (table->hash[h] != BODY_SLOT_NONE && table->slots[table->hash[h]].bodyId != body_id)
+        h = (h + 1) & HASH_MASK;
+    return h;
+}
+
+uint8_t body_slots_lookup(const struct BodySlotTable* table, uint32_t body_id)
+{
+    return table->hash[probe(table, body_id)];
+}
+
+uint8_t body_slots_assign(struct BodySlotTable* table, uint32_t body_id, int64_t now_usec)
+{
+    uint32_t h = probe(table, body_id);
+    uint8_t slot = table->hash[h];
+    if (slot != BODY_SLOT_NONE)
+    {
+        table->slots[slot].lastSeenUsec = now_usec;
+        return slot;
+    }
+    if (table->freeCount == 0)
+        return BODY_SLOT_NONE;
+
+    slot = table->freeSlots[table->freeHead];
+    table->freeHead = (table->freeHead + 1) % MAX_BODY_SLOTS;
+    table->freeCount--;
+
+    table->slots[slot].bodyId = body_id;
+    table->slots[slot].lastSeenUsec = now_usec;
+    table->slots[slot].active = true;
+    table->hash[h] = slot;
+    push_event(table, BODY_SLOT_SPAWN, slot, body_id);
+    return slot;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones
+static void hash_remove(struct BodySlotTable* table, uint32_t body_id)
+{
+    uint32_t hole = probe(table, body_id);
+    if (table->hash[hole] == BODY_SLOT_NONE)
+        return;
+    table->hash[hole] = BODY_SLOT_NONE;
+
+    uint32_t i = (hole + 1) & HASH_MASK;
+    while (table->hash[i] != BODY_SLOT_NONE)
+    {
+        uint32_t home = hash_index(table->slots[table->hash[i]].bodyId);
+        // move the entry back if its home is not cyclically in (hole, i]
+        if (((i - home) & HASH_MASK) >= ((i - hole) & HASH_MASK))
+        {
+            table->hash[hole] = table->hash[i];
+            table->hash[i] = BODY_SLOT_NONE;
+            hole = i;
+        }
+        i = (i + 1) & HASH_MASK;
+    }
+}
+
+void body_slots_expire(struct BodySlotTable* table, int64_t now_usec)
+{
+    for (int slot = 0; slot < MAX_BODY_SLOTS; slot++)
+    {
+        struct BodySlot* s = &table->slots[slot];
+        if (!s->active || now_usec - s->lastSeenUsec <= table->gracePeriodUsec)
+            continue;
+
+        hash_remove(table, s->bodyId);
+        s->active = false;
+        table->freeSlots[(table->freeHead + table->freeCount) % MAX_BODY_SLOTS] = (uint8_t)slot;
+        table->freeCount++;
+        push_event(table, BODY_SLOT_DESPAWN, (uint8_t)slot, s->bodyId);
+    }
+}
+
+int body_slots_take_events(struct BodySlotTable* table, struct BodySlotEvent* events, int capacity)
+{
+    int n = table->eventCount < capacity ? table->eventCount : capacity;
+    memcpy(events, table->events, sizeof(events[0]) * n);
+    memmove(table->events, table->events + n, sizeof(table->events[0]) * (table->eventCount - n));
+    table->eventCount -= n;
+    return n;
+}
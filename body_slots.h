@@ -0,0 +1,72 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Maps k4abt body ids (which grow without bound) to compact, stable slot
+// indices for the receiver. Fixed capacity, open addressing with linear
+// probing; no allocation after init.
+//
+// A body that disappears keeps its slot for a grace period, so short tracking
+// dropouts do not respawn the actor. Freed slots are reused oldest-first so a
+// slot that was just despawned is not immediately handed to someone else.
+
+#define MAX_BODY_SLOTS 16
+#define BODY_SLOT_NONE 0xFF
+#define BODY_SLOT_HASH_BITS 6
+#define BODY_SLOT_HASH_SIZE (1 << BODY_SLOT_HASH_BITS) // 4x slots keeps probes short
+#define BODY_SLOT_MAX_EVENTS (2 * MAX_BODY_SLOTS)
+
+enum BodySlotEventType
+{
+    BODY_SLOT_SPAWN = 1,
+    BODY_SLOT_DESPAWN = 2,
+};
+
+struct BodySlotEvent
+{
+    uint8_t type;// enum BodySlotEventType
+    uint8_t slot;
+    uint32_t bodyId;
+};
+
+struct BodySlot
+{
+    uint32_t bodyId;
+    int64_t lastSeenUsec;
+    bool active;
+};
+
+struct BodySlotTable
+{
+    int64_t gracePeriodUsec;
+
+    struct BodySlot slots[MAX_BODY_SLOTS];
+
+    // hash of body id -> slot index, BODY_SLOT_NONE when empty
+    uint8_t hash[BODY_SLOT_HASH_SIZE];
+
+    // FIFO of free slot indices
+    uint8_t freeSlots[MAX_BODY_SLOTS];
+    int freeHead;
+    int freeCount;
+
+    // events produced since the last body_slots_take_events
+    struct BodySlotEvent events[BODY_SLOT_MAX_EVENTS];
+    int eventCount;
+};
+
+void body_slots_init(struct BodySlotTable* table, int64_t grace_period_usec);
+
+// Slot of a body id, or BODY_SLOT_NONE if it has none
+uint8_t body_slots_lookup(const struct BodySlotTable* table, uint32_t body_id);
+
+// Slot of a body seen at now_usec, assigning one (and emitting a spawn event)
+// for new ids. Returns BODY_SLOT_NONE when all slots are taken.
+uint8_t body_slots_assign(struct BodySlotTable* table, uint32_t body_id, int64_t now_usec);
+
+// Free slots of bodies not seen for longer than the grace period, emitting
+// despawn events. Call once per frame after assigning the visible bodies.
+void body_slots_expire(struct BodySlotTable* table, int64_t now_usec);
+
+// Copy and clear pending events; returns the number copied
+int body_slots_take_events(struct BodySlotTable* table, struct BodySlotEvent* events, int capacity);
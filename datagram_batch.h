@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define DATAGRAM_BATCH_MAX 576        // 16 bodies x 32 text lines + events
+#define DATAGRAM_BATCH_BYTES (128 * 1024)
+
+// Datagrams of one output frame, serialized once into one buffer and then
+// sent to every destination (udp_sender.h)
+struct DatagramBatch
+{
+    uint32_t count;
+    size_t used;
+    uint32_t offsets[DATAGRAM_BATCH_MAX];
+    uint16_t sizes[DATAGRAM_BATCH_MAX];
+    uint8_t data[DATAGRAM_BATCH_BYTES];
+};
+
+static inline void datagram_batch_clear(struct DatagramBatch* batch)
+{
+    batch->count = 0;
+    batch->used = 0;
+}
+
+// Space for the next datagram of up to max_size bytes, NULL if the batch is full
+static inline uint8_t* datagram_batch_reserve(struct DatagramBatch* batch, size_t max_size)
+{
+    if (batch->count >= DATAGRAM_BATCH_MAX || batch->used + max_size > DATAGRAM_BATCH_BYTES)
+        return NULL;
+    return batch->data + batch->used;
+}
+
+// Append the datagram written into the reserved space
+static inline void datagram_batch_commit(struct DatagramBatch* batch, size_t size)
+{
+    if (size == 0)
+        return;
+    batch->offsets[batch->count] = (uint32_t)batch->used;
+    batch->sizes[batch->count] = (uint16_t)size;
+    batch->count++;
+    batch->used += size;
+}
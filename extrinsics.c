@@ -0,0 +1,659 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "extrinsics.h"
+#include "platform.h"
+
+#define MAX_RANSAC_THREADS 64
+#define SAMPLE_ATTEMPTS 16
+#define MIN_SAMPLE_AREA 20000.0f// mm^2, |cross| of a minimal sample: no near-collinear triples
+#define REFINE_STEP_MM 0.01     // refinement stops when no camera moves more
+#define REFINE_STEP_RAD 1e-6
+
+void extrinsics_default_config(struct ExtrinsicsConfig* config)
+{
+    config->maxGapUsec = 40000;
+    config->inlierMm = 60.0f;
+    config->ransacIterations = 2000;
+    config->minInliers = 200;
+    config->refineIterations = 100;
+    config->threads = 0;
+    config->seed = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Rigid transforms
+
+static struct RigidTransform rigid_identity(void)
+{
+    struct RigidTransform t = { quat_identity(), { 0.0f, 0.0f, 0.0f } };
+    return t;
+}
+
+// a after b
+static struct RigidTransform rigid_compose(const struct RigidTransform* a, const struct RigidTransform* b)
+{
+    struct RigidTransform t;
+    t.rotation = quat_normalize(quat_mul(a->rotation, b->rotation));
+    t.translation = rigid_apply(a, b->translation);
+    return t;
+}
+
+static struct RigidTransform rigid_inverse(const struct RigidTransform* a)
+{
+    struct RigidTransform t;
+    t.rotation = quat_conj(a->rotation);
+    t.translation = vec3_scale(quat_rotate(t.rotation, a->translation), -1.0f);
+    return t;
+}
+
+// Eigenvector of the largest eigenvalue of a symmetric 4x4 matrix (cyclic Jacobi)
+static void largest_eigenvector(double m[4][4], double v[4])
+{
+    double e[4][4] = { { 1, 0, 0, 0 }, { 0, 1, 0, 0 }, { 0, 0, 1, 0 }, { 0, 0, 0, 1 } };
+    for (int sweep = 0; sweep < 32; sweep++)
+    {
+        double off = 0.0;
+        for (int p = 0; p < 3; p++)
+            for (int q = p + 1; q < 4; q++)
+                off += m[p][q] * m[p][q];
+        if (off < 1e-18)
+            break;
+        for (int p = 0; p < 3; p++)
+        {
+            for (int q = p + 1; q < 4; q++)
+            {
+                if (fabs(m[p][q]) < 1e-30)
+                    continue;
+                double theta = (m[q][q] - m[p][p]) / (2.0 * m[p][q]);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+                for (int k = 0; k < 4; k++)
+                {
+                    double mkp = m[k][p], mkq = m[k][q];
+                    m[k][p] = c * mkp - s * mkq;
+                    m[k][q] = s * mkp + c * mkq;
+                }
+                for (int k = 0; k < 4; k++)
+                {
+                    double mpk = m[p][k], mqk = m[q][k];
+                    m[p][k] = c * mpk - s * mqk;
+                    m[q][k] = s * mpk + c * mqk;
+                }
+                for (int k = 0; k < 4; k++)
+                {
+                    double ekp = e[k][p], ekq = e[k][q];
+                    e[k][p] = c * ekp - s * ekq;
+                    e[k][q] = s * ekp + c * ekq;
+                }
+            }
+        }
+    }
+    int best = 0;
+    for (int i = 1; i < 4; i++)
+    {
+        if (m[i][i] > m[best][best])
+            best = i;
+    }
+    for (int k = 0; k < 4; k++)
+        v[k] = e[k][best];
+}
+
+// Horn's closed form over source[index[i]] -> target[index[i]] (all if index is NULL)
+static bool fit_indexed(const vec3_t* source, const vec3_t* target, const int* index, int count,
+                        struct RigidTransform* transform)
+{
+    if (count < 3)
+        return false;
+    double cs[3] = { 0, 0, 0 }, ct[3] = { 0, 0, 0 };
+    for (int i = 0; i < count; i++)
+    {
+        int k = index != NULL ? index[i] : i;
+        cs[0] += source[k].x; cs[1] += source[k].y; cs[2] += source[k].z;
+        ct[0] += target[k].x; ct[1] += target[k].y; ct[2] += target[k].z;
+    }
+    for (int a = 0; a < 3; a++)
+    {
+        cs[a] /= count;
+        ct[a] /= count;
+    }
+
+    double s[3][3] = { { 0 } };
+    double spread = 0.0;
+    for (int i = 0; i < count; i++)
+    {
+        int k = index != NULL ? index[i] : i;
+        double x[3] = { source[k].x - cs[0], source[k].y - cs[1], source[k].z - cs[2] };
+        double y[3] = { target[k].x - ct[0], target[k].y - ct[1], target[k].z - ct[2] };
+        for (int a = 0; a < 3; a++)
+        {
+            spread += x[a] * x[a];
+            for (int b = 0; b < 3; b++)
+                s[a][b] += x[a] * y[b];
+        }
+    }
+    if (spread < 1e-6 * count)
+        return false;
+
+    double n[4][4] = {
+        { s[0][0] + s[1][1] + s[2][2], s[1][2] - s[2][1], s[2][0] - s[0][2], s[0][1] - s[1][0] },
+        { s[1][2] - s[2][1], s[0][0] - s[1][1] - s[2][2], s[0][1] + s[1][0], s[2][0] + s[0][2] },
+        { s[2][0] - s[0][2], s[0][1] + s[1][0], -s[0][0] + s[1][1] - s[2][2], s[1][2] + s[2][1] },
+        { s[0][1] - s[1][0], s[2][0] + s[0][2], s[1][2] + s[2][1], -s[0][0] - s[1][1] + s[2][2] },
+    };
+    double q[4];
+    largest_eigenvector(n, q);
+    transform->rotation = quat_normalize(quat_make((float)q[0], (float)q[1], (float)q[2], (float)q[3]));
+    vec3_t centroid = quat_rotate(transform->rotation, vec3_make((float)cs[0], (float)cs[1], (float)cs[2]));
+    transform->translation = vec3_sub(vec3_make((float)ct[0], (float)ct[1], (float)ct[2]), centroid);
+    return true;
+}
+
+bool extrinsics_fit(const vec3_t* source, const vec3_t* target, int count, struct RigidTransform* transform)
+{
+    return fit_indexed(source, target, NULL, count, transform);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Correspondences
+
+// Joints a camera pair observed at the same time: first[i] in the first
+// camera, second[i] in the second
+struct PairData
+{
+    int a, b;
+    vec3_t* first;
+    vec3_t* second;
+    uint8_t* inlier;
+    int count;
+    int scoreIndex[EXTRINSICS_SCORE_SUBSET];
+    int scoreCount;
+};
+
+// Last observation at or before t, -1 if none
+static int find_before(const struct ExtrinsicsCamera* camera, int64_t t)
+{
+    int lo = 0, hi = camera->count - 1, found = -1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (camera->observations[mid].timeUsec <= t)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+    return found;
+}
+
+static bool collect_pair(const struct ExtrinsicsCamera* first, const struct ExtrinsicsCamera* second,
+                         int64_t max_gap_usec, uint32_t seed, struct PairData* pair)
+{
+    int capacity = first->count * SKELETON_JOINT_COUNT;
+    pair->count = 0;
+    pair->first = (vec3_t*)malloc((size_t)capacity * sizeof(vec3_t) + 1);
+    pair->second = (vec3_t*)malloc((size_t)capacity * sizeof(vec3_t) + 1);
+    pair->inlier = (uint8_t*)malloc((size_t)capacity + 1);
+    if (pair->first == NULL || pair->second == NULL || pair->inlier == NULL)
+        return false;
+
+    for (int i = 0; i < first->count; i++)
+    {
+        const struct ExtrinsicsObservation* o = &first->observations[i];
+        int k = find_before(second, o->timeUsec);
+        if (k < 0 || k + 1 >= second->count)
+            continue;
+        const struct ExtrinsicsObservation* s0 = &second->observations[k];
+        const struct ExtrinsicsObservation* s1 = &second->observations[k + 1];
+        int64_t span = s1->timeUsec - s0->timeUsec;
+        if (span <= 0 || span > max_gap_usec)
+            continue;
+        float alpha = (float)(o->timeUsec - s0->timeUsec) / (float)span;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            if (o->confidence[j] < EXTRINSICS_MIN_CONFIDENCE || s0->confidence[j] < EXTRINSICS_MIN_CONFIDENCE ||
+                s1->confidence[j] < EXTRINSICS_MIN_CONFIDENCE)
+                continue;
+            pair->first[pair->count] = o->joints[j];
+            pair->second[pair->count] = vec3_lerp(s0->joints[j], s1->joints[j], alpha);
+            pair->count++;
+        }
+    }
+
+    // hypotheses are scored on a fixed random subset, the final fit uses all
+    uint32_t rng = seed * 2654435761u + 1u;
+    pair->scoreCount = pair->count < EXTRINSICS_SCORE_SUBSET ? pair->count : EXTRINSICS_SCORE_SUBSET;
+    for (int i = 0; i < pair->scoreCount; i++)
+    {
+        rng = rng * 1664525u + 1013904223u;
+        pair->scoreIndex[i] = pair->count <= EXTRINSICS_SCORE_SUBSET ? i : (int)((rng >> 8) % (uint32_t)pair->count);
+    }
+    return true;
+}
+
+static void free_pair(struct PairData* pair)
+{
+    free(pair->first);
+    free(pair->second);
+    free(pair->inlier);
+    memset(pair, 0, sizeof(*pair));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// RANSAC
+
+struct Hypothesis
+{
+    struct RigidTransform transform;// second -> first
+    double cost;                    // truncated squared residuals on the score subset
+    bool valid;
+};
+
+struct RansacWorker
+{
+    struct PairData* pairs;
+    int pairCount;
+    int iterations;
+    float inlierMm;
+    uint32_t rng;
+    struct Hypothesis best[MAX_KINECTS * MAX_KINECTS];
+    platform_thread_t thread;
+};
+
+static uint32_t next_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static bool draw_sample(const struct PairData* pair, uint32_t* rng, int sample[3])
+{
+    for (int attempt = 0; attempt < SAMPLE_ATTEMPTS; attempt++)
+    {
+        for (int i = 0; i < 3; i++)
+            sample[i] = (int)(next_random(rng) % (uint32_t)pair->count);
+        vec3_t u = vec3_sub(pair->second[sample[1]], pair->second[sample[0]]);
+        vec3_t v = vec3_sub(pair->second[sample[2]], pair->second[sample[0]]);
+        if (vec3_length(vec3_cross(u, v)) >= MIN_SAMPLE_AREA)
+            return true;
+    }
+    return false;
+}
+
+static PLATFORM_THREAD_RETURN ransac_worker(void* param)
+{
+    struct RansacWorker* w = (struct RansacWorker*)param;
+    double threshold2 = (double)w->inlierMm * w->inlierMm;
+    for (int p = 0; p < w->pairCount; p++)
+    {
+        const struct PairData* pair = &w->pairs[p];
+        struct Hypothesis* best = &w->best[p];
+        best->valid = false;
+        if (pair->count < 3)
+            continue;
+        for (int it = 0; it < w->iterations; it++)
+        {
+            int sample[3];
+            struct RigidTransform t;
+            if (!draw_sample(pair, &w->rng, sample) || !fit_indexed(pair->second, pair->first, sample, 3, &t))
+                continue;
+
+            // MSAC: inliers cost their squared residual, outliers the threshold
+            double cost = 0.0;
+            for (int i = 0; i < pair->scoreCount && (!best->valid || cost < best->cost); i++)
+            {
+                int k = pair->scoreIndex[i];
+                vec3_t r = vec3_sub(rigid_apply(&t, pair->second[k]), pair->first[k]);
+                double d2 = (double)vec3_dot(r, r);
+                cost += d2 < threshold2 ? d2 : threshold2;
+            }
+            if (!best->valid || cost < best->cost)
+            {
+                best->transform = t;
+                best->cost = cost;
+                best->valid = true;
+            }
+        }
+    }
+    return PLATFORM_THREAD_RESULT;
+}
+
+static int mark_inliers(struct PairData* pair, const struct RigidTransform* t, float inlier_mm, double* sum2)
+{
+    double threshold2 = (double)inlier_mm * inlier_mm;
+    int inliers = 0;
+    *sum2 = 0.0;
+    for (int i = 0; i < pair->count; i++)
+    {
+        vec3_t r = vec3_sub(rigid_apply(t, pair->second[i]), pair->first[i]);
+        double d2 = (double)vec3_dot(r, r);
+        pair->inlier[i] = d2 < threshold2;
+        if (pair->inlier[i])
+        {
+            inliers++;
+            *sum2 += d2;
+        }
+    }
+    return inliers;
+}
+
+// Best hypothesis, then least squares on its inliers until they settle
+static void finish_pair(struct PairData* pair, const struct Hypothesis* best, float inlier_mm,
+                        struct ExtrinsicsPair* out)
+{
+    out->correspondences = pair->count;
+    out->inliers = 0;
+    out->rmsMm = 0.0f;
+    if (!best->valid)
+        return;
+
+    struct RigidTransform t = best->transform;
+    int* index = (int*)malloc((size_t)pair->count * sizeof(int) + 1);
+    if (index == NULL)
+        return;
+    double sum2 = 0.0;
+    int inliers = mark_inliers(pair, &t, inlier_mm, &sum2);
+    for (int round = 0; round < 4; round++)
+    {
+        int n = 0;
+        for (int i = 0; i < pair->count; i++)
+        {
+            if (pair->inlier[i])
+                index[n++] = i;
+        }
+        if (!fit_indexed(pair->second, pair->first, index, n, &t))
+            break;
+        int previous = inliers;
+        inliers = mark_inliers(pair, &t, inlier_mm, &sum2);
+        if (inliers == previous)
+            break;
+    }
+    free(index);
+
+    out->transform = t;
+    out->inliers = inliers;
+    out->rmsMm = inliers > 0 ? (float)sqrt(sum2 / inliers) : 0.0f;
+}
+
+static void run_ransac(struct PairData* pairs, int pair_count, const struct ExtrinsicsConfig* config,
+                       struct Hypothesis* best)
+{
+    int threads = config->threads > 0 ? config->threads : platform_cpu_count();
+    if (threads > MAX_RANSAC_THREADS)
+        threads = MAX_RANSAC_THREADS;
+    if (threads > config->ransacIterations)
+        threads = config->ransacIterations > 0 ? config->ransacIterations : 1;
+
+    struct RansacWorker* workers = (struct RansacWorker*)calloc((size_t)threads, sizeof(struct RansacWorker));
+    if (workers == NULL)
+        return;
+    for (int w = 0; w < threads; w++)
+    {
+        workers[w].pairs = pairs;
+        workers[w].pairCount = pair_count;
+        workers[w].iterations = config->ransacIterations / threads + (w < config->ransacIterations % threads);
+        workers[w].inlierMm = config->inlierMm;
+        workers[w].rng = (config->seed + 1u) * 2246822519u + (uint32_t)w * 3266489917u + 1u;
+    }
+    // the calling thread runs the first share itself
+    bool started[MAX_RANSAC_THREADS] = { false };
+    for (int w = 1; w < threads; w++)
+        started[w] = platform_thread_create(&workers[w].thread, ransac_worker, &workers[w]);
+    ransac_worker(&workers[0]);
+    for (int w = 1; w < threads; w++)
+    {
+        if (started[w])
+            platform_thread_join(workers[w].thread);
+        else
+            ransac_worker(&workers[w]);
+    }
+
+    for (int p = 0; p < pair_count; p++)
+    {
+        best[p].valid = false;
+        for (int w = 0; w < threads; w++)
+        {
+            const struct Hypothesis* h = &workers[w].best[p];
+            if (h->valid && (!best[p].valid || h->cost < best[p].cost))
+                best[p] = *h;
+        }
+    }
+    free(workers);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Global poses
+
+// Chain cameras to the reference through the pairs with most inliers
+static void chain_poses(struct ExtrinsicsResult* result, int count, int min_inliers)
+{
+    for (;;)
+    {
+        int best_a = -1, best_b = -1, best_inliers = min_inliers - 1;
+        for (int a = 0; a < count; a++)
+        {
+            for (int b = a + 1; b < count; b++)
+            {
+                const struct ExtrinsicsPair* pair = &result->pairs[a][b];
+                if (result->solved[a] != result->solved[b] && pair->inliers > best_inliers)
+                {
+                    best_a = a;
+                    best_b = b;
+                    best_inliers = pair->inliers;
+                }
+            }
+        }
+        if (best_a < 0)
+            break;
+
+        const struct RigidTransform* b_to_a = &result->pairs[best_a][best_b].transform;
+        if (result->solved[best_a])
+            result->poses[best_b] = rigid_compose(&result->poses[best_a], b_to_a);
+        else
+        {
+            struct RigidTransform a_to_b = rigid_inverse(b_to_a);
+            result->poses[best_a] = rigid_compose(&result->poses[best_b], &a_to_b);
+        }
+        result->solved[best_a] = result->solved[best_b] = true;
+    }
+}
+
+// Inlier correspondences of camera c with every other solved camera: c's
+// points in camera space, the other camera's in world space
+static int gather_camera(const struct ExtrinsicsResult* result, const struct PairData* pairs, int pair_count, int c,
+                         vec3_t* source, vec3_t* target)
+{
+    int n = 0;
+    for (int p = 0; p < pair_count; p++)
+    {
+        const struct PairData* pair = &pairs[p];
+        if ((pair->a != c && pair->b != c) || !result->solved[pair->a] || !result->solved[pair->b] ||
+            result->pairs[pair->a][pair->b].inliers < 3)
+            continue;
+        bool c_first = pair->a == c;
+        const struct RigidTransform* other = &result->poses[c_first ? pair->b : pair->a];
+        for (int i = 0; i < pair->count; i++)
+        {
+            if (!pair->inlier[i])
+                continue;
+            source[n] = c_first ? pair->first[i] : pair->second[i];
+            target[n] = rigid_apply(other, c_first ? pair->second[i] : pair->first[i]);
+            n++;
+        }
+    }
+    return n;
+}
+
+static int refine_poses(struct ExtrinsicsResult* result, const struct PairData* pairs, int pair_count, int count,
+                        int reference, int iterations)
+{
+    int capacity = 0;
+    for (int p = 0; p < pair_count; p++)
+        capacity += pairs[p].count;
+    vec3_t* source = (vec3_t*)malloc((size_t)capacity * sizeof(vec3_t) + 1);
+    vec3_t* target = (vec3_t*)malloc((size_t)capacity * sizeof(vec3_t) + 1);
+    int rounds = 0;
+    for (; source != NULL && target != NULL && rounds < iterations; rounds++)
+    {
+        double max_step_mm = 0.0, max_step_rad = 0.0;
+        for (int c = 0; c < count; c++)
+        {
+            if (c == reference || !result->solved[c])
+                continue;
+            int n = gather_camera(result, pairs, pair_count, c, source, target);
+            struct RigidTransform t;
+            if (!fit_indexed(source, target, NULL, n, &t))
+                continue;
+            double step_mm = vec3_length(vec3_sub(t.translation, result->poses[c].translation));
+            double step_rad = quat_angle_between(t.rotation, result->poses[c].rotation);
+            max_step_mm = step_mm > max_step_mm ? step_mm : max_step_mm;
+            max_step_rad = step_rad > max_step_rad ? step_rad : max_step_rad;
+            result->poses[c] = t;
+        }
+        if (max_step_mm < REFINE_STEP_MM && max_step_rad < REFINE_STEP_RAD)
+        {
+            rounds++;
+            break;
+        }
+    }
+
+    // residual of every camera against the others at the final poses
+    for (int c = 0; source != NULL && target != NULL && c < count; c++)
+    {
+        if (!result->solved[c])
+            continue;
+        int n = gather_camera(result, pairs, pair_count, c, source, target);
+        double sum2 = 0.0;
+        for (int i = 0; i < n; i++)
+        {
+            vec3_t r = vec3_sub(rigid_apply(&result->poses[c], source[i]), target[i]);
+            sum2 += (double)vec3_dot(r, r);
+        }
+        result->inliers[c] = n;
+        result->rmsMm[c] = n > 0 ? (float)sqrt(sum2 / n) : 0.0f;
+    }
+    free(source);
+    free(target);
+    return rounds;
+}
+
+bool extrinsics_solve(const struct ExtrinsicsCamera* cameras, int count, int reference,
+                      const struct RigidTransform* reference_pose, const struct ExtrinsicsConfig* config,
+                      struct ExtrinsicsResult* result)
+{
+    memset(result, 0, sizeof(*result));
+    if (count < 2 || count > MAX_KINECTS || reference < 0 || reference >= count)
+        return false;
+    result->cameraCount = count;
+    for (int c = 0; c < count; c++)
+        result->poses[c] = rigid_identity();
+    result->poses[reference] = reference_pose != NULL ? *reference_pose : rigid_identity();
+    result->solved[reference] = true;
+
+    struct PairData pairs[MAX_KINECTS * (MAX_KINECTS - 1) / 2];
+    struct Hypothesis best[MAX_KINECTS * (MAX_KINECTS - 1) / 2];
+    int pair_count = 0;
+    bool ok = true;
+    for (int a = 0; a < count && ok; a++)
+    {
+        for (int b = a + 1; b < count && ok; b++)
+        {
+            struct PairData* pair = &pairs[pair_count++];
+            memset(pair, 0, sizeof(*pair));
+            pair->a = a;
+            pair->b = b;
+            ok = collect_pair(&cameras[a], &cameras[b], config->maxGapUsec, config->seed + (uint32_t)pair_count,
+                              pair);
+        }
+    }
+
+    bool any = false;
+    if (ok)
+    {
+        run_ransac(pairs, pair_count, config, best);
+        for (int p = 0; p < pair_count; p++)
+        {
+            struct ExtrinsicsPair* out = &result->pairs[pairs[p].a][pairs[p].b];
+            finish_pair(&pairs[p], &best[p], config->inlierMm, out);
+            any |= out->inliers >= config->minInliers;
+            if (out->inliers < config->minInliers)
+                memset(pairs[p].inlier, 0, (size_t)pairs[p].count);
+        }
+        chain_poses(result, count, config->minInliers);
+        result->refineRounds = refine_poses(result, pairs, pair_count, count, reference, config->refineIterations);
+    }
+
+    for (int p = 0; p < pair_count; p++)
+        free_pair(&pairs[p]);
+    return ok && any;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Config file
+
+bool extrinsics_save(const char* path, const struct ExtrinsicsResult* result)
+{
+    FILE* f = fopen(path, "w");
+    if (f == NULL)
+        return false;
+    fprintf(f, "# kinect <n> <x> <y> <z> <qw> <qx> <qy> <qz>: camera -> world, mm\n");
+    for (int c = 0; c < result->cameraCount; c++)
+    {
+        if (!result->solved[c])
+        {
+            fprintf(f, "# kinect %d: not enough overlap with the other cameras\n", c);
+            continue;
+        }
+        const struct RigidTransform* t = &result->poses[c];
+        fprintf(f, "# kinect %d: %d inlier joints, rms %.1f mm\n", c, result->inliers[c], result->rmsMm[c]);
+        fprintf(f, "kinect %d %.3f %.3f %.3f %.7f %.7f %.7f %.7f\n", c, t->translation.x, t->translation.y,
+                t->translation.z, t->rotation.w, t->rotation.x, t->rotation.y, t->rotation.z);
+    }
+    bool ok = ferror(f) == 0;
+    return fclose(f) == 0 && ok;
+}
+
+int extrinsics_load(const char* path, struct RigidTransform* poses, bool* have, int max)
+{
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+    for (int c = 0; c < max; c++)
+        have[c] = false;
+
+    char line[256];
+    int read = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        char* p = line;
+        while (*p == ' ' || *p == '\t')
+            p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0')
+            continue;
+        int c;
+        float v[7];
+        if (sscanf(p, "kinect %d %f %f %f %f %f %f %f", &c, &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]) != 8 ||
+            c < 0)
+        {
+            read = -1;
+            break;
+        }
+        if (c >= max)
+            continue;
+        poses[c].translation = vec3_make(v[0], v[1], v[2]);
+        poses[c].rotation = quat_normalize(quat_make(v[3], v[4], v[5], v[6]));
+        if (!have[c])
+            read++;
+        have[c] = true;
+    }
+    fclose(f);
+    return read;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+
+// Extrinsic calibration of several Kinects from one person walking through
+// the overlap of their views. Every camera contributes camera-space skeletons
+// (mm) of frames where it saw exactly one body.
+//
+// For each camera pair the skeletons of one camera are interpolated to the
+// capture times of the other, and joints both observed with at least medium
+// confidence become 3D correspondences. The rigid transform of the pair
+// comes from RANSAC over minimal 3-point samples, each solved in closed form
+// with Horn's quaternion method (Kabsch without the SVD). The hypotheses are
+// scored on a fixed subset of the correspondences and spread over all cores.
+// The pairs with most inliers chain every camera to the reference camera,
+// and a refinement then re-solves each camera against all the others in turn
+// (block coordinate descent on the summed squared distance of all inlier
+// correspondences) until the poses settle.
+//
+// The result is a text file with one "kinect <n> x y z qw qx qy qz" line per
+// camera (mm, camera -> world) that the tracker loads with --extrinsics.
+
+#define EXTRINSICS_MIN_CONFIDENCE CONFIDENCE_MEDIUM
+#define EXTRINSICS_SCORE_SUBSET 4096// correspondences RANSAC hypotheses are scored on
+
+struct RigidTransform
+{
+    quat_t rotation;   // source -> target
+    vec3_t translation;// mm
+};
+
+// One single-body skeleton of one camera, in camera space
+struct ExtrinsicsObservation
+{
+    int64_t timeUsec;
+    vec3_t joints[SKELETON_JOINT_COUNT];// mm
+    uint8_t confidence[SKELETON_JOINT_COUNT];
+};
+
+// Observations of one camera, in time order
+struct ExtrinsicsCamera
+{
+    const struct ExtrinsicsObservation* observations;
+    int count;
+};
+
+struct ExtrinsicsConfig
+{
+    int64_t maxGapUsec;  // interpolate only between observations this close
+    float inlierMm;      // correspondence residual of an inlier
+    int ransacIterations;// per pair
+    int minInliers;      // a pair with fewer does not link its cameras
+    int refineIterations;
+    int threads;         // 0 = every core
+    uint32_t seed;
+};
+
+struct ExtrinsicsPair
+{
+    int correspondences;
+    int inliers;
+    float rmsMm;                    // of the inliers
+    struct RigidTransform transform;// second camera -> first camera
+};
+
+struct ExtrinsicsResult
+{
+    int cameraCount;
+    struct RigidTransform poses[MAX_KINECTS];// camera -> world
+    bool solved[MAX_KINECTS];
+    float rmsMm[MAX_KINECTS];  // inlier residual against the other cameras
+    int inliers[MAX_KINECTS];
+    struct ExtrinsicsPair pairs[MAX_KINECTS][MAX_KINECTS];// [a][b], a < b
+    int refineRounds;
+};
+
+void extrinsics_default_config(struct ExtrinsicsConfig* config);
+
+// Solve the pose of every camera; reference keeps reference_pose (identity
+// if NULL). Returns false if not even one pair could be solved; cameras
+// without enough overlap with the others stay unsolved.
+bool extrinsics_solve(const struct ExtrinsicsCamera* cameras, int count, int reference,
+                      const struct RigidTransform* reference_pose, const struct ExtrinsicsConfig* config,
+                      struct ExtrinsicsResult* result);
+
+// Closed-form least-squares rigid transform mapping source points onto
+// target points (Horn); false if the points are degenerate
+bool extrinsics_fit(const vec3_t* source, const vec3_t* target, int count, struct RigidTransform* transform);
+
+static inline vec3_t rigid_apply(const struct RigidTransform* t, vec3_t p)
+{
+    return vec3_add(quat_rotate(t->rotation, p), t->translation);
+}
+
+// Write the solved cameras; false on an I/O error
+bool extrinsics_save(const char* path, const struct ExtrinsicsResult* result);
+
+// Read a file written by extrinsics_save: poses[n] and have[n] for every
+// "kinect <n>" line below max. Returns the number of cameras read, or -1 if
+// the file can not be read or has a malformed line.
+int extrinsics_load(const char* path, struct RigidTransform* poses, bool* have, int max);
@@ -0,0 +1,27 @@
+#include <stdio.h>
+#include <string.h>
+#include "frame_budget.h"
+
+void frame_budget_init(struct FrameBudgetStats* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    latency_stats_init(&stats->resultAge, "frame age");
+    latency_stats_init(&stats->droppedAge, "dropped frame age");
+}
+
+void frame_budget_report(struct FrameBudgetStats* stats, const char* name, int64_t now_usec, int64_t interval_usec)
+{
+    if (now_usec - stats->lastReportUsec < interval_usec)
+        return;
+    if (stats->lastReportUsec != 0)
+    {
+        printf("%s frames: %llu captured, %llu processed, dropped %llu captures, %llu superseded, %llu stale\n",
+               name, (unsigned long long)stats->captures, (unsigned long long)stats->processed,
+               (unsigned long long)stats->capturesDropped, (unsigned long long)stats->resultsSuperseded,
+               (unsigned long long)stats->resultsStale);
+        latency_stats_print(&stats->resultAge);
+        latency_stats_print(&stats->droppedAge);
+    }
+    frame_budget_init(stats);
+    stats->lastReportUsec = now_usec;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdint.h>
+#include "latency_stats.h"
+
+// Accounting of the capture -> tracker -> output pipeline under a latency
+// budget. Captures and body frames that would only add latency are dropped
+// on purpose; these counters make the trade of freshness for completeness
+// visible.
+
+struct FrameBudgetStats
+{
+    uint64_t captures;         // read from the device
+    uint64_t capturesDropped;  // replaced by a newer capture before the tracker took them
+    uint64_t resultsSuperseded;// a newer body frame was already available
+    uint64_t resultsStale;     // older than the age budget
+    uint64_t processed;
+
+    struct LatencyStats resultAge; // capture to processing, processed frames
+    struct LatencyStats droppedAge;// capture to discard, dropped body frames
+    int64_t lastReportUsec;
+};
+
+void frame_budget_init(struct FrameBudgetStats* stats);
+
+// Print and reset the statistics every interval_usec, prefixed with name
+void frame_budget_report(struct FrameBudgetStats* stats, const char* name, int64_t now_usec, int64_t interval_usec);
@@ -0,0 +1,45 @@
+#include <string.h>
+#include "frame_merge.h"
+
+void frame_merge_init(struct FrameMerge* m, int64_t max_age_usec)
+{
+    memset(m, 0, sizeof(*m));
+    m->maxAgeUsec = max_age_usec;
+}
+
+static void copy_body(const struct SkeletonFrame* from, uint32_t b, struct SkeletonFrame* to, uint32_t out)
+{
+    to->bodyIds[out] = from->bodyIds[b];
+    to->slots[out] = from->slots[b];
+    to->cameraPositions[out] = from->cameraPositions[b];
+    memcpy(to->positions[out], from->positions[b], sizeof(from->positions[b]));
+    memcpy(to->worldRotations[out], from->worldRotations[b], sizeof(from->worldRotations[b]));
+    memcpy(to->localRotations[out], from->localRotations[b], sizeof(from->localRotations[b]));
+    memcpy(to->confidence[out], from->confidence[b], sizeof(from->confidence[b]));
+}
+
+void frame_merge_push(struct FrameMerge* m, int source, const struct SkeletonFrame* frame,
+                      struct SkeletonFrame* out)
+{
+    if (source >= 0 && source < MAX_KINECTS)
+    {
+        struct SkeletonFrame* latest = &m->latest[source];
+        latest->timestampUsec = frame->timestampUsec;
+        latest->bodyCount = 0;
+        for (uint32_t b = 0; b < frame->bodyCount; b++)
+            copy_body(frame, b, latest, latest->bodyCount++);
+        m->have[source] = true;
+    }
+
+    out->frameNumber = ++m->outputFrames;
+    out->timestampUsec = frame->timestampUsec;
+    out->bodyCount = 0;
+    for (int s = 0; s < MAX_KINECTS; s++)
+    {
+        const struct SkeletonFrame* latest = &m->latest[s];
+        if (!m->have[s] || frame->timestampUsec - latest->timestampUsec > m->maxAgeUsec)
+            continue;
+        for (uint32_t b = 0; b < latest->bodyCount && out->bodyCount < MAX_FRAME_BODIES; b++)
+            copy_body(latest, b, out, out->bodyCount++);
+    }
+}
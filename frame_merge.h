@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+
+// Output frames from several Kinect pipelines for the direct (unscheduled)
+// output path. Every source frame produces one output frame holding the
+// newest bodies of each source that reported within maxAgeUsec, so a
+// receiver always gets the whole stage; bodies of the other sources stay
+// where they were last seen. The fixed-rate scheduler needs none of this, it
+// interpolates every slot from its own samples.
+
+#define FRAME_MERGE_DEFAULT_MAX_AGE_USEC 100000
+
+struct FrameMerge
+{
+    int64_t maxAgeUsec;
+    uint32_t outputFrames;
+    bool have[MAX_KINECTS];
+    struct SkeletonFrame latest[MAX_KINECTS];
+};
+
+void frame_merge_init(struct FrameMerge* merge, int64_t max_age_usec);
+
+// Store the frame of one source and compose out from the newest frame of
+// every source. out gets the next output frame number and the timestamp of
+// frame; bodies beyond MAX_FRAME_BODIES are left out.
+void frame_merge_push(struct FrameMerge* merge, int source, const struct SkeletonFrame* frame,
+                      struct SkeletonFrame* out);
@@ -0,0 +1,541 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gesture_events.h"
+#include "platform.h"
+
+#define GESTURE_LINE_MAX 1024
+#define GESTURE_DEFAULT_SPEED_WINDOW_USEC 200000
+#define DEG_TO_RAD 0.017453293f
+
+void gesture_default_config(struct GestureConfig* config)
+{
+    config->lostUsec = 500000;
+}
+
+void gesture_engine_init(struct GestureEngine* engine, const struct GestureConfig* config)
+{
+    memset(engine, 0, sizeof(*engine));
+    if (config != NULL)
+        engine->config = *config;
+    else
+        gesture_default_config(&engine->config);
+    latency_stats_init(&engine->updateTime, "gesture update");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Definitions
+
+static float clamp(float v, float lo, float hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+// Monotonic stand-in of a measure value that the lanes can compute without
+// acos or sqrt: x|x| of the cosine or sine for angles, squares for lengths
+static float measure_key(uint8_t measure, float value)
+{
+    switch (measure)
+    {
+    case GESTURE_DISTANCE:
+    case GESTURE_SPEED:
+        value = value < 0.0f ? 0.0f : value;
+        return value * value;
+    case GESTURE_ANGLE:
+    case GESTURE_POINTING:
+    {
+        float c = cosf(clamp(value, 0.0f, 180.0f) * DEG_TO_RAD);
+        return -c * fabsf(c);// grows with the angle
+    }
+    case GESTURE_ELEVATION:
+    {
+        float s = sinf(clamp(value, -90.0f, 90.0f) * DEG_TO_RAD);
+        return s * fabsf(s);
+    }
+    default:
+        return value;
+    }
+}
+
+static int measure_joints(uint8_t measure)
+{
+    switch (measure)
+    {
+    case GESTURE_ANGLE:
+        return 3;
+    case GESTURE_SPEED:
+        return 1;
+    default:
+        return 2;
+    }
+}
+
+bool gesture_engine_add(struct GestureEngine* e, uint16_t id, int64_t hold_usec, int64_t release_usec)
+{
+    if (e->gestureCount == GESTURE_MAX_GESTURES || hold_usec < 0 || release_usec < 0)
+        return false;
+    struct Gesture* g = &e->gestures[e->gestureCount++];
+    g->id = id;
+    g->holdUsec = hold_usec;
+    g->releaseUsec = release_usec;
+    g->firstCondition = e->conditionCount;
+    g->conditionCount = 0;
+    return true;
+}
+
+bool gesture_engine_add_condition(struct GestureEngine* e, const struct GestureCondition* condition)
+{
+    if (e->gestureCount == 0 || e->conditionCount == GESTURE_MAX_CONDITIONS || condition->measure > GESTURE_SPEED ||
+        condition->margin < 0.0f || (condition->measure == GESTURE_SPEED && condition->windowUsec <= 0))
+        return false;
+    int joints = measure_joints(condition->measure);
+    for (int i = 0; i < joints; i++)
+    {
+        if (condition->joints[i] < 0 || condition->joints[i] >= SKELETON_JOINT_COUNT)
+            return false;
+    }
+
+    struct GestureCondition* c = &e->conditions[e->conditionCount++];
+    *c = *condition;
+    // unused joints repeat joint a, so the lanes can read three of them
+    for (int i = joints; i < 3; i++)
+        c->joints[i] = c->joints[0];
+    c->sign = c->greater ? 1.0f : -1.0f;
+    c->enterKey = c->sign * measure_key(c->measure, c->threshold);
+    c->stayKey = c->sign * measure_key(c->measure, c->threshold - c->sign * c->margin);
+    for (int i = 0; i < joints; i++)
+        e->jointMask |= 1u << c->joints[i];
+    e->gestures[e->gestureCount - 1].conditionCount++;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Bodies
+
+static void emit(struct GestureEngine* e, uint8_t type, uint16_t id, uint32_t body_id)
+{
+    if (e->eventCount == GESTURE_MAX_EVENTS)
+    {
+        e->dropped++;
+        return;
+    }
+    struct GestureEvent* event = &e->events[e->eventCount++];
+    event->type = type;
+    event->id = id;
+    event->bodyId = body_id;
+    e->emitted++;
+}
+
+static struct GestureBody* find_body(struct GestureEngine* e, uint32_t body_id)
+{
+    struct GestureBody* free_body = NULL;
+    for (int i = 0; i < GESTURE_MAX_BODIES; i++)
+    {
+        struct GestureBody* body = &e->bodies[i];
+        if (body->active && body->bodyId == body_id)
+            return body;
+        if (!body->active && free_body == NULL)
+            free_body = body;
+    }
+    if (free_body != NULL)
+    {
+        free_body->active = true;
+        free_body->bodyId = body_id;
+        free_body->started = 0;
+        free_body->pending = 0;
+        free_body->samples = 0;
+        memset(free_body->conditions, 0, sizeof(free_body->conditions));
+    }
+    return free_body;
+}
+
+// New sample of body b into the body's window and the joints of lane i
+static void gather(struct GestureEngine* e, struct GestureBody* body, int i, const struct SkeletonFrame* frame,
+                   uint32_t b)
+{
+    body->lastSeenUsec = frame->timestampUsec;
+    body->head = (body->head + 1) % GESTURE_WINDOW;
+    body->times[body->head] = frame->timestampUsec;
+    memcpy(body->joints[body->head], frame->positions[b], sizeof(body->joints[0]));
+    if (body->samples < GESTURE_WINDOW)
+        body->samples++;
+
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        if (!(e->jointMask & (1u << j)))
+            continue;
+        e->x[j][i] = frame->positions[b][j].x;
+        e->y[j][i] = frame->positions[b][j].y;
+        e->z[j][i] = frame->positions[b][j].z;
+        e->seen[j][i] = frame->confidence[b][j] != CONFIDENCE_NONE;
+    }
+}
+
+// Start of a speed window for every lane: the newest sample at least the
+// window old, or the oldest one if it covers half the window
+static void gather_past(struct GestureEngine* e, const struct GestureCondition* c, struct GestureBody** lanes,
+                        int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        const struct GestureBody* body = lanes[i];
+        int64_t now = body->times[body->head];
+        int k = 1;
+        while (k < body->samples - 1 && now - body->times[(body->head - k + GESTURE_WINDOW) % GESTURE_WINDOW] <
+                                            c->windowUsec)
+            k++;
+        int index = (body->head - k + GESTURE_WINDOW) % GESTURE_WINDOW;
+        int64_t age = now - body->times[index];
+        bool usable = k < body->samples && age > 0 && age * 2 >= c->windowUsec;
+        vec3_t p = body->joints[index][c->joints[0]];
+        e->past[0][i] = p.x;
+        e->past[1][i] = p.y;
+        e->past[2][i] = p.z;
+        e->pastRate[i] = usable ? 1e6f / (float)age : 0.0f;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Evaluation
+
+// One condition over all lanes, in and out of e->state. Every lane runs the
+// same arithmetic; lanes beyond the batch compute garbage nobody reads.
+static void evaluate_condition(struct GestureEngine* e, const struct GestureCondition* c)
+{
+    const float* ax = e->x[c->joints[0]];
+    const float* ay = e->y[c->joints[0]];
+    const float* az = e->z[c->joints[0]];
+    const float* bx = e->x[c->joints[1]];
+    const float* by = e->y[c->joints[1]];
+    const float* bz = e->z[c->joints[1]];
+    float key[GESTURE_LANES];
+    int32_t valid[GESTURE_LANES];
+    for (int i = 0; i < GESTURE_LANES; i++)
+        valid[i] = e->seen[c->joints[0]][i] & e->seen[c->joints[1]][i] & e->seen[c->joints[2]][i];
+
+    switch (c->measure)
+    {
+    case GESTURE_HEIGHT:
+    default:
+        for (int i = 0; i < GESTURE_LANES; i++)
+            key[i] = az[i] - bz[i];
+        break;
+    case GESTURE_DISTANCE:
+        for (int i = 0; i < GESTURE_LANES; i++)
+        {
+            float dx = bx[i] - ax[i], dy = by[i] - ay[i], dz = bz[i] - az[i];
+            key[i] = dx * dx + dy * dy + dz * dz;
+        }
+        break;
+    case GESTURE_ANGLE:
+    {
+        const float* cx = e->x[c->joints[2]];
+        const float* cy = e->y[c->joints[2]];
+        const float* cz = e->z[c->joints[2]];
+        for (int i = 0; i < GESTURE_LANES; i++)
+        {
+            float ux = ax[i] - bx[i], uy = ay[i] - by[i], uz = az[i] - bz[i];
+            float vx = cx[i] - bx[i], vy = cy[i] - by[i], vz = cz[i] - bz[i];
+            float dot = ux * vx + uy * vy + uz * vz;
+            float norms = (ux * ux + uy * uy + uz * uz) * (vx * vx + vy * vy + vz * vz);
+            key[i] = -dot * fabsf(dot) / (norms + 1e-6f);
+        }
+        break;
+    }
+    case GESTURE_ELEVATION:
+        for (int i = 0; i < GESTURE_LANES; i++)
+        {
+            float dx = bx[i] - ax[i], dy = by[i] - ay[i], dz = bz[i] - az[i];
+            key[i] = dz * fabsf(dz) / (dx * dx + dy * dy + dz * dz + 1e-6f);
+        }
+        break;
+    case GESTURE_POINTING:
+    {
+        float tx = c->target[0], ty = c->target[1], tz = c->target[2];
+        for (int i = 0; i < GESTURE_LANES; i++)
+        {
+            float ux = bx[i] - ax[i], uy = by[i] - ay[i], uz = bz[i] - az[i];
+            float vx = tx - bx[i], vy = ty - by[i], vz = tz - bz[i];
+            float dot = ux * vx + uy * vy + uz * vz;
+            float norms = (ux * ux + uy * uy + uz * uz) * (vx * vx + vy * vy + vz * vz);
+            key[i] = -dot * fabsf(dot) / (norms + 1e-6f);
+        }
+        break;
+    }
+    case GESTURE_SPEED:
+    {
+        const float* px = e->past[0];
+        const float* py = e->past[1];
+        const float* pz = e->past[2];
+        const float* rate = e->pastRate;
+        for (int i = 0; i < GESTURE_LANES; i++)
+        {
+            float dx = ax[i] - px[i], dy = ay[i] - py[i], dz = az[i] - pz[i];
+            key[i] = (dx * dx + dy * dy + dz * dz) * rate[i] * rate[i];
+            valid[i] &= rate[i] > 0.0f;
+        }
+        break;
+    }
+    }
+
+    // select by arithmetic: a conditional here keeps the loop scalar
+    float sign = c->sign, enter = c->enterKey, hysteresis = c->stayKey - c->enterKey;
+    for (int i = 0; i < GESTURE_LANES; i++)
+    {
+        int32_t was = e->state[i];
+        int32_t on = sign * key[i] > enter + (float)was * hysteresis;
+        e->state[i] = (on & valid[i]) | (was & (valid[i] ^ 1));
+    }
+}
+
+// Hold and release timing of gesture g of one body
+static void update_gesture(struct GestureEngine* e, int g, struct GestureBody* body, bool all, int64_t now_usec)
+{
+    const struct Gesture* gesture = &e->gestures[g];
+    uint64_t bit = 1ull << g;
+    bool started = (body->started & bit) != 0;
+    if (all == started)
+    {
+        body->pending &= ~bit;
+        return;
+    }
+    if (!(body->pending & bit))
+    {
+        body->pending |= bit;
+        body->pendingUsec[g] = now_usec;
+    }
+    if (now_usec - body->pendingUsec[g] < (started ? gesture->releaseUsec : gesture->holdUsec))
+        return;
+    body->started ^= bit;
+    body->pending &= ~bit;
+    emit(e, started ? GESTURE_END : GESTURE_START, gesture->id, body->bodyId);
+}
+
+static void evaluate(struct GestureEngine* e, struct GestureBody** lanes, int count, int64_t now_usec)
+{
+    for (int g = 0; g < e->gestureCount; g++)
+    {
+        const struct Gesture* gesture = &e->gestures[g];
+        for (int i = 0; i < GESTURE_LANES; i++)
+            e->all[i] = 1;
+        for (int k = 0; k < gesture->conditionCount; k++)
+        {
+            int c = gesture->firstCondition + k;
+            const struct GestureCondition* condition = &e->conditions[c];
+            for (int i = 0; i < count; i++)
+                e->state[i] = lanes[i]->conditions[c];
+            if (condition->measure == GESTURE_SPEED)
+                gather_past(e, condition, lanes, count);
+            evaluate_condition(e, condition);
+            for (int i = 0; i < count; i++)
+            {
+                lanes[i]->conditions[c] = e->state[i];
+                e->all[i] &= e->state[i];
+            }
+        }
+        for (int i = 0; i < count; i++)
+            update_gesture(e, g, lanes[i], e->all[i] != 0, now_usec);
+    }
+}
+
+// Bodies not seen for lostUsec end their gestures
+static void expire_bodies(struct GestureEngine* e, int64_t now_usec)
+{
+    for (int i = 0; i < GESTURE_MAX_BODIES; i++)
+    {
+        struct GestureBody* body = &e->bodies[i];
+        if (!body->active || now_usec - body->lastSeenUsec <= e->config.lostUsec)
+            continue;
+        for (int g = 0; g < e->gestureCount; g++)
+        {
+            if (body->started & (1ull << g))
+                emit(e, GESTURE_END, e->gestures[g].id, body->bodyId);
+        }
+        body->active = false;
+    }
+}
+
+void gesture_engine_update(struct GestureEngine* e, const struct SkeletonFrame* frame)
+{
+    int64_t start_usec = monotonic_usec();
+
+    for (uint32_t first = 0; first < frame->bodyCount; first += GESTURE_LANES)
+    {
+        struct GestureBody* lanes[GESTURE_LANES];
+        int count = 0;
+        for (uint32_t b = first; b < frame->bodyCount && b < first + GESTURE_LANES; b++)
+        {
+            struct GestureBody* body = find_body(e, frame->bodyIds[b]);
+            if (body == NULL)
+            {
+                e->dropped++;
+                continue;
+            }
+            gather(e, body, count, frame, b);
+            lanes[count++] = body;
+        }
+        evaluate(e, lanes, count, frame->timestampUsec);
+    }
+    expire_bodies(e, frame->timestampUsec);
+
+    e->updates++;
+    latency_stats_add(&e->updateTime, monotonic_usec() - start_usec);
+}
+
+int gesture_engine_take_events(struct GestureEngine* e, struct GestureEvent* events, int max)
+{
+    int count = e->eventCount < max ? e->eventCount : max;
+    memcpy(events, e->events, (size_t)count * sizeof(events[0]));
+    memmove(e->events, e->events + count, (size_t)(e->eventCount - count) * sizeof(events[0]));
+    e->eventCount -= count;
+    return count;
+}
+
+void gesture_engine_report(struct GestureEngine* e, int64_t now_usec, int64_t interval_usec)
+{
+    if (now_usec - e->lastReportUsec < interval_usec)
+        return;
+    if (e->lastReportUsec != 0 && e->updates > 0)
+    {
+        printf("gestures: %llu updates, %llu events, %llu dropped\n", (unsigned long long)e->updates,
+               (unsigned long long)e->emitted, (unsigned long long)e->dropped);
+        latency_stats_print(&e->updateTime);
+    }
+    e->updates = 0;
+    e->emitted = 0;
+    e->dropped = 0;
+    latency_stats_reset(&e->updateTime);
+    e->lastReportUsec = now_usec;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gesture file
+
+static const char* measure_names[] = { "height", "distance", "angle", "elevation", "pointing", "speed" };
+
+static bool parse_joint(const char* token, int8_t* joint)
+{
+    if (token == NULL)
+        return false;
+    char* end;
+    long j = strtol(token, &end, 10);
+    if (*token == '\0' || *end != '\0' || j < 0 || j >= SKELETON_JOINT_COUNT)
+        return false;
+    *joint = (int8_t)j;
+    return true;
+}
+
+static bool parse_float(const char* token, float* v)
+{
+    if (token == NULL)
+        return false;
+    char* end;
+    *v = strtof(token, &end);
+    return *token != '\0' && *end == '\0';
+}
+
+static bool parse_ms(const char* token, int64_t* usec)
+{
+    float ms;
+    if (!parse_float(token, &ms) || ms < 0.0f)
+        return false;
+    *usec = (int64_t)(ms * 1000.0f);
+    return true;
+}
+
+static bool parse_gesture(struct GestureEngine* e, const char* separators)
+{
+    char* id_token = strtok(NULL, separators);
+    if (id_token == NULL)
+        return false;
+    char* end;
+    long id = strtol(id_token, &end, 10);
+    if (*end != '\0' || id < 0 || id > 0xFFFF)
+        return false;
+
+    int64_t hold = 0, release = 0;
+    char* token;
+    while ((token = strtok(NULL, separators)) != NULL)
+    {
+        if (strcmp(token, "hold") == 0 && parse_ms(strtok(NULL, separators), &hold))
+            continue;
+        if (strcmp(token, "release") == 0 && parse_ms(strtok(NULL, separators), &release))
+            continue;
+        return false;
+    }
+    return gesture_engine_add(e, (uint16_t)id, hold, release);
+}
+
+static bool parse_condition(struct GestureEngine* e, const char* kind, const char* separators)
+{
+    struct GestureCondition c;
+    memset(&c, 0, sizeof(c));
+    c.measure = 0xFF;
+    for (uint8_t m = 0; m < sizeof(measure_names) / sizeof(measure_names[0]); m++)
+    {
+        if (strcmp(kind, measure_names[m]) == 0)
+            c.measure = m;
+    }
+    if (c.measure == 0xFF)
+        return false;
+
+    int joints = measure_joints(c.measure);
+    for (int i = 0; i < joints; i++)
+    {
+        if (!parse_joint(strtok(NULL, separators), &c.joints[i]))
+            return false;
+    }
+    if (c.measure == GESTURE_POINTING)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            if (!parse_float(strtok(NULL, separators), &c.target[i]))
+                return false;
+        }
+    }
+
+    char* op = strtok(NULL, separators);
+    c.windowUsec = GESTURE_DEFAULT_SPEED_WINDOW_USEC;
+    if (c.measure == GESTURE_SPEED && op != NULL && strcmp(op, "<") != 0 && strcmp(op, ">") != 0)
+    {
+        if (!parse_ms(op, &c.windowUsec))
+            return false;
+        op = strtok(NULL, separators);
+    }
+    if (op == NULL || (strcmp(op, "<") != 0 && strcmp(op, ">") != 0))
+        return false;
+    c.greater = op[0] == '>';
+    if (!parse_float(strtok(NULL, separators), &c.threshold))
+        return false;
+    char* margin = strtok(NULL, separators);
+    if (margin != NULL && !parse_float(margin, &c.margin))
+        return false;
+    return strtok(NULL, separators) == NULL && gesture_engine_add_condition(e, &c);
+}
+
+int gesture_engine_load(struct GestureEngine* e, const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+
+    static const char* separators = " \t\r\n";
+    char line[GESTURE_LINE_MAX];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f) != NULL)
+    {
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        char* kind = strtok(line, separators);
+        if (kind == NULL)
+            continue;
+        if (strcmp(kind, "gesture") == 0)
+            ok = parse_gesture(e, separators);
+        else
+            ok = parse_condition(e, kind, separators);
+    }
+    fclose(f);
+    return ok ? e->gestureCount : -1;
+}
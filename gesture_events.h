@@ -0,0 +1,168 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+#include "latency_stats.h"
+
+// Gesture and posture rules evaluated in the tracker, so receivers that only
+// want "hand raised", "pointing at the screen" or "crouching" get a start
+// and an end event instead of the pose stream.
+//
+// A gesture is a list of conditions on one body that must all hold for
+// holdUsec before it starts; it ends once they have not all held for
+// releaseUsec. A condition compares one measure of the body with a
+// threshold, with its own hysteresis: it turns true past the threshold and
+// false only once the measure is back by more than its margin. While one of
+// its joints is out of range (CONFIDENCE_NONE) a condition keeps its state.
+// Measures, in world space, mm, z up as the Marvelmind world:
+//   height a b             z of joint a above joint b, mm
+//   distance a b           between joints a and b, mm
+//   angle a b c            at joint b between b->a and b->c, degrees
+//   elevation a b          of the direction a->b above the floor plane, degrees
+//   pointing a b x y z     between the direction a->b and b->(x, y, z), degrees
+//   speed a [ms]           of joint a over the last ms (default 200), mm/s
+// Every tracked body keeps its last GESTURE_WINDOW samples for the speeds.
+//
+// Bodies of a frame are evaluated side by side: their joints are gathered
+// into arrays of GESTURE_LANES bodies and every condition runs as one loop
+// over the lanes with no branches, comparing the measure in a form that
+// needs no acos (the cosine for angles, squares for distances and speeds).
+// Bodies are tracked by id; bodies not seen for lostUsec end their gestures.
+//
+// Gesture file, one definition per line ('#' starts a comment); condition
+// lines belong to the gesture line above them:
+//   gesture <id> [hold <ms>] [release <ms>]
+//   <measure> <joints and arguments> <|> <threshold> [<margin>]
+// Joints are k4abt joint indices. Gesture ids are the ids events carry.
+
+#define GESTURE_MAX_GESTURES 64
+#define GESTURE_MAX_CONDITIONS 256
+#define GESTURE_MAX_BODIES 64        // tracked at a time
+#define GESTURE_MAX_EVENTS 1024      // per update
+#define GESTURE_WINDOW 32            // samples kept per body
+#define GESTURE_LANES MAX_FRAME_BODIES
+
+enum GestureEventType
+{
+    GESTURE_START = 1,
+    GESTURE_END = 2,
+};
+
+struct GestureEvent
+{
+    uint8_t type;// enum GestureEventType
+    uint16_t id; // gesture id
+    uint32_t bodyId;
+};
+
+enum GestureMeasure
+{
+    GESTURE_HEIGHT,
+    GESTURE_DISTANCE,
+    GESTURE_ANGLE,
+    GESTURE_ELEVATION,
+    GESTURE_POINTING,
+    GESTURE_SPEED,
+};
+
+struct GestureCondition
+{
+    uint8_t measure;    // enum GestureMeasure
+    int8_t joints[3];   // a, b, c as the measure uses them
+    float target[3];    // GESTURE_POINTING, mm
+    int64_t windowUsec; // GESTURE_SPEED
+    bool greater;       // measure > threshold, else measure < threshold
+    float threshold;    // mm, degrees or mm/s
+    float margin;       // back by this much to turn false
+
+    // set by gesture_engine_add_condition: sign * measure key compared
+    // against the keys of the threshold and of the threshold minus margin
+    float sign;
+    float enterKey;
+    float stayKey;
+};
+
+struct Gesture
+{
+    uint16_t id;
+    int64_t holdUsec;
+    int64_t releaseUsec;
+    int firstCondition;
+    int conditionCount;
+};
+
+struct GestureBody
+{
+    uint32_t bodyId;
+    bool active;
+    int64_t lastSeenUsec;
+    uint64_t started;                       // bit per gesture
+    uint64_t pending;                       // bit per gesture whose conditions changed
+    int64_t pendingUsec[GESTURE_MAX_GESTURES];// since when
+    uint8_t conditions[GESTURE_MAX_CONDITIONS];// hysteresis state
+
+    // sliding window of samples, newest at head
+    int64_t times[GESTURE_WINDOW];
+    vec3_t joints[GESTURE_WINDOW][SKELETON_JOINT_COUNT];
+    int head;
+    int samples;
+};
+
+struct GestureConfig
+{
+    int64_t lostUsec;// a body not seen this long ends its gestures
+};
+
+struct GestureEngine
+{
+    struct GestureConfig config;
+
+    struct Gesture gestures[GESTURE_MAX_GESTURES];
+    int gestureCount;
+    struct GestureCondition conditions[GESTURE_MAX_CONDITIONS];
+    int conditionCount;
+    uint32_t jointMask;// joints any condition reads
+
+    struct GestureBody bodies[GESTURE_MAX_BODIES];
+
+    // lanes of one batch of bodies
+    float x[SKELETON_JOINT_COUNT][GESTURE_LANES];
+    float y[SKELETON_JOINT_COUNT][GESTURE_LANES];
+    float z[SKELETON_JOINT_COUNT][GESTURE_LANES];
+    int32_t seen[SKELETON_JOINT_COUNT][GESTURE_LANES];// joint in range
+    float past[3][GESTURE_LANES];   // speed: joint position at the start of the window
+    float pastRate[GESTURE_LANES];  // and 1 / its age, 1/s (0: too few samples)
+    int32_t state[GESTURE_LANES];   // one condition, in and out
+    int32_t all[GESTURE_LANES];     // one gesture: all its conditions hold
+
+    struct GestureEvent events[GESTURE_MAX_EVENTS];
+    int eventCount;
+
+    uint64_t updates;
+    uint64_t emitted;
+    uint64_t dropped;// events beyond GESTURE_MAX_EVENTS, or bodies beyond GESTURE_MAX_BODIES
+    struct LatencyStats updateTime;// per update, us
+    int64_t lastReportUsec;
+};
+
+void gesture_default_config(struct GestureConfig* config);
+void gesture_engine_init(struct GestureEngine* engine, const struct GestureConfig* config);
+
+// Definitions; false if a table is full or the definition is invalid.
+// Conditions belong to the gesture added last.
+bool gesture_engine_add(struct GestureEngine* engine, uint16_t id, int64_t hold_usec, int64_t release_usec);
+bool gesture_engine_add_condition(struct GestureEngine* engine, const struct GestureCondition* condition);
+
+// Read a gesture file. Returns the number of gestures, or -1 if the file can
+// not be read or a line is malformed.
+int gesture_engine_load(struct GestureEngine* engine, const char* path);
+
+// Update the bodies of a world-space frame and evaluate the gestures;
+// events are queued until gesture_engine_take_events
+void gesture_engine_update(struct GestureEngine* engine, const struct SkeletonFrame* frame);
+
+// Move up to max queued events to events; returns how many
+int gesture_engine_take_events(struct GestureEngine* engine, struct GestureEvent* events, int max);
+
+// Print and reset the statistics every interval_usec
+void gesture_engine_report(struct GestureEngine* engine, int64_t now_usec, int64_t interval_usec);
@@ -0,0 +1,436 @@
+#ifndef WIN32
+#define _GNU_SOURCE // pthread_setaffinity_np
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "kinect_pipeline.h"
+#include "body_slots.h"
+
+static bool pin_thread(int cpu)
+{
+#ifdef WIN32
+    if (cpu >= 64)
+        return false;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#else
+    if (cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#endif
+}
+
+static int64_t fps_period_usec(k4a_fps_t fps)
+{
+    switch (fps)
+    {
+    case K4A_FRAMES_PER_SECOND_5:
+        return 200000;
+    case K4A_FRAMES_PER_SECOND_15:
+        return 66667;
+    default:
+        return 33333;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Sources
+
+// Device and host times of the depth image; false for captures without one
+static bool depth_times(k4a_capture_t capture, int64_t* device_usec, int64_t* system_usec)
+{
+    k4a_image_t depth = k4a_capture_get_depth_image(capture);
+    if (depth == NULL)
+        return false;
+    *device_usec = (int64_t)k4a_image_get_device_timestamp_usec(depth);
+    *system_usec = (int64_t)(k4a_image_get_system_timestamp_nsec(depth) / 1000);
+    k4a_image_release(depth);
+    return true;
+}
+
+// Next recorded capture with a depth image, back to the start at the end
+static k4a_capture_t read_recording(struct KinectPipeline* k, int64_t* device_usec)
+{
+    int rewinds = 0;
+    for (;;)
+    {
+        k4a_capture_t capture = NULL;
+        k4a_stream_result_t result = k4a_playback_get_next_capture(k->playback, &capture);
+        if (result == K4A_STREAM_RESULT_EOF && k->replayOnce)
+        {
+            k->replayEnded = true;
+            return NULL;
+        }
+        if (result == K4A_STREAM_RESULT_EOF)
+        {
+            // a second end without a capture in between: nothing playable
+            if (++rewinds > 1 ||
+                k4a_playback_seek_timestamp(k->playback, 0, K4A_PLAYBACK_SEEK_BEGIN) != K4A_RESULT_SUCCEEDED)
+                return NULL;
+            // the first capture of the next pass plays one period after the last one
+            k->replayStartUsec = k->replayNextUsec + k->replayPeriodUsec;
+            k->replayStartDeviceUsec = -1;
+            continue;
+        }
+        if (result != K4A_STREAM_RESULT_SUCCEEDED)
+            return NULL;
+
+        int64_t system_usec;
+        if (!depth_times(capture, device_usec, &system_usec))
+        {
+            k4a_capture_release(capture);
+            continue;
+        }
+        return capture;
+    }
+}
+
+// Recording captures are handed out at their recorded rate, stamped with the
+// host time they play at
+static k4a_wait_result_t next_replay_capture(struct KinectPipeline* k, k4a_capture_t* capture, int64_t* capture_usec,
+                                             int32_t wait_ms)
+{
+    if (k->replayOnce)
+    {
+        *capture = read_recording(k, capture_usec);
+        return *capture != NULL ? K4A_WAIT_RESULT_SUCCEEDED : K4A_WAIT_RESULT_FAILED;
+    }
+    if (k->replayNext == NULL)
+    {
+        int64_t device_usec;
+        k->replayNext = read_recording(k, &device_usec);
+        if (k->replayNext == NULL)
+            return K4A_WAIT_RESULT_FAILED;
+        if (k->replayStartUsec == 0)
+            k->replayStartUsec = monotonic_usec();
+        if (k->replayStartDeviceUsec < 0)
+            k->replayStartDeviceUsec = device_usec;
+        k->replayNextUsec = k->replayStartUsec + (device_usec - k->replayStartDeviceUsec);
+    }
+
+    int64_t now = monotonic_usec();
+    if (now < k->replayNextUsec)
+    {
+        int64_t wait = k->replayNextUsec - now;
+        if (wait > (int64_t)wait_ms * 1000)
+            wait = (int64_t)wait_ms * 1000;
+        if (wait > 0)
+            platform_sleep_usec(wait);
+        if (monotonic_usec() < k->replayNextUsec)
+            return K4A_WAIT_RESULT_TIMEOUT;
+    }
+    *capture = k->replayNext;
+    *capture_usec = k->replayNextUsec;
+    k->replayNext = NULL;
+    return K4A_WAIT_RESULT_SUCCEEDED;
+}
+
+static k4a_wait_result_t next_capture(struct KinectPipeline* k, k4a_capture_t* capture, int64_t* capture_usec,
+                                      int32_t wait_ms)
+{
+    if (k->playback != NULL)
+        return next_replay_capture(k, capture, capture_usec, wait_ms);
+
+    k4a_wait_result_t result = k4a_device_get_capture(k->device, capture, wait_ms);
+    int64_t device_usec;
+    if (result == K4A_WAIT_RESULT_SUCCEEDED && !depth_times(*capture, &device_usec, capture_usec))
+        *capture_usec = monotonic_usec();
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Processing
+
+static struct CameraPose camera_pose(const struct KinectPipeline* k, int64_t t_usec)
+{
+    struct CameraPose pose;
+    if (k->source.fixedPose || k->hedgePose == NULL)
+    {
+        pose.position = k->source.position;
+        pose.orientation = k->source.orientation;
+    }
+    else
+    {
+        pose = k->hedgePose(t_usec);
+        pose.position = vec3_scale(pose.position, 1000.0f);// mm
+    }
+    return pose;
+}
+
+// Move the bodies of a tracker result to world space and hand them on
+static void process_result(struct KinectPipeline* k, k4abt_frame_t body_frame, uint32_t number, int64_t frame_usec)
+{
+    struct SkeletonFrame* frame = &k->frame;
+    struct CameraPose pose = camera_pose(k, frame_usec);
+
+    frame->frameNumber = number;
+    frame->timestampUsec = frame_usec;
+    frame->bodyCount = 0;
+
+    uint32_t num_bodies = k4abt_frame_get_num_bodies(body_frame);
+    for (uint32_t i = 0; i < num_bodies && frame->bodyCount < MAX_FRAME_BODIES; i++)
+    {
+        k4abt_skeleton_t skeleton;
+        if (k4abt_frame_get_body_skeleton(body_frame, i, &skeleton) != K4A_RESULT_SUCCEEDED)
+        {
+            printf("%s: get body from body frame failed!\n", k->name);
+            continue;
+        }
+
+        uint32_t b = frame->bodyCount++;
+        for (int j = 0; j < (int)K4ABT_JOINT_COUNT; j++)
+        {
+            const k4abt_joint_t* joint = &skeleton.joints[j];
+            vec3_t position = vec3_make(joint->position.v[0], joint->position.v[1], joint->position.v[2]);
+            quat_t orientation = quat_make(joint->orientation.v[0], joint->orientation.v[1],
+                                           joint->orientation.v[2], joint->orientation.v[3]);
+            frame->positions[b][j] = vec3_add(pose.position, quat_rotate(pose.orientation, position));
+            frame->worldRotations[b][j] = quat_mul(pose.orientation, orientation);
+            frame->confidence[b][j] = (uint8_t)joint->confidence_level;
+        }
+        frame->bodyIds[b] = KINECT_BODY_ID(k->index, k4abt_frame_get_body_id(body_frame, i));
+        frame->slots[b] = BODY_SLOT_NONE;
+        frame->cameraPositions[b] = pose.position;
+    }
+
+    if (k->onFrame != NULL)
+        k->onFrame(k, frame, k->context);
+}
+
+static PLATFORM_THREAD_RETURN run(void* param)
+{
+    struct KinectPipeline* k = (struct KinectPipeline*)param;
+    if (k->cpu >= 0 && !pin_thread(k->cpu))
+        printf("%s: can not pin to CPU %d\n", k->name, k->cpu);
+
+    // Latency budget: never block indefinitely on the device or the tracker.
+    // With a max age, only the newest capture waits for the tracker and only
+    // the newest body frame younger than the budget is processed.
+    bool drop_stale = k->maxAgeUsec > 0;
+    int max_in_flight = drop_stale ? KINECT_FRESH_IN_FLIGHT : KINECT_MAX_IN_FLIGHT;
+    while (!k->stopRequested)
+    {
+        frame_budget_report(&k->budget, k->name, monotonic_usec(), 5000000);
+
+        // Newest capture from the device
+        if (k->pendingCapture == NULL || drop_stale)
+        {
+            int32_t wait_ms = (k->pendingCapture == NULL && k->inFlightCount == 0) ? KINECT_CAPTURE_WAIT_MS : 0;
+            k4a_capture_t capture;
+            int64_t capture_usec;
+            k4a_wait_result_t result = next_capture(k, &capture, &capture_usec, wait_ms);
+            if (result == K4A_WAIT_RESULT_SUCCEEDED)
+            {
+                k->captureCount++;
+                k->budget.captures++;
+                if (k->pendingCapture != NULL)
+                {
+                    // the tracker did not take the previous one in time
+                    k4a_capture_release(k->pendingCapture);
+                    k->budget.capturesDropped++;
+                }
+                k->pendingCapture = capture;
+                k->pendingNumber = k->captureCount;
+                k->pendingUsec = capture_usec;
+            }
+            else if (result == K4A_WAIT_RESULT_FAILED)
+            {
+                printf(k->replayEnded ? "%s: end of recording\n" : "%s: get depth capture failed\n", k->name);
+                break;
+            }
+        }
+
+        // Hand it to the tracker without waiting; a full queue keeps it pending
+        if (k->pendingCapture != NULL && k->inFlightCount < max_in_flight)
+        {
+            k4a_wait_result_t result = k4abt_tracker_enqueue_capture(
+                k->tracker, k->pendingCapture, (drop_stale && k->inFlightCount > 0) ? 0 : KINECT_RESULT_POLL_MS);
+            if (result == K4A_WAIT_RESULT_SUCCEEDED)
+            {
+                k4a_capture_release(k->pendingCapture);
+                k->pendingCapture = NULL;
+                struct KinectInFlight* f = &k->inFlight[(k->inFlightHead + k->inFlightCount) % KINECT_MAX_IN_FLIGHT];
+                f->number = k->pendingNumber;
+                f->captureUsec = k->pendingUsec;
+                k->inFlightCount++;
+            }
+            else if (result == K4A_WAIT_RESULT_FAILED)
+            {
+                printf("%s: add capture to tracker process queue failed!\n", k->name);
+                break;
+            }
+        }
+
+        // Newest finished body frame
+        k4abt_frame_t body_frame = NULL;
+        struct KinectInFlight body_info = { 0, 0 };
+        k4a_wait_result_t pop_result = K4A_WAIT_RESULT_TIMEOUT;
+        int32_t pop_wait_ms = KINECT_RESULT_POLL_MS;
+        while (k->inFlightCount > 0)
+        {
+            k4abt_frame_t result = NULL;
+            pop_result = k4abt_tracker_pop_result(k->tracker, &result, pop_wait_ms);
+            if (pop_result != K4A_WAIT_RESULT_SUCCEEDED)
+                break;
+
+            struct KinectInFlight info = k->inFlight[k->inFlightHead];
+            k->inFlightHead = (k->inFlightHead + 1) % KINECT_MAX_IN_FLIGHT;
+            k->inFlightCount--;
+            if (body_frame != NULL)
+            {
+                latency_stats_add(&k->budget.droppedAge, monotonic_usec() - body_info.captureUsec);
+                k->budget.resultsSuperseded++;
+                k4abt_frame_release(body_frame);
+            }
+            body_frame = result;
+            body_info = info;
+            pop_wait_ms = 0;
+            if (!drop_stale)
+                break;// process every result
+        }
+        if (pop_result == K4A_WAIT_RESULT_FAILED)
+        {
+            printf("%s: pop body frame result failed!\n", k->name);
+            if (body_frame != NULL)
+                k4abt_frame_release(body_frame);
+            break;
+        }
+        if (body_frame == NULL)
+            continue;
+
+        int64_t frame_age_usec = monotonic_usec() - body_info.captureUsec;
+        if (drop_stale && frame_age_usec > k->maxAgeUsec)
+        {
+            latency_stats_add(&k->budget.droppedAge, frame_age_usec);
+            k->budget.resultsStale++;
+            k4abt_frame_release(body_frame);
+            continue;
+        }
+        latency_stats_add(&k->budget.resultAge, frame_age_usec);
+        k->budget.processed++;
+
+        process_result(k, body_frame, body_info.number, body_info.captureUsec);
+        k4abt_frame_release(body_frame);
+    }
+
+    if (k->pendingCapture != NULL)
+    {
+        k4a_capture_release(k->pendingCapture);
+        k->pendingCapture = NULL;
+    }
+    k->finished = true;
+    return PLATFORM_THREAD_RESULT;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Lifetime
+
+bool kinect_pipeline_open(struct KinectPipeline* k, int index, const struct KinectSourceOptions* source,
+                          int cpu, int64_t max_age_usec, kinect_pose_fn hedge_pose,
+                          kinect_frame_fn on_frame, void* context)
+{
+    memset(k, 0, sizeof(*k));
+    k->index = index;
+    k->source = *source;
+    k->cpu = cpu;
+    k->maxAgeUsec = max_age_usec;
+    k->hedgePose = hedge_pose;
+    k->onFrame = on_frame;
+    k->context = context;
+    k->replayStartDeviceUsec = -1;
+    frame_budget_init(&k->budget);
+
+    k4a_calibration_t calibration;
+    if (source->device >= 0)
+    {
+        if (k4a_device_open((uint32_t)source->device, &k->device) != K4A_RESULT_SUCCEEDED)
+        {
+            printf("Kinect %d: open device %d failed!\n", index, source->device);
+            return false;
+        }
+        char serial[64] = "";
+        size_t serial_size = sizeof(serial);
+        k4a_device_get_serialnum(k->device, serial, &serial_size);
+        snprintf(k->name, sizeof(k->name), "Kinect %d (%s)", index, serial);
+
+        k4a_device_configuration_t device_config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
+        device_config.depth_mode = K4A_DEPTH_MODE_NFOV_UNBINNED;
+        if (k4a_device_start_cameras(k->device, &device_config) != K4A_RESULT_SUCCEEDED ||
+            k4a_device_get_calibration(k->device, device_config.depth_mode, K4A_COLOR_RESOLUTION_OFF,
+                                       &calibration) != K4A_RESULT_SUCCEEDED)
+        {
+            printf("%s: start cameras failed!\n", k->name);
+            kinect_pipeline_close(k);
+            return false;
+        }
+    }
+    else
+    {
+        snprintf(k->name, sizeof(k->name), "Kinect %d (%s)", index, source->recording);
+        k4a_record_configuration_t record_config;
+        if (k4a_playback_open(source->recording, &k->playback) != K4A_RESULT_SUCCEEDED ||
+            k4a_playback_get_calibration(k->playback, &calibration) != K4A_RESULT_SUCCEEDED ||
+            k4a_playback_get_record_configuration(k->playback, &record_config) != K4A_RESULT_SUCCEEDED)
+        {
+            printf("%s: open recording failed!\n", k->name);
+            kinect_pipeline_close(k);
+            return false;
+        }
+        k->replayPeriodUsec = fps_period_usec(record_config.camera_fps);
+    }
+
+    k4abt_tracker_configuration_t tracker_config = K4ABT_TRACKER_CONFIG_DEFAULT;
+    if (k4abt_tracker_create(&calibration, tracker_config, &k->tracker) != K4A_RESULT_SUCCEEDED)
+    {
+        printf("%s: body tracker initialization failed!\n", k->name);
+        kinect_pipeline_close(k);
+        return false;
+    }
+    return true;
+}
+
+bool kinect_pipeline_start(struct KinectPipeline* k)
+{
+    k->stopRequested = false;
+    k->finished = false;
+    k->running = platform_thread_create(&k->thread_, run, k);
+    return k->running;
+}
+
+void kinect_pipeline_stop(struct KinectPipeline* k)
+{
+    if (!k->running)
+        return;
+    k->stopRequested = true;
+    platform_thread_join(k->thread_);
+    k->running = false;
+}
+
+void kinect_pipeline_close(struct KinectPipeline* k)
+{
+    kinect_pipeline_stop(k);
+    if (k->tracker != NULL)
+    {
+        k4abt_tracker_shutdown(k->tracker);
+        k4abt_tracker_destroy(k->tracker);
+        k->tracker = NULL;
+    }
+    if (k->device != NULL)
+    {
+        k4a_device_stop_cameras(k->device);
+        k4a_device_close(k->device);
+        k->device = NULL;
+    }
+    if (k->replayNext != NULL)
+    {
+        k4a_capture_release(k->replayNext);
+        k->replayNext = NULL;
+    }
+    if (k->playback != NULL)
+    {
+        k4a_playback_close(k->playback);
+        k->playback = NULL;
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <k4a/k4a.h>
+#include <k4arecord/playback.h>
+#include <k4abt.h>
+#include "platform.h"
+#include "skeleton.h"
+#include "pose_filter.h"
+#include "frame_budget.h"
+#include "options.h"
+
+// One capture + body tracker pipeline per Kinect, each on its own thread with
+// its own calibration, tracker and world pose. A source is either a device or
+// a recording replayed at its recorded rate and looped, so several pipelines
+// can run without hardware.
+//
+// The thread keeps the latency budget of the single-camera loop: the newest
+// capture waits for the tracker, the newest result younger than maxAgeUsec is
+// processed. Bodies are moved to world space and handed to onFrame, which is
+// called from the pipeline thread; body ids carry the source number in their
+// top byte (KINECT_BODY_ID) so ids of different trackers never collide, and
+// slots are left for the output stage to assign.
+
+#define KINECT_CAPTURE_WAIT_MS 100      // > one camera period, short enough to stop
+#define KINECT_RESULT_POLL_MS 5         // tracker result polling while frames are in flight
+#define KINECT_FRESH_IN_FLIGHT 2        // one frame in inference, one queued
+#define KINECT_MAX_IN_FLIGHT 8
+
+struct KinectPipeline;
+
+typedef void (*kinect_frame_fn)(struct KinectPipeline* kinect, struct SkeletonFrame* frame, void* context);
+
+// World pose of a camera that follows the hedge, at a host monotonic time
+typedef struct CameraPose (*kinect_pose_fn)(int64_t t_usec);
+
+struct KinectInFlight
+{
+    uint32_t number;
+    int64_t captureUsec;// host monotonic
+};
+
+struct KinectPipeline
+{
+    int index;    // source number
+    char name[96];// serial number or recording path
+    struct KinectSourceOptions source;
+    int cpu;      // -1 = no affinity
+    int64_t maxAgeUsec;// 0 = process every frame
+    kinect_pose_fn hedgePose;// used unless source.fixedPose, NULL = level at the origin
+    kinect_frame_fn onFrame;
+    void* context;
+
+    k4a_device_t device;
+    k4a_playback_t playback;
+    k4abt_tracker_t tracker;
+
+    // set before start: play the recording once, as fast as the tracker takes
+    // it, with frames stamped in device time (offline processing)
+    bool replayOnce;
+    volatile bool replayEnded;
+
+    // replay clock: recording time replayStartDeviceUsec plays at replayStartUsec
+    int64_t replayPeriodUsec;
+    int64_t replayStartUsec;
+    int64_t replayStartDeviceUsec;
+    k4a_capture_t replayNext;// read ahead, due at replayNextUsec
+    int64_t replayNextUsec;
+
+    // pipeline thread only
+    k4a_capture_t pendingCapture;
+    uint32_t pendingNumber;
+    int64_t pendingUsec;
+    uint32_t captureCount;
+    struct KinectInFlight inFlight[KINECT_MAX_IN_FLIGHT];
+    int inFlightHead;
+    int inFlightCount;
+    struct FrameBudgetStats budget;
+    struct SkeletonFrame frame;
+
+    platform_thread_t thread_;
+    volatile bool stopRequested;
+    volatile bool finished;// stopped on its own after a device or tracker error
+    bool running;
+};
+
+// Open the device or recording and create its tracker
+bool kinect_pipeline_open(struct KinectPipeline* kinect, int index, const struct KinectSourceOptions* source,
+                          int cpu, int64_t max_age_usec, kinect_pose_fn hedge_pose,
+                          kinect_frame_fn on_frame, void* context);
+bool kinect_pipeline_start(struct KinectPipeline* kinect);
+void kinect_pipeline_stop(struct KinectPipeline* kinect);
+void kinect_pipeline_close(struct KinectPipeline* kinect);
@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+#include "latency_stats.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static int log2_floor(uint64_t v)
+{
+#ifdef _MSC_VER
+    unsigned long e;
+    _BitScanReverse64(&e, v);
+    return (int)e;
+#else
+    return 63 - __builtin_clzll(v);
+#endif
+}
+
+static int bucket_of(int64_t v)
+{
+    if (v < 16)
+        return v < 0 ? 0 : (int)v;
+    int e = log2_floor((uint64_t)v);
+    int idx = 16 + (e - 4) * 8 + (int)((v >> (e - 3)) & 7);
+    return idx < LATENCY_STATS_BUCKETS ? idx : LATENCY_STATS_BUCKETS - 1;
+}
+
+// Midpoint of a bucket
+static int64_t bucket_value(int idx)
+{
+    if (idx < 16)
+        return idx;
+    int e = (idx - 16) / 8 + 4;
+    int64_t sub = (idx - 16) % 8;
+    int64_t low = ((int64_t)8 + sub) << (e - 3);
+    return low + ((int64_t)1 << (e - 3)) / 2;
+}
+
+void latency_stats_init(struct LatencyStats* stats, const char* name)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->name = name;
+    stats->unit = "us";
+}
+
+void latency_stats_reset(struct LatencyStats* stats)
+{
+    const char* unit = stats->unit;
+    latency_stats_init(stats, stats->name);
+    stats->unit = unit;
+}
+
+void latency_stats_add(struct LatencyStats* stats, int64_t usec)
+{
+    if (stats->count == 0 || usec < stats->min)
+        stats->min = usec;
+    if (stats->count == 0 || usec > stats->max)
+        stats->max = usec;
+    stats->count++;
+    stats->sum += (double)usec;
+    stats->buckets[bucket_of(usec)]++;
+}
+
+int64_t latency_stats_percentile(const struct LatencyStats* stats, double p)
+{
+    if (stats->count == 0)
+        return 0;
+    uint64_t target = (uint64_t)(p * (double)stats->count);
+    if (target >= stats->count)
+        target = stats->count - 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_STATS_BUCKETS; i++)
+    {
+        seen += stats->buckets[i];
+        if (seen > target)
+        {
+            int64_t v = bucket_value(i);
+            return v > stats->max ? stats->max : (v < stats->min ? stats->min : v);
+        }
+    }
+    return stats->max;
+}
+
+void latency_stats_print(const struct LatencyStats* stats)
+{
+    if (stats->count == 0)
+    {
+        printf("%-20s no samples\n", stats->name);
+        return;
+    }
+    printf("%-20s n=%llu mean=%.0f p50=%lld p95=%lld p99=%lld max=%lld %s\n",
+           stats->name, (unsigned long long)stats->count, stats->sum / (double)stats->count,
+           (long long)latency_stats_percentile(stats, 0.50),
+           (long long)latency_stats_percentile(stats, 0.95),
+           (long long)latency_stats_percentile(stats, 0.99),
+           (long long)stats->max, stats->unit);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+// Fixed-size latency histogram (microseconds). Values below 16 us are exact,
+// above that each power of two is split into 8 buckets (~12% resolution), so
+// recording is O(1) and percentiles need no sample storage. Any non-negative
+// integer quantity can be recorded; unit only affects printing.
+
+#define LATENCY_STATS_BUCKETS 256
+
+struct LatencyStats
+{
+    const char* name;
+    const char* unit;// "us" unless changed after init
+    uint64_t count;
+    double sum;
+    int64_t min;
+    int64_t max;
+    uint32_t buckets[LATENCY_STATS_BUCKETS];
+};
+
+void latency_stats_init(struct LatencyStats* stats, const char* name);
+void latency_stats_reset(struct LatencyStats* stats);
+void latency_stats_add(struct LatencyStats* stats, int64_t usec);
+
+// Approximate value at fraction p (0..1) of the recorded samples
+int64_t latency_stats_percentile(const struct LatencyStats* stats, double p);
+
+// One line: name, count, mean, p50, p95, p99, max
+void latency_stats_print(const struct LatencyStats* stats);
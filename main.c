@@ -34,252 +34,738 @@ float v[3];  /**< Array representation of a vector.
 #include <k4abt.h> 
 #include <string.h> 
 #include <sys/types.h> 
-#include <winsock2.h>
-#include <windows.h> 
-// #include <marvelmind.h>
-
-#pragma comment(lib,"ws2_32.lib") //Winsock Library
-
-#define BUFLEN 100	//Max length of buffer // TODO: rearrange buffer size
-#define Port 8080
-#define VERIFY(result, error)                                                                            \
-    if(result != K4A_RESULT_SUCCEEDED)                                                                   \
-    {                                                                                                    \
-        printf("%s \n - (File: %s, Function: %s, Line: %d)\n", error, __FILE__, __FUNCTION__, __LINE__); \
-        exit(1);                                                                                         \
-    }                                                                                                    \
+#include "net.h"
+#include "platform.h"
+#include "marvelmind.h"
+#include "pose_filter.h"
+#include "skeleton.h"
+#include "protocol.h"
+#include "options.h"
+#include "body_slots.h"
+#include "output_scheduler.h"
+#include "motion_predictor.h"
+#include "frame_budget.h"
+#include "udp_sender.h"
+#include "shm_ring.h"
+#include "rate_control.h"
+#include "text_format.h"
+#include "kinect_pipeline.h"
+#include "frame_merge.h"
+#include "body_fusion.h"
+#include "extrinsics.h"
+#include "task_pool.h"
+#include "zone_events.h"
+#include "gesture_events.h"
+#include "pose_match.h"
+#include "retarget.h"
+#include "outlier_filter.h"
+
+#define SERVE_INTERVAL_USEC 2000   // receiver feedback and pings between camera frames
+
+_Static_assert(SKELETON_JOINT_COUNT == K4ABT_JOINT_COUNT, "skeleton.h joint set must match k4abt");
 
 volatile sig_atomic_t stop;
 void inthand(int signum) {
     stop = 1;
 }
 
-// Get Global position of Kinect using Beacon
-k4a_float3_t get_kinect_pos(){
-    // TODO: Get Global position of Kinect using Beacon
-    k4a_float3_t kinect_pos;
-    kinect_pos.v[0] = 0;
-    kinect_pos.v[1] = 0;
-    kinect_pos.v[2] = 0;
+// Marvelmind raw IMU scale: 1 mg and 0.0175 deg/s per LSB
+#define HEDGE_ACC_SCALE (9.81f / 1000.0f)
+#define HEDGE_GYRO_SCALE (0.0175f * 3.14159265f / 180.0f)
+#define HEDGE_POSITION_SIGMA 0.02f      // m
+#define HEDGE_ORIENTATION_SIGMA 0.05f   // rad
+
+// Kinect pose estimated from the hedge mounted on the camera. The hedge thread
+// feeds the filter through callbacks while the pipeline threads query it.
+static struct PoseFilter kinect_pose_filter;
+static platform_mutex_t kinect_pose_lock;
+
+static void on_hedge_position(struct PositionValue position){
+    vec3_t p = vec3_make(position.x / 1000.0f, position.y / 1000.0f, position.z / 1000.0f);
+    int64_t now = monotonic_usec();
+
+    platform_mutex_lock(&kinect_pose_lock);
+    pose_filter_update_position(&kinect_pose_filter, now, p, HEDGE_POSITION_SIGMA);
+    platform_mutex_unlock(&kinect_pose_lock);
+}
+
+static void on_hedge_raw_imu(struct RawIMUValue raw){
+    vec3_t acc = vec3_make(raw.acc_x * HEDGE_ACC_SCALE, raw.acc_y * HEDGE_ACC_SCALE, raw.acc_z * HEDGE_ACC_SCALE);
+    vec3_t gyro = vec3_make(raw.gyro_x * HEDGE_GYRO_SCALE, raw.gyro_y * HEDGE_GYRO_SCALE, raw.gyro_z * HEDGE_GYRO_SCALE);
+    int64_t now = monotonic_usec();
+
+    platform_mutex_lock(&kinect_pose_lock);
+    pose_filter_predict(&kinect_pose_filter, now, acc, gyro);
+    platform_mutex_unlock(&kinect_pose_lock);
+}
+
+static void on_hedge_fusion_imu(struct FusionIMUValue fusion){
+    // quaternion is normalized to 10000
+    quat_t q = quat_make(fusion.qw / 10000.0f, fusion.qx / 10000.0f, fusion.qy / 10000.0f, fusion.qz / 10000.0f);
+    int64_t now = monotonic_usec();
+
+    platform_mutex_lock(&kinect_pose_lock);
+    pose_filter_update_orientation(&kinect_pose_filter, now, q, HEDGE_ORIENTATION_SIGMA);
+    platform_mutex_unlock(&kinect_pose_lock);
+}
+
+// Start tracking the Kinect pose with the Marvelmind hedge attached to it
+struct MarvelmindHedge* start_kinect_pose_tracking(const char* tty_name, vec3_t mount_offset_mm,
+                                                   quat_t mount_rotation){
+    struct PoseFilterConfig config;
+    pose_filter_default_config(&config);
+    config.mountOffset = vec3_scale(mount_offset_mm, 0.001f);
+    config.mountRotation = mount_rotation;
+    pose_filter_init(&kinect_pose_filter, &config);
+    platform_mutex_init(&kinect_pose_lock);
 
-    /*
-    * // Init marvel mind 
     struct MarvelmindHedge * hedge=createMarvelmindHedge ();
     if (hedge==NULL)
     {
         puts ("Error: Unable to create MarvelmindHedge");
-        return kinect_pos;
+        return NULL;
     }
+    if (tty_name != NULL)
+        hedge->ttyFileName = tty_name;
+    hedge->receiveDataCallback = on_hedge_position;
+    hedge->receiveRawIMUCallback = on_hedge_raw_imu;
+    hedge->receiveFusionIMUCallback = on_hedge_fusion_imu;
     startMarvelmindHedge (hedge);
-    
-    // Get the position of mobile beacon
-    struct PositionValue position; 
-    bool valid = getPositionFromMarvelmindHedge(hedge, &position);
-    
-    if(valid){
-        kinect_pos.v[0] = position.x;
-        kinect_pos.v[1] = position.y;
-        kinect_pos.v[2] = position.z;
-    }
-
-    // Exit
+
+    return hedge;
+}
+
+void stop_kinect_pose_tracking(struct MarvelmindHedge* hedge){
+    if (hedge == NULL)
+        return;
     stopMarvelmindHedge (hedge);
     destroyMarvelmindHedge (hedge);
-    
-    */
-       
-    return kinect_pos;
+    platform_mutex_destroy(&kinect_pose_lock);
 }
 
-// Send data to unreal engine
-int send_data(int frame_count, uint32_t  id, k4abt_skeleton_t sk, SOCKET server_socket, SOCKADDR_IN server_info){
-    
-     int send_size;
-     char buffer[BUFLEN];
-     memset( buffer, 0, BUFLEN );
-
-     for (int i = 0; i < (int)K4ABT_JOINT_COUNT; i++){
-        k4a_float3_t position = sk.joints[i].position;
-//      k4a_quaternion_t orientation = sk.joints[i].orientation; add in future
-        k4abt_joint_confidence_level_t confidence_level = sk.joints[i].confidence_level;
-        snprintf(buffer, sizeof(buffer),"Frame: %d, Body ID[%u], Joint[%d]: Position[mm] ( %f, %f, %f ); \n", 
-                                        id, i, position.v[0], position.v[1], position.v[2]);
-
-        send_size = sendto (server_socket, buffer, BUFLEN, 0, (struct sockaddr*) &server_info, sizeof(server_info));
-        if(send_size == SOCKET_ERROR){
-            return -1;
-        }   
-        printf("sendto() buffer %d!\n", send_size);
-    }
+// Get Global pose of Kinect at a host monotonic time. Falls back to the
+// origin while the hedge has not reported a position yet.
+struct CameraPose get_kinect_pose(int64_t t_usec){
+    struct CameraPose pose;
 
+    platform_mutex_lock(&kinect_pose_lock);
+    pose_filter_query(&kinect_pose_filter, t_usec, &pose);
+    platform_mutex_unlock(&kinect_pose_lock);
+
+    return pose;
+}
+
+// Queue data for unreal engine, one text datagram per body with a line per joint
+int send_data(const struct SkeletonFrame* frame, uint32_t body, struct DatagramBatch* batch){
+
+    char* buffer = (char*)datagram_batch_reserve(batch, TEXT_FORMAT_MAX_BODY);
+    if (buffer == NULL){
+        return -1;
+    }
+    datagram_batch_commit(batch, text_format_body(frame, body, buffer, TEXT_FORMAT_MAX_BODY));
     return 0;
 }
 
+// Send slot spawn/despawn events so the receiver can create or remove actors
+int send_slot_events(uint32_t frame_number, struct BodySlotTable* slots, struct RateControl* control,
+                     struct UdpSender* sender){
+
+    struct BodySlotEvent events[BODY_SLOT_MAX_EVENTS];
+    int count = body_slots_take_events(slots, events, BODY_SLOT_MAX_EVENTS);
+    if (count == 0)
+        return 0;
+    return rate_control_send_events(control, sender, frame_number, events, count) == 0 ? 0 : -1;
+}
+
+// Send zone enter/exit and proximity events of the frame
+int send_zone_events(uint32_t frame_number, struct ZoneEngine* zones, struct RateControl* control,
+                     struct UdpSender* sender){
+
+    static struct ZoneEvent events[ZONE_MAX_EVENTS];
+    int count = zone_engine_take_events(zones, events, ZONE_MAX_EVENTS);
+    if (count == 0)
+        return 0;
+    return rate_control_send_zone_events(control, sender, frame_number, events, count) == 0 ? 0 : -1;
+}
+
+// Send gesture start/end events of the frame
+int send_gesture_events(uint32_t frame_number, struct GestureEngine* gestures, struct RateControl* control,
+                        struct UdpSender* sender){
+
+    static struct GestureEvent events[GESTURE_MAX_EVENTS];
+    int count = gesture_engine_take_events(gestures, events, GESTURE_MAX_EVENTS);
+    if (count == 0)
+        return 0;
+    return rate_control_send_gesture_events(control, sender, frame_number, events, count) == 0 ? 0 : -1;
+}
+
+// Send the library poses the bodies of the frame match
+int send_pose_matches(uint32_t frame_number, struct PoseMatcher* matcher, struct RateControl* control,
+                      struct UdpSender* sender){
+
+    struct PoseMatchResult matches[MAX_FRAME_BODIES];
+    int count = pose_matcher_take_results(matcher, matches, MAX_FRAME_BODIES);
+    if (count == 0)
+        return 0;
+    return rate_control_send_pose_matches(control, sender, frame_number, matches, count) == 0 ? 0 : -1;
+}
+
+// Send the bodies of the frame posed on the target skeleton
+int send_retargeted(uint32_t frame_number, const struct Retargeter* retargeter, struct RateControl* control,
+                    struct UdpSender* sender){
+
+    if (retargeter->poseCount == 0)
+        return 0;
+    return rate_control_send_retargeted(control, sender, frame_number, retargeter->poses, retargeter->poseCount,
+                                        retargeter->boneCount) == 0 ? 0 : -1;
+}
+
+// Datagrams receivers send back to the sender socket: feedback adapts their
+// encoding level, pings are answered at once for their clock offset
+static void serve_receivers(struct UdpSender* sender, struct RateControl* control, int64_t now_usec){
+
+    uint8_t buffer[SKP_MAX_DATAGRAM];
+    SOCKADDR_IN from;
+    int64_t arrival_usec;
+    int size;
+    while ((size = udp_sender_receive(sender, buffer, sizeof(buffer), &from, &arrival_usec)) > 0)
+    {
+        struct SkpHeader h;
+        struct SkpFeedback feedback;
+        struct SkpPong pong;
+        if (!skp_read_header(buffer, (size_t)size, &h))
+            continue;
+        if (skp_read_feedback(buffer, &h, &feedback))
+            rate_control_on_feedback(control, sender, &from, &feedback, now_usec);
+        else if (skp_read_ping(buffer, &h, &pong.pingSentUsec))
+        {
+            uint8_t reply[SKP_PONG_SIZE];
+            pong.pingReceivedUsec = arrival_usec;
+            pong.pongSentUsec = monotonic_usec();
+            size_t n = skp_write_pong(&pong, reply, sizeof(reply));
+            udp_sender_reply(sender, &from, reply, n);
+        }
+    }
+}
+
+// Where processed frames go, shared by the output stage and the output scheduler
+struct OutputTarget
+{
+    struct UdpSender* sender;
+    struct ShmRingWriter* shm;// NULL unless --shm
+    struct RateControl* control;// binary format: encoding level of every receiver
+    uint8_t rotations;// binary format: rotation sets any receiver subscribes to
+    const struct AppOptions* options;
+    struct DatagramBatch batch;// text format, serialized once for all destinations
+    struct TaskPool* pool;
+    struct TaskLoop rotationLoop;
+};
+
+static void compute_body_local_rotations(void* context, int index){
+    skeleton_compute_body_local_rotations((struct SkeletonFrame*)context, (uint32_t)index);
+}
+
+// Serialize one frame in the selected output format and send it to every destination
+static void publish_frame(struct SkeletonFrame* frame, void* context){
+    struct OutputTarget* target = (struct OutputTarget*)context;
+    datagram_batch_clear(&target->batch);
+
+    // Local receivers read whole frames from shared memory, rotations included
+    if (target->shm != NULL)
+    {
+        task_pool_for(target->pool, &target->rotationLoop, (int)frame->bodyCount, compute_body_local_rotations, frame);
+        shm_writer_publish(target->shm, frame);
+    }
+
+    if (target->options->format == OUTPUT_FORMAT_TEXT)
+    {
+        for (uint32_t b = 0; b < frame->bodyCount; b++)
+        {
+            if (send_data(frame, b, &target->batch) != 0)
+                printf("data is not sent!\n");
+        }
+    }
+    else
+    {
+        // Bone-local rotations for all bodies in one pass, then one datagram
+        // per body in the encoding each receiver currently gets
+        if ((target->rotations & SKP_LOCAL_ROTATIONS) && target->shm == NULL)
+            task_pool_for(target->pool, &target->rotationLoop, (int)frame->bodyCount, compute_body_local_rotations,
+                          frame);
+        if (rate_control_send_frame(target->control, target->sender, frame) != 0)
+            printf("data is not sent to every destination!\n");
+        return;
+    }
+
+    // Send data to unreal engine and the other receivers
+    if (udp_sender_send(target->sender, &target->batch) != 0)
+        printf("data is not sent to every destination!\n");
+}
+
+// Everything after the body trackers. Pipelines call in from their own
+// threads, one at a time under the lock: fusion, slots, prediction and the
+// output path are shared by all cameras. Bodies of large frames are spread
+// over the task pool.
+struct OutputStage
+{
+    platform_mutex_t lock;
+    struct TaskPool pool;
+    struct TaskLoop bodyLoop;
+    struct BodySlotTable slots;
+    struct OutlierFilter outliers;
+    bool filtering;// --bone-tolerance
+    struct MotionPredictor predictor;
+    bool predict;
+    struct OutputScheduler scheduler;
+    bool scheduled;
+    struct BodyFusion fusion;
+    bool fuse;// several cameras: one body per person
+    struct FrameMerge merge;
+    struct SkeletonFrame merged;
+    struct ZoneEngine zones;
+    bool zoned;// --zones
+    struct GestureEngine gestures;
+    bool gesturing;// --gestures
+    struct PoseMatcher poses;
+    bool matching;// --pose-index
+    struct Retargeter retarget;
+    bool retargeting;// --retarget
+    struct OutputTarget target;
+};
+
+// Prediction of one body: its motion filters, then its extrapolated pose
+struct PredictTask
+{
+    struct MotionPredictor* predictor;
+    struct SkeletonFrame* frame;
+    int64_t horizonUsec;
+};
+
+static void predict_body(void* context, int index){
+    struct PredictTask* task = (struct PredictTask*)context;
+    motion_predictor_observe_body(task->predictor, task->frame, (uint32_t)index);
+    motion_predictor_apply_body(task->predictor, task->frame, (uint32_t)index, task->horizonUsec);
+}
+
+static void on_kinect_frame(struct KinectPipeline* kinect, struct SkeletonFrame* frame, void* context){
+    struct OutputStage* stage = (struct OutputStage*)context;
+    const struct AppOptions* options = stage->target.options;
+
+    platform_mutex_lock(&stage->lock);
+    // Fused frames hold every person of every camera
+    struct SkeletonFrame* out = frame;
+    if (stage->fuse)
+    {
+        body_fusion_push(&stage->fusion, kinect->index, frame, &stage->merged);
+        body_fusion_report(&stage->fusion, monotonic_usec(), 5000000);
+        out = &stage->merged;
+    }
+
+    for (uint32_t b = 0; b < out->bodyCount; b++)
+        out->slots[b] = body_slots_assign(&stage->slots, out->bodyIds[b], out->timestampUsec);
+    body_slots_expire(&stage->slots, out->timestampUsec);
+
+    // Tracker glitches are repaired before anything looks at the bodies
+    if (stage->filtering)
+    {
+        outlier_filter_update(&stage->outliers, out);
+        outlier_filter_report(&stage->outliers, monotonic_usec(), 5000000);
+    }
+
+    // Zones, gestures and pose matches see where people are, not where
+    // prediction expects them
+    if (stage->zoned)
+    {
+        zone_engine_update(&stage->zones, out);
+        zone_engine_report(&stage->zones, monotonic_usec(), 5000000);
+    }
+    if (stage->gesturing)
+    {
+        gesture_engine_update(&stage->gestures, out);
+        gesture_engine_report(&stage->gestures, monotonic_usec(), 5000000);
+    }
+    if (stage->matching)
+    {
+        pose_matcher_update(&stage->poses, out);
+        pose_matcher_report(&stage->poses, monotonic_usec(), 5000000);
+    }
+
+    if (stage->predict)
+    {
+        int64_t now = monotonic_usec();
+        struct PredictTask task = { &stage->predictor, out, motion_predictor_horizon(&stage->predictor, out, now) };
+        task_pool_for(&stage->pool, &stage->bodyLoop, (int)out->bodyCount, predict_body, &task);
+        motion_predictor_collect(&stage->predictor);
+        motion_predictor_report(&stage->predictor, now, 5000000);
+    }
+
+    // Retargeted poses go out with the bodies, so they are predicted like them
+    if (stage->retargeting)
+    {
+        retargeter_update(&stage->retarget, out);
+        retargeter_report(&stage->retarget, monotonic_usec(), 5000000);
+    }
+
+    // The scheduler interpolates every slot from its own samples; frames sent
+    // directly carry the newest bodies of every camera
+    if (!stage->fuse && !stage->scheduled)
+    {
+        frame_merge_push(&stage->merge, kinect->index, frame, &stage->merged);
+        out = &stage->merged;
+    }
+
+    // Events carry the number of the frame that first sends the bodies they
+    // were found in: at a fixed output rate, the first one rendered at or
+    // after the capture
+    uint32_t event_frame = stage->scheduled ? output_scheduler_frame_at(&stage->scheduler, out->timestampUsec)
+                                            : out->frameNumber;
+    if (options->format == OUTPUT_FORMAT_BINARY)
+    {
+        if (send_slot_events(event_frame, &stage->slots, stage->target.control, stage->target.sender) != 0)
+            printf("slot events are not sent!\n");
+        if (stage->zoned && send_zone_events(event_frame, &stage->zones, stage->target.control,
+                                             stage->target.sender) != 0)
+            printf("zone events are not sent!\n");
+        if (stage->gesturing && send_gesture_events(event_frame, &stage->gestures, stage->target.control,
+                                                    stage->target.sender) != 0)
+            printf("gesture events are not sent!\n");
+        if (stage->matching && send_pose_matches(event_frame, &stage->poses, stage->target.control,
+                                                 stage->target.sender) != 0)
+            printf("pose matches are not sent!\n");
+        if (stage->retargeting && send_retargeted(event_frame, &stage->retarget, stage->target.control,
+                                                  stage->target.sender) != 0)
+            printf("retargeted poses are not sent!\n");
+    }
+
+    if (stage->scheduled)
+        output_scheduler_push(&stage->scheduler, out);
+    else
+        publish_frame(out, &stage->target);
+    platform_mutex_unlock(&stage->lock);
+}
 
 int main(int argc, char** argv)
 {
     printf("-------------------Body Joint Tracking----------------------\n");
     printf("Process has started! you can stop tracking by pressing ctr+c keys!\n");
 
+    struct AppOptions options;
+    default_options(&options);
+    if (!parse_options(argc, argv, &options))
+        return -1;
+
+    // Every installed device unless --kinect picked the sources
+    if (options.kinectCount == 0)
+    {
+        uint32_t installed = k4a_device_get_installed_count();
+        for (uint32_t d = 0; d < installed && options.kinectCount < MAX_KINECTS; d++)
+        {
+            struct KinectSourceOptions* source = &options.kinects[options.kinectCount++];
+            memset(source, 0, sizeof(*source));
+            source->device = (int)d;
+            source->orientation = kinect_level_orientation();
+        }
+        if (options.kinectCount == 0)
+        {
+            printf("No Kinect device found!\n");
+            return -1;
+        }
+    }
+
+    // Calibrated poses of the cameras without a --kinect-pose
+    if (options.extrinsicsPath != NULL)
+    {
+        struct RigidTransform poses[MAX_KINECTS];
+        bool have[MAX_KINECTS];
+        if (extrinsics_load(options.extrinsicsPath, poses, have, MAX_KINECTS) < 0)
+        {
+            printf("Can not read extrinsics %s\n", options.extrinsicsPath);
+            return -1;
+        }
+        for (int k = 0; k < options.kinectCount; k++)
+        {
+            struct KinectSourceOptions* source = &options.kinects[k];
+            if (source->fixedPose || !have[k])
+                continue;
+            source->fixedPose = true;
+            source->position = poses[k].translation;
+            source->orientation = poses[k].rotation;
+        }
+    }
+
+    // One camera carries the hedge; others without a pose would share its
+    // pose and stack their bodies on the same spot
+    bool follow_hedge = options.hedgeKinect < options.kinectCount && !options.kinects[options.hedgeKinect].fixedPose;
+    for (int k = 0; k < options.kinectCount; k++)
+    {
+        if (k != options.hedgeKinect && !options.kinects[k].fixedPose)
+            printf("Camera %d has no pose and no hedge (--hedge-kinect %d), it stands level at the origin\n", k,
+                   options.hedgeKinect);
+    }
+
     signal(SIGINT, inthand);
 
     //* Data sending settings 
-    WSADATA wsdata;
-    SOCKET server_socket;
-    SOCKADDR_IN server_info;
-    
-    printf("\nInitialising Winsock...\n");
-    if (WSAStartup(MAKEWORD(2, 2), &wsdata) != 0)
-    {
-        printf("Failed. Error Code : %d\n", WSAGetLastError());
+    printf("\nInitialising sockets...\n");
+    if (net_startup() != 0)
+    {
+        printf("Failed. Error Code : %d\n", socket_error());
         return -1;
     }
     printf("Initialised.\n");
 
-    memset(&server_info, 0, sizeof(server_info)); // fill with zero
-
-    server_info.sin_family = AF_INET;
-    server_info.sin_addr.s_addr = inet_addr("192.168.0.24");
-    server_info.sin_port = htons(Port);
-
-    // Create socket
-    server_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-    if (server_socket == INVALID_SOCKET) {
+    // Create socket and the receiver list
+    static struct UdpSender sender;
+    if (!udp_sender_open(&sender)) {
         printf("Can not create the socket!\n");
-        closesocket(server_socket);
-        WSACleanup();
+        net_cleanup();
+        return -1;
+    }
+    static struct RateControl rate_control;
+    struct RateControlConfig rate_config;
+    rate_control_default_config(&rate_config);
+    uint32_t events_only = 0;
+    uint8_t rotations = 0;// of every body destination, for the bone-local pass
+    for (int d = 0; d < options.destCount; d++)
+    {
+        if (options.destEventsOnly[d] && options.format != OUTPUT_FORMAT_BINARY)
+            printf("Events need --format binary, --events-dest %s is ignored\n", options.destHosts[d]);
+        else if (!udp_sender_add_destination(&sender, options.destHosts[d], options.destPorts[d]))
+            printf("Invalid destination %s:%u\n", options.destHosts[d], options.destPorts[d]);
+        else if (options.destEventsOnly[d])
+            events_only |= 1u << (sender.destinationCount - 1);
+        else
+        {
+            rate_config.rotations[sender.destinationCount - 1] = options.destRotations[d];
+            rotations |= options.destRotations[d];
+        }
+    }
+    if (options.multicast &&
+        !udp_sender_set_multicast(&sender, options.multicastTtl, options.multicastInterface, true))
+        printf("Can not set multicast options, Error Code : %d\n", socket_error());
+
+    // Binary streams: one per encoding level and rotation set, each receiver
+    // on the level its feedback allows (or the fixed --encoding)
+    rate_config.fecGroup = options.fecGroup;
+    rate_config.adaptive = options.adaptive;
+    rate_config.initialLevel = options.encodingLevel;
+    rate_config.budgetKbps = options.bandwidthKbps;
+    rate_config.latencyBudgetUsec = (int64_t)options.latencyBudgetMs * 1000;
+    rate_config.farDistanceMm = (float)options.farDistanceMm;
+    rate_config.eventsOnly = events_only;
+    static struct PoseBasis pca_basis;
+    if (options.pcaBasisPath != NULL && options.format != OUTPUT_FORMAT_BINARY)
+        printf("The pca encoding needs --format binary, --pca-basis is ignored\n");
+    else if (options.pcaBasisPath != NULL)
+    {
+        if (!pose_basis_load(&pca_basis, options.pcaBasisPath))
+        {
+            printf("Can not read pose basis %s\n", options.pcaBasisPath);
+            return -1;
+        }
+        rate_config.basis = &pca_basis;
+        rate_config.pcaComponents =
+            options.pcaComponents < pca_basis.components ? options.pcaComponents : pca_basis.components;
+        rate_config.pcaMaxErrorMm = (float)options.pcaMaxErrorMm;
+        printf("Pose basis %08x, %d of %d components\n", pca_basis.basisId, rate_config.pcaComponents,
+               pca_basis.components);
+    }
+    if (options.encodingLevel == RATE_LEVEL_PCA && rate_config.basis == NULL)
+    {
+        printf("The pca encoding needs --pca-basis\n");
         return -1;
     }
+    rate_control_init(&rate_control, &rate_config);
+
+    // Kinect camera global pose from the hedge, unless every camera has a fixed one
+    struct MarvelmindHedge* hedge = NULL;
+    if (follow_hedge)
+        hedge = start_kinect_pose_tracking(options.hedgeTty, options.hedgeMountOffset, options.hedgeMountRotation);
+
+    static struct OutputStage stage;
+    platform_mutex_init(&stage.lock);
+    if (!task_pool_init(&stage.pool, options.workers, TASK_POOL_DEFAULT_THRESHOLD_NS))
+        printf("Can not start output workers, bodies are processed on the camera threads\n");
+    task_loop_init(&stage.bodyLoop, "predict", 3000);
+    body_slots_init(&stage.slots, (int64_t)options.slotGraceMs * 1000);
+    frame_merge_init(&stage.merge, FRAME_MERGE_DEFAULT_MAX_AGE_USEC);
+    stage.fuse = options.kinectCount > 1 && options.fusionGateMm > 0;
+    if (options.zonesPath != NULL && options.format != OUTPUT_FORMAT_BINARY)
+        printf("Zone events need --format binary, --zones is ignored\n");
+    else if (options.zonesPath != NULL)
+    {
+        zone_engine_init(&stage.zones, NULL);
+        int loaded = zone_engine_load(&stage.zones, options.zonesPath);
+        if (loaded < 0)
+        {
+            printf("Can not read zones %s\n", options.zonesPath);
+            return -1;
+        }
+        printf("%d zones and %d proximity rules\n", stage.zones.zoneCount, stage.zones.ruleCount);
+        stage.zoned = true;
+    }
+    if (options.gesturesPath != NULL && options.format != OUTPUT_FORMAT_BINARY)
+        printf("Gesture events need --format binary, --gestures is ignored\n");
+    else if (options.gesturesPath != NULL)
+    {
+        gesture_engine_init(&stage.gestures, NULL);
+        if (gesture_engine_load(&stage.gestures, options.gesturesPath) < 0)
+        {
+            printf("Can not read gestures %s\n", options.gesturesPath);
+            return -1;
+        }
+        printf("%d gestures with %d conditions\n", stage.gestures.gestureCount, stage.gestures.conditionCount);
+        stage.gesturing = true;
+    }
+    if (options.poseIndexPath != NULL && options.format != OUTPUT_FORMAT_BINARY)
+        printf("Pose matches need --format binary, --pose-index is ignored\n");
+    else if (options.poseIndexPath != NULL)
+    {
+        if (!pose_matcher_init(&stage.poses, options.poseIndexPath, NULL))
+        {
+            printf("Can not read pose index %s\n", options.poseIndexPath);
+            return -1;
+        }
+        stage.poses.pool = &stage.pool;
+        printf("%u reference poses from %u clips\n", stage.poses.index.count, stage.poses.index.clipCount);
+        stage.matching = true;
+    }
+    if (options.retargetPath != NULL && options.format != OUTPUT_FORMAT_BINARY)
+        printf("Retargeted poses need --format binary, --retarget is ignored\n");
+    else if (options.retargetPath != NULL)
+    {
+        retargeter_init(&stage.retarget, NULL);
+        if (retargeter_load(&stage.retarget, options.retargetPath) < 0)
+        {
+            printf("Can not read target skeleton %s\n", options.retargetPath);
+            return -1;
+        }
+        stage.retarget.pool = &stage.pool;
+        printf("%d target bones with %d IK chains\n", stage.retarget.boneCount, stage.retarget.chainCount);
+        stage.retargeting = true;
+    }
+    if (stage.fuse)
+    {
+        struct BodyFusionConfig fusion_config;
+        body_fusion_default_config(&fusion_config);
+        fusion_config.gateMm = (float)options.fusionGateMm;
+        body_fusion_init(&stage.fusion, &fusion_config);
+        stage.fusion.pool = &stage.pool;
+    }
 
-    /**=======================
-     * todo     Test Geting kinect global position using beacon
-     * 
-     *========================**/
-    
-    // Kinect camera global position
-    k4a_float3_t kinect_pos = get_kinect_pos(); 
- 
-    k4a_device_configuration_t device_config = K4A_DEVICE_CONFIG_INIT_DISABLE_ALL;
-    device_config.depth_mode = K4A_DEPTH_MODE_NFOV_UNBINNED;
-
-    k4a_device_t device;
-    VERIFY(k4a_device_open(0, &device), "Open K4A Device failed!");
-    VERIFY(k4a_device_start_cameras(device, &device_config), "Start K4A cameras failed!");
-
-    k4a_calibration_t sensor_calibration;
-    VERIFY(k4a_device_get_calibration(device, device_config.depth_mode, K4A_COLOR_RESOLUTION_OFF, &sensor_calibration),
-        "Get depth camera calibration failed!");
-
-    k4abt_tracker_t tracker = NULL;
-    k4abt_tracker_configuration_t tracker_config = K4ABT_TRACKER_CONFIG_DEFAULT;
-    VERIFY(k4abt_tracker_create(&sensor_calibration, tracker_config, &tracker), "Body tracker initialization failed!");
-    int frame_count = 0;
-    do
-    {
-        k4a_capture_t sensor_capture;
-        k4a_wait_result_t get_capture_result = k4a_device_get_capture(device, &sensor_capture, K4A_WAIT_INFINITE);
-        if (get_capture_result == K4A_WAIT_RESULT_SUCCEEDED)
+    // Frames go out directly on every camera frame, or through the fixed-rate
+    // scheduler which interpolates between camera frames
+    struct OutputTarget* output_target = &stage.target;
+    output_target->sender = &sender;
+    output_target->control = &rate_control;
+    output_target->rotations = rotations;
+    output_target->options = &options;
+    output_target->pool = &stage.pool;
+    task_loop_init(&output_target->rotationLoop, "local rotations", 300);
+
+    static struct ShmRingWriter shm_writer;
+    if (options.shmName != NULL)
+    {
+        if (shm_writer_create(&shm_writer, options.shmName, true))
+            output_target->shm = &shm_writer;
+        else
+            printf("Can not create shared memory %s\n", options.shmName);
+    }
+    stage.scheduled = options.outputRateHz > 0;
+    if (stage.scheduled)
+    {
+        output_scheduler_init(&stage.scheduler, options.outputRateHz, (int64_t)options.outputDelayMs * 1000,
+                              publish_frame, output_target);
+        if (!output_scheduler_start(&stage.scheduler))
         {
-            frame_count++;
-
-            printf("Start processing frame %d\n", frame_count);
-
-            k4a_wait_result_t queue_capture_result = k4abt_tracker_enqueue_capture(tracker, sensor_capture, K4A_WAIT_INFINITE);
-
-            k4a_capture_release(sensor_capture);
-            if (queue_capture_result == K4A_WAIT_RESULT_TIMEOUT)
-            {
-                // It should never hit timeout when K4A_WAIT_INFINITE is set.
-                printf("Error! Add capture to tracker process queue timeout!\n");
-                break;
-            }
-            else if (queue_capture_result == K4A_WAIT_RESULT_FAILED)
-            {
-                printf("Error! Add capture to tracker process queue failed!\n");
-                break;
-            }
-
-            // Get body joints, change coordinate and send data
-            k4abt_frame_t body_frame = NULL;
-            k4a_wait_result_t pop_frame_result = k4abt_tracker_pop_result(tracker, &body_frame, K4A_WAIT_INFINITE);
-            if (pop_frame_result == K4A_WAIT_RESULT_SUCCEEDED)
-            {
-                uint32_t num_bodies = k4abt_frame_get_num_bodies(body_frame);
-                printf("%u bodies are detected!\n", num_bodies);
-
-                for (uint32_t i = 0; i < num_bodies; i++)
-                {
-                    k4abt_body_t body;
-                    VERIFY(k4abt_frame_get_body_skeleton(body_frame, i, &body.skeleton), "Get body from body frame failed!");
-                    body.id = k4abt_frame_get_body_id(body_frame, i);
-                    printf("Body ID: %u\n", body.id);
-                    
-                    for (int i = 0; i < (int)K4ABT_JOINT_COUNT; i++)
-                    {
-                        k4a_float3_t position = body.skeleton.joints[i].position;
-                        k4a_quaternion_t orientation = body.skeleton.joints[i].orientation;
-                        k4abt_joint_confidence_level_t confidence_level = body.skeleton.joints[i].confidence_level;
-
-                        printf("Body ID: %d ; Original Joint[%d]: Position[mm] ( %f, %f, %f ); Orientation ( %f, %f, %f, %f); Confidence Level (%d) \n",
-                           body.id, i, position.v[0], position.v[1], position.v[2], orientation.v[0], orientation.v[1], orientation.v[2], orientation.v[3], confidence_level);
-                        
-                        // Convert the position
-                        position.v[0] = position.v[0] + kinect_pos.v[0];
-                        position.v[1] = position.v[1] + kinect_pos.v[1];
-                        position.v[2] = position.v[2] + kinect_pos.v[2];
-
-                        printf("Global Joint[%d]: Position[mm] ( %f, %f, %f ); \n",
-                            i, position.v[0], position.v[1], position.v[2]);
-
-                    }
-
-                    // Send data to unreal engine
-                    if (send_data(frame_count, body.id, body.skeleton, server_socket,server_info) !=0)
-                        printf("data is not sent!\n");
-                }
-
-                k4abt_frame_release(body_frame);
-            }
-            else if (pop_frame_result == K4A_WAIT_RESULT_TIMEOUT)
-            {
-                //  It should never hit timeout when K4A_WAIT_INFINITE is set.
-                printf("Error! Pop body frame result timeout!\n");
-                break;
-            }
-            else
-            {
-                printf("Pop body frame result failed!\n");
-                break;
-            }
+            printf("Output scheduler failed to start, sending on camera frames\n");
+            stage.scheduled = false;
         }
-        else if (get_capture_result == K4A_WAIT_RESULT_TIMEOUT)
+    }
+
+    // Glitch rejection ahead of everything else that looks at the bodies
+    stage.filtering = options.boneTolerancePct > 0;
+    if (stage.filtering)
+    {
+        struct OutlierFilterConfig outlier_config;
+        outlier_filter_default_config(&outlier_config);
+        outlier_config.lengthTolerance = (float)options.boneTolerancePct / 100.0f;
+        outlier_filter_init(&stage.outliers, &outlier_config);
+        stage.outliers.pool = &stage.pool;
+    }
+
+    // Latency compensation ahead of either output path
+    stage.predict = options.predictMs > 0 || options.predictMeasured;
+    if (stage.predict)
+    {
+        struct MotionPredictorConfig predictor_config;
+        motion_predictor_default_config(&predictor_config);
+        predictor_config.horizonUsec = (int64_t)options.predictMs * 1000;
+        predictor_config.measureLatency = options.predictMeasured;
+        if (options.predictMeasured && stage.scheduled)
+            predictor_config.horizonUsec += (int64_t)options.outputDelayMs * 1000;
+        motion_predictor_init(&stage.predictor, &predictor_config);
+    }
+
+    // One capture and tracker thread per camera
+    static struct KinectPipeline kinects[MAX_KINECTS];
+    int64_t max_age_usec = (int64_t)options.maxAgeMs * 1000;
+    int started = 0;
+    for (int k = 0; k < options.kinectCount; k++)
+    {
+        int cpu = k < options.cpuCount ? options.cpus[k] : -1;
+        kinect_pose_fn hedge_pose = follow_hedge && k == options.hedgeKinect ? get_kinect_pose : NULL;
+        if (!kinect_pipeline_open(&kinects[k], k, &options.kinects[k], cpu, max_age_usec, hedge_pose,
+                                  on_kinect_frame, &stage))
+            continue;
+        if (kinect_pipeline_start(&kinects[k]))
         {
-            // It should never hit time out when K4A_WAIT_INFINITE is set.
-            printf("Error! Get depth frame time out!\n");
-            break;
+            printf("%s started\n", kinects[k].name);
+            started++;
         }
         else
+            printf("%s: can not start its thread\n", kinects[k].name);
+    }
+
+    // The main thread serves the receivers until ctrl+c or every camera failed
+    while (!stop && started > 0)
+    {
+        int64_t now = monotonic_usec();
+        udp_sender_report(&sender, now, 5000000);
+        if (options.format == OUTPUT_FORMAT_BINARY)
         {
-            printf("Get depth capture returned error: %d\n", get_capture_result);
-            break;
+            serve_receivers(&sender, &rate_control, now);
+            rate_control_report(&rate_control, &sender, now, 5000000);
         }
 
-    } while (!stop);
+        int running = 0;
+        for (int k = 0; k < options.kinectCount; k++)
+            running += kinects[k].running && !kinects[k].finished;
+        if (running == 0)
+            break;
+        platform_sleep_usec(SERVE_INTERVAL_USEC);
+    }
+
+    for (int k = 0; k < options.kinectCount; k++)
+        kinect_pipeline_close(&kinects[k]);
 
     printf("Finished body tracking processing!\n");
-   
-    closesocket(server_socket);
-    WSACleanup();
 
-    // Shut down the camera when finished with application logic
-    k4abt_tracker_shutdown(tracker);
-    k4abt_tracker_destroy(tracker);
-    k4a_device_stop_cameras(device);
+    if (stage.scheduled)
+        output_scheduler_stop(&stage.scheduler);
+   
+    udp_sender_close(&sender);
+    rate_control_destroy(&rate_control);
+    net_cleanup();
+    if (output_target->shm != NULL)
+        shm_writer_close(output_target->shm);
+    task_pool_destroy(&stage.pool);
+    if (stage.matching)
+        pose_matcher_close(&stage.poses);
+    platform_mutex_destroy(&stage.lock);
+
+    stop_kinect_pose_tracking(hedge);
     printf("Socket has closed.\n");
 
-    // Close the device 
-    k4a_device_close(device);
-
     return 0;
 }
-
@@ -486,8 +486,8 @@ static void process_imu_fusion_datagram(struct MarvelmindHedge * hedge, uint8_t
 {uint8_t *dataBuf= &buffer[5];
 
     hedge->fusionIMU.x= get_int32(&dataBuf[0]);
-    hedge->fusionIMU.y= get_int16(&dataBuf[4]);
-    hedge->fusionIMU.z= get_int16(&dataBuf[8]);
+    hedge->fusionIMU.y= get_int32(&dataBuf[4]);
+    hedge->fusionIMU.z= get_int32(&dataBuf[8]);
 
     hedge->fusionIMU.qw= get_int16(&dataBuf[12]);
     hedge->fusionIMU.qx= get_int16(&dataBuf[14]);
@@ -564,6 +564,8 @@ Marvelmind_Thread_ (void* param)
 {
     struct MarvelmindHedge * hedge=(struct MarvelmindHedge*) param;
     struct PositionValue curPosition;
+    struct RawIMUValue curRawIMU;
+    struct FusionIMUValue curFusionIMU;
     uint8_t input_buffer[256];
     uint8_t recvState=RECV_HDR; // current state of receive data
     uint8_t nBytesInBlockReceived=0; // bytes received
@@ -730,9 +732,11 @@ Marvelmind_Thread_ (void* param)
                                 break;
                             case IMU_RAW_DATAGRAM_ID:
 								process_imu_raw_datagram(hedge, input_buffer);
+                                curRawIMU= hedge->rawIMU;
                                 break;
                             case IMU_FUSION_DATAGRAM_ID:
                                 process_imu_fusion_datagram(hedge, input_buffer);
+                                curFusionIMU= hedge->fusionIMU;
                                 break;
                             case BEACON_RAW_DISTANCE_DATAGRAM_ID:
                                 process_raw_distances_datagram(hedge, input_buffer);
@@ -760,11 +764,28 @@ Marvelmind_Thread_ (void* param)
 
                         if (hedge->receiveDataCallback)
                         {
-                            if (dataId == POSITION_DATAGRAM_ID)
+                            if ((dataId == POSITION_DATAGRAM_ID) ||
+                                (dataId == POSITION_DATAGRAM_HIGHRES_ID))
                             {
                                 hedge->receiveDataCallback (curPosition);
                             }
                         }
+
+                        if (hedge->receiveRawIMUCallback)
+                        {
+                            if (dataId == IMU_RAW_DATAGRAM_ID)
+                            {
+                                hedge->receiveRawIMUCallback (curRawIMU);
+                            }
+                        }
+
+                        if (hedge->receiveFusionIMUCallback)
+                        {
+                            if (dataId == IMU_FUSION_DATAGRAM_ID)
+                            {
+                                hedge->receiveFusionIMUCallback (curFusionIMU);
+                            }
+                        }
                     }
                     // and repeat
                     recvState=RECV_HDR;
@@ -793,6 +814,8 @@ struct MarvelmindHedge * createMarvelmindHedge ()
         hedge->verbose=false;
         hedge->receiveDataCallback=NULL;
         hedge->anyInputPacketCallback= NULL;
+        hedge->receiveRawIMUCallback= NULL;
+        hedge->receiveFusionIMUCallback= NULL;
         hedge->lastValuesCount_=0;
         hedge->lastValues_next= 0;
         hedge->haveNewValues_=false;
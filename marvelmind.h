@@ -149,6 +149,9 @@ struct MarvelmindHedge
 //  receiveDataCallback is callback function to recieve data
     void (*receiveDataCallback)(struct PositionValue position);
     void (*anyInputPacketCallback)();
+//  IMU callbacks are called from the receive thread for every IMU datagram
+    void (*receiveRawIMUCallback)(struct RawIMUValue rawIMU);
+    void (*receiveFusionIMUCallback)(struct FusionIMUValue fusionIMU);
 
 // private variables
     uint8_t lastValuesCount_;
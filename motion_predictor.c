@@ -0,0 +1,305 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "motion_predictor.h"
+
+#define BONE_LEARN_RATE 0.05f
+#define LATENCY_SMOOTHING 0.1
+
+void motion_predictor_default_config(struct MotionPredictorConfig* config)
+{
+    config->horizonUsec = 50000;
+    config->measureLatency = false;
+    config->maxHorizonUsec = 200000;
+    config->alpha = 0.5f;
+    config->beta = 0.3f;
+    config->gamma = 0.05f;
+    config->rotationSmoothing = 0.3f;
+    config->maxSpeed = 5000.0f;      // faster than any limb motion
+    config->maxAngularSpeed = 12.0f; // ~700 deg/s
+    config->boneTolerance = 0.1f;
+    config->resetGapUsec = 250000;
+}
+
+void motion_predictor_init(struct MotionPredictor* p, const struct MotionPredictorConfig* config)
+{
+    memset(p, 0, sizeof(*p));
+    if (config != NULL)
+        p->config = *config;
+    else
+        motion_predictor_default_config(&p->config);
+
+    latency_stats_init(&p->predictionError, "prediction error");
+    latency_stats_init(&p->holdError, "unpredicted error");
+    latency_stats_init(&p->horizon, "prediction horizon");
+    p->predictionError.unit = "um";
+    p->holdError.unit = "um";
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Tracking
+
+static void reset_body(struct BodyMotion* m, const struct SkeletonFrame* frame, uint32_t b)
+{
+    m->bodyId = frame->bodyIds[b];
+    m->samples = 1;
+    m->lastUsec = frame->timestampUsec;
+    m->pendingCount = 0;
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        struct JointMotion* jm = &m->joints[j];
+        jm->p = frame->positions[b][j];
+        jm->v = vec3_make(0, 0, 0);
+        jm->a = vec3_make(0, 0, 0);
+        jm->w = vec3_make(0, 0, 0);
+        m->lastRotations[j] = frame->worldRotations[b][j];
+        m->lastObserved[j] = frame->positions[b][j];
+
+        int parent = skeleton_joint_parent[j];
+        m->boneLength[j] = parent < 0 ? 0.0f :
+            vec3_length(vec3_sub(frame->positions[b][j], frame->positions[b][parent]));
+    }
+}
+
+static float mean_joint_error(const vec3_t* a, const vec3_t* b)
+{
+    float sum = 0.0f;
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        sum += vec3_length(vec3_sub(a[j], b[j]));
+    return sum / SKELETON_JOINT_COUNT;
+}
+
+// Compare predictions whose target lies between the previous and the current
+// observation against the observed pose interpolated at the target time
+static void score_predictions(struct BodyMotion* m, const vec3_t* observed, int64_t t)
+{
+    int64_t t_prev = m->lastUsec;
+    while (m->pendingCount > 0)
+    {
+        struct PendingPrediction* pending = &m->pending[m->pendingHead];
+        if (pending->targetUsec > t)
+            break;
+
+        if (pending->targetUsec >= t_prev && t > t_prev)
+        {
+            vec3_t actual[SKELETON_JOINT_COUNT];
+            float u = (float)(pending->targetUsec - t_prev) / (float)(t - t_prev);
+            for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+                actual[j] = vec3_lerp(m->lastObserved[j], observed[j], u);
+
+            // kept with the body until collected, bodies are observed concurrently
+            if (m->scoredCount < MOTION_PENDING_PREDICTIONS)
+            {
+                int i = m->scoredCount++;
+                m->scoredPrediction[i] = (int64_t)(mean_joint_error(pending->predicted, actual) * 1000.0f);
+                m->scoredHold[i] = (int64_t)(mean_joint_error(pending->held, actual) * 1000.0f);
+            }
+        }
+        m->pendingHead = (m->pendingHead + 1) % MOTION_PENDING_PREDICTIONS;
+        m->pendingCount--;
+    }
+}
+
+static void update_body(struct MotionPredictor* p, struct BodyMotion* m, const struct SkeletonFrame* frame, uint32_t b)
+{
+    const struct MotionPredictorConfig* c = &p->config;
+    float dt = (float)(frame->timestampUsec - m->lastUsec) * 1e-6f;
+    if (dt <= 0.0f)
+        return;
+
+    score_predictions(m, frame->positions[b], frame->timestampUsec);
+
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        struct JointMotion* jm = &m->joints[j];
+        vec3_t z = frame->positions[b][j];
+
+        // alpha-beta-gamma: predict to the sample time, correct by the residual
+        vec3_t p_pred = vec3_add(jm->p, vec3_add(vec3_scale(jm->v, dt), vec3_scale(jm->a, 0.5f * dt * dt)));
+        vec3_t v_pred = vec3_add(jm->v, vec3_scale(jm->a, dt));
+        vec3_t r = vec3_sub(z, p_pred);
+        jm->p = vec3_add(p_pred, vec3_scale(r, c->alpha));
+        jm->v = vec3_add(v_pred, vec3_scale(r, c->beta / dt));
+        jm->a = vec3_add(jm->a, vec3_scale(r, 2.0f * c->gamma / (dt * dt)));
+
+        // world angular velocity from consecutive rotations
+        quat_t q = frame->worldRotations[b][j];
+        quat_t dq = quat_mul(q, quat_conj(m->lastRotations[j]));
+        if (dq.w < 0.0f)
+            dq = quat_make(-dq.w, -dq.x, -dq.y, -dq.z);
+        vec3_t w = vec3_scale(quat_to_rotvec(dq), 1.0f / dt);
+        jm->w = vec3_lerp(jm->w, w, c->rotationSmoothing);
+        m->lastRotations[j] = q;
+
+        // learn bone lengths from joints the tracker actually saw
+        int parent = skeleton_joint_parent[j];
+        if (parent >= 0 &&
+            frame->confidence[b][j] >= CONFIDENCE_MEDIUM && frame->confidence[b][parent] >= CONFIDENCE_MEDIUM)
+        {
+            float length = vec3_length(vec3_sub(z, frame->positions[b][parent]));
+            m->boneLength[j] += (length - m->boneLength[j]) * BONE_LEARN_RATE;
+        }
+        m->lastObserved[j] = z;
+    }
+    m->lastUsec = frame->timestampUsec;
+    m->samples++;
+}
+
+void motion_predictor_observe_body(struct MotionPredictor* p, const struct SkeletonFrame* frame, uint32_t b)
+{
+    uint8_t slot = frame->slots[b];
+    if (slot >= MAX_BODY_SLOTS)
+        return;
+
+    struct BodyMotion* m = &p->bodies[slot];
+    if (m->samples == 0 || m->bodyId != frame->bodyIds[b] ||
+        frame->timestampUsec - m->lastUsec > p->config.resetGapUsec)
+        reset_body(m, frame, b);
+    else
+        update_body(p, m, frame, b);
+}
+
+void motion_predictor_collect(struct MotionPredictor* p)
+{
+    for (int slot = 0; slot < MAX_BODY_SLOTS; slot++)
+    {
+        struct BodyMotion* m = &p->bodies[slot];
+        for (int i = 0; i < m->scoredCount; i++)
+        {
+            latency_stats_add(&p->predictionError, m->scoredPrediction[i]);
+            latency_stats_add(&p->holdError, m->scoredHold[i]);
+        }
+        m->scoredCount = 0;
+    }
+}
+
+void motion_predictor_observe(struct MotionPredictor* p, const struct SkeletonFrame* frame)
+{
+    for (uint32_t b = 0; b < frame->bodyCount; b++)
+        motion_predictor_observe_body(p, frame, b);
+    motion_predictor_collect(p);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Prediction
+
+static vec3_t clamp_length(vec3_t v, float max_length)
+{
+    float length = vec3_length(v);
+    if (length > max_length && length > 0.0f)
+        return vec3_scale(v, max_length / length);
+    return v;
+}
+
+static void predict_body(const struct MotionPredictorConfig* c, const struct BodyMotion* m,
+                         float h, struct SkeletonFrame* frame, uint32_t b)
+{
+    vec3_t* positions = frame->positions[b];
+    quat_t* rotations = frame->worldRotations[b];
+
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        const struct JointMotion* jm = &m->joints[j];
+        vec3_t step = vec3_add(vec3_scale(jm->v, h), vec3_scale(jm->a, 0.5f * h * h));
+        positions[j] = vec3_add(jm->p, clamp_length(step, c->maxSpeed * h));
+
+        vec3_t turn = clamp_length(vec3_scale(jm->w, h), c->maxAngularSpeed * h);
+        rotations[j] = quat_normalize(quat_mul(quat_from_rotvec(turn), rotations[j]));
+    }
+
+    // Keep bones near their learned length. Parents precede children, so each
+    // bone is re-attached to its already corrected parent.
+    for (int j = 1; j < SKELETON_JOINT_COUNT; j++)
+    {
+        int parent = skeleton_joint_parent[j];
+        float rest = m->boneLength[j];
+        if (parent < 0 || rest <= 0.0f)
+            continue;
+
+        vec3_t bone = vec3_sub(positions[j], positions[parent]);
+        float length = vec3_length(bone);
+        float lo = rest * (1.0f - c->boneTolerance);
+        float hi = rest * (1.0f + c->boneTolerance);
+        if (length > 0.0f && (length < lo || length > hi))
+            bone = vec3_scale(bone, (length < lo ? lo : hi) / length);
+        positions[j] = vec3_add(positions[parent], bone);
+    }
+}
+
+static void remember_prediction(struct BodyMotion* m, int64_t target, const vec3_t* predicted)
+{
+    struct PendingPrediction* pending;
+    if (m->pendingCount < MOTION_PENDING_PREDICTIONS)
+    {
+        pending = &m->pending[(m->pendingHead + m->pendingCount) % MOTION_PENDING_PREDICTIONS];
+        m->pendingCount++;
+    }
+    else
+    {
+        // horizon longer than the ring: overwrite the oldest
+        pending = &m->pending[m->pendingHead];
+        m->pendingHead = (m->pendingHead + 1) % MOTION_PENDING_PREDICTIONS;
+    }
+    pending->targetUsec = target;
+    memcpy(pending->predicted, predicted, sizeof(pending->predicted));
+    memcpy(pending->held, m->lastObserved, sizeof(pending->held));
+}
+
+int64_t motion_predictor_horizon(struct MotionPredictor* p, const struct SkeletonFrame* frame, int64_t now_usec)
+{
+    const struct MotionPredictorConfig* c = &p->config;
+
+    int64_t horizon = c->horizonUsec;
+    if (c->measureLatency)
+    {
+        int64_t age = now_usec - frame->timestampUsec;
+        if (age > 0)
+            p->measuredLatencyUsec += (int64_t)((age - p->measuredLatencyUsec) * LATENCY_SMOOTHING);
+        horizon += p->measuredLatencyUsec;
+    }
+    if (horizon > c->maxHorizonUsec)
+        horizon = c->maxHorizonUsec;
+    if (horizon <= 0)
+        return 0;
+    latency_stats_add(&p->horizon, horizon);
+    return horizon;
+}
+
+void motion_predictor_apply_body(struct MotionPredictor* p, struct SkeletonFrame* frame, uint32_t b,
+                                 int64_t horizon_usec)
+{
+    uint8_t slot = frame->slots[b];
+    if (horizon_usec <= 0 || slot >= MAX_BODY_SLOTS)
+        return;
+    struct BodyMotion* m = &p->bodies[slot];
+    if (m->samples < 2 || m->bodyId != frame->bodyIds[b])
+        return;// no velocity yet
+
+    // filter state is at the capture time of the newest sample
+    float h = (float)(frame->timestampUsec + horizon_usec - m->lastUsec) * 1e-6f;
+    predict_body(&p->config, m, h, frame, b);
+    remember_prediction(m, frame->timestampUsec + horizon_usec, frame->positions[b]);
+}
+
+void motion_predictor_apply(struct MotionPredictor* p, struct SkeletonFrame* frame, int64_t now_usec)
+{
+    int64_t horizon = motion_predictor_horizon(p, frame, now_usec);
+    for (uint32_t b = 0; horizon > 0 && b < frame->bodyCount; b++)
+        motion_predictor_apply_body(p, frame, b, horizon);
+}
+
+void motion_predictor_report(struct MotionPredictor* p, int64_t now_usec, int64_t interval_usec)
+{
+    if (now_usec - p->lastReportUsec < interval_usec)
+        return;
+    if (p->lastReportUsec != 0)
+    {
+        latency_stats_print(&p->horizon);
+        latency_stats_print(&p->predictionError);
+        latency_stats_print(&p->holdError);
+    }
+    latency_stats_reset(&p->horizon);
+    latency_stats_reset(&p->predictionError);
+    latency_stats_reset(&p->holdError);
+    p->lastReportUsec = now_usec;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+#include "body_slots.h"
+#include "latency_stats.h"
+
+// Latency compensation: extrapolates outgoing skeletons forward in time so the
+// pose the receiver renders matches where the person is now, not where they
+// were when the camera saw them.
+//
+// Every joint of every slot is tracked by an alpha-beta-gamma filter
+// (position, velocity, acceleration) and joint rotations by a smoothed world
+// angular velocity. The extrapolated pose is then clamped: per-joint speed is
+// limited and each bone is kept within a tolerance of its learned length, so
+// a noisy velocity never stretches a limb.
+//
+// Each prediction is kept until the camera observes its target time, and the
+// mean joint error is recorded next to the error of sending the pose
+// unpredicted, which shows whether the horizon helps.
+
+#define MOTION_PENDING_PREDICTIONS 8
+
+struct MotionPredictorConfig
+{
+    int64_t horizonUsec;    // fixed look-ahead (network + receiver + render)
+    bool measureLatency;    // also add the measured capture-to-send age
+    int64_t maxHorizonUsec; // never extrapolate further than this
+
+    float alpha;            // alpha-beta-gamma gains
+    float beta;
+    float gamma;
+    float rotationSmoothing;// EMA weight of new angular velocity samples
+
+    float maxSpeed;         // mm/s, clamp of the extrapolated joint motion
+    float maxAngularSpeed;  // rad/s
+    float boneTolerance;    // allowed relative deviation from bone length
+    int64_t resetGapUsec;   // restart tracking after a gap this long
+};
+
+struct JointMotion
+{
+    vec3_t p;// mm
+    vec3_t v;// mm/s
+    vec3_t a;// mm/s^2
+    vec3_t w;// world angular velocity, rad/s
+};
+
+struct PendingPrediction
+{
+    int64_t targetUsec;
+    vec3_t predicted[SKELETON_JOINT_COUNT];
+    vec3_t held[SKELETON_JOINT_COUNT];// pose sent without prediction
+};
+
+struct BodyMotion
+{
+    uint32_t bodyId;
+    uint32_t samples;// 0 = slot unused
+    int64_t lastUsec;
+
+    struct JointMotion joints[SKELETON_JOINT_COUNT];
+    quat_t lastRotations[SKELETON_JOINT_COUNT];
+    vec3_t lastObserved[SKELETON_JOINT_COUNT];
+    float boneLength[SKELETON_JOINT_COUNT];// mm, joint to its parent
+
+    struct PendingPrediction pending[MOTION_PENDING_PREDICTIONS];
+    int pendingHead;
+    int pendingCount;
+
+    // errors of predictions scored by the last observation, um
+    int64_t scoredPrediction[MOTION_PENDING_PREDICTIONS];
+    int64_t scoredHold[MOTION_PENDING_PREDICTIONS];
+    int scoredCount;
+};
+
+struct MotionPredictor
+{
+    struct MotionPredictorConfig config;
+    struct BodyMotion bodies[MAX_BODY_SLOTS];
+
+    int64_t measuredLatencyUsec;// smoothed capture-to-predict age
+
+    struct LatencyStats predictionError;// mean joint error, um
+    struct LatencyStats holdError;      // same without prediction, um
+    struct LatencyStats horizon;        // applied look-ahead, us
+    int64_t lastReportUsec;
+};
+
+void motion_predictor_default_config(struct MotionPredictorConfig* config);
+void motion_predictor_init(struct MotionPredictor* predictor, const struct MotionPredictorConfig* config);
+
+// Feed a processed camera frame (bodies keyed by receiver slot): updates the
+// motion filters and scores earlier predictions that reached their target time
+void motion_predictor_observe(struct MotionPredictor* predictor, const struct SkeletonFrame* frame);
+
+// Replace positions and world rotations of the frame's bodies by their
+// predicted pose one horizon past the capture time. Call after observe.
+void motion_predictor_apply(struct MotionPredictor* predictor, struct SkeletonFrame* frame, int64_t now_usec);
+
+// The same split per body, for running the bodies of a frame concurrently:
+// observe_body and apply_body only touch the slot of body b. collect adds
+// the scored errors to the statistics; horizon updates the latency estimate
+// and returns the look-ahead for apply_body (0: leave the frame as is).
+void motion_predictor_observe_body(struct MotionPredictor* predictor, const struct SkeletonFrame* frame, uint32_t b);
+void motion_predictor_collect(struct MotionPredictor* predictor);
+int64_t motion_predictor_horizon(struct MotionPredictor* predictor, const struct SkeletonFrame* frame,
+                                 int64_t now_usec);
+void motion_predictor_apply_body(struct MotionPredictor* predictor, struct SkeletonFrame* frame, uint32_t b,
+                                 int64_t horizon_usec);
+
+// Print and reset the error statistics every interval_usec
+void motion_predictor_report(struct MotionPredictor* predictor, int64_t now_usec, int64_t interval_usec);
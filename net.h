@@ -0,0 +1,40 @@
+#pragma once
+// Socket portability: Winsock on Windows, BSD sockets elsewhere.
+#ifdef WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib,"ws2_32.lib") //Winsock Library
+#define socket_error() WSAGetLastError()
+#else
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+typedef int SOCKET;
+typedef struct sockaddr_in SOCKADDR_IN;
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR (-1)
+#define closesocket close
+#define socket_error() errno
+#endif // WIN32
+
+// WSAStartup / WSACleanup on Windows, nothing elsewhere
+static inline int net_startup(void)
+{
+#ifdef WIN32
+    WSADATA wsdata;
+    return WSAStartup(MAKEWORD(2, 2), &wsdata);
+#else
+    return 0;
+#endif
+}
+
+static inline void net_cleanup(void)
+{
+#ifdef WIN32
+    WSACleanup();
+#endif
+}
@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "options.h"
+#include "protocol.h"
+#include "skp_stream.h"
+#include "rate_control.h"
+
+#define DEFAULT_DEST_HOST "192.168.0.24"
+#define DEFAULT_DEST_PORT 8080
+
+void default_options(struct AppOptions* options)
+{
+    memset(options, 0, sizeof(*options));
+    options->fusionGateMm = 300;
+    options->workers = -1;
+    options->hedgeTty = NULL;
+    options->hedgeKinect = 0;
+    options->hedgeMountOffset = vec3_make(0.0f, 0.0f, 0.0f);
+    options->hedgeMountRotation = kinect_level_orientation();
+    options->destCount = 0;// DEFAULT_DEST_HOST unless --dest or --multicast is given
+    options->multicast = false;
+    options->multicastTtl = 1;
+    options->multicastInterface = NULL;
+    options->shmName = NULL;
+    options->format = OUTPUT_FORMAT_TEXT;
+    options->rotations = SKP_LOCAL_ROTATIONS;
+    options->fecGroup = 0;
+    options->encodingLevel = RATE_LEVEL_FULL;
+    options->adaptive = false;
+    options->pcaBasisPath = NULL;
+    options->pcaComponents = 24;
+    options->pcaMaxErrorMm = 50;
+    options->bandwidthKbps = 0;
+    options->latencyBudgetMs = 30;
+    options->farDistanceMm = 4000;
+    options->slotGraceMs = 500;
+    options->outputRateHz = 0;
+    options->outputDelayMs = 40;
+    options->boneTolerancePct = 0;
+    options->predictMs = 0;
+    options->predictMeasured = false;
+    options->maxAgeMs = 100;
+}
+
+// Split "host[:port]" in place
+static bool parse_endpoint(char* value, const char** host, uint16_t* port)
+{
+    char* colon = strrchr(value, ':');
+    if (colon != NULL)
+    {
+        long p = strtol(colon + 1, NULL, 10);
+        if (p <= 0 || p > 65535)
+            return false;
+        *colon = '\0';
+        *port = (uint16_t)p;
+    }
+    *host = value;
+    return true;
+}
+
+static bool parse_encoding(const char* value, struct AppOptions* options)
+{
+    options->adaptive = strcmp(value, "auto") == 0;
+    if (options->adaptive)
+    {
+        options->encodingLevel = RATE_LEVEL_FULL;
+        return true;
+    }
+    for (int l = 0; l < RATE_LEVEL_COUNT; l++)
+    {
+        if (strcmp(value, rate_levels[l].name) == 0)
+        {
+            options->encodingLevel = l;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_kinect(const char* value, struct KinectSourceOptions* source)
+{
+    memset(source, 0, sizeof(*source));
+    source->orientation = kinect_level_orientation();
+    char* end;
+    long index = strtol(value, &end, 10);
+    if (*value != '\0' && *end == '\0')
+    {
+        source->device = (int)index;
+        return index >= 0;
+    }
+    source->device = -1;
+    source->recording = value;
+    return true;
+}
+
+// <x>,<y>,<z>[,<qw>,<qx>,<qy>,<qz>]; orientation is left as it is without
+// the quaternion
+static bool parse_transform(const char* value, vec3_t* position, quat_t* orientation)
+{
+    float v[7];
+    int n = sscanf(value, "%f,%f,%f,%f,%f,%f,%f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]);
+    if (n != 3 && n != 7)
+        return false;
+    *position = vec3_make(v[0], v[1], v[2]);
+    if (n == 7)
+        *orientation = quat_normalize(quat_make(v[3], v[4], v[5], v[6]));
+    return true;
+}
+
+static bool parse_pose(const char* value, struct KinectSourceOptions* source)
+{
+    source->fixedPose = true;
+    source->orientation = kinect_level_orientation();
+    return parse_transform(value, &source->position, &source->orientation);
+}
+
+static bool parse_cpus(const char* value, struct AppOptions* options)
+{
+    options->cpuCount = 0;
+    while (*value != '\0' && options->cpuCount < MAX_KINECTS)
+    {
+        char* end;
+        long cpu = strtol(value, &end, 10);
+        if (end == value || cpu < 0 || (*end != ',' && *end != '\0'))
+            return false;
+        options->cpus[options->cpuCount++] = (int)cpu;
+        value = *end == ',' ? end + 1 : end;
+    }
+    return options->cpuCount > 0;
+}
+
+static bool parse_rotations(const char* value, uint8_t* rotations)
+{
+    if (strcmp(value, "none") == 0)
+        *rotations = 0;
+    else if (strcmp(value, "world") == 0)
+        *rotations = SKP_WORLD_ROTATIONS;
+    else if (strcmp(value, "local") == 0)
+        *rotations = SKP_LOCAL_ROTATIONS;
+    else if (strcmp(value, "both") == 0)
+        *rotations = SKP_WORLD_ROTATIONS | SKP_LOCAL_ROTATIONS;
+    else
+        return false;
+    return true;
+}
+
+bool parse_options(int argc, char** argv, struct AppOptions* options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (value == NULL)
+        {
+            printf("Missing value for option %s\n", arg);
+            return false;
+        }
+        i++;
+
+        bool ok = true;
+        if (strcmp(arg, "--kinect") == 0)
+        {
+            ok = options->kinectCount < MAX_KINECTS &&
+                 parse_kinect(value, &options->kinects[options->kinectCount]);
+            if (ok)
+                options->kinectCount++;
+        }
+        else if (strcmp(arg, "--kinect-pose") == 0)
+            ok = options->kinectCount > 0 && parse_pose(value, &options->kinects[options->kinectCount - 1]);
+        else if (strcmp(arg, "--affinity") == 0)
+            ok = parse_cpus(value, options);
+        else if (strcmp(arg, "--extrinsics") == 0)
+            options->extrinsicsPath = value;
+        else if (strcmp(arg, "--fusion") == 0)
+            options->fusionGateMm = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--zones") == 0)
+            options->zonesPath = value;
+        else if (strcmp(arg, "--gestures") == 0)
+            options->gesturesPath = value;
+        else if (strcmp(arg, "--pose-index") == 0)
+            options->poseIndexPath = value;
+        else if (strcmp(arg, "--retarget") == 0)
+            options->retargetPath = value;
+        else if (strcmp(arg, "--workers") == 0)
+            options->workers = atoi(value);
+        else if (strcmp(arg, "--hedge") == 0)
+            options->hedgeTty = value;
+        else if (strcmp(arg, "--hedge-kinect") == 0)
+        {
+            options->hedgeKinect = atoi(value);
+            ok = options->hedgeKinect >= 0 && options->hedgeKinect < MAX_KINECTS;
+        }
+        else if (strcmp(arg, "--hedge-mount") == 0)
+            ok = parse_transform(value, &options->hedgeMountOffset, &options->hedgeMountRotation);
+        else if (strcmp(arg, "--dest") == 0 || strcmp(arg, "--multicast") == 0 || strcmp(arg, "--events-dest") == 0)
+        {
+            ok = options->destCount < MAX_DESTINATIONS;
+            if (ok)
+            {
+                options->destPorts[options->destCount] = DEFAULT_DEST_PORT;
+                ok = parse_endpoint(value, &options->destHosts[options->destCount],
+                                    &options->destPorts[options->destCount]);
+                if (ok && strcmp(arg, "--multicast") == 0)
+                {
+                    struct in_addr group;
+                    ok = inet_pton(AF_INET, value, &group) == 1 && IN_MULTICAST(ntohl(group.s_addr));
+                    options->multicast = true;
+                }
+                options->destEventsOnly[options->destCount] = strcmp(arg, "--events-dest") == 0;
+                options->destRotations[options->destCount] = DEST_ROTATIONS_DEFAULT;
+                options->destCount++;
+            }
+        }
+        else if (strcmp(arg, "--dest-rotations") == 0)
+            ok = options->destCount > 0 && parse_rotations(value, &options->destRotations[options->destCount - 1]);
+        else if (strcmp(arg, "--multicast-ttl") == 0)
+        {
+            options->multicastTtl = atoi(value);
+            ok = options->multicastTtl >= 0 && options->multicastTtl <= 255;
+        }
+        else if (strcmp(arg, "--multicast-if") == 0)
+            options->multicastInterface = value;
+        else if (strcmp(arg, "--shm") == 0)
+            options->shmName = value;
+        else if (strcmp(arg, "--format") == 0)
+        {
+            if (strcmp(value, "text") == 0)
+                options->format = OUTPUT_FORMAT_TEXT;
+            else if (strcmp(value, "binary") == 0)
+                options->format = OUTPUT_FORMAT_BINARY;
+            else
+                ok = false;
+        }
+        else if (strcmp(arg, "--rotations") == 0)
+            ok = parse_rotations(value, &options->rotations);
+        else if (strcmp(arg, "--fec") == 0)
+        {
+            unsigned long k = strtoul(value, NULL, 10);
+            ok = k == 0 || (k >= 2 && k <= SKP_FEC_MAX_GROUP);
+            options->fecGroup = (uint8_t)k;
+        }
+        else if (strcmp(arg, "--encoding") == 0)
+            ok = parse_encoding(value, options);
+        else if (strcmp(arg, "--pca-basis") == 0)
+            options->pcaBasisPath = value;
+        else if (strcmp(arg, "--pca-components") == 0)
+        {
+            options->pcaComponents = atoi(value);
+            ok = options->pcaComponents >= 1 && options->pcaComponents <= POSE_BASIS_MAX_COMPONENTS;
+        }
+        else if (strcmp(arg, "--pca-max-error") == 0)
+            options->pcaMaxErrorMm = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--bandwidth") == 0)
+            options->bandwidthKbps = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--latency-budget") == 0)
+            options->latencyBudgetMs = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--far") == 0)
+            options->farDistanceMm = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--slot-grace") == 0)
+            options->slotGraceMs = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--output-rate") == 0)
+        {
+            options->outputRateHz = (uint32_t)strtoul(value, NULL, 10);
+            ok = options->outputRateHz <= 1000;
+        }
+        else if (strcmp(arg, "--output-delay") == 0)
+            options->outputDelayMs = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--bone-tolerance") == 0)
+            options->boneTolerancePct = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--predict") == 0)
+            options->predictMs = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--max-age") == 0)
+            options->maxAgeMs = (uint32_t)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--predict-latency") == 0)
+        {
+            if (strcmp(value, "fixed") == 0)
+                options->predictMeasured = false;
+            else if (strcmp(value, "measured") == 0)
+                options->predictMeasured = true;
+            else
+                ok = false;
+        }
+        else
+        {
+            printf("Unknown option %s\n", arg);
+            return false;
+        }
+
+        if (!ok)
+        {
+            printf("Invalid value '%s' for option %s\n", value, arg);
+            return false;
+        }
+    }
+
+    if (options->destCount == 0)
+    {
+        options->destHosts[0] = DEFAULT_DEST_HOST;
+        options->destPorts[0] = DEFAULT_DEST_PORT;
+        options->destRotations[0] = DEST_ROTATIONS_DEFAULT;
+        options->destCount = 1;
+    }
+    // --rotations may follow the destinations it is the default of
+    for (int d = 0; d < options->destCount; d++)
+    {
+        if (options->destRotations[d] == DEST_ROTATIONS_DEFAULT)
+            options->destRotations[d] = options->rotations;
+    }
+    return true;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "udp_sender.h"
+#include "skeleton.h"
+
+// Command line options of the tracking app
+//   --kinect <index>|<file.mkv>
+//                             a Kinect by device index, or a recording replayed in
+//                             real time and looped; repeat the option for several
+//                             cameras (default: every installed device)
+//   --kinect-pose <x>,<y>,<z>[,<qw>,<qx>,<qy>,<qz>]
+//                             world pose of the preceding --kinect, mm, z up
+//                             (default orientation: level, looking along +y);
+//                             without one the --hedge-kinect camera follows the
+//                             Marvelmind hedge and the others stand level at the
+//                             origin
+//   --affinity <cpu>[,<cpu>...]
+//                             pin the pipeline thread of the n-th camera to the
+//                             n-th CPU of the list
+//   --extrinsics <file>       camera poses written by calibrate_extrinsics, by
+//                             camera number; --kinect-pose takes precedence
+//   --fusion <mm>             merge bodies several cameras see into one person when
+//                             their joints are this close on average (default
+//                             300, 0 = send every camera's bodies separately)
+//   --zones <file>            zones and proximity rules to send enter/exit/near
+//                             events for (zone_events.h, binary format only)
+//   --gestures <file>         gesture and posture rules to send start/end events
+//                             for (gesture_events.h, binary format only)
+//   --pose-index <file>       pose library built by pose_index_build; every body
+//                             is matched against it each frame and its nearest
+//                             reference pose sent (pose_match.h, binary format only)
+//   --retarget <file>         target skeleton (e.g. mannequin.retarget); every body
+//                             is also sent posed on it, as bone rotations
+//                             (retarget.h, binary format only)
+//   --workers <n>             threads that help the output stage with the bodies
+//                             of large frames (default one per core, 0 = none)
+//   --hedge <tty>             serial port of the Marvelmind hedge on the Kinect,
+//                             opened only if that camera has no fixed pose
+//   --hedge-kinect <n>        camera number the hedge is mounted on (default 0)
+//   --hedge-mount <x>,<y>,<z>[,<qw>,<qx>,<qy>,<qz>]
+//                             camera origin in the hedge body frame (mm) and the
+//                             rotation from camera to hedge body (default: at the
+//                             hedge, hedge level on the camera with y along the view)
+//   --dest <ip>[:port]        receiver address (default 192.168.0.24:8080); repeat
+//                             the option to send every frame to several receivers
+//   --dest-rotations none|world|local|both
+//                             joint rotations the preceding --dest or --multicast
+//                             subscribes to (default: --rotations)
+//   --events-dest <ip>[:port] receiver of slot, zone and gesture events and pose
+//                             matches only, no bodies (binary format only)
+//   --multicast <group>[:port]
+//                             publish to a multicast group (may be combined with --dest)
+//   --multicast-ttl <hops>    multicast TTL (default 1, stays on the local subnet)
+//   --multicast-if <ip>       address of the interface to send multicast on
+//   --shm <name>              also publish frames to a shared-memory ring for
+//                             receivers on this host (e.g. /body_tracking)
+//   --format text|binary      legacy per-joint text lines or binary body datagrams
+//   --rotations none|world|local|both
+//                             joint rotations of the destinations without a
+//                             --dest-rotations (binary format only, default local)
+//   --fec <k>                 one XOR parity datagram per k datagrams so receivers
+//                             can repair single losses (binary format only,
+//                             2..16, default 0 = off)
+//   --encoding full|quantized|delta|delta-far|core|pca|auto
+//                             body encoding of the binary format (rate_control.h);
+//                             auto starts at full and adapts every receiver from
+//                             its feedback, down to pca if a basis is given
+//                             (default full)
+//   --pca-basis <file>        pose basis written by pose_basis_learn for the pca
+//                             encoding; receivers load the same file
+//   --pca-components <k>      pose coefficients per body (default 24)
+//   --pca-max-error <mm>      bodies the basis rebuilds worse go out quantized
+//                             (default 50)
+//   --bandwidth <kbit/s>      per receiver budget for auto (default 0 = no limit)
+//   --latency-budget <ms>     receiver jitter + processing budget for auto (default 30)
+//   --far <mm>                bodies farther from the camera get fewer updates in
+//                             the delta-far and core encodings (default 4000)
+//   --slot-grace <ms>         keep a lost body's receiver slot this long (default 500)
+//   --output-rate <hz>        send interpolated frames at a fixed rate instead of
+//                             on every camera frame (default 0 = camera rate)
+//   --output-delay <ms>       render delay of the fixed-rate output (default 40)
+//   --bone-tolerance <%>      repair or reject joints whose bone is off its learned
+//                             length by more than this, turns or moves faster than
+//                             a person can or folds back too far (outlier_filter.h,
+//                             default 0 = off, 20 suits k4abt)
+//   --predict <ms>            extrapolate skeletons this far ahead (default 0 = off)
+//   --predict-latency fixed|measured
+//                             measured adds the observed capture-to-send age
+//                             (and output delay) to the --predict horizon
+//   --max-age <ms>            drop captures and body frames older than this
+//                             (default 100, 0 = process every frame)
+
+struct KinectSourceOptions
+{
+    int device;           // device index, -1 for a recording
+    const char* recording;
+    bool fixedPose;       // else the pose comes from the hedge
+    vec3_t position;      // mm, world
+    quat_t orientation;   // camera -> world, level by default
+};
+
+#define DEST_ROTATIONS_DEFAULT 0xff
+
+enum OutputFormat
+{
+    OUTPUT_FORMAT_TEXT,
+    OUTPUT_FORMAT_BINARY,
+};
+
+struct AppOptions
+{
+    struct KinectSourceOptions kinects[MAX_KINECTS];
+    int kinectCount;// 0 = every installed device
+    int cpus[MAX_KINECTS];
+    int cpuCount;
+    const char* extrinsicsPath;
+    uint32_t fusionGateMm;
+    const char* zonesPath;
+    const char* gesturesPath;
+    const char* poseIndexPath;
+    const char* retargetPath;
+    int workers;// -1 = one per core besides the caller
+    const char* hedgeTty;
+    int hedgeKinect;// camera number, counted as --kinect or the installed devices
+    vec3_t hedgeMountOffset;  // mm, camera origin in the hedge body frame
+    quat_t hedgeMountRotation;// camera -> hedge body
+    const char* destHosts[MAX_DESTINATIONS];
+    uint16_t destPorts[MAX_DESTINATIONS];
+    bool destEventsOnly[MAX_DESTINATIONS];
+    uint8_t destRotations[MAX_DESTINATIONS];// enum SkpFlags, DEST_ROTATIONS_DEFAULT = --rotations
+    int destCount;
+    bool multicast;
+    int multicastTtl;
+    const char* multicastInterface;
+    const char* shmName;
+    enum OutputFormat format;
+    uint8_t rotations;// enum SkpFlags, of destinations without their own
+    uint8_t fecGroup;
+    int encodingLevel;// enum RateLevel
+    bool adaptive;
+    const char* pcaBasisPath;
+    int pcaComponents;
+    uint32_t pcaMaxErrorMm;
+    uint32_t bandwidthKbps;
+    uint32_t latencyBudgetMs;
+    uint32_t farDistanceMm;
+    uint32_t slotGraceMs;
+    uint32_t outputRateHz;
+    uint32_t outputDelayMs;
+    uint32_t boneTolerancePct;
+    uint32_t predictMs;
+    bool predictMeasured;
+    uint32_t maxAgeMs;
+};
+
+void default_options(struct AppOptions* options);
+bool parse_options(int argc, char** argv, struct AppOptions* options);
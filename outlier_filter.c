@@ -0,0 +1,374 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "outlier_filter.h"
+#include "platform.h"
+
+#define N SKELETON_JOINT_COUNT
+#define MIN_BONE_MM 1.0f
+
+enum OutlierCheck
+{
+    OUTLIER_LENGTH = 1,
+    OUTLIER_TURN = 2,
+    OUTLIER_SPEED = 4,
+    OUTLIER_BEND = 8,
+    OUTLIER_CHILDREN = 16,
+};
+
+// Furthest a bone may fold back onto its parent's bone, degrees; the joints
+// not listed bend freely
+static const struct
+{
+    int joint;
+    float degrees;
+} bend_limits[] = {
+    { JOINT_SPINE_CHEST, 90.0f },// at the navel
+    { JOINT_NECK, 90.0f },       // at the chest
+    { JOINT_HEAD, 120.0f },      // at the neck
+    { JOINT_WRIST_LEFT, 165.0f },// elbows
+    { JOINT_WRIST_RIGHT, 165.0f },
+    { JOINT_ANKLE_LEFT, 165.0f },// knees
+    { JOINT_ANKLE_RIGHT, 165.0f },
+};
+
+void outlier_filter_default_config(struct OutlierFilterConfig* config)
+{
+    config->lengthTolerance = 0.2f;
+    config->noiseMm = 20.0f;
+    config->maxAngularSpeed = 15.0f;
+    config->maxSpeed = 10000.0f;
+    config->learnFrames = 30;
+    config->learnRate = 0.02f;
+    config->maxHoldUsec = 300000;
+    config->resetGapUsec = 250000;
+}
+
+void outlier_filter_init(struct OutlierFilter* f, const struct OutlierFilterConfig* config)
+{
+    memset(f, 0, sizeof(*f));
+    if (config != NULL)
+        f->config = *config;
+    else
+        outlier_filter_default_config(&f->config);
+
+    int children[N] = { 0 };
+    for (int j = 0; j < N; j++)
+    {
+        int parent = skeleton_joint_parent[j];
+        f->parent[j] = (int8_t)(parent < 0 ? j : parent);
+        f->cosBend[j] = -2.0f;
+        if (parent >= 0)
+            children[parent]++;
+    }
+    for (int j = 1; j < N; j++)
+        f->onlyChild[j] = children[f->parent[j]] == 1;
+    for (size_t i = 0; i < sizeof(bend_limits) / sizeof(bend_limits[0]); i++)
+        f->cosBend[bend_limits[i].joint] = cosf(bend_limits[i].degrees * 3.14159265f / 180.0f);
+
+    latency_stats_init(&f->updateTime, "outlier filter");
+    task_loop_init(&f->loop, "outliers", 1000);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks
+
+// One body in structure-of-arrays form: joints, bones to the parent and
+// the parent's bones, with 1 where both joints of a bone are in range
+struct BodyArrays
+{
+    float x[N], y[N], z[N];
+    float bx[N], by[N], bz[N];
+    float pbx[N], pby[N], pbz[N];
+    int32_t valid[N];
+    int32_t bone[N];
+    int32_t bend[N];// the bone and its parent's
+};
+
+// Failed checks of joints first..last-1 against model m. No branches and no
+// square roots (sqrtf may set errno, which keeps a loop scalar): lengths
+// compare squared and the bend compares the cosine times its magnitude, so
+// the loop vectorizes.
+static void check_joints(const struct OutlierFilter* f, const struct OutlierBody* m, const struct BodyArrays* a,
+                         float dt, int first, int last, int32_t* checks)
+{
+    const struct OutlierFilterConfig* c = &f->config;
+    float noise = c->noiseMm;
+    float learned = (float)c->learnFrames;
+    for (int j = first; j < last; j++)
+    {
+        float length = m->length[j];
+
+        float b2 = a->bx[j] * a->bx[j] + a->by[j] * a->by[j] + a->bz[j] * a->bz[j];
+        float margin = c->lengthTolerance * length + noise;
+        float longest = length + margin;
+        float shortest = length - margin;
+        int32_t bad_length = ((b2 > longest * longest) | ((b2 < shortest * shortest) & (shortest > 0.0f))) &
+                             (m->lengthSamples[j] >= learned) & a->bone[j];
+
+        float tx = a->bx[j] - m->boneX[j], ty = a->by[j] - m->boneY[j], tz = a->bz[j] - m->boneZ[j];
+        float turn = c->maxAngularSpeed * dt * length + 2.0f * noise;
+        int32_t bad_turn = (tx * tx + ty * ty + tz * tz > turn * turn) & a->bone[j] & m->boneSeen[j];
+
+        float dx = a->x[j] - m->x[j], dy = a->y[j] - m->y[j], dz = a->z[j] - m->z[j];
+        float move = c->maxSpeed * dt + 2.0f * noise;
+        int32_t bad_speed = (dx * dx + dy * dy + dz * dz > move * move) & a->valid[j] & m->seen[j];
+
+        float dot = a->bx[j] * a->pbx[j] + a->by[j] * a->pby[j] + a->bz[j] * a->pbz[j];
+        float pb2 = a->pbx[j] * a->pbx[j] + a->pby[j] * a->pby[j] + a->pbz[j] * a->pbz[j];
+        float cos_bend = f->cosBend[j];
+        int32_t bad_bend = (dot * fabsf(dot) < cos_bend * fabsf(cos_bend) * b2 * pb2) & a->bend[j];
+
+        checks[j] = bad_length * OUTLIER_LENGTH | bad_turn * OUTLIER_TURN | bad_speed * OUTLIER_SPEED |
+                    bad_bend * OUTLIER_BEND;
+    }
+}
+
+// Start the model of a slot over from the body as it is
+static void restart(struct OutlierBody* m, uint32_t body_id, bool keep_lengths)
+{
+    if (!keep_lengths)
+    {
+        memset(m->length, 0, sizeof(m->length));
+        memset(m->lengthSamples, 0, sizeof(m->lengthSamples));
+    }
+    m->bodyId = body_id;
+    m->samples = 0;
+    memset(m->age, 0, sizeof(m->age));
+    memset(m->seen, 0, sizeof(m->seen));
+    memset(m->boneSeen, 0, sizeof(m->boneSeen));
+}
+
+// Joint j passed, but the bones to all its children fail while the children
+// stayed where they were: j jumped, not they
+static bool blame(const struct OutlierFilter* f, const struct OutlierBody* m, const struct BodyArrays* a,
+                  const int32_t* checks, int j)
+{
+    float dx = a->x[j] - m->x[j], dy = a->y[j] - m->y[j], dz = a->z[j] - m->z[j];
+    float moved = dx * dx + dy * dy + dz * dz;
+    int children = 0;
+    for (int k = j + 1; k < N; k++)
+    {
+        if (f->parent[k] != j || !a->bone[k])
+            continue;
+        dx = a->x[k] - m->x[k];
+        dy = a->y[k] - m->y[k];
+        dz = a->z[k] - m->z[k];
+        bool failed = (checks[k] & (OUTLIER_LENGTH | OUTLIER_TURN)) != 0;
+        if (!failed || !m->seen[k] || 4.0f * (dx * dx + dy * dy + dz * dz) >= moved)
+            return false;
+        children++;
+    }
+    return children > 0;
+}
+
+// Put joint j, rejected or repaired, at the end of bone (bx, by, bz) from its
+// parent
+static void move_joint(struct BodyArrays* a, vec3_t* joints, int j, int p, float bx, float by, float bz)
+{
+    a->bx[j] = bx;
+    a->by[j] = by;
+    a->bz[j] = bz;
+    a->x[j] = a->x[p] + bx;
+    a->y[j] = a->y[p] + by;
+    a->z[j] = a->z[p] + bz;
+    joints[j] = vec3_make(a->x[j], a->y[j], a->z[j]);
+}
+
+static void filter_body(void* context, int b)
+{
+    struct OutlierFilter* f = (struct OutlierFilter*)context;
+    const struct OutlierFilterConfig* c = &f->config;
+    struct SkeletonFrame* frame = f->frame;
+    vec3_t* joints = frame->positions[b];
+    uint8_t* confidence = frame->confidence[b];
+    quat_t* rotations = frame->worldRotations[b];
+    const int8_t* parent = f->parent;
+    f->repaired[b] = 0;
+    f->rejected[b] = 0;
+    f->reset[b] = false;
+    if (frame->slots[b] >= MAX_BODY_SLOTS)
+        return;
+    struct OutlierBody* m = &f->bodies[frame->slots[b]];
+
+    int64_t gap = frame->timestampUsec - m->lastUsec;
+    bool same = m->samples > 0 && m->bodyId == frame->bodyIds[b];
+    if (same && gap <= 0)
+        return;// not newer than the model: leave it
+    if (!same || gap > c->resetGapUsec)
+    {
+        f->reset[b] = m->samples > 0;
+        restart(m, frame->bodyIds[b], same);
+    }
+    float dt = (float)gap * 1e-6f;
+
+    struct BodyArrays a;
+    for (int j = 0; j < N; j++)
+    {
+        a.x[j] = joints[j].x;
+        a.y[j] = joints[j].y;
+        a.z[j] = joints[j].z;
+        a.valid[j] = confidence[j] != CONFIDENCE_NONE;
+    }
+    for (int j = 0; j < N; j++)
+    {
+        int p = parent[j];
+        a.bx[j] = a.x[j] - a.x[p];
+        a.by[j] = a.y[j] - a.y[p];
+        a.bz[j] = a.z[j] - a.z[p];
+        a.bone[j] = a.valid[j] & a.valid[p] & (j != p);
+    }
+    for (int j = 0; j < N; j++)
+    {
+        int p = parent[j];
+        a.pbx[j] = a.bx[p];
+        a.pby[j] = a.by[p];
+        a.pbz[j] = a.bz[p];
+        a.bend[j] = a.bone[j] & a.bone[p];
+    }
+    int32_t checks[N];
+    check_joints(f, m, &a, dt, 0, N, checks);
+
+    // a pelvis that jumped is a person found again, not a glitch
+    if (m->samples > 0 && (checks[0] & OUTLIER_SPEED))
+    {
+        restart(m, frame->bodyIds[b], true);
+        f->reset[b] = true;
+    }
+
+    // walk out from the pelvis; children of moved joints are checked again
+    int32_t measured[N];
+    bool child_failed[N] = { false };
+    for (int j = 0; j < N; j++)
+    {
+        measured[j] = 1;
+        child_failed[parent[j]] |= (checks[j] & (OUTLIER_LENGTH | OUTLIER_TURN)) != 0;
+    }
+    bool changed[N] = { false };
+    float hold = (float)c->maxHoldUsec * 1e-6f;
+    for (int j = 1; j < N && m->samples > 0; j++)
+    {
+        int p = parent[j];
+        if (changed[p])
+        {
+            a.bx[j] = a.x[j] - a.x[p];
+            a.by[j] = a.y[j] - a.y[p];
+            a.bz[j] = a.z[j] - a.z[p];
+            a.pbx[j] = a.bx[p];
+            a.pby[j] = a.by[p];
+            a.pbz[j] = a.bz[p];
+            check_joints(f, m, &a, dt, j, j + 1, checks);
+            changed[j] = true;
+        }
+        if (checks[j] == 0 && child_failed[j] && a.valid[j] && m->seen[j] && blame(f, m, &a, checks, j))
+            checks[j] = OUTLIER_CHILDREN;
+        if (checks[j] == 0)
+            continue;
+        if (m->age[j] + dt >= hold)
+        {
+            m->lengthSamples[j] = 0.0f;// the model was wrong: learn the bone again
+            continue;
+        }
+
+        measured[j] = 0;
+        changed[j] = true;
+        float length = sqrtf(a.bx[j] * a.bx[j] + a.by[j] * a.by[j] + a.bz[j] * a.bz[j]);
+        if (checks[j] == OUTLIER_LENGTH && length > MIN_BONE_MM)
+        {
+            float scale = m->length[j] / length;
+            move_joint(&a, joints, j, p, a.bx[j] * scale, a.by[j] * scale, a.bz[j] * scale);
+            f->repaired[b]++;
+            continue;
+        }
+
+        // the bone of the last pose sent, at the learned length, or where the
+        // joint was if an end of the bone is out of range
+        float held = sqrtf(m->boneX[j] * m->boneX[j] + m->boneY[j] * m->boneY[j] + m->boneZ[j] * m->boneZ[j]);
+        if (a.bone[j] && m->boneSeen[j] && held > MIN_BONE_MM)
+        {
+            float scale = m->length[j] / held;
+            move_joint(&a, joints, j, p, m->boneX[j] * scale, m->boneY[j] * scale, m->boneZ[j] * scale);
+        }
+        else
+            move_joint(&a, joints, j, p, m->x[j] - a.x[p], m->y[j] - a.y[p], m->z[j] - a.z[p]);
+        rotations[j] = m->rotations[j];
+        if (f->onlyChild[j])
+            rotations[p] = m->rotations[p];
+        if (confidence[j] > CONFIDENCE_LOW)
+            confidence[j] = CONFIDENCE_LOW;
+        f->rejected[b]++;
+    }
+
+    // the pose sent becomes the model; measured bones in range teach lengths
+    float learn_frames = (float)c->learnFrames;
+    for (int j = 0; j < N; j++)
+    {
+        m->x[j] = a.x[j];
+        m->y[j] = a.y[j];
+        m->z[j] = a.z[j];
+        m->boneX[j] = a.bx[j];
+        m->boneY[j] = a.by[j];
+        m->boneZ[j] = a.bz[j];
+        m->seen[j] = a.valid[j];
+        m->boneSeen[j] = a.bone[j];
+
+        // a bone without a confident sample yet (a hand or foot only ever
+        // seen at LOW) has the length it has in the pose sent, so turns and
+        // rejections scale by it instead of collapsing the joint onto its
+        // parent; the first confident sample replaces it (rate 1)
+        int32_t learn = measured[j] & (confidence[j] >= CONFIDENCE_MEDIUM) &
+                        (confidence[parent[j]] >= CONFIDENCE_MEDIUM) & a.bone[j];
+        float samples = m->lengthSamples[j];
+        int32_t learning = samples < learn_frames;
+        int32_t unknown = (samples == 0.0f) & a.bone[j];
+        float rate = learning ? 1.0f / (samples + 1.0f) : c->learnRate;
+        float length = sqrtf(a.bx[j] * a.bx[j] + a.by[j] * a.by[j] + a.bz[j] * a.bz[j]);
+        m->length[j] += (float)(learn | unknown) * rate * (length - m->length[j]);
+        m->lengthSamples[j] = samples + (float)(learn & learning);
+        m->age[j] = (float)(measured[j] ^ 1) * (m->age[j] + dt);
+    }
+    memcpy(m->rotations, rotations, sizeof(m->rotations));
+    m->samples++;
+    m->lastUsec = frame->timestampUsec;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Frames
+
+void outlier_filter_update(struct OutlierFilter* f, struct SkeletonFrame* frame)
+{
+    int64_t start = monotonic_usec();
+    f->frame = frame;
+    task_pool_for(f->pool, &f->loop, (int)frame->bodyCount, filter_body, f);
+    f->frame = NULL;
+
+    for (uint32_t b = 0; b < frame->bodyCount; b++)
+    {
+        f->repairs += f->repaired[b];
+        f->rejections += f->rejected[b];
+        f->resets += f->reset[b];
+    }
+    f->updates++;
+    f->bodyCount += frame->bodyCount;
+    latency_stats_add(&f->updateTime, monotonic_usec() - start);
+}
+
+void outlier_filter_report(struct OutlierFilter* f, int64_t now_usec, int64_t interval_usec)
+{
+    if (now_usec - f->lastReportUsec < interval_usec)
+        return;
+    if (f->lastReportUsec != 0 && f->updates > 0)
+    {
+        printf("outliers: %llu frames, %llu bodies, %llu joints repaired, %llu rejected, %llu bodies started over\n",
+               (unsigned long long)f->updates, (unsigned long long)f->bodyCount, (unsigned long long)f->repairs,
+               (unsigned long long)f->rejections, (unsigned long long)f->resets);
+        latency_stats_print(&f->updateTime);
+    }
+    f->updates = 0;
+    f->bodyCount = 0;
+    f->repairs = 0;
+    f->rejections = 0;
+    f->resets = 0;
+    latency_stats_reset(&f->updateTime);
+    f->lastReportUsec = now_usec;
+}
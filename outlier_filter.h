@@ -0,0 +1,113 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+#include "body_slots.h"
+#include "latency_stats.h"
+#include "task_pool.h"
+
+// Rejection of tracker glitches: k4abt now and then puts a limb somewhere
+// else for a frame or two, at LOW or even MEDIUM confidence. Every slot
+// keeps a model of its body, the bone lengths learned online and the last
+// pose sent, and each frame every joint is checked against it before
+// anything else sees the body:
+//   length    the bone to the parent is off its learned length by more than
+//             lengthTolerance of it plus noiseMm
+//   turn      the bone turned faster than maxAngularSpeed since the last
+//             pose sent (moved by more than that angle times its length,
+//             plus twice noiseMm)
+//   speed     the joint moved faster than maxSpeed since the last pose sent
+//   bend      the bone folds back onto its parent's bone further than a
+//             knee, elbow, neck or spine can (a fixed table per joint)
+//   children  the bones to all its children fail while the children moved
+//             less than half as far as the joint: the joint jumped, not they
+// Bone checks need both joints in range; lengths are only enforced once a
+// bone has learnFrames samples.
+//
+// Joints are walked from the pelvis out. A joint off only in length is
+// repaired: kept in its direction at the learned length. Any other joint is
+// rejected: it takes the direction its bone had in the last pose sent, at
+// the learned length (or its last position if an end of the bone is out of
+// range), its rotation (and its parent's, if it is the parent's only child)
+// is that of the last pose sent and its confidence drops to CONFIDENCE_LOW.
+// Children of a moved joint are checked against its new position, so a
+// snapped limb is rejected down to its tip. A joint that stays an outlier
+// for maxHoldUsec is taken as measured, and its bone length learned again.
+// Lengths learn from accepted bones with both joints at CONFIDENCE_MEDIUM or
+// better; until a bone has one such sample its length is that of the last
+// pose sent, so a joint only ever seen at LOW is held at its own length.
+// A pelvis faster than maxSpeed (a person re-found elsewhere), a gap longer
+// than resetGapUsec or a new body id in the slot starts the model over;
+// lengths are kept unless the id changed.
+//
+// The checks of all joints of a body run as loops over structure-of-arrays
+// joint data without branches, which the compiler turns into SIMD lanes;
+// only the walk that moves the joints that failed is scalar. Bodies of a
+// frame are checked side by side on the task pool, each touching only its
+// slot.
+
+struct OutlierFilterConfig
+{
+    float lengthTolerance;// allowed relative deviation from the learned length
+    float noiseMm;        // tracker noise on a joint, added to every limit
+    float maxAngularSpeed;// rad/s of a bone
+    float maxSpeed;       // mm/s of a joint
+    int learnFrames;      // bone samples before its length is enforced
+    float learnRate;      // weight of a new length sample after that
+    int64_t maxHoldUsec;  // an outlier this long is taken as measured
+    int64_t resetGapUsec; // start over after a gap this long
+};
+
+struct OutlierBody
+{
+    uint32_t bodyId;
+    uint32_t samples;// frames seen, 0 = slot unused
+    int64_t lastUsec;
+
+    // last pose sent, structure-of-arrays
+    float x[SKELETON_JOINT_COUNT], y[SKELETON_JOINT_COUNT], z[SKELETON_JOINT_COUNT];
+    float boneX[SKELETON_JOINT_COUNT], boneY[SKELETON_JOINT_COUNT], boneZ[SKELETON_JOINT_COUNT];
+    quat_t rotations[SKELETON_JOINT_COUNT];
+
+    float length[SKELETON_JOINT_COUNT];       // learned bone length to the parent, mm
+    float lengthSamples[SKELETON_JOINT_COUNT];// up to learnFrames
+    float age[SKELETON_JOINT_COUNT];          // s since the joint was last taken as measured
+    int32_t seen[SKELETON_JOINT_COUNT];       // in range in the last pose sent
+    int32_t boneSeen[SKELETON_JOINT_COUNT];   // and its parent too
+};
+
+struct OutlierFilter
+{
+    struct OutlierFilterConfig config;
+    int8_t parent[SKELETON_JOINT_COUNT];// the pelvis is its own
+    float cosBend[SKELETON_JOINT_COUNT];// least cosine between a bone and its parent's
+    bool onlyChild[SKELETON_JOINT_COUNT];// the joint is its parent's only child
+
+    struct TaskPool* pool;// optional, set after init
+    struct TaskLoop loop;
+    struct OutlierBody bodies[MAX_BODY_SLOTS];
+
+    // one frame, filled by the bodies
+    struct SkeletonFrame* frame;
+    uint8_t repaired[MAX_FRAME_BODIES];
+    uint8_t rejected[MAX_FRAME_BODIES];
+    bool reset[MAX_FRAME_BODIES];
+
+    uint64_t updates;
+    uint64_t bodyCount;
+    uint64_t repairs;   // joints
+    uint64_t rejections;// joints
+    uint64_t resets;    // bodies started over
+    struct LatencyStats updateTime;// per frame, us
+    int64_t lastReportUsec;
+};
+
+void outlier_filter_default_config(struct OutlierFilterConfig* config);
+void outlier_filter_init(struct OutlierFilter* filter, const struct OutlierFilterConfig* config);
+
+// Check every body of a world-space frame against the model of its slot,
+// repairing and rejecting joints in place. Call after the slots are assigned.
+void outlier_filter_update(struct OutlierFilter* filter, struct SkeletonFrame* frame);
+
+// Print and reset the statistics every interval_usec
+void outlier_filter_report(struct OutlierFilter* filter, int64_t now_usec, int64_t interval_usec);
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <string.h>
+#include "output_scheduler.h"
+#ifndef WIN32
+#include <sys/timerfd.h>
+#endif
+
+#define STATS_INTERVAL_USEC 5000000
+
+void output_scheduler_init(struct OutputScheduler* s, uint32_t rate_hz, int64_t delay_usec,
+                           output_send_fn send, void* context)
+{
+    memset(s, 0, sizeof(*s));
+    s->rateHz = rate_hz ? rate_hz : 60;
+    s->periodUsec = 1000000 / s->rateHz;
+    s->delayUsec = delay_usec;
+    s->staleUsec = delay_usec + 250000;
+    s->send = send;
+    s->context = context;
+    s->statsIntervalUsec = STATS_INTERVAL_USEC;
+    platform_mutex_init(&s->lock);
+    latency_stats_init(&s->sendJitter, "send jitter");
+    latency_stats_init(&s->frameAge, "capture to send");
+}
+
+void output_scheduler_push(struct OutputScheduler* s, const struct SkeletonFrame* frame)
+{
+    platform_mutex_lock(&s->lock);
+    for (uint32_t b = 0; b < frame->bodyCount; b++)
+    {
+        uint8_t slot = frame->slots[b];
+        if (slot >= MAX_BODY_SLOTS)
+            continue;
+
+        struct BodyHistory* h = &s->bodies[slot];
+        if (h->count > 0 && h->bodyId != frame->bodyIds[b])
+            h->count = 0;// slot was handed to another body
+        h->bodyId = frame->bodyIds[b];
+        h->cameraPosition = frame->cameraPositions[b];
+
+        struct BodyHistorySample* sample;
+        if (h->count < BODY_HISTORY_LENGTH)
+        {
+            sample = &h->samples[(h->head + h->count) % BODY_HISTORY_LENGTH];
+            h->count++;
+        }
+        else
+        {
+            sample = &h->samples[h->head];
+            h->head = (h->head + 1) % BODY_HISTORY_LENGTH;
+        }
+        sample->timestampUsec = frame->timestampUsec;
+        memcpy(sample->positions, frame->positions[b], sizeof(sample->positions));
+        memcpy(sample->rotations, frame->worldRotations[b], sizeof(sample->rotations));
+        memcpy(sample->confidence, frame->confidence[b], sizeof(sample->confidence));
+    }
+    platform_mutex_unlock(&s->lock);
+}
+
+static const struct BodyHistorySample* sample_at(const struct BodyHistory* h, int i)
+{
+    return &h->samples[(h->head + i) % BODY_HISTORY_LENGTH];
+}
+
+// Interpolate one body history at time t into body b of the output frame
+static void render_body(const struct BodyHistory* h, int64_t t, struct SkeletonFrame* out, uint32_t b)
+{
+    const struct BodyHistorySample* a = sample_at(h, 0);
+    const struct BodyHistorySample* c = a;
+    for (int i = 1; i < h->count; i++)
+    {
+        const struct BodyHistorySample* next = sample_at(h, i);
+        c = next;
+        if (next->timestampUsec >= t)
+            break;
+        a = next;
+    }
+
+    float u = 0.0f;
+    if (c->timestampUsec > a->timestampUsec && t > a->timestampUsec)
+    {
+        u = (float)(t - a->timestampUsec) / (float)(c->timestampUsec - a->timestampUsec);
+        if (u > 1.0f)
+            u = 1.0f;
+    }
+
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        out->positions[b][j] = vec3_lerp(a->positions[j], c->positions[j], u);
+        out->worldRotations[b][j] = quat_slerp(a->rotations[j], c->rotations[j], u);
+    }
+    memcpy(out->confidence[b], (u < 0.5f ? a : c)->confidence, sizeof(out->confidence[b]));
+}
+
+void output_scheduler_tick(struct OutputScheduler* s, int64_t now_usec)
+{
+    struct SkeletonFrame* out = &s->frame;
+    // the scheduled time of the tick, not the wake-up: jitter moves no body
+    int64_t render_time = s->startUsec + (int64_t)s->ticks * s->periodUsec - s->delayUsec;
+    int64_t newest_capture = 0;
+
+    out->frameNumber = s->ticks;
+    out->timestampUsec = render_time;
+    out->bodyCount = 0;
+
+    platform_mutex_lock(&s->lock);
+    for (int slot = 0; slot < MAX_BODY_SLOTS && out->bodyCount < MAX_FRAME_BODIES; slot++)
+    {
+        const struct BodyHistory* h = &s->bodies[slot];
+        if (h->count == 0)
+            continue;
+        int64_t newest = sample_at(h, h->count - 1)->timestampUsec;
+        if (now_usec - newest > s->staleUsec)
+            continue;
+        if (newest > newest_capture)
+            newest_capture = newest;
+
+        uint32_t b = out->bodyCount++;
+        out->bodyIds[b] = h->bodyId;
+        out->cameraPositions[b] = h->cameraPosition;
+        out->slots[b] = (uint8_t)slot;
+        render_body(h, render_time, out, b);
+    }
+    platform_mutex_unlock(&s->lock);
+
+    if (out->bodyCount > 0)
+        latency_stats_add(&s->frameAge, now_usec - newest_capture);
+    s->send(out, s->context);
+}
+
+static void report_stats(struct OutputScheduler* s, int64_t now)
+{
+    if (now - s->lastStatsUsec < s->statsIntervalUsec)
+        return;
+    if (s->lastStatsUsec != 0)
+    {
+        printf("Output %u Hz:\n", s->rateHz);
+        latency_stats_print(&s->sendJitter);
+        latency_stats_print(&s->frameAge);
+    }
+    latency_stats_reset(&s->sendJitter);
+    latency_stats_reset(&s->frameAge);
+    s->lastStatsUsec = now;
+}
+
+uint32_t output_scheduler_frame_at(const struct OutputScheduler* s, int64_t t_usec)
+{
+    int64_t since_start = t_usec + s->delayUsec - s->startUsec;
+    if (since_start <= s->periodUsec)
+        return 1;
+    return (uint32_t)((since_start + s->periodUsec - 1) / s->periodUsec);
+}
+
+static PLATFORM_THREAD_RETURN scheduler_thread(void* param)
+{
+    struct OutputScheduler* s = (struct OutputScheduler*)param;
+    int64_t period = s->periodUsec;
+    int64_t start = s->startUsec;
+    uint64_t ticks = 0;
+
+#ifndef WIN32
+    // absolute, kernel-driven ticks: no drift from loop overhead
+    int tfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (tfd < 0)
+    {
+        perror("timerfd_create");
+        return PLATFORM_THREAD_RESULT;
+    }
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = period / 1000000;
+    spec.it_interval.tv_nsec = (period % 1000000) * 1000;
+    spec.it_value.tv_sec = (start + period) / 1000000;// first tick one period after start
+    spec.it_value.tv_nsec = ((start + period) % 1000000) * 1000;
+    timerfd_settime(tfd, TFD_TIMER_ABSTIME, &spec, NULL);
+#endif
+
+    while (!s->stopRequested)
+    {
+#ifndef WIN32
+        uint64_t expirations = 0;
+        if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations))
+            continue;
+        ticks += expirations;
+#else
+        ticks++;
+        int64_t wait = start + (int64_t)ticks * period - monotonic_usec();
+        if (wait > 0)
+            platform_sleep_usec(wait);
+#endif
+        int64_t now = monotonic_usec();
+        int64_t scheduled = start + (int64_t)ticks * period;
+        latency_stats_add(&s->sendJitter, now > scheduled ? now - scheduled : scheduled - now);
+
+        s->ticks = (uint32_t)ticks;
+        output_scheduler_tick(s, now);
+        report_stats(s, now);
+    }
+
+#ifndef WIN32
+    close(tfd);
+#endif
+    return PLATFORM_THREAD_RESULT;
+}
+
+bool output_scheduler_start(struct OutputScheduler* s)
+{
+    s->stopRequested = false;
+    s->startUsec = monotonic_usec();
+    s->running = platform_thread_create(&s->thread_, scheduler_thread, s);
+    return s->running;
+}
+
+void output_scheduler_stop(struct OutputScheduler* s)
+{
+    if (!s->running)
+        return;
+    s->stopRequested = true;
+    platform_thread_join(s->thread_);
+    s->running = false;
+    platform_mutex_destroy(&s->lock);
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "platform.h"
+#include "skeleton.h"
+#include "body_slots.h"
+#include "latency_stats.h"
+
+// Sends skeletons at a fixed rate independent of the camera. Every tick
+// renders the bodies at (tick time - delay), interpolating positions
+// linearly and rotations by slerp between the two camera frames around that
+// time, so a 30 Hz camera drives a 60-120 Hz receiver without visible steps.
+//
+// The capture loop pushes processed frames; a dedicated thread (timerfd on
+// Linux) wakes at the output rate and records its wake-up jitter. Output
+// frame n is the n-th tick since start (a tick the thread missed leaves its
+// number out) and renders at start + n * period - delay, so the frame a
+// capture first shows in is known when the capture is processed: events
+// found in it are stamped with that number (output_scheduler_frame_at).
+
+#define BODY_HISTORY_LENGTH 4
+
+struct BodyHistorySample
+{
+    int64_t timestampUsec;
+    vec3_t positions[SKELETON_JOINT_COUNT];
+    quat_t rotations[SKELETON_JOINT_COUNT];
+    uint8_t confidence[SKELETON_JOINT_COUNT];
+};
+
+// Recent samples of the body in one receiver slot, oldest at head
+struct BodyHistory
+{
+    uint32_t bodyId;
+    vec3_t cameraPosition;// of the newest sample
+    int count;
+    int head;
+    struct BodyHistorySample samples[BODY_HISTORY_LENGTH];
+};
+
+// The frame belongs to the scheduler; the callback may fill derived data such
+// as local rotations in place before serializing it.
+typedef void (*output_send_fn)(struct SkeletonFrame* frame, void* context);
+
+struct OutputScheduler
+{
+    uint32_t rateHz;
+    int64_t delayUsec;// render time behind now, about one camera period
+    int64_t staleUsec;// bodies without samples for this long are not sent
+
+    output_send_fn send;
+    void* context;
+
+    platform_mutex_t lock;
+    struct BodyHistory bodies[MAX_BODY_SLOTS];// indexed by receiver slot
+
+    int64_t startUsec;// set by output_scheduler_start
+    int64_t periodUsec;
+
+    // scheduler thread only
+    struct SkeletonFrame frame;
+    uint32_t ticks;// number of the frame being sent
+    struct LatencyStats sendJitter;// wake-up time vs. scheduled tick
+    struct LatencyStats frameAge;  // newest capture to send
+    int64_t statsIntervalUsec;
+    int64_t lastStatsUsec;
+
+    platform_thread_t thread_;
+    volatile bool stopRequested;
+    bool running;
+};
+
+void output_scheduler_init(struct OutputScheduler* scheduler, uint32_t rate_hz, int64_t delay_usec,
+                           output_send_fn send, void* context);
+
+// Add the bodies of a processed camera frame (bodies without a slot are ignored)
+void output_scheduler_push(struct OutputScheduler* scheduler, const struct SkeletonFrame* frame);
+
+// Interpolate the bodies at the scheduled time of tick number ticks, less
+// the delay, and send them as that output frame; now_usec drops stale bodies
+void output_scheduler_tick(struct OutputScheduler* scheduler, int64_t now_usec);
+
+// Number of the first output frame rendered at or after t_usec (a capture
+// time); any thread once the scheduler started
+uint32_t output_scheduler_frame_at(const struct OutputScheduler* scheduler, int64_t t_usec);
+
+bool output_scheduler_start(struct OutputScheduler* scheduler);
+void output_scheduler_stop(struct OutputScheduler* scheduler);
@@ -0,0 +1,110 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#ifdef WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN// no winsock.h: net.h includes winsock2.h, in any order
+#endif
+#include <windows.h>
+#include <process.h>
+#else
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif // WIN32
+
+// Monotonic host clock in microseconds. Uses the same clock source as the
+// k4a system timestamps (QueryPerformanceCounter / CLOCK_MONOTONIC), so body
+// frame times and hedge sample times can be compared directly.
+static inline int64_t monotonic_usec(void)
+{
+#ifdef WIN32
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (int64_t)((now.QuadPart / freq.QuadPart) * 1000000 +
+                     (now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+#ifdef WIN32
+#define platform_mutex_t CRITICAL_SECTION
+#define platform_mutex_init(m) InitializeCriticalSection(m)
+#define platform_mutex_destroy(m) DeleteCriticalSection(m)
+#define platform_mutex_lock(m) EnterCriticalSection(m)
+#define platform_mutex_unlock(m) LeaveCriticalSection(m)
+#else
+#define platform_mutex_t pthread_mutex_t
+#define platform_mutex_init(m) pthread_mutex_init(m, NULL)
+#define platform_mutex_destroy(m) pthread_mutex_destroy(m)
+#define platform_mutex_lock(m) pthread_mutex_lock(m)
+#define platform_mutex_unlock(m) pthread_mutex_unlock(m)
+#endif // WIN32
+
+// Condition variables, waited on with a locked platform_mutex_t
+#ifdef WIN32
+#define platform_cond_t CONDITION_VARIABLE
+#define platform_cond_init(c) InitializeConditionVariable(c)
+#define platform_cond_destroy(c) ((void)(c))
+#define platform_cond_wait(c, m) SleepConditionVariableCS(c, m, INFINITE)
+#define platform_cond_broadcast(c) WakeAllConditionVariable(c)
+#else
+#define platform_cond_t pthread_cond_t
+#define platform_cond_init(c) pthread_cond_init(c, NULL)
+#define platform_cond_destroy(c) pthread_cond_destroy(c)
+#define platform_cond_wait(c, m) pthread_cond_wait(c, m)
+#define platform_cond_broadcast(c) pthread_cond_broadcast(c)
+#endif // WIN32
+
+// Threads. Thread functions are declared as
+//   static PLATFORM_THREAD_RETURN worker(void* param) { ...; return PLATFORM_THREAD_RESULT; }
+#ifdef WIN32
+#define platform_thread_t HANDLE
+#define PLATFORM_THREAD_RETURN unsigned __stdcall
+#define PLATFORM_THREAD_RESULT 0
+static inline bool platform_thread_create(platform_thread_t* thread, unsigned (__stdcall *fn)(void*), void* param)
+{
+    *thread = (HANDLE)_beginthreadex(NULL, 0, fn, param, 0, NULL);
+    return *thread != 0;
+}
+static inline void platform_thread_join(platform_thread_t thread)
+{
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+}
+static inline void platform_sleep_usec(int64_t usec)
+{
+    Sleep((DWORD)(usec / 1000));
+}
+static inline int platform_cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+}
+#else
+#define platform_thread_t pthread_t
+#define PLATFORM_THREAD_RETURN void*
+#define PLATFORM_THREAD_RESULT NULL
+static inline bool platform_thread_create(platform_thread_t* thread, void* (*fn)(void*), void* param)
+{
+    return pthread_create(thread, NULL, fn, param) == 0;
+}
+static inline void platform_thread_join(platform_thread_t thread)
+{
+    pthread_join(thread, NULL);
+}
+static inline void platform_sleep_usec(int64_t usec)
+{
+    usleep((useconds_t)usec);
+}
+static inline int platform_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+#endif // WIN32
@@ -0,0 +1,359 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pose_basis.h"
+
+#define JACOBI_MAX_SWEEPS 64
+
+//////////////////////////////////////////////////////////////////////////////
+// Root transform and pose
+
+bool pose_basis_split(const vec3_t* joints, const uint8_t* confidence, float* pose, vec3_t* origin, float* heading)
+{
+    if (confidence != NULL && (confidence[JOINT_PELVIS] == CONFIDENCE_NONE ||
+                               confidence[JOINT_HIP_LEFT] == CONFIDENCE_NONE ||
+                               confidence[JOINT_HIP_RIGHT] == CONFIDENCE_NONE))
+        return false;
+
+    // parents precede their children
+    vec3_t p[SKELETON_JOINT_COUNT];
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        int parent = skeleton_joint_parent[j];
+        bool out = confidence != NULL && confidence[j] == CONFIDENCE_NONE && parent >= 0;
+        p[j] = out ? p[parent] : joints[j];
+    }
+
+    vec3_t hips = vec3_sub(p[JOINT_HIP_RIGHT], p[JOINT_HIP_LEFT]);
+    float across = sqrtf(hips.x * hips.x + hips.y * hips.y);
+    if (!(across > 1e-3f))
+        return false;
+
+    float c = hips.x / across, s = hips.y / across;
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        vec3_t v = vec3_sub(p[j], p[JOINT_PELVIS]);
+        pose[3 * j + 0] = c * v.x + s * v.y;
+        pose[3 * j + 1] = c * v.y - s * v.x;
+        pose[3 * j + 2] = v.z;
+    }
+    *origin = p[JOINT_PELVIS];
+    *heading = atan2f(s, c);
+    return true;
+}
+
+void pose_basis_join(const float* pose, vec3_t origin, float heading, vec3_t* joints)
+{
+    float c = cosf(heading), s = sinf(heading);
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        float x = pose[3 * j + 0], y = pose[3 * j + 1];
+        joints[j] = vec3_add(origin, vec3_make(c * x - s * y, s * x + c * y, pose[3 * j + 2]));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Coding
+
+static int16_t code_coefficient(float value, float step)
+{
+    float units = value / step;
+    units = units > 32767.0f ? 32767.0f : (units < -32767.0f ? -32767.0f : units);
+    return (int16_t)(units < 0.0f ? units - 0.5f : units + 0.5f);
+}
+
+void pose_basis_decode(const struct PoseBasis* basis, int k, const int16_t* coefficients, float* pose)
+{
+    memcpy(pose, basis->mean, sizeof(basis->mean));
+    for (int c = 0; c < k; c++)
+    {
+        float weight = coefficients[c] * basis->step[c];
+        const float* v = basis->vectors[c];
+        for (int i = 0; i < POSE_BASIS_DIMS; i++)
+            pose[i] += weight * v[i];
+    }
+}
+
+float pose_basis_encode(const struct PoseBasis* basis, int k, const float* pose, int16_t* coefficients)
+{
+    float centered[POSE_BASIS_DIMS];
+    for (int i = 0; i < POSE_BASIS_DIMS; i++)
+        centered[i] = pose[i] - basis->mean[i];
+    for (int c = 0; c < k; c++)
+    {
+        const float* v = basis->vectors[c];
+        float dot = 0.0f;
+        for (int i = 0; i < POSE_BASIS_DIMS; i++)
+            dot += centered[i] * v[i];
+        coefficients[c] = code_coefficient(dot, basis->step[c]);
+    }
+
+    // the receiver's reconstruction, coefficient rounding included
+    float rebuilt[POSE_BASIS_DIMS];
+    pose_basis_decode(basis, k, coefficients, rebuilt);
+    float worst = 0.0f;
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        float dx = rebuilt[3 * j] - pose[3 * j];
+        float dy = rebuilt[3 * j + 1] - pose[3 * j + 1];
+        float dz = rebuilt[3 * j + 2] - pose[3 * j + 2];
+        float d = dx * dx + dy * dy + dz * dz;
+        worst = d > worst ? d : worst;
+    }
+    return sqrtf(worst);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Learning
+
+void pose_basis_accumulator_init(struct PoseBasisAccumulator* acc)
+{
+    memset(acc, 0, sizeof(*acc));
+}
+
+void pose_basis_accumulate(struct PoseBasisAccumulator* acc, const float* pose)
+{
+    double x[POSE_BASIS_DIMS];
+    for (int i = 0; i < POSE_BASIS_DIMS; i++)
+    {
+        x[i] = pose[i];
+        acc->sum[i] += x[i];
+    }
+    for (int i = 0; i < POSE_BASIS_DIMS; i++)
+    {
+        double xi = x[i];
+        double* row = acc->scatter[i];
+        for (int j = i; j < POSE_BASIS_DIMS; j++)
+            row[j] += xi * x[j];
+    }
+    acc->count++;
+}
+
+void pose_basis_accumulator_merge(struct PoseBasisAccumulator* into, const struct PoseBasisAccumulator* from)
+{
+    into->count += from->count;
+    for (int i = 0; i < POSE_BASIS_DIMS; i++)
+    {
+        into->sum[i] += from->sum[i];
+        for (int j = i; j < POSE_BASIS_DIMS; j++)
+            into->scatter[i][j] += from->scatter[i][j];
+    }
+}
+
+// Covariance of the accumulated poses, both triangles
+static void covariance(const struct PoseBasisAccumulator* acc, double* cov)
+{
+    double n = (double)acc->count;
+    for (int i = 0; i < POSE_BASIS_DIMS; i++)
+    {
+        for (int j = i; j < POSE_BASIS_DIMS; j++)
+        {
+            double c = (acc->scatter[i][j] - acc->sum[i] * acc->sum[j] / n) / (n - 1.0);
+            cov[i * POSE_BASIS_DIMS + j] = c;
+            cov[j * POSE_BASIS_DIMS + i] = c;
+        }
+    }
+}
+
+// Cyclic Jacobi: a (symmetric n x n) ends up diagonal with the eigenvalues,
+// the columns of v are the eigenvectors
+static void jacobi_eigen(double* a, double* v, int n)
+{
+    for (int i = 0; i < n * n; i++)
+        v[i] = 0.0;
+    double scale = 0.0;
+    for (int i = 0; i < n; i++)
+    {
+        v[i * n + i] = 1.0;
+        scale += a[i * n + i] * a[i * n + i];
+    }
+
+    for (int sweep = 0; sweep < JACOBI_MAX_SWEEPS; sweep++)
+    {
+        double off = 0.0;
+        for (int p = 0; p < n; p++)
+        {
+            for (int q = p + 1; q < n; q++)
+                off += a[p * n + q] * a[p * n + q];
+        }
+        if (off <= 1e-24 * scale)
+            break;
+
+        for (int p = 0; p < n; p++)
+        {
+            for (int q = p + 1; q < n; q++)
+            {
+                double apq = a[p * n + q];
+                if (apq == 0.0)
+                    continue;
+                double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+                double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+                double c = 1.0 / sqrt(t * t + 1.0);
+                double s = t * c;
+                for (int k = 0; k < n; k++)
+                {
+                    double akp = a[k * n + p], akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (int k = 0; k < n; k++)
+                {
+                    double apk = a[p * n + k], aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+                for (int k = 0; k < n; k++)
+                {
+                    double vkp = v[k * n + p], vkq = v[k * n + q];
+                    v[k * n + p] = c * vkp - s * vkq;
+                    v[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+}
+
+// FNV-1a over the parts of the basis a receiver decodes with
+static uint32_t basis_hash(const struct PoseBasis* basis)
+{
+    uint32_t hash = 2166136261u;
+    const void* parts[3] = { basis->mean, basis->step, basis->vectors };
+    size_t sizes[3] = { sizeof(basis->mean), (size_t)basis->components * sizeof(float),
+                        (size_t)basis->components * sizeof(basis->vectors[0]) };
+    for (int part = 0; part < 3; part++)
+    {
+        const uint8_t* p = (const uint8_t*)parts[part];
+        for (size_t i = 0; i < sizes[part]; i++)
+            hash = (hash ^ p[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool pose_basis_learn(const struct PoseBasisAccumulator* acc, int components, struct PoseBasis* basis)
+{
+    const int n = POSE_BASIS_DIMS;
+    if (acc->count < 2 || components < 1)
+        return false;
+    if (components > POSE_BASIS_MAX_COMPONENTS)
+        components = POSE_BASIS_MAX_COMPONENTS;
+    double* a = (double*)malloc(sizeof(double) * n * n);
+    double* v = (double*)malloc(sizeof(double) * n * n);
+    if (a == NULL || v == NULL)
+    {
+        free(a);
+        free(v);
+        return false;
+    }
+    covariance(acc, a);
+    jacobi_eigen(a, v, n);
+
+    memset(basis, 0, sizeof(*basis));
+    basis->components = components;
+    basis->samples = acc->count;
+    for (int i = 0; i < n; i++)
+        basis->mean[i] = (float)(acc->sum[i] / (double)acc->count);
+
+    // largest eigenvalues first, by selection: n is small
+    bool taken[POSE_BASIS_DIMS] = { false };
+    for (int c = 0; c < components; c++)
+    {
+        int best = -1;
+        for (int i = 0; i < n; i++)
+        {
+            if (!taken[i] && (best < 0 || a[i * n + i] > a[best * n + best]))
+                best = i;
+        }
+        taken[best] = true;
+        double variance = a[best * n + best] > 0.0 ? a[best * n + best] : 0.0;
+
+        // sign fixed by the largest entry, so the same poses give the same file
+        int largest = 0;
+        for (int i = 1; i < n; i++)
+        {
+            if (fabs(v[i * n + best]) > fabs(v[largest * n + best]))
+                largest = i;
+        }
+        double sign = v[largest * n + best] < 0.0 ? -1.0 : 1.0;
+        for (int i = 0; i < n; i++)
+            basis->vectors[c][i] = (float)(sign * v[i * n + best]);
+        basis->variance[c] = (float)variance;
+        float step = POSE_BASIS_STEP_SIGMAS * (float)sqrt(variance) / 32767.0f;
+        basis->step[c] = step > POSE_BASIS_MIN_STEP ? step : POSE_BASIS_MIN_STEP;
+    }
+    free(a);
+    free(v);
+    basis->basisId = basis_hash(basis);
+    return true;
+}
+
+double pose_basis_explained(const struct PoseBasisAccumulator* acc, const struct PoseBasis* basis, int k)
+{
+    if (acc->count < 2)
+        return 0.0;
+    double n = (double)acc->count;
+    double total = 0.0;
+    for (int i = 0; i < POSE_BASIS_DIMS; i++)
+        total += (acc->scatter[i][i] - acc->sum[i] * acc->sum[i] / n) / (n - 1.0);
+    double explained = 0.0;
+    for (int c = 0; c < k && c < basis->components; c++)
+        explained += basis->variance[c];
+    return total > 0.0 ? explained / total : 0.0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// File
+
+bool pose_basis_save(const struct PoseBasis* basis, const char* path)
+{
+    struct PoseBasisHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = POSE_BASIS_MAGIC;
+    header.version = POSE_BASIS_VERSION;
+    header.basisId = basis->basisId;
+    header.dims = POSE_BASIS_DIMS;
+    header.components = (uint32_t)basis->components;
+    header.samples = basis->samples;
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL)
+        return false;
+    size_t k = (size_t)basis->components;
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+              fwrite(basis->mean, sizeof(basis->mean), 1, f) == 1 &&
+              fwrite(basis->step, sizeof(float), k, f) == k &&
+              fwrite(basis->variance, sizeof(float), k, f) == k &&
+              fwrite(basis->vectors, sizeof(basis->vectors[0]), k, f) == k;
+    return fclose(f) == 0 && ok;
+}
+
+bool pose_basis_load(struct PoseBasis* basis, const char* path)
+{
+    memset(basis, 0, sizeof(*basis));
+    FILE* f = fopen(path, "rb");
+    if (f == NULL)
+        return false;
+    struct PoseBasisHeader header;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == POSE_BASIS_MAGIC &&
+              header.version == POSE_BASIS_VERSION && header.dims == POSE_BASIS_DIMS && header.components > 0 &&
+              header.components <= POSE_BASIS_MAX_COMPONENTS;
+    size_t k = ok ? header.components : 0;
+    ok = ok && fread(basis->mean, sizeof(basis->mean), 1, f) == 1 &&
+         fread(basis->step, sizeof(float), k, f) == k &&
+         fread(basis->variance, sizeof(float), k, f) == k &&
+         fread(basis->vectors, sizeof(basis->vectors[0]), k, f) == k;
+    fclose(f);
+    if (!ok)
+        return false;
+
+    basis->components = (int)k;
+    basis->samples = header.samples;
+    for (size_t c = 0; c < k; c++)
+    {
+        if (!(basis->step[c] > 0.0f))
+            return false;
+    }
+    // a damaged or edited file would decode every body wrong
+    basis->basisId = basis_hash(basis);
+    return basis->basisId == header.basisId;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Pose-space basis for very low bandwidth streams (SKP_PCA in protocol.h).
+//
+// A body is split into a root transform and a pose: the pelvis position, the
+// heading (the angle of the hip line about the vertical z axis), and the
+// POSE_BASIS_DIMS coordinates of all joints relative to the pelvis, turned so
+// the hip line points along +x (mm). Joints out of range take the position
+// of their parent, as in pose_index.h. The pose is sent as its first k
+// principal component coefficients; the receiver rebuilds it as the mean
+// plus the components weighted by the coefficients.
+//
+// The basis is learned offline (tools/pose_basis_learn) from the covariance
+// of the poses of recordings, accumulated one pose at a time so recordings of
+// any length fit in constant memory, and diagonalized with Jacobi rotations.
+// Sender and receiver load the same basis file; its id, a hash of its
+// contents, goes with every body so a receiver with another basis drops the
+// body instead of decoding it wrong.
+//
+// Basis file, in the byte order of the host (little-endian on every supported
+// one): a struct PoseBasisHeader, then
+//   mean       float32[POSE_BASIS_DIMS]
+//   step       float32[components], mm per coefficient unit when coded as int16
+//   variance   float32[components], mm^2 the component explains
+//   vectors    float32[components][POSE_BASIS_DIMS], orthonormal, by variance
+
+#define POSE_BASIS_DIMS (SKELETON_JOINT_COUNT * 3)
+#define POSE_BASIS_MAX_COMPONENTS 32
+#define POSE_BASIS_MAGIC 0x42414350// "PCAB"
+#define POSE_BASIS_VERSION 1
+#define POSE_BASIS_STEP_SIGMAS 8.0f// int16 coefficients cover +-8 standard deviations
+#define POSE_BASIS_MIN_STEP 0.01f  // mm
+
+struct PoseBasisHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t basisId;
+    uint32_t dims;
+    uint32_t components;
+    uint32_t reserved;
+    uint64_t samples;// poses the basis was learned from
+};
+
+struct PoseBasis
+{
+    uint32_t basisId;
+    int components;
+    uint64_t samples;
+    float mean[POSE_BASIS_DIMS];
+    float step[POSE_BASIS_MAX_COMPONENTS];
+    float variance[POSE_BASIS_MAX_COMPONENTS];
+    float vectors[POSE_BASIS_MAX_COMPONENTS][POSE_BASIS_DIMS];
+};
+
+// Sums of the poses and of their outer products; one per learning thread,
+// merged at the end
+struct PoseBasisAccumulator
+{
+    uint64_t count;
+    double sum[POSE_BASIS_DIMS];
+    double scatter[POSE_BASIS_DIMS][POSE_BASIS_DIMS];// upper triangle
+};
+
+// Pose of a world-space body (z up): pose in mm relative to the pelvis with
+// the hip line along +x, origin the pelvis and heading the hip line angle in
+// radians. confidence may be NULL (all joints tracked). False if the pelvis
+// or a hip is out of range, or the hips are vertically above each other.
+bool pose_basis_split(const vec3_t* joints, const uint8_t* confidence, float* pose, vec3_t* origin, float* heading);
+
+// World-space joints of a pose (the inverse of pose_basis_split)
+void pose_basis_join(const float* pose, vec3_t origin, float heading, vec3_t* joints);
+
+// Coefficients of the first k components of a pose, coded as int16 with the
+// basis step; returns the largest joint distance of the rebuilt pose from
+// pose, mm
+float pose_basis_encode(const struct PoseBasis* basis, int k, const float* pose, int16_t* coefficients);
+
+// Pose from the first k int16 coded coefficients
+void pose_basis_decode(const struct PoseBasis* basis, int k, const int16_t* coefficients, float* pose);
+
+void pose_basis_accumulator_init(struct PoseBasisAccumulator* acc);
+void pose_basis_accumulate(struct PoseBasisAccumulator* acc, const float* pose);
+void pose_basis_accumulator_merge(struct PoseBasisAccumulator* into, const struct PoseBasisAccumulator* from);
+
+// Mean and the first components principal components (at most
+// POSE_BASIS_MAX_COMPONENTS) of the accumulated poses; false with fewer than
+// two poses
+bool pose_basis_learn(const struct PoseBasisAccumulator* acc, int components, struct PoseBasis* basis);
+
+// Fraction of the total variance of the accumulated poses the first k
+// components of the basis explain
+double pose_basis_explained(const struct PoseBasisAccumulator* acc, const struct PoseBasis* basis, int k);
+
+bool pose_basis_save(const struct PoseBasis* basis, const char* path);
+
+// Read and check a basis file, including its id
+bool pose_basis_load(struct PoseBasis* basis, const char* path);
+
+#ifdef __cplusplus
+}
+#endif
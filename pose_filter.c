@@ -0,0 +1,387 @@
+#include <string.h>
+#include "pose_filter.h"
+#include "skeleton.h"
+
+#define N POSE_FILTER_STATE_DIM
+
+// error state layout
+#define IDX_P 0
+#define IDX_V 3
+#define IDX_TH 6
+#define IDX_BA 9
+#define IDX_BG 12
+
+// IMU gaps longer than this are not integrated (hedge restarted or stalled)
+#define MAX_PREDICT_DT_SEC 0.5f
+
+void pose_filter_default_config(struct PoseFilterConfig* config)
+{
+    config->accNoise = 0.2f;
+    config->gyroNoise = 0.01f;
+    config->accBiasWalk = 0.01f;
+    config->gyroBiasWalk = 0.001f;
+    config->gravity = 9.81f;
+    config->maxExtrapolationSec = 0.1f;
+    config->mountOffset = vec3_make(0.0f, 0.0f, 0.0f);
+    config->mountRotation = kinect_level_orientation();
+}
+
+static void set_diag(double P[N][N], int from, int count, double value)
+{
+    for (int i = from; i < from + count; i++)
+        P[i][i] = value;
+}
+
+void pose_filter_init(struct PoseFilter* filter, const struct PoseFilterConfig* config)
+{
+    memset(filter, 0, sizeof(*filter));
+    if (config)
+        filter->config = *config;
+    else
+        pose_filter_default_config(&filter->config);
+
+    filter->q = quat_identity();
+
+    set_diag(filter->P, IDX_P, 3, 1.0);
+    set_diag(filter->P, IDX_V, 3, 1.0);
+    set_diag(filter->P, IDX_TH, 3, 0.1);
+    set_diag(filter->P, IDX_BA, 3, 0.25);
+    set_diag(filter->P, IDX_BG, 3, 0.0025);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// State history
+//////////////////////////////////////////////////////////////////////////////
+
+static void push_history(struct PoseFilter* f)
+{
+    struct PoseSample* s;
+    int newest = (f->historyHead + f->historyCount - 1) % POSE_FILTER_HISTORY;
+    if (f->historyCount > 0 && f->history[newest].t_usec >= f->t_usec)
+    {
+        // correction at the same instant replaces the predicted sample
+        s = &f->history[newest];
+    }
+    else if (f->historyCount < POSE_FILTER_HISTORY)
+    {
+        s = &f->history[(f->historyHead + f->historyCount) % POSE_FILTER_HISTORY];
+        f->historyCount++;
+    }
+    else
+    {
+        s = &f->history[f->historyHead];
+        f->historyHead = (f->historyHead + 1) % POSE_FILTER_HISTORY;
+    }
+    s->t_usec = f->t_usec;
+    s->p = f->p;
+    s->v = f->v;
+    s->q = f->q;
+    s->w = f->lastRate;
+}
+
+static const struct PoseSample* history_at(const struct PoseFilter* f, int i)
+{
+    return &f->history[(f->historyHead + i) % POSE_FILTER_HISTORY];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Prediction
+//////////////////////////////////////////////////////////////////////////////
+
+static void rotation_matrix(quat_t q, float R[3][3])
+{
+    float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+    float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+    float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+
+    R[0][0] = 1 - 2 * (yy + zz); R[0][1] = 2 * (xy - wz);     R[0][2] = 2 * (xz + wy);
+    R[1][0] = 2 * (xy + wz);     R[1][1] = 1 - 2 * (xx + zz); R[1][2] = 2 * (yz - wx);
+    R[2][0] = 2 * (xz - wy);     R[2][1] = 2 * (yz + wx);     R[2][2] = 1 - 2 * (xx + yy);
+}
+
+// Initial roll/pitch from the gravity direction seen by a resting accelerometer
+static quat_t level_from_gravity(vec3_t acc)
+{
+    float n = vec3_length(acc);
+    if (n < 1e-3f)
+        return quat_identity();
+    vec3_t up_body = vec3_scale(acc, 1.0f / n);
+    vec3_t up_world = vec3_make(0.0f, 0.0f, 1.0f);
+    // rotation taking up_body onto up_world
+    vec3_t axis = vec3_cross(up_body, up_world);
+    float c = vec3_dot(up_body, up_world);
+    return quat_normalize(quat_make(1.0f + c, axis.x, axis.y, axis.z));
+}
+
+struct Transition
+{
+    float dt;
+    float vth[3][3];
+    float vba[3][3];
+    float thth[3][3];
+};
+
+// out = F * in, touching only the position, velocity and attitude rows
+static void apply_transition(const struct Transition* T, const double in[N][N], double out[N][N])
+{
+    for (int c = 0; c < N; c++)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            out[IDX_P + i][c] = in[IDX_P + i][c] + T->dt * in[IDX_V + i][c];
+            out[IDX_V + i][c] = in[IDX_V + i][c] +
+                T->vth[i][0] * in[IDX_TH][c] + T->vth[i][1] * in[IDX_TH + 1][c] + T->vth[i][2] * in[IDX_TH + 2][c] +
+                T->vba[i][0] * in[IDX_BA][c] + T->vba[i][1] * in[IDX_BA + 1][c] + T->vba[i][2] * in[IDX_BA + 2][c];
+            out[IDX_TH + i][c] =
+                T->thth[i][0] * in[IDX_TH][c] + T->thth[i][1] * in[IDX_TH + 1][c] + T->thth[i][2] * in[IDX_TH + 2][c] -
+                T->dt * in[IDX_BG + i][c];
+            out[IDX_BA + i][c] = in[IDX_BA + i][c];
+            out[IDX_BG + i][c] = in[IDX_BG + i][c];
+        }
+    }
+}
+
+void pose_filter_predict(struct PoseFilter* f, int64_t t_usec, vec3_t acc, vec3_t gyro)
+{
+    if (!f->haveOrientation)
+    {
+        f->q = level_from_gravity(acc);
+        f->haveOrientation = true;
+    }
+    if (!f->havePosition)
+    {
+        // nothing to anchor the integration yet
+        f->t_usec = t_usec;
+        return;
+    }
+
+    float dt = (float)(t_usec - f->t_usec) * 1e-6f;
+    f->t_usec = t_usec;
+    if (dt <= 0.0f || dt > MAX_PREDICT_DT_SEC)
+        return;
+
+    vec3_t a_b = vec3_sub(acc, f->accBias);
+    vec3_t w_b = vec3_sub(gyro, f->gyroBias);
+    float R[3][3];
+    rotation_matrix(f->q, R);
+
+    // nominal state
+    vec3_t a_w = quat_rotate(f->q, a_b);
+    a_w.z -= f->config.gravity;
+    f->p = vec3_add(f->p, vec3_add(vec3_scale(f->v, dt), vec3_scale(a_w, 0.5f * dt * dt)));
+    f->v = vec3_add(f->v, vec3_scale(a_w, dt));
+    quat_t dq = quat_from_rotvec(vec3_scale(w_b, dt));
+    f->q = quat_normalize(quat_mul(f->q, dq));
+    f->lastRate = w_b;
+
+    // error-state transition F = I + A, kept as its non-trivial 3x3 blocks:
+    // dv/dth = -R [a]x dt, dv/dba = -R dt, dth/dth = R(w dt)^T
+    struct Transition T;
+    T.dt = dt;
+    float ax[3][3] = {
+        { 0.0f, -a_b.z, a_b.y },
+        { a_b.z, 0.0f, -a_b.x },
+        { -a_b.y, a_b.x, 0.0f } };
+    float Rw[3][3];
+    rotation_matrix(dq, Rw);
+    for (int r = 0; r < 3; r++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            float s = 0.0f;
+            for (int k = 0; k < 3; k++)
+                s += R[r][k] * ax[k][c];
+            T.vth[r][c] = -s * dt;
+            T.vba[r][c] = -R[r][c] * dt;
+            T.thth[r][c] = Rw[c][r];
+        }
+    }
+
+    // P = F P F^T + Q, evaluated as F (F P)^T using the block structure
+    double FP[N][N], FPt[N][N];
+    apply_transition(&T, f->P, FP);
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < N; c++)
+            FPt[r][c] = FP[c][r];
+    apply_transition(&T, FPt, f->P);
+    for (int r = 0; r < N; r++)
+    {
+        for (int c = r + 1; c < N; c++)
+        {
+            double s = 0.5 * (f->P[r][c] + f->P[c][r]);
+            f->P[r][c] = s;
+            f->P[c][r] = s;
+        }
+    }
+
+    double qv = (double)f->config.accNoise * f->config.accNoise * dt * dt;
+    double qth = (double)f->config.gyroNoise * f->config.gyroNoise * dt * dt;
+    double qba = (double)f->config.accBiasWalk * f->config.accBiasWalk * dt;
+    double qbg = (double)f->config.gyroBiasWalk * f->config.gyroBiasWalk * dt;
+    for (int i = 0; i < 3; i++)
+    {
+        f->P[IDX_V + i][IDX_V + i] += qv;
+        f->P[IDX_TH + i][IDX_TH + i] += qth;
+        f->P[IDX_BA + i][IDX_BA + i] += qba;
+        f->P[IDX_BG + i][IDX_BG + i] += qbg;
+    }
+
+    push_history(f);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Correction with a direct 3-dof measurement of the error-state block at
+// offset k (H = [0 .. I .. 0])
+//////////////////////////////////////////////////////////////////////////////
+
+static bool invert3(const double m[3][3], double inv[3][3])
+{
+    double c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+    double c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+    double c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+    double det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+    if (det > -1e-18 && det < 1e-18)
+        return false;
+    double id = 1.0 / det;
+    inv[0][0] = c00 * id;
+    inv[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * id;
+    inv[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * id;
+    inv[1][0] = c01 * id;
+    inv[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * id;
+    inv[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * id;
+    inv[2][0] = c02 * id;
+    inv[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * id;
+    inv[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * id;
+    return true;
+}
+
+static void correct_block(struct PoseFilter* f, int k, vec3_t innovation, float sigma)
+{
+    double y[3] = { innovation.x, innovation.y, innovation.z };
+    double S[3][3], Si[3][3];
+    for (int r = 0; r < 3; r++)
+        for (int c = 0; c < 3; c++)
+            S[r][c] = f->P[k + r][k + c] + (r == c ? (double)sigma * sigma : 0.0);
+    if (!invert3(S, Si))
+        return;
+
+    // K = P[:, k..k+2] S^-1
+    double K[N][3];
+    for (int r = 0; r < N; r++)
+        for (int c = 0; c < 3; c++)
+            K[r][c] = f->P[r][k] * Si[0][c] + f->P[r][k + 1] * Si[1][c] + f->P[r][k + 2] * Si[2][c];
+
+    double dx[N];
+    for (int r = 0; r < N; r++)
+        dx[r] = K[r][0] * y[0] + K[r][1] * y[1] + K[r][2] * y[2];
+
+    // P = P - K P[k..k+2, :]
+    double Pk[3][N];
+    for (int r = 0; r < 3; r++)
+        memcpy(Pk[r], f->P[k + r], sizeof(Pk[r]));
+    for (int r = 0; r < N; r++)
+    {
+        for (int c = r; c < N; c++)
+        {
+            double v = f->P[r][c] - (K[r][0] * Pk[0][c] + K[r][1] * Pk[1][c] + K[r][2] * Pk[2][c]);
+            f->P[r][c] = v;
+            f->P[c][r] = v;
+        }
+    }
+
+    // inject the error into the nominal state (the reset Jacobian is ~I)
+    f->p = vec3_add(f->p, vec3_make((float)dx[IDX_P], (float)dx[IDX_P + 1], (float)dx[IDX_P + 2]));
+    f->v = vec3_add(f->v, vec3_make((float)dx[IDX_V], (float)dx[IDX_V + 1], (float)dx[IDX_V + 2]));
+    f->q = quat_normalize(quat_mul(f->q, quat_from_rotvec(
+        vec3_make((float)dx[IDX_TH], (float)dx[IDX_TH + 1], (float)dx[IDX_TH + 2]))));
+    f->accBias = vec3_add(f->accBias, vec3_make((float)dx[IDX_BA], (float)dx[IDX_BA + 1], (float)dx[IDX_BA + 2]));
+    f->gyroBias = vec3_add(f->gyroBias, vec3_make((float)dx[IDX_BG], (float)dx[IDX_BG + 1], (float)dx[IDX_BG + 2]));
+}
+
+// Measurements are applied to the current (last predicted) state without
+// advancing its time; hedge datagrams arrive within a few milliseconds of the
+// IMU stream, well below the position noise.
+void pose_filter_update_position(struct PoseFilter* f, int64_t t_usec, vec3_t position, float sigma)
+{
+    if (!f->havePosition)
+    {
+        f->p = position;
+        f->t_usec = t_usec;
+        f->havePosition = true;
+        push_history(f);
+        return;
+    }
+    (void)t_usec;
+    correct_block(f, IDX_P, vec3_sub(position, f->p), sigma);
+    push_history(f);
+}
+
+void pose_filter_update_orientation(struct PoseFilter* f, int64_t t_usec, quat_t orientation, float sigma)
+{
+    orientation = quat_normalize(orientation);
+    if (!f->haveOrientation)
+    {
+        f->q = orientation;
+        f->haveOrientation = true;
+    }
+    (void)t_usec;
+    // local attitude error: q_meas = q * exp(dth)
+    vec3_t dth = quat_to_rotvec(quat_mul(quat_conj(f->q), orientation));
+    correct_block(f, IDX_TH, dth, sigma);
+    if (f->havePosition)
+        push_history(f);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Query
+//////////////////////////////////////////////////////////////////////////////
+
+static void to_camera_pose(const struct PoseFilter* f, vec3_t p, quat_t q, struct CameraPose* pose)
+{
+    pose->position = vec3_add(p, quat_rotate(q, f->config.mountOffset));
+    pose->orientation = quat_normalize(quat_mul(q, f->config.mountRotation));
+}
+
+bool pose_filter_query(const struct PoseFilter* f, int64_t t_usec, struct CameraPose* pose)
+{
+    if (f->historyCount == 0)
+    {
+        to_camera_pose(f, f->p, f->q, pose);
+        return false;
+    }
+
+    const struct PoseSample* oldest = history_at(f, 0);
+    const struct PoseSample* newest = history_at(f, f->historyCount - 1);
+
+    if (t_usec >= newest->t_usec)
+    {
+        float dt = (float)(t_usec - newest->t_usec) * 1e-6f;
+        if (dt > f->config.maxExtrapolationSec)
+            dt = f->config.maxExtrapolationSec;
+        vec3_t p = vec3_add(newest->p, vec3_scale(newest->v, dt));
+        quat_t q = quat_normalize(quat_mul(newest->q, quat_from_rotvec(vec3_scale(newest->w, dt))));
+        to_camera_pose(f, p, q, pose);
+        return true;
+    }
+    if (t_usec <= oldest->t_usec)
+    {
+        to_camera_pose(f, oldest->p, oldest->q, pose);
+        return t_usec == oldest->t_usec;
+    }
+
+    // binary search for the last sample at or before t_usec
+    int lo = 0, hi = f->historyCount - 1;
+    while (hi - lo > 1)
+    {
+        int mid = (lo + hi) / 2;
+        if (history_at(f, mid)->t_usec <= t_usec)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    const struct PoseSample* a = history_at(f, lo);
+    const struct PoseSample* b = history_at(f, hi);
+    float s = (float)(t_usec - a->t_usec) / (float)(b->t_usec - a->t_usec);
+    to_camera_pose(f, vec3_lerp(a->p, b->p, s), quat_slerp(a->q, b->q, s), pose);
+    return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "vecmath.h"
+
+// Error-state Kalman filter estimating the pose of a moving Kinect from the
+// Marvelmind hedge mounted on it.
+//
+// Nominal state: position, velocity, orientation (body->world), accelerometer
+// bias and gyro bias. The 15-dimensional error state is propagated with raw IMU
+// samples and corrected with hedge positions and fusion-IMU quaternions.
+// All units are SI (m, m/s, rad); timestamps are host monotonic microseconds.
+
+#define POSE_FILTER_STATE_DIM 15
+#define POSE_FILTER_HISTORY 256 // ~2.5 s of poses at 100 Hz IMU rate
+
+struct PoseFilterConfig
+{
+    float accNoise;      // accelerometer white noise, m/s^2
+    float gyroNoise;     // gyro white noise, rad/s
+    float accBiasWalk;   // accelerometer bias random walk, m/s^2/sqrt(s)
+    float gyroBiasWalk;  // gyro bias random walk, rad/s/sqrt(s)
+    float gravity;       // m/s^2, world z axis points up
+    float maxExtrapolationSec; // limit for queries past the newest sample
+
+    // Hedge -> camera mounting: camera origin in hedge body frame (m) and
+    // rotation from camera frame (k4a: x right, y down, z forward) to hedge
+    // body frame; by default the hedge lies level on the camera with its
+    // y axis along the view (kinect_level_orientation)
+    vec3_t mountOffset;
+    quat_t mountRotation;
+};
+
+struct PoseSample
+{
+    int64_t t_usec;
+    vec3_t p;
+    vec3_t v;
+    quat_t q;
+    vec3_t w;// bias-corrected body angular rate, rad/s
+};
+
+struct CameraPose
+{
+    vec3_t position;   // camera origin in world, meters
+    quat_t orientation;// camera -> world
+};
+
+struct PoseFilter
+{
+    struct PoseFilterConfig config;
+
+    // nominal state
+    int64_t t_usec;
+    vec3_t p;
+    vec3_t v;
+    quat_t q;
+    vec3_t accBias;
+    vec3_t gyroBias;
+    vec3_t lastRate;
+
+    double P[POSE_FILTER_STATE_DIM][POSE_FILTER_STATE_DIM];
+
+    bool havePosition;
+    bool haveOrientation;
+
+    // ring of past nominal states, oldest at historyHead
+    struct PoseSample history[POSE_FILTER_HISTORY];
+    int historyHead;
+    int historyCount;
+};
+
+void pose_filter_default_config(struct PoseFilterConfig* config);
+void pose_filter_init(struct PoseFilter* filter, const struct PoseFilterConfig* config);
+
+// Propagate with one IMU sample (specific force m/s^2 and angular rate rad/s,
+// both in the hedge body frame)
+void pose_filter_predict(struct PoseFilter* filter, int64_t t_usec, vec3_t acc, vec3_t gyro);
+
+// Correct with an absolute hedge position (world, meters)
+void pose_filter_update_position(struct PoseFilter* filter, int64_t t_usec, vec3_t position, float sigma);
+
+// Correct with an absolute hedge orientation (body -> world)
+void pose_filter_update_orientation(struct PoseFilter* filter, int64_t t_usec, quat_t orientation, float sigma);
+
+// Camera pose at an arbitrary time, interpolated from the state history or
+// extrapolated past the newest sample. Returns false if the filter has no
+// position yet or t_usec is older than the history (pose is still filled with
+// the best available estimate).
+bool pose_filter_query(const struct PoseFilter* filter, int64_t t_usec, struct CameraPose* pose);
@@ -0,0 +1,878 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pose_index.h"
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Hint that a node's vector is read soon; the loads of its neighbours then
+// overlap instead of waiting for memory one after the other
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#define prefetch(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define prefetch(p) __builtin_prefetch(p)
+#endif
+
+#define SECTION_ALIGN 64
+#define BUILD_CHUNK 256// nodes a build thread takes at a time
+
+enum PoseIndexSection
+{
+    SECTION_VECTORS,
+    SECTION_LEVELS,
+    SECTION_LINKS0,
+    SECTION_UPPER_OFFSETS,
+    SECTION_UPPER_LINKS,
+    SECTION_LABELS,
+    SECTION_CLIP_NAMES,
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Descriptor
+
+// Body joints of the descriptor: spine, head, arms to the hands, legs to the
+// feet. Pelvis is the origin; clavicles, hand tips, thumbs and the face
+// follow the joints next to them and only add tracker noise.
+static const int8_t descriptor_joints[POSE_DESCRIPTOR_JOINTS] = {
+    JOINT_SPINE_NAVEL, JOINT_SPINE_CHEST, JOINT_NECK, JOINT_HEAD,
+    JOINT_SHOULDER_LEFT, JOINT_ELBOW_LEFT, JOINT_WRIST_LEFT, JOINT_HAND_LEFT,
+    JOINT_SHOULDER_RIGHT, JOINT_ELBOW_RIGHT, JOINT_WRIST_RIGHT, JOINT_HAND_RIGHT,
+    JOINT_HIP_LEFT, JOINT_KNEE_LEFT, JOINT_ANKLE_LEFT, JOINT_FOOT_LEFT,
+    JOINT_HIP_RIGHT, JOINT_KNEE_RIGHT, JOINT_ANKLE_RIGHT, JOINT_FOOT_RIGHT,
+};
+
+bool pose_descriptor(const vec3_t* joints, const uint8_t* confidence, float* descriptor)
+{
+    if (confidence != NULL && (confidence[JOINT_PELVIS] == CONFIDENCE_NONE ||
+                               confidence[JOINT_HIP_LEFT] == CONFIDENCE_NONE ||
+                               confidence[JOINT_HIP_RIGHT] == CONFIDENCE_NONE))
+        return false;
+
+    // parents precede their children
+    vec3_t p[SKELETON_JOINT_COUNT];
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        int parent = skeleton_joint_parent[j];
+        bool out = confidence != NULL && confidence[j] == CONFIDENCE_NONE && parent >= 0;
+        p[j] = out ? p[parent] : joints[j];
+    }
+
+    float spine = vec3_length(vec3_sub(p[JOINT_SPINE_NAVEL], p[JOINT_PELVIS])) +
+                  vec3_length(vec3_sub(p[JOINT_SPINE_CHEST], p[JOINT_SPINE_NAVEL])) +
+                  vec3_length(vec3_sub(p[JOINT_NECK], p[JOINT_SPINE_CHEST]));
+    vec3_t hips = vec3_sub(p[JOINT_HIP_RIGHT], p[JOINT_HIP_LEFT]);
+    float across = sqrtf(hips.x * hips.x + hips.y * hips.y);
+    if (!(spine > 1.0f) || !(across > 1e-3f * spine))
+        return false;
+
+    // turn the hip line onto +x
+    float scale = 1.0f / spine;
+    float c = hips.x / across, s = hips.y / across;
+    for (int i = 0; i < POSE_DESCRIPTOR_JOINTS; i++)
+    {
+        vec3_t v = vec3_sub(p[descriptor_joints[i]], p[JOINT_PELVIS]);
+        descriptor[3 * i + 0] = (c * v.x + s * v.y) * scale;
+        descriptor[3 * i + 1] = (c * v.y - s * v.x) * scale;
+        descriptor[3 * i + 2] = v.z * scale;
+    }
+    for (int i = 3 * POSE_DESCRIPTOR_JOINTS; i < POSE_DESCRIPTOR_DIMS; i++)
+        descriptor[i] = 0.0f;
+    return true;
+}
+
+// Sixteen independent sums keep the loop free of a serial dependency, so it
+// vectorizes to whatever SIMD width the target has
+float pose_distance(const float* a, const float* b)
+{
+    float sums[16] = { 0 };
+    for (int i = 0; i < POSE_DESCRIPTOR_DIMS; i += 16)
+    {
+        for (int l = 0; l < 16; l++)
+        {
+            float d = a[i + l] - b[i + l];
+            sums[l] += d * d;
+        }
+    }
+    // pairwise, so the reduction stays in vector registers too
+    for (int width = 8; width > 0; width /= 2)
+    {
+        for (int l = 0; l < width; l++)
+            sums[l] += sums[l + width];
+    }
+    return sums[0];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Graph
+
+static const float* node_vector(const struct PoseIndex* index, uint32_t node)
+{
+    return index->vectors + (size_t)node * POSE_DESCRIPTOR_DIMS;
+}
+
+// Link list of a node on a level: count, then the links
+static uint32_t* node_links(const struct PoseIndex* index, uint32_t node, int level)
+{
+    if (level == 0)
+        return index->links0 + (size_t)node * (1 + POSE_INDEX_M0);
+    return index->upperLinks + index->upperOffsets[node] + (size_t)(level - 1) * (1 + POSE_INDEX_M);
+}
+
+static void lock_node(const struct PoseIndex* index, uint32_t node)
+{
+    if (index->locks != NULL)
+        platform_mutex_lock(&index->locks[node % POSE_INDEX_LOCK_STRIPES]);
+}
+
+static void unlock_node(const struct PoseIndex* index, uint32_t node)
+{
+    if (index->locks != NULL)
+        platform_mutex_unlock(&index->locks[node % POSE_INDEX_LOCK_STRIPES]);
+}
+
+// Copy of the links of a node, valid node ids only (the file may be damaged)
+static int copy_links(const struct PoseIndex* index, uint32_t node, int level, uint32_t* out)
+{
+    int max = level == 0 ? POSE_INDEX_M0 : POSE_INDEX_M;
+    lock_node(index, node);
+    const uint32_t* links = node_links(index, node, level);
+    int count = (int)links[0] < max ? (int)links[0] : max;
+    int n = 0;
+    for (int i = 1; i <= count; i++)
+    {
+        if (links[i] < index->count)
+            out[n++] = links[i];
+    }
+    unlock_node(index, node);
+    return n;
+}
+
+static void heap_push(float* keys, uint32_t* nodes, int* count, float key, uint32_t node)
+{
+    int i = (*count)++;
+    while (i > 0)
+    {
+        int parent = (i - 1) / 2;
+        if (keys[parent] <= key)
+            break;
+        keys[i] = keys[parent];
+        nodes[i] = nodes[parent];
+        i = parent;
+    }
+    keys[i] = key;
+    nodes[i] = node;
+}
+
+static void heap_pop(float* keys, uint32_t* nodes, int* count)
+{
+    int n = --(*count);
+    float key = keys[n];
+    uint32_t node = nodes[n];
+    int i = 0;
+    for (;;)
+    {
+        int child = 2 * i + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && keys[child + 1] < keys[child])
+            child++;
+        if (keys[child] >= key)
+            break;
+        keys[i] = keys[child];
+        nodes[i] = nodes[child];
+        i = child;
+    }
+    if (n > 0)
+    {
+        keys[i] = key;
+        nodes[i] = node;
+    }
+}
+
+static void visited_clear(struct PoseIndexScratch* s)
+{
+    for (int i = 0; i < s->touchedCount; i++)
+        s->visited[s->touched[i]] = 0;
+    s->touchedCount = 0;
+}
+
+// Mark a node visited; false if it already was, or if the set is full
+static bool visit(struct PoseIndexScratch* s, uint32_t node)
+{
+    uint32_t slot = (node * 2654435761u) & (POSE_INDEX_VISITED_SLOTS - 1);
+    while (s->visited[slot] != 0)
+    {
+        if (s->visited[slot] == node + 1)
+            return false;
+        slot = (slot + 1) & (POSE_INDEX_VISITED_SLOTS - 1);
+    }
+    if (s->touchedCount == POSE_INDEX_MAX_VISITS)
+    {
+        s->saturated = true;
+        return false;
+    }
+    s->visited[slot] = node + 1;
+    s->touched[s->touchedCount++] = slot;
+    return true;
+}
+
+// Walk to the nearest node of one level from node
+static uint32_t search_greedy(const struct PoseIndex* index, const float* query, uint32_t node, float* distance,
+                              int level)
+{
+    uint32_t links[1 + POSE_INDEX_M0];
+    bool moved = true;
+    while (moved)
+    {
+        moved = false;
+        int n = copy_links(index, node, level, links);
+        for (int i = 0; i < n; i++)
+        {
+            float d = pose_distance(query, node_vector(index, links[i]));
+            if (d < *distance)
+            {
+                *distance = d;
+                node = links[i];
+                moved = true;
+            }
+        }
+    }
+    return node;
+}
+
+// Best-first search of one level from the far_count nodes in the far heap
+// (already visited); leaves the ef nearest found there and returns how many
+static int search_level(const struct PoseIndex* index, const float* query, int ef, int level,
+                        struct PoseIndexScratch* s, int far_count)
+{
+    int near_count = 0;
+    for (int i = 0; i < far_count; i++)
+        heap_push(s->nearKey, s->nearNode, &near_count, -s->farKey[i], s->farNode[i]);
+
+    uint32_t links[1 + POSE_INDEX_M0];
+    while (near_count > 0)
+    {
+        float d = s->nearKey[0];
+        uint32_t node = s->nearNode[0];
+        if (far_count >= ef && d > -s->farKey[0])
+            break;
+        heap_pop(s->nearKey, s->nearNode, &near_count);
+
+        // the unvisited links first, their vectors on the way, then distances
+        int n = copy_links(index, node, level, links);
+        int fresh = 0;
+        for (int i = 0; i < n; i++)
+        {
+            if (!visit(s, links[i]))
+                continue;
+            const float* v = node_vector(index, links[i]);
+            for (int line = 0; line < POSE_DESCRIPTOR_DIMS; line += 16)
+                prefetch(v + line);
+            links[fresh++] = links[i];
+        }
+        for (int i = 0; i < fresh; i++)
+        {
+            uint32_t next = links[i];
+            float dn = pose_distance(query, node_vector(index, next));
+            if (far_count < ef || dn < -s->farKey[0])
+            {
+                heap_push(s->nearKey, s->nearNode, &near_count, dn, next);
+                heap_push(s->farKey, s->farNode, &far_count, -dn, next);
+                if (far_count > ef)
+                    heap_pop(s->farKey, s->farNode, &far_count);
+            }
+        }
+    }
+    return far_count;
+}
+
+static int compare_matches(const void* a, const void* b)
+{
+    float da = ((const struct PoseMatch*)a)->distance, db = ((const struct PoseMatch*)b)->distance;
+    return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+// HNSW neighbour heuristic: of candidates sorted nearest first, keep the ones
+// nearer to the base than to every one kept before, so links spread out
+// instead of all pointing into the same cluster. Returns how many are kept.
+static int select_neighbors(const struct PoseIndex* index, const struct PoseMatch* candidates, int count, int max,
+                            uint32_t* selected)
+{
+    int n = 0;
+    for (int i = 0; i < count && n < max; i++)
+    {
+        const float* v = node_vector(index, candidates[i].node);
+        bool keep = true;
+        for (int j = 0; j < n && keep; j++)
+            keep = pose_distance(v, node_vector(index, selected[j])) >= candidates[i].distance;
+        if (keep)
+            selected[n++] = candidates[i].node;
+    }
+    return n;
+}
+
+// Link node to its neighbours among the far heap results on a level, and
+// them back to it, pruning their lists that overflow
+static void connect_node(struct PoseIndex* index, uint32_t node, int level, const struct PoseIndexScratch* s,
+                         int far_count)
+{
+    int max = level == 0 ? POSE_INDEX_M0 : POSE_INDEX_M;
+    struct PoseMatch candidates[POSE_INDEX_MAX_EF + 1];
+    int count = 0;
+    for (int i = 0; i < far_count; i++)
+    {
+        if (s->farNode[i] == node)
+            continue;
+        candidates[count].node = s->farNode[i];
+        candidates[count++].distance = -s->farKey[i];
+    }
+    qsort(candidates, (size_t)count, sizeof(candidates[0]), compare_matches);
+
+    uint32_t selected[POSE_INDEX_M0];
+    int n = select_neighbors(index, candidates, count, max, selected);
+    lock_node(index, node);
+    uint32_t* links = node_links(index, node, level);
+    links[0] = (uint32_t)n;
+    memcpy(links + 1, selected, (size_t)n * sizeof(uint32_t));
+    unlock_node(index, node);
+
+    const float* v = node_vector(index, node);
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t other = selected[i];
+        lock_node(index, other);
+        uint32_t* back = node_links(index, other, level);
+        if ((int)back[0] < max)
+            back[++back[0]] = node;
+        else
+        {
+            const float* w = node_vector(index, other);
+            struct PoseMatch pruned[POSE_INDEX_M0 + 1];
+            for (int j = 0; j < max; j++)
+            {
+                pruned[j].node = back[1 + j];
+                pruned[j].distance = pose_distance(w, node_vector(index, back[1 + j]));
+            }
+            pruned[max].node = node;
+            pruned[max].distance = pose_distance(w, v);
+            qsort(pruned, (size_t)max + 1, sizeof(pruned[0]), compare_matches);
+            back[0] = (uint32_t)select_neighbors(index, pruned, max + 1, max, back + 1);
+        }
+        unlock_node(index, other);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Build
+
+static uint32_t next_random(uint32_t* state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+bool pose_index_create(struct PoseIndex* index, uint32_t count, uint32_t clip_count, uint32_t seed)
+{
+    memset(index, 0, sizeof(*index));
+    if (count == 0)
+        return false;
+    index->count = count;
+    index->clipCount = clip_count;
+    index->maxLevel = -1;
+
+    index->levels = (uint8_t*)malloc(count);
+    index->upperOffsets = (uint32_t*)malloc((size_t)count * sizeof(uint32_t));
+    if (index->levels == NULL || index->upperOffsets == NULL)
+    {
+        pose_index_close(index);
+        return false;
+    }
+    // level l with probability (1 / M)^l
+    uint32_t state = seed != 0 ? seed : 1;
+    float scale = 1.0f / logf((float)POSE_INDEX_M);
+    uint64_t upper = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        float u = ((next_random(&state) >> 8) + 1) * (1.0f / 16777216.0f);
+        int level = (int)(-logf(u) * scale);
+        index->levels[i] = (uint8_t)(level < POSE_INDEX_MAX_LEVEL ? level : POSE_INDEX_MAX_LEVEL);
+        index->upperOffsets[i] = (uint32_t)upper;
+        upper += (uint64_t)index->levels[i] * (1 + POSE_INDEX_M);
+    }
+    if (upper > UINT32_MAX)
+    {
+        pose_index_close(index);
+        return false;
+    }
+    index->upperSize = (uint32_t)upper;
+
+    index->vectors = (float*)calloc((size_t)count * POSE_DESCRIPTOR_DIMS, sizeof(float));
+    index->links0 = (uint32_t*)calloc((size_t)count * (1 + POSE_INDEX_M0), sizeof(uint32_t));
+    index->upperLinks = (uint32_t*)calloc(upper > 0 ? (size_t)upper : 1, sizeof(uint32_t));
+    index->labels = (struct PoseIndexLabel*)calloc(count, sizeof(struct PoseIndexLabel));
+    index->clipNames = (char(*)[POSE_INDEX_CLIP_NAME])calloc(clip_count > 0 ? clip_count : 1, POSE_INDEX_CLIP_NAME);
+    index->locks = (platform_mutex_t*)malloc(POSE_INDEX_LOCK_STRIPES * sizeof(platform_mutex_t));
+    if (index->vectors == NULL || index->links0 == NULL || index->upperLinks == NULL || index->labels == NULL ||
+        index->clipNames == NULL || index->locks == NULL)
+    {
+        free(index->locks);
+        index->locks = NULL;
+        pose_index_close(index);
+        return false;
+    }
+    for (int i = 0; i < POSE_INDEX_LOCK_STRIPES; i++)
+        platform_mutex_init(&index->locks[i]);
+    platform_mutex_init(&index->entryLock);
+    return true;
+}
+
+void pose_index_insert(struct PoseIndex* index, uint32_t node, int ef, struct PoseIndexScratch* scratch)
+{
+    int level = index->levels[node];
+    if (ef > POSE_INDEX_MAX_EF)
+        ef = POSE_INDEX_MAX_EF;
+
+    // a node above the top holds the lock until it is the new entry point
+    platform_mutex_lock(&index->entryLock);
+    int max_level = index->maxLevel;
+    uint32_t entry = index->entry;
+    bool top = level > max_level;
+    if (max_level < 0)
+    {
+        index->entry = node;
+        index->maxLevel = level;
+        platform_mutex_unlock(&index->entryLock);
+        return;
+    }
+    if (!top)
+        platform_mutex_unlock(&index->entryLock);
+
+    const float* query = node_vector(index, node);
+    float distance = pose_distance(query, node_vector(index, entry));
+    for (int l = max_level; l > level; l--)
+        entry = search_greedy(index, query, entry, &distance, l);
+
+    struct PoseIndexScratch* s = scratch;
+    s->farKey[0] = -distance;
+    s->farNode[0] = entry;
+    int far_count = 1;
+    for (int l = level < max_level ? level : max_level; l >= 0; l--)
+    {
+        // the nearest of the level above seed the search
+        visited_clear(s);
+        for (int i = 0; i < far_count; i++)
+            visit(s, s->farNode[i]);
+        far_count = search_level(index, query, ef, l, s, far_count);
+        connect_node(index, node, l, s, far_count);
+    }
+    visited_clear(s);
+
+    if (top)
+    {
+        index->entry = node;
+        index->maxLevel = level;
+        platform_mutex_unlock(&index->entryLock);
+    }
+}
+
+struct BuildState
+{
+    struct PoseIndex* index;
+    int ef;
+    platform_mutex_t lock;
+    uint32_t next;  // position in the insertion order
+    uint32_t stride;// insertion order: node = position * stride % count
+};
+
+struct BuildWorker
+{
+    struct BuildState* state;
+    struct PoseIndexScratch* scratch;
+};
+
+static PLATFORM_THREAD_RETURN build_worker(void* param)
+{
+    struct BuildWorker* worker = (struct BuildWorker*)param;
+    struct BuildState* state = worker->state;
+    uint32_t count = state->index->count;
+    for (;;)
+    {
+        platform_mutex_lock(&state->lock);
+        uint32_t first = state->next;
+        uint32_t last = count - first < BUILD_CHUNK ? count : first + BUILD_CHUNK;
+        state->next = last;
+        platform_mutex_unlock(&state->lock);
+        if (first >= count)
+            break;
+        for (uint32_t p = first; p < last; p++)
+        {
+            uint32_t node = (uint32_t)((uint64_t)p * state->stride % count);
+            pose_index_insert(state->index, node, state->ef, worker->scratch);
+        }
+    }
+    return PLATFORM_THREAD_RESULT;
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+    while (b != 0)
+    {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+bool pose_index_build(struct PoseIndex* index, int threads, int ef)
+{
+    if (threads < 1)
+        threads = platform_cpu_count();
+    if (threads > 64)
+        threads = 64;
+
+    struct BuildState state;
+    state.index = index;
+    state.ef = ef;
+    state.next = 0;
+    // recordings hold runs of near-identical frames; inserting them spread
+    // over the library gives the early graph long links across it
+    state.stride = (uint32_t)(index->count * 0.618f) | 1;
+    while (gcd(state.stride, index->count) != 1)
+        state.stride += 2;
+    platform_mutex_init(&state.lock);
+
+    struct BuildWorker workers[64];
+    platform_thread_t handles[64];
+    int started = 0;
+    bool ok = true;
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t].state = &state;
+        workers[t].scratch = (struct PoseIndexScratch*)calloc(1, sizeof(struct PoseIndexScratch));
+        if (workers[t].scratch == NULL)
+        {
+            threads = t;
+            ok = t > 0;
+            break;
+        }
+    }
+    // the first node alone, so the workers find an entry point
+    if (ok)
+    {
+        pose_index_insert(index, 0, ef, workers[0].scratch);
+        state.next = 1;
+        for (int t = 1; t < threads; t++)
+        {
+            if (!platform_thread_create(&handles[started], build_worker, &workers[t]))
+                break;
+            started++;
+        }
+        build_worker(&workers[0]);
+        for (int t = 0; t < started; t++)
+            platform_thread_join(handles[t]);
+    }
+    for (int t = 0; t < threads; t++)
+        free(workers[t].scratch);
+    platform_mutex_destroy(&state.lock);
+    return ok;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// File
+
+static uint64_t align_section(uint64_t offset)
+{
+    return (offset + SECTION_ALIGN - 1) & ~(uint64_t)(SECTION_ALIGN - 1);
+}
+
+// Section sizes in bytes, offsets from them
+static void section_layout(const struct PoseIndex* index, uint64_t* sizes, uint64_t* offsets, uint64_t* file_size)
+{
+    sizes[SECTION_VECTORS] = (uint64_t)index->count * POSE_DESCRIPTOR_DIMS * sizeof(float);
+    sizes[SECTION_LEVELS] = index->count;
+    sizes[SECTION_LINKS0] = (uint64_t)index->count * (1 + POSE_INDEX_M0) * sizeof(uint32_t);
+    sizes[SECTION_UPPER_OFFSETS] = (uint64_t)index->count * sizeof(uint32_t);
+    sizes[SECTION_UPPER_LINKS] = (uint64_t)index->upperSize * sizeof(uint32_t);
+    sizes[SECTION_LABELS] = (uint64_t)index->count * sizeof(struct PoseIndexLabel);
+    sizes[SECTION_CLIP_NAMES] = (uint64_t)index->clipCount * POSE_INDEX_CLIP_NAME;
+    uint64_t offset = align_section(sizeof(struct PoseIndexHeader));
+    for (int i = 0; i < POSE_INDEX_SECTIONS; i++)
+    {
+        offsets[i] = offset;
+        offset = align_section(offset + sizes[i]);
+    }
+    *file_size = offset;
+}
+
+static bool write_padded(FILE* f, const void* data, uint64_t size)
+{
+    static const uint8_t zeros[SECTION_ALIGN];
+    if (size > 0 && fwrite(data, 1, (size_t)size, f) != (size_t)size)
+        return false;
+    uint64_t pad = align_section(size) - size;
+    return pad == 0 || fwrite(zeros, 1, (size_t)pad, f) == (size_t)pad;
+}
+
+bool pose_index_save(const struct PoseIndex* index, const char* path)
+{
+    if (index->maxLevel < 0)
+        return false;
+    struct PoseIndexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = POSE_INDEX_MAGIC;
+    header.version = POSE_INDEX_VERSION;
+    header.dims = POSE_DESCRIPTOR_DIMS;
+    header.count = index->count;
+    header.m = POSE_INDEX_M;
+    header.m0 = POSE_INDEX_M0;
+    header.maxLevel = (uint32_t)index->maxLevel;
+    header.entry = index->entry;
+    header.clipCount = index->clipCount;
+    header.upperSize = index->upperSize;
+    uint64_t sizes[POSE_INDEX_SECTIONS];
+    section_layout(index, sizes, header.offsets, &header.fileSize);
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL)
+        return false;
+    const void* sections[POSE_INDEX_SECTIONS] = { index->vectors, index->levels, index->links0, index->upperOffsets,
+                                                  index->upperLinks, index->labels, index->clipNames };
+    bool ok = write_padded(f, &header, sizeof(header));
+    for (int i = 0; i < POSE_INDEX_SECTIONS && ok; i++)
+        ok = write_padded(f, sections[i], sizes[i]);
+    return fclose(f) == 0 && ok;
+}
+
+static void* map_file(struct PoseIndex* index, const char* path)
+{
+#ifdef WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return NULL;
+    LARGE_INTEGER size;
+    HANDLE map = NULL;
+    void* view = NULL;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+        map = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (map != NULL)
+        view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL)
+    {
+        if (map != NULL)
+            CloseHandle(map);
+        CloseHandle(file);
+        return NULL;
+    }
+    index->file = (intptr_t)file;
+    index->mapHandle = (intptr_t)map;
+    index->mappingSize = (size_t)size.QuadPart;
+    return view;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    void* view = NULL;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (view == NULL || view == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+    index->file = fd;
+    index->mappingSize = (size_t)st.st_size;
+    return view;
+#endif
+}
+
+static void unmap_file(struct PoseIndex* index)
+{
+#ifdef WIN32
+    UnmapViewOfFile(index->mapping);
+    CloseHandle((HANDLE)index->mapHandle);
+    CloseHandle((HANDLE)index->file);
+#else
+    munmap(index->mapping, index->mappingSize);
+    close((int)index->file);
+#endif
+    index->mapping = NULL;
+}
+
+// What the searches trust of a mapped file: every node at or under the top
+// level and the entry on it, the upper link lists where the levels put them,
+// upper links only to nodes on that level and labels within the clips. Level
+// 0 links are checked as they are read (copy_links), so the large sections
+// stay unread until used.
+static bool check_graph(const struct PoseIndex* index)
+{
+    if (index->levels[index->entry] != index->maxLevel)
+        return false;
+    uint64_t upper = 0;
+    for (uint32_t node = 0; node < index->count; node++)
+    {
+        int level = index->levels[node];
+        if (level > index->maxLevel || index->upperOffsets[node] != upper ||
+            index->labels[node].clip >= index->clipCount)
+            return false;
+        upper += (uint64_t)level * (1 + POSE_INDEX_M);
+        if (upper > index->upperSize)
+            return false;
+        for (int l = 1; l <= level; l++)
+        {
+            const uint32_t* links = node_links(index, node, l);
+            if (links[0] > POSE_INDEX_M)
+                return false;
+            for (uint32_t i = 1; i <= links[0]; i++)
+            {
+                if (links[i] >= index->count || index->levels[links[i]] < l)
+                    return false;
+            }
+        }
+    }
+    return upper == index->upperSize;
+}
+
+bool pose_index_open(struct PoseIndex* index, const char* path)
+{
+    memset(index, 0, sizeof(*index));
+    index->maxLevel = -1;
+    uint8_t* base = (uint8_t*)map_file(index, path);
+    if (base == NULL)
+        return false;
+    index->mapping = base;
+
+    const struct PoseIndexHeader* h = (const struct PoseIndexHeader*)base;
+    bool ok = index->mappingSize >= sizeof(*h) && h->magic == POSE_INDEX_MAGIC && h->version == POSE_INDEX_VERSION &&
+              h->dims == POSE_DESCRIPTOR_DIMS && h->m == POSE_INDEX_M && h->m0 == POSE_INDEX_M0 && h->count > 0 &&
+              h->entry < h->count && h->maxLevel <= POSE_INDEX_MAX_LEVEL;
+    if (ok)
+    {
+        // the layout follows from the counts; a file that disagrees is not ours
+        index->count = h->count;
+        index->clipCount = h->clipCount;
+        index->upperSize = h->upperSize;
+        uint64_t sizes[POSE_INDEX_SECTIONS], offsets[POSE_INDEX_SECTIONS], file_size;
+        section_layout(index, sizes, offsets, &file_size);
+        ok = file_size == h->fileSize && file_size <= index->mappingSize &&
+             memcmp(offsets, h->offsets, sizeof(offsets)) == 0;
+    }
+    if (!ok)
+    {
+        pose_index_close(index);
+        return false;
+    }
+    index->maxLevel = (int)h->maxLevel;
+    index->entry = h->entry;
+    index->vectors = (float*)(base + h->offsets[SECTION_VECTORS]);
+    index->levels = base + h->offsets[SECTION_LEVELS];
+    index->links0 = (uint32_t*)(base + h->offsets[SECTION_LINKS0]);
+    index->upperOffsets = (uint32_t*)(base + h->offsets[SECTION_UPPER_OFFSETS]);
+    index->upperLinks = (uint32_t*)(base + h->offsets[SECTION_UPPER_LINKS]);
+    index->labels = (struct PoseIndexLabel*)(base + h->offsets[SECTION_LABELS]);
+    index->clipNames = (char(*)[POSE_INDEX_CLIP_NAME])(base + h->offsets[SECTION_CLIP_NAMES]);
+    if (!check_graph(index))
+    {
+        pose_index_close(index);
+        return false;
+    }
+    return true;
+}
+
+void pose_index_close(struct PoseIndex* index)
+{
+    if (index->mapping != NULL)
+        unmap_file(index);
+    else
+    {
+        free(index->vectors);
+        free(index->levels);
+        free(index->links0);
+        free(index->upperOffsets);
+        free(index->upperLinks);
+        free(index->labels);
+        free(index->clipNames);
+        if (index->locks != NULL)
+        {
+            for (int i = 0; i < POSE_INDEX_LOCK_STRIPES; i++)
+                platform_mutex_destroy(&index->locks[i]);
+            platform_mutex_destroy(&index->entryLock);
+            free(index->locks);
+        }
+    }
+    memset(index, 0, sizeof(*index));
+    index->maxLevel = -1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Search
+
+int pose_index_search(const struct PoseIndex* index, const float* descriptor, int k, int ef,
+                      struct PoseIndexScratch* scratch, struct PoseMatch* matches)
+{
+    if (index->maxLevel < 0 || k < 1)
+        return 0;
+    if (ef > POSE_INDEX_MAX_EF)
+        ef = POSE_INDEX_MAX_EF;
+    if (k > ef)
+        k = ef;
+
+    uint32_t entry = index->entry;
+    float distance = pose_distance(descriptor, node_vector(index, entry));
+    for (int l = index->maxLevel; l > 0; l--)
+        entry = search_greedy(index, descriptor, entry, &distance, l);
+
+    struct PoseIndexScratch* s = scratch;
+    s->saturated = false;
+    visited_clear(s);
+    visit(s, entry);
+    s->farKey[0] = -distance;
+    s->farNode[0] = entry;
+    int found = search_level(index, descriptor, ef, 0, s, 1);
+    visited_clear(s);
+
+    while (found > k)
+        heap_pop(s->farKey, s->farNode, &found);
+    int n = found;
+    for (int i = n - 1; i >= 0; i--)
+    {
+        matches[i].node = s->farNode[0];
+        matches[i].distance = sqrtf(-s->farKey[0]);
+        heap_pop(s->farKey, s->farNode, &found);
+    }
+    return n;
+}
+
+int pose_index_search_exact(const struct PoseIndex* index, const float* descriptor, int k,
+                            struct PoseMatch* matches)
+{
+    int n = 0;
+    for (uint32_t node = 0; node < index->count; node++)
+    {
+        float d = pose_distance(descriptor, node_vector(index, node));
+        if (n == k && d >= matches[n - 1].distance)
+            continue;
+        // insert in order, dropping the farthest when full
+        int i = n < k ? n++ : n - 1;
+        while (i > 0 && matches[i - 1].distance > d)
+        {
+            matches[i] = matches[i - 1];
+            i--;
+        }
+        matches[i].node = node;
+        matches[i].distance = d;
+    }
+    for (int i = 0; i < n; i++)
+        matches[i].distance = sqrtf(matches[i].distance);
+    return n;
+}
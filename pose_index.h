@@ -0,0 +1,168 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+#include "platform.h"
+
+// Approximate nearest-neighbour search of a live pose in a library of
+// recorded reference poses (choreography scoring, pose-triggered effects).
+//
+// Poses are compared by a descriptor that ignores where the person stands,
+// which way they face and how tall they are: the POSE_DESCRIPTOR_JOINTS body
+// joints relative to the pelvis, turned about the vertical (z) axis so the
+// hip line points along +x, and divided by the length of the spine (pelvis,
+// navel, chest, neck bones, which do not change as the body bends). Distances
+// between descriptors are in spine lengths. Joints out of range take the
+// position of their parent.
+//
+// The index is a hierarchical navigable small world graph (HNSW): every pose
+// is a node on level 0 and, with probability 1 / POSE_INDEX_M per level, on
+// the levels above. A search descends greedily from the single node of the
+// top level and runs a best-first search of ef candidates on level 0, so a
+// query costs a few thousand distances for any library size. Distances are
+// over POSE_DESCRIPTOR_DIMS floats in 16 partial sums, which the compiler
+// turns into SIMD lanes.
+//
+// Building inserts the nodes from several threads: each node's links are
+// guarded by one of POSE_INDEX_LOCK_STRIPES mutexes and the top of the graph
+// by its own. Levels are drawn from a seed when the index is created, so the
+// file layout is known before the graph is.
+//
+// Index file (pose_index_build), written and mapped in place in the byte
+// order of the host (little-endian on every supported one): a struct
+// PoseIndexHeader, then the sections it gives the offsets of, each 64-byte
+// aligned:
+//   vectors        float32[count][POSE_DESCRIPTOR_DIMS]
+//   levels         uint8[count], top level of each node
+//   links0         uint32[count][1 + POSE_INDEX_M0], link count then links
+//   upperOffsets   uint32[count], first entry of the node in upperLinks
+//   upperLinks     uint32[][1 + POSE_INDEX_M], one list per level above 0
+//   labels         struct PoseIndexLabel[count]
+//   clipNames      char[clipCount][POSE_INDEX_CLIP_NAME]
+// Opening maps the file read-only; nothing is copied, so the pages of a large
+// library are shared by every process that opens it and loaded on use. Only
+// the levels, upper links and labels are read through once to refuse a
+// damaged file; vectors and level 0 links are not.
+
+#define POSE_DESCRIPTOR_JOINTS 20
+#define POSE_DESCRIPTOR_DIMS 64        // 3 * POSE_DESCRIPTOR_JOINTS, zero padded
+#define POSE_INDEX_MAGIC 0x58444950    // "PIDX"
+#define POSE_INDEX_VERSION 1
+#define POSE_INDEX_M 12                // links per node on the upper levels
+#define POSE_INDEX_M0 24               // on level 0
+#define POSE_INDEX_MAX_LEVEL 15
+#define POSE_INDEX_MAX_EF 512
+#define POSE_INDEX_DEFAULT_EF 64       // search
+#define POSE_INDEX_DEFAULT_BUILD_EF 128
+#define POSE_INDEX_VISITED_SLOTS 32768 // open addressing, power of two
+#define POSE_INDEX_MAX_VISITS (POSE_INDEX_VISITED_SLOTS / 2)
+#define POSE_INDEX_LOCK_STRIPES 4096
+#define POSE_INDEX_CLIP_NAME 64
+#define POSE_INDEX_SECTIONS 7
+
+// Reference pose: clip (recording) and frame number in it
+struct PoseIndexLabel
+{
+    uint32_t clip;
+    uint32_t frame;
+};
+
+struct PoseIndexHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dims;
+    uint32_t count;
+    uint32_t m;
+    uint32_t m0;
+    uint32_t maxLevel;
+    uint32_t entry;
+    uint32_t clipCount;
+    uint32_t upperSize;// uint32 entries of upperLinks
+    uint64_t offsets[POSE_INDEX_SECTIONS];
+    uint64_t fileSize;
+};
+
+struct PoseIndex
+{
+    uint32_t count;
+    uint32_t clipCount;
+    uint32_t upperSize;
+    int maxLevel;
+    uint32_t entry;
+
+    float* vectors;
+    uint8_t* levels;
+    uint32_t* links0;
+    uint32_t* upperOffsets;
+    uint32_t* upperLinks;
+    struct PoseIndexLabel* labels;
+    char (*clipNames)[POSE_INDEX_CLIP_NAME];
+
+    // building (pose_index_create), NULL once opened from a file
+    platform_mutex_t* locks;
+    platform_mutex_t entryLock;
+
+    // file mapping (pose_index_open)
+    void* mapping;
+    size_t mappingSize;
+    intptr_t file;
+    intptr_t mapHandle;
+};
+
+struct PoseMatch
+{
+    uint32_t node;
+    float distance;// spine lengths
+};
+
+// Per-query state, zeroed before first use (calloc or static). A query may
+// run on any thread with a scratch of its own.
+struct PoseIndexScratch
+{
+    uint32_t visited[POSE_INDEX_VISITED_SLOTS];// node + 1, 0 = free
+    uint32_t touched[POSE_INDEX_MAX_VISITS];   // slots to clear
+    int touchedCount;
+    bool saturated;// the visited set filled up and the search stopped early
+    float nearKey[POSE_INDEX_MAX_VISITS];      // candidates to expand, min-heap of distances
+    uint32_t nearNode[POSE_INDEX_MAX_VISITS];
+    float farKey[POSE_INDEX_MAX_EF + 1];       // best found, min-heap of negated distances
+    uint32_t farNode[POSE_INDEX_MAX_EF + 1];
+};
+
+// Descriptor of one pose in world space (z up). confidence may be NULL (all
+// joints in range). False if the pelvis or the hips are out of range or the
+// pose is degenerate.
+bool pose_descriptor(const vec3_t* joints, const uint8_t* confidence, float* descriptor);
+
+// Squared distance of two descriptors
+float pose_distance(const float* a, const float* b);
+
+// Allocate an empty graph of count nodes and clip_count clip names, levels
+// drawn from seed. Fill vectors, labels and clipNames, then insert the nodes.
+bool pose_index_create(struct PoseIndex* index, uint32_t count, uint32_t clip_count, uint32_t seed);
+
+// Link one node into the graph; safe to call from several threads with
+// different nodes. ef is the candidate count of the build searches.
+void pose_index_insert(struct PoseIndex* index, uint32_t node, int ef, struct PoseIndexScratch* scratch);
+
+// Insert every node with threads threads (< 1: one per core)
+bool pose_index_build(struct PoseIndex* index, int threads, int ef);
+
+bool pose_index_save(const struct PoseIndex* index, const char* path);
+
+// Map an index file; false if it can not be read, is not a valid index or its
+// graph does not hold together
+bool pose_index_open(struct PoseIndex* index, const char* path);
+
+// Free a created index or unmap an opened one
+void pose_index_close(struct PoseIndex* index);
+
+// Up to k nearest nodes of a descriptor, nearest first, searching ef
+// candidates (k <= ef <= POSE_INDEX_MAX_EF); returns how many
+int pose_index_search(const struct PoseIndex* index, const float* descriptor, int k, int ef,
+                      struct PoseIndexScratch* scratch, struct PoseMatch* matches);
+
+// Exact k nearest by scanning every node, for checks
+int pose_index_search_exact(const struct PoseIndex* index, const float* descriptor, int k,
+                            struct PoseMatch* matches);
@@ -0,0 +1,111 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pose_match.h"
+#include "platform.h"
+
+void pose_match_default_config(struct PoseMatchConfig* config)
+{
+    config->ef = POSE_INDEX_DEFAULT_EF;
+    config->maxDistance = 0.5f;
+}
+
+bool pose_matcher_init(struct PoseMatcher* matcher, const char* path, const struct PoseMatchConfig* config)
+{
+    memset(matcher, 0, sizeof(*matcher));
+    if (config != NULL)
+        matcher->config = *config;
+    else
+        pose_match_default_config(&matcher->config);
+    latency_stats_init(&matcher->updateTime, "pose match");
+    task_loop_init(&matcher->loop, "pose match", 50000);
+
+    if (!pose_index_open(&matcher->index, path))
+        return false;
+    matcher->scratch = (struct PoseIndexScratch*)calloc(MAX_FRAME_BODIES, sizeof(struct PoseIndexScratch));
+    if (matcher->scratch == NULL)
+    {
+        pose_index_close(&matcher->index);
+        return false;
+    }
+    return true;
+}
+
+void pose_matcher_close(struct PoseMatcher* matcher)
+{
+    pose_index_close(&matcher->index);
+    free(matcher->scratch);
+    matcher->scratch = NULL;
+}
+
+// One body; touches only its own scratch and result
+static void match_body(void* context, int b)
+{
+    struct PoseMatcher* m = (struct PoseMatcher*)context;
+    const struct SkeletonFrame* frame = m->frame;
+    m->found[b] = false;
+
+    float descriptor[POSE_DESCRIPTOR_DIMS];
+    if (!pose_descriptor(frame->positions[b], frame->confidence[b], descriptor))
+        return;
+    struct PoseMatch match;
+    if (pose_index_search(&m->index, descriptor, 1, m->config.ef, &m->scratch[b], &match) == 0 ||
+        match.distance > m->config.maxDistance)
+        return;
+
+    const struct PoseIndexLabel* label = &m->index.labels[match.node];
+    struct PoseMatchResult* r = &m->perBody[b];
+    r->bodyId = frame->bodyIds[b];
+    r->clip = (uint16_t)label->clip;
+    r->frame = label->frame;
+    r->distance = match.distance;
+    m->found[b] = true;
+}
+
+void pose_matcher_update(struct PoseMatcher* m, const struct SkeletonFrame* frame)
+{
+    int64_t start = monotonic_usec();
+    m->frame = frame;
+    task_pool_for(m->pool, &m->loop, (int)frame->bodyCount, match_body, m);
+    m->frame = NULL;
+
+    m->resultCount = 0;
+    for (uint32_t b = 0; b < frame->bodyCount; b++)
+    {
+        m->saturated += m->scratch[b].saturated;
+        m->scratch[b].saturated = false;
+        if (m->found[b])
+            m->results[m->resultCount++] = m->perBody[b];
+    }
+    m->updates++;
+    m->queries += frame->bodyCount;
+    m->matched += (uint64_t)m->resultCount;
+    latency_stats_add(&m->updateTime, monotonic_usec() - start);
+}
+
+int pose_matcher_take_results(struct PoseMatcher* m, struct PoseMatchResult* results, int max)
+{
+    int n = m->resultCount < max ? m->resultCount : max;
+    memcpy(results, m->results, (size_t)n * sizeof(results[0]));
+    m->resultCount = 0;
+    return n;
+}
+
+void pose_matcher_report(struct PoseMatcher* m, int64_t now_usec, int64_t interval_usec)
+{
+    if (now_usec - m->lastReportUsec < interval_usec)
+        return;
+    if (m->lastReportUsec != 0 && m->updates > 0)
+    {
+        printf("pose match: %llu frames, %llu queries, %llu matched, %llu saturated\n",
+               (unsigned long long)m->updates, (unsigned long long)m->queries, (unsigned long long)m->matched,
+               (unsigned long long)m->saturated);
+        latency_stats_print(&m->updateTime);
+    }
+    m->updates = 0;
+    m->queries = 0;
+    m->matched = 0;
+    m->saturated = 0;
+    latency_stats_reset(&m->updateTime);
+    m->lastReportUsec = now_usec;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+#include "latency_stats.h"
+#include "task_pool.h"
+#include "pose_index.h"
+#include "pose_match_result.h"
+
+// Live matching of every body against a pose library (pose_index.h). Each
+// body of a frame is one query with a scratch of its own, so the bodies run
+// on the task pool side by side. A body whose nearest reference pose lies
+// within maxDistance spine lengths gets a match with the clip and frame of
+// that pose; receivers look the clip up in the same index file.
+
+struct PoseMatchConfig
+{
+    int ef;           // search candidates, more is slower and nearer to exact
+    float maxDistance;// spine lengths; farther matches are not reported
+};
+
+struct PoseMatcher
+{
+    struct PoseMatchConfig config;
+    struct PoseIndex index;
+    struct TaskPool* pool;// optional, set after init
+    struct TaskLoop loop;
+    struct PoseIndexScratch* scratch;// one per body of a frame
+
+    // one frame, filled by the queries
+    const struct SkeletonFrame* frame;
+    bool found[MAX_FRAME_BODIES];
+    struct PoseMatchResult perBody[MAX_FRAME_BODIES];
+
+    struct PoseMatchResult results[MAX_FRAME_BODIES];
+    int resultCount;
+
+    uint64_t updates;
+    uint64_t queries;
+    uint64_t matched;
+    uint64_t saturated;// queries whose visited set filled up
+    struct LatencyStats updateTime;// per frame, us
+    int64_t lastReportUsec;
+};
+
+void pose_match_default_config(struct PoseMatchConfig* config);
+
+// Map the index file; false if it can not be opened or memory is short
+bool pose_matcher_init(struct PoseMatcher* matcher, const char* path, const struct PoseMatchConfig* config);
+void pose_matcher_close(struct PoseMatcher* matcher);
+
+// Query every body of a world-space frame; results replace those of the
+// previous frame until taken
+void pose_matcher_update(struct PoseMatcher* matcher, const struct SkeletonFrame* frame);
+
+// Move up to max results to results; returns how many
+int pose_matcher_take_results(struct PoseMatcher* matcher, struct PoseMatchResult* results, int max);
+
+// Print and reset the statistics every interval_usec
+void pose_matcher_report(struct PoseMatcher* matcher, int64_t now_usec, int64_t interval_usec);
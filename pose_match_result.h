@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+
+// Nearest library pose of a body (pose_match.h), as the matcher reports it
+// and receivers decode it (SKP_MSG_POSE_MATCHES in protocol.h). Kept apart
+// from the matcher so the receiver library does not pull in the task pool
+// and the platform headers.
+
+struct PoseMatchResult
+{
+    uint32_t bodyId;
+    uint16_t clip; // clip index in the index file
+    uint32_t frame;// frame number in the clip
+    float distance;// spine lengths
+};
@@ -0,0 +1,963 @@
+#include "protocol.h"
+
+#define POSITIONS_SIZE (SKELETON_JOINT_COUNT * 3 * 4)
+#define CONFIDENCE_SIZE SKELETON_JOINT_COUNT
+#define ROTATIONS_SIZE (SKELETON_JOINT_COUNT * 4 * 4)
+#define PACKED_CONFIDENCE_SIZE (SKELETON_JOINT_COUNT / 4)
+#define POSITION_UNITS_PER_MM 10.0f
+#define ROTATION_SCALE 32767.0f
+#define HEADING_UNITS_PER_TURN 65536.0f
+#define TWO_PI 6.28318530718f
+
+static void write_common_header(uint8_t* buffer, uint8_t type, uint32_t frame_number,
+                                size_t payload, uint8_t flags)
+{
+    skp_put_u16(buffer, SKP_MAGIC);
+    buffer[2] = SKP_VERSION;
+    buffer[3] = type;
+    skp_put_u32(buffer + 4, frame_number);
+    skp_put_u16(buffer + 8, (uint16_t)payload);
+    buffer[10] = flags;
+    buffer[11] = 0;
+    skp_put_u32(buffer + SKP_SEQUENCE_OFFSET, 0);// stamped by the sender
+}
+
+static uint32_t joint_count(uint32_t mask)
+{
+    uint32_t n = 0;
+    for (; mask != 0; mask &= mask - 1)
+        n++;
+    return n;
+}
+
+size_t skp_encoded_body_size(uint8_t flags, uint32_t joints)
+{
+    size_t rotation_sets = ((flags & SKP_WORLD_ROTATIONS) ? 1 : 0) + ((flags & SKP_LOCAL_ROTATIONS) ? 1 : 0);
+    if (!(flags & SKP_QUANTIZED))
+        return SKP_BODY_HEADER_SIZE + POSITIONS_SIZE + CONFIDENCE_SIZE + rotation_sets * ROTATIONS_SIZE;
+
+    size_t component = (flags & SKP_DELTA) ? 1 : 2;
+    size_t size = SKP_BODY_HEADER_SIZE + 12 + PACKED_CONFIDENCE_SIZE;
+    if (flags & SKP_JOINT_SUBSET)
+        size += 4;
+    if (flags & SKP_DELTA)
+        size += 8;
+    return size + joints * 3 * component + rotation_sets * joints * 4 * component;
+}
+
+size_t skp_body_size(uint8_t flags)
+{
+    return skp_encoded_body_size(flags, SKELETON_JOINT_COUNT);
+}
+
+static uint8_t* write_rotations(uint8_t* p, const quat_t* rotations)
+{
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++, p += 16)
+    {
+        skp_put_f32(p, rotations[j].w);
+        skp_put_f32(p + 4, rotations[j].x);
+        skp_put_f32(p + 8, rotations[j].y);
+        skp_put_f32(p + 12, rotations[j].z);
+    }
+    return p;
+}
+
+static void write_body_header(uint8_t* buffer, const struct SkeletonFrame* frame, uint32_t body,
+                              uint32_t index, uint32_t count, uint8_t flags, size_t size)
+{
+    write_common_header(buffer, SKP_MSG_BODY, frame->frameNumber, size - SKP_COMMON_HEADER_SIZE, flags);
+    skp_put_u32(buffer + 16, frame->bodyIds[body]);
+    buffer[20] = (uint8_t)index;
+    buffer[21] = (uint8_t)count;
+    buffer[22] = frame->slots[body];
+    buffer[23] = 0;
+    skp_put_i64(buffer + 24, frame->timestampUsec);
+}
+
+static void write_full_body(const struct SkeletonFrame* frame, uint32_t body, uint8_t flags, uint8_t* buffer)
+{
+    uint8_t* p = buffer + SKP_BODY_HEADER_SIZE;
+    const vec3_t* positions = frame->positions[body];
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++, p += 12)
+    {
+        skp_put_f32(p, positions[j].x);
+        skp_put_f32(p + 4, positions[j].y);
+        skp_put_f32(p + 8, positions[j].z);
+    }
+    memcpy(p, frame->confidence[body], CONFIDENCE_SIZE);
+    p += CONFIDENCE_SIZE;
+
+    if (flags & SKP_WORLD_ROTATIONS)
+        p = write_rotations(p, frame->worldRotations[body]);
+    if (flags & SKP_LOCAL_ROTATIONS)
+        p = write_rotations(p, frame->localRotations[body]);
+}
+
+static int16_t clamp_i16(int32_t v)
+{
+    return (int16_t)(v > 32767 ? 32767 : (v < -32767 ? -32767 : v));
+}
+
+static int32_t round_to_i32(float v)
+{
+    return (int32_t)(v < 0.0f ? v - 0.5f : v + 0.5f);
+}
+
+// Integer coding of one body, the same on both ends of a delta
+static void quantize_body(const struct SkeletonFrame* frame, uint32_t body, uint32_t mask, uint8_t flags,
+                          struct SkpBodyKey* q)
+{
+    const vec3_t* positions = frame->positions[body];
+    vec3_t origin = positions[JOINT_PELVIS];
+    q->valid = true;
+    q->frameNumber = frame->frameNumber;
+    q->bodyId = frame->bodyIds[body];
+    q->jointMask = mask;
+    q->origin[0] = round_to_i32(origin.x * POSITION_UNITS_PER_MM);
+    q->origin[1] = round_to_i32(origin.y * POSITION_UNITS_PER_MM);
+    q->origin[2] = round_to_i32(origin.z * POSITION_UNITS_PER_MM);
+
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        if (!(mask & (1u << j)))
+        {
+            memset(q->offsets[j], 0, sizeof(q->offsets[j]));
+            memset(q->rotations[0][j], 0, sizeof(q->rotations[0][j]));
+            memset(q->rotations[1][j], 0, sizeof(q->rotations[1][j]));
+            q->confidence[j] = CONFIDENCE_NONE;
+            continue;
+        }
+        vec3_t p = positions[j];
+        q->offsets[j][0] = clamp_i16(round_to_i32(p.x * POSITION_UNITS_PER_MM) - q->origin[0]);
+        q->offsets[j][1] = clamp_i16(round_to_i32(p.y * POSITION_UNITS_PER_MM) - q->origin[1]);
+        q->offsets[j][2] = clamp_i16(round_to_i32(p.z * POSITION_UNITS_PER_MM) - q->origin[2]);
+        q->confidence[j] = frame->confidence[body][j];
+
+        for (int set = 0; set < 2; set++)
+        {
+            if (!(flags & (set == 0 ? SKP_WORLD_ROTATIONS : SKP_LOCAL_ROTATIONS)))
+                continue;
+            quat_t r = set == 0 ? frame->worldRotations[body][j] : frame->localRotations[body][j];
+            float sign = r.w < 0.0f ? -ROTATION_SCALE : ROTATION_SCALE;// q and -q are the same rotation
+            q->rotations[set][j][0] = clamp_i16(round_to_i32(r.w * sign));
+            q->rotations[set][j][1] = clamp_i16(round_to_i32(r.x * sign));
+            q->rotations[set][j][2] = clamp_i16(round_to_i32(r.y * sign));
+            q->rotations[set][j][3] = clamp_i16(round_to_i32(r.z * sign));
+        }
+    }
+}
+
+static int32_t abs_i32(int32_t v)
+{
+    return v < 0 ? -v : v;
+}
+
+// Smallest shift that brings a difference of max_abs into int8 after rounding
+static int delta_shift(int32_t max_abs)
+{
+    int shift = 0;
+    while (shift <= SKP_MAX_DELTA_SHIFT && ((max_abs + (shift > 0 ? 1 << (shift - 1) : 0)) >> shift) > 127)
+        shift++;
+    return shift;
+}
+
+static uint8_t delta_code(int32_t difference, int shift)
+{
+    int32_t half = shift > 0 ? 1 << (shift - 1) : 0;
+    int32_t code = difference >= 0 ? (difference + half) >> shift : -((-difference + half) >> shift);
+    return (uint8_t)(int8_t)code;
+}
+
+static uint8_t* write_packed_confidence(uint8_t* p, const uint8_t* confidence)
+{
+    memset(p, 0, PACKED_CONFIDENCE_SIZE);
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        p[j / 4] |= (uint8_t)((confidence[j] & 3) << ((j % 4) * 2));
+    return p + PACKED_CONFIDENCE_SIZE;
+}
+
+static void write_quantized_body(const struct SkpBodyKey* q, const struct SkpBodyKey* key, int position_shift,
+                                 int rotation_shift, uint8_t flags, uint8_t* buffer)
+{
+    uint8_t* p = buffer + SKP_BODY_HEADER_SIZE;
+    bool delta = (flags & SKP_DELTA) != 0;
+    if (flags & SKP_JOINT_SUBSET)
+    {
+        skp_put_u32(p, q->jointMask);
+        p += 4;
+    }
+    if (delta)
+    {
+        skp_put_u32(p, key->frameNumber);
+        p[4] = (uint8_t)position_shift;
+        p[5] = (uint8_t)rotation_shift;
+        skp_put_u16(p + 6, 0);
+        p += 8;
+    }
+
+    for (int k = 0; k < 3; k++, p += 4)
+        skp_put_u32(p, (uint32_t)(delta ? q->origin[k] - key->origin[k] : q->origin[k]));
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        if (!(q->jointMask & (1u << j)))
+            continue;
+        for (int k = 0; k < 3; k++)
+        {
+            if (delta)
+                *p++ = delta_code(q->offsets[j][k] - key->offsets[j][k], position_shift);
+            else
+            {
+                skp_put_u16(p, (uint16_t)q->offsets[j][k]);
+                p += 2;
+            }
+        }
+    }
+    p = write_packed_confidence(p, q->confidence);
+
+    for (int set = 0; set < 2; set++)
+    {
+        if (!(flags & (set == 0 ? SKP_WORLD_ROTATIONS : SKP_LOCAL_ROTATIONS)))
+            continue;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            if (!(q->jointMask & (1u << j)))
+                continue;
+            for (int k = 0; k < 4; k++)
+            {
+                if (delta)
+                    *p++ = delta_code(q->rotations[set][j][k] - key->rotations[set][j][k], rotation_shift);
+                else
+                {
+                    skp_put_u16(p, (uint16_t)q->rotations[set][j][k]);
+                    p += 2;
+                }
+            }
+        }
+    }
+}
+
+size_t skp_write_body_encoded(const struct SkeletonFrame* frame, uint32_t body, uint32_t index, uint32_t count,
+                              uint8_t flags, uint32_t joint_mask, struct SkpBodyKey* key,
+                              uint8_t* buffer, size_t capacity)
+{
+    if (body >= frame->bodyCount || index >= count || count > MAX_FRAME_BODIES)
+        return 0;
+
+    if (!(flags & SKP_QUANTIZED))
+    {
+        size_t size = skp_body_size(flags);
+        if (size > capacity || (flags & (SKP_DELTA | SKP_JOINT_SUBSET)))
+            return 0;
+        write_body_header(buffer, frame, body, index, count, flags, size);
+        write_full_body(frame, body, flags, buffer);
+        return size;
+    }
+
+    if (!(flags & SKP_JOINT_SUBSET))
+        joint_mask = SKP_ALL_JOINTS;
+    size_t size = skp_encoded_body_size(flags, joint_count(joint_mask));
+    if (size > capacity)
+        return 0;
+
+    struct SkpBodyKey q;
+    quantize_body(frame, body, joint_mask, flags, &q);
+
+    int position_shift = 0;
+    int rotation_shift = 0;
+    if (flags & SKP_DELTA)
+    {
+        if (key == NULL || !key->valid || key->bodyId != q.bodyId || key->jointMask != joint_mask)
+            return 0;
+        int32_t max_position = 0;
+        int32_t max_rotation = 0;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                int32_t d = abs_i32(q.offsets[j][k] - key->offsets[j][k]);
+                max_position = d > max_position ? d : max_position;
+            }
+            for (int set = 0; set < 2; set++)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    int32_t d = abs_i32(q.rotations[set][j][k] - key->rotations[set][j][k]);
+                    max_rotation = d > max_rotation ? d : max_rotation;
+                }
+            }
+        }
+        position_shift = delta_shift(max_position);
+        rotation_shift = delta_shift(max_rotation);
+        if (position_shift > SKP_MAX_DELTA_SHIFT || rotation_shift > SKP_MAX_DELTA_SHIFT)
+            return 0;// moved too far since the key
+    }
+
+    write_body_header(buffer, frame, body, index, count, flags, size);
+    write_quantized_body(&q, key, position_shift, rotation_shift, flags, buffer);
+    if (!(flags & SKP_DELTA) && key != NULL)
+        *key = q;
+    return size;
+}
+
+size_t skp_write_body(const struct SkeletonFrame* frame, uint32_t body, uint8_t flags,
+                      uint8_t* buffer, size_t capacity)
+{
+    return skp_write_body_encoded(frame, body, body, frame->bodyCount, flags, SKP_ALL_JOINTS, NULL,
+                                  buffer, capacity);
+}
+
+size_t skp_write_pca_body(const struct SkeletonFrame* frame, uint32_t body, uint32_t index, uint32_t count,
+                          const struct PoseBasis* basis, int k, float max_error_mm, float* error_mm,
+                          uint8_t* buffer, size_t capacity)
+{
+    *error_mm = 0.0f;
+    size_t size = SKP_PCA_BODY_SIZE(k);
+    if (body >= frame->bodyCount || index >= count || count > MAX_FRAME_BODIES || k < 1 ||
+        k > basis->components || size > capacity)
+        return 0;
+
+    float pose[POSE_BASIS_DIMS];
+    vec3_t origin;
+    float heading;
+    if (!pose_basis_split(frame->positions[body], frame->confidence[body], pose, &origin, &heading))
+        return 0;
+    int16_t coefficients[POSE_BASIS_MAX_COMPONENTS];
+    *error_mm = pose_basis_encode(basis, k, pose, coefficients);
+    if (!(*error_mm <= max_error_mm))
+        return 0;
+
+    write_body_header(buffer, frame, body, index, count, SKP_PCA, size);
+    uint8_t* p = buffer + SKP_BODY_HEADER_SIZE;
+    skp_put_u32(p, basis->basisId);
+    p[4] = (uint8_t)k;
+    p[5] = 0;
+    int32_t error = round_to_i32(*error_mm * POSITION_UNITS_PER_MM);
+    skp_put_u16(p + 6, (uint16_t)(error > 65535 ? 65535 : error));
+    skp_put_u32(p + 8, (uint32_t)round_to_i32(origin.x * POSITION_UNITS_PER_MM));
+    skp_put_u32(p + 12, (uint32_t)round_to_i32(origin.y * POSITION_UNITS_PER_MM));
+    skp_put_u32(p + 16, (uint32_t)round_to_i32(origin.z * POSITION_UNITS_PER_MM));
+    skp_put_u16(p + 20, (uint16_t)round_to_i32(heading / TWO_PI * HEADING_UNITS_PER_TURN));// wraps a turn
+    p = write_packed_confidence(p + 22, frame->confidence[body]);
+    for (int c = 0; c < k; c++, p += 2)
+        skp_put_u16(p, (uint16_t)coefficients[c]);
+    return size;
+}
+
+size_t skp_write_slot_events(uint32_t frame_number, const struct BodySlotEvent* events, int count,
+                             uint8_t* buffer, size_t capacity)
+{
+    size_t size = SKP_COMMON_HEADER_SIZE + 1 + (size_t)count * SKP_EVENT_SIZE;
+    if (size > capacity || count > 255)
+        return 0;
+
+    write_common_header(buffer, SKP_MSG_SLOT_EVENTS, frame_number, size - SKP_COMMON_HEADER_SIZE, 0);
+    buffer[16] = (uint8_t)count;
+    uint8_t* p = buffer + 17;
+    for (int i = 0; i < count; i++, p += SKP_EVENT_SIZE)
+    {
+        p[0] = events[i].type;
+        p[1] = events[i].slot;
+        skp_put_u32(p + 2, events[i].bodyId);
+    }
+    return size;
+}
+
+size_t skp_write_zone_events(uint32_t frame_number, const struct ZoneEvent* events, int count,
+                             uint8_t* buffer, size_t capacity)
+{
+    size_t size = SKP_COMMON_HEADER_SIZE + 1 + (size_t)count * SKP_ZONE_EVENT_SIZE;
+    if (size > capacity || count > SKP_MAX_ZONE_EVENTS)
+        return 0;
+
+    write_common_header(buffer, SKP_MSG_ZONE_EVENTS, frame_number, size - SKP_COMMON_HEADER_SIZE, 0);
+    buffer[16] = (uint8_t)count;
+    uint8_t* p = buffer + 17;
+    for (int i = 0; i < count; i++, p += SKP_ZONE_EVENT_SIZE)
+    {
+        p[0] = events[i].type;
+        p[1] = 0;
+        skp_put_u16(p + 2, events[i].id);
+        skp_put_u32(p + 4, events[i].bodyId);
+        skp_put_u32(p + 8, events[i].otherBodyId);
+    }
+    return size;
+}
+
+size_t skp_write_gesture_events(uint32_t frame_number, const struct GestureEvent* events, int count,
+                                uint8_t* buffer, size_t capacity)
+{
+    size_t size = SKP_COMMON_HEADER_SIZE + 1 + (size_t)count * SKP_GESTURE_EVENT_SIZE;
+    if (size > capacity || count > SKP_MAX_GESTURE_EVENTS)
+        return 0;
+
+    write_common_header(buffer, SKP_MSG_GESTURE_EVENTS, frame_number, size - SKP_COMMON_HEADER_SIZE, 0);
+    buffer[16] = (uint8_t)count;
+    uint8_t* p = buffer + 17;
+    for (int i = 0; i < count; i++, p += SKP_GESTURE_EVENT_SIZE)
+    {
+        p[0] = events[i].type;
+        p[1] = 0;
+        skp_put_u16(p + 2, events[i].id);
+        skp_put_u32(p + 4, events[i].bodyId);
+    }
+    return size;
+}
+
+size_t skp_write_pose_matches(uint32_t frame_number, const struct PoseMatchResult* matches, int count,
+                              uint8_t* buffer, size_t capacity)
+{
+    size_t size = SKP_COMMON_HEADER_SIZE + 1 + (size_t)count * SKP_POSE_MATCH_SIZE;
+    if (size > capacity || count > MAX_FRAME_BODIES)
+        return 0;
+
+    write_common_header(buffer, SKP_MSG_POSE_MATCHES, frame_number, size - SKP_COMMON_HEADER_SIZE, 0);
+    buffer[16] = (uint8_t)count;
+    uint8_t* p = buffer + 17;
+    for (int i = 0; i < count; i++, p += SKP_POSE_MATCH_SIZE)
+    {
+        skp_put_u32(p, matches[i].bodyId);
+        skp_put_u16(p + 4, matches[i].clip);
+        skp_put_u16(p + 6, 0);
+        skp_put_u32(p + 8, matches[i].frame);
+        skp_put_f32(p + 12, matches[i].distance);
+    }
+    return size;
+}
+
+size_t skp_write_retargeted(uint32_t frame_number, const struct RetargetPose* poses, int count, int bone_count,
+                            uint8_t* buffer, size_t capacity)
+{
+    size_t size = SKP_RETARGET_HEADER_SIZE + (size_t)count * SKP_RETARGET_POSE_SIZE(bone_count);
+    if (size > capacity || bone_count < 1 || bone_count > RETARGET_MAX_BONES ||
+        count > skp_max_retarget_poses(bone_count))
+        return 0;
+
+    write_common_header(buffer, SKP_MSG_RETARGETED, frame_number, size - SKP_COMMON_HEADER_SIZE, 0);
+    buffer[16] = (uint8_t)count;
+    buffer[17] = (uint8_t)bone_count;
+    skp_put_u16(buffer + 18, 0);
+    uint8_t* p = buffer + SKP_RETARGET_HEADER_SIZE;
+    for (int i = 0; i < count; i++)
+    {
+        const struct RetargetPose* pose = &poses[i];
+        skp_put_u32(p, pose->bodyId);
+        p[4] = pose->slot;
+        p[5] = pose->lockMask;
+        skp_put_u16(p + 6, 0);
+        skp_put_u32(p + 8, (uint32_t)round_to_i32(pose->root.x * POSITION_UNITS_PER_MM));
+        skp_put_u32(p + 12, (uint32_t)round_to_i32(pose->root.y * POSITION_UNITS_PER_MM));
+        skp_put_u32(p + 16, (uint32_t)round_to_i32(pose->root.z * POSITION_UNITS_PER_MM));
+        p += 20;
+        for (int b = 0; b < bone_count; b++, p += 8)
+        {
+            quat_t r = pose->rotations[b];
+            float sign = r.w < 0.0f ? -ROTATION_SCALE : ROTATION_SCALE;
+            skp_put_u16(p, (uint16_t)clamp_i16(round_to_i32(r.w * sign)));
+            skp_put_u16(p + 2, (uint16_t)clamp_i16(round_to_i32(r.x * sign)));
+            skp_put_u16(p + 4, (uint16_t)clamp_i16(round_to_i32(r.y * sign)));
+            skp_put_u16(p + 6, (uint16_t)clamp_i16(round_to_i32(r.z * sign)));
+        }
+    }
+    return size;
+}
+
+size_t skp_write_parity_header(uint8_t* buffer, uint32_t frame_number, uint32_t first_sequence, uint8_t count,
+                               uint16_t size_xor, size_t xor_size)
+{
+    size_t size = SKP_PARITY_HEADER_SIZE + xor_size;
+    write_common_header(buffer, SKP_MSG_PARITY, frame_number, size - SKP_COMMON_HEADER_SIZE, 0);
+    skp_put_u32(buffer + 16, first_sequence);
+    buffer[20] = count;
+    buffer[21] = 0;
+    skp_put_u16(buffer + 22, size_xor);
+    return size;
+}
+
+bool skp_read_header(const uint8_t* buffer, size_t size, struct SkpHeader* header)
+{
+    if (size < SKP_COMMON_HEADER_SIZE || skp_get_u16(buffer) != SKP_MAGIC || buffer[2] != SKP_VERSION)
+        return false;
+
+    header->type = buffer[3];
+    header->frameNumber = skp_get_u32(buffer + 4);
+    header->payloadSize = skp_get_u16(buffer + 8);
+    header->flags = buffer[10];
+    header->stream = buffer[11];
+    header->sequence = skp_get_u32(buffer + SKP_SEQUENCE_OFFSET);
+    return SKP_COMMON_HEADER_SIZE + (size_t)header->payloadSize <= size;
+}
+
+static const uint8_t* read_rotations(const uint8_t* p, quat_t* rotations)
+{
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++, p += 16)
+    {
+        rotations[j].w = skp_get_f32(p);
+        rotations[j].x = skp_get_f32(p + 4);
+        rotations[j].y = skp_get_f32(p + 8);
+        rotations[j].z = skp_get_f32(p + 12);
+    }
+    return p;
+}
+
+static uint8_t read_packed_confidence(const uint8_t* p, int joint)
+{
+    return (uint8_t)((p[joint / 4] >> ((joint % 4) * 2)) & 3);
+}
+
+static int16_t add_delta(int16_t key, uint8_t code, int shift)
+{
+    return clamp_i16(key + (int32_t)(int8_t)code * (1 << shift));
+}
+
+// Integer fields of a quantized body; deltas are applied to the slot's key
+static bool read_quantized(const uint8_t* buffer, const struct SkpHeader* header, struct SkpBodyKey* keys,
+                           struct SkpBodyKey* q)
+{
+    size_t size = SKP_COMMON_HEADER_SIZE + (size_t)header->payloadSize;
+    uint8_t flags = header->flags;
+    bool delta = (flags & SKP_DELTA) != 0;
+    const uint8_t* p = buffer + SKP_BODY_HEADER_SIZE;
+    uint32_t mask = SKP_ALL_JOINTS;
+    if (flags & SKP_JOINT_SUBSET)
+    {
+        if (size < SKP_BODY_HEADER_SIZE + 4)
+            return false;
+        mask = skp_get_u32(p);
+        p += 4;
+    }
+    if (size != skp_encoded_body_size(flags, joint_count(mask)))
+        return false;
+
+    uint32_t body_id = skp_get_u32(buffer + 16);
+    uint8_t slot = buffer[22];
+    int position_shift = 0;
+    int rotation_shift = 0;
+    if (delta)
+    {
+        const struct SkpBodyKey* key = (keys != NULL && slot < MAX_BODY_SLOTS) ? &keys[slot] : NULL;
+        position_shift = p[4];
+        rotation_shift = p[5];
+        if (key == NULL || !key->valid || key->frameNumber != skp_get_u32(p) || key->bodyId != body_id ||
+            key->jointMask != mask || position_shift > SKP_MAX_DELTA_SHIFT || rotation_shift > SKP_MAX_DELTA_SHIFT)
+            return false;
+        *q = *key;
+        p += 8;
+    }
+    else
+    {
+        q->valid = true;
+        q->frameNumber = header->frameNumber;
+        q->bodyId = body_id;
+        q->jointMask = mask;
+    }
+
+    for (int k = 0; k < 3; k++, p += 4)
+        q->origin[k] = (int32_t)skp_get_u32(p) + (delta ? q->origin[k] : 0);
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        if (!(mask & (1u << j)))
+            continue;
+        for (int k = 0; k < 3; k++)
+        {
+            if (delta)
+                q->offsets[j][k] = add_delta(q->offsets[j][k], *p++, position_shift);
+            else
+            {
+                q->offsets[j][k] = (int16_t)skp_get_u16(p);
+                p += 2;
+            }
+        }
+    }
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        q->confidence[j] = read_packed_confidence(p, j);
+    p += PACKED_CONFIDENCE_SIZE;
+
+    for (int set = 0; set < 2; set++)
+    {
+        if (!(flags & (set == 0 ? SKP_WORLD_ROTATIONS : SKP_LOCAL_ROTATIONS)))
+            continue;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            if (!(mask & (1u << j)))
+                continue;
+            for (int k = 0; k < 4; k++)
+            {
+                if (delta)
+                    q->rotations[set][j][k] = add_delta(q->rotations[set][j][k], *p++, rotation_shift);
+                else
+                {
+                    q->rotations[set][j][k] = (int16_t)skp_get_u16(p);
+                    p += 2;
+                }
+            }
+        }
+    }
+
+    if (!delta && keys != NULL && slot < MAX_BODY_SLOTS)
+        keys[slot] = *q;
+    return true;
+}
+
+static quat_t dequantize_rotation(const int16_t* r)
+{
+    return quat_normalize(quat_make(r[0] / ROTATION_SCALE, r[1] / ROTATION_SCALE, r[2] / ROTATION_SCALE,
+                                    r[3] / ROTATION_SCALE));
+}
+
+// Float body from its integer coding; joints outside the mask follow their parent
+static void dequantize_body(const struct SkpBodyKey* q, uint8_t flags, struct SkeletonFrame* frame, uint32_t body)
+{
+    vec3_t origin = vec3_make(q->origin[0] / POSITION_UNITS_PER_MM, q->origin[1] / POSITION_UNITS_PER_MM,
+                              q->origin[2] / POSITION_UNITS_PER_MM);
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        frame->confidence[body][j] = q->confidence[j];
+        if (q->jointMask & (1u << j))
+        {
+            frame->positions[body][j] = vec3_add(origin, vec3_make(q->offsets[j][0] / POSITION_UNITS_PER_MM,
+                                                                   q->offsets[j][1] / POSITION_UNITS_PER_MM,
+                                                                   q->offsets[j][2] / POSITION_UNITS_PER_MM));
+            if (flags & SKP_WORLD_ROTATIONS)
+                frame->worldRotations[body][j] = dequantize_rotation(q->rotations[0][j]);
+            if (flags & SKP_LOCAL_ROTATIONS)
+                frame->localRotations[body][j] = dequantize_rotation(q->rotations[1][j]);
+            continue;
+        }
+
+        int parent = skeleton_joint_parent[j];
+        frame->positions[body][j] = parent < 0 ? origin : frame->positions[body][parent];
+        if (flags & SKP_WORLD_ROTATIONS)
+            frame->worldRotations[body][j] = parent < 0 ? quat_identity() : frame->worldRotations[body][parent];
+        if (flags & SKP_LOCAL_ROTATIONS)
+            frame->localRotations[body][j] = quat_identity();
+    }
+}
+
+bool skp_body_key_frame(const uint8_t* buffer, const struct SkpHeader* header, uint32_t* key_frame)
+{
+    if (header->type != SKP_MSG_BODY || (header->flags & (SKP_QUANTIZED | SKP_DELTA)) != (SKP_QUANTIZED | SKP_DELTA))
+        return false;
+    size_t at = SKP_BODY_HEADER_SIZE + ((header->flags & SKP_JOINT_SUBSET) ? 4 : 0);
+    if (SKP_COMMON_HEADER_SIZE + (size_t)header->payloadSize < at + 4)
+        return false;
+    *key_frame = skp_get_u32(buffer + at);
+    return true;
+}
+
+bool skp_pca_body_basis(const uint8_t* buffer, const struct SkpHeader* header, uint32_t* basis_id)
+{
+    if (header->type != SKP_MSG_BODY || header->flags != SKP_PCA ||
+        (size_t)header->payloadSize < SKP_PCA_HEADER_SIZE - SKP_COMMON_HEADER_SIZE)
+        return false;
+    *basis_id = skp_get_u32(buffer + SKP_BODY_HEADER_SIZE);
+    return true;
+}
+
+bool skp_read_pca_body(const uint8_t* buffer, const struct SkpHeader* header, const struct PoseBasis* basis,
+                       struct SkeletonFrame* frame, uint32_t* index, uint32_t* count, float* error_mm)
+{
+    uint32_t basis_id;
+    if (!skp_pca_body_basis(buffer, header, &basis_id) || basis_id != basis->basisId)
+        return false;
+    uint32_t body = buffer[20];
+    uint32_t bodies = buffer[21];
+    const uint8_t* p = buffer + SKP_BODY_HEADER_SIZE;
+    int k = p[4];
+    if (body >= bodies || bodies > MAX_FRAME_BODIES || k < 1 || k > basis->components ||
+        SKP_COMMON_HEADER_SIZE + (size_t)header->payloadSize != SKP_PCA_BODY_SIZE(k))
+        return false;
+
+    *error_mm = skp_get_u16(p + 6) / POSITION_UNITS_PER_MM;
+    vec3_t origin = vec3_make((int32_t)skp_get_u32(p + 8) / POSITION_UNITS_PER_MM,
+                              (int32_t)skp_get_u32(p + 12) / POSITION_UNITS_PER_MM,
+                              (int32_t)skp_get_u32(p + 16) / POSITION_UNITS_PER_MM);
+    float heading = skp_get_u16(p + 20) / HEADING_UNITS_PER_TURN * TWO_PI;
+    const uint8_t* confidence = p + 22;
+    const uint8_t* coded = confidence + PACKED_CONFIDENCE_SIZE;
+    int16_t coefficients[POSE_BASIS_MAX_COMPONENTS];
+    for (int c = 0; c < k; c++)
+        coefficients[c] = (int16_t)skp_get_u16(coded + 2 * c);
+
+    float pose[POSE_BASIS_DIMS];
+    pose_basis_decode(basis, k, coefficients, pose);
+    pose_basis_join(pose, origin, heading, frame->positions[body]);
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        frame->confidence[body][j] = read_packed_confidence(confidence, j);
+    frame->timestampUsec = skp_get_i64(buffer + 24);
+    frame->bodyIds[body] = skp_get_u32(buffer + 16);
+    frame->slots[body] = buffer[22];
+    *index = body;
+    *count = bodies;
+    return true;
+}
+
+bool skp_read_body(const uint8_t* buffer, const struct SkpHeader* header, struct SkeletonFrame* frame,
+                   uint32_t* index, uint32_t* count, struct SkpBodyKey* keys)
+{
+    if (header->type != SKP_MSG_BODY || (header->flags & SKP_PCA))
+        return false;
+
+    uint32_t body = buffer[20];
+    uint32_t bodies = buffer[21];
+    if (body >= bodies || bodies > MAX_FRAME_BODIES)
+        return false;
+
+    if (header->flags & SKP_QUANTIZED)
+    {
+        struct SkpBodyKey q;
+        if (!read_quantized(buffer, header, keys, &q))
+            return false;
+        frame->timestampUsec = skp_get_i64(buffer + 24);
+        frame->bodyIds[body] = q.bodyId;
+        frame->slots[body] = buffer[22];
+        dequantize_body(&q, header->flags, frame, body);
+        *index = body;
+        *count = bodies;
+        return true;
+    }
+
+    if ((header->flags & (SKP_DELTA | SKP_JOINT_SUBSET)) ||
+        SKP_COMMON_HEADER_SIZE + (size_t)header->payloadSize != skp_body_size(header->flags))
+        return false;
+
+    frame->timestampUsec = skp_get_i64(buffer + 24);
+    frame->bodyIds[body] = skp_get_u32(buffer + 16);
+    frame->slots[body] = buffer[22];
+
+    const uint8_t* p = buffer + SKP_BODY_HEADER_SIZE;
+    vec3_t* positions = frame->positions[body];
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++, p += 12)
+    {
+        positions[j].x = skp_get_f32(p);
+        positions[j].y = skp_get_f32(p + 4);
+        positions[j].z = skp_get_f32(p + 8);
+    }
+    memcpy(frame->confidence[body], p, CONFIDENCE_SIZE);
+    p += CONFIDENCE_SIZE;
+
+    if (header->flags & SKP_WORLD_ROTATIONS)
+        p = read_rotations(p, frame->worldRotations[body]);
+    if (header->flags & SKP_LOCAL_ROTATIONS)
+        p = read_rotations(p, frame->localRotations[body]);
+
+    *index = body;
+    *count = bodies;
+    return true;
+}
+
+int skp_read_slot_events(const uint8_t* buffer, const struct SkpHeader* header,
+                         struct BodySlotEvent* events, int max)
+{
+    if (header->type != SKP_MSG_SLOT_EVENTS || header->payloadSize < 1)
+        return 0;
+
+    int count = buffer[16];
+    if ((size_t)header->payloadSize < 1 + (size_t)count * SKP_EVENT_SIZE)
+        return 0;
+    if (count > max)
+        count = max;
+
+    const uint8_t* p = buffer + 17;
+    for (int i = 0; i < count; i++, p += SKP_EVENT_SIZE)
+    {
+        events[i].type = p[0];
+        events[i].slot = p[1];
+        events[i].bodyId = skp_get_u32(p + 2);
+    }
+    return count;
+}
+
+int skp_read_zone_events(const uint8_t* buffer, const struct SkpHeader* header,
+                         struct ZoneEvent* events, int max)
+{
+    if (header->type != SKP_MSG_ZONE_EVENTS || header->payloadSize < 1)
+        return 0;
+
+    int count = buffer[16];
+    if ((size_t)header->payloadSize < 1 + (size_t)count * SKP_ZONE_EVENT_SIZE)
+        return 0;
+    if (count > max)
+        count = max;
+
+    const uint8_t* p = buffer + 17;
+    for (int i = 0; i < count; i++, p += SKP_ZONE_EVENT_SIZE)
+    {
+        events[i].type = p[0];
+        events[i].id = skp_get_u16(p + 2);
+        events[i].bodyId = skp_get_u32(p + 4);
+        events[i].otherBodyId = skp_get_u32(p + 8);
+    }
+    return count;
+}
+
+int skp_read_gesture_events(const uint8_t* buffer, const struct SkpHeader* header,
+                            struct GestureEvent* events, int max)
+{
+    if (header->type != SKP_MSG_GESTURE_EVENTS || header->payloadSize < 1)
+        return 0;
+
+    int count = buffer[16];
+    if ((size_t)header->payloadSize < 1 + (size_t)count * SKP_GESTURE_EVENT_SIZE)
+        return 0;
+    if (count > max)
+        count = max;
+
+    const uint8_t* p = buffer + 17;
+    for (int i = 0; i < count; i++, p += SKP_GESTURE_EVENT_SIZE)
+    {
+        events[i].type = p[0];
+        events[i].id = skp_get_u16(p + 2);
+        events[i].bodyId = skp_get_u32(p + 4);
+    }
+    return count;
+}
+
+int skp_read_pose_matches(const uint8_t* buffer, const struct SkpHeader* header,
+                          struct PoseMatchResult* matches, int max)
+{
+    if (header->type != SKP_MSG_POSE_MATCHES || header->payloadSize < 1)
+        return 0;
+
+    int count = buffer[16];
+    if ((size_t)header->payloadSize < 1 + (size_t)count * SKP_POSE_MATCH_SIZE)
+        return 0;
+    if (count > max)
+        count = max;
+
+    const uint8_t* p = buffer + 17;
+    for (int i = 0; i < count; i++, p += SKP_POSE_MATCH_SIZE)
+    {
+        matches[i].bodyId = skp_get_u32(p);
+        matches[i].clip = skp_get_u16(p + 4);
+        matches[i].frame = skp_get_u32(p + 8);
+        matches[i].distance = skp_get_f32(p + 12);
+    }
+    return count;
+}
+
+int skp_read_retargeted(const uint8_t* buffer, const struct SkpHeader* header, struct RetargetPose* poses, int max,
+                        int* bone_count)
+{
+    if (header->type != SKP_MSG_RETARGETED || header->payloadSize < SKP_RETARGET_HEADER_SIZE - SKP_COMMON_HEADER_SIZE)
+        return 0;
+
+    int count = buffer[16], bones = buffer[17];
+    if (bones < 1 || bones > RETARGET_MAX_BONES ||
+        (size_t)header->payloadSize < SKP_RETARGET_HEADER_SIZE - SKP_COMMON_HEADER_SIZE +
+                                          (size_t)count * SKP_RETARGET_POSE_SIZE(bones))
+        return 0;
+    if (count > max)
+        count = max;
+
+    *bone_count = bones;
+    const uint8_t* p = buffer + SKP_RETARGET_HEADER_SIZE;
+    for (int i = 0; i < count; i++)
+    {
+        struct RetargetPose* pose = &poses[i];
+        pose->bodyId = skp_get_u32(p);
+        pose->slot = p[4];
+        pose->lockMask = p[5];
+        pose->root = vec3_make((int32_t)skp_get_u32(p + 8) / POSITION_UNITS_PER_MM,
+                               (int32_t)skp_get_u32(p + 12) / POSITION_UNITS_PER_MM,
+                               (int32_t)skp_get_u32(p + 16) / POSITION_UNITS_PER_MM);
+        p += 20;
+        for (int b = 0; b < bones; b++, p += 8)
+        {
+            int16_t r[4] = { (int16_t)skp_get_u16(p), (int16_t)skp_get_u16(p + 2), (int16_t)skp_get_u16(p + 4),
+                             (int16_t)skp_get_u16(p + 6) };
+            pose->rotations[b] = dequantize_rotation(r);
+        }
+    }
+    return count;
+}
+
+bool skp_read_parity(const uint8_t* buffer, const struct SkpHeader* header, struct SkpParity* parity)
+{
+    size_t size = SKP_COMMON_HEADER_SIZE + (size_t)header->payloadSize;
+    if (header->type != SKP_MSG_PARITY || size < SKP_PARITY_HEADER_SIZE || size > SKP_MAX_PARITY)
+        return false;
+
+    parity->firstSequence = skp_get_u32(buffer + 16);
+    parity->count = buffer[20];
+    parity->sizeXor = skp_get_u16(buffer + 22);
+    parity->data = buffer + SKP_PARITY_HEADER_SIZE;
+    parity->size = size - SKP_PARITY_HEADER_SIZE;
+    return parity->count > 0;
+}
+
+size_t skp_write_feedback(const struct SkpFeedback* feedback, uint8_t* buffer, size_t capacity)
+{
+    if (capacity < SKP_FEEDBACK_SIZE)
+        return 0;
+
+    write_common_header(buffer, SKP_MSG_FEEDBACK, 0, SKP_FEEDBACK_SIZE - SKP_COMMON_HEADER_SIZE, 0);
+    skp_put_u32(buffer + 16, feedback->intervalMs);
+    skp_put_u32(buffer + 20, feedback->datagrams);
+    skp_put_u32(buffer + 24, feedback->lost);
+    skp_put_u32(buffer + 28, feedback->framesComplete);
+    skp_put_u32(buffer + 32, feedback->framesPartial);
+    skp_put_u32(buffer + 36, feedback->jitterUsec);
+    skp_put_u32(buffer + 40, feedback->processingUsec);
+    skp_put_u32(buffer + 44, feedback->maxKbps);
+    skp_put_u32(buffer + 48, feedback->ageUsec);
+    return SKP_FEEDBACK_SIZE;
+}
+
+bool skp_read_feedback(const uint8_t* buffer, const struct SkpHeader* header, struct SkpFeedback* feedback)
+{
+    if (header->type != SKP_MSG_FEEDBACK || SKP_COMMON_HEADER_SIZE + (size_t)header->payloadSize < SKP_FEEDBACK_SIZE)
+        return false;
+
+    feedback->intervalMs = skp_get_u32(buffer + 16);
+    feedback->datagrams = skp_get_u32(buffer + 20);
+    feedback->lost = skp_get_u32(buffer + 24);
+    feedback->framesComplete = skp_get_u32(buffer + 28);
+    feedback->framesPartial = skp_get_u32(buffer + 32);
+    feedback->jitterUsec = skp_get_u32(buffer + 36);
+    feedback->processingUsec = skp_get_u32(buffer + 40);
+    feedback->maxKbps = skp_get_u32(buffer + 44);
+    feedback->ageUsec = skp_get_u32(buffer + 48);
+    return true;
+}
+
+size_t skp_write_ping(int64_t sent_usec, uint8_t* buffer, size_t capacity)
+{
+    if (capacity < SKP_PING_SIZE)
+        return 0;
+
+    write_common_header(buffer, SKP_MSG_PING, 0, SKP_PING_SIZE - SKP_COMMON_HEADER_SIZE, 0);
+    skp_put_i64(buffer + 16, sent_usec);
+    return SKP_PING_SIZE;
+}
+
+bool skp_read_ping(const uint8_t* buffer, const struct SkpHeader* header, int64_t* sent_usec)
+{
+    if (header->type != SKP_MSG_PING || SKP_COMMON_HEADER_SIZE + (size_t)header->payloadSize < SKP_PING_SIZE)
+        return false;
+
+    *sent_usec = skp_get_i64(buffer + 16);
+    return true;
+}
+
+size_t skp_write_pong(const struct SkpPong* pong, uint8_t* buffer, size_t capacity)
+{
+    if (capacity < SKP_PONG_SIZE)
+        return 0;
+
+    write_common_header(buffer, SKP_MSG_PONG, 0, SKP_PONG_SIZE - SKP_COMMON_HEADER_SIZE, 0);
+    skp_put_i64(buffer + 16, pong->pingSentUsec);
+    skp_put_i64(buffer + 24, pong->pingReceivedUsec);
+    skp_put_i64(buffer + 32, pong->pongSentUsec);
+    return SKP_PONG_SIZE;
+}
+
+bool skp_read_pong(const uint8_t* buffer, const struct SkpHeader* header, struct SkpPong* pong)
+{
+    if (header->type != SKP_MSG_PONG || SKP_COMMON_HEADER_SIZE + (size_t)header->payloadSize < SKP_PONG_SIZE)
+        return false;
+
+    pong->pingSentUsec = skp_get_i64(buffer + 16);
+    pong->pingReceivedUsec = skp_get_i64(buffer + 24);
+    pong->pongSentUsec = skp_get_i64(buffer + 32);
+    return true;
+}
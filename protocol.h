@@ -0,0 +1,432 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdbool.h>
+#include "skeleton.h"
+#include "body_slots.h"
+#include "zone_events.h"
+#include "gesture_events.h"
+#include "pose_match_result.h"
+#include "pose_basis.h"
+#include "retarget_pose.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary skeleton stream sent to Unreal (and any other receiver).
+// All values little-endian. Every datagram starts with a common header:
+//
+//   offset size
+//    0     2   magic SKP_MAGIC
+//    2     1   version SKP_VERSION
+//    3     1   message type (enum SkpMessageType)
+//    4     4   frame number; events, pose matches and retargeted poses
+//              carry the number of the body frame that first sends the
+//              bodies they were found in (with --output-rate, the first
+//              output frame rendered at or after their capture)
+//    8     2   payload size following the message header
+//   10     1   flags (enum SkpFlags)
+//   11     1   stream id: the sender keeps one stream per encoding level
+//              and rotation set and one for receivers of events only
+//              (rate_control.h); a receiver that is moved to another level
+//              sees the id change and restarts its sequence tracking
+//   12     4   datagram sequence number, +1 per datagram of the stream
+//              (stamped when sent, so every receiver can count its losses)
+//
+// SKP_MSG_BODY, one datagram per body:
+//   16     4   k4abt body id
+//   20     1   body index in frame
+//   21     1   bodies in frame
+//   22     1   stable receiver slot (BODY_SLOT_NONE if the table is full)
+//   23     1   reserved
+//   24     8   capture time, int64 us, sender monotonic clock (map it to
+//              the receiver clock with SKP_MSG_PING / SKP_MSG_PONG)
+//   32         positions, float32[32][3], mm, world space
+//              confidence, uint8[32] (k4abt_joint_confidence_level_t)
+//              world rotations, float32[32][4] w,x,y,z  (SKP_WORLD_ROTATIONS)
+//              parent-relative rotations, float32[32][4] (SKP_LOCAL_ROTATIONS)
+//
+// With SKP_QUANTIZED the body after offset 32 is integer coded, for the n
+// joints of the joint mask (all 32 without SKP_JOINT_SUBSET):
+//              joint mask u32 (SKP_JOINT_SUBSET only)
+//              key frame u32, position shift u8, rotation shift u8,
+//              reserved u16 (SKP_DELTA only)
+//              origin (pelvis), int32[3], 0.1 mm
+//              joint offsets from the origin, int16[n][3], 0.1 mm
+//              confidence, 2 bits per joint, uint8[8], all 32 joints
+//              world rotations, int16[n][4] w,x,y,z * 32767, w >= 0
+//              parent-relative rotations, int16[n][4]
+// A quantized body without SKP_DELTA is a key for its slot. With SKP_DELTA
+// the origin is an int32 difference to the key of the same slot sent in the
+// key frame, and offsets and rotations are int8 differences scaled by
+// 1 << shift. Receivers without that key drop the body. Joints outside the
+// mask decode with the parent's position and world rotation, an identity
+// local rotation and no confidence.
+//
+// With SKP_PCA (and no other encoding or rotation flag) the body after
+// offset 32 is a root transform and pose coefficients (pose_basis.h):
+//   32     4   basis id; receivers with another basis drop the body
+//   36     1   coefficient count k
+//   37     1   reserved
+//   38     2   reconstruction error, largest joint distance, 0.1 mm
+//   40    12   origin (pelvis), int32[3], 0.1 mm
+//   52     2   heading, u16, 65536 per turn about z
+//   54     8   confidence, 2 bits per joint
+//   62         coefficients of the first k components, int16[k] * basis step
+// Joints out of range were sent at their parent's position.
+//
+// SKP_MSG_SLOT_EVENTS, sent before the bodies of a frame when slots change:
+//   16     1   event count
+//   17         events, 6 bytes each: type (enum BodySlotEventType), slot, body id u32
+//
+// SKP_MSG_ZONE_EVENTS, zone and proximity events of a frame (zone_events.h),
+// several datagrams if they do not fit one:
+//   16     1   event count
+//   17         events, 12 bytes each: type (enum ZoneEventType), reserved,
+//              zone or rule id u16, body id u32, other body id u32 (near and
+//              apart events, else 0)
+//
+// SKP_MSG_GESTURE_EVENTS, gesture start and end events of a frame
+// (gesture_events.h), several datagrams if they do not fit one:
+//   16     1   event count
+//   17         events, 8 bytes each: type (enum GestureEventType), reserved,
+//              gesture id u16, body id u32
+//
+// SKP_MSG_POSE_MATCHES, nearest library pose of the bodies of a frame that
+// have one within the sender's distance (pose_match.h):
+//   16     1   match count
+//   17         matches, 16 bytes each: body id u32, clip u16, reserved u16,
+//              frame in the clip u32, distance float32 (spine lengths)
+//
+// SKP_MSG_RETARGETED, bodies of a frame posed on the sender's target skeleton
+// (retarget.h), several datagrams if they do not fit one:
+//   16     1   pose count
+//   17     1   bone count n, bones in the order of the skeleton file
+//   18     2   reserved
+//   20         poses, 20 + 8n bytes each: body id u32, slot u8, lock mask u8
+//              (bit per IK chain whose end is held), reserved u16, root
+//              int32[3] 0.1 mm, local rotations int16[n][4] w,x,y,z * 32767,
+//              w >= 0
+//
+// SKP_MSG_PARITY, optional XOR forward error correction (skp_stream.h) after
+// each group of datagrams:
+//   16     4   sequence number of the first datagram in the group
+//   20     1   datagrams in the group (consecutive sequence numbers)
+//   21     1   reserved
+//   22     2   XOR of the datagram sizes
+//   24         XOR of the datagrams, each zero-padded to the longest
+// A parity datagram is 24 bytes longer than the longest datagram it covers,
+// so with both rotation sets it exceeds SKP_MAX_DATAGRAM and is fragmented.
+//
+// SKP_MSG_FEEDBACK, receiver -> sender (to the source address of the stream),
+// about once per second:
+//   16     4   report interval, ms
+//   20     4   datagrams received in the interval
+//   24     4   datagrams lost
+//   28     4   frames delivered complete
+//   32     4   frames delivered partial
+//   36     4   frame interarrival jitter, us
+//   40     4   receiver processing time per frame, us
+//   44     4   bandwidth the receiver accepts, kbit/s (0 = no limit)
+//   48     4   mean frame age at delivery, us (0 = clock not synchronized)
+//
+// SKP_MSG_PING, receiver -> sender (to the source address of the stream):
+//   16     8   t1, receiver clock when sent, us
+// SKP_MSG_PONG, sender -> the address of the ping, sent at once:
+//   16     8   t1, echoed
+//   24     8   t2, sender clock when the ping arrived, us
+//   32     8   t3, sender clock when the pong is sent, us
+// With t4 the receiver clock at the pong's arrival, the sender clock is ahead
+// of the receiver clock by ((t2 - t1) + (t3 - t4)) / 2, with an error of at
+// most half the round trip (t4 - t1) - (t3 - t2). Ping, pong and feedback
+// datagrams carry no stream id or sequence number.
+
+#define SKP_MAGIC 0x4B53
+#define SKP_VERSION 9
+#define SKP_COMMON_HEADER_SIZE 16
+#define SKP_SEQUENCE_OFFSET 12
+#define SKP_BODY_HEADER_SIZE 32
+#define SKP_EVENT_SIZE 6
+#define SKP_ZONE_EVENT_SIZE 12
+#define SKP_MAX_ZONE_EVENTS ((SKP_MAX_DATAGRAM - SKP_COMMON_HEADER_SIZE - 1) / SKP_ZONE_EVENT_SIZE)// per datagram
+#define SKP_GESTURE_EVENT_SIZE 8
+#define SKP_MAX_GESTURE_EVENTS ((SKP_MAX_DATAGRAM - SKP_COMMON_HEADER_SIZE - 1) / SKP_GESTURE_EVENT_SIZE)
+#define SKP_POSE_MATCH_SIZE 16
+#define SKP_RETARGET_HEADER_SIZE 20
+#define SKP_RETARGET_POSE_SIZE(n) (20 + 8 * (size_t)(n))
+#define SKP_MAX_DATAGRAM 1472// fits an Ethernet MTU without fragmentation
+#define SKP_PARITY_HEADER_SIZE 24
+#define SKP_MAX_PARITY (SKP_PARITY_HEADER_SIZE + SKP_MAX_DATAGRAM)
+#define SKP_FEEDBACK_SIZE 52
+#define SKP_PING_SIZE 24
+#define SKP_PONG_SIZE 40
+#define SKP_ALL_JOINTS 0xFFFFFFFFu
+#define SKP_MAX_DELTA_SHIFT 7
+#define SKP_PCA_HEADER_SIZE 62
+#define SKP_PCA_BODY_SIZE(k) (SKP_PCA_HEADER_SIZE + 2 * (size_t)(k))
+
+enum SkpMessageType
+{
+    SKP_MSG_BODY = 0,
+    SKP_MSG_SLOT_EVENTS = 1,
+    SKP_MSG_PARITY = 2,
+    SKP_MSG_FEEDBACK = 3,
+    SKP_MSG_PING = 4,
+    SKP_MSG_PONG = 5,
+    SKP_MSG_ZONE_EVENTS = 6,
+    SKP_MSG_GESTURE_EVENTS = 7,
+    SKP_MSG_POSE_MATCHES = 8,
+    SKP_MSG_RETARGETED = 9,
+};
+
+enum SkpFlags
+{
+    SKP_WORLD_ROTATIONS = 0x01,
+    SKP_LOCAL_ROTATIONS = 0x02,
+    SKP_QUANTIZED = 0x04,
+    SKP_DELTA = 0x08,       // with SKP_QUANTIZED
+    SKP_JOINT_SUBSET = 0x10,// with SKP_QUANTIZED
+    SKP_PCA = 0x20,         // alone
+};
+
+static inline void skp_put_u16(uint8_t* p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void skp_put_u32(uint8_t* p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline void skp_put_f32(uint8_t* p, float f)
+{
+    uint32_t v;
+    memcpy(&v, &f, sizeof(v));
+    skp_put_u32(p, v);
+}
+
+static inline void skp_put_i64(uint8_t* p, int64_t v)
+{
+    skp_put_u32(p, (uint32_t)(uint64_t)v);
+    skp_put_u32(p + 4, (uint32_t)((uint64_t)v >> 32));
+}
+
+static inline uint16_t skp_get_u16(const uint8_t* p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t skp_get_u32(const uint8_t* p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline int64_t skp_get_i64(const uint8_t* p)
+{
+    return (int64_t)(skp_get_u32(p) | ((uint64_t)skp_get_u32(p + 4) << 32));
+}
+
+static inline float skp_get_f32(const uint8_t* p)
+{
+    uint32_t v = skp_get_u32(p);
+    float f;
+    memcpy(&f, &v, sizeof(f));
+    return f;
+}
+
+// Decoded common header
+struct SkpHeader
+{
+    uint8_t type;// enum SkpMessageType
+    uint8_t flags;
+    uint16_t payloadSize;
+    uint32_t frameNumber;
+    uint8_t stream;
+    uint32_t sequence;
+};
+
+// Integer coded body as last sent (sender) or received (receiver) in a key
+// datagram; deltas of the same slot are coded against it
+struct SkpBodyKey
+{
+    bool valid;
+    uint32_t frameNumber;
+    uint32_t bodyId;
+    uint32_t jointMask;
+    int32_t origin[3];
+    int16_t offsets[SKELETON_JOINT_COUNT][3];
+    int16_t rotations[2][SKELETON_JOINT_COUNT][4];// world, local
+    uint8_t confidence[SKELETON_JOINT_COUNT];
+};
+
+struct SkpFeedback
+{
+    uint32_t intervalMs;
+    uint32_t datagrams;
+    uint32_t lost;
+    uint32_t framesComplete;
+    uint32_t framesPartial;
+    uint32_t jitterUsec;
+    uint32_t processingUsec;
+    uint32_t maxKbps;
+    uint32_t ageUsec;
+};
+
+struct SkpPong
+{
+    int64_t pingSentUsec;    // t1, receiver clock
+    int64_t pingReceivedUsec;// t2, sender clock
+    int64_t pongSentUsec;    // t3, sender clock
+};
+
+// Retargeted poses of bone_count bones that fit one datagram, at most
+// MAX_FRAME_BODIES
+static inline int skp_max_retarget_poses(int bone_count)
+{
+    size_t n = (SKP_MAX_DATAGRAM - SKP_RETARGET_HEADER_SIZE) / SKP_RETARGET_POSE_SIZE(bone_count);
+    return n < MAX_FRAME_BODIES ? (int)n : MAX_FRAME_BODIES;
+}
+
+// Datagrams that belong to a stream, with its sequence numbers
+static inline bool skp_is_stream_message(uint8_t type)
+{
+    return type == SKP_MSG_BODY || type == SKP_MSG_SLOT_EVENTS || type == SKP_MSG_PARITY ||
+           type == SKP_MSG_ZONE_EVENTS || type == SKP_MSG_GESTURE_EVENTS || type == SKP_MSG_POSE_MATCHES ||
+           type == SKP_MSG_RETARGETED;
+}
+
+// Decoded parity datagram; data points into the received buffer
+struct SkpParity
+{
+    uint32_t firstSequence;
+    uint8_t count;
+    uint16_t sizeXor;
+    const uint8_t* data;
+    size_t size;
+};
+
+// Size of one body datagram with the given flags
+size_t skp_body_size(uint8_t flags);
+
+// Size of a body datagram carrying joint_count joints
+size_t skp_encoded_body_size(uint8_t flags, uint32_t joint_count);
+
+// Serialize one body of the frame; returns the datagram size or 0 if the
+// buffer is too small
+size_t skp_write_body(const struct SkeletonFrame* frame, uint32_t body, uint8_t flags,
+                      uint8_t* buffer, size_t capacity);
+
+// Serialize one body as body index of count bodies sent for the frame, in
+// any encoding. A quantized body without SKP_DELTA is written as a key and
+// stored in key (may be NULL). With SKP_DELTA it is coded against key, and 0
+// is returned if key does not hold this body with the same joint mask or the
+// motion since the key does not fit the deltas: send a key instead.
+size_t skp_write_body_encoded(const struct SkeletonFrame* frame, uint32_t body, uint32_t index, uint32_t count,
+                              uint8_t flags, uint32_t joint_mask, struct SkpBodyKey* key,
+                              uint8_t* buffer, size_t capacity);
+
+// Serialize one body as body index of count bodies with the first k
+// components of basis. error_mm is set to the largest joint distance of the
+// body the receiver rebuilds; 0 is returned if it exceeds max_error_mm or the
+// body has no pose (pelvis or hips out of range): send it in another encoding.
+size_t skp_write_pca_body(const struct SkeletonFrame* frame, uint32_t body, uint32_t index, uint32_t count,
+                          const struct PoseBasis* basis, int k, float max_error_mm, float* error_mm,
+                          uint8_t* buffer, size_t capacity);
+
+// Serialize slot spawn/despawn events of a frame
+size_t skp_write_slot_events(uint32_t frame_number, const struct BodySlotEvent* events, int count,
+                             uint8_t* buffer, size_t capacity);
+
+// Serialize up to SKP_MAX_ZONE_EVENTS zone events of a frame
+size_t skp_write_zone_events(uint32_t frame_number, const struct ZoneEvent* events, int count,
+                             uint8_t* buffer, size_t capacity);
+
+// Serialize up to SKP_MAX_GESTURE_EVENTS gesture events of a frame
+size_t skp_write_gesture_events(uint32_t frame_number, const struct GestureEvent* events, int count,
+                                uint8_t* buffer, size_t capacity);
+
+// Serialize the pose matches of a frame (at most MAX_FRAME_BODIES)
+size_t skp_write_pose_matches(uint32_t frame_number, const struct PoseMatchResult* matches, int count,
+                              uint8_t* buffer, size_t capacity);
+
+// Serialize up to skp_max_retarget_poses(bone_count) retargeted poses of a
+// frame
+size_t skp_write_retargeted(uint32_t frame_number, const struct RetargetPose* poses, int count, int bone_count,
+                            uint8_t* buffer, size_t capacity);
+
+// Header of a parity datagram whose XOR payload of xor_size bytes is already
+// at buffer + SKP_PARITY_HEADER_SIZE; returns the datagram size
+size_t skp_write_parity_header(uint8_t* buffer, uint32_t frame_number, uint32_t first_sequence, uint8_t count,
+                               uint16_t size_xor, size_t xor_size);
+
+// Validate magic, version and sizes of a received datagram and decode its
+// common header
+bool skp_read_header(const uint8_t* buffer, size_t size, struct SkpHeader* header);
+
+// Decode a body datagram into the body index it carries. Fills bodyIds,
+// slots, positions, confidence and the rotations present in header->flags of
+// that body, and the frame's timestampUsec with the capture time in the
+// sender clock; returns false if the datagram is malformed.
+//
+// keys holds one key per receiver slot (MAX_BODY_SLOTS, NULL if the receiver
+// does not keep them): quantized keys are stored there and deltas decoded
+// against them. A delta whose key is missing is reported as malformed; check
+// skp_body_key_frame first to tell the two apart. SKP_PCA bodies are read
+// with skp_read_pca_body.
+bool skp_read_body(const uint8_t* buffer, const struct SkpHeader* header, struct SkeletonFrame* frame,
+                   uint32_t* index, uint32_t* count, struct SkpBodyKey* keys);
+
+// Key frame a delta body was coded against; false for any other datagram
+bool skp_body_key_frame(const uint8_t* buffer, const struct SkpHeader* header, uint32_t* key_frame);
+
+// Basis id a pose coefficient (SKP_PCA) body was coded with; false for any
+// other datagram
+bool skp_pca_body_basis(const uint8_t* buffer, const struct SkpHeader* header, uint32_t* basis_id);
+
+// Decode a pose coefficient body like skp_read_body (positions and
+// confidence only) with the basis it was coded with; error_mm is the
+// sender's reconstruction error. False if malformed or the basis differs.
+bool skp_read_pca_body(const uint8_t* buffer, const struct SkpHeader* header, const struct PoseBasis* basis,
+                       struct SkeletonFrame* frame, uint32_t* index, uint32_t* count, float* error_mm);
+
+size_t skp_write_feedback(const struct SkpFeedback* feedback, uint8_t* buffer, size_t capacity);
+bool skp_read_feedback(const uint8_t* buffer, const struct SkpHeader* header, struct SkpFeedback* feedback);
+
+size_t skp_write_ping(int64_t sent_usec, uint8_t* buffer, size_t capacity);
+bool skp_read_ping(const uint8_t* buffer, const struct SkpHeader* header, int64_t* sent_usec);
+size_t skp_write_pong(const struct SkpPong* pong, uint8_t* buffer, size_t capacity);
+bool skp_read_pong(const uint8_t* buffer, const struct SkpHeader* header, struct SkpPong* pong);
+
+bool skp_read_parity(const uint8_t* buffer, const struct SkpHeader* header, struct SkpParity* parity);
+
+// Decode a slot event datagram; returns the number of events (at most max)
+int skp_read_slot_events(const uint8_t* buffer, const struct SkpHeader* header,
+                         struct BodySlotEvent* events, int max);
+
+// Decode a zone event datagram; returns the number of events (at most max)
+int skp_read_zone_events(const uint8_t* buffer, const struct SkpHeader* header,
+                         struct ZoneEvent* events, int max);
+
+// Decode a gesture event datagram; returns the number of events (at most max)
+int skp_read_gesture_events(const uint8_t* buffer, const struct SkpHeader* header,
+                            struct GestureEvent* events, int max);
+
+// Decode a pose match datagram; returns the number of matches (at most max)
+int skp_read_pose_matches(const uint8_t* buffer, const struct SkpHeader* header,
+                          struct PoseMatchResult* matches, int max);
+
+// Decode a retargeted pose datagram; returns the number of poses (at most
+// max) and sets bone_count (at most RETARGET_MAX_BONES)
+int skp_read_retargeted(const uint8_t* buffer, const struct SkpHeader* header, struct RetargetPose* poses, int max,
+                        int* bone_count);
+
+#ifdef __cplusplus
+}
+#endif
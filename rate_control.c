@@ -0,0 +1,483 @@
+#include <stdio.h>
+#include <string.h>
+#include "rate_control.h"
+
+#define CORE_JOINTS (SKP_ALL_JOINTS & ~((1u << JOINT_HANDTIP_LEFT) | (1u << JOINT_THUMB_LEFT) |            \
+                                       (1u << JOINT_HANDTIP_RIGHT) | (1u << JOINT_THUMB_RIGHT) |          \
+                                       (1u << JOINT_NOSE) | (1u << JOINT_EYE_LEFT) | (1u << JOINT_EAR_LEFT) | \
+                                       (1u << JOINT_EYE_RIGHT) | (1u << JOINT_EAR_RIGHT)))
+
+#define ROTATION_BITS (SKP_WORLD_ROTATIONS | SKP_LOCAL_ROTATIONS)
+#define MAX_EVENT_STREAMS (RATE_LEVEL_COUNT * RATE_ROTATION_SETS + 1)
+
+const struct RateLevelSpec rate_levels[RATE_LEVEL_COUNT] = {
+    { "full", 0, SKP_ALL_JOINTS, 1 },
+    { "quantized", SKP_QUANTIZED, SKP_ALL_JOINTS, 1 },
+    { "delta", SKP_QUANTIZED | SKP_DELTA, SKP_ALL_JOINTS, 1 },
+    { "delta-far", SKP_QUANTIZED | SKP_DELTA, SKP_ALL_JOINTS, 2 },
+    { "core", SKP_QUANTIZED | SKP_DELTA | SKP_JOINT_SUBSET, CORE_JOINTS, 4 },
+    { "pca", SKP_PCA, SKP_ALL_JOINTS, 4 },
+};
+
+void rate_control_default_config(struct RateControlConfig* config)
+{
+    memset(config->rotations, SKP_LOCAL_ROTATIONS, sizeof(config->rotations));
+    config->fecGroup = 0;
+    config->adaptive = false;
+    config->initialLevel = RATE_LEVEL_FULL;
+    config->budgetKbps = 0;
+    config->latencyBudgetUsec = 30000;
+    config->maxLoss = 0.02f;
+    config->farDistanceMm = 4000.0f;
+    config->keyInterval = 8;
+    config->eventsOnly = 0;
+    config->basis = NULL;
+    config->pcaComponents = 24;
+    config->pcaMaxErrorMm = 50.0f;
+}
+
+static uint32_t level_joint_count(int level)
+{
+    uint32_t n = 0;
+    for (uint32_t mask = rate_levels[level].jointMask; mask != 0; mask &= mask - 1)
+        n++;
+    return n;
+}
+
+// Rotation set of a destination's bodies on a level: pca bodies have none
+static int receiver_set(const struct RateControl* rc, int k, int level)
+{
+    return (rate_levels[level].encoding & SKP_PCA) ? 0 : rc->config.rotations[k] & ROTATION_BITS;
+}
+
+void rate_control_init(struct RateControl* rc, const struct RateControlConfig* config)
+{
+    memset(rc, 0, sizeof(*rc));
+    rc->config = *config;
+    platform_mutex_init(&rc->lock);
+    for (int k = 0; k < MAX_DESTINATIONS; k++)
+        rc->receivers[k].level = config->initialLevel;
+    for (int l = 0; l < RATE_LEVEL_COUNT; l++)
+    {
+        for (int set = 0; set < RATE_ROTATION_SETS; set++)
+        {
+            struct RateLevelStream* level = &rc->levels[l][set];
+            skp_stream_encoder_init(&level->stream, config->fecGroup);
+            level->stream.streamId = (uint8_t)(l | set << 4);
+            // a delta body is about half a key; start from the size of a key
+            uint8_t flags = (uint8_t)(set | (rate_levels[l].encoding & ~SKP_DELTA));
+            size_t size = (flags & SKP_PCA) ? SKP_PCA_BODY_SIZE(config->pcaComponents)
+                                            : skp_encoded_body_size(flags, level_joint_count(l));
+            level->bytesPerBody = (float)size / (float)rate_levels[l].farDivisor;
+        }
+    }
+    rc->levelCount = config->basis != NULL ? RATE_LEVEL_COUNT : RATE_LEVEL_PCA;
+    latency_stats_init(&rc->pcaError, "pca error");
+    rc->pcaError.unit = "um";
+    skp_stream_encoder_init(&rc->eventsStream, config->fecGroup);
+    rc->eventsStream.streamId = RATE_CONTROL_EVENTS_STREAM;
+}
+
+void rate_control_destroy(struct RateControl* rc)
+{
+    platform_mutex_destroy(&rc->lock);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Sending
+
+static bool body_skipped(const struct RateControl* rc, const struct RateLevelSpec* spec,
+                         const struct SkeletonFrame* frame, uint32_t b)
+{
+    if (spec->farDivisor <= 1)
+        return false;
+    vec3_t offset = vec3_sub(frame->positions[b][JOINT_PELVIS], frame->cameraPositions[b]);
+    if (vec3_length(offset) <= rc->config.farDistanceMm)
+        return false;
+    // stagger far bodies over the frames by slot
+    return (frame->frameNumber + frame->slots[b]) % spec->farDivisor != 0;
+}
+
+// Pose coefficients, or a quantized key body with all joints and no
+// rotations if the basis does not rebuild the body well enough
+static size_t serialize_pca_body(struct RateControl* rc, const struct SkeletonFrame* frame, uint32_t b, uint32_t index,
+                                 uint32_t count, uint8_t* buffer, float* error_mm, bool* fallback)
+{
+    size_t size = skp_write_pca_body(frame, b, index, count, rc->config.basis, rc->config.pcaComponents,
+                                     rc->config.pcaMaxErrorMm, error_mm, buffer, SKP_MAX_DATAGRAM);
+    *fallback = size == 0;
+    if (size == 0)
+        size = skp_write_body_encoded(frame, b, index, count, SKP_QUANTIZED, SKP_ALL_JOINTS, NULL, buffer,
+                                      SKP_MAX_DATAGRAM);
+    return size;
+}
+
+static void serialize_level(struct RateControl* rc, int l, int set, const struct SkeletonFrame* frame, bool keys_only)
+{
+    const struct RateLevelSpec* spec = &rate_levels[l];
+    struct RateLevelStream* level = &rc->levels[l][set];
+    struct DatagramBatch* batch = &rc->batch;
+    uint8_t flags = (uint8_t)(set | spec->encoding);
+    uint64_t fallbacks = 0;
+    float worst_error = 0.0f;
+    datagram_batch_clear(batch);
+
+    uint32_t bodies[MAX_FRAME_BODIES];
+    uint32_t count = 0;
+    for (uint32_t b = 0; b < frame->bodyCount; b++)
+    {
+        if (!body_skipped(rc, spec, frame, b))
+            bodies[count++] = b;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t b = bodies[i];
+        uint8_t slot = frame->slots[b];
+        struct SkpBodyKey* key = slot < MAX_BODY_SLOTS ? &level->keys[slot] : NULL;
+        uint8_t* buffer = datagram_batch_reserve(batch, SKP_MAX_DATAGRAM);
+        if (buffer == NULL)
+            break;
+
+        size_t size = 0;
+        if (flags & SKP_PCA)
+        {
+            float error;
+            bool fallback;
+            size = serialize_pca_body(rc, frame, b, i, count, buffer, &error, &fallback);
+            fallbacks += fallback;
+            worst_error = error > worst_error ? error : worst_error;
+            datagram_batch_commit(batch, size);
+            continue;
+        }
+        if ((flags & SKP_DELTA) && key != NULL && !keys_only && level->keyAge[slot] < rc->config.keyInterval)
+        {
+            size = skp_write_body_encoded(frame, b, i, count, flags, spec->jointMask, key, buffer, SKP_MAX_DATAGRAM);
+            if (size > 0)
+                level->keyAge[slot]++;
+        }
+        if (size == 0)
+        {
+            // key body: first of the slot, periodic, or the delta did not fit
+            size = skp_write_body_encoded(frame, b, i, count, (uint8_t)(flags & ~SKP_DELTA), spec->jointMask, key,
+                                          buffer, SKP_MAX_DATAGRAM);
+            if (key != NULL)
+                level->keyAge[slot] = 1;
+        }
+        datagram_batch_commit(batch, size);
+    }
+
+    if (frame->bodyCount > 0)
+        level->bytesPerBody += ((float)batch->used / (float)frame->bodyCount - level->bytesPerBody) * 0.05f;
+    if ((flags & SKP_PCA) && count > 0)
+    {
+        platform_mutex_lock(&rc->lock);
+        rc->pcaBodies += count;
+        rc->pcaFallbacks += fallbacks;
+        latency_stats_add(&rc->pcaError, (int64_t)(worst_error * 1000.0f));
+        platform_mutex_unlock(&rc->lock);
+    }
+}
+
+// Body destinations of every stream, consistent for one frame. Returns the
+// streams joined since the last frame when take_joined is set.
+static uint32_t level_masks(struct RateControl* rc, const struct UdpSender* sender,
+                            uint32_t masks[RATE_LEVEL_COUNT][RATE_ROTATION_SETS], bool take_joined)
+{
+    memset(masks, 0, sizeof(uint32_t) * RATE_LEVEL_COUNT * RATE_ROTATION_SETS);
+    platform_mutex_lock(&rc->lock);
+    for (int k = 0; k < sender->destinationCount; k++)
+    {
+        int level = rc->receivers[k].level;
+        if (!(rc->config.eventsOnly & (1u << k)))
+            masks[level][receiver_set(rc, k, level)] |= 1u << k;
+    }
+    uint32_t joined = rc->joinedStreams;
+    if (take_joined)
+        rc->joinedStreams = 0;
+    platform_mutex_unlock(&rc->lock);
+    return joined;
+}
+
+int rate_control_send_frame(struct RateControl* rc, struct UdpSender* sender, const struct SkeletonFrame* frame)
+{
+    uint32_t masks[RATE_LEVEL_COUNT][RATE_ROTATION_SETS];
+    uint32_t joined = level_masks(rc, sender, masks, true);
+
+    int failed = 0;
+    for (int l = 0; l < RATE_LEVEL_COUNT; l++)
+    {
+        for (int set = 0; set < RATE_ROTATION_SETS; set++)
+        {
+            if (masks[l][set] == 0)
+                continue;
+            serialize_level(rc, l, set, frame, (joined & (1u << (l * RATE_ROTATION_SETS + set))) != 0);
+            failed += udp_sender_send_to(sender, &rc->batch, masks[l][set], skp_stream_prepare,
+                                         &rc->levels[l][set].stream);
+        }
+    }
+    return failed;
+}
+
+// Streams events go out on: every body stream in use and, with events_only,
+// the events-only destinations. Returns the number of streams.
+static int event_streams(struct RateControl* rc, const struct UdpSender* sender, bool events_only, uint32_t* masks,
+                         struct SkpStreamEncoder** streams)
+{
+    uint32_t level_mask[RATE_LEVEL_COUNT][RATE_ROTATION_SETS];
+    level_masks(rc, sender, level_mask, false);
+    int count = 0;
+    for (int l = 0; l < RATE_LEVEL_COUNT; l++)
+    {
+        for (int set = 0; set < RATE_ROTATION_SETS; set++)
+        {
+            if (level_mask[l][set] == 0)
+                continue;
+            masks[count] = level_mask[l][set];
+            streams[count++] = &rc->levels[l][set].stream;
+        }
+    }
+    uint32_t only = events_only ? rc->config.eventsOnly & ((1u << sender->destinationCount) - 1) : 0;
+    if (only != 0)
+    {
+        masks[count] = only;
+        streams[count++] = &rc->eventsStream;
+    }
+    return count;
+}
+
+int rate_control_send_events(struct RateControl* rc, struct UdpSender* sender, uint32_t frame_number,
+                             const struct BodySlotEvent* events, int count)
+{
+    uint32_t masks[MAX_EVENT_STREAMS];
+    struct SkpStreamEncoder* streams[MAX_EVENT_STREAMS];
+    int stream_count = event_streams(rc, sender, true, masks, streams);
+
+    int failed = 0;
+    for (int s = 0; s < stream_count; s++)
+    {
+        // rebuilt per stream: the prepare hook stamps and appends parity in place
+        datagram_batch_clear(&rc->eventsBatch);
+        uint8_t* buffer = datagram_batch_reserve(&rc->eventsBatch, SKP_MAX_DATAGRAM);
+        datagram_batch_commit(&rc->eventsBatch,
+                              skp_write_slot_events(frame_number, events, count, buffer, SKP_MAX_DATAGRAM));
+        failed += udp_sender_send_to(sender, &rc->eventsBatch, masks[s], skp_stream_prepare, streams[s]);
+    }
+    return failed;
+}
+
+int rate_control_send_zone_events(struct RateControl* rc, struct UdpSender* sender, uint32_t frame_number,
+                                  const struct ZoneEvent* events, int count)
+{
+    uint32_t masks[MAX_EVENT_STREAMS];
+    struct SkpStreamEncoder* streams[MAX_EVENT_STREAMS];
+    int stream_count = event_streams(rc, sender, true, masks, streams);
+
+    int failed = 0;
+    for (int s = 0; s < stream_count; s++)
+    {
+        datagram_batch_clear(&rc->eventsBatch);
+        for (int first = 0; first < count; first += SKP_MAX_ZONE_EVENTS)
+        {
+            int n = count - first < SKP_MAX_ZONE_EVENTS ? count - first : SKP_MAX_ZONE_EVENTS;
+            uint8_t* buffer = datagram_batch_reserve(&rc->eventsBatch, SKP_MAX_DATAGRAM);
+            if (buffer == NULL)
+                break;
+            datagram_batch_commit(&rc->eventsBatch,
+                                  skp_write_zone_events(frame_number, events + first, n, buffer, SKP_MAX_DATAGRAM));
+        }
+        failed += udp_sender_send_to(sender, &rc->eventsBatch, masks[s], skp_stream_prepare, streams[s]);
+    }
+    return failed;
+}
+
+int rate_control_send_gesture_events(struct RateControl* rc, struct UdpSender* sender, uint32_t frame_number,
+                                     const struct GestureEvent* events, int count)
+{
+    uint32_t masks[MAX_EVENT_STREAMS];
+    struct SkpStreamEncoder* streams[MAX_EVENT_STREAMS];
+    int stream_count = event_streams(rc, sender, true, masks, streams);
+
+    int failed = 0;
+    for (int s = 0; s < stream_count; s++)
+    {
+        datagram_batch_clear(&rc->eventsBatch);
+        for (int first = 0; first < count; first += SKP_MAX_GESTURE_EVENTS)
+        {
+            int n = count - first < SKP_MAX_GESTURE_EVENTS ? count - first : SKP_MAX_GESTURE_EVENTS;
+            uint8_t* buffer = datagram_batch_reserve(&rc->eventsBatch, SKP_MAX_DATAGRAM);
+            if (buffer == NULL)
+                break;
+            datagram_batch_commit(&rc->eventsBatch,
+                                  skp_write_gesture_events(frame_number, events + first, n, buffer, SKP_MAX_DATAGRAM));
+        }
+        failed += udp_sender_send_to(sender, &rc->eventsBatch, masks[s], skp_stream_prepare, streams[s]);
+    }
+    return failed;
+}
+
+int rate_control_send_pose_matches(struct RateControl* rc, struct UdpSender* sender, uint32_t frame_number,
+                                   const struct PoseMatchResult* matches, int count)
+{
+    uint32_t masks[MAX_EVENT_STREAMS];
+    struct SkpStreamEncoder* streams[MAX_EVENT_STREAMS];
+    int stream_count = event_streams(rc, sender, true, masks, streams);
+
+    int failed = 0;
+    for (int s = 0; s < stream_count; s++)
+    {
+        datagram_batch_clear(&rc->eventsBatch);
+        uint8_t* buffer = datagram_batch_reserve(&rc->eventsBatch, SKP_MAX_DATAGRAM);
+        datagram_batch_commit(&rc->eventsBatch,
+                              skp_write_pose_matches(frame_number, matches, count, buffer, SKP_MAX_DATAGRAM));
+        failed += udp_sender_send_to(sender, &rc->eventsBatch, masks[s], skp_stream_prepare, streams[s]);
+    }
+    return failed;
+}
+
+int rate_control_send_retargeted(struct RateControl* rc, struct UdpSender* sender, uint32_t frame_number,
+                                 const struct RetargetPose* poses, int count, int bone_count)
+{
+    uint32_t masks[MAX_EVENT_STREAMS];
+    struct SkpStreamEncoder* streams[MAX_EVENT_STREAMS];
+    int stream_count = event_streams(rc, sender, false, masks, streams);
+    int per_datagram = skp_max_retarget_poses(bone_count);
+
+    int failed = 0;
+    for (int s = 0; s < stream_count; s++)
+    {
+        datagram_batch_clear(&rc->eventsBatch);
+        for (int first = 0; first < count; first += per_datagram)
+        {
+            int n = count - first < per_datagram ? count - first : per_datagram;
+            uint8_t* buffer = datagram_batch_reserve(&rc->eventsBatch, SKP_MAX_DATAGRAM);
+            if (buffer == NULL)
+                break;
+            datagram_batch_commit(&rc->eventsBatch, skp_write_retargeted(frame_number, poses + first, n, bone_count,
+                                                                         buffer, SKP_MAX_DATAGRAM));
+        }
+        failed += udp_sender_send_to(sender, &rc->eventsBatch, masks[s], skp_stream_prepare, streams[s]);
+    }
+    return failed;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Feedback
+
+static uint32_t effective_budget(const struct RateControl* rc, const struct SkpFeedback* feedback)
+{
+    uint32_t budget = rc->config.budgetKbps;
+    if (feedback->maxKbps != 0 && (budget == 0 || feedback->maxKbps < budget))
+        budget = feedback->maxKbps;
+    return budget;
+}
+
+static void set_level(struct RateControl* rc, const struct UdpSender* sender, int k, int level, const char* reason)
+{
+    struct RateReceiver* r = &rc->receivers[k];
+    printf("Receiver %s: %s -> %s (%s)\n", sender->destinations[k].name, rate_levels[r->level].name,
+           rate_levels[level].name, reason);
+    platform_mutex_lock(&rc->lock);
+    r->level = level;
+    rc->joinedStreams |= 1u << (level * RATE_ROTATION_SETS + receiver_set(rc, k, level));
+    platform_mutex_unlock(&rc->lock);
+    r->healthyReports = 0;
+}
+
+static void on_feedback(struct RateControl* rc, struct UdpSender* sender, int k, const struct SkpFeedback* feedback,
+                        int64_t now)
+{
+    struct RateReceiver* r = &rc->receivers[k];
+    platform_mutex_lock(&sender->lock);
+    uint64_t bytes = sender->destinations[k].totalBytes;
+    platform_mutex_unlock(&sender->lock);
+
+    bool first = !r->haveFeedback;
+    if (!first && now > r->feedbackUsec)
+        r->sentKbps = (float)(bytes - r->feedbackBytes) * 8.0f / ((float)(now - r->feedbackUsec) / 1000.0f);
+    r->haveFeedback = true;
+    r->feedback = *feedback;
+    r->feedbackUsec = now;
+    r->feedbackBytes = bytes;
+    if (first || !rc->config.adaptive || (rc->config.eventsOnly & (1u << k)))
+        return;
+
+    uint32_t budget = effective_budget(rc, feedback);
+    uint32_t expected = feedback->datagrams + feedback->lost;
+    float loss = expected > 0 ? (float)feedback->lost / (float)expected : 0.0f;
+    int64_t latency = (int64_t)feedback->jitterUsec + feedback->processingUsec;
+
+    const char* reason = NULL;
+    if (budget != 0 && r->sentKbps > (float)budget)
+        reason = "over bandwidth budget";
+    else if (latency > rc->config.latencyBudgetUsec)
+        reason = "over latency budget";
+    else if (loss > rc->config.maxLoss)
+        reason = "losing datagrams";
+
+    if (reason != NULL)
+    {
+        r->healthyReports = 0;
+        if (r->level + 1 < rc->levelCount)
+            set_level(rc, sender, k, r->level + 1, reason);
+        return;
+    }
+
+    if (++r->healthyReports < RATE_CONTROL_RECOVER_REPORTS || r->level == 0)
+        return;
+    // scale the measured rate by the per-body cost of the richer level
+    const struct RateLevelStream* current = &rc->levels[r->level][receiver_set(rc, k, r->level)];
+    const struct RateLevelStream* up = &rc->levels[r->level - 1][receiver_set(rc, k, r->level - 1)];
+    float richer = r->sentKbps * up->bytesPerBody / current->bytesPerBody;
+    if (budget == 0 || richer < (float)budget * RATE_CONTROL_UPGRADE_HEADROOM)
+        set_level(rc, sender, k, r->level - 1, "healthy");
+}
+
+void rate_control_on_feedback(struct RateControl* rc, struct UdpSender* sender, const SOCKADDR_IN* from,
+                              const struct SkpFeedback* feedback, int64_t now_usec)
+{
+    int k = udp_sender_find_destination(sender, from);
+    if (k < 0)
+        return;
+    rc->feedbackReceived++;
+    on_feedback(rc, sender, k, feedback, now_usec);
+}
+
+void rate_control_report(struct RateControl* rc, const struct UdpSender* sender, int64_t now_usec,
+                         int64_t interval_usec)
+{
+    if (now_usec - rc->lastReportUsec < interval_usec)
+        return;
+    if (rc->lastReportUsec != 0 && rc->feedbackReceived > 0)
+    {
+        for (int k = 0; k < sender->destinationCount; k++)
+        {
+            const struct RateReceiver* r = &rc->receivers[k];
+            if (!r->haveFeedback)
+                continue;
+            const struct SkpFeedback* f = &r->feedback;
+            printf("Receiver %-21s %-9s %7.0f kbit/s, lost %u of %u, jitter %u us, processing %u us",
+                   sender->destinations[k].name,
+                   (rc->config.eventsOnly & (1u << k)) ? "events" : rate_levels[r->level].name, r->sentKbps, f->lost,
+                   f->datagrams + f->lost, f->jitterUsec, f->processingUsec);
+            if (f->ageUsec != 0)
+                printf(", frame age %.1f ms", f->ageUsec / 1000.0);
+            printf("\n");
+        }
+    }
+
+    platform_mutex_lock(&rc->lock);
+    uint64_t bodies = rc->pcaBodies;
+    uint64_t fallbacks = rc->pcaFallbacks;
+    struct LatencyStats error = rc->pcaError;
+    rc->pcaBodies = 0;
+    rc->pcaFallbacks = 0;
+    latency_stats_reset(&rc->pcaError);
+    platform_mutex_unlock(&rc->lock);
+    if (rc->lastReportUsec != 0 && bodies > 0)
+    {
+        printf("pca: %llu bodies, %llu sent quantized\n", (unsigned long long)bodies, (unsigned long long)fallbacks);
+        latency_stats_print(&error);
+    }
+    rc->lastReportUsec = now_usec;
+}
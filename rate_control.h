@@ -0,0 +1,150 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "platform.h"
+#include "protocol.h"
+#include "udp_sender.h"
+#include "skp_stream.h"
+#include "latency_stats.h"
+
+// Per-receiver adaptation of the binary stream from receiver feedback.
+//
+// The sender keeps one output stream per encoding level and rotation set,
+// each with its own stream id, sequence numbers, FEC and delta keys, and
+// serializes a frame once per stream that has receivers. Every destination
+// gets the rotation sets it subscribed to (--dest-rotations); the pca level
+// carries none, so its receivers share one stream whatever they asked for. Receivers report loss, jitter and
+// processing time about once per second (SKP_MSG_FEEDBACK). A receiver over
+// its bandwidth or latency budget, or losing datagrams, moves one level down
+// the ladder at once; it moves back up after RATE_CONTROL_RECOVER_REPORTS
+// healthy reports if the richer level is expected to fit the budget.
+// Receivers that never report stay at the initial level.
+//
+// The last level sends each body as a root transform and the coefficients of
+// a pose basis (pose_basis.h), positions only; it exists only when a basis is
+// configured. A body the basis rebuilds worse than pcaMaxErrorMm (a pose it
+// was not learned from) goes out as a quantized key with all joints instead.
+//
+// Destinations marked events-only get slot, zone and gesture events and pose
+// matches but no bodies, on a stream of their own (id RATE_CONTROL_EVENTS_STREAM) so their
+// sequence numbers have no holes; their feedback moves no level.
+
+#define RATE_CONTROL_RECOVER_REPORTS 3
+#define RATE_CONTROL_UPGRADE_HEADROOM 0.8f// richer level must fit in this share of the budget
+#define RATE_CONTROL_EVENTS_STREAM RATE_LEVEL_COUNT
+#define RATE_ROTATION_SETS 4// none, world, local, both: the SkpFlags rotation bits
+
+enum RateLevel
+{
+    RATE_LEVEL_FULL,      // float32, as without rate control
+    RATE_LEVEL_QUANTIZED, // int16 offsets and rotations
+    RATE_LEVEL_DELTA,     // int8 deltas to periodic key bodies
+    RATE_LEVEL_DELTA_FAR, // and far bodies at half rate
+    RATE_LEVEL_CORE,      // and far bodies at quarter rate, no finger, face or ear joints
+    RATE_LEVEL_PCA,       // pose basis coefficients, far bodies at quarter rate, no rotations
+    RATE_LEVEL_COUNT
+};
+
+struct RateLevelSpec
+{
+    const char* name;
+    uint8_t encoding;// SKP_QUANTIZED, SKP_DELTA, SKP_JOINT_SUBSET, SKP_PCA
+    uint32_t jointMask;
+    uint32_t farDivisor;// far bodies are sent on one frame in this many
+};
+
+extern const struct RateLevelSpec rate_levels[RATE_LEVEL_COUNT];
+
+struct RateControlConfig
+{
+    uint8_t rotations[MAX_DESTINATIONS];// enum SkpFlags rotation sets of every destination
+    uint8_t fecGroup;         // see skp_stream.h, 0 = off
+    bool adaptive;            // follow feedback; otherwise receivers keep initialLevel
+    int initialLevel;
+    uint32_t budgetKbps;      // per receiver, 0 = no limit (receivers may ask for less)
+    int64_t latencyBudgetUsec;// receiver jitter + processing time per frame
+    float maxLoss;            // fraction of datagrams
+    float farDistanceMm;      // pelvis distance from the camera
+    uint32_t keyInterval;     // frames between key bodies of a slot in delta levels
+    uint32_t eventsOnly;      // bit per destination that gets events but no bodies
+    const struct PoseBasis* basis;// RATE_LEVEL_PCA, NULL = the ladder ends at core
+    int pcaComponents;        // coefficients per body, at most basis->components
+    float pcaMaxErrorMm;      // larger reconstruction errors fall back to a quantized body
+};
+
+struct RateReceiver
+{
+    int level;
+    int healthyReports;
+    bool haveFeedback;
+    struct SkpFeedback feedback;// latest
+    int64_t feedbackUsec;
+    uint64_t feedbackBytes;// destination totalBytes at the latest feedback
+    float sentKbps;        // over the latest feedback interval
+};
+
+// One encoding level with one rotation set; stream id level | set << 4
+struct RateLevelStream
+{
+    struct SkpStreamEncoder stream;
+    struct SkpBodyKey keys[MAX_BODY_SLOTS];
+    uint32_t keyAge[MAX_BODY_SLOTS];// frames since the key of the slot
+    float bytesPerBody;             // smoothed, for upgrade estimates
+};
+
+struct RateControl
+{
+    struct RateControlConfig config;
+    platform_mutex_t lock;// receiver levels: feedback on the main thread, sends on the output thread
+    struct RateReceiver receivers[MAX_DESTINATIONS];
+    uint32_t joinedStreams;// bit per stream (level * RATE_ROTATION_SETS + set) a receiver just
+                           // joined: it has no keys yet
+    struct RateLevelStream levels[RATE_LEVEL_COUNT][RATE_ROTATION_SETS];
+    struct DatagramBatch batch;// bodies of one stream at a time, on the output thread
+    struct SkpStreamEncoder eventsStream;// events-only destinations
+    struct DatagramBatch eventsBatch;// under the output stage lock
+    int levelCount;// RATE_LEVEL_PCA without a basis
+    uint64_t feedbackReceived;
+
+    // RATE_LEVEL_PCA since the last report, under lock
+    uint64_t pcaBodies;
+    uint64_t pcaFallbacks;
+    struct LatencyStats pcaError;// largest reconstruction error of a frame, um
+
+    int64_t lastReportUsec;
+};
+
+void rate_control_default_config(struct RateControlConfig* config);
+void rate_control_init(struct RateControl* control, const struct RateControlConfig* config);
+void rate_control_destroy(struct RateControl* control);
+
+// Serialize the frame once per stream in use and send each stream to its
+// receivers; returns the number of failed datagrams
+int rate_control_send_frame(struct RateControl* control, struct UdpSender* sender, const struct SkeletonFrame* frame);
+
+// Slot events go to every stream in use, in the sequence of each stream,
+// and to the events-only destinations
+int rate_control_send_events(struct RateControl* control, struct UdpSender* sender, uint32_t frame_number,
+                             const struct BodySlotEvent* events, int count);
+
+// Zone events likewise, in as many datagrams as they need
+int rate_control_send_zone_events(struct RateControl* control, struct UdpSender* sender, uint32_t frame_number,
+                                  const struct ZoneEvent* events, int count);
+int rate_control_send_gesture_events(struct RateControl* control, struct UdpSender* sender, uint32_t frame_number,
+                                     const struct GestureEvent* events, int count);
+int rate_control_send_pose_matches(struct RateControl* control, struct UdpSender* sender, uint32_t frame_number,
+                                   const struct PoseMatchResult* matches, int count);
+
+// Retargeted poses go to every stream in use but not to the events-only
+// destinations: they are bodies, not events
+int rate_control_send_retargeted(struct RateControl* control, struct UdpSender* sender, uint32_t frame_number,
+                                 const struct RetargetPose* poses, int count, int bone_count);
+
+// Adapt the level of the receiver a feedback datagram came from
+void rate_control_on_feedback(struct RateControl* control, struct UdpSender* sender, const SOCKADDR_IN* from,
+                              const struct SkpFeedback* feedback, int64_t now_usec);
+
+// Print the level and latest feedback of every receiver, and the pose basis
+// reconstruction errors, every interval_usec
+void rate_control_report(struct RateControl* control, const struct UdpSender* sender, int64_t now_usec,
+                         int64_t interval_usec);
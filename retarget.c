@@ -0,0 +1,555 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "retarget.h"
+#include "platform.h"
+
+#define RETARGET_LINE_MAX 512
+#define MIN_SEGMENT_MM 1.0f
+#define REACH_TOLERANCE_MM 0.01f
+
+void retarget_default_config(struct RetargetConfig* config)
+{
+    config->lockSpeed = 250.0f;
+    config->releaseSpeed = 500.0f;
+    config->lockHeight = 150.0f;
+    config->releaseDistance = 150.0f;
+    config->releaseUsec = 200000;
+    config->legSmoothing = 0.05f;
+    config->maxRootDrop = 100.0f;
+}
+
+void retargeter_init(struct Retargeter* retargeter, const struct RetargetConfig* config)
+{
+    memset(retargeter, 0, sizeof(*retargeter));
+    if (config != NULL)
+        retargeter->config = *config;
+    else
+        retarget_default_config(&retargeter->config);
+    retargeter->hipBones[0] = retargeter->hipBones[1] = -1;
+    latency_stats_init(&retargeter->updateTime, "retarget");
+    task_loop_init(&retargeter->loop, "retarget", 5000);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Rotations
+
+static vec3_t normalize_or(vec3_t v, vec3_t fallback)
+{
+    float n = vec3_length(v);
+    return n > 1e-6f ? vec3_scale(v, 1.0f / n) : fallback;
+}
+
+// Any unit vector perpendicular to unit v
+static vec3_t perpendicular(vec3_t v)
+{
+    vec3_t axis = fabsf(v.z) < 0.9f ? vec3_make(0.0f, 0.0f, 1.0f) : vec3_make(1.0f, 0.0f, 0.0f);
+    return normalize_or(vec3_cross(v, axis), vec3_make(0.0f, 1.0f, 0.0f));
+}
+
+// Smallest rotation taking unit u onto unit v
+static quat_t swing(vec3_t u, vec3_t v)
+{
+    float d = vec3_dot(u, v);
+    if (d < -0.9999f)
+    {
+        vec3_t a = perpendicular(u);
+        return quat_make(0.0f, a.x, a.y, a.z);
+    }
+    vec3_t c = vec3_cross(u, v);
+    return quat_normalize(quat_make(1.0f + d, c.x, c.y, c.z));
+}
+
+// Rotation taking unit aim a and side s (not along a) onto aim b and side t:
+// the swing of the aims, then the twist about b that lines up the sides
+static quat_t align(vec3_t a, vec3_t s, vec3_t b, vec3_t t)
+{
+    quat_t q = swing(a, b);
+    vec3_t turned = quat_rotate(q, s);
+    vec3_t from = vec3_sub(turned, vec3_scale(b, vec3_dot(turned, b)));
+    vec3_t to = vec3_sub(t, vec3_scale(b, vec3_dot(t, b)));
+    float angle = atan2f(vec3_dot(vec3_cross(from, to), b), vec3_dot(from, to));
+    return quat_normalize(quat_mul(quat_from_rotvec(vec3_scale(b, angle)), q));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Solver
+
+// Hip-knee-ankle length of a body or target, mean of the sides that have it;
+// 0 if neither does
+static float leg_length(const vec3_t* hip, const vec3_t* knee, const vec3_t* ankle, const bool* present)
+{
+    float sum = 0.0f;
+    int sides = 0;
+    for (int side = 0; side < 2; side++)
+    {
+        if (!present[side])
+            continue;
+        sum += vec3_length(vec3_sub(knee[side], hip[side])) + vec3_length(vec3_sub(ankle[side], knee[side]));
+        sides++;
+    }
+    return sides > 0 ? sum / sides : 0.0f;
+}
+
+static float body_leg_length(const vec3_t* joints)
+{
+    vec3_t hip[2] = { joints[JOINT_HIP_LEFT], joints[JOINT_HIP_RIGHT] };
+    vec3_t knee[2] = { joints[JOINT_KNEE_LEFT], joints[JOINT_KNEE_RIGHT] };
+    vec3_t ankle[2] = { joints[JOINT_ANKLE_LEFT], joints[JOINT_ANKLE_RIGHT] };
+    bool present[2] = { true, true };
+    return leg_length(hip, knee, ankle, present);
+}
+
+// Target of a chain end marked lock: the touch-down point while held, else
+// the free target plus what is left of the offset at lift-off
+static vec3_t hold_end(const struct Retargeter* r, struct RetargetLock* lock, vec3_t free_target, vec3_t joint,
+                       int64_t now_usec, bool* held)
+{
+    const struct RetargetConfig* c = &r->config;
+    float dt = lock->lastUsec != 0 ? (float)(now_usec - lock->lastUsec) * 1e-6f : 0.0f;
+    float speed = dt > 0.0f ? vec3_length(vec3_sub(joint, lock->lastJoint)) / dt : INFINITY;
+    float height = joint.z - r->floorZ;
+    lock->lastJoint = joint;
+    lock->lastUsec = now_usec;
+
+    if (lock->locked && (speed > c->releaseSpeed || height > c->lockHeight ||
+                         vec3_length(vec3_sub(free_target, lock->position)) > c->releaseDistance))
+    {
+        lock->locked = false;
+        lock->offset = vec3_sub(lock->position, free_target);
+    }
+    else if (!lock->locked && speed < c->lockSpeed && height < c->lockHeight)
+    {
+        lock->locked = true;
+        lock->position = vec3_add(free_target, lock->offset);// no jump at touch-down
+        lock->offset = vec3_make(0.0f, 0.0f, 0.0f);
+    }
+    *held = lock->locked;
+    if (lock->locked)
+        return lock->position;
+
+    // about 95% of the offset is gone after releaseUsec
+    float fade = c->releaseUsec > 0 && dt > 0.0f ? expf(-3.0f * dt * 1e6f / (float)c->releaseUsec) : 0.0f;
+    lock->offset = vec3_scale(lock->offset, fade);
+    return vec3_add(free_target, lock->offset);
+}
+
+// Two-bone solution of one chain: the corrections of the upper and lower
+// bone turns that put the end head on target. False if out of reach.
+static bool solve_chain(const struct RetargetChain* chain, const vec3_t* heads, vec3_t target, vec3_t bend,
+                        quat_t* upper, quat_t* lower)
+{
+    vec3_t a = heads[chain->bones[0]], m = heads[chain->bones[1]], e = heads[chain->bones[2]];
+    float l1 = chain->upperLength, l2 = chain->lowerLength;
+
+    vec3_t d = vec3_sub(target, a);
+    float dist = vec3_length(d);
+    vec3_t dir = normalize_or(d, normalize_or(vec3_sub(e, a), vec3_make(0.0f, 0.0f, -1.0f)));
+    float longest = l1 + l2, shortest = fabsf(l1 - l2) + MIN_SEGMENT_MM;
+    bool reached = dist <= longest + REACH_TOLERANCE_MM;
+    dist = dist > longest ? longest : (dist < shortest ? shortest : dist);
+
+    // bend plane: the body's middle joint, else the current one
+    vec3_t n = vec3_sub(bend, vec3_scale(dir, vec3_dot(bend, dir)));
+    vec3_t current = vec3_sub(m, a);
+    n = normalize_or(n, normalize_or(vec3_sub(current, vec3_scale(dir, vec3_dot(current, dir))), perpendicular(dir)));
+
+    float cos_a = (l1 * l1 + dist * dist - l2 * l2) / (2.0f * l1 * dist);
+    cos_a = cos_a > 1.0f ? 1.0f : (cos_a < -1.0f ? -1.0f : cos_a);
+    float sin_a = sqrtf(1.0f - cos_a * cos_a);
+    vec3_t mid = vec3_add(a, vec3_add(vec3_scale(dir, l1 * cos_a), vec3_scale(n, l1 * sin_a)));
+    vec3_t end = vec3_add(a, vec3_scale(dir, dist));
+
+    *upper = swing(normalize_or(current, dir), normalize_or(vec3_sub(mid, a), dir));
+    *lower = swing(normalize_or(vec3_sub(e, m), dir), normalize_or(vec3_sub(end, mid), dir));
+    return reached;
+}
+
+// One body; touches only its own pose and slot
+static void retarget_body(void* context, int b)
+{
+    struct Retargeter* r = (struct Retargeter*)context;
+    const struct SkeletonFrame* frame = r->frame;
+    const vec3_t* joints = frame->positions[b];
+    const uint8_t* confidence = frame->confidence[b];
+    const struct RetargetBone* bones = r->bones;
+    struct RetargetPose* pose = &r->poses[b];
+    pose->bodyId = frame->bodyIds[b];
+    pose->slot = frame->slots[b];
+    pose->lockMask = 0;
+
+    struct RetargetSlot* slot = pose->slot < MAX_BODY_SLOTS ? &r->slots[pose->slot] : NULL;
+    if (slot != NULL && (!slot->used || slot->bodyId != pose->bodyId))
+    {
+        memset(slot, 0, sizeof(*slot));
+        slot->used = true;
+        slot->bodyId = pose->bodyId;
+    }
+
+    // root on the pelvis, its height scaled to the target's legs
+    float leg = body_leg_length(joints);
+    if (slot != NULL)
+    {
+        slot->legLength = slot->legLength > 0.0f ? slot->legLength + r->config.legSmoothing * (leg - slot->legLength)
+                                                 : leg;
+        leg = slot->legLength;
+    }
+    float scale = r->legLength > 0.0f && leg > MIN_SEGMENT_MM ? r->legLength / leg : 1.0f;
+    vec3_t pelvis = joints[bones[0].joint];
+    pose->root = vec3_make(pelvis.x, pelvis.y, r->floorZ + (pelvis.z - r->floorZ) * scale);
+
+    // turn of every bone from the reference pose, world heads by forward
+    // kinematics with the target bone lengths
+    quat_t turn[RETARGET_MAX_BONES];
+    vec3_t heads[RETARGET_MAX_BONES];
+    const struct RetargetBone* left = &bones[r->hipBones[0]];
+    const struct RetargetBone* right = &bones[r->hipBones[1]];
+    vec3_t aim = vec3_sub(joints[bones[bones[0].aimChild].joint], pelvis);
+    vec3_t side = vec3_sub(joints[right->joint], joints[left->joint]);
+    vec3_t reference_side = vec3_sub(right->reference, left->reference);
+    turn[0] = align(bones[0].aim, normalize_or(reference_side, perpendicular(bones[0].aim)),
+                    normalize_or(aim, bones[0].aim), normalize_or(side, perpendicular(bones[0].aim)));
+    heads[0] = pose->root;
+    for (int i = 1; i < r->boneCount; i++)
+    {
+        const struct RetargetBone* bone = &bones[i];
+        quat_t parent = turn[bone->parent];
+        turn[i] = parent;
+        if (bone->aimChild >= 0)
+        {
+            int from = bone->joint, to = bones[bone->aimChild].joint;
+            vec3_t segment = vec3_sub(joints[to], joints[from]);
+            if (confidence[from] != CONFIDENCE_NONE && confidence[to] != CONFIDENCE_NONE &&
+                vec3_length(segment) > MIN_SEGMENT_MM)
+                turn[i] = quat_normalize(
+                    quat_mul(swing(quat_rotate(parent, bone->aim), vec3_scale(segment, 1.0f / vec3_length(segment))),
+                             parent));
+        }
+        heads[i] = vec3_add(heads[bone->parent], quat_rotate(parent, bone->offset));
+    }
+
+    // chain end targets: where the body's end joint is from its upper joint,
+    // scaled to the chain, or where a locked end is held
+    vec3_t targets[RETARGET_MAX_CHAINS];
+    float drop = 0.0f;
+    for (int c = 0; c < r->chainCount; c++)
+    {
+        const struct RetargetChain* chain = &r->chains[c];
+        vec3_t ja = joints[bones[chain->bones[0]].joint], jm = joints[bones[chain->bones[1]].joint],
+               je = joints[bones[chain->bones[2]].joint];
+        float length = chain->upperLength + chain->lowerLength;
+        float body_length = vec3_length(vec3_sub(jm, ja)) + vec3_length(vec3_sub(je, jm));
+        float k = body_length > MIN_SEGMENT_MM ? length / body_length : 1.0f;
+        vec3_t a = heads[chain->bones[0]];
+        targets[c] = vec3_add(a, vec3_scale(vec3_sub(je, ja), k));
+        if (!chain->lock || slot == NULL)
+            continue;
+        bool held;
+        targets[c] = hold_end(r, &slot->locks[c], targets[c], je, frame->timestampUsec, &held);
+        if (!held)
+            continue;
+        pose->lockMask |= (uint8_t)(1u << c);
+
+        // a held end out of reach pulls the root down until it is reached
+        vec3_t v = vec3_sub(a, targets[c]);
+        float across = v.x * v.x + v.y * v.y;
+        if (across < length * length)
+        {
+            float need = v.z - sqrtf(length * length - across);
+            drop = need > drop ? need : drop;
+        }
+    }
+    drop = drop < r->config.maxRootDrop ? drop : r->config.maxRootDrop;
+    if (drop > 0.0f)
+    {
+        pose->root.z -= drop;
+        for (int i = 0; i < r->boneCount; i++)
+            heads[i].z -= drop;
+        for (int c = 0; c < r->chainCount; c++)
+        {
+            if (!(pose->lockMask & (1u << c)))
+                targets[c].z -= drop;
+        }
+    }
+
+    // IK: a correction per bone, the chain's own for its upper and lower
+    // bones, none for its end, the parent's for every other bone
+    quat_t correction[RETARGET_MAX_BONES];
+    for (int i = 0; i < r->boneCount; i++)
+        correction[i] = quat_identity();
+    bool clamped = false;
+    for (int c = 0; c < r->chainCount; c++)
+    {
+        const struct RetargetChain* chain = &r->chains[c];
+        vec3_t bend = vec3_sub(joints[bones[chain->bones[1]].joint], joints[bones[chain->bones[0]].joint]);
+        clamped |= !solve_chain(chain, heads, targets[c], bend, &correction[chain->bones[0]],
+                                &correction[chain->bones[1]]);
+    }
+    for (int i = 0; i < r->boneCount; i++)
+    {
+        const struct RetargetBone* bone = &bones[i];
+        if (i > 0 && bone->chain < 0)
+            correction[i] = correction[bone->parent];
+        turn[i] = quat_normalize(quat_mul(correction[i], turn[i]));
+    }
+    r->clamped[b] = clamped;
+
+    // engine local rotations: inverse(parent component) * component, where
+    // a component rotation is the turn of the reference one
+    pose->rotations[0] = quat_normalize(quat_mul(turn[0], bones[0].referenceComponent));
+    for (int i = 1; i < r->boneCount; i++)
+    {
+        const struct RetargetBone* bone = &bones[i];
+        const struct RetargetBone* parent = &bones[bone->parent];
+        quat_t relative = quat_mul(quat_conj(turn[bone->parent]), turn[i]);
+        pose->rotations[i] = quat_normalize(
+            quat_mul(quat_conj(parent->referenceComponent), quat_mul(relative, bone->referenceComponent)));
+    }
+}
+
+void retargeter_update(struct Retargeter* r, const struct SkeletonFrame* frame)
+{
+    int64_t start = monotonic_usec();
+    r->frame = frame;
+    task_pool_for(r->pool, &r->loop, r->boneCount > 0 ? (int)frame->bodyCount : 0, retarget_body, r);
+    r->frame = NULL;
+
+    r->poseCount = r->boneCount > 0 ? (int)frame->bodyCount : 0;
+    for (int b = 0; b < r->poseCount; b++)
+    {
+        for (uint8_t mask = r->poses[b].lockMask; mask != 0; mask &= (uint8_t)(mask - 1))
+            r->locked++;
+        r->outOfReach += r->clamped[b];
+    }
+    r->updates++;
+    r->bodies += (uint64_t)r->poseCount;
+    latency_stats_add(&r->updateTime, monotonic_usec() - start);
+}
+
+void retarget_pose_positions(const struct Retargeter* r, const struct RetargetPose* pose, vec3_t* positions)
+{
+    quat_t component[RETARGET_MAX_BONES];
+    component[0] = pose->rotations[0];
+    positions[0] = pose->root;
+    for (int i = 1; i < r->boneCount; i++)
+    {
+        const struct RetargetBone* bone = &r->bones[i];
+        const struct RetargetBone* parent = &r->bones[bone->parent];
+        component[i] = quat_mul(component[bone->parent], pose->rotations[i]);
+        quat_t turn = quat_mul(component[bone->parent], quat_conj(parent->referenceComponent));
+        positions[i] = vec3_add(positions[bone->parent], quat_rotate(turn, bone->offset));
+    }
+}
+
+void retargeter_report(struct Retargeter* r, int64_t now_usec, int64_t interval_usec)
+{
+    if (now_usec - r->lastReportUsec < interval_usec)
+        return;
+    if (r->lastReportUsec != 0 && r->updates > 0)
+    {
+        printf("retarget: %llu frames, %llu bodies, %llu chain ends held, %llu bodies out of reach\n",
+               (unsigned long long)r->updates, (unsigned long long)r->bodies, (unsigned long long)r->locked,
+               (unsigned long long)r->outOfReach);
+        latency_stats_print(&r->updateTime);
+    }
+    r->updates = 0;
+    r->bodies = 0;
+    r->locked = 0;
+    r->outOfReach = 0;
+    latency_stats_reset(&r->updateTime);
+    r->lastReportUsec = now_usec;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Target skeleton file
+
+static int find_bone(const struct Retargeter* r, const char* name)
+{
+    if (name == NULL)
+        return -1;
+    for (int i = 0; i < r->boneCount; i++)
+    {
+        if (strcmp(r->bones[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static int find_joint_bone(const struct Retargeter* r, int joint)
+{
+    for (int i = 0; i < r->boneCount; i++)
+    {
+        if (r->bones[i].joint == joint)
+            return i;
+    }
+    return -1;
+}
+
+static bool parse_float(const char* token, float* v)
+{
+    if (token == NULL)
+        return false;
+    char* end;
+    *v = strtof(token, &end);
+    return *token != '\0' && *end == '\0';
+}
+
+static bool parse_bone(struct Retargeter* r, const char* separators)
+{
+    if (r->boneCount >= RETARGET_MAX_BONES)
+        return false;
+    struct RetargetBone* bone = &r->bones[r->boneCount];
+    memset(bone, 0, sizeof(*bone));
+    const char* name = strtok(NULL, separators);
+    const char* parent = strtok(NULL, separators);
+    const char* joint = strtok(NULL, separators);
+    if (name == NULL || parent == NULL || joint == NULL || strlen(name) >= RETARGET_NAME_MAX ||
+        find_bone(r, name) >= 0)
+        return false;
+    strcpy(bone->name, name);
+
+    // the root has no parent, every other bone one that is already defined
+    bone->parent = (int8_t)(strcmp(parent, "-") == 0 ? -1 : find_bone(r, parent));
+    if ((bone->parent < 0) != (r->boneCount == 0))
+        return false;
+    char* end;
+    long j = strtol(joint, &end, 10);
+    if (*end != '\0' || j < 0 || j >= SKELETON_JOINT_COUNT)
+        return false;
+    bone->joint = (int8_t)j;
+
+    float v[7] = { 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f };
+    int count = 0;
+    const char* token;
+    while ((token = strtok(NULL, separators)) != NULL)
+    {
+        if (count == 7 || !parse_float(token, &v[count]))
+            return false;
+        count++;
+    }
+    if (count != 3 && count != 7)
+        return false;
+    bone->reference = vec3_make(v[0], v[1], v[2]);
+    bone->referenceLocal = quat_normalize(quat_make(v[3], v[4], v[5], v[6]));
+    bone->aimChild = -1;
+    bone->chain = -1;
+    r->boneCount++;
+    return true;
+}
+
+static bool parse_chain(struct Retargeter* r, const char* separators)
+{
+    if (r->chainCount >= RETARGET_MAX_CHAINS)
+        return false;
+    struct RetargetChain* chain = &r->chains[r->chainCount];
+    for (int i = 0; i < 3; i++)
+    {
+        int bone = find_bone(r, strtok(NULL, separators));
+        if (bone < 0 || r->bones[bone].chain >= 0 || (i > 0 && r->bones[bone].parent != chain->bones[i - 1]))
+            return false;
+        chain->bones[i] = (int8_t)bone;
+        r->bones[bone].chain = (int8_t)r->chainCount;
+    }
+    const char* token = strtok(NULL, separators);
+    chain->lock = token != NULL && strcmp(token, "lock") == 0;
+    if (token != NULL && (!chain->lock || strtok(NULL, separators) != NULL))
+        return false;
+    r->chainCount++;
+    return true;
+}
+
+// Offsets, aims, lengths and reference rotations once every bone is known
+static bool finish_skeleton(struct Retargeter* r)
+{
+    if (r->boneCount == 0)
+        return false;
+    for (int i = 0; i < r->boneCount; i++)
+    {
+        struct RetargetBone* bone = &r->bones[i];
+        if (i == 0)
+            bone->referenceComponent = bone->referenceLocal;
+        else
+        {
+            struct RetargetBone* parent = &r->bones[bone->parent];
+            bone->offset = vec3_sub(bone->reference, parent->reference);
+            bone->referenceComponent = quat_normalize(quat_mul(parent->referenceComponent, bone->referenceLocal));
+            if (parent->aimChild < 0 && vec3_length(bone->offset) > MIN_SEGMENT_MM)
+            {
+                parent->aimChild = (int8_t)i;
+                parent->aim = vec3_scale(bone->offset, 1.0f / vec3_length(bone->offset));
+            }
+        }
+    }
+
+    r->hipBones[0] = (int8_t)find_joint_bone(r, JOINT_HIP_LEFT);
+    r->hipBones[1] = (int8_t)find_joint_bone(r, JOINT_HIP_RIGHT);
+    if (r->bones[0].aimChild < 0 || r->hipBones[0] < 0 || r->hipBones[1] < 0 ||
+        vec3_length(vec3_cross(r->bones[0].aim, vec3_sub(r->bones[r->hipBones[1]].reference,
+                                                          r->bones[r->hipBones[0]].reference))) < MIN_SEGMENT_MM)
+        return false;
+
+    for (int c = 0; c < r->chainCount; c++)
+    {
+        struct RetargetChain* chain = &r->chains[c];
+        chain->upperLength = vec3_length(r->bones[chain->bones[1]].offset);
+        chain->lowerLength = vec3_length(r->bones[chain->bones[2]].offset);
+        if (chain->upperLength < MIN_SEGMENT_MM || chain->lowerLength < MIN_SEGMENT_MM)
+            return false;
+    }
+
+    static const int leg_joints[2][3] = { { JOINT_HIP_LEFT, JOINT_KNEE_LEFT, JOINT_ANKLE_LEFT },
+                                          { JOINT_HIP_RIGHT, JOINT_KNEE_RIGHT, JOINT_ANKLE_RIGHT } };
+    vec3_t hip[2], knee[2], ankle[2];
+    bool present[2];
+    for (int side = 0; side < 2; side++)
+    {
+        int h = find_joint_bone(r, leg_joints[side][0]), k = find_joint_bone(r, leg_joints[side][1]),
+            a = find_joint_bone(r, leg_joints[side][2]);
+        present[side] = h >= 0 && k >= 0 && a >= 0;
+        if (present[side])
+        {
+            hip[side] = r->bones[h].reference;
+            knee[side] = r->bones[k].reference;
+            ankle[side] = r->bones[a].reference;
+        }
+    }
+    r->legLength = leg_length(hip, knee, ankle, present);
+    return true;
+}
+
+int retargeter_load(struct Retargeter* r, const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+
+    static const char* separators = " \t\r\n";
+    char line[RETARGET_LINE_MAX];
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f) != NULL)
+    {
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        char* kind = strtok(line, separators);
+        if (kind == NULL)
+            continue;
+        if (strcmp(kind, "bone") == 0)
+            ok = parse_bone(r, separators);
+        else if (strcmp(kind, "ik") == 0)
+            ok = parse_chain(r, separators);
+        else if (strcmp(kind, "floor") == 0)
+            ok = parse_float(strtok(NULL, separators), &r->floorZ) && strtok(NULL, separators) == NULL;
+        else
+            ok = false;
+    }
+    fclose(f);
+    if (!ok || !finish_skeleton(r))
+    {
+        r->boneCount = 0;
+        r->chainCount = 0;
+        return -1;
+    }
+    return r->boneCount;
+}
@@ -0,0 +1,156 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+#include "body_slots.h"
+#include "latency_stats.h"
+#include "task_pool.h"
+#include "retarget_pose.h"
+
+// Retargeting of tracked bodies onto the skeleton of a game character (the
+// Unreal mannequin, see mannequin.retarget, or any other rig), so the game
+// sets bone rotations instead of fitting k4abt joints to its rig itself.
+//
+// The target skeleton comes from a file: its bones, each with a parent, the
+// k4abt joint at its head and the head position in the reference pose of the
+// character (mm, right-handed, z up like the world), and optionally the
+// bone's local rotation in that pose as the engine stores it. Bone lengths
+// are the distances between heads in the reference pose.
+//
+// Every bone is turned from the reference pose by the rotation that lays it
+// along the body: the root by its aim at its first child and the hip line
+// (the bones on the hip joints), every other bone by the smallest rotation
+// that takes its aim, turned with its parent, onto the body's segment to the
+// joint of its first child. Twist thus follows the parent chain. Bones
+// without a child, or whose segment has a joint out of range, turn with
+// their parent. The root stands on the pelvis, its height above the floor
+// scaled by the target's leg length over the body's (smoothed per slot).
+//
+// IK chains of three bones (upper, lower, end: upper arm, forearm, hand or
+// thigh, calf, foot) are then solved with the analytic two-bone solution:
+// the end is placed where the body's end joint is relative to its upper
+// joint, scaled by the chain length over the body's, and the chain bends in
+// the plane of the body's middle joint. The end keeps its own rotation, so
+// hands and feet point as the body's do. The end of a chain marked lock is
+// held where it touched down while the body's end joint stays slower than
+// lockSpeed within lockHeight of the floor, so the feet of a character with
+// other proportions do not slide; the root sinks (up to maxRootDrop) if a
+// held end would be out of reach. Once released the end blends back to the
+// body over releaseUsec.
+//
+// A pose is the root position (world, mm) and the local rotation of every
+// bone in file order, the root's in world space: the reference local
+// rotations turned by the pose, ready to set on the engine's bones. The
+// bodies of a frame are solved side by side on the task pool into poses
+// kept in the retargeter; nothing is allocated after load.
+//
+// Target skeleton file, one definition per line ('#' starts a comment):
+//   bone <name> <parent|-> <joint> <x> <y> <z> [<qw> <qx> <qy> <qz>]
+//   ik <upper> <lower> <end> [lock]
+//   floor <z>
+// The first bone is the root and parents come before their children; joints
+// are k4abt joint indices and floor is the height of the world floor, mm.
+// The lower bone of a chain is a child of the upper and the end of the lower;
+// a bone belongs to one chain at most.
+
+#define RETARGET_MAX_CHAINS 8
+#define RETARGET_NAME_MAX 32
+
+struct RetargetBone
+{
+    char name[RETARGET_NAME_MAX];
+    int8_t parent;   // -1 for the root
+    int8_t joint;    // k4abt joint at the head
+    int8_t aimChild; // first child, -1 if none
+    int8_t chain;    // IK chain the bone is in, -1 if none
+    vec3_t reference;// head position in the reference pose, mm
+    vec3_t offset;   // from the parent's head in the reference pose
+    vec3_t aim;      // unit, to the aim child's head in the reference pose
+    quat_t referenceLocal;    // engine local rotation in the reference pose
+    quat_t referenceComponent;// and the product down from the root
+};
+
+struct RetargetChain
+{
+    int8_t bones[3];// upper, lower, end
+    bool lock;
+    float upperLength;// mm, upper head to lower head
+    float lowerLength;// lower head to end head
+};
+
+struct RetargetConfig
+{
+    float lockSpeed;      // mm/s, end joint slower than this touches down
+    float releaseSpeed;   // mm/s, faster lifts off
+    float lockHeight;     // mm above the floor, end joint higher never locks
+    float releaseDistance;// mm, the body's end this far from the lock lifts off
+    int64_t releaseUsec;  // blend back to the body after lift-off
+    float legSmoothing;   // weight of a new leg length sample
+    float maxRootDrop;    // mm the root may sink for a held end to be reached
+};
+
+// Lock state of one chain end of one slot
+struct RetargetLock
+{
+    bool locked;
+    vec3_t position;// mm, world: where the end is held
+    vec3_t offset;  // from the free target, fading after release
+    vec3_t lastJoint;
+    int64_t lastUsec;
+};
+
+struct RetargetSlot
+{
+    uint32_t bodyId;
+    bool used;
+    float legLength;// mm, smoothed hip-knee-ankle length of the body
+    struct RetargetLock locks[RETARGET_MAX_CHAINS];
+};
+
+struct Retargeter
+{
+    struct RetargetConfig config;
+    struct RetargetBone bones[RETARGET_MAX_BONES];
+    int boneCount;
+    struct RetargetChain chains[RETARGET_MAX_CHAINS];
+    int chainCount;
+    int8_t hipBones[2];// on JOINT_HIP_LEFT and JOINT_HIP_RIGHT
+    float legLength;   // mm, target hip-knee-ankle, 0 if unknown
+    float floorZ;      // mm, world
+
+    struct TaskPool* pool;// optional, set after init
+    struct TaskLoop loop;
+    struct RetargetSlot slots[MAX_BODY_SLOTS];
+
+    // one frame, filled by the bodies
+    const struct SkeletonFrame* frame;
+    bool clamped[MAX_FRAME_BODIES];// a chain end was out of reach
+    struct RetargetPose poses[MAX_FRAME_BODIES];
+    int poseCount;
+
+    uint64_t updates;
+    uint64_t bodies;
+    uint64_t locked;  // chain ends held, summed over bodies
+    uint64_t outOfReach;// bodies with a chain end out of reach
+    struct LatencyStats updateTime;// per frame, us
+    int64_t lastReportUsec;
+};
+
+void retarget_default_config(struct RetargetConfig* config);
+void retargeter_init(struct Retargeter* retargeter, const struct RetargetConfig* config);
+
+// Read a target skeleton file. Returns the number of bones, or -1 if the file
+// can not be read, a line is malformed or the hip bones are missing.
+int retargeter_load(struct Retargeter* retargeter, const char* path);
+
+// Pose every body of a world-space frame; the poses replace those of the
+// previous frame (poses, poseCount, in frame order)
+void retargeter_update(struct Retargeter* retargeter, const struct SkeletonFrame* frame);
+
+// World-space head positions (mm) of the bones of a pose, as a game applying
+// it gets them; for checks and debug drawing
+void retarget_pose_positions(const struct Retargeter* retargeter, const struct RetargetPose* pose,
+                             vec3_t* positions);
+
+// Print and reset the statistics every interval_usec
+void retargeter_report(struct Retargeter* retargeter, int64_t now_usec, int64_t interval_usec);
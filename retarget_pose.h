@@ -0,0 +1,19 @@
+#pragma once
+#include <stdint.h>
+#include "skeleton.h"
+
+// A body posed on a target skeleton (retarget.h), as the retargeter makes it
+// and receivers decode it (SKP_MSG_RETARGETED in protocol.h). Kept apart
+// from the retargeter so the receiver library does not pull in the task
+// pool and the platform headers.
+
+#define RETARGET_MAX_BONES 64
+
+struct RetargetPose
+{
+    uint32_t bodyId;
+    uint8_t slot;    // BODY_SLOT_NONE if the body has none
+    uint8_t lockMask;// bit per IK chain whose end is held
+    vec3_t root;     // mm, world
+    quat_t rotations[RETARGET_MAX_BONES];// local, file order
+};
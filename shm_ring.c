@@ -0,0 +1,222 @@
+#include <stdio.h>
+#include <string.h>
+#include "shm_ring.h"
+#ifndef WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#define READ_ATTEMPTS 4
+
+#ifndef WIN32
+
+//////////////////////////////////////////////////////////////////////////////
+// Writer
+
+bool shm_writer_create(struct ShmRingWriter* writer, const char* name, bool notify)
+{
+    memset(writer, 0, sizeof(*writer));
+    snprintf(writer->name, sizeof(writer->name), "%s", name);
+    writer->notify = notify;
+
+    writer->fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (writer->fd < 0)
+        return false;
+    if (ftruncate(writer->fd, sizeof(struct ShmRing)) != 0)
+    {
+        close(writer->fd);
+        return false;
+    }
+    writer->ring = (struct ShmRing*)mmap(NULL, sizeof(struct ShmRing), PROT_READ | PROT_WRITE,
+                                         MAP_SHARED, writer->fd, 0);
+    if (writer->ring == MAP_FAILED)
+    {
+        writer->ring = NULL;
+        close(writer->fd);
+        return false;
+    }
+
+    // readers check the magic last, after the layout fields are valid
+    struct ShmRingHeader* h = &writer->ring->header;
+    __atomic_store_n(&h->magic, 0, __ATOMIC_RELEASE);
+    memset(writer->ring, 0, sizeof(struct ShmRing));
+    h->version = SHM_RING_VERSION;
+    h->recordSize = sizeof(struct SkeletonFrame);
+    h->slotCount = SHM_RING_SLOTS;
+    h->writerPid = (uint32_t)getpid();
+    __atomic_store_n(&h->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+    return true;
+}
+
+void shm_writer_publish(struct ShmRingWriter* writer, const struct SkeletonFrame* frame)
+{
+    struct ShmRingHeader* h = &writer->ring->header;
+    uint64_t n = h->published;// single writer
+    struct ShmRingSlot* slot = &writer->ring->slots[n % SHM_RING_SLOTS];
+
+    __atomic_store_n(&slot->sequence, 2 * n + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&slot->frame, frame, sizeof(slot->frame));
+    __atomic_store_n(&slot->sequence, 2 * n + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&h->published, n + 1, __ATOMIC_RELEASE);
+
+    if (writer->notify)
+    {
+        __atomic_add_fetch(&h->futexWord, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &h->futexWord, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+    }
+}
+
+void shm_writer_close(struct ShmRingWriter* writer)
+{
+    if (writer->ring == NULL)
+        return;
+    munmap(writer->ring, sizeof(struct ShmRing));
+    close(writer->fd);
+    shm_unlink(writer->name);
+    writer->ring = NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Reader
+
+bool shm_reader_open(struct ShmRingReader* reader, const char* name)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = shm_open(name, O_RDONLY, 0);
+    if (reader->fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(reader->fd, &st) != 0 || (size_t)st.st_size < sizeof(struct ShmRing))
+    {
+        close(reader->fd);
+        return false;
+    }
+    reader->ring = (const struct ShmRing*)mmap(NULL, sizeof(struct ShmRing), PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (reader->ring == MAP_FAILED)
+    {
+        reader->ring = NULL;
+        close(reader->fd);
+        return false;
+    }
+
+    const struct ShmRingHeader* h = &reader->ring->header;
+    if (__atomic_load_n(&h->magic, __ATOMIC_ACQUIRE) != SHM_RING_MAGIC || h->version != SHM_RING_VERSION ||
+        h->recordSize != sizeof(struct SkeletonFrame) || h->slotCount != SHM_RING_SLOTS)
+    {
+        shm_reader_close(reader);
+        return false;
+    }
+    return true;
+}
+
+void shm_reader_close(struct ShmRingReader* reader)
+{
+    if (reader->ring == NULL)
+        return;
+    munmap((void*)reader->ring, sizeof(struct ShmRing));
+    close(reader->fd);
+    reader->ring = NULL;
+}
+
+int shm_reader_latest(struct ShmRingReader* reader, struct SkeletonFrame* out)
+{
+    const struct ShmRing* ring = reader->ring;
+    for (int attempt = 0; attempt < READ_ATTEMPTS; attempt++)
+    {
+        uint64_t published = __atomic_load_n(&ring->header.published, __ATOMIC_ACQUIRE);
+        if (published == reader->lastRead)
+            return 0;
+
+        uint64_t n = published - 1;
+        const struct ShmRingSlot* slot = &ring->slots[n % SHM_RING_SLOTS];
+        uint64_t before = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (before != 2 * n + 2)
+        {
+            reader->retries++;// already overwritten by a newer frame
+            continue;
+        }
+        memcpy(out, &slot->frame, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) != before)
+        {
+            reader->retries++;// torn copy
+            continue;
+        }
+        reader->lastRead = published;
+        return 1;
+    }
+    return 0;
+}
+
+bool shm_reader_wait(struct ShmRingReader* reader, int64_t timeout_usec)
+{
+    const struct ShmRingHeader* h = &reader->ring->header;
+    struct timespec timeout;
+    timeout.tv_sec = timeout_usec / 1000000;
+    timeout.tv_nsec = (timeout_usec % 1000000) * 1000;
+
+    // sample the futex word before checking, so a publish in between wakes us
+    uint32_t word = __atomic_load_n(&h->futexWord, __ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&h->published, __ATOMIC_ACQUIRE) != reader->lastRead)
+        return true;
+    syscall(SYS_futex, &h->futexWord, FUTEX_WAIT, word, &timeout, NULL, 0);
+    return __atomic_load_n(&h->published, __ATOMIC_ACQUIRE) != reader->lastRead;
+}
+
+#else
+
+bool shm_writer_create(struct ShmRingWriter* writer, const char* name, bool notify)
+{
+    (void)name;
+    (void)notify;
+    memset(writer, 0, sizeof(*writer));
+    printf("Shared memory output is not supported on this platform\n");
+    return false;
+}
+
+void shm_writer_publish(struct ShmRingWriter* writer, const struct SkeletonFrame* frame)
+{
+    (void)writer;
+    (void)frame;
+}
+
+void shm_writer_close(struct ShmRingWriter* writer)
+{
+    (void)writer;
+}
+
+bool shm_reader_open(struct ShmRingReader* reader, const char* name)
+{
+    (void)name;
+    memset(reader, 0, sizeof(*reader));
+    return false;
+}
+
+void shm_reader_close(struct ShmRingReader* reader)
+{
+    (void)reader;
+}
+
+int shm_reader_latest(struct ShmRingReader* reader, struct SkeletonFrame* out)
+{
+    (void)reader;
+    (void)out;
+    return 0;
+}
+
+bool shm_reader_wait(struct ShmRingReader* reader, int64_t timeout_usec)
+{
+    (void)reader;
+    (void)timeout_usec;
+    return false;
+}
+
+#endif // WIN32
@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "skeleton.h"
+
+// Shared-memory transport for receivers on the tracking host (Linux only).
+// A named POSIX shm segment holds a ring of fixed-size frame records. The
+// writer publishes with a per-slot seqlock, so any number of readers copy the
+// newest frame without syscalls or locks and never block the writer. Readers
+// that do not want to poll can sleep on a futex in the segment.
+//
+// Records are struct SkeletonFrame as laid out by this build; the header
+// carries magic, version and record size so mismatched readers refuse to
+// attach.
+
+#define SHM_RING_MAGIC 0x534B4652 // "SKFR"
+#define SHM_RING_VERSION 3
+#define SHM_RING_SLOTS 8         // a reader must copy within 7 frames of the writer
+#define SHM_RING_DEFAULT_NAME "/body_tracking"
+
+struct ShmRingHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t slotCount;
+    uint64_t published;  // frames published so far; newest is in slot (published - 1) % slotCount
+    uint32_t futexWord;  // bumped on every publish when notification is enabled
+    uint32_t writerPid;
+    uint8_t reserved[32];// keeps the header on its own cache line
+};
+
+struct ShmRingSlot
+{
+    uint64_t sequence;// 2n + 1 while frame n is written, 2n + 2 once complete
+    uint8_t reserved[56];
+    struct SkeletonFrame frame;
+};
+
+struct ShmRing
+{
+    struct ShmRingHeader header;
+    struct ShmRingSlot slots[SHM_RING_SLOTS];
+};
+
+struct ShmRingWriter
+{
+    struct ShmRing* ring;
+    int fd;
+    bool notify;
+    char name[64];
+};
+
+struct ShmRingReader
+{
+    const struct ShmRing* ring;
+    int fd;
+    uint64_t lastRead;// published count of the last frame returned
+    uint64_t retries; // copies discarded because the writer overwrote the slot
+};
+
+// Writer: create (or take over) the segment and publish frames into it
+bool shm_writer_create(struct ShmRingWriter* writer, const char* name, bool notify);
+void shm_writer_publish(struct ShmRingWriter* writer, const struct SkeletonFrame* frame);
+void shm_writer_close(struct ShmRingWriter* writer);// unlinks the segment
+
+// Reader: attach to an existing segment
+bool shm_reader_open(struct ShmRingReader* reader, const char* name);
+void shm_reader_close(struct ShmRingReader* reader);
+
+// Copy the newest frame if it is newer than the last one returned.
+// Returns 1 with out filled, 0 if there is nothing new.
+int shm_reader_latest(struct ShmRingReader* reader, struct SkeletonFrame* out);
+
+// Sleep until a frame newer than the last one returned is published (needs a
+// writer with notification) or timeout_usec passes. Returns true if one is
+// available.
+bool shm_reader_wait(struct ShmRingReader* reader, int64_t timeout_usec);
@@ -0,0 +1,52 @@
+#include "skeleton.h"
+
+const int8_t skeleton_joint_parent[SKELETON_JOINT_COUNT] = {
+    -1,                     // PELVIS
+    JOINT_PELVIS,           // SPINE_NAVEL
+    JOINT_SPINE_NAVEL,      // SPINE_CHEST
+    JOINT_SPINE_CHEST,      // NECK
+    JOINT_SPINE_CHEST,      // CLAVICLE_LEFT
+    JOINT_CLAVICLE_LEFT,    // SHOULDER_LEFT
+    JOINT_SHOULDER_LEFT,    // ELBOW_LEFT
+    JOINT_ELBOW_LEFT,       // WRIST_LEFT
+    JOINT_WRIST_LEFT,       // HAND_LEFT
+    JOINT_HAND_LEFT,        // HANDTIP_LEFT
+    JOINT_WRIST_LEFT,       // THUMB_LEFT
+    JOINT_SPINE_CHEST,      // CLAVICLE_RIGHT
+    JOINT_CLAVICLE_RIGHT,   // SHOULDER_RIGHT
+    JOINT_SHOULDER_RIGHT,   // ELBOW_RIGHT
+    JOINT_ELBOW_RIGHT,      // WRIST_RIGHT
+    JOINT_WRIST_RIGHT,      // HAND_RIGHT
+    JOINT_HAND_RIGHT,       // HANDTIP_RIGHT
+    JOINT_WRIST_RIGHT,      // THUMB_RIGHT
+    JOINT_PELVIS,           // HIP_LEFT
+    JOINT_HIP_LEFT,         // KNEE_LEFT
+    JOINT_KNEE_LEFT,        // ANKLE_LEFT
+    JOINT_ANKLE_LEFT,       // FOOT_LEFT
+    JOINT_PELVIS,           // HIP_RIGHT
+    JOINT_HIP_RIGHT,        // KNEE_RIGHT
+    JOINT_KNEE_RIGHT,       // ANKLE_RIGHT
+    JOINT_ANKLE_RIGHT,      // FOOT_RIGHT
+    JOINT_NECK,             // HEAD
+    JOINT_HEAD,             // NOSE
+    JOINT_HEAD,             // EYE_LEFT
+    JOINT_HEAD,             // EAR_LEFT
+    JOINT_HEAD,             // EYE_RIGHT
+    JOINT_HEAD,             // EAR_RIGHT
+};
+
+void skeleton_compute_body_local_rotations(struct SkeletonFrame* frame, uint32_t b)
+{
+    const quat_t* world = frame->worldRotations[b];
+    quat_t* local = frame->localRotations[b];
+
+    local[JOINT_PELVIS] = world[JOINT_PELVIS];
+    for (int j = 1; j < SKELETON_JOINT_COUNT; j++)
+        local[j] = quat_mul(quat_conj(world[skeleton_joint_parent[j]]), world[j]);
+}
+
+void skeleton_compute_local_rotations(struct SkeletonFrame* frame)
+{
+    for (uint32_t b = 0; b < frame->bodyCount; b++)
+        skeleton_compute_body_local_rotations(frame, b);
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <stdint.h>
+#include "vecmath.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Skeleton data shared by the processing and output stages. Mirrors the k4abt
+// joint set (k4abt_joint_id_t) so these modules build without the Body
+// Tracking SDK; main.c checks that the counts agree.
+
+#define SKELETON_JOINT_COUNT 32
+#define MAX_FRAME_BODIES 16
+#define MAX_KINECTS 8// cameras feeding one output
+
+// Body id of a camera's tracker id: the camera number in the top byte, so ids
+// of different trackers never collide
+#define KINECT_BODY_ID(source, id) (((uint32_t)(source) << 24) | ((id) & 0x00FFFFFFu))
+
+// Orientation of a level Kinect looking along +y of a z-up frame: turns the
+// depth camera axes (x right, y down, z forward) into x right, y forward,
+// z up
+static inline quat_t kinect_level_orientation(void)
+{
+    return quat_make(0.70710678f, -0.70710678f, 0.0f, 0.0f);
+}
+
+enum SkeletonJoint
+{
+    JOINT_PELVIS = 0,
+    JOINT_SPINE_NAVEL,
+    JOINT_SPINE_CHEST,
+    JOINT_NECK,
+    JOINT_CLAVICLE_LEFT,
+    JOINT_SHOULDER_LEFT,
+    JOINT_ELBOW_LEFT,
+    JOINT_WRIST_LEFT,
+    JOINT_HAND_LEFT,
+    JOINT_HANDTIP_LEFT,
+    JOINT_THUMB_LEFT,
+    JOINT_CLAVICLE_RIGHT,
+    JOINT_SHOULDER_RIGHT,
+    JOINT_ELBOW_RIGHT,
+    JOINT_WRIST_RIGHT,
+    JOINT_HAND_RIGHT,
+    JOINT_HANDTIP_RIGHT,
+    JOINT_THUMB_RIGHT,
+    JOINT_HIP_LEFT,
+    JOINT_KNEE_LEFT,
+    JOINT_ANKLE_LEFT,
+    JOINT_FOOT_LEFT,
+    JOINT_HIP_RIGHT,
+    JOINT_KNEE_RIGHT,
+    JOINT_ANKLE_RIGHT,
+    JOINT_FOOT_RIGHT,
+    JOINT_HEAD,
+    JOINT_NOSE,
+    JOINT_EYE_LEFT,
+    JOINT_EAR_LEFT,
+    JOINT_EYE_RIGHT,
+    JOINT_EAR_RIGHT
+};
+
+// Mirrors k4abt_joint_confidence_level_t
+enum SkeletonConfidence
+{
+    CONFIDENCE_NONE = 0,  // out of range (too far from the depth camera)
+    CONFIDENCE_LOW = 1,   // not observed, predicted by the tracker
+    CONFIDENCE_MEDIUM = 2,
+    CONFIDENCE_HIGH = 3,
+};
+
+// Parent of each joint in the k4abt hierarchy (-1 for the pelvis). Parents
+// always precede their children, so one forward pass visits a valid order.
+extern const int8_t skeleton_joint_parent[SKELETON_JOINT_COUNT];
+
+// One processed body frame in world space (positions in mm, z up). Bodies are
+// stored structure-of-arrays so per-joint passes run over contiguous memory.
+struct SkeletonFrame
+{
+    uint32_t frameNumber;
+    int64_t timestampUsec;// host monotonic time of the capture
+    uint32_t bodyCount;
+
+    uint32_t bodyIds[MAX_FRAME_BODIES];
+    vec3_t cameraPositions[MAX_FRAME_BODIES];// mm, world: the Kinect that observed the body
+    uint8_t slots[MAX_FRAME_BODIES];// stable receiver slot, see body_slots.h
+    vec3_t positions[MAX_FRAME_BODIES][SKELETON_JOINT_COUNT];
+    quat_t worldRotations[MAX_FRAME_BODIES][SKELETON_JOINT_COUNT];
+    quat_t localRotations[MAX_FRAME_BODIES][SKELETON_JOINT_COUNT];
+    uint8_t confidence[MAX_FRAME_BODIES][SKELETON_JOINT_COUNT];
+};
+
+// Parent-relative rotations (inverse(parent world) * child world) for every
+// joint of every body in the frame
+void skeleton_compute_local_rotations(struct SkeletonFrame* frame);
+void skeleton_compute_body_local_rotations(struct SkeletonFrame* frame, uint32_t b);
+
+#ifdef __cplusplus
+}
+#endif
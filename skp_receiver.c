@@ -0,0 +1,406 @@
+#include <string.h>
+#include "skp_receiver.h"
+
+// Wrap-safe frame number order
+static int32_t frame_diff(uint32_t a, uint32_t b)
+{
+    return (int32_t)(a - b);
+}
+
+void skp_receiver_init(struct SkpReceiver* r, skp_frame_fn on_frame, skp_slot_events_fn on_slot_events,
+                       void* context)
+{
+    memset(r, 0, sizeof(*r));
+    r->onFrame = on_frame;
+    r->onSlotEvents = on_slot_events;
+    r->context = context;
+    r->timeoutUsec = SKP_RECEIVER_DEFAULT_TIMEOUT_USEC;
+}
+
+// Count losses, late arrivals and duplicates; false for a duplicate
+static bool track_sequence(struct SkpReceiver* r, uint8_t stream, uint32_t sequence)
+{
+    if (!r->haveSequence || stream != r->stream)
+    {
+        // first datagram, or the sender moved us to another encoding stream
+        r->haveSequence = true;
+        r->stream = stream;
+        r->nextSequence = sequence + 1;
+        r->seenMask = 1;
+        return true;
+    }
+
+    int32_t ahead = (int32_t)(sequence - r->nextSequence);
+    if (ahead >= 0)
+    {
+        r->stats.lost += (uint64_t)ahead;
+        r->nextSequence = sequence + 1;
+        r->seenMask = ahead + 1 < SKP_SEQUENCE_WINDOW ? r->seenMask << (ahead + 1) : 0;
+        r->seenMask |= 1;
+        return true;
+    }
+
+    uint32_t back = (uint32_t)(-ahead - 1);
+    if (back >= SKP_SEQUENCE_WINDOW)
+    {
+        // too old to tell a late datagram from a copy: loss stays counted
+        r->stats.reordered++;
+        return true;
+    }
+    if (r->seenMask & ((uint64_t)1 << back))
+    {
+        r->stats.duplicates++;
+        return false;
+    }
+    // counted as lost when the newer one arrived
+    r->seenMask |= (uint64_t)1 << back;
+    r->stats.reordered++;
+    if (r->stats.lost > 0)
+        r->stats.lost--;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Clock synchronization
+
+// Error bound of a sample: half its round trip plus the drift since it was taken
+static int64_t sample_distance(const struct SkpClockSample* s, int64_t now)
+{
+    return s->rttUsec / 2 + (now - s->timeUsec) * SKP_CLOCK_DRIFT_PPM / 1000000;
+}
+
+static void on_pong(struct SkpReceiver* r, const struct SkpPong* pong, int64_t now)
+{
+    struct SkpClockSync* c = &r->clock;
+    int64_t rtt = (now - pong->pingSentUsec) - (pong->pongSentUsec - pong->pingReceivedUsec);
+    if (pong->pingSentUsec > now || rtt < 0)
+        return;// not our ping, or a clock went backwards
+
+    struct SkpClockSample* s = &c->samples[c->next];
+    s->offsetUsec = ((pong->pingReceivedUsec - pong->pingSentUsec) + (pong->pongSentUsec - now)) / 2;
+    s->rttUsec = rtt;
+    s->timeUsec = now;
+    c->next = (c->next + 1) % SKP_CLOCK_SAMPLES;
+    if (c->count < SKP_CLOCK_SAMPLES)
+        c->count++;
+
+    const struct SkpClockSample* best = &c->samples[0];
+    for (int i = 1; i < c->count; i++)
+    {
+        if (sample_distance(&c->samples[i], now) < sample_distance(best, now))
+            best = &c->samples[i];
+    }
+    c->offsetUsec = best->offsetUsec;
+    c->rttUsec = best->rttUsec;
+    c->synced = true;
+    r->stats.pongs++;
+}
+
+size_t skp_receiver_write_ping(struct SkpReceiver* r, int64_t now_usec, uint8_t* buffer, size_t capacity)
+{
+    r->stats.pings++;
+    return skp_write_ping(now_usec, buffer, capacity);
+}
+
+bool skp_receiver_local_time(const struct SkpReceiver* r, int64_t sender_usec, int64_t* local_usec)
+{
+    if (!r->clock.synced)
+        return false;
+    *local_usec = sender_usec - r->clock.offsetUsec;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Frame assembly
+
+// Move the bodies that arrived to the front
+static void compact_bodies(struct SkpAssembly* a)
+{
+    struct SkeletonFrame* f = &a->frame;
+    uint32_t out = 0;
+    for (uint32_t b = 0; b < a->info.bodiesExpected; b++)
+    {
+        if (!(a->receivedMask & (1u << b)))
+            continue;
+        if (out != b)
+        {
+            f->bodyIds[out] = f->bodyIds[b];
+            f->slots[out] = f->slots[b];
+            memcpy(f->positions[out], f->positions[b], sizeof(f->positions[b]));
+            memcpy(f->worldRotations[out], f->worldRotations[b], sizeof(f->worldRotations[b]));
+            memcpy(f->localRotations[out], f->localRotations[b], sizeof(f->localRotations[b]));
+            memcpy(f->confidence[out], f->confidence[b], sizeof(f->confidence[b]));
+        }
+        out++;
+    }
+}
+
+static void deliver(struct SkpReceiver* r, struct SkpAssembly* a, int64_t now)
+{
+    int64_t local_capture;
+    a->info.clockSynced = skp_receiver_local_time(r, a->info.captureUsec, &local_capture);
+    if (a->info.clockSynced)
+    {
+        a->frame.timestampUsec = local_capture;
+        a->info.ageUsec = now - local_capture;
+        r->ageSumUsec += a->info.ageUsec;
+        r->ageCount++;
+    }
+    else
+        a->frame.timestampUsec = a->info.firstArrivalUsec;
+
+    a->info.complete = a->info.bodiesReceived == a->info.bodiesExpected;
+    if (a->info.complete)
+        r->stats.framesComplete++;
+    else
+    {
+        compact_bodies(a);
+        r->stats.framesPartial++;
+    }
+    a->frame.bodyCount = a->info.bodiesReceived;
+
+    r->haveDelivered = true;
+    r->lastDelivered = a->frame.frameNumber;
+    a->used = false;
+    if (r->onFrame != NULL)
+        r->onFrame(&a->frame, &a->info, r->context);
+}
+
+static struct SkpAssembly* oldest_assembly(struct SkpReceiver* r)
+{
+    struct SkpAssembly* oldest = NULL;
+    for (int i = 0; i < SKP_RECEIVER_WINDOW; i++)
+    {
+        struct SkpAssembly* a = &r->assembly[i];
+        if (a->used && (oldest == NULL || frame_diff(a->frame.frameNumber, oldest->frame.frameNumber) < 0))
+            oldest = a;
+    }
+    return oldest;
+}
+
+// Deliver, in order, every pending frame older than frame_number
+static void deliver_older(struct SkpReceiver* r, uint32_t frame_number, int64_t now)
+{
+    struct SkpAssembly* a;
+    while ((a = oldest_assembly(r)) != NULL && frame_diff(a->frame.frameNumber, frame_number) < 0)
+        deliver(r, a, now);
+}
+
+static struct SkpAssembly* assembly_for(struct SkpReceiver* r, uint32_t frame_number, int64_t now)
+{
+    struct SkpAssembly* free_slot = NULL;
+    for (int i = 0; i < SKP_RECEIVER_WINDOW; i++)
+    {
+        struct SkpAssembly* a = &r->assembly[i];
+        if (a->used && a->frame.frameNumber == frame_number)
+            return a;
+        if (!a->used && free_slot == NULL)
+            free_slot = a;
+    }
+
+    if (r->haveDelivered && frame_diff(frame_number, r->lastDelivered) <= 0)
+        return NULL;// late
+
+    if (free_slot == NULL)
+    {
+        // window full: the oldest frame goes out partial, unless this one is older still
+        struct SkpAssembly* oldest = oldest_assembly(r);
+        if (frame_diff(frame_number, oldest->frame.frameNumber) < 0)
+            return NULL;
+        deliver(r, oldest, now);
+        free_slot = oldest;
+    }
+
+    // RFC 3550 style jitter over the first datagram of each frame
+    if (r->lastFrameArrivalUsec != 0)
+    {
+        int64_t interval = now - r->lastFrameArrivalUsec;
+        if (r->meanIntervalUsec == 0)
+            r->meanIntervalUsec = interval;
+        int64_t deviation = interval - r->meanIntervalUsec;
+        r->meanIntervalUsec += deviation / 16;
+        int64_t jitter = (int64_t)r->stats.jitterUsec;
+        jitter += ((deviation < 0 ? -deviation : deviation) - jitter) / 16;
+        r->stats.jitterUsec = (uint32_t)jitter;
+    }
+    r->lastFrameArrivalUsec = now;
+
+    free_slot->used = true;
+    free_slot->receivedMask = 0;
+    memset(&free_slot->info, 0, sizeof(free_slot->info));
+    free_slot->info.firstArrivalUsec = now;
+    free_slot->frame.frameNumber = frame_number;
+    free_slot->frame.bodyCount = 0;
+    return free_slot;
+}
+
+static bool push_body(struct SkpReceiver* r, const uint8_t* data, const struct SkpHeader* h, int64_t now)
+{
+    // body count and index are checked before decoding into the assembly
+    uint32_t index = data[20];
+    uint32_t count = data[21];
+    if (index >= count || count > MAX_FRAME_BODIES)
+        return false;
+
+    struct SkpAssembly* a = assembly_for(r, h->frameNumber, now);
+    if (a == NULL)
+    {
+        r->stats.late++;
+        return true;
+    }
+    if (a->info.bodiesExpected == 0)
+    {
+        a->info.bodiesExpected = count;
+        a->info.flags = h->flags;
+    }
+    else if (a->info.bodiesExpected != count)
+        return false;
+    if (a->receivedMask & (1u << index))
+    {
+        r->stats.duplicates++;
+        return true;
+    }
+
+    uint32_t key_frame, basis_id;
+    if (skp_body_key_frame(data, h, &key_frame))
+    {
+        uint8_t slot = data[22];
+        if (slot >= MAX_BODY_SLOTS || !r->keys[slot].valid || r->keys[slot].frameNumber != key_frame)
+        {
+            r->stats.missingKey++;
+            return true;
+        }
+    }
+
+    if (h->flags & SKP_PCA)
+    {
+        if (!skp_pca_body_basis(data, h, &basis_id))
+            return false;
+        if (r->basis == NULL || r->basis->basisId != basis_id)
+        {
+            r->stats.unknownBasis++;
+            return true;
+        }
+        float error;
+        if (!skp_read_pca_body(data, h, r->basis, &a->frame, &index, &count, &error))
+            return false;
+        if (error > a->info.pcaErrorMm)
+            a->info.pcaErrorMm = error;
+    }
+    else if (!skp_read_body(data, h, &a->frame, &index, &count, r->keys))
+        return false;
+    a->info.captureUsec = a->frame.timestampUsec;// replaced at delivery
+    a->receivedMask |= (uint16_t)(1u << index);
+    a->info.bodiesReceived++;
+    a->info.lastArrivalUsec = now;
+
+    if (a->info.bodiesReceived == a->info.bodiesExpected)
+    {
+        deliver_older(r, h->frameNumber, now);
+        deliver(r, a, now);
+    }
+    return true;
+}
+
+bool skp_receiver_push(struct SkpReceiver* r, const uint8_t* data, size_t size, int64_t now_usec)
+{
+    struct SkpHeader h;
+    if (!skp_read_header(data, size, &h))
+    {
+        r->stats.malformed++;
+        return false;
+    }
+    if (h.type == SKP_MSG_PONG)
+    {
+        struct SkpPong pong;
+        if (!skp_read_pong(data, &h, &pong))
+        {
+            r->stats.malformed++;
+            return false;
+        }
+        on_pong(r, &pong, now_usec);
+        return true;
+    }
+    r->stats.datagrams++;
+    r->stats.bytes += size;
+    if (skp_is_stream_message(h.type) && !track_sequence(r, h.stream, h.sequence))
+        return true;// a copy of a datagram already handled
+
+    bool ok = true;
+    if (h.type == SKP_MSG_BODY)
+        ok = push_body(r, data, &h, now_usec);
+    else if (h.type == SKP_MSG_SLOT_EVENTS)
+    {
+        struct BodySlotEvent events[BODY_SLOT_MAX_EVENTS];
+        int count = skp_read_slot_events(data, &h, events, BODY_SLOT_MAX_EVENTS);
+        if (count > 0 && r->onSlotEvents != NULL)
+            r->onSlotEvents(h.frameNumber, events, count, r->context);
+    }
+    else if (h.type == SKP_MSG_ZONE_EVENTS)
+    {
+        struct ZoneEvent events[SKP_MAX_ZONE_EVENTS];
+        int count = skp_read_zone_events(data, &h, events, SKP_MAX_ZONE_EVENTS);
+        if (count > 0 && r->onZoneEvents != NULL)
+            r->onZoneEvents(h.frameNumber, events, count, r->context);
+    }
+    else if (h.type == SKP_MSG_GESTURE_EVENTS)
+    {
+        struct GestureEvent events[SKP_MAX_GESTURE_EVENTS];
+        int count = skp_read_gesture_events(data, &h, events, SKP_MAX_GESTURE_EVENTS);
+        if (count > 0 && r->onGestureEvents != NULL)
+            r->onGestureEvents(h.frameNumber, events, count, r->context);
+    }
+    else if (h.type == SKP_MSG_POSE_MATCHES)
+    {
+        struct PoseMatchResult matches[MAX_FRAME_BODIES];
+        int count = skp_read_pose_matches(data, &h, matches, MAX_FRAME_BODIES);
+        if (count > 0 && r->onPoseMatches != NULL)
+            r->onPoseMatches(h.frameNumber, matches, count, r->context);
+    }
+    else if (h.type == SKP_MSG_RETARGETED)
+    {
+        int bone_count = 0;
+        int count = skp_read_retargeted(data, &h, r->retargeted, MAX_FRAME_BODIES, &bone_count);
+        if (count > 0 && r->onRetargeted != NULL)
+            r->onRetargeted(h.frameNumber, r->retargeted, count, bone_count, r->context);
+    }
+
+    if (!ok)
+        r->stats.malformed++;
+    return ok;
+}
+
+void skp_receiver_flush(struct SkpReceiver* r, int64_t now_usec)
+{
+    struct SkpAssembly* a;
+    while ((a = oldest_assembly(r)) != NULL && now_usec - a->info.firstArrivalUsec > r->timeoutUsec)
+        deliver(r, a, now_usec);
+}
+
+size_t skp_receiver_write_feedback(struct SkpReceiver* r, uint32_t processing_usec, uint32_t max_kbps,
+                                   int64_t now_usec, uint8_t* buffer, size_t capacity)
+{
+    const struct SkpReceiverStats* st = &r->stats;
+    const struct SkpReceiverStats* last = &r->feedbackStats;
+    struct SkpFeedback feedback;
+    feedback.intervalMs = r->feedbackUsec != 0 ? (uint32_t)((now_usec - r->feedbackUsec) / 1000) : 0;
+    feedback.datagrams = (uint32_t)(st->datagrams - last->datagrams);
+    feedback.lost = (uint32_t)(st->lost > last->lost ? st->lost - last->lost : 0);
+    feedback.framesComplete = (uint32_t)(st->framesComplete - last->framesComplete);
+    feedback.framesPartial = (uint32_t)(st->framesPartial - last->framesPartial);
+    feedback.jitterUsec = st->jitterUsec;
+    feedback.processingUsec = processing_usec;
+    feedback.maxKbps = max_kbps;
+    feedback.ageUsec = 0;
+    if (r->ageCount > 0)
+    {
+        int64_t age = r->ageSumUsec / r->ageCount;
+        feedback.ageUsec = age > 0 ? (uint32_t)age : 1;// 0 means not synchronized
+    }
+
+    r->feedbackStats = *st;
+    r->feedbackUsec = now_usec;
+    r->ageSumUsec = 0;
+    r->ageCount = 0;
+    return skp_write_feedback(&feedback, buffer, capacity);
+}
@@ -0,0 +1,173 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Receiver side of the binary skeleton stream (protocol.h), for the Unreal
+// plugin, the recorder, the dashboard and test stand-ins. Datagrams are
+// decoded straight into frames owned by the receiver struct (no allocation),
+// bodies are reassembled per frame number, and every finished frame is
+// handed to a callback in frame order.
+//
+// Loss and reordering: the datagram sequence counts lost and late datagrams;
+// copies of any of the last SKP_SEQUENCE_WINDOW datagrams are counted as
+// duplicates and dropped, so they never cancel a loss. A frame is delivered
+// complete when all its bodies arrived, or partial when a newer frame
+// completes first, the window is full, or it waited longer than timeoutUsec
+// (see skp_receiver_flush). Datagrams of frames already delivered are
+// dropped as late.
+//
+// Quantized and delta coded bodies are decoded against the last key body of
+// each receiver slot, pose coefficient bodies with the basis the application
+// loaded (the same file as the sender's). Feedback for the sender's rate control
+// (skp_receiver_write_feedback) summarizes the stats since the last report.
+//
+// Clock: bodies carry their capture time in the sender's monotonic clock.
+// Send skp_receiver_write_ping datagrams to the sender every few hundred ms;
+// each pong gives one offset sample, and the offset used is the sample with
+// the smallest round trip, aged by SKP_CLOCK_DRIFT_PPM so old samples give
+// way to fresh ones as the two clocks drift apart. Once synchronized, frames
+// are stamped with their capture time in the receiver clock and their age.
+
+#define SKP_RECEIVER_WINDOW 4// frames assembled at the same time
+#define SKP_SEQUENCE_WINDOW 64// datagrams a duplicate is recognized within
+#define SKP_RECEIVER_DEFAULT_TIMEOUT_USEC 50000
+#define SKP_CLOCK_SAMPLES 16 // pong round trips the offset is picked from
+#define SKP_CLOCK_DRIFT_PPM 15// assumed drift between the clocks, as in NTP
+
+struct SkpFrameInfo
+{
+    uint8_t flags;           // rotations present (enum SkpFlags)
+    bool complete;
+    uint32_t bodiesExpected;
+    uint32_t bodiesReceived; // frame->bodyCount; missing bodies are compacted out
+    int64_t firstArrivalUsec;
+    int64_t lastArrivalUsec;
+    int64_t captureUsec;     // sender clock
+    bool clockSynced;        // frame->timestampUsec is the capture time in the
+                             // receiver clock, else firstArrivalUsec
+    int64_t ageUsec;         // delivery time - capture time, if clockSynced
+    float pcaErrorMm;        // largest reconstruction error of its SKP_PCA bodies
+};
+
+struct SkpReceiverStats
+{
+    uint64_t datagrams;
+    uint64_t bytes;
+    uint64_t malformed;
+    uint64_t lost;          // datagram sequence numbers never seen
+    uint64_t reordered;     // arrived after a newer sequence number
+    uint64_t duplicates;    // sequence number or body already received
+    uint64_t late;          // body of a frame that was already delivered
+    uint64_t missingKey;    // delta body whose key body was lost
+    uint64_t unknownBasis;  // SKP_PCA body coded with a basis the receiver does not have
+    uint64_t framesComplete;
+    uint64_t framesPartial;
+    uint32_t jitterUsec;    // smoothed variation of the frame interarrival time
+    uint64_t pings;
+    uint64_t pongs;
+};
+
+struct SkpClockSample
+{
+    int64_t offsetUsec;// sender clock - receiver clock
+    int64_t rttUsec;
+    int64_t timeUsec;  // receiver clock at the pong
+};
+
+struct SkpClockSync
+{
+    struct SkpClockSample samples[SKP_CLOCK_SAMPLES];
+    int count;
+    int next;
+    bool synced;
+    int64_t offsetUsec;// of the chosen sample
+    int64_t rttUsec;
+};
+
+typedef void (*skp_frame_fn)(const struct SkeletonFrame* frame, const struct SkpFrameInfo* info, void* context);
+typedef void (*skp_slot_events_fn)(uint32_t frame_number, const struct BodySlotEvent* events, int count, void* context);
+typedef void (*skp_zone_events_fn)(uint32_t frame_number, const struct ZoneEvent* events, int count, void* context);
+typedef void (*skp_gesture_events_fn)(uint32_t frame_number, const struct GestureEvent* events, int count,
+                                      void* context);
+typedef void (*skp_pose_matches_fn)(uint32_t frame_number, const struct PoseMatchResult* matches, int count,
+                                    void* context);
+typedef void (*skp_retargeted_fn)(uint32_t frame_number, const struct RetargetPose* poses, int count, int bone_count,
+                                  void* context);
+
+struct SkpAssembly
+{
+    bool used;
+    uint16_t receivedMask;// bit per body index
+    struct SkpFrameInfo info;
+    struct SkeletonFrame frame;
+};
+
+struct SkpReceiver
+{
+    skp_frame_fn onFrame;
+    skp_slot_events_fn onSlotEvents;// may be NULL
+    skp_zone_events_fn onZoneEvents;// may be NULL, set after init
+    skp_gesture_events_fn onGestureEvents;// likewise
+    skp_pose_matches_fn onPoseMatches;    // likewise
+    skp_retargeted_fn onRetargeted;       // likewise
+    const struct PoseBasis* basis;        // for SKP_PCA bodies, may be NULL, set after init
+    void* context;
+    int64_t timeoutUsec;
+
+    bool haveSequence;
+    uint8_t stream;
+    uint32_t nextSequence;
+    uint64_t seenMask;// bit i: sequence nextSequence - 1 - i arrived
+    bool haveDelivered;
+    uint32_t lastDelivered;
+
+    int64_t lastFrameArrivalUsec;
+    int64_t meanIntervalUsec;
+
+    struct SkpAssembly assembly[SKP_RECEIVER_WINDOW];
+    struct SkpBodyKey keys[MAX_BODY_SLOTS];
+    struct SkpReceiverStats stats;
+    struct SkpClockSync clock;
+    struct RetargetPose retargeted[MAX_FRAME_BODIES];// decoded SKP_MSG_RETARGETED
+
+    struct SkpReceiverStats feedbackStats;// at the last feedback
+    int64_t feedbackUsec;
+    int64_t ageSumUsec;// since the last feedback
+    uint32_t ageCount;
+};
+
+void skp_receiver_init(struct SkpReceiver* receiver, skp_frame_fn on_frame, skp_slot_events_fn on_slot_events,
+                       void* context);
+
+// Decode one datagram; callbacks run from inside this call. now_usec is its
+// arrival time in the receiver's monotonic clock. Returns false if the
+// datagram is not a valid skeleton stream datagram.
+bool skp_receiver_push(struct SkpReceiver* receiver, const uint8_t* data, size_t size, int64_t now_usec);
+
+// Deliver partial frames that waited longer than timeoutUsec. Call it when
+// the socket read times out so the last frame before a pause is not held.
+void skp_receiver_flush(struct SkpReceiver* receiver, int64_t now_usec);
+
+// Feedback datagram for the sender covering the time since the previous one.
+// processing_usec is the application's time per frame (decode and apply);
+// max_kbps caps the stream the sender picks for this receiver (0 = no cap).
+// Send it to the source address of the stream about once per second.
+size_t skp_receiver_write_feedback(struct SkpReceiver* receiver, uint32_t processing_usec, uint32_t max_kbps,
+                                   int64_t now_usec, uint8_t* buffer, size_t capacity);
+
+// Clock offset request for the sender; send it to the source address of the
+// stream. The pong is consumed by skp_receiver_push.
+size_t skp_receiver_write_ping(struct SkpReceiver* receiver, int64_t now_usec, uint8_t* buffer, size_t capacity);
+
+// Map a sender clock time into the receiver clock; false until the first pong
+bool skp_receiver_local_time(const struct SkpReceiver* receiver, int64_t sender_usec, int64_t* local_usec);
+
+#ifdef __cplusplus
+}
+#endif
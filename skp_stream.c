@@ -0,0 +1,206 @@
+#include <string.h>
+#include "skp_stream.h"
+
+//////////////////////////////////////////////////////////////////////////////
+// Encoder
+
+void skp_stream_encoder_init(struct SkpStreamEncoder* e, uint8_t group_size)
+{
+    e->nextSequence = 0;
+    e->streamId = 0;
+    e->groupSize = group_size > SKP_FEC_MAX_GROUP ? SKP_FEC_MAX_GROUP : group_size;
+}
+
+// XOR datagrams [first, first + count) of the batch into a parity datagram
+static void append_parity(struct SkpStreamEncoder* e, struct DatagramBatch* batch, uint32_t first, uint32_t count)
+{
+    uint8_t* parity = datagram_batch_reserve(batch, SKP_MAX_PARITY);
+    if (parity == NULL)
+        return;
+
+    uint8_t* xor_data = parity + SKP_PARITY_HEADER_SIZE;
+    size_t longest = 0;
+    uint16_t size_xor = 0;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        const uint8_t* d = batch->data + batch->offsets[i];
+        size_t size = batch->sizes[i];
+        if (size > longest)
+        {
+            memset(xor_data + longest, 0, size - longest);
+            longest = size;
+        }
+        for (size_t k = 0; k < size; k++)
+            xor_data[k] ^= d[k];
+        size_xor ^= (uint16_t)size;
+    }
+
+    const uint8_t* last = batch->data + batch->offsets[first + count - 1];
+    uint32_t first_sequence = skp_get_u32(batch->data + batch->offsets[first] + SKP_SEQUENCE_OFFSET);
+    size_t size = skp_write_parity_header(parity, skp_get_u32(last + 4), first_sequence, (uint8_t)count,
+                                          size_xor, longest);
+    parity[11] = e->streamId;
+    skp_put_u32(parity + SKP_SEQUENCE_OFFSET, e->nextSequence++);
+    datagram_batch_commit(batch, size);
+}
+
+void skp_stream_prepare(struct DatagramBatch* batch, void* context)
+{
+    struct SkpStreamEncoder* e = (struct SkpStreamEncoder*)context;
+    uint32_t count = batch->count;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (batch->sizes[i] < SKP_COMMON_HEADER_SIZE)
+            continue;
+        uint8_t* d = batch->data + batch->offsets[i];
+        d[11] = e->streamId;
+        skp_put_u32(d + SKP_SEQUENCE_OFFSET, e->nextSequence++);
+    }
+
+    // parity follows the data of the frame, one per group
+    for (uint32_t first = 0; e->groupSize > 0 && first < count; first += e->groupSize)
+    {
+        uint32_t n = count - first < e->groupSize ? count - first : e->groupSize;
+        append_parity(e, batch, first, n);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Decoder
+
+void skp_fec_decoder_init(struct SkpFecDecoder* d)
+{
+    memset(d, 0, sizeof(*d));
+}
+
+static const struct SkpFecStored* find_stored(const struct SkpFecDecoder* d, uint8_t stream, uint32_t sequence)
+{
+    const struct SkpFecStored* s = &d->stored[sequence % SKP_FEC_WINDOW];
+    return (s->size > 0 && s->sequence == sequence && s->stream == stream) ? s : NULL;
+}
+
+static void store(struct SkpFecDecoder* d, uint8_t stream, uint32_t sequence, const uint8_t* data, size_t size)
+{
+    if (size > SKP_MAX_DATAGRAM)
+        return;
+    struct SkpFecStored* s = &d->stored[sequence % SKP_FEC_WINDOW];
+    s->stream = stream;
+    s->sequence = sequence;
+    s->size = (uint16_t)size;
+    memcpy(s->data, data, size);
+}
+
+static int missing_in(const struct SkpFecDecoder* d, const struct SkpFecGroup* g, uint32_t* missing)
+{
+    int holes = 0;
+    for (uint32_t i = 0; i < g->count; i++)
+    {
+        if (find_stored(d, g->stream, g->firstSequence + i) == NULL)
+        {
+            *missing = g->firstSequence + i;
+            holes++;
+        }
+    }
+    return holes;
+}
+
+// Rebuild the only missing datagram of the group and feed it to the receiver
+static void recover(struct SkpFecDecoder* d, struct SkpFecGroup* g, uint32_t missing,
+                    struct SkpReceiver* receiver, int64_t now)
+{
+    uint8_t out[SKP_MAX_DATAGRAM];
+    uint16_t size = g->sizeXor;
+    memcpy(out, g->data, g->size);
+    for (uint32_t i = 0; i < g->count; i++)
+    {
+        const struct SkpFecStored* s = find_stored(d, g->stream, g->firstSequence + i);
+        if (s == NULL)
+            continue;
+        for (size_t k = 0; k < s->size; k++)
+            out[k] ^= s->data[k];
+        size ^= s->size;
+    }
+    g->used = false;
+    if (size == 0 || size > g->size)
+        return;
+
+    d->stats.recovered++;
+    store(d, g->stream, missing, out, size);
+    skp_receiver_push(receiver, out, size, now);
+}
+
+// Settle a group: recover if one datagram is missing, forget it if none is
+static void resolve(struct SkpFecDecoder* d, struct SkpFecGroup* g, struct SkpReceiver* receiver, int64_t now)
+{
+    uint32_t missing = 0;
+    int holes = missing_in(d, g, &missing);
+    if (holes == 0)
+        g->used = false;
+    else if (holes == 1)
+        recover(d, g, missing, receiver, now);
+}
+
+static void push_parity(struct SkpFecDecoder* d, struct SkpReceiver* receiver, uint8_t stream,
+                        const struct SkpParity* p, int64_t now)
+{
+    d->stats.parity++;
+    if (p->count > SKP_FEC_MAX_GROUP || p->size > SKP_MAX_DATAGRAM)
+        return;
+
+    struct SkpFecGroup* g = &d->pending[d->nextPending];
+    d->nextPending = (d->nextPending + 1) % SKP_FEC_PENDING;
+    if (g->used)
+    {
+        // evicted before its holes arrived
+        uint32_t missing;
+        d->stats.unrecoverable += (uint64_t)missing_in(d, g, &missing);
+    }
+
+    g->used = true;
+    g->stream = stream;
+    g->firstSequence = p->firstSequence;
+    g->count = p->count;
+    g->sizeXor = p->sizeXor;
+    g->size = (uint16_t)p->size;
+    memcpy(g->data, p->data, p->size);
+    resolve(d, g, receiver, now);
+}
+
+bool skp_fec_push(struct SkpFecDecoder* d, struct SkpReceiver* receiver, const uint8_t* data, size_t size,
+                  int64_t now_usec)
+{
+    struct SkpHeader h;
+    if (!skp_read_header(data, size, &h) || !skp_is_stream_message(h.type))
+        return skp_receiver_push(receiver, data, size, now_usec);
+
+    if (h.type == SKP_MSG_PARITY)
+    {
+        struct SkpParity parity;
+        // the receiver still sees it, for sequence accounting
+        bool ok = skp_receiver_push(receiver, data, size, now_usec);
+        if (skp_read_parity(data, &h, &parity))
+            push_parity(d, receiver, h.stream, &parity, now_usec);
+        return ok;
+    }
+
+    if (find_stored(d, h.stream, h.sequence) != NULL)
+    {
+        // a copy, or the original of a datagram already recovered: the
+        // receiver has seen it once and must not count it again
+        d->stats.dropped++;
+        return true;
+    }
+
+    store(d, h.stream, h.sequence, data, size);
+    bool ok = skp_receiver_push(receiver, data, size, now_usec);
+
+    // a late datagram may complete a group waiting for it
+    for (int i = 0; i < SKP_FEC_PENDING; i++)
+    {
+        struct SkpFecGroup* g = &d->pending[i];
+        if (g->used && g->stream == h.stream && (uint32_t)(h.sequence - g->firstSequence) < g->count)
+            resolve(d, g, receiver, now_usec);
+    }
+    return ok;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "datagram_batch.h"
+#include "skp_receiver.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Stream-level framing of the binary protocol: datagram sequence numbers and
+// optional XOR forward error correction.
+//
+// The encoder runs as the udp_sender prepare hook. With a group size k it
+// appends one parity datagram per group of up to k consecutive datagrams;
+// groups end at frame boundaries so recovery never waits for the next
+// frame. Overhead is 1/k for frames of k or more datagrams and up to 100%
+// for one-datagram frames. Any single loss within a group is repaired.
+//
+// The decoder sits in front of an SkpReceiver: it keeps the last
+// SKP_FEC_WINDOW datagrams and rebuilds a missing one as soon as its group
+// has exactly one hole, wherever the parity arrives in the order. The
+// receiver counts a recovered datagram as reordered (and no longer as lost);
+// the original arriving late after all is dropped, as are copies.
+
+#define SKP_FEC_MAX_GROUP 16
+#define SKP_FEC_WINDOW 64  // datagrams kept for recovery
+#define SKP_FEC_PENDING 8  // parity groups waiting for a late datagram
+
+struct SkpStreamEncoder
+{
+    uint32_t nextSequence;
+    uint8_t groupSize;// 0 = no parity
+    uint8_t streamId;
+};
+
+void skp_stream_encoder_init(struct SkpStreamEncoder* encoder, uint8_t group_size);
+
+// udp_sender prepare hook (context is the encoder): stamps sequence numbers
+// (and the stream id) and appends the parity datagrams of the batch
+void skp_stream_prepare(struct DatagramBatch* batch, void* context);
+
+struct SkpFecStats
+{
+    uint64_t parity;       // parity datagrams received
+    uint64_t recovered;    // datagrams rebuilt from parity
+    uint64_t unrecoverable;// holes left in groups that lost two or more datagrams
+                           // (a group whose parity is lost is not seen at all)
+    uint64_t dropped;      // copies of datagrams already passed on, or late
+                           // originals of recovered ones
+};
+
+struct SkpFecStored
+{
+    uint8_t stream;
+    uint32_t sequence;
+    uint16_t size;// 0 = empty
+    uint8_t data[SKP_MAX_DATAGRAM];
+};
+
+struct SkpFecGroup
+{
+    bool used;
+    uint8_t stream;
+    uint32_t firstSequence;
+    uint8_t count;
+    uint16_t sizeXor;
+    uint16_t size;
+    uint8_t data[SKP_MAX_DATAGRAM];
+};
+
+struct SkpFecDecoder
+{
+    struct SkpFecStored stored[SKP_FEC_WINDOW];
+    struct SkpFecGroup pending[SKP_FEC_PENDING];
+    int nextPending;
+    struct SkpFecStats stats;
+};
+
+void skp_fec_decoder_init(struct SkpFecDecoder* decoder);
+
+// Pass a received datagram through the decoder into the receiver, together
+// with any datagram it allows to recover
+bool skp_fec_push(struct SkpFecDecoder* decoder, struct SkpReceiver* receiver, const uint8_t* data, size_t size,
+                  int64_t now_usec);
+
+#ifdef __cplusplus
+}
+#endif
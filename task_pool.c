@@ -0,0 +1,210 @@
+#include <string.h>
+#include "task_pool.h"
+
+#define COST_SMOOTHING 8// EMA weight 1/8 of each new inline measurement
+
+//////////////////////////////////////////////////////////////////////////////
+// Deques
+
+static bool deque_pop(struct TaskDeque* d, int* begin)
+{
+    platform_mutex_lock(&d->lock);
+    bool have = d->bottom > d->top;
+    if (have)
+        *begin = d->begin[--d->bottom];
+    platform_mutex_unlock(&d->lock);
+    return have;
+}
+
+static bool deque_steal(struct TaskDeque* d, int* begin)
+{
+    platform_mutex_lock(&d->lock);
+    bool have = d->bottom > d->top;
+    if (have)
+        *begin = d->begin[d->top++];
+    platform_mutex_unlock(&d->lock);
+    return have;
+}
+
+// Run chunks of the current loop until no deque has any left
+static void participate(struct TaskPool* pool, int self, task_fn fn, void* context, int count, int grain)
+{
+    int participants = pool->workerCount + 1;
+    for (;;)
+    {
+        int begin;
+        bool have = deque_pop(&pool->deques[self], &begin);
+        for (int i = 1; !have && i < participants; i++)
+            have = deque_steal(&pool->deques[(self + i) % participants], &begin);
+        if (!have)
+            return;
+
+        int end = begin + grain < count ? begin + grain : count;
+        for (int index = begin; index < end; index++)
+            fn(context, index);
+
+        platform_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            platform_cond_broadcast(&pool->done);
+        platform_mutex_unlock(&pool->lock);
+    }
+}
+
+static PLATFORM_THREAD_RETURN worker_thread(void* param)
+{
+    struct TaskWorker* worker = (struct TaskWorker*)param;
+    struct TaskPool* pool = worker->pool;
+    uint32_t seen = 0;
+
+    platform_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        // join only a loop that still has chunks: one that ended while this
+        // worker slept may already be replaced by the next
+        while (!pool->stopping && (pool->generation == seen || pool->pending == 0))
+        {
+            seen = pool->generation;
+            platform_cond_wait(&pool->wake, &pool->lock);
+        }
+        if (pool->stopping)
+            break;
+        seen = pool->generation;
+        task_fn fn = pool->fn;
+        void* context = pool->context;
+        int count = pool->count;
+        int grain = pool->grain;
+        pool->active++;
+        platform_mutex_unlock(&pool->lock);
+
+        participate(pool, worker->index, fn, context, count, grain);
+
+        platform_mutex_lock(&pool->lock);
+        if (--pool->active == 0 && pool->pending == 0)
+            platform_cond_broadcast(&pool->done);
+    }
+    platform_mutex_unlock(&pool->lock);
+    return PLATFORM_THREAD_RESULT;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Pool
+
+bool task_pool_init(struct TaskPool* pool, int workers_wanted, int64_t threshold_ns)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->thresholdNs = threshold_ns;
+    if (workers_wanted < 0)
+        workers_wanted = platform_cpu_count() - 1;
+    if (workers_wanted > TASK_POOL_MAX_WORKERS)
+        workers_wanted = TASK_POOL_MAX_WORKERS;
+
+    platform_mutex_init(&pool->lock);
+    platform_cond_init(&pool->wake);
+    platform_cond_init(&pool->done);
+    for (int d = 0; d <= TASK_POOL_MAX_WORKERS; d++)
+        platform_mutex_init(&pool->deques[d].lock);
+
+    for (int w = 0; w < workers_wanted; w++)
+    {
+        pool->workers[w].pool = pool;
+        pool->workers[w].index = w + 1;
+        if (!platform_thread_create(&pool->threads[w], worker_thread, &pool->workers[w]))
+            break;
+        pool->workerCount++;
+    }
+    return workers_wanted <= 0 || pool->workerCount > 0;
+}
+
+void task_pool_destroy(struct TaskPool* pool)
+{
+    platform_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    platform_cond_broadcast(&pool->wake);
+    platform_mutex_unlock(&pool->lock);
+    for (int w = 0; w < pool->workerCount; w++)
+        platform_thread_join(pool->threads[w]);
+
+    for (int d = 0; d <= TASK_POOL_MAX_WORKERS; d++)
+        platform_mutex_destroy(&pool->deques[d].lock);
+    platform_cond_destroy(&pool->done);
+    platform_cond_destroy(&pool->wake);
+    platform_mutex_destroy(&pool->lock);
+    pool->workerCount = 0;
+}
+
+void task_loop_init(struct TaskLoop* loop, const char* name, int64_t initial_ns_per_item)
+{
+    memset(loop, 0, sizeof(*loop));
+    loop->name = name;
+    loop->nsPerItem = initial_ns_per_item;
+}
+
+static void run_inline(struct TaskLoop* loop, int count, task_fn fn, void* context)
+{
+    int64_t start = monotonic_usec();
+    for (int i = 0; i < count; i++)
+        fn(context, i);
+    int64_t ns = (monotonic_usec() - start) * 1000 / count;
+    loop->nsPerItem += (ns - loop->nsPerItem) / COST_SMOOTHING;
+    loop->inlineRuns++;
+}
+
+// Deal the chunks out evenly, contiguous ranges per participant
+static void deal_chunks(struct TaskPool* pool, int chunks)
+{
+    int participants = pool->workerCount + 1;
+    for (int p = 0; p < participants; p++)
+    {
+        struct TaskDeque* d = &pool->deques[p];
+        int first = chunks * p / participants;
+        int end = chunks * (p + 1) / participants;
+        d->top = 0;
+        d->bottom = 0;
+        // popped from the bottom: the owner works its range front to back
+        for (int c = end - 1; c >= first; c--)
+            d->begin[d->bottom++] = c * pool->grain;
+    }
+}
+
+void task_pool_for(struct TaskPool* pool, struct TaskLoop* loop, int count, task_fn fn, void* context)
+{
+    if (count <= 0)
+        return;
+    if (pool == NULL || pool->workerCount == 0 || count < 2 || loop->nsPerItem * count < pool->thresholdNs ||
+        ++loop->eligible % TASK_LOOP_PROBE_INTERVAL == 0)
+    {
+        run_inline(loop, count, fn, context);
+        return;
+    }
+
+    platform_mutex_lock(&pool->lock);
+    if (pool->busy)
+    {
+        platform_mutex_unlock(&pool->lock);
+        run_inline(loop, count, fn, context);
+        return;
+    }
+    int participants = pool->workerCount + 1;
+    int max_chunks = participants * TASK_POOL_DEQUE_SIZE;
+    pool->busy = true;
+    pool->fn = fn;
+    pool->context = context;
+    pool->count = count;
+    pool->grain = (count + max_chunks - 1) / max_chunks;
+    int chunks = (count + pool->grain - 1) / pool->grain;
+    deal_chunks(pool, chunks);
+    pool->pending = chunks;
+    pool->generation++;
+    platform_cond_broadcast(&pool->wake);
+    platform_mutex_unlock(&pool->lock);
+
+    participate(pool, 0, fn, context, count, pool->grain);
+
+    // the loop ends when every chunk ran and no worker still looks at the deques
+    platform_mutex_lock(&pool->lock);
+    while (pool->pending > 0 || pool->active > 0)
+        platform_cond_wait(&pool->done, &pool->lock);
+    pool->busy = false;
+    platform_mutex_unlock(&pool->lock);
+    loop->parallelRuns++;
+}
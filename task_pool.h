@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "platform.h"
+
+// Small work-stealing pool for the per-body and per-camera loops of the
+// output stage.
+//
+// task_pool_for runs fn(context, i) for every i of a range and returns when
+// all are done. The range is cut into chunks dealt out evenly to one deque
+// per participant (the workers and the calling thread, which works too).
+// Each participant pops chunks from the bottom of its own deque; once it is
+// empty it steals from the top of the others, so a body that takes longer
+// (a new slot, a long bone clamp) does not leave the rest of the pool idle.
+//
+// Waking the workers costs a few microseconds, more than the whole loop of a
+// small frame. Every call site keeps a TaskLoop with its measured cost per
+// item and the range runs inline unless count * cost reaches the pool
+// threshold. The cost is only measured by inline runs, so every
+// TASK_LOOP_PROBE_INTERVAL-th parallel-eligible call runs inline to keep it
+// current. Calls while the pool is busy with another loop (another thread,
+// or fn itself calling task_pool_for) also run inline.
+
+#define TASK_POOL_MAX_WORKERS 15
+#define TASK_POOL_DEQUE_SIZE 64                // chunks per participant
+#define TASK_POOL_DEFAULT_THRESHOLD_NS 40000   // see tools/crowd_bench
+#define TASK_LOOP_PROBE_INTERVAL 64
+
+typedef void (*task_fn)(void* context, int index);
+
+struct TaskDeque
+{
+    platform_mutex_t lock;
+    int begin[TASK_POOL_DEQUE_SIZE];// first index of each chunk
+    int top;   // next chunk to steal
+    int bottom;// one past the chunk the owner pops next
+};
+
+struct TaskWorker
+{
+    struct TaskPool* pool;
+    int index;// deque of the worker
+};
+
+// Cost model of one call site
+struct TaskLoop
+{
+    const char* name;
+    int64_t nsPerItem;// smoothed inline cost of one index
+    uint32_t eligible;// parallel-eligible calls, for the probes
+    uint64_t inlineRuns;
+    uint64_t parallelRuns;
+};
+
+struct TaskPool
+{
+    int workerCount;    // threads besides the caller, 0 = always inline
+    int64_t thresholdNs;// estimated work of one call at which it goes parallel
+
+    platform_thread_t threads[TASK_POOL_MAX_WORKERS];
+    struct TaskWorker workers[TASK_POOL_MAX_WORKERS];
+    struct TaskDeque deques[TASK_POOL_MAX_WORKERS + 1];// [0] is the caller's
+
+    platform_mutex_t lock;
+    platform_cond_t wake;// new loop, or stopping
+    platform_cond_t done;// last chunk finished, or last worker left
+    bool stopping;
+    bool busy;           // a loop owns the pool
+
+    // current loop, fixed while busy
+    task_fn fn;
+    void* context;
+    int count;
+    int grain;           // indices per chunk
+    uint32_t generation; // bumped per parallel loop
+    int pending;         // chunks not finished
+    int active;          // workers inside the loop
+};
+
+// Start workers threads (< 0: one per core besides the caller). False if no
+// thread could be started; the pool then runs everything inline.
+bool task_pool_init(struct TaskPool* pool, int workers, int64_t threshold_ns);
+void task_pool_destroy(struct TaskPool* pool);
+
+// initial_ns_per_item is the guess used until the first inline run
+void task_loop_init(struct TaskLoop* loop, const char* name, int64_t initial_ns_per_item);
+
+// Run fn(context, i) for i in [0, count), in parallel if the loop's estimated
+// work reaches the threshold. pool may be NULL (always inline). Indices run
+// in any order and concurrently, so fn may only touch state of its index.
+void task_pool_for(struct TaskPool* pool, struct TaskLoop* loop, int count, task_fn fn, void* context);
@@ -0,0 +1,106 @@
+#include <math.h>
+#include <string.h>
+#include "text_format.h"
+
+#define UNITS_PER_MM 1000000.0// 10^TEXT_FORMAT_DECIMALS
+
+static const char digit_pairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char frame_fragment[] = "Frame: ";
+static const char body_fragment[] = ", Body ID[";
+static const char joint_fragment[] = "], Joint[";
+static const char position_fragment[] = "]: Position[mm] ( ";
+static const char separator_fragment[] = ", ";
+static const char end_fragment[] = " ); \n";
+
+#define FRAGMENT(p, f) (memcpy((p), (f), sizeof(f) - 1), (p) + sizeof(f) - 1)
+
+static int decimal_digits(uint32_t v)
+{
+    return 1 + (v >= 10) + (v >= 100) + (v >= 1000) + (v >= 10000) + (v >= 100000) + (v >= 1000000) +
+           (v >= 10000000) + (v >= 100000000) + (v >= 1000000000);
+}
+
+// Two digits at a time from the end, no division per digit
+static char* write_u32(char* p, uint32_t v)
+{
+    int n = decimal_digits(v);
+    char* end = p + n;
+    char* q = end;
+    while (v >= 100)
+    {
+        uint32_t pair = v % 100;
+        v /= 100;
+        q -= 2;
+        memcpy(q, digit_pairs + pair * 2, 2);
+    }
+    if (v >= 10)
+        memcpy(q - 2, digit_pairs + v * 2, 2);
+    else
+        q[-1] = (char)('0' + v);
+    return end;
+}
+
+// %.6f of a float: the float times 10^6 is exact in a double, so rounding it
+// to an integer with the default rounding mode matches printf exactly
+static char* write_fixed(char* p, float v)
+{
+    if (v != v)
+        v = 0.0f;
+    if (signbit(v))
+        *p++ = '-';
+    float magnitude = fabsf(v);
+    if (magnitude > TEXT_FORMAT_MAX_MM)
+        magnitude = TEXT_FORMAT_MAX_MM;
+
+    uint64_t units = (uint64_t)nearbyint((double)magnitude * UNITS_PER_MM);
+    uint32_t whole = (uint32_t)(units / 1000000);
+    uint32_t fraction = (uint32_t)(units % 1000000);
+    p = write_u32(p, whole);
+    p[0] = '.';
+    memcpy(p + 1, digit_pairs + (fraction / 10000) * 2, 2);
+    memcpy(p + 3, digit_pairs + (fraction / 100 % 100) * 2, 2);
+    memcpy(p + 5, digit_pairs + (fraction % 100) * 2, 2);
+    return p + 7;
+}
+
+size_t text_format_body(const struct SkeletonFrame* frame, uint32_t body, char* buffer, size_t capacity)
+{
+    if (capacity < TEXT_FORMAT_MAX_BODY)
+        return 0;
+
+    // "Frame: <n>, Body ID[<id>], Joint[" is the same on every line
+    char prefix[64];
+    char* q = FRAGMENT(prefix, frame_fragment);
+    q = write_u32(q, frame->frameNumber);
+    q = FRAGMENT(q, body_fragment);
+    q = write_u32(q, frame->bodyIds[body]);
+    q = FRAGMENT(q, joint_fragment);
+    size_t prefix_size = (size_t)(q - prefix);
+
+    char* p = buffer;
+    const vec3_t* positions = frame->positions[body];
+    for (uint32_t j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        memcpy(p, prefix, prefix_size);
+        p = write_u32(p + prefix_size, j);
+        p = FRAGMENT(p, position_fragment);
+        p = write_fixed(p, positions[j].x);
+        p = FRAGMENT(p, separator_fragment);
+        p = write_fixed(p, positions[j].y);
+        p = FRAGMENT(p, separator_fragment);
+        p = write_fixed(p, positions[j].z);
+        p = FRAGMENT(p, end_fragment);
+    }
+    return (size_t)(p - buffer);
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "skeleton.h"
+
+// Legacy text protocol for consumers that parse
+//   "Frame: %u, Body ID[%u], Joint[%d]: Position[mm] ( %f, %f, %f ); \n"
+// lines. The output is byte for byte what snprintf prints with that format
+// (six decimals, round half to even), but written with integer arithmetic
+// and precomputed fragments: the "Frame: ..., Joint[" prefix is formatted
+// once per body and the joint fragments are static. All joints of a body go
+// into one datagram, one line per joint.
+
+#define TEXT_FORMAT_DECIMALS 6
+#define TEXT_FORMAT_MAX_LINE 136// two 10-digit ids, three saturated coordinates
+#define TEXT_FORMAT_MAX_BODY (SKELETON_JOINT_COUNT * TEXT_FORMAT_MAX_LINE)
+#define TEXT_FORMAT_MAX_MM 1e9f // coordinates saturate here (NaN prints 0)
+
+// Lines of every joint of one body; returns the size written (no NUL), or 0
+// if capacity is below TEXT_FORMAT_MAX_BODY
+size_t text_format_body(const struct SkeletonFrame* frame, uint32_t body, char* buffer, size_t capacity);
@@ -0,0 +1,209 @@
+/**==============================================
+ * @description : extrinsic calibration of several Kinects from one person
+ *  walking through the shared view. Runs the body tracker of every source
+ *  in parallel, keeps the frames where a camera sees exactly one body and
+ *  solves every camera pose against the first one (extrinsics.c). The file
+ *  it writes is loaded by body_tracking --extrinsics.
+ *  Recordings are processed once as fast as the trackers go, matched by
+ *  device time: record them together with wired sync (k4arecorder
+ *  --external-sync) so their device clocks agree. Devices are matched by
+ *  host capture time and recorded for --seconds.
+ *  Usage: calibrate_extrinsics <out.cfg> <index>|<file.mkv>... [--seconds <s>=60]
+ *                              [--world <x>,<y>,<z>[,<qw>,<qx>,<qy>,<qz>]]
+ *  --world is the pose of the first camera (mm, z up); default: at the
+ *  origin, level and looking along +y (the quaternion defaults likewise)
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "../kinect_pipeline.h"
+#include "../extrinsics.h"
+
+#define OBSERVATIONS_GROW 4096
+
+struct Collector
+{
+    struct ExtrinsicsObservation* observations;
+    int count;
+    int capacity;
+    uint64_t frames;
+    uint64_t crowded;// frames with more than one body
+};
+
+static struct Collector collectors[MAX_KINECTS];
+static struct KinectPipeline kinects[MAX_KINECTS];
+static volatile sig_atomic_t stop;
+
+static void on_interrupt(int signum)
+{
+    (void)signum;
+    stop = 1;
+}
+
+// Pipeline thread of the camera: frames are in camera space (identity pose)
+static void on_frame(struct KinectPipeline* kinect, struct SkeletonFrame* frame, void* context)
+{
+    struct Collector* c = &((struct Collector*)context)[kinect->index];
+    c->frames++;
+    if (frame->bodyCount != 1)
+    {
+        c->crowded += frame->bodyCount > 1;
+        return;
+    }
+    if (c->count == c->capacity)
+    {
+        int capacity = c->capacity + OBSERVATIONS_GROW;
+        struct ExtrinsicsObservation* grown = (struct ExtrinsicsObservation*)realloc(
+            c->observations, (size_t)capacity * sizeof(struct ExtrinsicsObservation));
+        if (grown == NULL)
+            return;
+        c->observations = grown;
+        c->capacity = capacity;
+    }
+    struct ExtrinsicsObservation* o = &c->observations[c->count++];
+    o->timeUsec = frame->timestampUsec;
+    memcpy(o->joints, frame->positions[0], sizeof(o->joints));
+    memcpy(o->confidence, frame->confidence[0], sizeof(o->confidence));
+}
+
+static int compare_time(const void* a, const void* b)
+{
+    int64_t ta = ((const struct ExtrinsicsObservation*)a)->timeUsec;
+    int64_t tb = ((const struct ExtrinsicsObservation*)b)->timeUsec;
+    return (ta > tb) - (ta < tb);
+}
+
+static bool parse_world(const char* value, struct RigidTransform* pose)
+{
+    float v[7];
+    int n = sscanf(value, "%f,%f,%f,%f,%f,%f,%f", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6]);
+    if (n != 3 && n != 7)
+        return false;
+    pose->translation = vec3_make(v[0], v[1], v[2]);
+    pose->rotation = n == 7 ? quat_normalize(quat_make(v[3], v[4], v[5], v[6])) : kinect_level_orientation();
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        printf("Usage: calibrate_extrinsics <out.cfg> <index>|<file.mkv>... [--seconds <s>] [--world <pose>]\n");
+        return 1;
+    }
+    const char* out_path = argv[1];
+    int seconds = 60;
+    struct RigidTransform world = { kinect_level_orientation(), { 0.0f, 0.0f, 0.0f } };
+    struct KinectSourceOptions sources[MAX_KINECTS];
+    int count = 0;
+    bool devices = false;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+            seconds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--world") == 0 && i + 1 < argc)
+        {
+            if (!parse_world(argv[++i], &world))
+            {
+                printf("Invalid pose '%s'\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (count < MAX_KINECTS)
+        {
+            struct KinectSourceOptions* s = &sources[count++];
+            memset(s, 0, sizeof(*s));
+            char* end;
+            long index = strtol(argv[i], &end, 10);
+            s->device = (*argv[i] != '\0' && *end == '\0') ? (int)index : -1;
+            s->recording = s->device < 0 ? argv[i] : NULL;
+            s->fixedPose = true;// identity: bodies stay in camera space
+            s->orientation = quat_identity();
+            devices |= s->device >= 0;
+        }
+    }
+    if (count < 2)
+    {
+        printf("At least two cameras are needed\n");
+        return 1;
+    }
+
+    signal(SIGINT, on_interrupt);
+    int started = 0;
+    for (int k = 0; k < count; k++)
+    {
+        if (!kinect_pipeline_open(&kinects[k], k, &sources[k], -1, 0, NULL, on_frame, collectors))
+            break;
+        kinects[k].replayOnce = sources[k].device < 0;
+        if (!kinect_pipeline_start(&kinects[k]))
+            break;
+        started++;
+    }
+    if (started < count)
+    {
+        printf("Not every camera could be started\n");
+        stop = 1;
+    }
+
+    // Until every recording ended, or --seconds of live capture
+    int64_t end_usec = monotonic_usec() + (int64_t)seconds * 1000000;
+    while (!stop)
+    {
+        int running = 0;
+        for (int k = 0; k < started; k++)
+            running += !kinects[k].finished;
+        if (running == 0 || (devices && monotonic_usec() >= end_usec))
+            break;
+        platform_sleep_usec(100000);
+    }
+    for (int k = 0; k < count; k++)
+        kinect_pipeline_close(&kinects[k]);
+    if (started < count)
+        return 1;
+
+    struct ExtrinsicsCamera cameras[MAX_KINECTS];
+    for (int k = 0; k < count; k++)
+    {
+        struct Collector* c = &collectors[k];
+        qsort(c->observations, (size_t)c->count, sizeof(struct ExtrinsicsObservation), compare_time);
+        cameras[k].observations = c->observations;
+        cameras[k].count = c->count;
+        printf("%s: %llu frames, %d with one body, %llu with several\n", kinects[k].name,
+               (unsigned long long)c->frames, c->count, (unsigned long long)c->crowded);
+    }
+
+    struct ExtrinsicsConfig config;
+    extrinsics_default_config(&config);
+    static struct ExtrinsicsResult result;
+    int64_t start = monotonic_usec();
+    bool solved = extrinsics_solve(cameras, count, 0, &world, &config, &result);
+    printf("Solved in %.2f s\n", (double)(monotonic_usec() - start) * 1e-6);
+
+    for (int a = 0; a < count; a++)
+    {
+        for (int b = a + 1; b < count; b++)
+        {
+            const struct ExtrinsicsPair* pair = &result.pairs[a][b];
+            printf("  pair %d-%d: %d correspondences, %d inliers, rms %.1f mm\n", a, b, pair->correspondences,
+                   pair->inliers, pair->rmsMm);
+        }
+    }
+    for (int k = 0; k < count; k++)
+    {
+        if (result.solved[k])
+            printf("  kinect %d: rms %.1f mm over %d joints\n", k, result.rmsMm[k], result.inliers[k]);
+        else
+            printf("  kinect %d: not enough overlap with the other cameras\n", k);
+    }
+
+    bool saved = solved && extrinsics_save(out_path, &result);
+    if (saved)
+        printf("Wrote %s\n", out_path);
+    else
+        printf("Calibration failed\n");
+    for (int k = 0; k < count; k++)
+        free(collectors[k].observations);
+    return saved ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+/**==============================================
+ * @description : end-to-end check of capture timestamps and the ping/pong
+ *  clock offset. A sender stamps frames with their capture time and, like the
+ *  capture loop, reads pings only once per frame; a receiver thread whose
+ *  clock is offset by a known amount pings it every 100 ms and measures frame
+ *  age. Runs once with kernel arrival times on the pongs and once with the
+ *  read time, and compares the measured age with the true one.
+ *  Usage: clock_sync_check [seconds=4] [receiver offset ms=-3141.59]
+ *                          [pipeline ms=40] [receiver port=9071]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../udp_sender.h"
+#include "../skp_receiver.h"
+#include "../skp_stream.h"
+
+#define FRAME_INTERVAL_USEC 33333
+#define PING_INTERVAL_USEC 100000
+#define WARMUP_USEC 500000
+
+struct RunResult
+{
+    uint64_t frames;
+    uint64_t pongs;
+    int64_t maxAgeError;
+    double meanAgeError;// absolute
+    int64_t offsetError;// final estimate
+    int64_t rtt;
+    double meanAge;
+};
+
+static int64_t receiver_offset;// receiver clock - sender clock
+static int64_t push_now;       // receiver clock of the datagram being pushed
+static int64_t first_sync;
+static double age_error_sum;
+static double age_sum;
+static struct RunResult result;
+
+static int64_t receiver_clock(void)
+{
+    return monotonic_usec() + receiver_offset;
+}
+
+static void on_frame(const struct SkeletonFrame* frame, const struct SkpFrameInfo* info, void* context)
+{
+    (void)frame;
+    (void)context;
+    if (!info->clockSynced)
+        return;
+    if (first_sync == 0)
+        first_sync = push_now;
+    if (push_now - first_sync < WARMUP_USEC)
+        return;
+
+    int64_t true_age = (push_now - receiver_offset) - info->captureUsec;
+    int64_t error = info->ageUsec - true_age;
+    if (error < 0)
+        error = -error;
+    if (error > result.maxAgeError)
+        result.maxAgeError = error;
+    age_error_sum += (double)error;
+    age_sum += (double)info->ageUsec;
+    result.frames++;
+}
+
+struct ReceiverThread
+{
+    SOCKET socket;
+    volatile bool stop;
+    struct SkpReceiver receiver;
+};
+
+static PLATFORM_THREAD_RETURN receive(void* param)
+{
+    struct ReceiverThread* t = (struct ReceiverThread*)param;
+    uint8_t buffer[SKP_MAX_DATAGRAM];
+    SOCKADDR_IN source;
+    bool have_source = false;
+    int64_t next_ping = 0;
+    while (!t->stop)
+    {
+        SOCKADDR_IN from;
+        socklen_t length = sizeof(from);
+        ssize_t size = recvfrom(t->socket, (char*)buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &length);
+        push_now = receiver_clock();
+        if (size > 0)
+        {
+            source = from;
+            have_source = true;
+            skp_receiver_push(&t->receiver, buffer, (size_t)size, push_now);
+        }
+        else
+            skp_receiver_flush(&t->receiver, push_now);
+
+        if (have_source && push_now >= next_ping)
+        {
+            uint8_t ping[SKP_PING_SIZE];
+            size_t n = skp_receiver_write_ping(&t->receiver, receiver_clock(), ping, sizeof(ping));
+            sendto(t->socket, (const char*)ping, (int)n, 0, (struct sockaddr*)&source, sizeof(source));
+            next_ping = push_now + PING_INTERVAL_USEC;
+        }
+    }
+    return PLATFORM_THREAD_RESULT;
+}
+
+// Answer pings like the capture loop; with read_time the pong claims the
+// ping arrived when it was read
+static void serve_pings(struct UdpSender* sender, bool read_time)
+{
+    uint8_t buffer[SKP_MAX_DATAGRAM];
+    SOCKADDR_IN from;
+    int64_t arrival;
+    int size;
+    while ((size = udp_sender_receive(sender, buffer, sizeof(buffer), &from, &arrival)) > 0)
+    {
+        struct SkpHeader h;
+        struct SkpPong pong;
+        if (!skp_read_header(buffer, (size_t)size, &h) || !skp_read_ping(buffer, &h, &pong.pingSentUsec))
+            continue;
+        uint8_t reply[SKP_PONG_SIZE];
+        pong.pingReceivedUsec = read_time ? monotonic_usec() : arrival;
+        pong.pongSentUsec = monotonic_usec();
+        udp_sender_reply(sender, &from, reply, skp_write_pong(&pong, reply, sizeof(reply)));
+    }
+}
+
+static bool run(bool read_time, double seconds, int64_t pipeline_usec, uint16_t port, SOCKET s)
+{
+    static struct UdpSender sender;
+    static struct SkpStreamEncoder stream;
+    static struct DatagramBatch batch;
+    static struct SkeletonFrame frame;
+    if (!udp_sender_open(&sender) || !udp_sender_add_destination(&sender, "127.0.0.1", port))
+        return false;
+    skp_stream_encoder_init(&stream, 0);
+    sender.prepare = skp_stream_prepare;
+    sender.prepareContext = &stream;
+
+    static struct ReceiverThread t;
+    t.socket = s;
+    t.stop = false;
+    skp_receiver_init(&t.receiver, on_frame, NULL, NULL);
+    memset(&result, 0, sizeof(result));
+    first_sync = 0;
+    age_error_sum = 0.0;
+    age_sum = 0.0;
+    platform_thread_t thread;
+    if (!platform_thread_create(&thread, receive, &t))
+        return false;
+
+    frame.bodyCount = 1;
+    frame.bodyIds[0] = 1;
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        frame.positions[0][j] = (vec3_t){ 0.0f, (float)j * 20.0f, 2000.0f };
+        frame.confidence[0][j] = CONFIDENCE_MEDIUM;
+    }
+
+    int64_t start = monotonic_usec();
+    int64_t next = start;
+    for (uint32_t f = 0; monotonic_usec() - start < (int64_t)(seconds * 1e6); f++)
+    {
+        // the capture loop waits for the camera, then sends and serves receivers
+        while (monotonic_usec() < next)
+            platform_sleep_usec(1000);
+        next += FRAME_INTERVAL_USEC;
+
+        frame.frameNumber = f;
+        frame.timestampUsec = monotonic_usec() - pipeline_usec;
+        datagram_batch_clear(&batch);
+        uint8_t* buffer = datagram_batch_reserve(&batch, SKP_MAX_DATAGRAM);
+        datagram_batch_commit(&batch, skp_write_body(&frame, 0, 0, buffer, SKP_MAX_DATAGRAM));
+        udp_sender_send(&sender, &batch);
+        serve_pings(&sender, read_time);
+    }
+
+    t.stop = true;
+    platform_thread_join(thread);
+    udp_sender_close(&sender);
+
+    result.pongs = t.receiver.stats.pongs;
+    if (result.frames > 0)
+    {
+        result.meanAgeError = age_error_sum / (double)result.frames;
+        result.meanAge = age_sum / (double)result.frames;
+    }
+    result.offsetError = t.receiver.clock.offsetUsec + receiver_offset;
+    result.rtt = t.receiver.clock.rttUsec;
+    return true;
+}
+
+static void print_result(const char* name, const struct RunResult* r)
+{
+    printf("%-16s %4llu frames, %3llu pongs | age %6.2f ms, error mean %7.1f us, max %7lld us | "
+           "offset error %6lld us, rtt %5lld us\n",
+           name, (unsigned long long)r->frames, (unsigned long long)r->pongs, r->meanAge / 1000.0, r->meanAgeError,
+           (long long)r->maxAgeError, (long long)r->offsetError, (long long)r->rtt);
+}
+
+int main(int argc, char** argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 4.0;
+    receiver_offset = (int64_t)((argc > 2 ? atof(argv[2]) : -3141.59) * 1000.0);
+    int64_t pipeline_usec = (int64_t)((argc > 3 ? atof(argv[3]) : 40.0) * 1000.0);
+    uint16_t port = (uint16_t)(argc > 4 ? atoi(argv[4]) : 9071);
+
+    net_startup();
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    SOCKADDR_IN a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &a.sin_addr);
+    if (bind(s, (struct sockaddr*)&a, sizeof(a)) != 0)
+    {
+        printf("Can not bind port %u\n", port);
+        return 1;
+    }
+    struct timeval timeout = { 0, 10000 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+    printf("%.1f s at 30 fps, receiver clock %+.3f ms from the sender's, true frame age %.1f ms + network\n",
+           seconds, receiver_offset / 1000.0, pipeline_usec / 1000.0);
+    struct RunResult kernel, read;
+    if (!run(false, seconds, pipeline_usec, port, s))
+        return 1;
+    kernel = result;
+    if (!run(true, seconds, pipeline_usec, port, s))
+        return 1;
+    read = result;
+    print_result("kernel arrival", &kernel);
+    print_result("read time", &read);
+
+    // the offset error is at most half the round trip of the chosen sample
+    bool ok = kernel.frames > 0 && kernel.maxAgeError < 1000;
+    closesocket(s);
+    net_cleanup();
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,193 @@
+/**==============================================
+ * @description : output stage per-body work on synthetic crowds of 1..50
+ *  bodies, inline against the work-stealing task pool. Crowds larger than a
+ *  camera frame are spread over several frames with a predictor each, as
+ *  several cameras would be. Every body runs what the output stage runs per
+ *  body: motion filters, prediction and bone-local rotations. Each crowd is
+ *  timed inline, always on the pool and with the pool's default threshold.
+ *  The outputs of the three must be identical, and with no more threads than
+ *  cores the adaptive choice must be about as fast as the better of the two.
+ *  Usage: crowd_bench [workers=cores-1] [frames=2000]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../task_pool.h"
+#include "../motion_predictor.h"
+
+#define MAX_CROWD 50
+#define CROWD_FRAMES ((MAX_CROWD + MAX_FRAME_BODIES - 1) / MAX_FRAME_BODIES)
+#define CAMERA_PERIOD_USEC 33333
+
+enum Mode
+{
+    MODE_INLINE,
+    MODE_POOL,    // threshold 0: every call with 2+ bodies goes parallel
+    MODE_ADAPTIVE,// TASK_POOL_DEFAULT_THRESHOLD_NS
+    MODE_COUNT,
+};
+static const char* mode_names[MODE_COUNT] = { "inline", "pool", "adaptive" };
+
+// Output stage state of one mode
+struct World
+{
+    struct MotionPredictor predictors[CROWD_FRAMES];
+    struct SkeletonFrame frames[CROWD_FRAMES];
+    int64_t horizons[CROWD_FRAMES];
+    struct TaskLoop loop;
+};
+
+static struct World worlds[MODE_COUNT];
+static vec3_t skeleton_template[SKELETON_JOINT_COUNT];
+
+static void process_body(void* context, int index)
+{
+    struct World* world = (struct World*)context;
+    int f = index / MAX_FRAME_BODIES;
+    uint32_t b = (uint32_t)(index % MAX_FRAME_BODIES);
+    motion_predictor_observe_body(&world->predictors[f], &world->frames[f], b);
+    motion_predictor_apply_body(&world->predictors[f], &world->frames[f], b, world->horizons[f]);
+    skeleton_compute_body_local_rotations(&world->frames[f], b);
+}
+
+// Body i of the crowd at time t: walking a circle, limbs swinging
+static void capture(struct World* world, int crowd, int step)
+{
+    int64_t t = 1000000 + (int64_t)step * CAMERA_PERIOD_USEC;
+    float s = (float)t * 1e-6f;
+    for (int f = 0; f * MAX_FRAME_BODIES < crowd; f++)
+    {
+        struct SkeletonFrame* frame = &world->frames[f];
+        int first = f * MAX_FRAME_BODIES;
+        frame->frameNumber = (uint32_t)step + 1;
+        frame->timestampUsec = t;
+        frame->bodyCount = (uint32_t)(crowd - first < MAX_FRAME_BODIES ? crowd - first : MAX_FRAME_BODIES);
+        for (uint32_t b = 0; b < frame->bodyCount; b++)
+        {
+            int person = first + (int)b;
+            float phase = (float)person * 0.37f;
+            vec3_t pelvis = vec3_make(2000.0f * sinf(s * 0.3f + phase), 950.0f, 2000.0f * cosf(s * 0.3f + phase));
+            quat_t heading = quat_from_rotvec(vec3_make(0.0f, s * 0.3f + phase, 0.0f));
+            frame->bodyIds[b] = (uint32_t)person + 1;
+            frame->slots[b] = (uint8_t)b;
+            frame->cameraPositions[b] = vec3_make(0.0f, 1000.0f, -3000.0f);
+            for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+            {
+                float swing = 0.4f * sinf(s * 5.0f + phase + (float)j);
+                quat_t limb = quat_mul(heading, quat_from_rotvec(vec3_make(swing, 0.0f, 0.0f)));
+                frame->positions[b][j] = vec3_add(pelvis, quat_rotate(limb, skeleton_template[j]));
+                frame->worldRotations[b][j] = limb;
+                frame->confidence[b][j] = CONFIDENCE_MEDIUM;
+            }
+        }
+    }
+}
+
+static double run(enum Mode mode, struct TaskPool* pool, int crowd, int steps)
+{
+    struct World* world = &worlds[mode];
+    struct MotionPredictorConfig config;
+    motion_predictor_default_config(&config);
+    for (int f = 0; f < CROWD_FRAMES; f++)
+        motion_predictor_init(&world->predictors[f], &config);
+    task_loop_init(&world->loop, mode_names[mode], 3000);
+    if (pool != NULL)
+        pool->thresholdNs = mode == MODE_POOL ? 0 : TASK_POOL_DEFAULT_THRESHOLD_NS;
+    int frames = (crowd + MAX_FRAME_BODIES - 1) / MAX_FRAME_BODIES;
+
+    int64_t total = 0;
+    for (int step = 0; step < steps; step++)
+    {
+        capture(world, crowd, step);
+        int64_t start = monotonic_usec();
+        for (int f = 0; f < frames; f++)
+            world->horizons[f] = motion_predictor_horizon(&world->predictors[f], &world->frames[f], start);
+        task_pool_for(mode == MODE_INLINE ? NULL : pool, &world->loop, crowd, process_body, world);
+        for (int f = 0; f < frames; f++)
+            motion_predictor_collect(&world->predictors[f]);
+        total += monotonic_usec() - start;
+    }
+    return (double)total / (double)steps;
+}
+
+static bool same_output(int crowd)
+{
+    for (int f = 0; f * MAX_FRAME_BODIES < crowd; f++)
+    {
+        const struct SkeletonFrame* a = &worlds[MODE_INLINE].frames[f];
+        for (int m = MODE_POOL; m < MODE_COUNT; m++)
+        {
+            const struct SkeletonFrame* b = &worlds[m].frames[f];
+            size_t n = a->bodyCount;
+            if (memcmp(a->positions, b->positions, n * sizeof(a->positions[0])) != 0 ||
+                memcmp(a->localRotations, b->localRotations, n * sizeof(a->localRotations[0])) != 0 ||
+                worlds[MODE_INLINE].predictors[f].predictionError.count != worlds[m].predictors[f].predictionError.count)
+                return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    int cores = platform_cpu_count();
+    int workers = argc > 1 ? atoi(argv[1]) : (cores > 1 ? cores - 1 : 1);
+    int steps = argc > 2 ? atoi(argv[2]) : 2000;
+    if (workers < 1 || workers > TASK_POOL_MAX_WORKERS || steps < 100)
+    {
+        printf("workers must be 1..%d and frames at least 100\n", TASK_POOL_MAX_WORKERS);
+        return 1;
+    }
+
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        skeleton_template[j] = vec3_make((float)(j % 5) * 60.0f - 120.0f, (float)j * 30.0f - 300.0f,
+                                         (float)(j % 3) * 50.0f - 50.0f);
+
+    static struct TaskPool pool;
+    if (!task_pool_init(&pool, workers, TASK_POOL_DEFAULT_THRESHOLD_NS))
+    {
+        printf("Can not start the workers\n");
+        return 1;
+    }
+    printf("%d cores, %d workers + caller, threshold %lld ns, %d frames per crowd\n", cores, pool.workerCount,
+           (long long)TASK_POOL_DEFAULT_THRESHOLD_NS, steps);
+    bool oversubscribed = pool.workerCount + 1 > cores;
+    if (oversubscribed)
+        printf("more threads than cores: the pool times only show its overhead\n");
+    printf("bodies   inline us   pool us   adaptive us   speedup   adaptive ran\n");
+
+    static const int crowds[] = { 1, 2, 4, 8, 12, 16, 24, 32, 40, 50 };
+    int crossover = 0;// smallest crowd from which on the pool is faster
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(crowds) / sizeof(crowds[0]); i++)
+    {
+        int crowd = crowds[i];
+        double us[MODE_COUNT];
+        for (int m = 0; m < MODE_COUNT; m++)
+            us[m] = run((enum Mode)m, &pool, crowd, steps);
+        const struct TaskLoop* adaptive = &worlds[MODE_ADAPTIVE].loop;
+        bool same = same_output(crowd);
+        // the adaptive choice should be about as fast as the better of the two
+        double best = us[MODE_INLINE] < us[MODE_POOL] ? us[MODE_INLINE] : us[MODE_POOL];
+        bool good = same && (oversubscribed || us[MODE_ADAPTIVE] <= best * 1.25 + 2.0);
+        if (us[MODE_POOL] >= us[MODE_INLINE])
+            crossover = 0;
+        else if (crossover == 0 && crowd > 1)
+            crossover = crowd;
+        printf("%6d %11.1f %9.1f %13.1f %8.2fx   %s%s%s\n", crowd, us[MODE_INLINE], us[MODE_POOL], us[MODE_ADAPTIVE],
+               us[MODE_INLINE] / us[MODE_POOL],
+               adaptive->parallelRuns > adaptive->inlineRuns ? "parallel" : "inline",
+               same ? "" : "  <-- outputs differ", good ? "" : "  <--");
+        ok &= good;
+    }
+    if (crossover > 0)
+        printf("the pool pays off from %d bodies\n", crossover);
+    else
+        printf("the pool never paid off on this machine\n");
+
+    task_pool_destroy(&pool);
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../skeleton.h"
+
+// Synthetic dancers for the pose tools (pose_index_bench, pose_basis_check):
+// a dancer has its own height, place and facing and moves every limb along
+// smooth random paths of PARAMS joint angles. Joints are world space, z up,
+// mm. Random numbers come from one xorshift state per tool.
+
+#define PARAMS 16
+
+static uint32_t rng = 2463534242u;
+static float random_unit(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (float)(rng >> 8) / 16777216.0f;
+}
+
+static float random_range(float lo, float hi)
+{
+    return lo + (hi - lo) * random_unit();
+}
+
+// Joint angles of a pose, radians, and their ranges
+enum Param
+{
+    LEAN, TWIST,
+    LEFT_ARM_UP, LEFT_ARM_FORWARD, LEFT_ELBOW, RIGHT_ARM_UP, RIGHT_ARM_FORWARD, RIGHT_ELBOW,
+    LEFT_LEG_FORWARD, LEFT_LEG_OUT, LEFT_KNEE, RIGHT_LEG_FORWARD, RIGHT_LEG_OUT, RIGHT_KNEE,
+    CROUCH, HEAD_TILT,
+};
+static const float param_min[PARAMS] = { -0.3f, -0.5f, -0.3f, -1.2f, 0.0f, -0.3f, -1.2f, 0.0f,
+                                         -0.6f, -0.1f, 0.0f, -0.6f, -0.1f, 0.0f, 0.0f, -0.3f };
+static const float param_max[PARAMS] = { 0.6f, 0.5f, 2.8f, 1.2f, 2.4f, 2.8f, 1.2f, 2.4f,
+                                         1.2f, 0.6f, 2.0f, 1.2f, 0.6f, 2.0f, 0.5f, 0.3f };
+
+struct Dancer
+{
+    vec3_t position;// pelvis on the floor, mm
+    float yaw;
+    float scale;// body size
+    float params[PARAMS];
+    float speeds[PARAMS];// rad per frame
+};
+
+// Direction of a limb hanging down, raised by up towards side (-1 left,
+// +1 right) and swung forward
+static vec3_t spherical(float up, float forward, float side)
+{
+    float s = sinf(up);
+    return vec3_make(side * s * cosf(forward), s * sinf(forward), -cosf(up));
+}
+
+// Joints below root along upper and lower: elbow, wrist, hand, hand tip and
+// thumb, or knee, ankle and foot
+static void limb(vec3_t* joints, int root, vec3_t upper, vec3_t lower, float a, float b, float c, bool arm)
+{
+    joints[root + 1] = vec3_add(joints[root], vec3_scale(upper, a));
+    joints[root + 2] = vec3_add(joints[root + 1], vec3_scale(lower, b));
+    joints[root + 3] = vec3_add(joints[root + 2], arm ? vec3_scale(lower, c) : vec3_make(0.0f, c, -40.0f));
+    if (arm)
+    {
+        joints[root + 4] = vec3_add(joints[root + 3], vec3_scale(lower, 60.0f));
+        joints[root + 5] = vec3_add(joints[root + 3], vec3_make(0.0f, 40.0f, 0.0f));
+    }
+}
+
+// Rotate v about x by angle
+static vec3_t pitch(vec3_t v, float angle)
+{
+    float c = cosf(angle), s = sinf(angle);
+    return vec3_make(v.x, c * v.y - s * v.z, s * v.y + c * v.z);
+}
+
+// World joints of a dancer: built in the dancer's frame (x right, y forward,
+// z up), then scaled, turned by yaw and placed
+static void dancer_joints(const struct Dancer* d, vec3_t* joints)
+{
+    const float* p = d->params;
+    float h = 950.0f * (1.0f - p[CROUCH]);
+    vec3_t local[SKELETON_JOINT_COUNT];
+    vec3_t pelvis = vec3_make(0.0f, 0.0f, h);
+    local[JOINT_PELVIS] = pelvis;
+    vec3_t up = pitch(vec3_make(0.0f, 0.0f, 1.0f), -p[LEAN]);// leaning forward
+    local[JOINT_SPINE_NAVEL] = vec3_add(pelvis, vec3_scale(up, 180.0f));
+    local[JOINT_SPINE_CHEST] = vec3_add(local[JOINT_SPINE_NAVEL], vec3_scale(up, 180.0f));
+    local[JOINT_NECK] = vec3_add(local[JOINT_SPINE_CHEST], vec3_scale(up, 200.0f));
+    vec3_t head = pitch(up, -p[HEAD_TILT]);
+    local[JOINT_HEAD] = vec3_add(local[JOINT_NECK], vec3_scale(head, 150.0f));
+    local[JOINT_NOSE] = vec3_add(local[JOINT_HEAD], vec3_make(0.0f, 90.0f, 0.0f));
+    local[JOINT_EYE_LEFT] = vec3_add(local[JOINT_HEAD], vec3_make(-35.0f, 80.0f, 30.0f));
+    local[JOINT_EAR_LEFT] = vec3_add(local[JOINT_HEAD], vec3_make(-75.0f, 0.0f, 10.0f));
+    local[JOINT_EYE_RIGHT] = vec3_add(local[JOINT_HEAD], vec3_make(35.0f, 80.0f, 30.0f));
+    local[JOINT_EAR_RIGHT] = vec3_add(local[JOINT_HEAD], vec3_make(75.0f, 0.0f, 10.0f));
+
+    // shoulders turn against the hips by TWIST
+    float ct = cosf(p[TWIST]), st = sinf(p[TWIST]);
+    vec3_t across = vec3_make(ct, st, 0.0f);
+    vec3_t chest = local[JOINT_SPINE_CHEST];
+    local[JOINT_CLAVICLE_LEFT] = vec3_add(local[JOINT_NECK], vec3_scale(across, -60.0f));
+    local[JOINT_CLAVICLE_RIGHT] = vec3_add(local[JOINT_NECK], vec3_scale(across, 60.0f));
+    local[JOINT_SHOULDER_LEFT] = vec3_add(vec3_add(chest, vec3_scale(up, 150.0f)), vec3_scale(across, -180.0f));
+    local[JOINT_SHOULDER_RIGHT] = vec3_add(vec3_add(chest, vec3_scale(up, 150.0f)), vec3_scale(across, 180.0f));
+
+    vec3_t upper = spherical(p[LEFT_ARM_UP], p[LEFT_ARM_FORWARD], -1.0f);
+    vec3_t lower = spherical(p[LEFT_ARM_UP] + p[LEFT_ELBOW], p[LEFT_ARM_FORWARD] + 0.5f * p[LEFT_ELBOW], -1.0f);
+    limb(local, JOINT_SHOULDER_LEFT, upper, lower, 280.0f, 250.0f, 80.0f, true);
+    upper = spherical(p[RIGHT_ARM_UP], p[RIGHT_ARM_FORWARD], 1.0f);
+    lower = spherical(p[RIGHT_ARM_UP] + p[RIGHT_ELBOW], p[RIGHT_ARM_FORWARD] + 0.5f * p[RIGHT_ELBOW], 1.0f);
+    limb(local, JOINT_SHOULDER_RIGHT, upper, lower, 280.0f, 250.0f, 80.0f, true);
+
+    local[JOINT_HIP_LEFT] = vec3_add(pelvis, vec3_make(-90.0f, 0.0f, -40.0f));
+    local[JOINT_HIP_RIGHT] = vec3_add(pelvis, vec3_make(90.0f, 0.0f, -40.0f));
+    upper = pitch(spherical(p[LEFT_LEG_OUT], 0.0f, -1.0f), p[LEFT_LEG_FORWARD]);
+    limb(local, JOINT_HIP_LEFT, upper, pitch(upper, -p[LEFT_KNEE]), 420.0f, 400.0f, 130.0f, false);
+    upper = pitch(spherical(p[RIGHT_LEG_OUT], 0.0f, 1.0f), p[RIGHT_LEG_FORWARD]);
+    limb(local, JOINT_HIP_RIGHT, upper, pitch(upper, -p[RIGHT_KNEE]), 420.0f, 400.0f, 130.0f, false);
+
+    float c = cosf(d->yaw), s = sinf(d->yaw);
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        vec3_t v = vec3_scale(local[j], d->scale);
+        joints[j] = vec3_add(d->position, vec3_make(c * v.x - s * v.y, s * v.x + c * v.y, v.z));
+    }
+}
+
+static void dancer_start(struct Dancer* d)
+{
+    d->position = vec3_make(random_range(-4000.0f, 4000.0f), random_range(1000.0f, 6000.0f), 0.0f);
+    d->yaw = random_range(-3.14159f, 3.14159f);
+    d->scale = random_range(0.85f, 1.15f);
+    for (int i = 0; i < PARAMS; i++)
+    {
+        d->params[i] = random_range(param_min[i], param_max[i]);
+        d->speeds[i] = 0.0f;
+    }
+}
+
+// One frame: every angle accelerates at random, bounces off its range
+static void dancer_step(struct Dancer* d)
+{
+    for (int i = 0; i < PARAMS; i++)
+    {
+        d->speeds[i] = 0.95f * d->speeds[i] + random_range(-0.006f, 0.006f);
+        d->params[i] += d->speeds[i];
+        if (d->params[i] < param_min[i] || d->params[i] > param_max[i])
+        {
+            d->params[i] = d->params[i] < param_min[i] ? param_min[i] : param_max[i];
+            d->speeds[i] = -d->speeds[i];
+        }
+    }
+    d->yaw += random_range(-0.01f, 0.01f);
+}
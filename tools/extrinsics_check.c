@@ -0,0 +1,183 @@
+/**==============================================
+ * @description : extrinsic calibration on simulated cameras. Kinects stand
+ *  around a stage facing its centre with unknown poses; one person walks
+ *  through it. Each camera sees the skeleton in its own space at 30 fps with
+ *  its own phase, with joint noise, low-confidence joints, frames where the
+ *  person is out of view and misdetections a metre or two off. Solves all
+ *  poses from camera 0 and compares them with the true ones.
+ *  Usage: extrinsics_check [cameras=4] [seconds=120] [threads=0 (all cores)]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../extrinsics.h"
+#include "../platform.h"
+
+#define CAMERA_PERIOD_USEC 33333
+#define STAGE_RADIUS_MM 3500.0f
+#define NOISE_MM 10.0f
+#define OUTLIER_RATE 0.03f
+#define FIELD_OF_VIEW_COS 0.5f// 60 degrees off the optical axis
+#define MAX_ROTATION_ERROR_DEG 0.5
+#define MAX_TRANSLATION_ERROR_MM 15.0
+
+static struct RigidTransform truth[MAX_KINECTS];
+static vec3_t skeleton_template[SKELETON_JOINT_COUNT];
+
+static uint32_t rng = 88172645u;
+static float random_unit(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (float)(rng >> 8) / 16777216.0f;
+}
+static float random_normal(void)
+{
+    float u = random_unit() + 1e-7f;
+    return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * random_unit());
+}
+
+// Person walks a wandering loop through the stage, turning as it goes (y up)
+static void person_at(int64_t t_usec, vec3_t joints[SKELETON_JOINT_COUNT])
+{
+    float s = (float)t_usec * 1e-6f;
+    vec3_t pelvis = vec3_make(1800.0f * sinf(s * 0.31f) + 400.0f * sinf(s * 1.3f), 950.0f + 40.0f * sinf(s * 4.0f),
+                              1500.0f * sinf(s * 0.23f + 1.0f));
+    quat_t heading = quat_from_rotvec(vec3_make(0.0f, s * 0.8f, 0.0f));
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        joints[j] = vec3_add(pelvis, quat_rotate(heading, skeleton_template[j]));
+}
+
+static void place_cameras(int cameras)
+{
+    for (int c = 0; c < cameras; c++)
+    {
+        float angle = 6.2831853f * (float)c / (float)cameras + 0.3f * random_normal();
+        vec3_t position = vec3_make(STAGE_RADIUS_MM * sinf(angle), 1200.0f + 300.0f * random_unit(),
+                                    STAGE_RADIUS_MM * cosf(angle));
+        // camera z looks at the stage centre, tilted down a little, y down like k4a
+        quat_t look = quat_from_rotvec(vec3_make(0.0f, angle + 3.14159265f, 0.0f));
+        quat_t tilt = quat_from_rotvec(vec3_make(0.15f + 0.1f * random_unit(), 0.0f, 0.0f));
+        quat_t flip = quat_from_rotvec(vec3_make(0.0f, 0.0f, 3.14159265f));
+        truth[c].rotation = quat_normalize(quat_mul(look, quat_mul(tilt, flip)));
+        truth[c].translation = position;
+    }
+}
+
+static int observe(int camera, int cameras, int seconds, struct ExtrinsicsObservation* out)
+{
+    struct RigidTransform to_camera;
+    to_camera.rotation = quat_conj(truth[camera].rotation);
+    to_camera.translation = vec3_scale(quat_rotate(to_camera.rotation, truth[camera].translation), -1.0f);
+
+    int count = 0;
+    int64_t phase = (int64_t)camera * CAMERA_PERIOD_USEC / cameras;
+    for (int64_t t = phase; t < (int64_t)seconds * 1000000; t += CAMERA_PERIOD_USEC)
+    {
+        vec3_t joints[SKELETON_JOINT_COUNT];
+        person_at(t, joints);
+        if (random_unit() < OUTLIER_RATE)
+        {
+            vec3_t off = vec3_make(random_normal() * 1500.0f, 0.0f, random_normal() * 1500.0f);
+            for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+                joints[j] = vec3_add(joints[j], off);
+        }
+
+        struct ExtrinsicsObservation* o = &out[count];
+        vec3_t pelvis = rigid_apply(&to_camera, joints[JOINT_PELVIS]);
+        if (pelvis.z <= 0.0f || pelvis.z / vec3_length(pelvis) < FIELD_OF_VIEW_COS)
+            continue;
+        o->timeUsec = t;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            vec3_t noise = vec3_make(random_normal(), random_normal(), random_normal());
+            o->joints[j] = vec3_add(rigid_apply(&to_camera, joints[j]), vec3_scale(noise, NOISE_MM));
+            float r = random_unit();
+            o->confidence[j] = r < 0.05f ? CONFIDENCE_NONE : (r < 0.15f ? CONFIDENCE_LOW : CONFIDENCE_MEDIUM);
+        }
+        count++;
+    }
+    return count;
+}
+
+int main(int argc, char** argv)
+{
+    int cameras = argc > 1 ? atoi(argv[1]) : 4;
+    int seconds = argc > 2 ? atoi(argv[2]) : 120;
+    int threads = argc > 3 ? atoi(argv[3]) : 0;
+    if (cameras < 2 || cameras > MAX_KINECTS || seconds < 1)
+    {
+        printf("cameras must be 2..%d\n", MAX_KINECTS);
+        return 1;
+    }
+
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        skeleton_template[j] = vec3_make((float)(j % 5) * 90.0f - 180.0f, (float)(j % 11) * 80.0f - 300.0f,
+                                         (float)(j % 3) * 60.0f - 60.0f);
+    place_cameras(cameras);
+
+    int capacity = seconds * 31;
+    struct ExtrinsicsObservation* observations[MAX_KINECTS];
+    struct ExtrinsicsCamera views[MAX_KINECTS];
+    for (int c = 0; c < cameras; c++)
+    {
+        observations[c] = (struct ExtrinsicsObservation*)malloc((size_t)capacity * sizeof(struct ExtrinsicsObservation));
+        if (observations[c] == NULL)
+            return 1;
+        views[c].observations = observations[c];
+        views[c].count = observe(c, cameras, seconds, observations[c]);
+    }
+
+    struct ExtrinsicsConfig config;
+    extrinsics_default_config(&config);
+    config.threads = threads;
+    static struct ExtrinsicsResult result;
+    int64_t start = monotonic_usec();
+    bool solved = extrinsics_solve(views, cameras, 0, &truth[0], &config, &result);
+    int64_t elapsed = monotonic_usec() - start;
+
+    printf("%d cameras, %d s session, solved in %.2f s on %d threads, %d refinement rounds\n", cameras, seconds,
+           (double)elapsed * 1e-6, threads > 0 ? threads : platform_cpu_count(), result.refineRounds);
+    bool ok = solved;
+    for (int c = 0; c < cameras; c++)
+    {
+        double rotation_deg = quat_angle_between(result.poses[c].rotation, truth[c].rotation) * 180.0 / 3.14159265;
+        double translation_mm = vec3_length(vec3_sub(result.poses[c].translation, truth[c].translation));
+        bool good = result.solved[c] && rotation_deg < MAX_ROTATION_ERROR_DEG &&
+                    translation_mm < MAX_TRANSLATION_ERROR_MM;
+        printf("camera %d: %5d frames, %7d inlier joints, rms %5.1f mm, error %.3f deg %.1f mm%s\n", c, views[c].count,
+               result.inliers[c], result.rmsMm[c], rotation_deg, translation_mm, good ? "" : "  <--");
+        ok &= good;
+    }
+    for (int a = 0; a < cameras; a++)
+    {
+        for (int b = a + 1; b < cameras; b++)
+        {
+            const struct ExtrinsicsPair* pair = &result.pairs[a][b];
+            printf("pair %d-%d: %7d correspondences, %7d inliers, rms %.1f mm\n", a, b, pair->correspondences,
+                   pair->inliers, pair->rmsMm);
+        }
+    }
+
+    // the config file round trip the tracker depends on
+    const char* path = "extrinsics_check.cfg";
+    struct RigidTransform loaded[MAX_KINECTS];
+    bool have[MAX_KINECTS];
+    bool saved = extrinsics_save(path, &result) && extrinsics_load(path, loaded, have, MAX_KINECTS) == cameras;
+    for (int c = 0; saved && c < cameras; c++)
+    {
+        saved = have[c] && quat_angle_between(loaded[c].rotation, result.poses[c].rotation) < 1e-5f &&
+                vec3_length(vec3_sub(loaded[c].translation, result.poses[c].translation)) < 0.01f;
+    }
+    remove(path);
+    printf("config file round trip: %s\n", saved ? "ok" : "failed");
+    ok &= saved;
+
+    for (int c = 0; c < cameras; c++)
+        free(observations[c]);
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
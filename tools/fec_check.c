@@ -0,0 +1,268 @@
+/**==============================================
+ * @description : end-to-end check of the FEC layer. Streams binary skeleton
+ *  frames through a local loss-injecting relay (loss_relay.c) to a receiver,
+ *  once without parity and once with one parity datagram per group, and
+ *  compares the frames that arrive incomplete or not at all. Then checks
+ *  the loss accounting on a fixed arrival order: a recovered datagram whose
+ *  original arrives late after all, and copies of datagrams, must not take
+ *  anything off the loss count, with and without FEC.
+ *  Usage: fec_check [loss%=2] [group=4] [burst=1] [frames=3000] [bodies=3]
+ *                   [relay port=9061] [receiver port=9062]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include "../udp_sender.h"
+#include "../skp_receiver.h"
+#include "../skp_stream.h"
+#include "loss_relay.h"
+
+#define FRAME_INTERVAL_USEC 1000
+
+struct RunResult
+{
+    struct LossRelayStats relay;
+    struct SkpReceiverStats receiver;
+    struct SkpFecStats fec;
+    uint64_t datagramsSent;
+    uint64_t bytesSent;
+    uint64_t hitches;// frames delivered partial or never
+};
+
+static struct SkeletonFrame frame;
+static struct DatagramBatch batch;
+
+static void on_frame(const struct SkeletonFrame* f, const struct SkpFrameInfo* info, void* context)
+{
+    (void)f;
+    (void)info;
+    (void)context;
+}
+
+static void drain(SOCKET s, struct SkpFecDecoder* fec, struct SkpReceiver* receiver)
+{
+    uint8_t buffer[SKP_MAX_PARITY];
+    for (;;)
+    {
+        ssize_t size = recv(s, (char*)buffer, sizeof(buffer), 0);
+        if (size <= 0)
+            return;
+        skp_fec_push(fec, receiver, buffer, (size_t)size, monotonic_usec());
+    }
+}
+
+static bool run(const struct LossRelayConfig* config, uint8_t group, int frames, uint32_t bodies,
+                uint16_t relay_port, SOCKET s, struct RunResult* result)
+{
+    static struct LossRelay relay;
+    if (!loss_relay_open(&relay, config, relay_port, "127.0.0.1", 0))
+        return false;
+    SOCKADDR_IN local;
+    socklen_t length = sizeof(local);
+    getsockname(s, (struct sockaddr*)&local, &length);
+    relay.target.sin_port = local.sin_port;
+    loss_relay_start(&relay);
+
+    static struct UdpSender sender;
+    static struct SkpStreamEncoder stream;
+    if (!udp_sender_open(&sender) || !udp_sender_add_destination(&sender, "127.0.0.1", relay_port))
+        return false;
+    skp_stream_encoder_init(&stream, group);
+    sender.prepare = skp_stream_prepare;
+    sender.prepareContext = &stream;
+
+    static struct SkpReceiver receiver;
+    static struct SkpFecDecoder fec;
+    skp_receiver_init(&receiver, on_frame, NULL, NULL);
+    skp_fec_decoder_init(&fec);
+
+    memset(result, 0, sizeof(*result));
+    int64_t next = monotonic_usec();
+    for (int f = 0; f < frames; f++)
+    {
+        frame.frameNumber = (uint32_t)f;
+        datagram_batch_clear(&batch);
+        for (uint32_t b = 0; b < bodies; b++)
+        {
+            frame.positions[b][JOINT_PELVIS].x = (float)f;
+            uint8_t* buffer = datagram_batch_reserve(&batch, SKP_MAX_DATAGRAM);
+            datagram_batch_commit(&batch, skp_write_body(&frame, b, SKP_LOCAL_ROTATIONS, buffer, SKP_MAX_DATAGRAM));
+        }
+        udp_sender_send(&sender, &batch);
+        result->datagramsSent += batch.count;
+        result->bytesSent += batch.used;
+
+        next += FRAME_INTERVAL_USEC;
+        while (monotonic_usec() < next)
+        {
+            drain(s, &fec, &receiver);
+            platform_sleep_usec(200);
+        }
+    }
+    platform_sleep_usec(100000);
+    drain(s, &fec, &receiver);
+    skp_receiver_flush(&receiver, monotonic_usec() + 10 * receiver.timeoutUsec);
+
+    loss_relay_close(&relay);
+    udp_sender_close(&sender);
+    result->relay = relay.stats;
+    result->receiver = receiver.stats;
+    result->fec = fec.stats;
+    result->hitches = (uint64_t)frames - receiver.stats.framesComplete;
+    return true;
+}
+
+// Two frames of four bodies, stamped by an encoder with parity groups of
+// group datagrams (0 = none), fed in the given order of datagram indices
+static void feed(uint8_t group, const int* order, int count, struct SkpReceiver* receiver,
+                 struct SkpFecDecoder* fec)
+{
+    static struct DatagramBatch frames;
+    struct SkpStreamEncoder stream;
+    skp_stream_encoder_init(&stream, group);
+    datagram_batch_clear(&frames);
+    for (int f = 0; f < 2; f++)
+    {
+        static struct DatagramBatch one;
+        datagram_batch_clear(&one);
+        frame.frameNumber = (uint32_t)f;
+        for (uint32_t b = 0; b < 4; b++)
+        {
+            uint8_t* buffer = datagram_batch_reserve(&one, SKP_MAX_DATAGRAM);
+            datagram_batch_commit(&one, skp_write_body(&frame, b, SKP_LOCAL_ROTATIONS, buffer, SKP_MAX_DATAGRAM));
+        }
+        skp_stream_prepare(&one, &stream);
+        for (uint32_t i = 0; i < one.count; i++)
+        {
+            uint8_t* buffer = datagram_batch_reserve(&frames, SKP_MAX_PARITY);
+            memcpy(buffer, one.data + one.offsets[i], one.sizes[i]);
+            datagram_batch_commit(&frames, one.sizes[i]);
+        }
+    }
+
+    skp_receiver_init(receiver, on_frame, NULL, NULL);
+    skp_fec_decoder_init(fec);
+    for (int i = 0; i < count; i++)
+    {
+        const uint8_t* data = frames.data + frames.offsets[order[i]];
+        if (group > 0)
+            skp_fec_push(fec, receiver, data, frames.sizes[order[i]], 0);
+        else
+            skp_receiver_push(receiver, data, frames.sizes[order[i]], 0);
+    }
+}
+
+static bool check_accounting(void)
+{
+    static struct SkpReceiver receiver;
+    static struct SkpFecDecoder fec;
+    frame.bodyCount = 4;
+    for (uint32_t b = 0; b < 4; b++)
+        frame.bodyIds[b] = b + 1;
+
+    // with FEC, datagrams 0-3 + parity 4, 5-8 + parity 9: 1 is recovered and
+    // arrives late after all, 6 and 7 are lost for good, 3 comes twice
+    static const int with_fec[] = { 0, 2, 3, 4, 5, 8, 9, 1, 3 };
+    feed(4, with_fec, 9, &receiver, &fec);
+    bool fec_ok = receiver.stats.lost == 2 && fec.stats.recovered == 1 && fec.stats.dropped == 2;
+    printf("accounting with FEC: lost %llu (2), recovered %llu (1), dropped %llu (2)\n",
+           (unsigned long long)receiver.stats.lost, (unsigned long long)fec.stats.recovered,
+           (unsigned long long)fec.stats.dropped);
+
+    // without, datagrams 0-7: 1 arrives late and twice, 5 and 6 are lost
+    static const int plain[] = { 0, 2, 3, 4, 7, 1, 1, 3 };
+    feed(0, plain, 8, &receiver, &fec);
+    bool plain_ok = receiver.stats.lost == 2 && receiver.stats.reordered == 1 && receiver.stats.duplicates == 2;
+    printf("accounting without FEC: lost %llu (2), reordered %llu (1), duplicates %llu (2)\n",
+           (unsigned long long)receiver.stats.lost, (unsigned long long)receiver.stats.reordered,
+           (unsigned long long)receiver.stats.duplicates);
+    return fec_ok && plain_ok;
+}
+
+static void print_result(const char* name, const struct RunResult* r, const struct RunResult* baseline, int frames)
+{
+    printf("%-10s %6llu datagrams (+%4.1f%% bytes), relay dropped %4llu | frames complete %5llu, partial %4llu, "
+           "missing %4llu | recovered %4llu, unrecoverable %4llu\n",
+           name, (unsigned long long)r->datagramsSent,
+           baseline != NULL ? 100.0 * ((double)r->bytesSent / (double)baseline->bytesSent - 1.0) : 0.0,
+           (unsigned long long)r->relay.dropped, (unsigned long long)r->receiver.framesComplete,
+           (unsigned long long)r->receiver.framesPartial,
+           (unsigned long long)((uint64_t)frames - r->receiver.framesComplete - r->receiver.framesPartial),
+           (unsigned long long)r->fec.recovered, (unsigned long long)r->fec.unrecoverable);
+}
+
+int main(int argc, char** argv)
+{
+    struct LossRelayConfig config;
+    loss_relay_default_config(&config);
+    if (argc > 1)
+        config.lossRate = atof(argv[1]) / 100.0;
+    int group = argc > 2 ? atoi(argv[2]) : 4;
+    if (argc > 3)
+        config.burstLength = atof(argv[3]);
+    int frames = argc > 4 ? atoi(argv[4]) : 3000;
+    uint32_t bodies = (uint32_t)(argc > 5 ? atoi(argv[5]) : 3);
+    uint16_t relay_port = (uint16_t)(argc > 6 ? atoi(argv[6]) : 9061);
+    uint16_t receiver_port = (uint16_t)(argc > 7 ? atoi(argv[7]) : 9062);
+    if (group < 2 || group > SKP_FEC_MAX_GROUP || bodies < 1 || bodies > MAX_FRAME_BODIES)
+    {
+        printf("group must be 2..%d and bodies 1..%d\n", SKP_FEC_MAX_GROUP, MAX_FRAME_BODIES);
+        return 1;
+    }
+
+    net_startup();
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    int buffer_size = 4 * 1024 * 1024;
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer_size, sizeof(buffer_size));
+    SOCKADDR_IN a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(receiver_port);
+    inet_pton(AF_INET, "127.0.0.1", &a.sin_addr);
+    if (bind(s, (struct sockaddr*)&a, sizeof(a)) != 0)
+    {
+        printf("Can not bind port %u\n", receiver_port);
+        return 1;
+    }
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+
+    frame.bodyCount = bodies;
+    for (uint32_t b = 0; b < bodies; b++)
+    {
+        frame.bodyIds[b] = b + 1;
+        frame.slots[b] = (uint8_t)b;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            frame.positions[b][j] = (vec3_t){ (float)b * 500.0f, (float)j * 20.0f, 2000.0f };
+            frame.confidence[b][j] = CONFIDENCE_MEDIUM;
+            frame.localRotations[b][j] = quat_identity();
+        }
+    }
+
+    printf("%d frames of %u bodies, %.1f%% loss in bursts of %.1f, parity every %d datagrams\n", frames, bodies,
+           config.lossRate * 100.0, config.burstLength, group);
+    struct RunResult plain, protected_;
+    if (!run(&config, 0, frames, bodies, relay_port, s, &plain) ||
+        !run(&config, (uint8_t)group, frames, bodies, relay_port, s, &protected_))
+    {
+        printf("Can not set up the relay on port %u\n", relay_port);
+        return 1;
+    }
+    print_result("no FEC", &plain, NULL, frames);
+    char name[32];
+    snprintf(name, sizeof(name), "FEC k=%d", group);
+    print_result(name, &protected_, &plain, frames);
+    printf("hitches: %llu without FEC, %llu with\n", (unsigned long long)plain.hitches,
+           (unsigned long long)protected_.hitches);
+
+    // FEC must repair most losses whenever there are any
+    bool ok = protected_.relay.dropped == 0 ||
+              (protected_.fec.recovered > 0 && protected_.hitches * 2 <= plain.hitches);
+    ok = check_accounting() && ok;
+    closesocket(s);
+    net_cleanup();
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,186 @@
+/**==============================================
+ * @description : cross-camera fusion on simulated cameras. People walk on a
+ *  stage seen by every camera; each camera captures at 30 fps with its own
+ *  phase, adds joint noise and a calibration bias, misses people now and then
+ *  and gives them a new tracker id after a longer dropout, like k4abt. Checks
+ *  that every fused person holds bodies of one person only, that nobody is
+ *  split in two, that fused ids survive dropouts, and the fusion time.
+ *  Usage: fusion_bench [cameras=4] [people=10] [frames=3000]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../body_fusion.h"
+#include "../platform.h"
+
+#define CAMERA_PERIOD_USEC 33333
+#define NOISE_MM 15.0f
+#define BIAS_MM 25.0f
+#define MISS_RATE 0.08f
+#define REACQUIRE_FRAMES 3// a dropout this long gives a new tracker id
+#define PERSON_SPACING_MM 1200.0f
+#define SWAY_MM 350.0f
+
+struct CameraView
+{
+    uint32_t trackerId[MAX_FRAME_BODIES];// per person, 0 = not tracked
+    int missed[MAX_FRAME_BODIES];
+    uint32_t nextId;
+    vec3_t bias;
+};
+
+static struct BodyFusion fusion;
+static struct SkeletonFrame frame;
+static struct SkeletonFrame out;
+static struct CameraView views[MAX_KINECTS];
+static vec3_t skeleton_template[SKELETON_JOINT_COUNT];
+
+static uint32_t rng = 2463534242u;
+static float random_unit(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (float)(rng >> 8) / 16777216.0f;
+}
+static float random_normal(void)
+{
+    float u = random_unit() + 1e-7f;
+    return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * random_unit());
+}
+
+// Pelvis of a person at a time: a grid spot plus a slow sway (up to ~1 m/s)
+static vec3_t person_pelvis(int person, int64_t t_usec)
+{
+    float seconds = (float)t_usec * 1e-6f;
+    float phase = (float)person * 1.7f;
+    return vec3_make((float)(person % 4) * PERSON_SPACING_MM + SWAY_MM * sinf(seconds * 0.9f + phase),
+                     900.0f,
+                     (float)(person / 4) * PERSON_SPACING_MM + SWAY_MM * cosf(seconds * 0.7f + phase));
+}
+
+// Who a camera body id belongs to
+static int truth_of(uint32_t body_id, int cameras, int people)
+{
+    for (int c = 0; c < cameras; c++)
+    {
+        for (int p = 0; p < people; p++)
+        {
+            if (views[c].trackerId[p] != 0 && KINECT_BODY_ID(c, views[c].trackerId[p]) == body_id)
+                return p;
+        }
+    }
+    return -1;
+}
+
+static void capture(int camera, int people, int64_t t_usec, uint32_t number)
+{
+    struct CameraView* view = &views[camera];
+    frame.frameNumber = number;
+    frame.timestampUsec = t_usec;
+    frame.bodyCount = 0;
+    for (int p = 0; p < people; p++)
+    {
+        if (random_unit() < MISS_RATE)
+        {
+            if (++view->missed[p] >= REACQUIRE_FRAMES)
+                view->trackerId[p] = 0;
+            continue;
+        }
+        view->missed[p] = 0;
+        if (view->trackerId[p] == 0)
+            view->trackerId[p] = ++view->nextId;
+
+        uint32_t b = frame.bodyCount++;
+        vec3_t pelvis = vec3_add(person_pelvis(p, t_usec), view->bias);
+        frame.bodyIds[b] = KINECT_BODY_ID(camera, view->trackerId[p]);
+        frame.cameraPositions[b] = vec3_make(0.0f, 1000.0f, -3000.0f);
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            vec3_t noise = vec3_make(random_normal(), random_normal(), random_normal());
+            frame.positions[b][j] = vec3_add(vec3_add(pelvis, skeleton_template[j]), vec3_scale(noise, NOISE_MM));
+            frame.worldRotations[b][j] = quat_identity();
+            float r = random_unit();
+            frame.confidence[b][j] = r < 0.1f ? CONFIDENCE_LOW : (r < 0.5f ? CONFIDENCE_MEDIUM : CONFIDENCE_HIGH);
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int cameras = argc > 1 ? atoi(argv[1]) : 4;
+    int people = argc > 2 ? atoi(argv[2]) : 10;
+    int frames = argc > 3 ? atoi(argv[3]) : 3000;
+    if (cameras < 1 || cameras > MAX_KINECTS || people < 1 || people > MAX_FRAME_BODIES)
+    {
+        printf("cameras must be 1..%d and people 1..%d\n", MAX_KINECTS, MAX_FRAME_BODIES);
+        return 1;
+    }
+
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        skeleton_template[j] = vec3_make((float)(j % 5) * 60.0f - 120.0f, (float)j * 30.0f - 300.0f,
+                                         (float)(j % 3) * 50.0f - 50.0f);
+    for (int c = 0; c < cameras; c++)
+        views[c].bias = vec3_make(random_normal() * BIAS_MM, random_normal() * BIAS_MM, random_normal() * BIAS_MM);
+
+    struct BodyFusionConfig config;
+    body_fusion_default_config(&config);
+    body_fusion_init(&fusion, &config);
+
+    // ids of each true person seen in the previous output
+    uint32_t last_id[MAX_FRAME_BODIES] = { 0 };
+    uint64_t pushes = 0, impure = 0, split = 0, id_changes = 0, persons = 0;
+    int64_t total_usec = 0;
+    for (int f = 0; f < frames; f++)
+    {
+        for (int c = 0; c < cameras; c++)
+        {
+            int64_t t = 1000000 + (int64_t)f * CAMERA_PERIOD_USEC + (int64_t)c * CAMERA_PERIOD_USEC / cameras;
+            capture(c, people, t, (uint32_t)f + 1);
+
+            int64_t start = monotonic_usec();
+            body_fusion_push(&fusion, c, &frame, &out);
+            total_usec += monotonic_usec() - start;
+            pushes++;
+            persons += out.bodyCount;
+
+            // every fused person should hold one true person, each true person one fused person
+            int owner[MAX_FRAME_BODIES];
+            for (int p = 0; p < people; p++)
+                owner[p] = -1;
+            for (int i = 0; i < (int)out.bodyCount; i++)// output persons come first
+            {
+                const struct FusionPerson* person = &fusion.persons[i];
+                int truth = truth_of(person->members[0], cameras, people);
+                for (int m = 1; m < person->memberCount; m++)
+                {
+                    if (truth_of(person->members[m], cameras, people) != truth)
+                        impure++;
+                }
+                if (truth < 0)
+                    continue;
+                if (owner[truth] >= 0)
+                    split++;
+                owner[truth] = i;
+                if (f > 10 && last_id[truth] != 0 && last_id[truth] != person->id)
+                    id_changes++;
+                last_id[truth] = person->id;
+            }
+        }
+    }
+
+    double mean_usec = (double)total_usec / (double)pushes;
+    int64_t p99_usec = latency_stats_percentile(&fusion.fuseTime, 0.99);
+    printf("%d cameras x %d people, %d frames per camera\n", cameras, people, frames);
+    printf("fusion time: mean %.1f us, p99 %lld us, max %lld us per push\n", mean_usec, (long long)p99_usec,
+           (long long)fusion.fuseTime.max);
+    printf("persons per output %.2f, impure members %llu, split persons %llu, id changes %llu\n",
+           (double)persons / (double)pushes, (unsigned long long)impure, (unsigned long long)split,
+           (unsigned long long)id_changes);
+
+    bool ok = impure == 0 && split <= pushes / 1000 && id_changes <= pushes / 1000 && p99_usec < 1000;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,529 @@
+/**==============================================
+ * @description : gesture and posture events on a simulated crowd. People
+ *  stand around a hall and switch every few seconds between idle, raising a
+ *  hand, crouching, pointing at a screen, waving, clapping and holding their
+ *  arms out, blending from pose to pose; hands go out of range now and then
+ *  and people drop out of tracking. A rule file covering every measure is
+ *  loaded through the parser. Every event of the lane-wise engine is checked
+ *  against a scalar reference with acos and sqrt, and the update time and
+ *  the bytes of the event stream against those of the pose stream are
+ *  reported.
+ *  Usage: gesture_bench [people=48] [steps=3000]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../gesture_events.h"
+#include "../protocol.h"
+#include "../platform.h"
+
+#define HALL_MM 10000.0f
+#define STEP_USEC 33333
+#define MAX_PEOPLE 64
+#define BLEND_USEC 400000
+#define DROPOUT_RATE 0.001f     // per person and step
+#define DROPOUT_STEPS 30        // about a second, longer than lostUsec
+#define OCCLUSION_RATE 0.005f   // right hand out of range
+#define OCCLUSION_STEPS 5
+#define MAX_P99_USEC 300
+#define RULES_PATH "gesture_bench.rules"
+
+static const char* rules =
+    "# right hand raised\n"
+    "gesture 1 hold 200 release 200\n"
+    "height 15 26 > 100 40\n"
+    "# left hand raised\n"
+    "gesture 2 hold 200 release 200\n"
+    "height 8 26 > 100 40\n"
+    "# crouching\n"
+    "gesture 3 hold 300 release 300\n"
+    "height 0 20 < 550 50\n"
+    "angle 18 19 20 < 120 10\n"
+    "# pointing at the screen with a straight right arm\n"
+    "gesture 4 hold 300 release 200\n"
+    "pointing 13 15 5000 12000 2000 < 15 5\n"
+    "angle 12 13 14 > 150 10\n"
+    "# waving the right hand\n"
+    "gesture 5 hold 150 release 400\n"
+    "speed 15 150 > 800 100   # mm/s over 150 ms\n"
+    "height 15 12 > 0 30\n"
+    "# hands together\n"
+    "gesture 6 hold 200 release 200\n"
+    "distance 8 15 < 150 30\n"
+    "# arms out to the sides\n"
+    "gesture 7 hold 300 release 200\n"
+    "elevation 12 15 > -20 5\n"
+    "elevation 12 15 < 20 5\n"
+    "elevation 5 8 > -20 5\n"
+    "elevation 5 8 < 20 5\n";
+
+enum Pose
+{
+    POSE_IDLE,
+    POSE_RIGHT_UP,
+    POSE_LEFT_UP,
+    POSE_CROUCH,
+    POSE_POINT,
+    POSE_WAVE,
+    POSE_CLAP,
+    POSE_ARMS_OUT,
+    POSE_COUNT,
+};
+
+struct Person
+{
+    vec3_t position;// pelvis on the floor, mm
+    float yaw;
+    int pose, previousPose;
+    int64_t poseUsec;// since when
+    int64_t nextUsec;
+    int dropout;
+    int occlusion;
+};
+
+static struct GestureEngine engine;
+static struct SkeletonFrame frame;
+static struct Person people_state[MAX_PEOPLE];
+static const vec3_t screen = { 5000.0f, 12000.0f, 2000.0f };
+
+// reference state, by person
+struct RefPerson
+{
+    bool active;
+    int64_t seenUsec;
+    bool conditions[GESTURE_MAX_CONDITIONS];
+    bool started[GESTURE_MAX_GESTURES];
+    bool pending[GESTURE_MAX_GESTURES];
+    int64_t pendingUsec[GESTURE_MAX_GESTURES];
+    int64_t times[GESTURE_WINDOW];
+    vec3_t joints[GESTURE_WINDOW][SKELETON_JOINT_COUNT];
+    int samples;// newest last
+};
+static struct RefPerson ref[MAX_PEOPLE];
+static struct GestureEvent expected[GESTURE_MAX_EVENTS];
+static int expected_count;
+
+static uint32_t rng = 987654321u;
+static float random_unit(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (float)(rng >> 8) / 16777216.0f;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Crowd
+
+static vec3_t normalize(vec3_t v)
+{
+    return vec3_scale(v, 1.0f / vec3_length(v));
+}
+
+// Elbow between shoulder and hand, pushed out by bend mm along side
+static void arm(vec3_t* joints, int shoulder, vec3_t hand, vec3_t side, float bend)
+{
+    vec3_t s = joints[shoulder];
+    vec3_t elbow = vec3_add(vec3_scale(vec3_add(s, hand), 0.5f), vec3_scale(side, bend));
+    vec3_t direction = normalize(vec3_sub(hand, elbow));
+    joints[shoulder + 1] = elbow;
+    joints[shoulder + 2] = vec3_sub(hand, vec3_scale(direction, 80.0f));// wrist
+    joints[shoulder + 3] = hand;
+    joints[shoulder + 4] = vec3_add(hand, vec3_scale(direction, 70.0f));// hand tip
+    joints[shoulder + 5] = vec3_add(hand, vec3_make(0.0f, 40.0f, 0.0f));// thumb
+}
+
+static void leg(vec3_t* joints, int hip, float x, float pelvis_z)
+{
+    vec3_t h = vec3_make(x, 0.0f, pelvis_z - 50.0f);
+    vec3_t ankle = vec3_make(x, 0.0f, 80.0f);
+    float half = (h.z - ankle.z) * 0.5f;
+    float forward = sqrtf(fmaxf(0.0f, 420.0f * 420.0f - half * half));
+    joints[hip] = h;
+    joints[hip + 1] = vec3_make(x, forward, ankle.z + half);
+    joints[hip + 2] = ankle;
+    joints[hip + 3] = vec3_make(x, 120.0f, 30.0f);
+}
+
+// Joints of a pose in the person's frame: x right, y forward, z up
+static void pose_joints(const struct Person* person, int pose, float s, vec3_t* joints)
+{
+    float h = pose == POSE_CROUCH ? 500.0f : 950.0f;
+    joints[JOINT_PELVIS] = vec3_make(0.0f, 0.0f, h);
+    joints[JOINT_SPINE_NAVEL] = vec3_make(0.0f, 0.0f, h + 150.0f);
+    joints[JOINT_SPINE_CHEST] = vec3_make(0.0f, 0.0f, h + 300.0f);
+    joints[JOINT_NECK] = vec3_make(0.0f, 0.0f, h + 500.0f);
+    joints[JOINT_HEAD] = vec3_make(0.0f, 0.0f, h + 650.0f);
+    joints[JOINT_NOSE] = vec3_make(0.0f, 90.0f, h + 650.0f);
+    joints[JOINT_EYE_LEFT] = vec3_make(-35.0f, 80.0f, h + 680.0f);
+    joints[JOINT_EAR_LEFT] = vec3_make(-75.0f, 0.0f, h + 660.0f);
+    joints[JOINT_EYE_RIGHT] = vec3_make(35.0f, 80.0f, h + 680.0f);
+    joints[JOINT_EAR_RIGHT] = vec3_make(75.0f, 0.0f, h + 660.0f);
+    joints[JOINT_CLAVICLE_LEFT] = vec3_make(-60.0f, 0.0f, h + 460.0f);
+    joints[JOINT_CLAVICLE_RIGHT] = vec3_make(60.0f, 0.0f, h + 460.0f);
+    joints[JOINT_SHOULDER_LEFT] = vec3_make(-180.0f, 0.0f, h + 450.0f);
+    joints[JOINT_SHOULDER_RIGHT] = vec3_make(180.0f, 0.0f, h + 450.0f);
+    leg(joints, JOINT_HIP_LEFT, -100.0f, h);
+    leg(joints, JOINT_HIP_RIGHT, 100.0f, h);
+
+    vec3_t left = joints[JOINT_SHOULDER_LEFT], right = joints[JOINT_SHOULDER_RIGHT];
+    vec3_t out_left = vec3_make(-1.0f, 0.0f, 0.0f), out_right = vec3_make(1.0f, 0.0f, 0.0f);
+    vec3_t down = vec3_make(0.0f, 30.0f, -600.0f);
+    vec3_t left_hand = vec3_add(left, down), right_hand = vec3_add(right, down);
+    float left_bend = 0.0f, right_bend = 0.0f;
+    switch (pose)
+    {
+    case POSE_RIGHT_UP:
+        right_hand = vec3_add(right, vec3_make(0.0f, 50.0f, 600.0f));
+        break;
+    case POSE_LEFT_UP:
+        left_hand = vec3_add(left, vec3_make(0.0f, 50.0f, 600.0f));
+        break;
+    case POSE_POINT:
+    {
+        // the screen in the person's frame
+        vec3_t d = vec3_sub(screen, person->position);
+        float c = cosf(person->yaw), sn = sinf(person->yaw);
+        vec3_t local = vec3_make(c * d.x + sn * d.y, -sn * d.x + c * d.y, d.z);
+        right_hand = vec3_add(right, vec3_scale(normalize(vec3_sub(local, right)), 600.0f));
+        break;
+    }
+    case POSE_WAVE:
+    {
+        float phi = 0.8f * sinf(s * 12.566371f);// 2 Hz
+        vec3_t elbow = vec3_add(right, vec3_make(250.0f, 0.0f, 100.0f));
+        right_hand = vec3_add(elbow, vec3_make(250.0f * sinf(phi), 0.0f, 250.0f * cosf(phi)));
+        right_bend = 120.0f;
+        break;
+    }
+    case POSE_CLAP:
+        left_hand = vec3_make(-20.0f, 300.0f, h + 250.0f);
+        right_hand = vec3_make(20.0f, 300.0f, h + 250.0f);
+        left_bend = right_bend = 150.0f;
+        break;
+    case POSE_ARMS_OUT:
+        left_hand = vec3_add(left, vec3_make(-600.0f, 0.0f, 0.0f));
+        right_hand = vec3_add(right, vec3_make(600.0f, 0.0f, 0.0f));
+        break;
+    default:
+        break;
+    }
+    arm(joints, JOINT_SHOULDER_LEFT, left_hand, out_left, left_bend);
+    arm(joints, JOINT_SHOULDER_RIGHT, right_hand, out_right, right_bend);
+}
+
+static void person_joints(struct Person* person, int64_t t, vec3_t* out)
+{
+    if (t >= person->nextUsec)
+    {
+        person->previousPose = person->pose;
+        person->pose = random_unit() < 0.3f ? POSE_IDLE : (int)(random_unit() * POSE_COUNT) % POSE_COUNT;
+        person->poseUsec = t;
+        person->nextUsec = t + 1000000 + (int64_t)(random_unit() * 2500000.0f);
+    }
+    float s = (float)t * 1e-6f;
+    vec3_t a[SKELETON_JOINT_COUNT], b[SKELETON_JOINT_COUNT];
+    pose_joints(person, person->previousPose, s, a);
+    pose_joints(person, person->pose, s, b);
+    float blend = fminf(1.0f, (float)(t - person->poseUsec) / (float)BLEND_USEC);
+    float c = cosf(person->yaw), sn = sinf(person->yaw);
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        vec3_t p = vec3_add(vec3_scale(a[j], 1.0f - blend), vec3_scale(b[j], blend));
+        p = vec3_add(p, vec3_make(random_unit() * 10.0f - 5.0f, random_unit() * 10.0f - 5.0f,
+                                  random_unit() * 10.0f - 5.0f));
+        out[j] = vec3_add(person->position, vec3_make(c * p.x - sn * p.y, sn * p.x + c * p.y, p.z));
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Scalar reference
+
+static double degrees(double cosine)
+{
+    cosine = cosine < -1.0 ? -1.0 : (cosine > 1.0 ? 1.0 : cosine);
+    return acos(cosine) * 57.29577951308232;
+}
+
+static double length(vec3_t v)
+{
+    return sqrt((double)v.x * v.x + (double)v.y * v.y + (double)v.z * v.z);
+}
+
+static double dot(vec3_t u, vec3_t v)
+{
+    return (double)u.x * v.x + (double)u.y * v.y + (double)u.z * v.z;
+}
+
+// Measure value of condition c; false if it can not be measured
+static bool ref_measure(const struct RefPerson* r, const struct GestureCondition* c, const uint8_t* confidence,
+                        double* value)
+{
+    const vec3_t* now = r->joints[r->samples - 1];
+    vec3_t a = now[c->joints[0]], b = now[c->joints[1]], k = now[c->joints[2]];
+    for (int i = 0; i < 3; i++)
+    {
+        if (confidence[c->joints[i]] == CONFIDENCE_NONE)
+            return false;
+    }
+    switch (c->measure)
+    {
+    case GESTURE_HEIGHT:
+        *value = (double)a.z - b.z;
+        return true;
+    case GESTURE_DISTANCE:
+        *value = length(vec3_sub(a, b));
+        return true;
+    case GESTURE_ANGLE:
+    {
+        vec3_t u = vec3_sub(a, b), v = vec3_sub(k, b);
+        *value = degrees(dot(u, v) / (length(u) * length(v)));
+        return true;
+    }
+    case GESTURE_ELEVATION:
+    {
+        vec3_t d = vec3_sub(b, a);
+        *value = asin(d.z / length(d)) * 57.29577951308232;
+        return true;
+    }
+    case GESTURE_POINTING:
+    {
+        vec3_t u = vec3_sub(b, a), v = vec3_sub(vec3_make(c->target[0], c->target[1], c->target[2]), b);
+        *value = degrees(dot(u, v) / (length(u) * length(v)));
+        return true;
+    }
+    default:
+    {
+        // newest earlier sample at least the window old, else the oldest
+        // if it covers half of it
+        int64_t t = r->times[r->samples - 1];
+        int s = r->samples - 2;
+        while (s > 0 && t - r->times[s] < c->windowUsec)
+            s--;
+        if (s < 0 || 2 * (t - r->times[s]) < c->windowUsec)
+            return false;
+        *value = length(vec3_sub(a, r->joints[s][c->joints[0]])) / ((double)(t - r->times[s]) * 1e-6);
+        return true;
+    }
+    }
+}
+
+static void expect(uint8_t type, uint16_t id, uint32_t body)
+{
+    struct GestureEvent* e = &expected[expected_count++];
+    e->type = type;
+    e->id = id;
+    e->bodyId = body;
+}
+
+static void ref_body(uint32_t b)
+{
+    int p = (int)frame.bodyIds[b] - 1;
+    struct RefPerson* r = &ref[p];
+    if (!r->active)
+        memset(r, 0, sizeof(*r));
+    r->active = true;
+    r->seenUsec = frame.timestampUsec;
+    if (r->samples == GESTURE_WINDOW)
+    {
+        memmove(r->times, r->times + 1, sizeof(r->times[0]) * (GESTURE_WINDOW - 1));
+        memmove(r->joints, r->joints + 1, sizeof(r->joints[0]) * (GESTURE_WINDOW - 1));
+        r->samples--;
+    }
+    r->times[r->samples] = frame.timestampUsec;
+    memcpy(r->joints[r->samples], frame.positions[b], sizeof(r->joints[0]));
+    r->samples++;
+
+    for (int g = 0; g < engine.gestureCount; g++)
+    {
+        const struct Gesture* gesture = &engine.gestures[g];
+        bool all = true;
+        for (int k = 0; k < gesture->conditionCount; k++)
+        {
+            int ci = gesture->firstCondition + k;
+            const struct GestureCondition* c = &engine.conditions[ci];
+            double q;
+            if (ref_measure(r, c, frame.confidence[b], &q))
+            {
+                if (c->greater)
+                    r->conditions[ci] = q > c->threshold - (r->conditions[ci] ? c->margin : 0.0f);
+                else
+                    r->conditions[ci] = q < c->threshold + (r->conditions[ci] ? c->margin : 0.0f);
+            }
+            all = all && r->conditions[ci];
+        }
+        if (all == r->started[g])
+        {
+            r->pending[g] = false;
+            continue;
+        }
+        if (!r->pending[g])
+        {
+            r->pending[g] = true;
+            r->pendingUsec[g] = frame.timestampUsec;
+        }
+        if (frame.timestampUsec - r->pendingUsec[g] >= (r->started[g] ? gesture->releaseUsec : gesture->holdUsec))
+        {
+            expect(r->started[g] ? GESTURE_END : GESTURE_START, gesture->id, (uint32_t)p + 1);
+            r->started[g] = !r->started[g];
+            r->pending[g] = false;
+        }
+    }
+}
+
+static void ref_update(int people)
+{
+    for (uint32_t b = 0; b < frame.bodyCount; b++)
+        ref_body(b);
+    for (int p = 0; p < people; p++)
+    {
+        struct RefPerson* r = &ref[p];
+        if (!r->active || frame.timestampUsec - r->seenUsec <= engine.config.lostUsec)
+            continue;
+        for (int g = 0; g < engine.gestureCount; g++)
+        {
+            if (r->started[g])
+                expect(GESTURE_END, engine.gestures[g].id, (uint32_t)p + 1);
+        }
+        r->active = false;
+    }
+}
+
+static int compare_events(const void* a, const void* b)
+{
+    const struct GestureEvent* x = (const struct GestureEvent*)a;
+    const struct GestureEvent* y = (const struct GestureEvent*)b;
+    if (x->bodyId != y->bodyId)
+        return x->bodyId < y->bodyId ? -1 : 1;
+    if (x->id != y->id)
+        return x->id - y->id;
+    return x->type - y->type;
+}
+
+int main(int argc, char** argv)
+{
+    int people = argc > 1 ? atoi(argv[1]) : 48;
+    int steps = argc > 2 ? atoi(argv[2]) : 3000;
+    if (people < 1 || people > MAX_PEOPLE || steps < 100)
+    {
+        printf("people must be 1..%d and steps at least 100\n", MAX_PEOPLE);
+        return 1;
+    }
+
+    FILE* f = fopen(RULES_PATH, "w");
+    if (f == NULL || fputs(rules, f) < 0)
+    {
+        printf("Can not write %s\n", RULES_PATH);
+        return 1;
+    }
+    fclose(f);
+    gesture_engine_init(&engine, NULL);
+    int loaded = gesture_engine_load(&engine, RULES_PATH);
+    remove(RULES_PATH);
+    if (loaded != 7)
+    {
+        printf("rule file not loaded (%d)\n", loaded);
+        return 1;
+    }
+
+    for (int p = 0; p < people; p++)
+    {
+        people_state[p].position = vec3_make(random_unit() * HALL_MM, random_unit() * HALL_MM, 0.0f);
+        people_state[p].yaw = random_unit() * 6.2831853f;
+    }
+
+    static struct GestureEvent got[GESTURE_MAX_EVENTS];
+    uint64_t updates = 0, events = 0, mismatches = 0, bodies = 0, event_datagrams = 0;
+    uint64_t starts[GESTURE_MAX_GESTURES] = { 0 };
+    int64_t total_usec = 0;
+    for (int step = 0; step < steps; step++)
+    {
+        int64_t t = 1000000 + (int64_t)step * STEP_USEC;
+        for (int p = 0; p < people; p++)
+        {
+            struct Person* person = &people_state[p];
+            if (person->dropout > 0)
+                person->dropout--;
+            else if (random_unit() < DROPOUT_RATE)
+                person->dropout = DROPOUT_STEPS;
+            if (person->occlusion > 0)
+                person->occlusion--;
+            else if (random_unit() < OCCLUSION_RATE)
+                person->occlusion = OCCLUSION_STEPS;
+        }
+
+        // one frame per camera, 16 people each
+        for (int first = 0; first < people; first += MAX_FRAME_BODIES)
+        {
+            frame.frameNumber = (uint32_t)step + 1;
+            frame.timestampUsec = t;
+            frame.bodyCount = 0;
+            for (int p = first; p < people && p < first + MAX_FRAME_BODIES; p++)
+            {
+                struct Person* person = &people_state[p];
+                if (person->dropout > 0)
+                    continue;
+                uint32_t b = frame.bodyCount++;
+                frame.bodyIds[b] = (uint32_t)p + 1;
+                person_joints(person, t, frame.positions[b]);
+                for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+                    frame.confidence[b][j] = CONFIDENCE_MEDIUM;
+                if (person->occlusion > 0)
+                {
+                    frame.confidence[b][JOINT_HAND_RIGHT] = CONFIDENCE_NONE;
+                    frame.confidence[b][JOINT_HANDTIP_RIGHT] = CONFIDENCE_NONE;
+                }
+            }
+            bodies += frame.bodyCount;
+
+            int64_t start = monotonic_usec();
+            gesture_engine_update(&engine, &frame);
+            total_usec += monotonic_usec() - start;
+            updates++;
+
+            expected_count = 0;
+            ref_update(people);
+            int count = gesture_engine_take_events(&engine, got, GESTURE_MAX_EVENTS);
+            for (int i = 0; i < count; i++)
+            {
+                for (int g = 0; g < engine.gestureCount; g++)
+                    starts[g] += got[i].type == GESTURE_START && got[i].id == engine.gestures[g].id;
+            }
+            qsort(got, (size_t)count, sizeof(got[0]), compare_events);
+            qsort(expected, (size_t)expected_count, sizeof(expected[0]), compare_events);
+            bool same = count == expected_count;
+            for (int i = 0; same && i < count; i++)
+                same = compare_events(&got[i], &expected[i]) == 0;
+            mismatches += !same;
+            events += (uint64_t)count;
+            event_datagrams += (uint64_t)(count + SKP_MAX_GESTURE_EVENTS - 1) / SKP_MAX_GESTURE_EVENTS;
+        }
+    }
+
+    int64_t p99 = latency_stats_percentile(&engine.updateTime, 0.99);
+    double seconds = (double)steps * STEP_USEC * 1e-6;
+    double event_bytes = (double)(event_datagrams * (SKP_COMMON_HEADER_SIZE + 1) + events * SKP_GESTURE_EVENT_SIZE);
+    double pose_bytes = (double)bodies * (double)skp_encoded_body_size(SKP_QUANTIZED, SKELETON_JOINT_COUNT);
+    printf("%d gestures, %d conditions, %d people, %llu updates\n", engine.gestureCount, engine.conditionCount,
+           people, (unsigned long long)updates);
+    printf("events: %llu, %llu dropped, %llu updates differing from the reference\n", (unsigned long long)events,
+           (unsigned long long)engine.dropped, (unsigned long long)mismatches);
+    printf("starts per gesture:");
+    bool every = true;
+    for (int g = 0; g < engine.gestureCount; g++)
+    {
+        printf(" %u:%llu", engine.gestures[g].id, (unsigned long long)starts[g]);
+        every &= starts[g] > 0;
+    }
+    printf("\n");
+    printf("update time: mean %.1f us, p99 %lld us, max %lld us\n", (double)total_usec / (double)updates,
+           (long long)p99, (long long)engine.updateTime.max);
+    printf("per person: events %.1f bytes/s, quantized poses %.0f bytes/s (%.0fx)\n",
+           event_bytes / seconds / people, pose_bytes / seconds / people, pose_bytes / event_bytes);
+
+    bool ok = mismatches == 0 && engine.dropped == 0 && every && p99 < MAX_P99_USEC;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
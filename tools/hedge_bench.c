@@ -0,0 +1,124 @@
+/**==============================================
+ * @description : measures the Marvelmind receiver (marvelmind.c) against the
+ *  hedge simulator: parser throughput, CPU per datagram and datagram loss.
+ *  Usage: hedge_bench [options], see hedge_sim_common.h
+ *  e.g.   hedge_bench --only --rate imu_raw=20000 --line-rate 0 --duration 5
+ *=============================================**/
+
+#include <time.h>
+#include <unistd.h>
+#include "hedge_sim_common.h"
+#include "../marvelmind.h"
+
+static volatile uint64_t received_total;
+static volatile uint64_t received_positions;
+static volatile uint64_t received_raw_imu;
+static volatile uint64_t received_fusion_imu;
+
+static void on_any_packet(void)
+{
+    received_total++;
+}
+
+static void on_position(struct PositionValue position)
+{
+    (void)position;
+    received_positions++;
+}
+
+static void on_raw_imu(struct RawIMUValue raw)
+{
+    (void)raw;
+    received_raw_imu++;
+}
+
+static void on_fusion_imu(struct FusionIMUValue fusion)
+{
+    (void)fusion;
+    received_fusion_imu++;
+}
+
+static double process_cpu_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char** argv)
+{
+    struct HedgeSimConfig config;
+    struct HedgeSim sim;
+
+    hedge_sim_default_config(&config);
+    config.durationSec = 5.0;
+    if (hedge_sim_parse_args(argc, argv, &config) < 0)
+        return 1;
+    if (config.durationSec <= 0.0)
+        config.durationSec = 5.0;
+
+    if (!hedge_sim_open(&sim, &config))
+        return 1;
+
+    struct MarvelmindHedge* hedge = createMarvelmindHedge();
+    if (hedge == NULL)
+        return 1;
+    hedge->ttyFileName = sim.slaveName;
+    hedge->baudRate = 115200;
+    hedge->anyInputPacketCallback = on_any_packet;
+    hedge->receiveDataCallback = on_position;
+    hedge->receiveRawIMUCallback = on_raw_imu;
+    hedge->receiveFusionIMUCallback = on_fusion_imu;
+    startMarvelmindHedge(hedge);
+    usleep(200000);// let the receiver open and configure the port
+    if (hedge->terminationRequired)
+    {
+        printf("Receiver could not open %s\n", sim.slaveName);
+        return 1;
+    }
+
+    double cpu_start = process_cpu_sec();
+    hedge_sim_start(&sim);
+    while (!sim.finished)
+        usleep(10000);
+    hedge_sim_stop(&sim);
+
+    // drain whatever is still queued in the pty
+    uint64_t last;
+    do
+    {
+        last = received_total;
+        usleep(200000);
+    } while (received_total != last);
+    double parser_cpu = process_cpu_sec() - cpu_start - sim.stats.cpuSec;
+
+    stopMarvelmindHedge(hedge);
+    destroyMarvelmindHedge(hedge);
+
+    uint64_t sent = hedge_sim_total_sent(&sim.stats);
+    uint64_t received = received_total;
+    double elapsed = sim.stats.elapsedSec;
+    uint64_t lost = sent > received ? sent - received : 0;
+    uint64_t offered = sent + sim.stats.dropped;
+    double loss = sent ? 100.0 * (double)lost / (double)sent : 0.0;
+    double overall_loss = offered ? 100.0 * (double)(lost + sim.stats.dropped) / (double)offered : 0.0;
+
+    printf("Simulated %.2f s on %s\n", elapsed, sim.slaveName);
+    for (int k = 0; k < HEDGE_SIM_KIND_COUNT; k++)
+        if (sim.stats.sent[k])
+            printf("  %-18s sent %llu\n", hedge_sim_kind_name((enum HedgeSimKind)k),
+                   (unsigned long long)sim.stats.sent[k]);
+    printf("  corrupted (expected rejects) %llu, dropped at pty %llu\n",
+           (unsigned long long)sim.stats.corrupted, (unsigned long long)sim.stats.dropped);
+    printf("Received %llu of %llu intact datagrams (positions %llu, raw IMU %llu, fusion IMU %llu)\n",
+           (unsigned long long)received, (unsigned long long)sent, (unsigned long long)received_positions,
+           (unsigned long long)received_raw_imu, (unsigned long long)received_fusion_imu);
+    printf("Throughput: %.0f datagrams/s, %.0f bytes/s\n",
+           received / elapsed, sim.stats.bytes / elapsed);
+    printf("Parser CPU: %.3f s total, %.2f us per datagram\n",
+           parser_cpu, received ? parser_cpu * 1e6 / received : 0.0);
+    printf("Datagram loss: %.3f %% of written, %.3f %% including pty overruns\n", loss, overall_loss);
+
+    hedge_sim_close(&sim);
+    return 0;
+}
@@ -0,0 +1,419 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <termios.h>
+#include "hedge_sim.h"
+#include "../marvelmind.h"
+
+static const char* kind_names[HEDGE_SIM_KIND_COUNT] = {
+    "position", "position_highres", "beacons", "beacons_highres",
+    "imu_raw", "imu_fusion", "raw_distances", "telemetry", "quality"
+};
+
+const char* hedge_sim_kind_name(enum HedgeSimKind kind)
+{
+    return kind_names[kind];
+}
+
+int hedge_sim_kind_from_name(const char* name)
+{
+    for (int i = 0; i < HEDGE_SIM_KIND_COUNT; i++)
+        if (strcmp(name, kind_names[i]) == 0)
+            return i;
+    return -1;
+}
+
+void hedge_sim_default_config(struct HedgeSimConfig* config)
+{
+    memset(config, 0, sizeof(*config));
+    // typical hedge output: 16 Hz positions, 100 Hz IMU, slow housekeeping
+    config->rates[HEDGE_SIM_POSITION_HIGHRES] = 16.0;
+    config->rates[HEDGE_SIM_BEACONS_HIGHRES] = 1.0;
+    config->rates[HEDGE_SIM_IMU_RAW] = 100.0;
+    config->rates[HEDGE_SIM_IMU_FUSION] = 100.0;
+    config->rates[HEDGE_SIM_RAW_DISTANCES] = 16.0;
+    config->rates[HEDGE_SIM_TELEMETRY] = 1.0;
+    config->rates[HEDGE_SIM_QUALITY] = 1.0;
+    config->lineRate = 115200 / 10;
+    config->burstLength = 64;
+    config->seed = 1;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Datagram construction
+//////////////////////////////////////////////////////////////////////////////
+
+// CRC (Modbus), same polynomial as the receiver
+static uint16_t crc16_modbus(const uint8_t* buf, int len)
+{
+    uint16_t crc = 0xFFFF;
+    for (int pos = 0; pos < len; pos++)
+    {
+        crc ^= buf[pos];
+        for (int i = 8; i != 0; i--)
+            crc = (crc & 1) ? (uint16_t)((crc >> 1) ^ 0xA001) : (uint16_t)(crc >> 1);
+    }
+    return crc;
+}
+
+static void put16(uint8_t* p, int32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t* p, int32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static int finish(uint8_t* out, uint16_t id, int payload)
+{
+    out[0] = 0xff;
+    out[1] = 0x47;
+    put16(&out[2], id);
+    out[4] = (uint8_t)payload;
+    uint16_t crc = crc16_modbus(out, 5 + payload);
+    put16(&out[5 + payload], crc);
+    return 7 + payload;
+}
+
+int hedge_sim_build_datagram(enum HedgeSimKind kind, uint32_t seq, uint8_t* out)
+{
+    // hedge walking a 3 m circle, timestamps in ms at 100 Hz ticks
+    double t = seq * 0.01;
+    int32_t x = (int32_t)(3000.0 * cos(0.3 * t));
+    int32_t y = (int32_t)(3000.0 * sin(0.3 * t));
+    int32_t z = 1500;
+    uint32_t ts = seq * 10;
+    uint8_t* d = &out[5];
+    int n;
+
+    memset(out, 0, HEDGE_SIM_MAX_DATAGRAM);
+    switch (kind)
+    {
+    case HEDGE_SIM_POSITION:
+        put32(&d[0], (int32_t)ts);
+        put16(&d[4], x / 10);
+        put16(&d[6], y / 10);
+        put16(&d[8], z / 10);
+        d[11] = 9;// address
+        put16(&d[12], (int32_t)(seq % 3600));
+        return finish(out, POSITION_DATAGRAM_ID, 0x10);
+    case HEDGE_SIM_POSITION_HIGHRES:
+        put32(&d[0], (int32_t)ts);
+        put32(&d[4], x);
+        put32(&d[8], y);
+        put32(&d[12], z);
+        d[17] = 9;
+        put16(&d[18], (int32_t)(seq % 3600));
+        return finish(out, POSITION_DATAGRAM_HIGHRES_ID, 0x16);
+    case HEDGE_SIM_BEACONS:
+        n = 4;
+        d[0] = (uint8_t)n;
+        for (int i = 0; i < n; i++)
+        {
+            uint8_t* b = &d[1 + i * 8];
+            b[0] = (uint8_t)(1 + i);
+            put16(&b[1], (i & 1) ? 600 : -600);
+            put16(&b[3], (i & 2) ? 600 : -600);
+            put16(&b[5], 250);
+        }
+        return finish(out, BEACONS_POSITIONS_DATAGRAM_ID, 1 + n * 8);
+    case HEDGE_SIM_BEACONS_HIGHRES:
+        n = 4;
+        d[0] = (uint8_t)n;
+        for (int i = 0; i < n; i++)
+        {
+            uint8_t* b = &d[1 + i * 14];
+            b[0] = (uint8_t)(1 + i);
+            put32(&b[1], (i & 1) ? 6000 : -6000);
+            put32(&b[5], (i & 2) ? 6000 : -6000);
+            put32(&b[9], 2500);
+        }
+        return finish(out, BEACONS_POSITIONS_DATAGRAM_HIGHRES_ID, 1 + n * 14);
+    case HEDGE_SIM_IMU_RAW:
+        put16(&d[0], (int32_t)(30 * sin(t)));
+        put16(&d[2], (int32_t)(30 * cos(t)));
+        put16(&d[4], 1000);// 1 g, 1 mg/LSB
+        put16(&d[6], 0);
+        put16(&d[8], 0);
+        put16(&d[10], (int32_t)(0.3 * 57.29578 / 0.0175));// yaw rate of the circle
+        put16(&d[12], 200);
+        put16(&d[14], -50);
+        put16(&d[16], 400);
+        put32(&d[24], (int32_t)ts);
+        return finish(out, IMU_RAW_DATAGRAM_ID, 0x20);
+    case HEDGE_SIM_IMU_FUSION:
+    {
+        double yaw = 0.3 * t + 1.5707963;
+        put32(&d[0], x);
+        put32(&d[4], y);
+        put32(&d[8], z);
+        put16(&d[12], (int32_t)(10000 * cos(0.5 * yaw)));
+        put16(&d[14], 0);
+        put16(&d[16], 0);
+        put16(&d[18], (int32_t)(10000 * sin(0.5 * yaw)));
+        put16(&d[20], (int32_t)(-900.0 * sin(0.3 * t)));
+        put16(&d[22], (int32_t)(900.0 * cos(0.3 * t)));
+        put16(&d[24], 0);
+        put16(&d[26], -x * 9 / 100);
+        put16(&d[28], -y * 9 / 100);
+        put16(&d[30], 0);
+        put32(&d[34], (int32_t)ts);
+        return finish(out, IMU_FUSION_DATAGRAM_ID, 0x2a);
+    }
+    case HEDGE_SIM_RAW_DISTANCES:
+        d[0] = 9;
+        for (int i = 0; i < 4; i++)
+        {
+            d[1 + i * 6] = (uint8_t)(1 + i);
+            put32(&d[2 + i * 6], 4000 + 100 * i + (int32_t)(seq % 50));
+        }
+        put32(&d[25], (int32_t)ts);
+        put16(&d[29], 12);
+        return finish(out, BEACON_RAW_DISTANCE_DATAGRAM_ID, 0x20);
+    case HEDGE_SIM_TELEMETRY:
+        put16(&d[0], 3900 - (int32_t)(seq % 100));
+        d[2] = (uint8_t)(int8_t)-60;
+        return finish(out, TELEMETRY_DATAGRAM_ID, 0x10);
+    case HEDGE_SIM_QUALITY:
+        d[0] = 9;
+        d[1] = (uint8_t)(90 + seq % 10);
+        return finish(out, QUALITY_DATAGRAM_ID, 0x10);
+    default:
+        return 0;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Pseudo-terminal
+//////////////////////////////////////////////////////////////////////////////
+
+bool hedge_sim_open(struct HedgeSim* sim, const struct HedgeSimConfig* config)
+{
+    memset(sim, 0, sizeof(*sim));
+    sim->masterFd = -1;
+    sim->slaveFd = -1;
+    if (config)
+        sim->config = *config;
+    else
+        hedge_sim_default_config(&sim->config);
+    if (sim->config.burstLength == 0)
+        sim->config.burstLength = 1;
+
+    sim->masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (sim->masterFd < 0 || grantpt(sim->masterFd) != 0 || unlockpt(sim->masterFd) != 0)
+    {
+        perror("hedge_sim: unable to create pty");
+        hedge_sim_close(sim);
+        return false;
+    }
+    if (ptsname_r(sim->masterFd, sim->slaveName, sizeof(sim->slaveName)) != 0)
+    {
+        perror("hedge_sim: ptsname");
+        hedge_sim_close(sim);
+        return false;
+    }
+
+    // raw mode before anything reaches the line discipline, so no byte is
+    // echoed or translated even before the receiver configures the port
+    sim->slaveFd = open(sim->slaveName, O_RDWR | O_NOCTTY);
+    if (sim->slaveFd >= 0)
+    {
+        struct termios tio;
+        if (tcgetattr(sim->slaveFd, &tio) == 0)
+        {
+            cfmakeraw(&tio);
+            tcsetattr(sim->slaveFd, TCSANOW, &tio);
+        }
+    }
+
+    // a full pty buffer drops datagrams like a UART overrun would
+    fcntl(sim->masterFd, F_SETFL, fcntl(sim->masterFd, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+void hedge_sim_close(struct HedgeSim* sim)
+{
+    if (sim->running)
+        hedge_sim_stop(sim);
+    if (sim->slaveFd >= 0)
+        close(sim->slaveFd);
+    if (sim->masterFd >= 0)
+        close(sim->masterFd);
+    sim->slaveFd = -1;
+    sim->masterFd = -1;
+}
+
+uint64_t hedge_sim_total_sent(const struct HedgeSimStats* stats)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < HEDGE_SIM_KIND_COUNT; i++)
+        total += stats->sent[i];
+    return total;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Emitter thread
+//////////////////////////////////////////////////////////////////////////////
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double t)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)t;
+    ts.tv_nsec = (long)((t - (double)ts.tv_sec) * 1e9);
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+static uint32_t next_random(uint32_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static double random01(uint32_t* state)
+{
+    return next_random(state) / 4294967296.0;
+}
+
+// Write a whole datagram or nothing; returns false when the pty is full
+static bool write_datagram(struct HedgeSim* sim, const uint8_t* buf, int len)
+{
+    int done = 0;
+    while (done < len)
+    {
+        ssize_t n = write(sim->masterFd, buf + done, len - done);
+        if (n > 0)
+        {
+            done += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (done == 0 || sim->stopRequested)
+            return false;
+        // partially written: the tail has to follow or the stream desyncs
+        usleep(50);
+    }
+    sim->stats.bytes += len;
+    return true;
+}
+
+static void* emitter_thread(void* param)
+{
+    struct HedgeSim* sim = (struct HedgeSim*)param;
+    const struct HedgeSimConfig* cfg = &sim->config;
+    uint32_t rnd = cfg->seed ? cfg->seed : 1;
+    uint32_t seq[HEDGE_SIM_KIND_COUNT] = { 0 };
+    double due[HEDGE_SIM_KIND_COUNT];
+    uint8_t dgram[HEDGE_SIM_MAX_DATAGRAM + 8];
+    double start = now_sec();
+    double line_time = start;
+
+    for (int k = 0; k < HEDGE_SIM_KIND_COUNT; k++)
+        due[k] = start;
+
+    while (!sim->stopRequested)
+    {
+        double now = now_sec();
+        if (cfg->durationSec > 0.0 && now - start >= cfg->durationSec)
+            break;
+
+        // emit up to burstLength overdue datagrams, earliest first
+        uint32_t emitted = 0;
+        while (emitted < cfg->burstLength)
+        {
+            int k_next = -1;
+            for (int k = 0; k < HEDGE_SIM_KIND_COUNT; k++)
+                if (cfg->rates[k] > 0.0 && due[k] <= now && (k_next < 0 || due[k] < due[k_next]))
+                    k_next = k;
+            if (k_next < 0)
+                break;
+
+            int len = hedge_sim_build_datagram((enum HedgeSimKind)k_next, seq[k_next]++, dgram);
+            due[k_next] += 1.0 / cfg->rates[k_next];
+
+            bool corrupt = random01(&rnd) < cfg->corruptFraction;
+            if (corrupt)
+                dgram[5 + next_random(&rnd) % (len - 5)] ^= (uint8_t)(1 + next_random(&rnd) % 255);
+            if (random01(&rnd) < cfg->garbageFraction)
+            {
+                int extra = 1 + next_random(&rnd) % 8;
+                for (int i = 0; i < extra; i++)
+                    dgram[len + i] = (uint8_t)next_random(&rnd);
+                len += extra;
+            }
+
+            if (!write_datagram(sim, dgram, len))
+                sim->stats.dropped++;
+            else if (corrupt)
+                sim->stats.corrupted++;
+            else
+                sim->stats.sent[k_next]++;
+            emitted++;
+
+            if (cfg->lineRate > 0)
+            {
+                // pace to the emulated baud rate
+                line_time += (double)len / cfg->lineRate;
+                if (line_time < now - 0.1)
+                    line_time = now - 0.1;
+                sleep_until(line_time);
+                now = now_sec();
+            }
+        }
+
+        if (emitted == 0)
+        {
+            double next = 1e30;
+            for (int k = 0; k < HEDGE_SIM_KIND_COUNT; k++)
+                if (cfg->rates[k] > 0.0 && due[k] < next)
+                    next = due[k];
+            if (next > now + 0.05)
+                next = now + 0.05;
+            sleep_until(next);
+        }
+    }
+
+    struct timespec cpu;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    sim->stats.cpuSec = cpu.tv_sec + cpu.tv_nsec * 1e-9;
+    sim->stats.elapsedSec = now_sec() - start;
+    sim->finished = true;
+    return NULL;
+}
+
+void hedge_sim_start(struct HedgeSim* sim)
+{
+    sim->stopRequested = false;
+    sim->finished = false;
+    sim->running = pthread_create(&sim->thread_, NULL, emitter_thread, sim) == 0;
+}
+
+void hedge_sim_stop(struct HedgeSim* sim)
+{
+    if (!sim->running)
+        return;
+    sim->stopRequested = true;
+    pthread_join(sim->thread_, NULL);
+    sim->running = false;
+}
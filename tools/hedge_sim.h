@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+// Marvelmind hedge simulator (Linux only). Opens a pseudo-terminal whose slave
+// side behaves like the hedge's serial port and streams datagrams with valid
+// CRCs at configurable rates, so marvelmind.c can run without hardware.
+
+enum HedgeSimKind
+{
+    HEDGE_SIM_POSITION,
+    HEDGE_SIM_POSITION_HIGHRES,
+    HEDGE_SIM_BEACONS,
+    HEDGE_SIM_BEACONS_HIGHRES,
+    HEDGE_SIM_IMU_RAW,
+    HEDGE_SIM_IMU_FUSION,
+    HEDGE_SIM_RAW_DISTANCES,
+    HEDGE_SIM_TELEMETRY,
+    HEDGE_SIM_QUALITY,
+    HEDGE_SIM_KIND_COUNT
+};
+
+#define HEDGE_SIM_MAX_DATAGRAM 256
+
+struct HedgeSimConfig
+{
+// datagrams per second for each kind (0 disables the kind)
+    double rates[HEDGE_SIM_KIND_COUNT];
+
+// emulated line rate in bytes per second; 0 writes as fast as the schedule
+// allows (bursts far beyond any real baud rate)
+    uint32_t lineRate;
+
+// datagrams written back-to-back in one write() when the schedule is behind
+    uint32_t burstLength;
+
+// fraction of datagrams with one byte flipped (CRC must reject them)
+    double corruptFraction;
+
+// fraction of datagrams followed by a few random garbage bytes
+    double garbageFraction;
+
+// stop after this many seconds (0 runs until hedge_sim_stop)
+    double durationSec;
+
+    uint32_t seed;
+};
+
+struct HedgeSimStats
+{
+    uint64_t sent[HEDGE_SIM_KIND_COUNT];// intact datagrams fully written
+    uint64_t corrupted;                 // datagrams sent with a flipped byte
+    uint64_t dropped;                   // datagrams not written: pty buffer full
+    uint64_t bytes;
+    double cpuSec;                      // CPU used by the simulator thread
+    double elapsedSec;
+};
+
+struct HedgeSim
+{
+    struct HedgeSimConfig config;
+    struct HedgeSimStats stats;
+
+    int masterFd;
+    int slaveFd;// kept open so the pty survives reopening by the reader
+    char slaveName[128];
+
+    pthread_t thread_;
+    volatile bool stopRequested;
+    volatile bool finished;
+    bool running;
+};
+
+void hedge_sim_default_config(struct HedgeSimConfig* config);
+const char* hedge_sim_kind_name(enum HedgeSimKind kind);
+int hedge_sim_kind_from_name(const char* name);
+
+// Build one datagram of the given kind into out (HEDGE_SIM_MAX_DATAGRAM bytes)
+// and return its length. seq drives the simulated motion and timestamps.
+int hedge_sim_build_datagram(enum HedgeSimKind kind, uint32_t seq, uint8_t* out);
+
+// Open the pty; the slave path is available in sim->slaveName afterwards
+bool hedge_sim_open(struct HedgeSim* sim, const struct HedgeSimConfig* config);
+void hedge_sim_start(struct HedgeSim* sim);
+void hedge_sim_stop(struct HedgeSim* sim);
+void hedge_sim_close(struct HedgeSim* sim);
+uint64_t hedge_sim_total_sent(const struct HedgeSimStats* stats);
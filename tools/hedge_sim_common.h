@@ -0,0 +1,69 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hedge_sim.h"
+
+// Command line options shared by hedge_sim and hedge_bench:
+//   --rate <kind>=<per second>   (kinds: position, position_highres, beacons,
+//                                 beacons_highres, imu_raw, imu_fusion,
+//                                 raw_distances, telemetry, quality)
+//   --only                       zero all default rates before --rate options
+//   --line-rate <bytes/s>        0 = unlimited bursts
+//   --burst <datagrams>
+//   --corrupt <fraction>
+//   --garbage <fraction>
+//   --duration <seconds>
+//   --seed <n>
+// Returns the index of the first unparsed argument or -1 on error.
+static int hedge_sim_parse_args(int argc, char** argv, struct HedgeSimConfig* config)
+{
+    int i;
+    for (i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--only") == 0)
+        {
+            memset(config->rates, 0, sizeof(config->rates));
+            continue;
+        }
+        if (strncmp(arg, "--", 2) != 0)
+            break;
+        if (val == NULL)
+        {
+            printf("Missing value for %s\n", arg);
+            return -1;
+        }
+        i++;
+        if (strcmp(arg, "--rate") == 0)
+        {
+            char name[64];
+            double rate;
+            if (sscanf(val, "%63[^=]=%lf", name, &rate) != 2 || hedge_sim_kind_from_name(name) < 0)
+            {
+                printf("Bad rate '%s'\n", val);
+                return -1;
+            }
+            config->rates[hedge_sim_kind_from_name(name)] = rate;
+        }
+        else if (strcmp(arg, "--line-rate") == 0)
+            config->lineRate = (uint32_t)strtoul(val, NULL, 10);
+        else if (strcmp(arg, "--burst") == 0)
+            config->burstLength = (uint32_t)strtoul(val, NULL, 10);
+        else if (strcmp(arg, "--corrupt") == 0)
+            config->corruptFraction = atof(val);
+        else if (strcmp(arg, "--garbage") == 0)
+            config->garbageFraction = atof(val);
+        else if (strcmp(arg, "--duration") == 0)
+            config->durationSec = atof(val);
+        else if (strcmp(arg, "--seed") == 0)
+            config->seed = (uint32_t)strtoul(val, NULL, 10);
+        else
+        {
+            printf("Unknown option %s\n", arg);
+            return -1;
+        }
+    }
+    return i;
+}
@@ -0,0 +1,46 @@
+/**==============================================
+ * @description : Marvelmind hedge simulator. Prints the pty to pass to the
+ *  tracking app (or any hedge client) and streams datagrams until ctr+c.
+ *  Usage: hedge_sim [options], see hedge_sim_common.h
+ *=============================================**/
+
+#include <signal.h>
+#include <unistd.h>
+#include "hedge_sim_common.h"
+
+volatile sig_atomic_t stop;
+void inthand(int signum) {
+    stop = 1;
+}
+
+int main(int argc, char** argv)
+{
+    struct HedgeSimConfig config;
+    struct HedgeSim sim;
+
+    hedge_sim_default_config(&config);
+    if (hedge_sim_parse_args(argc, argv, &config) < 0)
+        return 1;
+
+    signal(SIGINT, inthand);
+    if (!hedge_sim_open(&sim, &config))
+        return 1;
+    printf("Simulated hedge on %s\n", sim.slaveName);
+    fflush(stdout);
+
+    hedge_sim_start(&sim);
+    while (!stop && !sim.finished)
+        usleep(100000);
+    hedge_sim_stop(&sim);
+
+    for (int k = 0; k < HEDGE_SIM_KIND_COUNT; k++)
+        if (sim.stats.sent[k])
+            printf("%-18s %llu\n", hedge_sim_kind_name((enum HedgeSimKind)k),
+                   (unsigned long long)sim.stats.sent[k]);
+    printf("corrupted %llu, dropped %llu, %llu bytes in %.1f s\n",
+           (unsigned long long)sim.stats.corrupted, (unsigned long long)sim.stats.dropped,
+           (unsigned long long)sim.stats.bytes, sim.stats.elapsedSec);
+
+    hedge_sim_close(&sim);
+    return 0;
+}
@@ -0,0 +1,128 @@
+#include <string.h>
+#include "loss_relay.h"
+
+#define RELAY_MAX_DATAGRAM 65536
+#define RELAY_POLL_USEC 20000
+
+void loss_relay_default_config(struct LossRelayConfig* config)
+{
+    config->lossRate = 0.02;
+    config->burstLength = 1.0;
+    config->seed = 1;
+}
+
+// xorshift32, uniform in [0, 1)
+static double next_uniform(struct LossRelay* relay)
+{
+    uint32_t x = relay->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    relay->random = x;
+    return (double)x / 4294967296.0;
+}
+
+// Advance the two-state link model by one datagram; true = drop it
+static bool link_drops(struct LossRelay* relay)
+{
+    double loss = relay->config.lossRate;
+    double burst = relay->config.burstLength < 1.0 ? 1.0 : relay->config.burstLength;
+    if (loss <= 0.0)
+        return false;
+    if (loss >= 1.0)
+        return true;
+
+    if (relay->bad)
+        relay->bad = next_uniform(relay) >= 1.0 / burst;
+    else
+    {
+        // enter a burst often enough that the stationary loss is lossRate
+        relay->bad = next_uniform(relay) < loss / (burst * (1.0 - loss));
+        if (relay->bad)
+            relay->stats.bursts++;
+    }
+    return relay->bad;
+}
+
+bool loss_relay_open(struct LossRelay* relay, const struct LossRelayConfig* config, uint16_t listen_port,
+                     const char* target_host, uint16_t target_port)
+{
+    memset(relay, 0, sizeof(*relay));
+    relay->config = *config;
+    relay->random = config->seed != 0 ? config->seed : 1;
+
+    memset(&relay->target, 0, sizeof(relay->target));
+    relay->target.sin_family = AF_INET;
+    relay->target.sin_port = htons(target_port);
+    if (inet_pton(AF_INET, target_host, &relay->target.sin_addr) != 1)
+        return false;
+
+    relay->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (relay->socket == INVALID_SOCKET)
+        return false;
+    int buffer_size = 4 * 1024 * 1024;
+    setsockopt(relay->socket, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer_size, sizeof(buffer_size));
+
+    SOCKADDR_IN a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(listen_port);
+    a.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(relay->socket, (struct sockaddr*)&a, sizeof(a)) != 0)
+    {
+        closesocket(relay->socket);
+        return false;
+    }
+
+#ifdef WIN32
+    DWORD timeout = RELAY_POLL_USEC / 1000;
+#else
+    struct timeval timeout = { 0, RELAY_POLL_USEC };
+#endif
+    setsockopt(relay->socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    return true;
+}
+
+static PLATFORM_THREAD_RETURN relay_thread(void* param)
+{
+    struct LossRelay* relay = (struct LossRelay*)param;
+    static uint8_t buffer[RELAY_MAX_DATAGRAM];
+
+    while (!relay->stopRequested)
+    {
+        int size = (int)recv(relay->socket, (char*)buffer, sizeof(buffer), 0);
+        if (size <= 0)
+            continue;// poll timeout
+
+        relay->stats.received++;
+        if (link_drops(relay))
+        {
+            relay->stats.dropped++;
+            continue;
+        }
+        sendto(relay->socket, (const char*)buffer, size, 0, (struct sockaddr*)&relay->target, sizeof(relay->target));
+        relay->stats.forwarded++;
+    }
+    return PLATFORM_THREAD_RESULT;
+}
+
+void loss_relay_start(struct LossRelay* relay)
+{
+    relay->stopRequested = false;
+    relay->running = platform_thread_create(&relay->thread_, relay_thread, relay);
+}
+
+void loss_relay_stop(struct LossRelay* relay)
+{
+    if (!relay->running)
+        return;
+    relay->stopRequested = true;
+    platform_thread_join(relay->thread_);
+    relay->running = false;
+}
+
+void loss_relay_close(struct LossRelay* relay)
+{
+    loss_relay_stop(relay);
+    closesocket(relay->socket);
+}
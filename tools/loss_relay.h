@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "../net.h"
+#include "../platform.h"
+
+// Loss-injecting UDP relay. Receives datagrams on a local port and forwards
+// them to one target, dropping some on the way like a lossy Wi-Fi link.
+//
+// Losses follow a two-state (Gilbert) model: the link drops every datagram
+// while in the bad state and stays there burstLength datagrams on average.
+// burstLength 1 gives independent losses; the long-run loss rate is lossRate
+// either way.
+
+struct LossRelayConfig
+{
+    double lossRate;   // fraction of datagrams dropped, 0..1
+    double burstLength;// mean datagrams per loss burst, >= 1
+    uint32_t seed;
+};
+
+struct LossRelayStats
+{
+    uint64_t received;
+    uint64_t forwarded;
+    uint64_t dropped;
+    uint64_t bursts;
+};
+
+struct LossRelay
+{
+    struct LossRelayConfig config;
+    struct LossRelayStats stats;
+
+    SOCKET socket;
+    SOCKADDR_IN target;
+    uint32_t random;
+    bool bad;// in a loss burst
+
+    platform_thread_t thread_;
+    volatile bool stopRequested;
+    bool running;
+};
+
+void loss_relay_default_config(struct LossRelayConfig* config);
+
+// Bind listen_port on all interfaces and resolve the target
+bool loss_relay_open(struct LossRelay* relay, const struct LossRelayConfig* config, uint16_t listen_port,
+                     const char* target_host, uint16_t target_port);
+void loss_relay_start(struct LossRelay* relay);
+void loss_relay_stop(struct LossRelay* relay);
+void loss_relay_close(struct LossRelay* relay);
@@ -0,0 +1,75 @@
+/**==============================================
+ * @description : lossy link between the tracking app and a receiver. Forwards
+ *  UDP datagrams from a local port to a target, dropping loss% of them in
+ *  bursts of the given mean length, and prints the counters every second.
+ *  Usage: loss_relay <listen port> <target ip>:<port> [loss%=2] [burst=1] [seed=1]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "loss_relay.h"
+
+static volatile sig_atomic_t stop;
+
+static void inthand(int signum)
+{
+    (void)signum;
+    stop = 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        printf("Usage: loss_relay <listen port> <target ip>:<port> [loss%%=2] [burst=1] [seed=1]\n");
+        return 1;
+    }
+
+    char target[64];
+    strncpy(target, argv[2], sizeof(target) - 1);
+    target[sizeof(target) - 1] = '\0';
+    char* colon = strrchr(target, ':');
+    if (colon == NULL)
+    {
+        printf("Target must be <ip>:<port>\n");
+        return 1;
+    }
+    *colon = '\0';
+
+    struct LossRelayConfig config;
+    loss_relay_default_config(&config);
+    if (argc > 3)
+        config.lossRate = atof(argv[3]) / 100.0;
+    if (argc > 4)
+        config.burstLength = atof(argv[4]);
+    if (argc > 5)
+        config.seed = (uint32_t)strtoul(argv[5], NULL, 10);
+
+    net_startup();
+    static struct LossRelay relay;
+    if (!loss_relay_open(&relay, &config, (uint16_t)atoi(argv[1]), target, (uint16_t)atoi(colon + 1)))
+    {
+        printf("Can not relay port %s to %s\n", argv[1], argv[2]);
+        return 1;
+    }
+    printf("Relaying port %s to %s:%s, %.1f%% loss in bursts of %.1f\n", argv[1], target, colon + 1,
+           config.lossRate * 100.0, config.burstLength);
+    signal(SIGINT, inthand);
+    loss_relay_start(&relay);
+
+    struct LossRelayStats last = relay.stats;
+    while (!stop)
+    {
+        platform_sleep_usec(1000000);
+        struct LossRelayStats now = relay.stats;
+        printf("received %llu, forwarded %llu, dropped %llu in %llu bursts\n",
+               (unsigned long long)(now.received - last.received), (unsigned long long)(now.forwarded - last.forwarded),
+               (unsigned long long)(now.dropped - last.dropped), (unsigned long long)(now.bursts - last.bursts));
+        last = now;
+    }
+    loss_relay_close(&relay);
+    net_cleanup();
+    return 0;
+}
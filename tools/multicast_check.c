@@ -0,0 +1,169 @@
+/**==============================================
+ * @description : verifies multicast output on one host. Publishes binary
+ *  skeleton frames to a group with udp_sender.c and receives them on several
+ *  local sockets that joined the group; every receiver checks the datagram
+ *  sequence numbers independently.
+ *  Usage: multicast_check [group=239.255.42.1] [port=9050] [receivers=4]
+ *                         [frames=3000] [interface=127.0.0.1]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include "../udp_sender.h"
+#include "../protocol.h"
+#include "../skp_stream.h"
+
+#define MAX_RECEIVERS 16
+#define BODIES 3
+
+struct Receiver
+{
+    SOCKET socket;
+    uint64_t received;
+    uint64_t lost;      // sequence numbers skipped
+    uint64_t reordered; // sequence numbers older than the newest
+    uint32_t expected;
+    bool started;
+};
+
+static struct SkeletonFrame frame;
+static struct DatagramBatch batch;
+
+static bool open_receiver(struct Receiver* r, const char* group, uint16_t port, const char* interface_address)
+{
+    memset(r, 0, sizeof(*r));
+    r->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (r->socket == INVALID_SOCKET)
+        return false;
+
+    // all receivers share the group port like separate nodes would
+    int on = 1;
+    setsockopt(r->socket, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+    int buffer_size = 4 * 1024 * 1024;
+    setsockopt(r->socket, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer_size, sizeof(buffer_size));
+
+    SOCKADDR_IN a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(port);
+    a.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(r->socket, (struct sockaddr*)&a, sizeof(a)) != 0)
+        return false;
+
+    struct ip_mreq membership;
+    inet_pton(AF_INET, group, &membership.imr_multiaddr);
+    inet_pton(AF_INET, interface_address, &membership.imr_interface);
+    if (setsockopt(r->socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&membership, sizeof(membership)) != 0)
+        return false;
+
+    fcntl(r->socket, F_SETFL, fcntl(r->socket, F_GETFL) | O_NONBLOCK);
+    return true;
+}
+
+static void drain(struct Receiver* r)
+{
+    uint8_t buffer[SKP_MAX_DATAGRAM];
+    for (;;)
+    {
+        ssize_t size = recv(r->socket, buffer, sizeof(buffer), 0);
+        if (size < SKP_COMMON_HEADER_SIZE || skp_get_u16(buffer) != SKP_MAGIC)
+            return;
+
+        uint32_t sequence = skp_get_u32(buffer + SKP_SEQUENCE_OFFSET);
+        r->received++;
+        if (!r->started)
+        {
+            r->started = true;
+            r->expected = sequence + 1;
+        }
+        else if ((int32_t)(sequence - r->expected) >= 0)
+        {
+            r->lost += sequence - r->expected;
+            r->expected = sequence + 1;
+        }
+        else
+        {
+            r->reordered++;
+            if (r->lost > 0)
+                r->lost--;// arrived late, not lost
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    const char* group = argc > 1 ? argv[1] : "239.255.42.1";
+    uint16_t port = (uint16_t)(argc > 2 ? atoi(argv[2]) : 9050);
+    int receiver_count = argc > 3 ? atoi(argv[3]) : 4;
+    int frames = argc > 4 ? atoi(argv[4]) : 3000;
+    const char* interface_address = argc > 5 ? argv[5] : "127.0.0.1";
+    if (receiver_count < 1 || receiver_count > MAX_RECEIVERS)
+        receiver_count = 4;
+
+    static struct Receiver receivers[MAX_RECEIVERS];
+    for (int i = 0; i < receiver_count; i++)
+    {
+        if (!open_receiver(&receivers[i], group, port, interface_address))
+        {
+            printf("Receiver %d can not join %s on %s: error %d\n", i, group, interface_address, socket_error());
+            return 1;
+        }
+    }
+
+    static struct UdpSender sender;
+    if (!udp_sender_open(&sender) || !udp_sender_add_destination(&sender, group, port) ||
+        !udp_sender_set_multicast(&sender, 1, interface_address, true))
+    {
+        printf("Can not set up the multicast sender: error %d\n", socket_error());
+        return 1;
+    }
+    static struct SkpStreamEncoder stream;
+    skp_stream_encoder_init(&stream, 0);
+    sender.prepare = skp_stream_prepare;
+    sender.prepareContext = &stream;
+
+    frame.bodyCount = BODIES;
+    for (uint32_t b = 0; b < BODIES; b++)
+    {
+        frame.bodyIds[b] = b + 1;
+        frame.slots[b] = (uint8_t)b;
+    }
+
+    int64_t start = monotonic_usec();
+    for (int f = 0; f < frames; f++)
+    {
+        frame.frameNumber = (uint32_t)f;
+        datagram_batch_clear(&batch);
+        for (uint32_t b = 0; b < BODIES; b++)
+        {
+            uint8_t* buffer = datagram_batch_reserve(&batch, SKP_MAX_DATAGRAM);
+            datagram_batch_commit(&batch, skp_write_body(&frame, b, SKP_LOCAL_ROTATIONS, buffer, SKP_MAX_DATAGRAM));
+        }
+        udp_sender_send(&sender, &batch);
+        for (int i = 0; i < receiver_count; i++)
+            drain(&receivers[i]);
+    }
+    platform_sleep_usec(50000);
+    for (int i = 0; i < receiver_count; i++)
+        drain(&receivers[i]);
+    double elapsed = (double)(monotonic_usec() - start) / 1e6;
+
+    uint64_t sent = (uint64_t)frames * BODIES;
+    bool ok = sender.destinations[0].errors == 0;
+    printf("%llu datagrams sent to %s:%u in %.2f s, %llu send errors\n",
+           (unsigned long long)sent, group, port, elapsed, (unsigned long long)sender.destinations[0].errors);
+    for (int i = 0; i < receiver_count; i++)
+    {
+        struct Receiver* r = &receivers[i];
+        printf("receiver %d: %llu received, %llu lost, %llu reordered\n", i,
+               (unsigned long long)r->received, (unsigned long long)r->lost, (unsigned long long)r->reordered);
+        if (r->received + r->lost < sent || r->received == 0)
+            ok = false;
+        closesocket(r->socket);
+    }
+    udp_sender_close(&sender);
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,310 @@
+/**==============================================
+ * @description : rejection of tracker glitches (outlier_filter.h) on
+ *  synthetic dancers with tracker noise and now and then a joint out of
+ *  range. Glitches of one to three frames are injected as k4abt makes them:
+ *  a limb snapped to another direction about its shoulder or hip, a single
+ *  joint jumping away, and a wrist or ankle stretched along its bone. Nine
+ *  in ten glitched joints must come out within GLITCH_MAX_MM of where the
+ *  dancer is, clean joints must almost never be touched, joints out of
+ *  range must pass as they are, and a dancer found again elsewhere must
+ *  start over instead of being held. Every fourth dancer has its hands and
+ *  feet occluded, only ever at LOW confidence, so their bones are never
+ *  learned; they must still follow the dancer, also after a glitch (these
+ *  dancers snap and jump but do not stretch: without a length, a stretch
+ *  can not be told from a turn). A 16-body frame on one core must take
+ *  under 20 us per body (median).
+ *  Usage: outlier_bench [frames=3000]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../outlier_filter.h"
+#include "../latency_stats.h"
+#include "dancer_sim.h"
+
+#define STEP_USEC 33333
+#define WARMUP_FRAMES 60
+#define NOISE_MM 6.0f
+#define GLITCH_RATE 0.02f       // per body and frame
+#define OUT_OF_RANGE_RATE 0.005f// per joint and frame
+#define GLITCH_MAX_MM 60.0f
+#define MAX_FALSE_RATE 0.002    // clean joints touched
+#define MIN_FIXED 0.9
+#define MIN_OCCLUDED_FOLLOWED 0.99// clean occluded joints within GLITCH_MAX_MM
+#define MAX_BODY_MEDIAN_USEC 20
+
+enum GlitchType
+{
+    GLITCH_SNAP,
+    GLITCH_JUMP,
+    GLITCH_STRETCH,
+    GLITCH_TYPES
+};
+static const char* glitch_names[GLITCH_TYPES] = { "snapped limb", "jumping joint", "stretched bone" };
+
+struct Glitch
+{
+    int type;
+    int frames;// left, 0 = none
+    int joint;
+    vec3_t direction;// snap: turned across the limb to the axis; jump: of the offset
+    float amount;    // snap: angle, rad; jump: mm; stretch: relative
+};
+
+struct GlitchScore
+{
+    uint64_t joints;
+    uint64_t fixed;
+    double rawError;
+    double error;
+};
+
+static const int occluded_joints[] = { JOINT_WRIST_LEFT,  JOINT_HAND_LEFT,  JOINT_HANDTIP_LEFT,  JOINT_THUMB_LEFT,
+                                       JOINT_WRIST_RIGHT, JOINT_HAND_RIGHT, JOINT_HANDTIP_RIGHT, JOINT_THUMB_RIGHT,
+                                       JOINT_ANKLE_LEFT,  JOINT_FOOT_LEFT,  JOINT_ANKLE_RIGHT,   JOINT_FOOT_RIGHT };
+#define OCCLUDED_JOINTS (int)(sizeof(occluded_joints) / sizeof(occluded_joints[0]))
+
+static float distance(vec3_t a, vec3_t b)
+{
+    return vec3_length(vec3_sub(a, b));
+}
+
+static vec3_t random_direction(void)
+{
+    vec3_t v;
+    do
+        v = vec3_make(random_range(-1.0f, 1.0f), random_range(-1.0f, 1.0f), random_range(-1.0f, 1.0f));
+    while (vec3_length(v) < 0.1f || vec3_length(v) > 1.0f);
+    return vec3_scale(v, 1.0f / vec3_length(v));
+}
+
+static bool descends(int j, int root)
+{
+    for (; j >= 0; j = skeleton_joint_parent[j])
+    {
+        if (j == root)
+            return true;
+    }
+    return false;
+}
+
+static void start_glitch(struct Glitch* g, bool occluded)
+{
+    static const int limbs[] = { JOINT_SHOULDER_LEFT, JOINT_SHOULDER_RIGHT, JOINT_HIP_LEFT, JOINT_HIP_RIGHT,
+                                 JOINT_ELBOW_LEFT, JOINT_ELBOW_RIGHT, JOINT_KNEE_LEFT, JOINT_KNEE_RIGHT };
+    static const int jumpers[] = { JOINT_ELBOW_LEFT, JOINT_WRIST_LEFT, JOINT_HAND_LEFT, JOINT_ELBOW_RIGHT,
+                                   JOINT_WRIST_RIGHT, JOINT_HAND_RIGHT, JOINT_KNEE_LEFT, JOINT_ANKLE_LEFT,
+                                   JOINT_FOOT_LEFT, JOINT_KNEE_RIGHT, JOINT_ANKLE_RIGHT, JOINT_FOOT_RIGHT,
+                                   JOINT_HEAD };
+    static const int stretched[] = { JOINT_WRIST_LEFT, JOINT_WRIST_RIGHT, JOINT_ANKLE_LEFT, JOINT_ANKLE_RIGHT };
+    int types = occluded ? GLITCH_STRETCH : GLITCH_TYPES;
+    g->type = (int)(random_unit() * types) % types;
+    g->frames = 1 + (int)(random_unit() * 3.0f) % 3;
+    switch (g->type)
+    {
+    case GLITCH_SNAP:
+        g->joint = limbs[(int)(random_unit() * 8.0f) % 8];
+        g->direction = random_direction();
+        g->amount = random_range(1.2f, 2.6f);
+        break;
+    case GLITCH_JUMP:
+        g->joint = jumpers[(int)(random_unit() * 13.0f) % 13];
+        g->direction = random_direction();
+        g->amount = random_range(200.0f, 400.0f);
+        break;
+    default:
+        g->joint = stretched[(int)(random_unit() * 4.0f) % 4];
+        g->amount = random_range(0.35f, 0.6f);
+        break;
+    }
+}
+
+// Glitch the tracked joints; glitched marks the joints it moved
+static void apply_glitch(const struct Glitch* g, vec3_t* joints, bool* glitched)
+{
+    if (g->type == GLITCH_SNAP)
+    {
+        // the limb below the joint turns about it, rigidly, about an axis
+        // across its first bone
+        vec3_t root = joints[g->joint];
+        vec3_t axis = vec3_cross(g->direction, vec3_sub(joints[g->joint + 1], root));
+        quat_t q = quat_from_rotvec(vec3_scale(axis, g->amount / vec3_length(axis)));
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            if (j == g->joint || !descends(j, g->joint))
+                continue;
+            joints[j] = vec3_add(root, quat_rotate(q, vec3_sub(joints[j], root)));
+            glitched[j] = true;
+        }
+    }
+    else if (g->type == GLITCH_JUMP)
+    {
+        joints[g->joint] = vec3_add(joints[g->joint], vec3_scale(g->direction, g->amount));
+        glitched[g->joint] = true;
+    }
+    else
+    {
+        vec3_t from = joints[skeleton_joint_parent[g->joint]];
+        joints[g->joint] = vec3_add(from, vec3_scale(vec3_sub(joints[g->joint], from), 1.0f + g->amount));
+        glitched[g->joint] = true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int frames = argc > 1 ? atoi(argv[1]) : 3000;
+    if (frames < 2 * WARMUP_FRAMES)
+    {
+        printf("Usage: outlier_bench [frames=3000]\n");
+        return 1;
+    }
+
+    static struct OutlierFilter filter;
+    outlier_filter_init(&filter, NULL);
+    struct Dancer dancers[MAX_FRAME_BODIES];
+    struct Glitch glitches[MAX_FRAME_BODIES];
+    for (int b = 0; b < MAX_FRAME_BODIES; b++)
+    {
+        dancer_start(&dancers[b]);
+        glitches[b].frames = 0;
+    }
+
+    static struct SkeletonFrame frame;
+    struct LatencyStats frame_time;
+    latency_stats_init(&frame_time, "frame of 16 bodies");
+    struct GlitchScore scores[GLITCH_TYPES];
+    memset(scores, 0, sizeof(scores));
+    uint64_t clean_joints = 0, clean_touched = 0, out_of_range = 0, out_of_range_moved = 0;
+    uint64_t occluded = 0, occluded_followed = 0;
+    int found_again = frames / 2;
+    bool restarted = false;
+    int64_t now_usec = 1000000;
+    for (int n = 0; n < frames; n++)
+    {
+        frame.bodyCount = MAX_FRAME_BODIES;
+        frame.frameNumber = (uint32_t)n;
+        frame.timestampUsec = now_usec += STEP_USEC;
+        vec3_t truth[MAX_FRAME_BODIES][SKELETON_JOINT_COUNT];
+        bool glitched[MAX_FRAME_BODIES][SKELETON_JOINT_COUNT];
+        memset(glitched, 0, sizeof(glitched));
+        for (int b = 0; b < MAX_FRAME_BODIES; b++)
+        {
+            if (n == found_again && b == 0)
+                dancers[b].position = vec3_add(dancers[b].position, vec3_make(2000.0f, 0.0f, 0.0f));
+            dancer_step(&dancers[b]);
+            dancer_joints(&dancers[b], truth[b]);
+            frame.bodyIds[b] = 100u + (uint32_t)b;
+            frame.slots[b] = (uint8_t)b;
+            for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+            {
+                vec3_t noise = vec3_make(random_range(-NOISE_MM, NOISE_MM), random_range(-NOISE_MM, NOISE_MM),
+                                         random_range(-NOISE_MM, NOISE_MM));
+                frame.positions[b][j] = vec3_add(truth[b][j], noise);
+                frame.worldRotations[b][j] = quat_identity();
+                frame.confidence[b][j] = CONFIDENCE_MEDIUM;
+            }
+            if (b % 4 == 3)
+            {
+                for (int i = 0; i < OCCLUDED_JOINTS; i++)
+                    frame.confidence[b][occluded_joints[i]] = CONFIDENCE_LOW;
+            }
+
+            struct Glitch* g = &glitches[b];
+            if (g->frames == 0 && n >= WARMUP_FRAMES && n != found_again && random_unit() < GLITCH_RATE)
+                start_glitch(g, b % 4 == 3);
+            if (g->frames > 0)
+            {
+                apply_glitch(g, frame.positions[b], glitched[b]);
+                g->frames--;
+            }
+
+            // joints out of range are anywhere
+            for (int j = 1; j < SKELETON_JOINT_COUNT; j++)
+            {
+                if (random_unit() < OUT_OF_RANGE_RATE)
+                {
+                    frame.confidence[b][j] = CONFIDENCE_NONE;
+                    frame.positions[b][j] = vec3_make(random_range(-5000.0f, 5000.0f),
+                                                      random_range(-5000.0f, 5000.0f), 0.0f);
+                    glitched[b][j] = false;
+                }
+            }
+        }
+
+        static struct SkeletonFrame input;
+        memcpy(&input, &frame, sizeof(frame));
+        int64_t start = monotonic_usec();
+        outlier_filter_update(&filter, &frame);
+        latency_stats_add(&frame_time, monotonic_usec() - start);
+
+        if (n == found_again)
+            restarted = filter.reset[0] && filter.rejected[0] == 0 && filter.repaired[0] == 0;
+        if (n < WARMUP_FRAMES)
+            continue;
+        for (int b = 0; b < MAX_FRAME_BODIES; b++)
+        {
+            bool any = false;
+            for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+                any = any || glitched[b][j];
+            for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+            {
+                float moved = distance(frame.positions[b][j], input.positions[b][j]);
+                if (input.confidence[b][j] == CONFIDENCE_NONE)
+                {
+                    out_of_range++;
+                    out_of_range_moved += moved > 0.0f;
+                }
+                else if (glitched[b][j])
+                {
+                    struct GlitchScore* s = &scores[glitches[b].type];
+                    float error = distance(frame.positions[b][j], truth[b][j]);
+                    s->joints++;
+                    s->fixed += error < GLITCH_MAX_MM;
+                    s->rawError += distance(input.positions[b][j], truth[b][j]);
+                    s->error += error;
+                }
+                else
+                {
+                    if (input.confidence[b][j] == CONFIDENCE_LOW)
+                    {
+                        occluded++;
+                        occluded_followed += distance(frame.positions[b][j], truth[b][j]) < GLITCH_MAX_MM;
+                    }
+                    if (!any && j > 0)
+                    {
+                        clean_joints++;
+                        clean_touched += moved > 0.0f;
+                    }
+                }
+            }
+        }
+    }
+
+    latency_stats_print(&frame_time);
+    double per_body = (double)latency_stats_percentile(&frame_time, 0.5) / MAX_FRAME_BODIES;
+    bool ok = true;
+    for (int t = 0; t < GLITCH_TYPES; t++)
+    {
+        const struct GlitchScore* s = &scores[t];
+        double fixed = s->joints > 0 ? (double)s->fixed / s->joints : 0.0;
+        printf("%s: %llu joints, %.1f%% within %.0f mm, mean error %.1f mm (%.1f mm unfiltered)\n", glitch_names[t],
+               (unsigned long long)s->joints, 100.0 * fixed, GLITCH_MAX_MM, s->joints > 0 ? s->error / s->joints : 0.0,
+               s->joints > 0 ? s->rawError / s->joints : 0.0);
+        ok = ok && fixed >= MIN_FIXED;
+    }
+    double false_rate = clean_joints > 0 ? (double)clean_touched / clean_joints : 1.0;
+    printf("clean joints touched %.3f%% of %llu, out of range moved %llu of %llu, found again: %s\n",
+           100.0 * false_rate, (unsigned long long)clean_joints, (unsigned long long)out_of_range_moved,
+           (unsigned long long)out_of_range, restarted ? "started over" : "held");
+    double followed = occluded > 0 ? (double)occluded_followed / occluded : 0.0;
+    printf("occluded joints %.2f%% within %.0f mm of %llu\n", 100.0 * followed, GLITCH_MAX_MM,
+           (unsigned long long)occluded);
+    printf("median %.2f us per body\n", per_body);
+
+    ok = ok && false_rate < MAX_FALSE_RATE && out_of_range_moved == 0 && restarted &&
+         followed >= MIN_OCCLUDED_FOLLOWED && per_body < MAX_BODY_MEDIAN_USEC;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
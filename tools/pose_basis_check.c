@@ -0,0 +1,260 @@
+/**==============================================
+ * @description : pose basis coding (the pca encoding) on synthetic dancers.
+ *  A basis is learned from the performances of one set of dancers in two
+ *  accumulators, merged, saved and loaded back; frames of other dancers are
+ *  then coded with the first k components and decoded by a receiver that
+ *  loaded the same file. The components must be orthonormal, a damaged
+ *  file must not load, the decoded joints must be within the error the
+ *  sender reports, most bodies must fit the error threshold, a pose the
+ *  basis does not span must be refused (the sender falls back to a
+ *  quantized body), and receivers without the basis or with another one
+ *  must drop the bodies instead of decoding them.
+ *  Usage: pose_basis_check [k=24] [max error mm=50] [training poses=60000]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../pose_basis.h"
+#include "../protocol.h"
+#include "../skp_receiver.h"
+#include "../latency_stats.h"
+#include "../platform.h"
+#include "dancer_sim.h"
+
+#define CLIP_FRAMES 600
+#define LIVE_FRAMES 300
+#define MAX_FALLBACK_SHARE 0.1
+#define QUANTIZATION_SLACK_MM 1.0f// origin and heading rounding on top of the reported error
+#define BASIS_PATH "pose_basis_check.basis"
+
+struct Decoded
+{
+    bool delivered;
+    struct SkeletonFrame frame;
+    struct SkpFrameInfo info;
+};
+
+static void on_frame(const struct SkeletonFrame* frame, const struct SkpFrameInfo* info, void* context)
+{
+    struct Decoded* d = (struct Decoded*)context;
+    d->delivered = true;
+    d->frame = *frame;
+    d->info = *info;
+}
+
+// Poses of clips clip_count dancers perform, alternately into two sums
+static void learn_poses(struct PoseBasisAccumulator* acc, int clip_count)
+{
+    for (int c = 0; c < clip_count; c++)
+    {
+        struct Dancer d;
+        dancer_start(&d);
+        for (int f = 0; f < CLIP_FRAMES; f++)
+        {
+            dancer_step(&d);
+            vec3_t joints[SKELETON_JOINT_COUNT];
+            dancer_joints(&d, joints);
+            float pose[POSE_BASIS_DIMS];
+            vec3_t origin;
+            float heading;
+            if (pose_basis_split(joints, NULL, pose, &origin, &heading))
+                pose_basis_accumulate(&acc[f % 2], pose);
+        }
+    }
+}
+
+static float orthonormality_error(const struct PoseBasis* basis)
+{
+    float worst = 0.0f;
+    for (int a = 0; a < basis->components; a++)
+    {
+        for (int b = a; b < basis->components; b++)
+        {
+            float dot = 0.0f;
+            for (int i = 0; i < POSE_BASIS_DIMS; i++)
+                dot += basis->vectors[a][i] * basis->vectors[b][i];
+            float e = fabsf(dot - (a == b ? 1.0f : 0.0f));
+            worst = e > worst ? e : worst;
+        }
+    }
+    return worst;
+}
+
+static bool damaged_file_loads(void)
+{
+    FILE* f = fopen(BASIS_PATH, "r+b");
+    if (f == NULL)
+        return true;
+    fseek(f, (long)sizeof(struct PoseBasisHeader) + 40, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, (long)sizeof(struct PoseBasisHeader) + 40, SEEK_SET);
+    fputc(c ^ 0x10, f);
+    fclose(f);
+    struct PoseBasis damaged;
+    return pose_basis_load(&damaged, BASIS_PATH);
+}
+
+static void dancer_frame(struct Dancer* dancers, uint32_t number, struct SkeletonFrame* frame)
+{
+    frame->frameNumber = number;
+    frame->timestampUsec = (int64_t)number * 33333;
+    frame->bodyCount = MAX_FRAME_BODIES;
+    for (uint32_t b = 0; b < MAX_FRAME_BODIES; b++)
+    {
+        dancer_step(&dancers[b]);
+        dancer_joints(&dancers[b], frame->positions[b]);
+        frame->bodyIds[b] = 100 + b;
+        frame->slots[b] = (uint8_t)b;
+        frame->cameraPositions[b] = vec3_make(0.0f, 0.0f, 0.0f);
+        memset(frame->confidence[b], CONFIDENCE_MEDIUM, SKELETON_JOINT_COUNT);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int k = argc > 1 ? atoi(argv[1]) : 24;
+    float max_error = argc > 2 ? (float)atof(argv[2]) : 50.0f;
+    int training = argc > 3 ? atoi(argv[3]) : 60000;
+    if (k < 1 || k > POSE_BASIS_MAX_COMPONENTS || !(max_error > 0.0f) || training < CLIP_FRAMES)
+    {
+        printf("Usage: pose_basis_check [k=24] [max error mm=50] [training poses=60000]\n");
+        return 1;
+    }
+    bool pass = true;
+
+    // Learn, save and load
+    static struct PoseBasisAccumulator acc[2];
+    pose_basis_accumulator_init(&acc[0]);
+    pose_basis_accumulator_init(&acc[1]);
+    int64_t start = monotonic_usec();
+    learn_poses(acc, training / CLIP_FRAMES);
+    pose_basis_accumulator_merge(&acc[0], &acc[1]);
+    static struct PoseBasis learned, basis, other;
+    if (!pose_basis_learn(&acc[0], POSE_BASIS_MAX_COMPONENTS, &learned) || !pose_basis_save(&learned, BASIS_PATH) ||
+        !pose_basis_load(&basis, BASIS_PATH))
+    {
+        printf("Can not learn, save or load the basis\nFAIL\n");
+        return 1;
+    }
+    printf("learned %08x from %llu poses in %.2f s: %d components explain %.4f of the variance, %d explain %.4f\n",
+           basis.basisId, (unsigned long long)basis.samples, (monotonic_usec() - start) / 1e6, k,
+           pose_basis_explained(&acc[0], &basis, k), basis.components,
+           pose_basis_explained(&acc[0], &basis, basis.components));
+    float ortho = orthonormality_error(&basis);
+    bool same = memcmp(&learned, &basis, sizeof(basis)) == 0;
+    bool damaged = damaged_file_loads();
+    remove(BASIS_PATH);
+    printf("orthonormality error %.2g, loaded %s the learned basis, damaged file %s\n", ortho,
+           same ? "equals" : "differs from", damaged ? "loads" : "is refused");
+    pass = pass && ortho < 1e-4f && same && !damaged;
+
+    // Live frames through a receiver with the basis, one without any and one
+    // with a basis learned from other poses
+    pose_basis_learn(&acc[1], k, &other);
+    static struct SkpReceiver receiver, bare, stranger;
+    static struct Decoded decoded, bare_decoded, stranger_decoded;
+    skp_receiver_init(&receiver, on_frame, NULL, &decoded);
+    skp_receiver_init(&bare, on_frame, NULL, &bare_decoded);
+    skp_receiver_init(&stranger, on_frame, NULL, &stranger_decoded);
+    receiver.basis = &basis;
+    stranger.basis = &other;
+
+    static struct Dancer dancers[MAX_FRAME_BODIES];
+    for (int b = 0; b < MAX_FRAME_BODIES; b++)
+        dancer_start(&dancers[b]);
+    struct LatencyStats error_stats, encode_time;
+    latency_stats_init(&error_stats, "pca error");
+    error_stats.unit = "um";
+    latency_stats_init(&encode_time, "encode per frame");
+    uint64_t bodies = 0, fallbacks = 0, bytes = 0, delivered = 0;
+    float worst_beyond = 0.0f, worst_info = 0.0f;
+    static struct SkeletonFrame frame;
+    static uint8_t buffers[MAX_FRAME_BODIES][SKP_MAX_DATAGRAM];
+    for (uint32_t n = 1; n <= LIVE_FRAMES; n++)
+    {
+        dancer_frame(dancers, n, &frame);
+        size_t sizes[MAX_FRAME_BODIES];
+        float errors[MAX_FRAME_BODIES];
+        float frame_error = 0.0f;
+        int64_t t0 = monotonic_usec();
+        for (uint32_t b = 0; b < frame.bodyCount; b++)
+        {
+            sizes[b] = skp_write_pca_body(&frame, b, b, frame.bodyCount, &basis, k, max_error, &errors[b],
+                                          buffers[b], SKP_MAX_DATAGRAM);
+            if (sizes[b] == 0)
+            {
+                fallbacks++;
+                errors[b] = 0.1f;// quantized
+                sizes[b] = skp_write_body_encoded(&frame, b, b, frame.bodyCount, SKP_QUANTIZED, SKP_ALL_JOINTS,
+                                                  NULL, buffers[b], SKP_MAX_DATAGRAM);
+            }
+            else
+                frame_error = errors[b] > frame_error ? errors[b] : frame_error;
+        }
+        latency_stats_add(&encode_time, monotonic_usec() - t0);
+        latency_stats_add(&error_stats, (int64_t)(frame_error * 1000.0f));
+
+        decoded.delivered = false;
+        for (uint32_t b = 0; b < frame.bodyCount; b++)
+        {
+            skp_put_u32(buffers[b] + SKP_SEQUENCE_OFFSET, (uint32_t)bodies);// as the sender stamps it
+            bodies++;
+            bytes += sizes[b];
+            skp_receiver_push(&receiver, buffers[b], sizes[b], (int64_t)n * 33333);
+            skp_receiver_push(&bare, buffers[b], sizes[b], (int64_t)n * 33333);
+            skp_receiver_push(&stranger, buffers[b], sizes[b], (int64_t)n * 33333);
+        }
+        if (!decoded.delivered || decoded.frame.bodyCount != frame.bodyCount)
+            continue;
+        delivered++;
+        float info_off = fabsf(decoded.info.pcaErrorMm - frame_error);
+        worst_info = info_off > worst_info ? info_off : worst_info;
+        for (uint32_t b = 0; b < frame.bodyCount; b++)
+        {
+            float body_error = 0.0f;
+            for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+            {
+                float e = vec3_length(vec3_sub(decoded.frame.positions[b][j], frame.positions[b][j]));
+                body_error = e > body_error ? e : body_error;
+            }
+            float beyond = body_error - errors[b];
+            worst_beyond = beyond > worst_beyond ? beyond : worst_beyond;
+        }
+    }
+    double fallback_share = (double)fallbacks / (double)bodies;
+    printf("%llu bodies, %.1f bytes each (positions only: quantized %zu, core delta %zu), %.3f sent quantized\n",
+           (unsigned long long)bodies, (double)bytes / (double)bodies, skp_body_size(SKP_QUANTIZED),
+           skp_encoded_body_size(SKP_QUANTIZED | SKP_DELTA | SKP_JOINT_SUBSET, 23), fallback_share);
+    latency_stats_print(&error_stats);
+    latency_stats_print(&encode_time);
+    printf("%llu of %d frames decoded, joints at most %.2f mm beyond the body's error, frame error %.2f mm off\n",
+           (unsigned long long)delivered, LIVE_FRAMES, worst_beyond, worst_info);
+    pass = pass && delivered == LIVE_FRAMES && worst_beyond <= QUANTIZATION_SLACK_MM && worst_info <= 0.1f &&
+           fallback_share <= MAX_FALLBACK_SHARE;
+
+    // A pose off the learned space is refused
+    dancer_frame(dancers, LIVE_FRAMES + 1, &frame);
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        frame.positions[0][j] = vec3_add(frame.positions[0][j], vec3_make(0.0f, 0.0f, (j % 2) ? 300.0f : -300.0f));
+    frame.positions[0][JOINT_PELVIS] = vec3_add(frame.positions[0][JOINT_PELVIS], vec3_make(0.0f, 0.0f, 300.0f));
+    float error;
+    size_t refused = skp_write_pca_body(&frame, 0, 0, 1, &basis, k, max_error, &error, buffers[0], SKP_MAX_DATAGRAM);
+    printf("off-space pose: error %.0f mm, %s\n", error, refused == 0 ? "refused" : "sent");
+    pass = pass && refused == 0;
+
+    printf("receiver without the basis: %llu frames, %llu bodies dropped; with another basis: %llu frames, "
+           "%llu dropped, %llu malformed\n",
+           (unsigned long long)(bare.stats.framesComplete + bare.stats.framesPartial),
+           (unsigned long long)bare.stats.unknownBasis,
+           (unsigned long long)(stranger.stats.framesComplete + stranger.stats.framesPartial),
+           (unsigned long long)stranger.stats.unknownBasis,
+           (unsigned long long)(bare.stats.malformed + stranger.stats.malformed));
+    pass = pass && other.basisId != basis.basisId && bare.stats.unknownBasis == bodies - fallbacks &&
+           stranger.stats.unknownBasis == bodies - fallbacks && bare.stats.malformed == 0 &&
+           stranger.stats.malformed == 0;
+
+    printf("%s\n", pass ? "PASS" : "FAIL");
+    return pass ? 0 : 1;
+}
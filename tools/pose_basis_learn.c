@@ -0,0 +1,220 @@
+/**==============================================
+ * @description : learns the pose basis of the pca encoding (pose_basis.h)
+ *  from skeleton recordings. A recording is a capture of the text stream
+ *  (--format text), as for pose_index_build; every body with all 32 joints
+ *  is one pose. Files are read line by line and each pose is folded into
+ *  the covariance sums of its thread at once, so memory does not grow with
+ *  the recordings. Prints how much of the pose variance the first k
+ *  components explain, to pick --pca-components.
+ *  Usage: pose_basis_learn <out.basis> <clip.txt>... [--components <n>=32]
+ *                          [--every <n>=1] [--threads <n>=cores]
+ *  --every keeps every n-th frame of a recording
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../pose_basis.h"
+#include "../platform.h"
+
+#define MAX_CLIPS 4096
+#define MAX_THREADS 64
+#define LINE_MAX_SIZE 512
+
+struct Clip
+{
+    const char* path;
+    uint64_t bodies;  // bodies seen, complete or not
+    uint64_t poses;
+    uint64_t rejected;// complete bodies without a pose
+    bool failed;
+};
+
+struct LearnState
+{
+    struct Clip* clips;
+    int clipCount;
+    int next;
+    uint32_t every;
+    platform_mutex_t lock;
+};
+
+struct Worker
+{
+    struct LearnState* state;
+    struct PoseBasisAccumulator acc;
+};
+
+// Lines of one body arrive together; a body is a pose once all its joints did
+static void flush_body(struct Worker* w, struct Clip* clip, const vec3_t* joints, uint32_t mask, uint32_t frame)
+{
+    clip->bodies++;
+    if (mask != 0xFFFFFFFFu || frame % w->state->every != 0)
+        return;
+    float pose[POSE_BASIS_DIMS];
+    vec3_t origin;
+    float heading;
+    if (!pose_basis_split(joints, NULL, pose, &origin, &heading))
+    {
+        clip->rejected++;
+        return;
+    }
+    pose_basis_accumulate(&w->acc, pose);
+    clip->poses++;
+}
+
+static void learn_clip(struct Worker* w, struct Clip* clip)
+{
+    FILE* f = fopen(clip->path, "r");
+    if (f == NULL)
+    {
+        clip->failed = true;
+        return;
+    }
+    char line[LINE_MAX_SIZE];
+    vec3_t joints[SKELETON_JOINT_COUNT];
+    uint32_t mask = 0, frame = 0, body = 0;
+    bool open = false;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        unsigned int n, id;
+        int joint;
+        float x, y, z;
+        if (sscanf(line, "Frame: %u, Body ID[%u], Joint[%d]: Position[mm] ( %f, %f, %f );", &n, &id, &joint, &x, &y,
+                   &z) != 6 || joint < 0 || joint >= SKELETON_JOINT_COUNT)
+            continue;
+        if (open && (n != frame || id != body))
+        {
+            flush_body(w, clip, joints, mask, frame);
+            mask = 0;
+        }
+        open = true;
+        frame = n;
+        body = id;
+        joints[joint] = vec3_make(x, y, z);
+        mask |= 1u << joint;
+    }
+    if (open)
+        flush_body(w, clip, joints, mask, frame);
+    fclose(f);
+}
+
+static PLATFORM_THREAD_RETURN learn_worker(void* param)
+{
+    struct Worker* w = (struct Worker*)param;
+    struct LearnState* state = w->state;
+    for (;;)
+    {
+        platform_mutex_lock(&state->lock);
+        int c = state->next++;
+        platform_mutex_unlock(&state->lock);
+        if (c >= state->clipCount)
+            break;
+        learn_clip(w, &state->clips[c]);
+    }
+    return PLATFORM_THREAD_RESULT;
+}
+
+int main(int argc, char** argv)
+{
+    static struct Clip clips[MAX_CLIPS];
+    const char* out_path = NULL;
+    int clip_count = 0, threads = 0, components = POSE_BASIS_MAX_COMPONENTS;
+    uint32_t every = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--components") == 0 && i + 1 < argc)
+            components = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--every") == 0 && i + 1 < argc)
+            every = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (out_path == NULL)
+            out_path = argv[i];
+        else if (clip_count < MAX_CLIPS)
+            clips[clip_count++].path = argv[i];
+    }
+    if (out_path == NULL || clip_count == 0 || every == 0 || components < 1 ||
+        components > POSE_BASIS_MAX_COMPONENTS)
+    {
+        printf("Usage: pose_basis_learn <out.basis> <clip.txt>... [--components <n>=32] [--every <n>=1] "
+               "[--threads <n>=cores]\n");
+        return 1;
+    }
+    if (threads < 1)
+        threads = platform_cpu_count();
+    if (threads > clip_count)
+        threads = clip_count;
+    if (threads > MAX_THREADS)
+        threads = MAX_THREADS;
+
+    int64_t start = monotonic_usec();
+    struct LearnState state;
+    state.clips = clips;
+    state.clipCount = clip_count;
+    state.next = 0;
+    state.every = every;
+    platform_mutex_init(&state.lock);
+    struct Worker* workers = (struct Worker*)malloc((size_t)threads * sizeof(struct Worker));
+    if (workers == NULL)
+    {
+        printf("Not enough memory for %d threads\n", threads);
+        return 1;
+    }
+    for (int t = 0; t < threads; t++)
+    {
+        workers[t].state = &state;
+        pose_basis_accumulator_init(&workers[t].acc);
+    }
+    platform_thread_t handles[MAX_THREADS];
+    int started = 0;
+    for (int t = 1; t < threads; t++)
+    {
+        if (!platform_thread_create(&handles[started], learn_worker, &workers[t]))
+            break;
+        started++;
+    }
+    learn_worker(&workers[0]);
+    for (int t = 0; t < started; t++)
+        platform_thread_join(handles[t]);
+    platform_mutex_destroy(&state.lock);
+    for (int t = 1; t <= started; t++)
+        pose_basis_accumulator_merge(&workers[0].acc, &workers[t].acc);
+    const struct PoseBasisAccumulator* acc = &workers[0].acc;
+
+    for (int c = 0; c < clip_count; c++)
+    {
+        const struct Clip* clip = &clips[c];
+        if (clip->failed)
+        {
+            printf("Can not read %s\n", clip->path);
+            return 1;
+        }
+        printf("%s: %llu bodies, %llu poses, %llu rejected\n", clip->path, (unsigned long long)clip->bodies,
+               (unsigned long long)clip->poses, (unsigned long long)clip->rejected);
+    }
+    int64_t read = monotonic_usec();
+
+    static struct PoseBasis basis;
+    if (!pose_basis_learn(acc, components, &basis))
+    {
+        printf("Not enough poses to learn from\n");
+        return 1;
+    }
+    int64_t learned = monotonic_usec();
+    if (!pose_basis_save(&basis, out_path))
+    {
+        printf("Can not write %s\n", out_path);
+        return 1;
+    }
+
+    printf("components  sigma mm  explained\n");
+    for (int k = 1; k <= basis.components; k++)
+        printf("%10d %9.1f %9.4f\n", k, sqrt(basis.variance[k - 1]), pose_basis_explained(acc, &basis, k));
+    printf("Basis %08x: %d components from %llu poses, read in %.1f s on %d threads, learned in %.2f s -> %s\n",
+           basis.basisId, basis.components, (unsigned long long)basis.samples, (read - start) / 1e6, started + 1,
+           (learned - read) / 1e6, out_path);
+    free(workers);
+    return 0;
+}
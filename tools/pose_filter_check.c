@@ -0,0 +1,204 @@
+/**==============================================
+ * @description : validates the Kinect pose filter against synthetic hedge
+ *  trajectories and measures the cost of each filter step.
+ *  Usage: pose_filter_check [seconds]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include "../platform.h"
+#include "../pose_filter.h"
+
+#define IMU_RATE_HZ 100
+#define POSITION_RATE_HZ 16
+#define ORIENTATION_RATE_HZ 25
+#define QUERY_RATE_HZ 30
+
+#define ACC_NOISE 0.05f
+#define GYRO_NOISE 0.005f
+#define POSITION_NOISE 0.02f
+#define ORIENTATION_NOISE 0.01f
+
+#define MAX_RMS_POSITION_ERROR 0.05f  // m
+#define MAX_RMS_ANGLE_ERROR 0.035f    // rad (~2 deg)
+#define MAX_UPDATE_USEC 10.0
+
+struct Trajectory
+{
+    const char* name;
+    void (*pose)(double t, vec3_t* p, quat_t* q);
+};
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static float uniform01(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (float)((rng_state >> 11) * (1.0 / 9007199254740992.0));
+}
+
+static float gaussian(float sigma)
+{
+    float u1 = uniform01() + 1e-12f;
+    float u2 = uniform01();
+    return sigma * sqrtf(-2.0f * logf(u1)) * cosf(6.2831853f * u2);
+}
+
+static vec3_t noisy3(vec3_t v, float sigma)
+{
+    return vec3_make(v.x + gaussian(sigma), v.y + gaussian(sigma), v.z + gaussian(sigma));
+}
+
+static quat_t yaw_pitch_roll(float yaw, float pitch, float roll)
+{
+    quat_t qz = quat_make(cosf(yaw / 2), 0, 0, sinf(yaw / 2));
+    quat_t qy = quat_make(cosf(pitch / 2), 0, sinf(pitch / 2), 0);
+    quat_t qx = quat_make(cosf(roll / 2), sinf(roll / 2), 0, 0);
+    return quat_mul(qz, quat_mul(qy, qx));
+}
+
+static void static_pose(double t, vec3_t* p, quat_t* q)
+{
+    (void)t;
+    *p = vec3_make(1.0f, 2.0f, 1.5f);
+    *q = yaw_pitch_roll(0.5f, 0.0f, 0.0f);
+}
+
+static void walk_pose(double t, vec3_t* p, quat_t* q)
+{
+    float w = 0.5f;
+    *p = vec3_make(2.0f * cosf(w * t), 2.0f * sinf(w * t), 1.5f + 0.05f * sinf(6.0f * t));
+    *q = yaw_pitch_roll(w * t + 1.5707963f, 0.05f * sinf(3.0f * t), 0.05f * cosf(2.0f * t));
+}
+
+static void handheld_pose(double t, vec3_t* p, quat_t* q)
+{
+    *p = vec3_make(0.3f * sinf(0.7f * t) + 0.05f * sinf(12.0f * t),
+                   0.2f * sinf(0.9f * t),
+                   1.2f + 0.05f * sinf(9.0f * t));
+    *q = yaw_pitch_roll(0.6f * sinf(0.8f * t), 0.1f * sinf(7.0f * t), 0.08f * sinf(5.0f * t));
+}
+
+// Specific force and angular rate in the body frame by central differences
+static void imu_truth(const struct Trajectory* tr, double t, float g, vec3_t* acc, vec3_t* gyro)
+{
+    const double h = 5e-3;
+    vec3_t p0, p1, p2;
+    quat_t q0, q1, q2;
+    tr->pose(t - h, &p0, &q0);
+    tr->pose(t, &p1, &q1);
+    tr->pose(t + h, &p2, &q2);
+
+    vec3_t a = vec3_scale(vec3_add(vec3_sub(p2, vec3_scale(p1, 2.0f)), p0), (float)(1.0 / (h * h)));
+    a.z += g;
+    *acc = quat_rotate(quat_conj(q1), a);
+    *gyro = vec3_scale(quat_to_rotvec(quat_mul(quat_conj(q0), q2)), (float)(1.0 / (2.0 * h)));
+}
+
+static int run(const struct Trajectory* tr, double seconds)
+{
+    struct PoseFilter filter;
+    struct PoseFilterConfig config;
+    pose_filter_default_config(&config);
+    config.mountOffset = vec3_make(0.0f, 0.04f, -0.06f);// camera under the hedge, lens ahead
+    pose_filter_init(&filter, &config);
+
+    vec3_t acc_bias = vec3_make(0.05f, -0.03f, 0.08f);
+    vec3_t gyro_bias = vec3_make(0.002f, -0.001f, 0.003f);
+
+    const int64_t imu_step = 1000000 / IMU_RATE_HZ;
+    const int64_t position_step = 1000000 / POSITION_RATE_HZ;
+    const int64_t orientation_step = 1000000 / ORIENTATION_RATE_HZ;
+    const int64_t query_step = 1000000 / QUERY_RATE_HZ;
+    const int64_t end = (int64_t)(seconds * 1e6);
+    const int64_t warmup = 2000000;
+
+    int64_t next_position = 0, next_orientation = 0, next_query = warmup + 3333;
+    double predict_usec = 0.0, update_usec = 0.0;
+    long predicts = 0, updates = 0, queries = 0;
+    double pos_err2 = 0.0, ang_err2 = 0.0, pos_err_max = 0.0;
+
+    for (int64_t t = 0; t <= end; t += imu_step)
+    {
+        vec3_t p;
+        quat_t q;
+        tr->pose(t * 1e-6, &p, &q);
+
+        if (t >= next_position)
+        {
+            int64_t t0 = monotonic_usec();
+            pose_filter_update_position(&filter, t, noisy3(p, POSITION_NOISE), POSITION_NOISE);
+            update_usec += (double)(monotonic_usec() - t0);
+            updates++;
+            next_position += position_step;
+        }
+        if (t >= next_orientation)
+        {
+            quat_t qn = quat_mul(q, quat_from_rotvec(noisy3(vec3_make(0, 0, 0), ORIENTATION_NOISE)));
+            int64_t t0 = monotonic_usec();
+            pose_filter_update_orientation(&filter, t, qn, ORIENTATION_NOISE);
+            update_usec += (double)(monotonic_usec() - t0);
+            updates++;
+            next_orientation += orientation_step;
+        }
+
+        vec3_t acc, gyro;
+        imu_truth(tr, t * 1e-6, config.gravity, &acc, &gyro);
+        acc = noisy3(vec3_add(acc, acc_bias), ACC_NOISE);
+        gyro = noisy3(vec3_add(gyro, gyro_bias), GYRO_NOISE);
+        int64_t t0 = monotonic_usec();
+        pose_filter_predict(&filter, t, acc, gyro);
+        predict_usec += (double)(monotonic_usec() - t0);
+        predicts++;
+
+        // query between IMU samples, as the tracking loop does
+        while (next_query <= t)
+        {
+            struct CameraPose pose;
+            vec3_t tp;
+            quat_t tq;
+            pose_filter_query(&filter, next_query, &pose);
+            tr->pose(next_query * 1e-6, &tp, &tq);
+            // the camera on its mount
+            tp = vec3_add(tp, quat_rotate(tq, config.mountOffset));
+            tq = quat_mul(tq, config.mountRotation);
+            double e = vec3_length(vec3_sub(pose.position, tp));
+            double a = quat_angle_between(pose.orientation, tq);
+            pos_err2 += e * e;
+            ang_err2 += a * a;
+            if (e > pos_err_max)
+                pos_err_max = e;
+            queries++;
+            next_query += query_step;
+        }
+    }
+
+    double rms_pos = sqrt(pos_err2 / (queries ? queries : 1));
+    double rms_ang = sqrt(ang_err2 / (queries ? queries : 1));
+    double avg_predict = predict_usec / (predicts ? predicts : 1);
+    double avg_update = update_usec / (updates ? updates : 1);
+    bool ok = rms_pos < MAX_RMS_POSITION_ERROR && rms_ang < MAX_RMS_ANGLE_ERROR &&
+              avg_predict < MAX_UPDATE_USEC && avg_update < MAX_UPDATE_USEC;
+
+    printf("%-10s position rms %.4f m (max %.4f), angle rms %.3f deg, predict %.2f us, update %.2f us  %s\n",
+           tr->name, rms_pos, pos_err_max, rms_ang * 57.29578, avg_predict, avg_update, ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 60.0;
+    const struct Trajectory trajectories[] = {
+        { "static", static_pose },
+        { "walk", walk_pose },
+        { "handheld", handheld_pose },
+    };
+
+    int failed = 0;
+    for (size_t i = 0; i < sizeof(trajectories) / sizeof(trajectories[0]); i++)
+        failed += run(&trajectories[i], seconds);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,237 @@
+/**==============================================
+ * @description : pose library search on a synthetic library. Clips of
+ *  dancers with their own height, place and facing move every limb along
+ *  smooth random paths; their poses are indexed on every core, saved and
+ *  mapped back. Live queries are new performances by other dancers. The
+ *  descriptor must not change when a pose is moved, turned or scaled, the
+ *  mapped index must answer exactly as the built one, the nearest pose must
+ *  be the exact nearest for most queries, a file whose graph points out of
+ *  its sections must not open, and a frame of MAX_FRAME_BODIES queries on
+ *  one core must take under a millisecond (median; the tracker spreads the
+ *  bodies of a frame over the task pool on top of that).
+ *  Usage: pose_index_bench [poses=200000] [queries=2000] [ef=64] [threads=cores]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../pose_index.h"
+#include "../latency_stats.h"
+#include "dancer_sim.h"
+
+#define CLIP_FRAMES 600      // 20 s at 30 fps
+#define MIN_RECALL 0.9
+#define MAX_FRAME_MEDIAN_USEC 1000
+#define INDEX_PATH "pose_index_bench.idx"
+#define DAMAGED_PATH "pose_index_bench_damaged.idx"
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks
+
+// Moving, turning and scaling a pose leaves its descriptor alone
+static float invariance_error(void)
+{
+    float worst = 0.0f;
+    for (int i = 0; i < 100; i++)
+    {
+        struct Dancer d;
+        dancer_start(&d);
+        vec3_t a[SKELETON_JOINT_COUNT], b[SKELETON_JOINT_COUNT];
+        dancer_joints(&d, a);
+        d.position = vec3_make(random_range(-4000.0f, 4000.0f), random_range(1000.0f, 6000.0f), 0.0f);
+        d.yaw = random_range(-3.14159f, 3.14159f);
+        d.scale = random_range(0.85f, 1.15f);
+        dancer_joints(&d, b);
+        float da[POSE_DESCRIPTOR_DIMS], db[POSE_DESCRIPTOR_DIMS];
+        if (!pose_descriptor(a, NULL, da) || !pose_descriptor(b, NULL, db))
+            return INFINITY;
+        float e = sqrtf(pose_distance(da, db));
+        worst = e > worst ? e : worst;
+    }
+    return worst;
+}
+
+// Saved with one value broken, the index must not open
+static bool opens_damaged(const struct PoseIndex* built, uint32_t* value, uint32_t broken)
+{
+    uint32_t kept = *value;
+    *value = broken;
+    struct PoseIndex damaged;
+    bool opened = pose_index_save(built, DAMAGED_PATH) && pose_index_open(&damaged, DAMAGED_PATH);
+    if (opened)
+        pose_index_close(&damaged);
+    *value = kept;
+    remove(DAMAGED_PATH);
+    return opened;
+}
+
+// Files whose graph points out of its sections are refused
+static int damaged_opened(struct PoseIndex* built)
+{
+    // a node of the top level other than the entry, and a node of level 0
+    uint32_t upper = built->entry, ground = 0;
+    for (uint32_t i = 0; i < built->count; i++)
+    {
+        if (i != built->entry && built->levels[i] > 0)
+            upper = i;
+        if (built->levels[i] == 0)
+            ground = i;
+    }
+    uint32_t* links = built->upperLinks + built->upperOffsets[upper];
+    uint32_t* entry_links = built->upperLinks + built->upperOffsets[built->entry];
+    int opened = 0;
+    opened += opens_damaged(built, &built->upperOffsets[upper], built->upperSize);
+    opened += opens_damaged(built, &built->labels[ground].clip, built->clipCount);
+    opened += opens_damaged(built, &links[0], POSE_INDEX_M + 1);
+    opened += opens_damaged(built, &links[1], built->count);
+    opened += opens_damaged(built, &entry_links[1], ground);// a level 1 link to a level 0 node
+
+    // the levels are bytes
+    uint8_t kept = built->levels[ground];
+    built->levels[ground] = (uint8_t)(built->maxLevel + 1);
+    struct PoseIndex damaged;
+    if (pose_index_save(built, DAMAGED_PATH) && pose_index_open(&damaged, DAMAGED_PATH))
+    {
+        pose_index_close(&damaged);
+        opened++;
+    }
+    built->levels[ground] = kept;
+    remove(DAMAGED_PATH);
+    return opened;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t count = (uint32_t)(argc > 1 ? strtoul(argv[1], NULL, 10) : 200000);
+    int queries = argc > 2 ? atoi(argv[2]) : 2000;
+    int ef = argc > 3 ? atoi(argv[3]) : POSE_INDEX_DEFAULT_EF;
+    int threads = argc > 4 ? atoi(argv[4]) : 0;
+    if (count < 1000 || queries < MAX_FRAME_BODIES || ef < 1)
+    {
+        printf("Usage: pose_index_bench [poses=200000] [queries=2000] [ef=64] [threads=cores]\n");
+        return 1;
+    }
+
+    float invariance = invariance_error();
+    printf("descriptor change when moved, turned and scaled: %.2g\n", invariance);
+
+    // library
+    uint32_t clips = (count + CLIP_FRAMES - 1) / CLIP_FRAMES;
+    static struct PoseIndex built;
+    if (!pose_index_create(&built, count, clips, 12345u))
+    {
+        printf("Not enough memory\n");
+        return 1;
+    }
+    struct Dancer dancer;
+    vec3_t joints[SKELETON_JOINT_COUNT];
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t clip = i / CLIP_FRAMES, frame = i % CLIP_FRAMES;
+        if (frame == 0)
+        {
+            dancer_start(&dancer);
+            snprintf(built.clipNames[clip], POSE_INDEX_CLIP_NAME, "dance%04u.txt", clip);
+        }
+        else
+            dancer_step(&dancer);
+        dancer_joints(&dancer, joints);
+        if (!pose_descriptor(joints, NULL, built.vectors + (size_t)i * POSE_DESCRIPTOR_DIMS))
+        {
+            printf("degenerate library pose %u\n", i);
+            return 1;
+        }
+        built.labels[i].clip = clip;
+        built.labels[i].frame = frame;
+    }
+    int64_t start = monotonic_usec();
+    if (!pose_index_build(&built, threads, POSE_INDEX_DEFAULT_BUILD_EF))
+    {
+        printf("Not enough memory\n");
+        return 1;
+    }
+    double build_s = (monotonic_usec() - start) / 1e6;
+    if (!pose_index_save(&built, INDEX_PATH))
+    {
+        printf("Can not write %s\n", INDEX_PATH);
+        return 1;
+    }
+    static struct PoseIndex mapped;
+    bool opened = pose_index_open(&mapped, INDEX_PATH);
+    printf("%u poses in %u clips, built in %.1f s on %d threads (%.1f us per pose), top level %d, file %.1f MB\n",
+           count, clips, build_s, threads > 0 ? threads : platform_cpu_count(), build_s * 1e6 / count,
+           built.maxLevel, opened ? mapped.mappingSize / 1e6 : 0.0);
+    if (!opened)
+    {
+        printf("Can not map %s\nFAIL\n", INDEX_PATH);
+        remove(INDEX_PATH);
+        return 1;
+    }
+
+    int damaged = damaged_opened(&built);
+    printf("damaged files opened: %d of 6\n", damaged);
+
+    // live performances by other dancers, a frame of bodies at a time
+    float* descriptors = (float*)malloc((size_t)queries * POSE_DESCRIPTOR_DIMS * sizeof(float));
+    static struct PoseIndexScratch scratch;
+    struct LatencyStats frame_time, query_time;
+    latency_stats_init(&frame_time, "frame of 16 queries");
+    latency_stats_init(&query_time, "query");
+    for (int q = 0; q < queries; q++)
+    {
+        if (q % 300 == 0)
+            dancer_start(&dancer);
+        for (int s = 0; s < 7; s++)
+            dancer_step(&dancer);
+        dancer_joints(&dancer, joints);
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)// tracker noise
+            joints[j] = vec3_add(joints[j], vec3_make(random_range(-10.0f, 10.0f), random_range(-10.0f, 10.0f),
+                                                      random_range(-10.0f, 10.0f)));
+        pose_descriptor(joints, NULL, descriptors + (size_t)q * POSE_DESCRIPTOR_DIMS);
+    }
+
+    int hits = 0, differences = 0;
+    double ratio_sum = 0.0;
+    uint64_t saturated = 0;
+    for (int first = 0; first + MAX_FRAME_BODIES <= queries; first += MAX_FRAME_BODIES)
+    {
+        struct PoseMatch found[MAX_FRAME_BODIES];
+        int64_t frame_start = monotonic_usec();
+        for (int b = 0; b < MAX_FRAME_BODIES; b++)
+        {
+            int64_t t = monotonic_usec();
+            pose_index_search(&mapped, descriptors + (size_t)(first + b) * POSE_DESCRIPTOR_DIMS, 1, ef, &scratch,
+                              &found[b]);
+            latency_stats_add(&query_time, monotonic_usec() - t);
+            saturated += scratch.saturated;
+        }
+        latency_stats_add(&frame_time, monotonic_usec() - frame_start);
+
+        for (int b = 0; b < MAX_FRAME_BODIES; b++)
+        {
+            const float* d = descriptors + (size_t)(first + b) * POSE_DESCRIPTOR_DIMS;
+            struct PoseMatch same, exact;
+            pose_index_search(&built, d, 1, ef, &scratch, &same);
+            pose_index_search_exact(&mapped, d, 1, &exact);
+            differences += same.node != found[b].node;
+            hits += found[b].distance <= exact.distance;
+            ratio_sum += exact.distance > 0.0f ? found[b].distance / exact.distance : 1.0;
+        }
+    }
+    int checked = queries / MAX_FRAME_BODIES * MAX_FRAME_BODIES;
+    double recall = (double)hits / checked;
+    latency_stats_print(&query_time);
+    latency_stats_print(&frame_time);
+    printf("recall@1 %.3f, found / exact distance %.3f, mapped != built %d, saturated %llu (ef %d)\n", recall,
+           ratio_sum / checked, differences, (unsigned long long)saturated, ef);
+
+    int64_t median = latency_stats_percentile(&frame_time, 0.5);
+    bool ok = invariance < 1e-4f && damaged == 0 && differences == 0 && recall >= MIN_RECALL && median < MAX_FRAME_MEDIAN_USEC;
+    free(descriptors);
+    pose_index_close(&mapped);
+    pose_index_close(&built);
+    remove(INDEX_PATH);
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,250 @@
+/**==============================================
+ * @description : builds a pose library index (pose_index.h) from skeleton
+ *  recordings. A recording is a capture of the text stream (--format text,
+ *  e.g. what a UDP listener writes to a file): one clip per file, the poses
+ *  of a clip are its bodies with all 32 joints, labeled with their frame
+ *  numbers. Files are parsed and the graph is built on every core; the
+ *  index file is mapped by body_tracking --pose-index.
+ *  Usage: pose_index_build <out.idx> <clip.txt>... [--every <n>=1]
+ *                          [--ef <n>=128] [--threads <n>=cores]
+ *  --every keeps every n-th frame of a clip
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../pose_index.h"
+
+#define MAX_CLIPS 4096
+#define POSES_GROW 16384
+#define LINE_MAX_SIZE 512
+
+struct Clip
+{
+    const char* path;
+    uint32_t every;
+    float* descriptors;
+    uint32_t* frames;
+    uint32_t count;
+    uint32_t capacity;
+    uint64_t bodies;    // bodies seen, complete or not
+    uint64_t rejected;  // complete bodies without a descriptor
+    bool failed;
+};
+
+struct ParseState
+{
+    struct Clip* clips;
+    int clipCount;
+    int next;
+    platform_mutex_t lock;
+};
+
+static bool add_pose(struct Clip* clip, const float* descriptor, uint32_t frame)
+{
+    if (clip->count == clip->capacity)
+    {
+        uint32_t capacity = clip->capacity + POSES_GROW;
+        float* descriptors = (float*)realloc(clip->descriptors, (size_t)capacity * POSE_DESCRIPTOR_DIMS * sizeof(float));
+        if (descriptors == NULL)
+            return false;
+        clip->descriptors = descriptors;
+        uint32_t* frames = (uint32_t*)realloc(clip->frames, (size_t)capacity * sizeof(uint32_t));
+        if (frames == NULL)
+            return false;
+        clip->frames = frames;
+        clip->capacity = capacity;
+    }
+    memcpy(clip->descriptors + (size_t)clip->count * POSE_DESCRIPTOR_DIMS, descriptor,
+           POSE_DESCRIPTOR_DIMS * sizeof(float));
+    clip->frames[clip->count++] = frame;
+    return true;
+}
+
+// Lines of one body arrive together; a body is a pose once all its joints did
+static bool flush_body(struct Clip* clip, const vec3_t* joints, uint32_t mask, uint32_t frame)
+{
+    clip->bodies++;
+    if (mask != 0xFFFFFFFFu || frame % clip->every != 0)
+        return true;
+    float descriptor[POSE_DESCRIPTOR_DIMS];
+    if (!pose_descriptor(joints, NULL, descriptor))
+    {
+        clip->rejected++;
+        return true;
+    }
+    return add_pose(clip, descriptor, frame);
+}
+
+static void parse_clip(struct Clip* clip)
+{
+    FILE* f = fopen(clip->path, "r");
+    if (f == NULL)
+    {
+        clip->failed = true;
+        return;
+    }
+    char line[LINE_MAX_SIZE];
+    vec3_t joints[SKELETON_JOINT_COUNT];
+    uint32_t mask = 0, frame = 0, body = 0;
+    bool open = false;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        unsigned int n, id;
+        int joint;
+        float x, y, z;
+        if (sscanf(line, "Frame: %u, Body ID[%u], Joint[%d]: Position[mm] ( %f, %f, %f );", &n, &id, &joint, &x, &y,
+                   &z) != 6 || joint < 0 || joint >= SKELETON_JOINT_COUNT)
+            continue;
+        if (open && (n != frame || id != body))
+        {
+            if (!flush_body(clip, joints, mask, frame))
+                clip->failed = true;
+            mask = 0;
+        }
+        open = true;
+        frame = n;
+        body = id;
+        joints[joint] = vec3_make(x, y, z);
+        mask |= 1u << joint;
+    }
+    if (open && !flush_body(clip, joints, mask, frame))
+        clip->failed = true;
+    fclose(f);
+}
+
+static PLATFORM_THREAD_RETURN parse_worker(void* param)
+{
+    struct ParseState* state = (struct ParseState*)param;
+    for (;;)
+    {
+        platform_mutex_lock(&state->lock);
+        int c = state->next++;
+        platform_mutex_unlock(&state->lock);
+        if (c >= state->clipCount)
+            break;
+        parse_clip(&state->clips[c]);
+    }
+    return PLATFORM_THREAD_RESULT;
+}
+
+static const char* base_name(const char* path)
+{
+    const char* name = path;
+    for (const char* p = path; *p != '\0'; p++)
+    {
+        if (*p == '/' || *p == '\\')
+            name = p + 1;
+    }
+    return name;
+}
+
+int main(int argc, char** argv)
+{
+    static struct Clip clips[MAX_CLIPS];
+    const char* out_path = NULL;
+    int clip_count = 0, threads = 0, ef = POSE_INDEX_DEFAULT_BUILD_EF;
+    uint32_t every = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--every") == 0 && i + 1 < argc)
+            every = (uint32_t)strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--ef") == 0 && i + 1 < argc)
+            ef = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = atoi(argv[++i]);
+        else if (out_path == NULL)
+            out_path = argv[i];
+        else if (clip_count < MAX_CLIPS)
+            clips[clip_count++].path = argv[i];
+    }
+    if (out_path == NULL || clip_count == 0 || every == 0 || ef < 1)
+    {
+        printf("Usage: pose_index_build <out.idx> <clip.txt>... [--every <n>=1] [--ef <n>=128] [--threads <n>=cores]\n");
+        return 1;
+    }
+    if (threads < 1)
+        threads = platform_cpu_count();
+
+    int64_t start = monotonic_usec();
+    struct ParseState state;
+    state.clips = clips;
+    state.clipCount = clip_count;
+    state.next = 0;
+    platform_mutex_init(&state.lock);
+    for (int c = 0; c < clip_count; c++)
+        clips[c].every = every;
+    platform_thread_t handles[64];
+    int started = 0;
+    for (int t = 1; t < threads && t < clip_count && started < 64; t++)
+    {
+        if (!platform_thread_create(&handles[started], parse_worker, &state))
+            break;
+        started++;
+    }
+    parse_worker(&state);
+    for (int t = 0; t < started; t++)
+        platform_thread_join(handles[t]);
+    platform_mutex_destroy(&state.lock);
+
+    uint64_t total = 0;
+    for (int c = 0; c < clip_count; c++)
+    {
+        const struct Clip* clip = &clips[c];
+        if (clip->failed)
+        {
+            printf("Can not read %s\n", clip->path);
+            return 1;
+        }
+        printf("%s: %llu bodies, %u poses, %llu rejected\n", clip->path, (unsigned long long)clip->bodies,
+               clip->count, (unsigned long long)clip->rejected);
+        total += clip->count;
+    }
+    if (total == 0 || total > UINT32_MAX)
+    {
+        printf("No poses to index\n");
+        return 1;
+    }
+    int64_t parsed = monotonic_usec();
+
+    static struct PoseIndex index;
+    if (!pose_index_create(&index, (uint32_t)total, (uint32_t)clip_count, 0x9E3779B9u))
+    {
+        printf("Not enough memory for %llu poses\n", (unsigned long long)total);
+        return 1;
+    }
+    uint32_t node = 0;
+    for (int c = 0; c < clip_count; c++)
+    {
+        struct Clip* clip = &clips[c];
+        if (clip->count > 0)
+            memcpy(index.vectors + (size_t)node * POSE_DESCRIPTOR_DIMS, clip->descriptors,
+                   (size_t)clip->count * POSE_DESCRIPTOR_DIMS * sizeof(float));
+        for (uint32_t i = 0; i < clip->count; i++)
+        {
+            index.labels[node + i].clip = (uint32_t)c;
+            index.labels[node + i].frame = clip->frames[i];
+        }
+        snprintf(index.clipNames[c], POSE_INDEX_CLIP_NAME, "%s", base_name(clip->path));
+        node += clip->count;
+        free(clip->descriptors);
+        free(clip->frames);
+    }
+
+    if (!pose_index_build(&index, threads, ef))
+    {
+        printf("Not enough memory to build the index\n");
+        return 1;
+    }
+    int64_t built = monotonic_usec();
+    if (!pose_index_save(&index, out_path))
+    {
+        printf("Can not write %s\n", out_path);
+        return 1;
+    }
+    printf("%u poses from %d clips, top level %d, parsed in %.1f s, built in %.1f s on %d threads -> %s\n",
+           index.count, clip_count, index.maxLevel, (parsed - start) / 1e6, (built - parsed) / 1e6, threads,
+           out_path);
+    pose_index_close(&index);
+    return 0;
+}
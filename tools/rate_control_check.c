@@ -0,0 +1,277 @@
+/**==============================================
+ * @description : closed-loop check of the receiver feedback channel. Streams
+ *  moving bodies with rate_control.c to a local receiver that reports back
+ *  through skp_receiver_write_feedback, in three phases: no limit, then a
+ *  bandwidth cap requested by the receiver, then no limit again. Prints the
+ *  level, rate and decode error per interval; the sender must go down to a
+ *  level under the cap and come back to full precision. Receivers that
+ *  subscribe to different rotation sets must each get theirs, those with the
+ *  same set on one stream, every stream without holes.
+ *  Usage: rate_control_check [cap kbit/s=1500] [bodies=5] [phase s=4] [port=9063]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include "../rate_control.h"
+#include "../skp_receiver.h"
+
+#define FRAME_RATE 60
+#define FEEDBACK_INTERVAL_USEC 250000
+#define SENT_HISTORY 64
+
+struct SentFrame
+{
+    struct SkeletonFrame frame;
+    int level;
+};
+
+static struct SentFrame sent[SENT_HISTORY];
+static float max_error[RATE_LEVEL_COUNT];// mm, joints of the level's mask
+static uint64_t frames_decoded[RATE_LEVEL_COUNT];
+
+// Bodies walking on circles, limbs swinging; every other body beyond 4 m
+static void animate(struct SkeletonFrame* frame, uint32_t number, uint32_t bodies)
+{
+    float t = (float)number / FRAME_RATE;
+    frame->frameNumber = number;
+    frame->bodyCount = bodies;
+    for (uint32_t b = 0; b < bodies; b++)
+    {
+        float radius = (b % 2 == 0) ? 2000.0f : 6000.0f;
+        float angle = 0.4f * t + (float)b;
+        vec3_t pelvis = vec3_make(radius * cosf(angle), 900.0f, radius * sinf(angle));
+        frame->bodyIds[b] = 100 + b;
+        frame->cameraPositions[b] = vec3_make(0.0f, 0.0f, 0.0f);
+        frame->slots[b] = (uint8_t)b;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            float swing = 150.0f * sinf(3.0f * t + (float)j);
+            frame->positions[b][j] = vec3_add(pelvis, vec3_make(40.0f * (j % 5) + swing, 25.0f * j, 0.5f * swing));
+            frame->localRotations[b][j] = quat_from_rotvec(vec3_make(0.3f * sinf(t + j), 0.2f * cosf(2.0f * t), 0.1f * j));
+            frame->confidence[b][j] = CONFIDENCE_MEDIUM;
+        }
+    }
+}
+
+static void on_frame(const struct SkeletonFrame* frame, const struct SkpFrameInfo* info, void* context)
+{
+    (void)info;
+    (void)context;
+    const struct SentFrame* s = &sent[frame->frameNumber % SENT_HISTORY];
+    if (s->frame.frameNumber != frame->frameNumber)
+        return;
+    uint32_t mask = rate_levels[s->level].jointMask;
+    for (uint32_t b = 0; b < frame->bodyCount; b++)
+    {
+        uint32_t source = frame->bodyIds[b] - 100;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            if (!(mask & (1u << j)))
+                continue;
+            float e = vec3_length(vec3_sub(frame->positions[b][j], s->frame.positions[source][j]));
+            if (e > max_error[s->level])
+                max_error[s->level] = e;
+        }
+    }
+    frames_decoded[s->level]++;
+}
+
+static SOCKET bind_local(uint16_t port)
+{
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    int buffer_size = 4 * 1024 * 1024;
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer_size, sizeof(buffer_size));
+    SOCKADDR_IN a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &a.sin_addr);
+    if (bind(s, (struct sockaddr*)&a, sizeof(a)) != 0)
+    {
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+    fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+    return s;
+}
+
+// Three receivers asking for world, no and world rotations: bodies carry
+// the set of their receiver, the two world receivers share a stream and no
+// stream skips a sequence number
+static bool check_rotation_sets(uint16_t port, uint32_t bodies)
+{
+    static const uint8_t sets[3] = { SKP_WORLD_ROTATIONS, 0, SKP_WORLD_ROTATIONS };
+    static struct UdpSender sender;
+    static struct RateControl control;
+    struct RateControlConfig config;
+    rate_control_default_config(&config);
+    SOCKET sockets[3];
+    bool ok = udp_sender_open(&sender);
+    for (int k = 0; k < 3; k++)
+    {
+        sockets[k] = bind_local((uint16_t)(port + 1 + k));
+        ok = ok && sockets[k] != INVALID_SOCKET && udp_sender_add_destination(&sender, "127.0.0.1", port + 1 + k);
+        config.rotations[k] = sets[k];
+    }
+    if (!ok)
+    {
+        printf("Can not bind ports %u..%u\n", port + 1, port + 3);
+        return false;
+    }
+    rate_control_init(&control, &config);
+    static struct SkeletonFrame frame;
+    for (uint32_t f = 0; f < 20; f++)
+    {
+        animate(&frame, f, bodies);
+        rate_control_send_frame(&control, &sender, &frame);
+    }
+    platform_sleep_usec(50000);
+
+    int streams[3];
+    for (int k = 0; k < 3; k++)
+    {
+        uint8_t buffer[SKP_MAX_PARITY];
+        uint32_t received = 0, wrong = 0, holes = 0, next = 0;
+        streams[k] = -1;
+        ssize_t size;
+        while ((size = recv(sockets[k], (char*)buffer, sizeof(buffer), 0)) > 0)
+        {
+            struct SkpHeader h;
+            if (!skp_read_header(buffer, (size_t)size, &h) || h.type != SKP_MSG_BODY)
+                continue;
+            wrong += (h.flags & (SKP_WORLD_ROTATIONS | SKP_LOCAL_ROTATIONS)) != sets[k] ||
+                     (streams[k] >= 0 && h.stream != streams[k]);
+            holes += received > 0 && h.sequence != next;
+            streams[k] = h.stream;
+            next = h.sequence + 1;
+            received++;
+        }
+        printf("receiver %d (rotations %u): %u bodies on stream %d, %u with other rotations, %u holes\n", k, sets[k],
+               received, streams[k], wrong, holes);
+        ok = ok && received == 20 * bodies && wrong == 0 && holes == 0;
+        closesocket(sockets[k]);
+    }
+    ok = ok && streams[0] == streams[2] && streams[0] != streams[1];
+    udp_sender_close(&sender);
+    rate_control_destroy(&control);
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t cap_kbps = (uint32_t)(argc > 1 ? atoi(argv[1]) : 1500);
+    uint32_t bodies = (uint32_t)(argc > 2 ? atoi(argv[2]) : 5);
+    int phase_sec = argc > 3 ? atoi(argv[3]) : 4;
+    uint16_t port = (uint16_t)(argc > 4 ? atoi(argv[4]) : 9063);
+    if (bodies < 1 || bodies > MAX_FRAME_BODIES)
+        bodies = 5;
+
+    net_startup();
+    SOCKET s = bind_local(port);
+    if (s == INVALID_SOCKET)
+    {
+        printf("Can not bind port %u\n", port);
+        return 1;
+    }
+
+    static struct UdpSender sender;
+    if (!udp_sender_open(&sender) || !udp_sender_add_destination(&sender, "127.0.0.1", port))
+        return 1;
+
+    static struct RateControl control;
+    struct RateControlConfig config;
+    rate_control_default_config(&config);
+    config.adaptive = true;
+    rate_control_init(&control, &config);
+
+    static struct SkpReceiver receiver;
+    skp_receiver_init(&receiver, on_frame, NULL, NULL);
+
+    printf("%u bodies at %d Hz, receiver asks for at most %u kbit/s during the second phase\n", bodies, FRAME_RATE,
+           cap_kbps);
+    int total_frames = 3 * phase_sec * FRAME_RATE;
+    int64_t start = monotonic_usec();
+    int64_t next_feedback = start + FEEDBACK_INTERVAL_USEC;
+    int lowest_level = 0;
+    int level_under_cap = -1;
+    for (int f = 0; f < total_frames; f++)
+    {
+        int phase = f / (phase_sec * FRAME_RATE);
+        struct SentFrame* s_frame = &sent[(uint32_t)f % SENT_HISTORY];
+        animate(&s_frame->frame, (uint32_t)f, bodies);
+        s_frame->level = control.receivers[0].level;
+        if (s_frame->level > lowest_level)
+            lowest_level = s_frame->level;
+        rate_control_send_frame(&control, &sender, &s_frame->frame);
+
+        // receiver side
+        int64_t until = start + (int64_t)(f + 1) * 1000000 / FRAME_RATE;
+        for (;;)
+        {
+            uint8_t buffer[SKP_MAX_PARITY];
+            SOCKADDR_IN from;
+            socklen_t length = sizeof(from);
+            ssize_t size = recvfrom(s, (char*)buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &length);
+            int64_t now = monotonic_usec();
+            if (size > 0)
+            {
+                skp_receiver_push(&receiver, buffer, (size_t)size, now);
+                if (now >= next_feedback)
+                {
+                    uint8_t feedback[SKP_FEEDBACK_SIZE];
+                    size_t n = skp_receiver_write_feedback(&receiver, 200, phase == 1 ? cap_kbps : 0, now, feedback,
+                                                           sizeof(feedback));
+                    sendto(s, (const char*)feedback, (int)n, 0, (struct sockaddr*)&from, sizeof(from));
+                    next_feedback = now + FEEDBACK_INTERVAL_USEC;
+                }
+                continue;
+            }
+            if (now >= until)
+                break;
+            platform_sleep_usec(500);
+        }
+        uint8_t reply[SKP_MAX_DATAGRAM];
+        SOCKADDR_IN reply_from;
+        int64_t arrival;
+        int reply_size;
+        while ((reply_size = udp_sender_receive(&sender, reply, sizeof(reply), &reply_from, &arrival)) > 0)
+        {
+            struct SkpHeader h;
+            struct SkpFeedback feedback;
+            if (skp_read_header(reply, (size_t)reply_size, &h) && skp_read_feedback(reply, &h, &feedback))
+                rate_control_on_feedback(&control, &sender, &reply_from, &feedback, monotonic_usec());
+        }
+
+        if (phase == 1 && f % FRAME_RATE == FRAME_RATE - 1)
+            level_under_cap = control.receivers[0].sentKbps <= (float)cap_kbps ? control.receivers[0].level : -1;
+        if (f % FRAME_RATE == FRAME_RATE - 1)
+            printf("t=%2ds phase %d: level %-9s %7.0f kbit/s, lost %u, jitter %u us\n", (f + 1) / FRAME_RATE, phase,
+                   rate_levels[control.receivers[0].level].name, control.receivers[0].sentKbps,
+                   control.receivers[0].feedback.lost, control.receivers[0].feedback.jitterUsec);
+    }
+    skp_receiver_flush(&receiver, monotonic_usec() + 10 * receiver.timeoutUsec);
+
+    printf("level       frames  max error\n");
+    for (int l = 0; l < RATE_LEVEL_COUNT; l++)
+    {
+        if (frames_decoded[l] > 0)
+            printf("%-10s %7llu  %6.2f mm\n", rate_levels[l].name, (unsigned long long)frames_decoded[l],
+                   max_error[l]);
+    }
+    printf("frames complete %llu, partial %llu, missing key %llu, malformed %llu\n",
+           (unsigned long long)receiver.stats.framesComplete, (unsigned long long)receiver.stats.framesPartial,
+           (unsigned long long)receiver.stats.missingKey, (unsigned long long)receiver.stats.malformed);
+
+    bool ok = lowest_level > 0 && level_under_cap > 0 && control.receivers[0].level == RATE_LEVEL_FULL &&
+              receiver.stats.malformed == 0;
+    udp_sender_close(&sender);
+    rate_control_destroy(&control);
+    closesocket(s);
+    ok = check_rotation_sets(port, bodies) && ok;
+    net_cleanup();
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
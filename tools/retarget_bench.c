@@ -0,0 +1,425 @@
+/**==============================================
+ * @description : retargeting onto a target skeleton (retarget.h) on
+ *  synthetic dancers. A skeleton built from a dancer's own joints must give
+ *  back the dancer's joints when the dancer neither leans nor twists. On
+ *  the Unreal mannequin (mannequin.retarget) every bone must keep its
+ *  length, and with no foot held every IK chain end must land on its
+ *  scaled target unless out of reach, bend in the plane of the body's limb
+ *  and keep the direction of the body's hand or foot. A planted foot under
+ *  tracker noise must hold still while locked, lift off when the dancer
+ *  walks and lock again once they stop. Poses must survive the wire format, and a 16-body frame on
+ *  one core must take under 20 us per body (median).
+ *  Usage: retarget_bench [skeleton=mannequin.retarget] [frames=3000]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../retarget.h"
+#include "../protocol.h"
+#include "../latency_stats.h"
+#include "dancer_sim.h"
+
+#ifndef RETARGET_MANNEQUIN
+#define RETARGET_MANNEQUIN "mannequin.retarget"
+#endif
+
+#define SELF_PATH "retarget_bench_self.retarget"
+#define BAD_PATH "retarget_bench_bad.retarget"
+#define STEP_USEC 33333
+#define MAX_BODY_MEDIAN_USEC 20
+#define RAD_TO_DEG 57.29578f
+
+static int64_t now_usec = 1000000;
+
+static float distance(vec3_t a, vec3_t b)
+{
+    return vec3_length(vec3_sub(a, b));
+}
+
+static float angle_deg(vec3_t a, vec3_t b)
+{
+    float c = vec3_dot(a, b) / (vec3_length(a) * vec3_length(b));
+    return acosf(c > 1.0f ? 1.0f : (c < -1.0f ? -1.0f : c)) * RAD_TO_DEG;
+}
+
+static void fill_body(struct SkeletonFrame* frame, uint32_t b, uint32_t id, const vec3_t* joints)
+{
+    frame->bodyIds[b] = id;
+    frame->slots[b] = (uint8_t)(id % MAX_BODY_SLOTS);
+    memcpy(frame->positions[b], joints, sizeof(frame->positions[b]));
+    memset(frame->confidence[b], CONFIDENCE_MEDIUM, sizeof(frame->confidence[b]));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// A dancer retargeted onto itself
+
+struct SelfBone
+{
+    const char* name;
+    const char* parent;
+    int joint;
+};
+
+// children listed first are the ones their parent aims at
+static const struct SelfBone self_bones[] = {
+    { "pelvis", "-", JOINT_PELVIS },           { "navel", "pelvis", JOINT_SPINE_NAVEL },
+    { "chest", "navel", JOINT_SPINE_CHEST },   { "neck", "chest", JOINT_NECK },
+    { "head", "neck", JOINT_HEAD },            { "shoulder_l", "chest", JOINT_SHOULDER_LEFT },
+    { "elbow_l", "shoulder_l", JOINT_ELBOW_LEFT }, { "wrist_l", "elbow_l", JOINT_WRIST_LEFT },
+    { "shoulder_r", "chest", JOINT_SHOULDER_RIGHT }, { "elbow_r", "shoulder_r", JOINT_ELBOW_RIGHT },
+    { "wrist_r", "elbow_r", JOINT_WRIST_RIGHT }, { "hip_l", "pelvis", JOINT_HIP_LEFT },
+    { "knee_l", "hip_l", JOINT_KNEE_LEFT },    { "ankle_l", "knee_l", JOINT_ANKLE_LEFT },
+    { "foot_l", "ankle_l", JOINT_FOOT_LEFT },  { "hip_r", "pelvis", JOINT_HIP_RIGHT },
+    { "knee_r", "hip_r", JOINT_KNEE_RIGHT },   { "ankle_r", "knee_r", JOINT_ANKLE_RIGHT },
+    { "foot_r", "ankle_r", JOINT_FOOT_RIGHT },
+};
+#define SELF_BONES ((int)(sizeof(self_bones) / sizeof(self_bones[0])))
+
+static bool write_self_skeleton(const struct Dancer* d)
+{
+    vec3_t joints[SKELETON_JOINT_COUNT];
+    dancer_joints(d, joints);
+    FILE* f = fopen(SELF_PATH, "w");
+    if (f == NULL)
+        return false;
+    fprintf(f, "# skeleton of a dancer at rest\nfloor 0\n");
+    for (int i = 0; i < SELF_BONES; i++)
+    {
+        vec3_t p = joints[self_bones[i].joint];
+        fprintf(f, "bone %s %s %d %.4f %.4f %.4f\n", self_bones[i].name, self_bones[i].parent, self_bones[i].joint,
+                p.x, p.y, p.z);
+    }
+    fprintf(f, "ik shoulder_l elbow_l wrist_l\nik shoulder_r elbow_r wrist_r\n");
+    fprintf(f, "ik hip_l knee_l ankle_l\nik hip_r knee_r ankle_r\n");
+    fclose(f);
+    return true;
+}
+
+// Largest distance of a bone head from the dancer's joint, mm
+static float self_error(int frames)
+{
+    struct Dancer rest;
+    dancer_start(&rest);
+    rest.position = vec3_make(0.0f, 0.0f, 0.0f);
+    rest.yaw = 0.0f;
+    rest.scale = 1.0f;
+    for (int i = 0; i < PARAMS; i++)
+        rest.params[i] = 0.0f;
+    rest.params[LEFT_ELBOW] = rest.params[RIGHT_ELBOW] = 0.3f;// bent a little, so IK can tell the plane
+    rest.params[LEFT_KNEE] = rest.params[RIGHT_KNEE] = 0.3f;
+    if (!write_self_skeleton(&rest))
+        return INFINITY;
+    static struct Retargeter r;
+    retargeter_init(&r, NULL);
+    int loaded = retargeter_load(&r, SELF_PATH);
+    remove(SELF_PATH);
+    if (loaded != SELF_BONES)
+        return INFINITY;
+
+    static struct SkeletonFrame frame;
+    struct Dancer d;
+    dancer_start(&d);
+    d.scale = 1.0f;
+    float worst = 0.0f;
+    for (int f = 0; f < frames; f++)
+    {
+        dancer_step(&d);
+        d.params[LEAN] = d.params[TWIST] = 0.0f;
+        vec3_t joints[SKELETON_JOINT_COUNT];
+        dancer_joints(&d, joints);
+        frame.bodyCount = 1;
+        frame.timestampUsec = now_usec += STEP_USEC;
+        fill_body(&frame, 0, 1, joints);
+        retargeter_update(&r, &frame);
+
+        // the root stands a floor-relative leg ratio above the floor, which is
+        // one here
+        vec3_t heads[RETARGET_MAX_BONES];
+        retarget_pose_positions(&r, &r.poses[0], heads);
+        for (int i = 0; i < SELF_BONES; i++)
+        {
+            float e = distance(heads[i], joints[self_bones[i].joint]);
+            worst = e > worst ? e : worst;
+        }
+    }
+    return worst;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Mannequin invariants
+
+struct Invariants
+{
+    float length;   // largest bone length change, mm
+    float reach;    // largest chain end miss of its target, reachable ends, mm
+    float plane;    // largest middle head distance from the body's limb plane, mm
+    float direction;// largest end direction change against the body's, degrees
+    uint64_t ends;
+    uint64_t outOfReach;
+};
+
+static int find(const struct Retargeter* r, const char* name)
+{
+    for (int i = 0; i < r->boneCount; i++)
+    {
+        if (strcmp(r->bones[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static void check_pose(const struct Retargeter* r, const vec3_t* joints, const struct RetargetPose* pose,
+                       struct Invariants* inv)
+{
+    vec3_t heads[RETARGET_MAX_BONES];
+    retarget_pose_positions(r, pose, heads);
+    for (int i = 1; i < r->boneCount; i++)
+    {
+        float e = fabsf(distance(heads[i], heads[r->bones[i].parent]) - vec3_length(r->bones[i].offset));
+        inv->length = e > inv->length ? e : inv->length;
+    }
+    for (int c = 0; c < r->chainCount; c++)
+    {
+        const struct RetargetChain* chain = &r->chains[c];
+        int u = chain->bones[0], l = chain->bones[1], e = chain->bones[2];
+        vec3_t ja = joints[r->bones[u].joint], jm = joints[r->bones[l].joint], je = joints[r->bones[e].joint];
+        float k = (chain->upperLength + chain->lowerLength) / (distance(jm, ja) + distance(je, jm));
+        vec3_t target = vec3_add(heads[u], vec3_scale(vec3_sub(je, ja), k));
+        inv->ends++;
+        if (distance(target, heads[u]) > chain->upperLength + chain->lowerLength)
+            inv->outOfReach++;
+        else
+        {
+            float miss = distance(heads[e], target);
+            inv->reach = miss > inv->reach ? miss : inv->reach;
+        }
+
+        vec3_t normal = vec3_cross(vec3_sub(jm, ja), vec3_sub(je, ja));
+        if (vec3_length(normal) > 0.1f * distance(jm, ja) * distance(je, ja))// bent by more than ~6 degrees
+        {
+            float off = fabsf(vec3_dot(vec3_sub(heads[l], heads[u]), normal)) / vec3_length(normal);
+            inv->plane = off > inv->plane ? off : inv->plane;
+        }
+
+        // the end aims at its first child as the body's end joint does at its
+        int child = r->bones[e].aimChild;
+        if (child >= 0)
+        {
+            float a = angle_deg(vec3_sub(heads[child], heads[e]),
+                                vec3_sub(joints[r->bones[child].joint], joints[r->bones[e].joint]));
+            inv->direction = a > inv->direction ? a : inv->direction;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Foot locking
+
+struct LockResult
+{
+    float heldDrift;  // mm, largest locked foot movement while standing
+    float freeJitter; // mm, largest foot step between frames without locking
+    float walkHeld;   // share of walking frames with the foot held
+    int relockFrames; // after stopping
+};
+
+static void plant(struct Retargeter* r, int foot, bool walk_then_stop, struct LockResult* out)
+{
+    static struct SkeletonFrame frame;
+    struct Dancer d;
+    dancer_start(&d);
+    d.scale = 1.0f;
+    d.params[CROUCH] = 0.0f;
+    d.params[LEFT_LEG_FORWARD] = d.params[LEFT_LEG_OUT] = d.params[LEFT_KNEE] = 0.05f;
+    vec3_t held_at = vec3_make(0.0f, 0.0f, 0.0f), last = held_at;
+    bool was_held = false;
+    int walking = 0, walking_held = 0;
+    out->relockFrames = -1;
+    for (int f = 0; f < 360; f++)
+    {
+        // arms keep dancing, the left leg stands; frames 120..239 walk along y
+        dancer_step(&d);
+        d.params[CROUCH] = 0.0f;
+        d.params[LEFT_LEG_FORWARD] = d.params[LEFT_LEG_OUT] = d.params[LEFT_KNEE] = 0.05f;
+        bool moving = walk_then_stop && f >= 120 && f < 240;
+        if (moving)
+            d.position.y += 1200.0f * STEP_USEC / 1e6f;
+        vec3_t joints[SKELETON_JOINT_COUNT];
+        dancer_joints(&d, joints);
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)// tracker noise
+            joints[j] = vec3_add(joints[j], vec3_make(random_range(-2.0f, 2.0f), random_range(-2.0f, 2.0f),
+                                                      random_range(-2.0f, 2.0f)));
+        frame.bodyCount = 1;
+        frame.timestampUsec = now_usec += STEP_USEC;
+        fill_body(&frame, 0, 7, joints);
+        retargeter_update(r, &frame);
+
+        vec3_t heads[RETARGET_MAX_BONES];
+        retarget_pose_positions(r, &r->poses[0], heads);
+        bool held = (r->poses[0].lockMask & (1u << r->bones[foot].chain)) != 0;
+        if (f > 0 && !moving && f < 120)
+        {
+            float step = distance(heads[foot], last);
+            out->freeJitter = step > out->freeJitter ? step : out->freeJitter;
+        }
+        if (held && was_held && !moving)
+        {
+            float drift = distance(heads[foot], held_at);
+            out->heldDrift = drift > out->heldDrift ? drift : out->heldDrift;
+        }
+        if (held && !was_held)
+            held_at = heads[foot];
+        if (moving)
+        {
+            walking++;
+            walking_held += held;
+        }
+        if (walk_then_stop && f >= 240 && held && out->relockFrames < 0)
+            out->relockFrames = f - 240;
+        was_held = held;
+        last = heads[foot];
+    }
+    out->walkHeld = walking > 0 ? (float)walking_held / walking : 0.0f;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char** argv)
+{
+    const char* path = argc > 1 ? argv[1] : RETARGET_MANNEQUIN;
+    int frames = argc > 2 ? atoi(argv[2]) : 3000;
+    if (frames < 100)
+    {
+        printf("Usage: retarget_bench [skeleton=mannequin.retarget] [frames=3000]\n");
+        return 1;
+    }
+
+    // malformed files are refused
+    FILE* f = fopen(BAD_PATH, "w");
+    if (f != NULL)
+    {
+        fprintf(f, "bone pelvis - 0 0 0 900\nbone thigh_l nowhere 18 -90 0 880\n");
+        fclose(f);
+    }
+    static struct Retargeter bad;
+    retargeter_init(&bad, NULL);
+    bool refused = retargeter_load(&bad, BAD_PATH) < 0;
+    remove(BAD_PATH);
+
+    float self = self_error(frames);
+    printf("dancer onto itself: largest joint error %.3f mm, malformed file %s\n", self,
+           refused ? "refused" : "accepted");
+
+    // feet are not held here: the invariants are those of the free solution
+    static struct Retargeter r;
+    struct RetargetConfig config;
+    retarget_default_config(&config);
+    config.lockSpeed = 0.0f;
+    retargeter_init(&r, &config);
+    if (retargeter_load(&r, path) < 0)
+    {
+        printf("Can not read target skeleton %s\nFAIL\n", path);
+        return 1;
+    }
+    printf("%s: %d bones, %d IK chains, leg %.0f mm\n", path, r.boneCount, r.chainCount, r.legLength);
+
+    // a frame of dancers at a time, every frame through the wire format
+    struct Dancer dancers[MAX_FRAME_BODIES];
+    for (int b = 0; b < MAX_FRAME_BODIES; b++)
+        dancer_start(&dancers[b]);
+    static struct SkeletonFrame frame;
+    static struct RetargetPose decoded[MAX_FRAME_BODIES];
+    struct Invariants inv;
+    memset(&inv, 0, sizeof(inv));
+    struct LatencyStats frame_time;
+    latency_stats_init(&frame_time, "frame of 16 bodies");
+    float wire_error = 0.0f;
+    uint64_t datagrams = 0, bytes = 0, poses_sent = 0;
+    uint8_t buffer[SKP_MAX_DATAGRAM];
+    for (int n = 0; n < frames; n++)
+    {
+        frame.bodyCount = MAX_FRAME_BODIES;
+        frame.frameNumber = (uint32_t)n;
+        frame.timestampUsec = now_usec += STEP_USEC;
+        for (int b = 0; b < MAX_FRAME_BODIES; b++)
+        {
+            dancer_step(&dancers[b]);
+            vec3_t joints[SKELETON_JOINT_COUNT];
+            dancer_joints(&dancers[b], joints);
+            fill_body(&frame, (uint32_t)b, 100u + (uint32_t)b, joints);
+        }
+        int64_t start = monotonic_usec();
+        retargeter_update(&r, &frame);
+        latency_stats_add(&frame_time, monotonic_usec() - start);
+
+        int per_datagram = skp_max_retarget_poses(r.boneCount);
+        for (int first = 0; first < r.poseCount; first += per_datagram)
+        {
+            int count = r.poseCount - first < per_datagram ? r.poseCount - first : per_datagram;
+            size_t size = skp_write_retargeted(frame.frameNumber, r.poses + first, count, r.boneCount, buffer,
+                                               sizeof(buffer));
+            struct SkpHeader h;
+            int bones = 0;
+            if (size == 0 || !skp_read_header(buffer, size, &h) ||
+                skp_read_retargeted(buffer, &h, decoded + first, count, &bones) != count || bones != r.boneCount)
+            {
+                printf("wire format round trip failed\nFAIL\n");
+                return 1;
+            }
+            datagrams++;
+            bytes += size;
+            poses_sent += (uint64_t)count;
+        }
+        for (int b = 0; b < r.poseCount; b++)
+        {
+            check_pose(&r, frame.positions[b], &r.poses[b], &inv);
+            vec3_t sent[RETARGET_MAX_BONES], received[RETARGET_MAX_BONES];
+            retarget_pose_positions(&r, &r.poses[b], sent);
+            retarget_pose_positions(&r, &decoded[b], received);
+            for (int i = 0; i < r.boneCount; i++)
+            {
+                float e = distance(sent[i], received[i]);
+                wire_error = e > wire_error ? e : wire_error;
+            }
+        }
+    }
+    latency_stats_print(&frame_time);
+    int64_t median = latency_stats_percentile(&frame_time, 0.5);
+    double per_body = (double)median / MAX_FRAME_BODIES;
+    printf("median %.2f us per body; bone length change %.4f mm, reach miss %.3f mm (%.1f%% of %llu ends out of "
+           "reach), bend plane %.3f mm, end direction %.3f deg\n",
+           per_body, inv.length, inv.reach, 100.0 * inv.outOfReach / inv.ends, (unsigned long long)inv.ends,
+           inv.plane, inv.direction);
+    printf("wire: %.1f bytes per pose, %.1f poses per datagram, largest head error after decoding %.3f mm\n",
+           (double)bytes / poses_sent, (double)poses_sent / datagrams, wire_error);
+
+    // foot locking on the left foot, with and without
+    int foot = find(&r, "foot_l");
+    struct LockResult locked, free_foot;
+    memset(&locked, 0, sizeof(locked));
+    memset(&free_foot, 0, sizeof(free_foot));
+    bool lockable = foot >= 0 && r.bones[foot].chain >= 0 && r.chains[r.bones[foot].chain].lock;
+    if (lockable)
+    {
+        static struct Retargeter held;
+        retargeter_init(&held, NULL);
+        retargeter_load(&held, path);
+        plant(&r, foot, false, &free_foot);
+        plant(&held, foot, true, &locked);
+        printf("planted foot: jitter %.2f mm per frame unlocked, drift %.3f mm held; held %.0f%% of walking "
+               "frames, locked again %d frames after stopping\n",
+               free_foot.freeJitter, locked.heldDrift, 100.0 * locked.walkHeld, locked.relockFrames);
+    }
+    else
+        printf("no locked chain ending in foot_l, foot locking not checked\n");
+
+    bool ok = refused && self < 1.0f && inv.length < 0.01f && inv.reach < 0.5f && inv.plane < 0.5f &&
+              inv.direction < 0.5f && wire_error < 1.0f && per_body < MAX_BODY_MEDIAN_USEC;
+    if (lockable)
+        ok = ok && locked.heldDrift < 0.01f && free_foot.freeJitter > 1.0f && locked.walkHeld < 0.1f &&
+             locked.relockFrames >= 0 && locked.relockFrames < 10;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,227 @@
+/**==============================================
+ * @description : publish-to-read latency of the shared-memory ring
+ *  (shm_ring.c) against loopback UDP carrying the same frame as binary body
+ *  datagrams. A writer thread publishes frames at a fixed rate; a reader
+ *  thread with its own mapping / socket records when each frame is complete.
+ *  Usage: shm_bench [frames=5000] [rate_hz=1000] [bodies=4]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../shm_ring.h"
+#include "../udp_sender.h"
+#include "../protocol.h"
+#include "../latency_stats.h"
+
+#define BENCH_SHM_NAME "/body_tracking_bench"
+#define BENCH_PORT 9051
+
+enum BenchMode
+{
+    BENCH_SHM_SPIN,
+    BENCH_SHM_FUTEX,
+    BENCH_UDP,
+};
+
+static const char* mode_names[] = { "shm, polling", "shm, futex wake", "udp loopback" };
+
+static int frames;
+static int64_t period_nsec;
+static uint32_t bodies;
+static int64_t* publish_times;// by frame number
+static volatile bool writer_done;
+static struct LatencyStats stats;
+static uint64_t frames_seen;
+
+static int64_t now_nsec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void make_frame(struct SkeletonFrame* frame, uint32_t number)
+{
+    frame->frameNumber = number;
+    frame->bodyCount = bodies;
+    for (uint32_t b = 0; b < bodies; b++)
+    {
+        frame->bodyIds[b] = b + 1;
+        frame->slots[b] = (uint8_t)b;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            frame->positions[b][j] = vec3_make((float)number, 20.0f * j, 2000.0f);
+            frame->localRotations[b][j] = quat_identity();
+        }
+    }
+}
+
+static void record(uint32_t number)
+{
+    if ((int)number < frames)
+    {
+        latency_stats_add(&stats, now_nsec() - publish_times[number]);
+        frames_seen++;
+    }
+}
+
+static void pace(int64_t start, int f)
+{
+    int64_t t = start + f * period_nsec;
+    struct timespec ts;
+    ts.tv_sec = t / 1000000000;
+    ts.tv_nsec = t % 1000000000;
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Shared memory
+
+static struct ShmRingWriter shm_writer;
+
+static PLATFORM_THREAD_RETURN shm_writer_thread(void* param)
+{
+    (void)param;
+    static struct SkeletonFrame frame;
+    int64_t start = now_nsec();
+    for (int f = 0; f < frames; f++)
+    {
+        pace(start, f);
+        make_frame(&frame, (uint32_t)f);
+        publish_times[f] = now_nsec();
+        shm_writer_publish(&shm_writer, &frame);
+    }
+    writer_done = true;
+    return PLATFORM_THREAD_RESULT;
+}
+
+static void run_shm(bool futex)
+{
+    static struct SkeletonFrame frame;
+    struct ShmRingReader reader;
+    if (!shm_writer_create(&shm_writer, BENCH_SHM_NAME, futex) || !shm_reader_open(&reader, BENCH_SHM_NAME))
+    {
+        printf("Can not create shared memory %s\n", BENCH_SHM_NAME);
+        exit(1);
+    }
+
+    platform_thread_t writer;
+    platform_thread_create(&writer, shm_writer_thread, NULL);
+    while (!writer_done || reader.lastRead < (uint64_t)frames)
+    {
+        if (futex && !shm_reader_wait(&reader, 10000))
+        {
+            if (writer_done)
+                break;
+            continue;
+        }
+        if (shm_reader_latest(&reader, &frame))
+            record(frame.frameNumber);
+    }
+    platform_thread_join(writer);
+    if (reader.retries > 0)
+        printf("  %llu torn or overwritten copies retried\n", (unsigned long long)reader.retries);
+    shm_reader_close(&reader);
+    shm_writer_close(&shm_writer);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// UDP
+
+static struct UdpSender udp_sender;
+
+static PLATFORM_THREAD_RETURN udp_writer_thread(void* param)
+{
+    (void)param;
+    static struct SkeletonFrame frame;
+    static struct DatagramBatch batch;
+    int64_t start = now_nsec();
+    for (int f = 0; f < frames; f++)
+    {
+        pace(start, f);
+        make_frame(&frame, (uint32_t)f);
+        publish_times[f] = now_nsec();
+        datagram_batch_clear(&batch);
+        for (uint32_t b = 0; b < bodies; b++)
+        {
+            uint8_t* buffer = datagram_batch_reserve(&batch, SKP_MAX_DATAGRAM);
+            datagram_batch_commit(&batch, skp_write_body(&frame, b, SKP_LOCAL_ROTATIONS, buffer, SKP_MAX_DATAGRAM));
+        }
+        udp_sender_send(&udp_sender, &batch);
+    }
+    writer_done = true;
+    return PLATFORM_THREAD_RESULT;
+}
+
+static void run_udp(void)
+{
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    SOCKADDR_IN a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(BENCH_PORT);
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int buffer_size = 4 * 1024 * 1024;
+    setsockopt(s, SOL_SOCKET, SO_RCVBUF, (const char*)&buffer_size, sizeof(buffer_size));
+    struct timeval timeout = { 0, 100000 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    if (bind(s, (struct sockaddr*)&a, sizeof(a)) != 0 || !udp_sender_open(&udp_sender) ||
+        !udp_sender_add_destination(&udp_sender, "127.0.0.1", BENCH_PORT))
+    {
+        printf("Can not set up loopback UDP on port %d\n", BENCH_PORT);
+        exit(1);
+    }
+
+    platform_thread_t writer;
+    platform_thread_create(&writer, udp_writer_thread, NULL);
+    uint8_t buffer[SKP_MAX_DATAGRAM];
+    for (;;)
+    {
+        ssize_t size = recv(s, buffer, sizeof(buffer), 0);
+        if (size < SKP_BODY_HEADER_SIZE)
+        {
+            if (writer_done)
+                break;
+            continue;
+        }
+        // the frame is complete with its last body
+        if (buffer[20] + 1 == buffer[21])
+            record(skp_get_u32(buffer + 4));
+    }
+    platform_thread_join(writer);
+    udp_sender_close(&udp_sender);
+    closesocket(s);
+}
+
+int main(int argc, char** argv)
+{
+    frames = argc > 1 ? atoi(argv[1]) : 5000;
+    int rate = argc > 2 ? atoi(argv[2]) : 1000;
+    bodies = argc > 3 ? (uint32_t)atoi(argv[3]) : 4;
+    if (frames < 1 || rate < 1 || bodies < 1 || bodies > MAX_FRAME_BODIES)
+    {
+        printf("Usage: shm_bench [frames] [rate_hz] [bodies 1..%d]\n", MAX_FRAME_BODIES);
+        return 1;
+    }
+    period_nsec = 1000000000LL / rate;
+    publish_times = (int64_t*)calloc((size_t)frames, sizeof(int64_t));
+
+    printf("%d frames at %d Hz, %u bodies, frame record %zu bytes\n", frames, rate, bodies, sizeof(struct SkeletonFrame));
+    for (int mode = BENCH_SHM_SPIN; mode <= BENCH_UDP; mode++)
+    {
+        latency_stats_init(&stats, mode_names[mode]);
+        stats.unit = "ns";
+        frames_seen = 0;
+        writer_done = false;
+        if (mode == BENCH_UDP)
+            run_udp();
+        else
+            run_shm(mode == BENCH_SHM_FUTEX);
+        latency_stats_print(&stats);
+        printf("  %llu of %d frames read\n", (unsigned long long)frames_seen, frames);
+    }
+    free(publish_times);
+    return 0;
+}
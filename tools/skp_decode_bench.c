@@ -0,0 +1,164 @@
+/**==============================================
+ * @description : decode throughput of the receiver library (skp_receiver.c)
+ *  on in-memory datagrams, in order and with loss and reordering, next to
+ *  sscanf() parsing of the legacy per-joint text lines.
+ *  Usage: skp_decode_bench [bodies=4] [rounds=200]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../skp_receiver.h"
+#include "../platform.h"
+
+#define FRAMES 1000
+#define TEXT_LINE 100
+
+static uint8_t* datagrams;
+static uint16_t* sizes;
+static uint32_t* order;
+static uint32_t datagram_count;
+static uint64_t bodies_seen;
+
+static void on_frame(const struct SkeletonFrame* frame, const struct SkpFrameInfo* info, void* context)
+{
+    (void)info;
+    (void)context;
+    bodies_seen += frame->bodyCount;
+}
+
+static void build(uint32_t bodies)
+{
+    static struct SkeletonFrame frame;
+    datagram_count = FRAMES * bodies;
+    datagrams = (uint8_t*)malloc((size_t)datagram_count * SKP_MAX_DATAGRAM);
+    sizes = (uint16_t*)malloc(datagram_count * sizeof(uint16_t));
+    order = (uint32_t*)malloc(datagram_count * sizeof(uint32_t));
+
+    uint32_t n = 0;
+    for (uint32_t f = 0; f < FRAMES; f++)
+    {
+        frame.frameNumber = f;
+        frame.bodyCount = bodies;
+        for (uint32_t b = 0; b < bodies; b++)
+        {
+            frame.bodyIds[b] = b + 1;
+            frame.slots[b] = (uint8_t)b;
+            for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+            {
+                frame.positions[b][j] = vec3_make(f * 1.5f, 20.0f * j, 2000.0f + b);
+                frame.localRotations[b][j] = quat_identity();
+                frame.confidence[b][j] = 2;
+            }
+        }
+        for (uint32_t b = 0; b < bodies; b++, n++)
+        {
+            uint8_t* d = datagrams + (size_t)n * SKP_MAX_DATAGRAM;
+            sizes[n] = (uint16_t)skp_write_body(&frame, b, SKP_LOCAL_ROTATIONS, d, SKP_MAX_DATAGRAM);
+            skp_put_u32(d + SKP_SEQUENCE_OFFSET, n);
+        }
+    }
+}
+
+// In order, or with ~1% loss and ~2% adjacent swaps
+static uint32_t make_order(bool impaired)
+{
+    uint32_t count = 0;
+    srand(1);
+    for (uint32_t i = 0; i < datagram_count; i++)
+    {
+        if (impaired && rand() % 100 == 0)
+            continue;
+        order[count++] = i;
+    }
+    for (uint32_t i = 1; impaired && i < count; i++)
+    {
+        if (rand() % 50 == 0)
+        {
+            uint32_t t = order[i];
+            order[i] = order[i - 1];
+            order[i - 1] = t;
+        }
+    }
+    return count;
+}
+
+static void bench_binary(const char* name, bool impaired, int rounds)
+{
+    static struct SkpReceiver receiver;
+    uint32_t count = make_order(impaired);
+    uint64_t bytes = 0;
+    bodies_seen = 0;
+
+    int64_t start = monotonic_usec();
+    for (int r = 0; r < rounds; r++)
+    {
+        skp_receiver_init(&receiver, on_frame, NULL, NULL);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t k = order[i];
+            skp_receiver_push(&receiver, datagrams + (size_t)k * SKP_MAX_DATAGRAM, sizes[k], 0);
+            bytes += sizes[k];
+        }
+        skp_receiver_flush(&receiver, receiver.timeoutUsec + 1);
+    }
+    double sec = (double)(monotonic_usec() - start) / 1e6;
+
+    printf("%-22s %8.0f ns/datagram %8.1f MB/s %8.2f M bodies/s  (complete %llu, partial %llu, lost %llu, reordered %llu)\n",
+           name, sec * 1e9 / ((double)count * rounds), bytes / sec / 1e6, bodies_seen / sec / 1e6,
+           (unsigned long long)receiver.stats.framesComplete, (unsigned long long)receiver.stats.framesPartial,
+           (unsigned long long)receiver.stats.lost, (unsigned long long)receiver.stats.reordered);
+}
+
+// Legacy text stream: one line per joint, parsed with sscanf
+static void bench_text(uint32_t bodies, int rounds)
+{
+    uint32_t lines = bodies * SKELETON_JOINT_COUNT * 50;
+    char* text = (char*)calloc(lines, TEXT_LINE);
+    for (uint32_t i = 0; i < lines; i++)
+        snprintf(text + (size_t)i * TEXT_LINE, TEXT_LINE, "Frame: %d, Body ID[%u], Joint[%d]: Position[mm] ( %f, %f, %f ); \n",
+                 (int)(i / (bodies * SKELETON_JOINT_COUNT)), i % bodies + 1, (int)(i % SKELETON_JOINT_COUNT),
+                 i * 1.5f, 20.0f, 2000.0f);
+
+    int text_rounds = rounds / 10 > 0 ? rounds / 10 : 1;
+    int64_t start = monotonic_usec();
+    uint64_t parsed = 0;
+    for (int r = 0; r < text_rounds; r++)
+    {
+        for (uint32_t i = 0; i < lines; i++)
+        {
+            int frame, joint;
+            unsigned id;
+            float x, y, z;
+            if (sscanf(text + (size_t)i * TEXT_LINE, "Frame: %d, Body ID[%u], Joint[%d]: Position[mm] ( %f, %f, %f );",
+                       &frame, &id, &joint, &x, &y, &z) == 6)
+                parsed++;
+        }
+    }
+    double sec = (double)(monotonic_usec() - start) / 1e6;
+    printf("%-22s %8.0f ns/line     %8.1f MB/s %8.2f M bodies/s\n", "text, sscanf", sec * 1e9 / parsed,
+           parsed * TEXT_LINE / sec / 1e6, parsed / (double)SKELETON_JOINT_COUNT / sec / 1e6);
+    free(text);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t bodies = argc > 1 ? (uint32_t)atoi(argv[1]) : 4;
+    int rounds = argc > 2 ? atoi(argv[2]) : 200;
+    if (bodies < 1 || bodies > MAX_FRAME_BODIES || rounds < 1)
+    {
+        printf("Usage: skp_decode_bench [bodies 1..%d] [rounds]\n", MAX_FRAME_BODIES);
+        return 1;
+    }
+
+    build(bodies);
+    printf("%u frames x %u bodies, %u byte datagrams, %d rounds\n", FRAMES, bodies, sizes[0], rounds);
+    bench_binary("binary, in order", false, rounds);
+    bench_binary("binary, loss+reorder", true, rounds);
+    bench_text(bodies, rounds);
+
+    free(datagrams);
+    free(sizes);
+    free(order);
+    return 0;
+}
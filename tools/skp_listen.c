@@ -0,0 +1,273 @@
+/**==============================================
+ * @description : local stand-in for the Unreal receiver. Listens for the
+ *  binary skeleton stream with the receiver library and prints once per
+ *  second: frames, bodies, loss, FEC repairs, frame age and the pelvis of the
+ *  first body. Sends feedback to the sender every second, so --encoding auto
+ *  adapts to it; max kbit/s caps the stream it asks for. Pings the sender
+ *  every 250 ms to map capture times into the local clock. Slot, zone and
+ *  gesture events are printed as they arrive, the newest pose match with
+ *  the once per second line. Bodies of the pca encoding are decoded with the
+ *  pose basis file the sender uses, if given; the line shows their largest
+ *  reconstruction error. Retargeted poses (--retarget) add the root of the
+ *  newest one and how many of its chain ends are held.
+ *  Usage: skp_listen [port=8080] [multicast group] [interface=0.0.0.0] [max kbit/s=0]
+ *                    [pose basis]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include "../skp_receiver.h"
+#include "../skp_stream.h"
+#include "../udp_sender.h"
+
+static volatile sig_atomic_t stop;
+static uint64_t bodies_seen;
+static struct SkeletonFrame last_frame;
+static int64_t age_sum, age_min, age_max;
+static uint64_t aged_frames;
+static struct PoseMatchResult last_match;
+static bool have_match;
+static float pca_error;// mm, largest since the last line
+static struct RetargetPose last_pose;
+static int last_pose_bones;
+static uint64_t poses_seen;
+
+#define PING_INTERVAL_USEC 250000
+
+static void inthand(int signum)
+{
+    (void)signum;
+    stop = 1;
+}
+
+static void on_frame(const struct SkeletonFrame* frame, const struct SkpFrameInfo* info, void* context)
+{
+    (void)context;
+    if (info->clockSynced)
+    {
+        if (aged_frames == 0 || info->ageUsec < age_min)
+            age_min = info->ageUsec;
+        if (aged_frames == 0 || info->ageUsec > age_max)
+            age_max = info->ageUsec;
+        age_sum += info->ageUsec;
+        aged_frames++;
+    }
+    bodies_seen += frame->bodyCount;
+    if (info->pcaErrorMm > pca_error)
+        pca_error = info->pcaErrorMm;
+    last_frame.frameNumber = frame->frameNumber;
+    last_frame.bodyCount = frame->bodyCount;
+    if (frame->bodyCount > 0)
+    {
+        last_frame.bodyIds[0] = frame->bodyIds[0];
+        last_frame.slots[0] = frame->slots[0];
+        last_frame.positions[0][JOINT_PELVIS] = frame->positions[0][JOINT_PELVIS];
+    }
+}
+
+static void on_slot_events(uint32_t frame_number, const struct BodySlotEvent* events, int count, void* context)
+{
+    (void)context;
+    for (int i = 0; i < count; i++)
+        printf("frame %u: %s slot %u (body %u)\n", frame_number,
+               events[i].type == BODY_SLOT_SPAWN ? "spawn" : "despawn", events[i].slot, events[i].bodyId);
+}
+
+static void on_zone_events(uint32_t frame_number, const struct ZoneEvent* events, int count, void* context)
+{
+    (void)context;
+    static const char* names[] = { "?", "enter", "exit", "near", "apart" };
+    for (int i = 0; i < count; i++)
+    {
+        const struct ZoneEvent* e = &events[i];
+        if (e->type == ZONE_NEAR || e->type == ZONE_APART)
+            printf("frame %u: body %u %s body %u (rule %u)\n", frame_number, e->bodyId, names[e->type],
+                   e->otherBodyId, e->id);
+        else
+            printf("frame %u: body %u %s zone %u\n", frame_number, e->bodyId, names[e->type <= ZONE_EXIT ? e->type : 0],
+                   e->id);
+    }
+}
+
+static void on_gesture_events(uint32_t frame_number, const struct GestureEvent* events, int count, void* context)
+{
+    (void)context;
+    for (int i = 0; i < count; i++)
+        printf("frame %u: body %u %s gesture %u\n", frame_number, events[i].bodyId,
+               events[i].type == GESTURE_START ? "starts" : "ends", events[i].id);
+}
+
+static void on_pose_matches(uint32_t frame_number, const struct PoseMatchResult* matches, int count, void* context)
+{
+    (void)frame_number;
+    (void)count;
+    (void)context;
+    last_match = matches[0];
+    have_match = true;
+}
+
+static void on_retargeted(uint32_t frame_number, const struct RetargetPose* poses, int count, int bone_count,
+                          void* context)
+{
+    (void)frame_number;
+    (void)context;
+    last_pose = poses[0];
+    last_pose_bones = bone_count;
+    poses_seen += (uint64_t)count;
+}
+
+int main(int argc, char** argv)
+{
+    uint16_t port = (uint16_t)(argc > 1 ? atoi(argv[1]) : 8080);
+    const char* group = argc > 2 ? argv[2] : NULL;
+    const char* interface_address = argc > 3 ? argv[3] : "0.0.0.0";
+    uint32_t max_kbps = (uint32_t)(argc > 4 ? strtoul(argv[4], NULL, 10) : 0);
+    static struct PoseBasis basis;
+    if (argc > 5 && !pose_basis_load(&basis, argv[5]))
+    {
+        printf("Can not read pose basis %s\n", argv[5]);
+        return 1;
+    }
+
+    net_startup();
+    SOCKET s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    int on = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+    SOCKADDR_IN a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_port = htons(port);
+    a.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(s, (struct sockaddr*)&a, sizeof(a)) != 0)
+    {
+        printf("Can not bind port %u\n", port);
+        return 1;
+    }
+    if (group != NULL)
+    {
+        struct ip_mreq membership;
+        inet_pton(AF_INET, group, &membership.imr_multiaddr);
+        inet_pton(AF_INET, interface_address, &membership.imr_interface);
+        if (setsockopt(s, IPPROTO_IP, IP_ADD_MEMBERSHIP, (const char*)&membership, sizeof(membership)) != 0)
+        {
+            printf("Can not join %s\n", group);
+            return 1;
+        }
+    }
+    struct timeval timeout = { 0, 20000 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    signal(SIGINT, inthand);
+
+    static struct SkpReceiver receiver;
+    skp_receiver_init(&receiver, on_frame, on_slot_events, NULL);
+    receiver.onZoneEvents = on_zone_events;
+    receiver.onGestureEvents = on_gesture_events;
+    receiver.onPoseMatches = on_pose_matches;
+    receiver.onRetargeted = on_retargeted;
+    if (argc > 5)
+        receiver.basis = &basis;
+    static struct SkpFecDecoder fec;
+    skp_fec_decoder_init(&fec);
+    printf("Listening on port %u%s%s\n", port, group ? ", group " : "", group ? group : "");
+
+    uint8_t buffer[SKP_MAX_PARITY];
+    int64_t last_print = monotonic_usec();
+    struct SkpReceiverStats last = receiver.stats;
+    struct SkpFecStats last_fec = fec.stats;
+    SOCKADDR_IN source;
+    bool have_source = false;
+    int64_t processing_usec = 0;
+    int64_t next_ping = 0;
+    while (!stop)
+    {
+        SOCKADDR_IN from;
+        socklen_t from_length = sizeof(from);
+        ssize_t size = recvfrom(s, (char*)buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &from_length);
+        int64_t now = monotonic_usec();
+        if (size > 0)
+        {
+            source = from;
+            have_source = true;
+            skp_fec_push(&fec, &receiver, buffer, (size_t)size, now);
+            processing_usec += monotonic_usec() - now;
+        }
+        else
+            skp_receiver_flush(&receiver, now);
+
+        if (have_source && now >= next_ping)
+        {
+            uint8_t ping[SKP_PING_SIZE];
+            size_t n = skp_receiver_write_ping(&receiver, monotonic_usec(), ping, sizeof(ping));
+            sendto(s, (const char*)ping, (int)n, 0, (struct sockaddr*)&source, sizeof(source));
+            next_ping = now + PING_INTERVAL_USEC;
+        }
+
+        if (now - last_print >= 1000000)
+        {
+            const struct SkpReceiverStats* st = &receiver.stats;
+            uint64_t frames = st->framesComplete + st->framesPartial - last.framesComplete - last.framesPartial;
+            if (have_source)
+            {
+                uint8_t feedback[SKP_FEEDBACK_SIZE];
+                uint32_t per_frame = frames > 0 ? (uint32_t)(processing_usec / (int64_t)frames) : 0;
+                size_t n = skp_receiver_write_feedback(&receiver, per_frame, max_kbps, now, feedback, sizeof(feedback));
+                sendto(s, (const char*)feedback, (int)n, 0, (struct sockaddr*)&source, sizeof(source));
+            }
+            processing_usec = 0;
+            printf("frames %llu complete %llu partial, %llu bodies, lost %llu, reordered %llu, duplicates %llu, late %llu, "
+                   "malformed %llu, jitter %u us",
+                   (unsigned long long)(st->framesComplete - last.framesComplete),
+                   (unsigned long long)(st->framesPartial - last.framesPartial), (unsigned long long)bodies_seen,
+                   (unsigned long long)(st->lost - last.lost), (unsigned long long)(st->reordered - last.reordered),
+                   (unsigned long long)(st->duplicates - last.duplicates), (unsigned long long)(st->late - last.late),
+                   (unsigned long long)(st->malformed - last.malformed), st->jitterUsec);
+            if (fec.stats.parity > 0)
+                printf(", recovered %llu, unrecoverable %llu, dropped %llu",
+                       (unsigned long long)(fec.stats.recovered - last_fec.recovered),
+                       (unsigned long long)(fec.stats.unrecoverable - last_fec.unrecoverable),
+                       (unsigned long long)(fec.stats.dropped - last_fec.dropped));
+            if (aged_frames > 0)
+                printf(", age %.1f/%.1f/%.1f ms (offset %+.3f ms, rtt %.3f ms)", age_min / 1000.0,
+                       age_sum / (double)aged_frames / 1000.0, age_max / 1000.0, receiver.clock.offsetUsec / 1000.0,
+                       receiver.clock.rttUsec / 1000.0);
+            aged_frames = 0;
+            age_sum = 0;
+            if (pca_error > 0.0f)
+                printf(", pca error %.1f mm", pca_error);
+            if (st->unknownBasis > last.unknownBasis)
+                printf(", %llu bodies of another pose basis",
+                       (unsigned long long)(st->unknownBasis - last.unknownBasis));
+            pca_error = 0.0f;
+            if (last_frame.bodyCount > 0)
+            {
+                vec3_t p = last_frame.positions[0][JOINT_PELVIS];
+                printf(" | frame %u slot %u pelvis (%.0f, %.0f, %.0f) mm", last_frame.frameNumber,
+                       last_frame.slots[0], p.x, p.y, p.z);
+            }
+            if (have_match)
+                printf(" | body %u matches clip %u frame %u (%.2f)", last_match.bodyId, last_match.clip,
+                       last_match.frame, last_match.distance);
+            have_match = false;
+            if (poses_seen > 0)
+            {
+                int held = 0;
+                for (uint8_t mask = last_pose.lockMask; mask != 0; mask &= (uint8_t)(mask - 1))
+                    held++;
+                printf(" | %llu poses of %d bones, body %u root (%.0f, %.0f, %.0f) mm, %d ends held",
+                       (unsigned long long)poses_seen, last_pose_bones, last_pose.bodyId, last_pose.root.x,
+                       last_pose.root.y, last_pose.root.z, held);
+            }
+            poses_seen = 0;
+            printf("\n");
+            bodies_seen = 0;
+            last = *st;
+            last_fec = fec.stats;
+            last_print = now;
+        }
+    }
+    closesocket(s);
+    net_cleanup();
+    return 0;
+}
@@ -0,0 +1,148 @@
+/**==============================================
+ * @description : cost of rendering the legacy text protocol for one frame:
+ *  snprintf() into one 100-byte datagram per joint (the old send_data),
+ *  snprintf() packed into one datagram per body, and text_format.c. Checks
+ *  that text_format.c prints exactly what snprintf() prints, on random
+ *  frames and on edge values (ties, -0, saturation).
+ *  Usage: text_format_bench [bodies=6] [frames=20000]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../text_format.h"
+#include "../platform.h"
+
+#define LEGACY_DATAGRAM 100
+#define LINE_FORMAT "Frame: %u, Body ID[%u], Joint[%d]: Position[mm] ( %f, %f, %f ); \n"
+
+static struct SkeletonFrame frame;
+static char output[MAX_FRAME_BODIES * TEXT_FORMAT_MAX_BODY];
+static char expected[MAX_FRAME_BODIES * TEXT_FORMAT_MAX_BODY];
+static volatile size_t sink;
+
+static uint32_t rng = 12345;
+static float random_mm(void)
+{
+    rng = rng * 1664525u + 1013904223u;
+    return ((float)(rng >> 8) / 16777216.0f - 0.5f) * 8000.0f;
+}
+
+static void make_frame(uint32_t bodies, uint32_t number)
+{
+    frame.frameNumber = number;
+    frame.bodyCount = bodies;
+    for (uint32_t b = 0; b < bodies; b++)
+    {
+        frame.bodyIds[b] = number * 7 + b + 1;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+            frame.positions[b][j] = vec3_make(random_mm(), random_mm(), random_mm());
+    }
+}
+
+static size_t format_legacy(char* out)
+{
+    size_t used = 0;
+    for (uint32_t b = 0; b < frame.bodyCount; b++)
+    {
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++, used += LEGACY_DATAGRAM)
+        {
+            vec3_t p = frame.positions[b][j];
+            memset(out + used, 0, LEGACY_DATAGRAM);
+            snprintf(out + used, LEGACY_DATAGRAM, LINE_FORMAT, frame.frameNumber, frame.bodyIds[b], j, p.x, p.y, p.z);
+        }
+    }
+    return used;
+}
+
+static size_t format_snprintf(char* out)
+{
+    size_t used = 0;
+    for (uint32_t b = 0; b < frame.bodyCount; b++)
+    {
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            vec3_t p = frame.positions[b][j];
+            used += (size_t)snprintf(out + used, TEXT_FORMAT_MAX_LINE, LINE_FORMAT, frame.frameNumber,
+                                     frame.bodyIds[b], j, p.x, p.y, p.z);
+        }
+    }
+    return used;
+}
+
+static size_t format_fast(char* out)
+{
+    size_t used = 0;
+    for (uint32_t b = 0; b < frame.bodyCount; b++)
+        used += text_format_body(&frame, b, out + used, TEXT_FORMAT_MAX_BODY);
+    return used;
+}
+
+static double bench(size_t (*format)(char*), uint32_t bodies, int frames)
+{
+    int64_t start = monotonic_usec();
+    for (int f = 0; f < frames; f++)
+    {
+        frame.frameNumber = (uint32_t)f;
+        sink += format(output);
+    }
+    (void)bodies;
+    return (double)(monotonic_usec() - start) * 1000.0 / frames;
+}
+
+static bool same_output(void)
+{
+    size_t n = format_fast(output);
+    size_t m = format_snprintf(expected);
+    return n == m && memcmp(output, expected, n) == 0;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t bodies = (uint32_t)(argc > 1 ? atoi(argv[1]) : 6);
+    int frames = argc > 2 ? atoi(argv[2]) : 20000;
+    if (bodies < 1 || bodies > MAX_FRAME_BODIES)
+    {
+        printf("bodies must be 1..%d\n", MAX_FRAME_BODIES);
+        return 1;
+    }
+
+    // random frames, then values where rounding or signs are easy to get wrong
+    int mismatches = 0;
+    for (uint32_t f = 0; f < 20000; f++)
+    {
+        make_frame(bodies, f * 104729u);
+        if (!same_output())
+            mismatches++;
+    }
+    static const float edges[] = { 0.0f, -0.0f, 0.0625f, -0.0625f, 0.0000005f, -0.0000004f, 1.5e-7f, 2.5f,
+                                   999999.9999995f, -1234.5678f, 4294967.5f, 1e9f, -1e9f, 3.0e-45f };
+    int edge_count = (int)(sizeof(edges) / sizeof(edges[0]));
+    make_frame(1, 4294967295u);
+    frame.bodyIds[0] = 4294967295u;
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        frame.positions[0][j] = vec3_make(edges[j % edge_count], edges[(j + 5) % edge_count], edges[(j + 9) % edge_count]);
+    if (!same_output())
+        mismatches++;
+    size_t longest = format_snprintf(expected) / SKELETON_JOINT_COUNT;
+
+    make_frame(bodies, 1);
+    size_t packed_size = format_fast(output);
+    double legacy = bench(format_legacy, bodies, frames);
+    double packed = bench(format_snprintf, bodies, frames);
+    double fast = bench(format_fast, bodies, frames);
+
+    printf("%u bodies per frame, %d frames\n", bodies, frames);
+    printf("%-28s %9.0f ns/frame  %4u datagrams of %d bytes\n", "snprintf, datagram per joint", legacy,
+           bodies * SKELETON_JOINT_COUNT, LEGACY_DATAGRAM);
+    printf("%-28s %9.0f ns/frame  %4u datagrams of ~%zu bytes\n", "snprintf, datagram per body", packed, bodies,
+           packed_size / bodies);
+    printf("%-28s %9.0f ns/frame  %.1fx faster than snprintf per body\n", "text_format", fast, packed / fast);
+    printf("identical output: %s (%d mismatching frames), longest edge line %zu bytes\n",
+           mismatches == 0 ? "yes" : "no", mismatches, longest);
+
+    bool ok = mismatches == 0 && fast < packed;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
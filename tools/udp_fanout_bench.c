@@ -0,0 +1,122 @@
+/**==============================================
+ * @description : measures the cost of sending one binary skeleton frame to
+ *  1..N loopback receivers with udp_sender.c (one sendmmsg() per frame)
+ *  against a plain sendto() loop per destination.
+ *  Usage: udp_fanout_bench [receivers=10] [bodies=4] [frames=20000]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../udp_sender.h"
+#include "../protocol.h"
+
+static struct SkeletonFrame frame;
+static struct DatagramBatch batch;
+
+static void make_frame(uint32_t bodies)
+{
+    frame.frameNumber = 1;
+    frame.bodyCount = bodies;
+    for (uint32_t b = 0; b < bodies; b++)
+    {
+        frame.bodyIds[b] = b + 1;
+        frame.slots[b] = (uint8_t)b;
+        for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        {
+            frame.positions[b][j] = vec3_make(100.0f * b, 20.0f * j, 2000.0f);
+            frame.worldRotations[b][j] = quat_identity();
+            frame.localRotations[b][j] = quat_identity();
+            frame.confidence[b][j] = 2;
+        }
+    }
+}
+
+// Open a loopback receiver on an ephemeral port and return its port
+static uint16_t open_receiver(SOCKET* s)
+{
+    *s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    SOCKADDR_IN a;
+    memset(&a, 0, sizeof(a));
+    a.sin_family = AF_INET;
+    a.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(*s, (struct sockaddr*)&a, sizeof(a));
+    socklen_t length = sizeof(a);
+    getsockname(*s, (struct sockaddr*)&a, &length);
+    return ntohs(a.sin_port);
+}
+
+// Receivers are never read: loopback drops what overflows their buffers,
+// which does not change the sender side being measured.
+static double bench_sender(struct UdpSender* sender, int frames)
+{
+    int64_t start = monotonic_usec();
+    for (int f = 0; f < frames; f++)
+        udp_sender_send(sender, &batch);
+    return (double)(monotonic_usec() - start) / frames;
+}
+
+static double bench_sendto(SOCKET s, const SOCKADDR_IN* destinations, int count, int frames)
+{
+    int64_t start = monotonic_usec();
+    for (int f = 0; f < frames; f++)
+    {
+        for (uint32_t i = 0; i < batch.count; i++)
+        {
+            for (int k = 0; k < count; k++)
+                sendto(s, (const char*)batch.data + batch.offsets[i], batch.sizes[i], 0,
+                       (const struct sockaddr*)&destinations[k], sizeof(destinations[k]));
+        }
+    }
+    return (double)(monotonic_usec() - start) / frames;
+}
+
+int main(int argc, char** argv)
+{
+    int receivers = argc > 1 ? atoi(argv[1]) : 10;
+    uint32_t bodies = argc > 2 ? (uint32_t)atoi(argv[2]) : 4;
+    int frames = argc > 3 ? atoi(argv[3]) : 20000;
+    if (receivers < 1 || receivers > MAX_DESTINATIONS || bodies < 1 || bodies > MAX_FRAME_BODIES)
+    {
+        printf("Usage: udp_fanout_bench [receivers 1..%d] [bodies 1..%d] [frames]\n", MAX_DESTINATIONS, MAX_FRAME_BODIES);
+        return 1;
+    }
+
+    net_startup();
+    make_frame(bodies);
+    datagram_batch_clear(&batch);
+    for (uint32_t b = 0; b < bodies; b++)
+    {
+        uint8_t* buffer = datagram_batch_reserve(&batch, SKP_MAX_DATAGRAM);
+        datagram_batch_commit(&batch, skp_write_body(&frame, b, SKP_LOCAL_ROTATIONS, buffer, SKP_MAX_DATAGRAM));
+    }
+    printf("%u datagrams of %u bytes per frame, %d frames\n", batch.count, batch.sizes[0], frames);
+    printf("%-10s %16s %16s %10s\n", "receivers", "sendmmsg us/frm", "sendto us/frm", "errors");
+
+    SOCKET sinks[MAX_DESTINATIONS];
+    SOCKADDR_IN addresses[MAX_DESTINATIONS];
+    static struct UdpSender sender;
+    udp_sender_open(&sender);
+    for (int n = 1; n <= receivers; n++)
+    {
+        uint16_t port = open_receiver(&sinks[n - 1]);
+        udp_sender_add_destination(&sender, "127.0.0.1", port);
+        addresses[n - 1] = sender.destinations[n - 1].address;
+        if (n != 1 && n != 2 && n != 5 && n != receivers)
+            continue;
+
+        double mmsg = bench_sender(&sender, frames);
+        double plain = bench_sendto(sender.socket, addresses, n, frames);
+        uint64_t errors = 0;
+        for (int k = 0; k < n; k++)
+            errors += sender.destinations[k].errors;
+        printf("%-10d %16.2f %16.2f %10llu\n", n, mmsg, plain, (unsigned long long)errors);
+    }
+
+    udp_sender_close(&sender);
+    for (int n = 0; n < receivers; n++)
+        closesocket(sinks[n]);
+    net_cleanup();
+    return 0;
+}
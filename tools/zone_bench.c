@@ -0,0 +1,316 @@
+/**==============================================
+ * @description : zone and proximity events on a simulated hall. People walk
+ *  through a 20 x 20 m hall full of box and polygon zones (some watching any
+ *  joint, a few covering the whole hall) and drop out of tracking now and
+ *  then. Frames of up to 16 bodies arrive per camera, as from the output
+ *  stage. Every event of the grid-based engine is checked against a brute
+ *  force evaluation of every zone and pair, and the update time is measured.
+ *  Usage: zone_bench [zones=500] [people=48] [steps=3000]
+ *=============================================**/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "../zone_events.h"
+#include "../platform.h"
+
+#define HALL_MM 20000.0f
+#define STEP_USEC 33333
+#define RULES 3
+#define MAX_PEOPLE 64
+#define DROPOUT_RATE 0.002f     // per person and step
+#define DROPOUT_STEPS 30        // about a second, longer than lostUsec
+#define MAX_P99_USEC 500
+
+static struct ZoneEngine engine;
+static struct SkeletonFrame frame;
+static vec3_t skeleton_template[SKELETON_JOINT_COUNT];
+
+// brute force reference state, by person
+static bool ref_inside[MAX_PEOPLE][ZONE_MAX_ZONES];
+static bool ref_near[RULES][MAX_PEOPLE][MAX_PEOPLE];
+static bool ref_active[MAX_PEOPLE];
+static int64_t ref_seen[MAX_PEOPLE];
+static vec3_t ref_joints[MAX_PEOPLE][SKELETON_JOINT_COUNT];
+static struct ZoneEvent expected[4 * ZONE_MAX_EVENTS];
+static int expected_count;
+
+static uint32_t rng = 123456789u;
+static float random_unit(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (float)(rng >> 8) / 16777216.0f;
+}
+
+static void add_zones(int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float cx = random_unit() * HALL_MM, cy = random_unit() * HALL_MM;
+        int joint = random_unit() < 0.1f ? ZONE_JOINT_ANY : (random_unit() < 0.8f ? JOINT_PELVIS : JOINT_HAND_RIGHT);
+        if (i < 3)
+        {
+            // whole hall, below and above the waist
+            float z0 = i == 0 ? 0.0f : 1000.0f;
+            zone_engine_add_box(&engine, (uint16_t)i, vec3_make(-1000.0f, -1000.0f, z0),
+                                vec3_make(HALL_MM + 1000.0f, HALL_MM + 1000.0f, z0 + 1000.0f), joint);
+        }
+        else if (i % 2 == 0)
+        {
+            vec3_t half = vec3_make(300.0f + random_unit() * 700.0f, 300.0f + random_unit() * 700.0f, 0.0f);
+            zone_engine_add_box(&engine, (uint16_t)i, vec3_make(cx - half.x, cy - half.y, 0.0f),
+                                vec3_make(cx + half.x, cy + half.y, 800.0f + random_unit() * 1500.0f), joint);
+        }
+        else
+        {
+            // star-shaped polygon, concave now and then
+            float xy[8][2];
+            int n = 3 + (int)(random_unit() * 6.0f);
+            for (int v = 0; v < n; v++)
+            {
+                float angle = 6.2831853f * (float)v / (float)n;
+                float r = 400.0f + random_unit() * 900.0f;
+                xy[v][0] = cx + r * cosf(angle);
+                xy[v][1] = cy + r * sinf(angle);
+            }
+            zone_engine_add_polygon(&engine, (uint16_t)i, 0.0f, 2500.0f, (const float (*)[2])xy, n, joint);
+        }
+    }
+    zone_engine_add_rule(&engine, 0, 800.0f, JOINT_PELVIS, JOINT_PELVIS);
+    zone_engine_add_rule(&engine, 1, 400.0f, JOINT_HAND_RIGHT, JOINT_HAND_RIGHT);
+    zone_engine_add_rule(&engine, 2, 600.0f, JOINT_HAND_LEFT, JOINT_HEAD);
+}
+
+// Person wanders the hall with swinging hands (z up)
+static void person_at(int person, int64_t t_usec, vec3_t* joints)
+{
+    float s = (float)t_usec * 1e-6f;
+    float phase = (float)person * 2.39996f;
+    float x = HALL_MM * (0.5f + 0.45f * sinf(s * 0.05f * (1.0f + 0.1f * (float)(person % 7)) + phase));
+    float y = HALL_MM * (0.5f + 0.45f * sinf(s * 0.043f * (1.0f + 0.07f * (float)(person % 5)) + 2.0f * phase));
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        float swing = (j == JOINT_HAND_LEFT || j == JOINT_HAND_RIGHT) ? 300.0f * sinf(s * 3.0f + phase) : 0.0f;
+        joints[j] = vec3_add(vec3_make(x + swing, y, 950.0f), skeleton_template[j]);
+    }
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Brute force reference
+
+static bool ref_contains(const struct Zone* z, vec3_t p, float margin)
+{
+    if (p.z < z->min[2] - margin || p.z > z->max[2] + margin)
+        return false;
+    if (z->shape == ZONE_BOX)
+        return p.x >= z->min[0] - margin && p.x <= z->max[0] + margin && p.y >= z->min[1] - margin &&
+               p.y <= z->max[1] + margin;
+
+    // winding number, then distance to every edge
+    const float (*v)[2] = (const float (*)[2])engine.vertices[z->firstVertex];
+    int winding = 0;
+    float best = 1e30f;
+    for (int i = 0; i < z->vertexCount; i++)
+    {
+        const float* a = v[i];
+        const float* b = v[(i + 1) % z->vertexCount];
+        float cross = (b[0] - a[0]) * (p.y - a[1]) - (p.x - a[0]) * (b[1] - a[1]);
+        if (a[1] <= p.y && b[1] > p.y && cross > 0.0f)
+            winding++;
+        else if (a[1] > p.y && b[1] <= p.y && cross < 0.0f)
+            winding--;
+        float ex = b[0] - a[0], ey = b[1] - a[1];
+        float t = ((p.x - a[0]) * ex + (p.y - a[1]) * ey) / (ex * ex + ey * ey);
+        t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+        float dx = p.x - a[0] - t * ex, dy = p.y - a[1] - t * ey;
+        best = fminf(best, sqrtf(dx * dx + dy * dy));
+    }
+    return winding != 0 || best <= margin;
+}
+
+static void expect(uint8_t type, uint16_t id, uint32_t body, uint32_t other)
+{
+    struct ZoneEvent* e = &expected[expected_count++];
+    e->type = type;
+    e->id = id;
+    e->bodyId = body < other || type == ZONE_ENTER || type == ZONE_EXIT ? body : other;
+    e->otherBodyId = body < other || type == ZONE_ENTER || type == ZONE_EXIT ? other : body;
+}
+
+static void ref_update(int people, int64_t now)
+{
+    float margin = engine.config.marginMm;
+    for (uint32_t b = 0; b < frame.bodyCount; b++)
+    {
+        int p = (int)frame.bodyIds[b] - 1;
+        ref_active[p] = true;
+        ref_seen[p] = frame.timestampUsec;
+        memcpy(ref_joints[p], frame.positions[b], sizeof(ref_joints[p]));
+        for (int z = 0; z < engine.zoneCount; z++)
+        {
+            const struct Zone* zone = &engine.zones[z];
+            bool in = false;
+            for (int j = 0; j < SKELETON_JOINT_COUNT && !in; j++)
+            {
+                if (zone->joint == ZONE_JOINT_ANY || zone->joint == j)
+                    in = ref_contains(zone, ref_joints[p][j], ref_inside[p][z] ? margin : 0.0f);
+            }
+            if (in != ref_inside[p][z])
+                expect(in ? ZONE_ENTER : ZONE_EXIT, zone->id, (uint32_t)p + 1, 0);
+            ref_inside[p][z] = in;
+        }
+    }
+    for (int p = 0; p < people; p++)
+    {
+        if (!ref_active[p] || now - ref_seen[p] <= engine.config.lostUsec)
+            continue;
+        for (int z = 0; z < engine.zoneCount; z++)
+        {
+            if (ref_inside[p][z])
+                expect(ZONE_EXIT, engine.zones[z].id, (uint32_t)p + 1, 0);
+            ref_inside[p][z] = false;
+        }
+        for (int r = 0; r < RULES; r++)
+        {
+            for (int q = 0; q < people; q++)
+            {
+                if (ref_near[r][p][q])
+                    expect(ZONE_APART, (uint16_t)r, (uint32_t)p + 1, (uint32_t)q + 1);
+                ref_near[r][p][q] = ref_near[r][q][p] = false;
+            }
+        }
+        ref_active[p] = false;
+    }
+    for (int r = 0; r < RULES; r++)
+    {
+        const struct ZoneRule* rule = &engine.rules[r];
+        for (int p = 0; p < people; p++)
+        {
+            for (int q = p + 1; q < people; q++)
+            {
+                bool near = false;
+                if (ref_active[p] && ref_active[q])
+                {
+                    float d = fminf(vec3_length(vec3_sub(ref_joints[p][rule->jointB], ref_joints[q][rule->jointA])),
+                                    vec3_length(vec3_sub(ref_joints[q][rule->jointB], ref_joints[p][rule->jointA])));
+                    near = d < rule->distanceMm || (ref_near[r][p][q] && d <= rule->distanceMm + margin);
+                }
+                if (near != ref_near[r][p][q])
+                    expect(near ? ZONE_NEAR : ZONE_APART, rule->id, (uint32_t)p + 1, (uint32_t)q + 1);
+                ref_near[r][p][q] = ref_near[r][q][p] = near;
+            }
+        }
+    }
+}
+
+static int compare_events(const void* a, const void* b)
+{
+    const struct ZoneEvent* x = (const struct ZoneEvent*)a;
+    const struct ZoneEvent* y = (const struct ZoneEvent*)b;
+    if (x->type != y->type)
+        return x->type - y->type;
+    if (x->id != y->id)
+        return x->id - y->id;
+    if (x->bodyId != y->bodyId)
+        return x->bodyId < y->bodyId ? -1 : 1;
+    return (x->otherBodyId > y->otherBodyId) - (x->otherBodyId < y->otherBodyId);
+}
+
+int main(int argc, char** argv)
+{
+    int zones = argc > 1 ? atoi(argv[1]) : 500;
+    int people = argc > 2 ? atoi(argv[2]) : 48;
+    int steps = argc > 3 ? atoi(argv[3]) : 3000;
+    if (zones < 3 || zones > ZONE_MAX_ZONES || people < 1 || people > MAX_PEOPLE)
+    {
+        printf("zones must be 3..%d and people 1..%d\n", ZONE_MAX_ZONES, MAX_PEOPLE);
+        return 1;
+    }
+
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+        skeleton_template[j] = vec3_make((float)(j % 5) * 60.0f - 120.0f, (float)(j % 3) * 50.0f - 50.0f,
+                                         (float)j * 30.0f - 300.0f);
+    zone_engine_init(&engine, NULL);
+    add_zones(zones);
+    if (!zone_engine_build(&engine))
+    {
+        printf("zone grid overflow\n");
+        return 1;
+    }
+
+    static int dropout[MAX_PEOPLE];
+    static struct ZoneEvent got[ZONE_MAX_EVENTS];
+    uint64_t updates = 0, events = 0, mismatches = 0, enters = 0, nears = 0;
+    int64_t total_usec = 0;
+    for (int step = 0; step < steps; step++)
+    {
+        int64_t t = 1000000 + (int64_t)step * STEP_USEC;
+        for (int p = 0; p < people; p++)
+        {
+            if (dropout[p] > 0)
+                dropout[p]--;
+            else if (random_unit() < DROPOUT_RATE)
+                dropout[p] = DROPOUT_STEPS;
+        }
+
+        // one frame per camera, 16 people each
+        for (int first = 0; first < people; first += MAX_FRAME_BODIES)
+        {
+            frame.frameNumber = (uint32_t)step + 1;
+            frame.timestampUsec = t;
+            frame.bodyCount = 0;
+            for (int p = first; p < people && p < first + MAX_FRAME_BODIES; p++)
+            {
+                if (dropout[p] > 0)
+                    continue;
+                uint32_t b = frame.bodyCount++;
+                frame.bodyIds[b] = (uint32_t)p + 1;
+                person_at(p, t, frame.positions[b]);
+            }
+
+            int64_t start = monotonic_usec();
+            zone_engine_update(&engine, &frame);
+            total_usec += monotonic_usec() - start;
+            updates++;
+
+            expected_count = 0;
+            ref_update(people, t);
+            int count = zone_engine_take_events(&engine, got, ZONE_MAX_EVENTS);
+            for (int i = 0; i < count; i++)
+            {
+                // pairs in id order, like the reference
+                if (got[i].type >= ZONE_NEAR && got[i].bodyId > got[i].otherBodyId)
+                {
+                    uint32_t swap = got[i].bodyId;
+                    got[i].bodyId = got[i].otherBodyId;
+                    got[i].otherBodyId = swap;
+                }
+                enters += got[i].type == ZONE_ENTER;
+                nears += got[i].type == ZONE_NEAR;
+            }
+            qsort(got, (size_t)count, sizeof(got[0]), compare_events);
+            qsort(expected, (size_t)expected_count, sizeof(expected[0]), compare_events);
+            bool same = count == expected_count;
+            for (int i = 0; same && i < count; i++)
+                same = compare_events(&got[i], &expected[i]) == 0;
+            mismatches += !same;
+            events += (uint64_t)count;
+        }
+    }
+
+    int64_t p99 = latency_stats_percentile(&engine.updateTime, 0.99);
+    printf("%d zones (%d tested everywhere), %d rules, %d people, %llu updates\n", engine.zoneCount,
+           engine.largeCount, engine.ruleCount, people, (unsigned long long)updates);
+    printf("events: %llu (%llu enter, %llu near), %llu dropped, %llu updates differing from brute force\n",
+           (unsigned long long)events, (unsigned long long)enters, (unsigned long long)nears,
+           (unsigned long long)engine.dropped, (unsigned long long)mismatches);
+    printf("update time: mean %.1f us, p99 %lld us, max %lld us\n", (double)total_usec / (double)updates,
+           (long long)p99, (long long)engine.updateTime.max);
+
+    bool ok = mismatches == 0 && engine.dropped == 0 && enters > 0 && nears > 0 && p99 < MAX_P99_USEC;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
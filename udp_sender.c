@@ -0,0 +1,305 @@
+#ifndef WIN32
+#define _GNU_SOURCE // sendmmsg
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "udp_sender.h"
+
+#ifndef WIN32
+struct SendMessages
+{
+    struct mmsghdr headers[UDP_SENDER_CHUNK];
+    struct iovec iov[UDP_SENDER_CHUNK];
+    int destinationOf[UDP_SENDER_CHUNK];
+};
+#endif
+
+bool udp_sender_open(struct UdpSender* sender)
+{
+    memset(sender, 0, sizeof(*sender));
+    sender->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sender->socket == INVALID_SOCKET)
+        return false;
+#ifndef WIN32
+    sender->messages_ = calloc(1, sizeof(struct SendMessages));
+    if (sender->messages_ == NULL)
+    {
+        closesocket(sender->socket);
+        sender->socket = INVALID_SOCKET;
+        return false;
+    }
+    // kernel arrival times for datagrams sent back, so pongs do not include
+    // the time a ping waited for the capture loop
+    int on = 1;
+    setsockopt(sender->socket, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on));
+#endif
+    platform_mutex_init(&sender->lock);
+    return true;
+}
+
+void udp_sender_close(struct UdpSender* sender)
+{
+    if (sender->socket == INVALID_SOCKET)
+        return;
+    closesocket(sender->socket);
+    sender->socket = INVALID_SOCKET;
+    free(sender->messages_);
+    sender->messages_ = NULL;
+    platform_mutex_destroy(&sender->lock);
+}
+
+bool udp_sender_add_destination(struct UdpSender* sender, const char* host, uint16_t port)
+{
+    if (sender->destinationCount >= MAX_DESTINATIONS)
+        return false;
+
+    struct UdpDestination* d = &sender->destinations[sender->destinationCount];
+    memset(d, 0, sizeof(*d));
+    d->address.sin_family = AF_INET;
+    d->address.sin_port = htons(port);
+    if (inet_pton(AF_INET, host, &d->address.sin_addr) != 1)
+        return false;
+    snprintf(d->name, sizeof(d->name), "%s:%u", host, port);
+    sender->destinationCount++;
+    return true;
+}
+
+bool udp_sender_set_multicast(struct UdpSender* sender, int ttl, const char* interface_address, bool loopback)
+{
+#ifdef WIN32
+    DWORD ttl_value = (DWORD)ttl;
+    DWORD loop_value = loopback ? 1 : 0;
+#else
+    unsigned char ttl_value = (unsigned char)ttl;
+    unsigned char loop_value = loopback ? 1 : 0;
+#endif
+    if (setsockopt(sender->socket, IPPROTO_IP, IP_MULTICAST_TTL, (const char*)&ttl_value, sizeof(ttl_value)) != 0)
+        return false;
+    if (setsockopt(sender->socket, IPPROTO_IP, IP_MULTICAST_LOOP, (const char*)&loop_value, sizeof(loop_value)) != 0)
+        return false;
+    if (interface_address != NULL)
+    {
+        struct in_addr address;
+        if (inet_pton(AF_INET, interface_address, &address) != 1)
+            return false;
+        if (setsockopt(sender->socket, IPPROTO_IP, IP_MULTICAST_IF, (const char*)&address, sizeof(address)) != 0)
+            return false;
+    }
+    return true;
+}
+
+#ifndef WIN32
+// Send messages[0..count) with as few syscalls as possible; failed messages
+// are skipped and charged to their destination
+static void send_chunk(struct UdpSender* sender, int count, int* failed)
+{
+    struct SendMessages* m = (struct SendMessages*)sender->messages_;
+    int done = 0;
+    while (done < count)
+    {
+        int sent = sendmmsg(sender->socket, &m->headers[done], (unsigned int)(count - done), 0);
+        if (sent < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            // the first message failed: record it and go on with the rest
+            struct UdpDestination* d = &sender->destinations[m->destinationOf[done]];
+            d->errors++;
+            d->lastError = errno;
+            (*failed)++;
+            done++;
+            continue;
+        }
+        for (int i = done; i < done + sent; i++)
+        {
+            struct UdpDestination* d = &sender->destinations[m->destinationOf[i]];
+            d->datagrams++;
+            d->bytes += m->headers[i].msg_len;
+            d->totalBytes += m->headers[i].msg_len;
+        }
+        done += sent;
+    }
+}
+#endif
+
+int udp_sender_send(struct UdpSender* sender, struct DatagramBatch* batch)
+{
+    return udp_sender_send_to(sender, batch, UDP_SENDER_ALL, sender->prepare, sender->prepareContext);
+}
+
+int udp_sender_send_to(struct UdpSender* sender, struct DatagramBatch* batch, uint32_t destinations,
+                       void (*prepare)(struct DatagramBatch* batch, void* context), void* prepare_context)
+{
+    int failed = 0;
+    if (batch->count == 0 || destinations == 0)
+        return 0;
+
+    platform_mutex_lock(&sender->lock);
+    if (prepare != NULL)
+        prepare(batch, prepare_context);
+#ifndef WIN32
+    struct SendMessages* m = (struct SendMessages*)sender->messages_;
+    int count = 0;
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        // all destinations share the serialized bytes
+        for (int k = 0; k < sender->destinationCount; k++)
+        {
+            if (!(destinations & (1u << k)))
+                continue;
+            struct iovec* iov = &m->iov[count];
+            iov->iov_base = (void*)(batch->data + batch->offsets[i]);
+            iov->iov_len = batch->sizes[i];
+
+            struct msghdr* h = &m->headers[count].msg_hdr;
+            memset(h, 0, sizeof(*h));
+            h->msg_name = &sender->destinations[k].address;
+            h->msg_namelen = sizeof(sender->destinations[k].address);
+            h->msg_iov = iov;
+            h->msg_iovlen = 1;
+            m->destinationOf[count] = k;
+
+            if (++count == UDP_SENDER_CHUNK)
+            {
+                send_chunk(sender, count, &failed);
+                count = 0;
+            }
+        }
+    }
+    if (count > 0)
+        send_chunk(sender, count, &failed);
+#else
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        const char* data = (const char*)(batch->data + batch->offsets[i]);
+        for (int k = 0; k < sender->destinationCount; k++)
+        {
+            if (!(destinations & (1u << k)))
+                continue;
+            struct UdpDestination* d = &sender->destinations[k];
+            int sent = sendto(sender->socket, data, batch->sizes[i], 0,
+                              (struct sockaddr*)&d->address, sizeof(d->address));
+            if (sent == SOCKET_ERROR)
+            {
+                d->errors++;
+                d->lastError = socket_error();
+                failed++;
+            }
+            else
+            {
+                d->datagrams++;
+                d->bytes += (uint64_t)sent;
+                d->totalBytes += (uint64_t)sent;
+            }
+        }
+    }
+#endif
+    platform_mutex_unlock(&sender->lock);
+    return failed;
+}
+
+int udp_sender_receive(struct UdpSender* sender, uint8_t* buffer, size_t capacity, SOCKADDR_IN* from,
+                       int64_t* arrival_usec)
+{
+    // poll instead of a non-blocking socket, so sends keep blocking when the
+    // socket buffer is full
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(sender->socket, &readable);
+    struct timeval no_wait = { 0, 0 };
+    if (select((int)sender->socket + 1, &readable, NULL, NULL, &no_wait) <= 0)
+        return 0;
+
+#ifndef WIN32
+    struct iovec iov = { buffer, capacity };
+    char control[CMSG_SPACE(sizeof(struct timeval))];
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_name = from;
+    message.msg_namelen = sizeof(*from);
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    int size = (int)recvmsg(sender->socket, &message, 0);
+    if (size <= 0)
+        return 0;
+
+    // SO_TIMESTAMP is in CLOCK_REALTIME: move it to the monotonic clock by
+    // how long ago it was
+    *arrival_usec = monotonic_usec();
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(&message); c != NULL; c = CMSG_NXTHDR(&message, c))
+    {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_TIMESTAMP)
+            continue;
+        struct timeval stamp;
+        struct timespec now;
+        memcpy(&stamp, CMSG_DATA(c), sizeof(stamp));
+        clock_gettime(CLOCK_REALTIME, &now);
+        int64_t waited = ((int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000) -
+                         ((int64_t)stamp.tv_sec * 1000000 + stamp.tv_usec);
+        if (waited > 0)
+            *arrival_usec -= waited;
+    }
+    return size;
+#else
+    socklen_t length = sizeof(*from);
+    int size = (int)recvfrom(sender->socket, (char*)buffer, (int)capacity, 0, (struct sockaddr*)from, &length);
+    *arrival_usec = monotonic_usec();
+    return size > 0 ? size : 0;
+#endif
+}
+
+bool udp_sender_reply(struct UdpSender* sender, const SOCKADDR_IN* to, const uint8_t* data, size_t size)
+{
+    return sendto(sender->socket, (const char*)data, (int)size, 0, (const struct sockaddr*)to, sizeof(*to)) ==
+           (int)size;
+}
+
+int udp_sender_find_destination(const struct UdpSender* sender, const SOCKADDR_IN* from)
+{
+    int same_host = -1;
+    int group = -1;
+    for (int k = 0; k < sender->destinationCount; k++)
+    {
+        const SOCKADDR_IN* a = &sender->destinations[k].address;
+        if (a->sin_addr.s_addr == from->sin_addr.s_addr)
+        {
+            if (a->sin_port == from->sin_port)
+                return k;
+            if (same_host < 0)
+                same_host = k;
+        }
+        else if (group < 0 && IN_MULTICAST(ntohl(a->sin_addr.s_addr)))
+            group = k;
+    }
+    return same_host >= 0 ? same_host : group;
+}
+
+void udp_sender_report(struct UdpSender* sender, int64_t now_usec, int64_t interval_usec)
+{
+    if (now_usec - sender->lastReportUsec < interval_usec)
+        return;
+
+    platform_mutex_lock(&sender->lock);
+    for (int k = 0; k < sender->destinationCount && sender->lastReportUsec != 0; k++)
+    {
+        struct UdpDestination* d = &sender->destinations[k];
+        printf("Destination %-21s %llu datagrams, %llu bytes, %llu errors",
+               d->name, (unsigned long long)d->datagrams, (unsigned long long)d->bytes,
+               (unsigned long long)d->errors);
+        if (d->errors > 0)
+            printf(" (last %d)", d->lastError);
+        printf("\n");
+    }
+    for (int k = 0; k < sender->destinationCount; k++)
+    {
+        struct UdpDestination* d = &sender->destinations[k];
+        d->datagrams = 0;
+        d->bytes = 0;
+        d->errors = 0;
+    }
+    sender->lastReportUsec = now_usec;
+    platform_mutex_unlock(&sender->lock);
+}
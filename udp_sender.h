@@ -0,0 +1,81 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "net.h"
+#include "platform.h"
+#include "datagram_batch.h"
+
+// Fan-out of the output stream to several UDP receivers (render node,
+// recorder, dashboard...). A frame is serialized once into a DatagramBatch and
+// the whole batch goes to every destination in one sendmmsg() call on Linux
+// (a sendto() loop elsewhere), so extra receivers cost almost nothing.
+// A destination may be a multicast group; one datagram then reaches every
+// node that joined it, whatever their number.
+
+#define MAX_DESTINATIONS 16
+#define UDP_SENDER_CHUNK 1024         // messages per sendmmsg() call (UIO_MAXIOV)
+#define UDP_SENDER_ALL 0xFFFFFFFFu    // destination mask of every destination
+
+struct UdpDestination
+{
+    SOCKADDR_IN address;
+    char name[32];
+    uint64_t datagrams;
+    uint64_t bytes;
+    uint64_t errors;
+    int lastError;
+    uint64_t totalBytes;// never reset, for rate measurements
+};
+
+struct UdpSender
+{
+    SOCKET socket;
+    struct UdpDestination destinations[MAX_DESTINATIONS];
+    int destinationCount;
+
+    // Called under the send lock right before a batch goes out, so whatever
+    // it stamps (sequence numbers, FEC parity) follows the real send order
+    // across threads. NULL = send batches as they are.
+    void (*prepare)(struct DatagramBatch* batch, void* context);
+    void* prepareContext;
+
+    platform_mutex_t lock;// pipeline and scheduler threads both send
+    int64_t lastReportUsec;
+    void* messages_;// sendmmsg() headers, allocated by udp_sender_open on Linux
+};
+
+bool udp_sender_open(struct UdpSender* sender);
+void udp_sender_close(struct UdpSender* sender);
+bool udp_sender_add_destination(struct UdpSender* sender, const char* host, uint16_t port);
+
+// Multicast options of the socket: hop limit, outgoing interface address
+// (NULL = routing table default) and whether local receivers get a copy
+bool udp_sender_set_multicast(struct UdpSender* sender, int ttl, const char* interface_address, bool loopback);
+
+// Prepare the batch, then send every datagram of it to every destination.
+// Returns the number of datagrams that failed (counted per destination).
+int udp_sender_send(struct UdpSender* sender, struct DatagramBatch* batch);
+
+// Same for the destinations in a bit mask (bit k = destinations[k]), with a
+// prepare hook of its own instead of the sender's (may be NULL)
+int udp_sender_send_to(struct UdpSender* sender, struct DatagramBatch* batch, uint32_t destinations,
+                       void (*prepare)(struct DatagramBatch* batch, void* context), void* prepare_context);
+
+// Read one datagram sent back to the sender's socket (receiver feedback,
+// clock pings) without blocking; returns its size, or 0 if there is none.
+// arrival_usec is when it reached the host (kernel timestamp on Linux, the
+// read time elsewhere), in the monotonic_usec() clock.
+int udp_sender_receive(struct UdpSender* sender, uint8_t* buffer, size_t capacity, SOCKADDR_IN* from,
+                       int64_t* arrival_usec);
+
+// Send one datagram to a single address, outside of any stream (pongs)
+bool udp_sender_reply(struct UdpSender* sender, const SOCKADDR_IN* to, const uint8_t* data, size_t size);
+
+// Destination a datagram from this address belongs to: same address and port,
+// else same host, else the multicast group (its members answer from their
+// own addresses); -1 if none
+int udp_sender_find_destination(const struct UdpSender* sender, const SOCKADDR_IN* from);
+
+// Print and reset per-destination counters every interval_usec
+void udp_sender_report(struct UdpSender* sender, int64_t now_usec, int64_t interval_usec);
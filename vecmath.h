@@ -0,0 +1,160 @@
+#pragma once
+#include <math.h>
+
+// Small vector / quaternion helpers shared by the pose filter and skeleton
+// processing. Layouts match k4a_float3_t and k4a_quaternion_t (w, x, y, z) so
+// joint data can be reinterpreted without copying.
+
+typedef struct
+{
+    float x, y, z;
+} vec3_t;
+
+typedef struct
+{
+    float w, x, y, z;
+} quat_t;
+
+static inline vec3_t vec3_make(float x, float y, float z)
+{
+    vec3_t r = { x, y, z };
+    return r;
+}
+
+static inline vec3_t vec3_add(vec3_t a, vec3_t b)
+{
+    return vec3_make(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+static inline vec3_t vec3_sub(vec3_t a, vec3_t b)
+{
+    return vec3_make(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+static inline vec3_t vec3_scale(vec3_t a, float s)
+{
+    return vec3_make(a.x * s, a.y * s, a.z * s);
+}
+
+static inline float vec3_dot(vec3_t a, vec3_t b)
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline vec3_t vec3_cross(vec3_t a, vec3_t b)
+{
+    return vec3_make(a.y * b.z - a.z * b.y,
+                     a.z * b.x - a.x * b.z,
+                     a.x * b.y - a.y * b.x);
+}
+
+static inline float vec3_length(vec3_t a)
+{
+    return sqrtf(vec3_dot(a, a));
+}
+
+static inline vec3_t vec3_lerp(vec3_t a, vec3_t b, float t)
+{
+    return vec3_make(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t);
+}
+
+static inline quat_t quat_identity(void)
+{
+    quat_t r = { 1.0f, 0.0f, 0.0f, 0.0f };
+    return r;
+}
+
+static inline quat_t quat_make(float w, float x, float y, float z)
+{
+    quat_t r = { w, x, y, z };
+    return r;
+}
+
+static inline quat_t quat_mul(quat_t a, quat_t b)
+{
+    return quat_make(a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+                     a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+                     a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+                     a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w);
+}
+
+static inline quat_t quat_conj(quat_t q)
+{
+    return quat_make(q.w, -q.x, -q.y, -q.z);
+}
+
+static inline float quat_dot(quat_t a, quat_t b)
+{
+    return a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline quat_t quat_normalize(quat_t q)
+{
+    float n = sqrtf(quat_dot(q, q));
+    if (n < 1e-12f)
+        return quat_identity();
+    float inv = 1.0f / n;
+    return quat_make(q.w * inv, q.x * inv, q.y * inv, q.z * inv);
+}
+
+// Rotate v by unit quaternion q (q * v * q^-1)
+static inline vec3_t quat_rotate(quat_t q, vec3_t v)
+{
+    vec3_t u = vec3_make(q.x, q.y, q.z);
+    vec3_t t = vec3_scale(vec3_cross(u, v), 2.0f);
+    return vec3_add(vec3_add(v, vec3_scale(t, q.w)), vec3_cross(u, t));
+}
+
+// Quaternion from a rotation vector (axis * angle, radians)
+static inline quat_t quat_from_rotvec(vec3_t r)
+{
+    float angle = vec3_length(r);
+    if (angle < 1e-6f)
+        return quat_normalize(quat_make(1.0f, 0.5f * r.x, 0.5f * r.y, 0.5f * r.z));
+    float s = sinf(0.5f * angle) / angle;
+    return quat_make(cosf(0.5f * angle), r.x * s, r.y * s, r.z * s);
+}
+
+// Rotation vector (axis * angle, radians) of a unit quaternion
+static inline vec3_t quat_to_rotvec(quat_t q)
+{
+    if (q.w < 0.0f)
+        q = quat_make(-q.w, -q.x, -q.y, -q.z);
+    float s = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z);
+    if (s < 1e-6f)
+        return vec3_make(2.0f * q.x, 2.0f * q.y, 2.0f * q.z);
+    float k = 2.0f * atan2f(s, q.w) / s;
+    return vec3_make(q.x * k, q.y * k, q.z * k);
+}
+
+// Shortest-path spherical interpolation between unit quaternions
+static inline quat_t quat_slerp(quat_t a, quat_t b, float t)
+{
+    float d = quat_dot(a, b);
+    if (d < 0.0f)
+    {
+        b = quat_make(-b.w, -b.x, -b.y, -b.z);
+        d = -d;
+    }
+    if (d > 0.9995f)
+    {
+        // nearly parallel: normalized lerp is accurate and avoids 0/0
+        return quat_normalize(quat_make(a.w + (b.w - a.w) * t, a.x + (b.x - a.x) * t,
+                                        a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t));
+    }
+    float theta = acosf(d);
+    float s = sinf(theta);
+    float wa = sinf((1.0f - t) * theta) / s;
+    float wb = sinf(t * theta) / s;
+    return quat_make(a.w * wa + b.w * wb, a.x * wa + b.x * wb,
+                     a.y * wa + b.y * wb, a.z * wa + b.z * wb);
+}
+
+// Angle in radians between two unit quaternions
+static inline float quat_angle_between(quat_t a, quat_t b)
+{
+    float d = fabsf(quat_dot(a, b));
+    if (d > 1.0f)
+        d = 1.0f;
+    return 2.0f * acosf(d);
+}
@@ -0,0 +1,588 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zone_events.h"
+#include "platform.h"
+
+#define ZONE_LINE_MAX 4096
+
+void zone_default_config(struct ZoneConfig* config)
+{
+    config->cellMm = 500.0f;
+    config->marginMm = 100.0f;
+    config->lostUsec = 500000;
+}
+
+void zone_engine_init(struct ZoneEngine* engine, const struct ZoneConfig* config)
+{
+    memset(engine, 0, sizeof(*engine));
+    if (config != NULL)
+        engine->config = *config;
+    else
+        zone_default_config(&engine->config);
+    latency_stats_init(&engine->updateTime, "zone update");
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Definitions
+
+static bool valid_joint(int joint)
+{
+    return joint == ZONE_JOINT_ANY || (joint >= 0 && joint < SKELETON_JOINT_COUNT);
+}
+
+bool zone_engine_add_box(struct ZoneEngine* e, uint16_t id, vec3_t min, vec3_t max, int joint)
+{
+    if (e->zoneCount == ZONE_MAX_ZONES || !valid_joint(joint) || min.x > max.x || min.y > max.y || min.z > max.z)
+        return false;
+    struct Zone* z = &e->zones[e->zoneCount++];
+    memset(z, 0, sizeof(*z));
+    z->id = id;
+    z->shape = ZONE_BOX;
+    z->joint = (int8_t)joint;
+    z->min[0] = min.x, z->min[1] = min.y, z->min[2] = min.z;
+    z->max[0] = max.x, z->max[1] = max.y, z->max[2] = max.z;
+    e->built = false;
+    return true;
+}
+
+bool zone_engine_add_polygon(struct ZoneEngine* e, uint16_t id, float z0, float z1, const float (*xy)[2],
+                             int count, int joint)
+{
+    if (e->zoneCount == ZONE_MAX_ZONES || count < 3 || e->vertexCount + count > ZONE_MAX_VERTICES ||
+        !valid_joint(joint) || z0 > z1)
+        return false;
+    struct Zone* z = &e->zones[e->zoneCount++];
+    memset(z, 0, sizeof(*z));
+    z->id = id;
+    z->shape = ZONE_POLYGON;
+    z->joint = (int8_t)joint;
+    z->firstVertex = e->vertexCount;
+    z->vertexCount = count;
+    z->min[0] = z->max[0] = xy[0][0];
+    z->min[1] = z->max[1] = xy[0][1];
+    z->min[2] = z0;
+    z->max[2] = z1;
+    for (int v = 0; v < count; v++)
+    {
+        e->vertices[e->vertexCount + v][0] = xy[v][0];
+        e->vertices[e->vertexCount + v][1] = xy[v][1];
+        for (int a = 0; a < 2; a++)
+        {
+            z->min[a] = fminf(z->min[a], xy[v][a]);
+            z->max[a] = fmaxf(z->max[a], xy[v][a]);
+        }
+    }
+    e->vertexCount += count;
+    e->built = false;
+    return true;
+}
+
+bool zone_engine_add_rule(struct ZoneEngine* e, uint16_t id, float distance_mm, int joint_a, int joint_b)
+{
+    if (e->ruleCount == ZONE_MAX_RULES || distance_mm <= 0.0f || joint_a < 0 || joint_a >= SKELETON_JOINT_COUNT ||
+        joint_b < 0 || joint_b >= SKELETON_JOINT_COUNT)
+        return false;
+    struct ZoneRule* r = &e->rules[e->ruleCount++];
+    r->id = id;
+    r->distanceMm = distance_mm;
+    r->jointA = (int8_t)joint_a;
+    r->jointB = (int8_t)joint_b;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Grids
+
+static int32_t cell_of(float v, float cell_mm)
+{
+    return (int32_t)floorf(v / cell_mm);
+}
+
+static uint32_t cell_hash(int32_t cx, int32_t cy, uint32_t buckets)
+{
+    return (((uint32_t)cx * 73856093u) ^ ((uint32_t)cy * 19349663u)) & (buckets - 1);
+}
+
+// Cell range of a zone's bounds grown by the exit margin
+static void zone_cells(const struct ZoneEngine* e, const struct Zone* z, int32_t* c0, int32_t* c1)
+{
+    float margin = e->config.marginMm;
+    for (int a = 0; a < 2; a++)
+    {
+        c0[a] = cell_of(z->min[a] - margin, e->config.cellMm);
+        c1[a] = cell_of(z->max[a] + margin, e->config.cellMm);
+    }
+}
+
+static bool is_large(const int32_t* c0, const int32_t* c1)
+{
+    int64_t cells = (int64_t)(c1[0] - c0[0] + 1) * (int64_t)(c1[1] - c0[1] + 1);
+    return cells > ZONE_MAX_CELLS_PER_ZONE;
+}
+
+bool zone_engine_build(struct ZoneEngine* e)
+{
+    // count the references of every bucket, then fill them in place
+    uint32_t counts[ZONE_GRID_BUCKETS + 1];
+    memset(counts, 0, sizeof(counts));
+    e->largeCount = 0;
+    uint32_t total = 0;
+    for (int i = 0; i < e->zoneCount; i++)
+    {
+        int32_t c0[2], c1[2];
+        zone_cells(e, &e->zones[i], c0, c1);
+        if (is_large(c0, c1))
+        {
+            e->largeZones[e->largeCount++] = (uint16_t)i;
+            continue;
+        }
+        for (int32_t cy = c0[1]; cy <= c1[1]; cy++)
+        {
+            for (int32_t cx = c0[0]; cx <= c1[0]; cx++)
+                counts[cell_hash(cx, cy, ZONE_GRID_BUCKETS)]++;
+        }
+        total += (uint32_t)((c1[0] - c0[0] + 1) * (c1[1] - c0[1] + 1));
+    }
+    if (total > ZONE_MAX_CELL_ENTRIES)
+        return false;
+
+    e->cellStart[0] = 0;
+    for (int h = 0; h < ZONE_GRID_BUCKETS; h++)
+        e->cellStart[h + 1] = e->cellStart[h] + counts[h];
+    memcpy(counts, e->cellStart, sizeof(e->cellStart));// next free entry per bucket
+    for (int i = 0; i < e->zoneCount; i++)
+    {
+        int32_t c0[2], c1[2];
+        zone_cells(e, &e->zones[i], c0, c1);
+        if (is_large(c0, c1))
+            continue;
+        for (int32_t cy = c0[1]; cy <= c1[1]; cy++)
+        {
+            for (int32_t cx = c0[0]; cx <= c1[0]; cx++)
+                e->cellZones[counts[cell_hash(cx, cy, ZONE_GRID_BUCKETS)]++] = (uint16_t)i;
+        }
+    }
+    e->built = true;
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Zone tests
+
+static bool inside_polygon(const float (*v)[2], int count, float x, float y)
+{
+    bool inside = false;
+    for (int i = 0, k = count - 1; i < count; k = i++)
+    {
+        if ((v[i][1] > y) != (v[k][1] > y) &&
+            x < (v[k][0] - v[i][0]) * (y - v[i][1]) / (v[k][1] - v[i][1]) + v[i][0])
+            inside = !inside;
+    }
+    return inside;
+}
+
+static bool near_polygon_edge(const float (*v)[2], int count, float x, float y, float margin)
+{
+    for (int i = 0, k = count - 1; i < count; k = i++)
+    {
+        float ex = v[i][0] - v[k][0], ey = v[i][1] - v[k][1];
+        float px = x - v[k][0], py = y - v[k][1];
+        float length2 = ex * ex + ey * ey;
+        float t = length2 > 0.0f ? (px * ex + py * ey) / length2 : 0.0f;
+        t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+        float dx = px - t * ex, dy = py - t * ey;
+        if (dx * dx + dy * dy <= margin * margin)
+            return true;
+    }
+    return false;
+}
+
+// Joint inside the zone grown by margin
+static bool zone_contains(const struct ZoneEngine* e, const struct Zone* z, vec3_t p, float margin)
+{
+    if (p.x < z->min[0] - margin || p.x > z->max[0] + margin || p.y < z->min[1] - margin ||
+        p.y > z->max[1] + margin || p.z < z->min[2] - margin || p.z > z->max[2] + margin)
+        return false;
+    if (z->shape == ZONE_BOX)
+        return true;
+    const float (*v)[2] = (const float (*)[2])e->vertices[z->firstVertex];
+    return inside_polygon(v, z->vertexCount, p.x, p.y) ||
+           (margin > 0.0f && near_polygon_edge(v, z->vertexCount, p.x, p.y, margin));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Evaluation
+
+static void emit(struct ZoneEngine* e, uint8_t type, uint16_t id, uint32_t body_id, uint32_t other_body_id)
+{
+    if (e->eventCount == ZONE_MAX_EVENTS)
+    {
+        e->dropped++;
+        return;
+    }
+    struct ZoneEvent* event = &e->events[e->eventCount++];
+    event->type = type;
+    event->id = id;
+    event->bodyId = body_id;
+    event->otherBodyId = other_body_id;
+    e->emitted++;
+}
+
+static struct ZoneBody* find_body(struct ZoneEngine* e, uint32_t body_id)
+{
+    struct ZoneBody* free_body = NULL;
+    for (int i = 0; i < ZONE_MAX_BODIES; i++)
+    {
+        struct ZoneBody* body = &e->bodies[i];
+        if (body->active && body->bodyId == body_id)
+            return body;
+        if (!body->active && free_body == NULL)
+            free_body = body;
+    }
+    if (free_body != NULL)
+    {
+        free_body->active = true;
+        free_body->bodyId = body_id;
+        free_body->insideCount = 0;
+    }
+    return free_body;
+}
+
+static bool was_inside(const struct ZoneBody* body, uint16_t zone)
+{
+    for (int i = 0; i < body->insideCount; i++)
+    {
+        if (body->inside[i] == zone)
+            return true;
+    }
+    return false;
+}
+
+// One candidate zone for joint j: is the body inside it (again)?
+static void test_zone(struct ZoneEngine* e, struct ZoneBody* body, uint16_t zone, int j, uint16_t* inside,
+                      int* count)
+{
+    const struct Zone* z = &e->zones[zone];
+    if (e->zoneMark[zone] == e->mark || (z->joint != ZONE_JOINT_ANY && z->joint != j))
+        return;
+    bool was = was_inside(body, zone);
+    if (!zone_contains(e, z, body->joints[j], was ? e->config.marginMm : 0.0f))
+        return;
+    e->zoneMark[zone] = e->mark;
+    if (*count == ZONE_MAX_INSIDE)
+    {
+        e->dropped++;
+        return;
+    }
+    inside[(*count)++] = zone;
+    if (!was)
+        emit(e, ZONE_ENTER, z->id, body->bodyId, 0);
+}
+
+static void update_zones(struct ZoneEngine* e, struct ZoneBody* body, uint32_t joint_mask)
+{
+    uint16_t inside[ZONE_MAX_INSIDE];
+    int count = 0;
+    if (++e->mark == 0)
+    {
+        memset(e->zoneMark, 0, sizeof(e->zoneMark));
+        e->mark = 1;
+    }
+
+    for (int j = 0; j < SKELETON_JOINT_COUNT; j++)
+    {
+        if (!(joint_mask & (1u << j)))
+            continue;
+        vec3_t p = body->joints[j];
+        uint32_t h = cell_hash(cell_of(p.x, e->config.cellMm), cell_of(p.y, e->config.cellMm), ZONE_GRID_BUCKETS);
+        for (uint32_t k = e->cellStart[h]; k < e->cellStart[h + 1]; k++)
+            test_zone(e, body, e->cellZones[k], j, inside, &count);
+        for (int k = 0; k < e->largeCount; k++)
+            test_zone(e, body, e->largeZones[k], j, inside, &count);
+    }
+
+    for (int i = 0; i < body->insideCount; i++)
+    {
+        if (e->zoneMark[body->inside[i]] != e->mark)
+            emit(e, ZONE_EXIT, e->zones[body->inside[i]].id, body->bodyId, 0);
+    }
+    memcpy(body->inside, inside, (size_t)count * sizeof(inside[0]));
+    body->insideCount = count;
+}
+
+static void update_rule(struct ZoneEngine* e, int r)
+{
+    const struct ZoneRule* rule = &e->rules[r];
+    float stay = rule->distanceMm + e->config.marginMm;
+    uint64_t enter_mask[ZONE_MAX_BODIES];
+    uint64_t stay_mask[ZONE_MAX_BODIES];
+    memset(enter_mask, 0, sizeof(enter_mask));
+    memset(stay_mask, 0, sizeof(stay_mask));
+
+    // joint a of every body into a grid of cells as large as the stay distance
+    for (int h = 0; h < ZONE_BODY_BUCKETS; h++)
+        e->bodyHeads[h] = -1;
+    for (int i = 0; i < ZONE_MAX_BODIES; i++)
+    {
+        if (!e->bodies[i].active)
+            continue;
+        vec3_t p = e->bodies[i].joints[rule->jointA];
+        uint32_t h = cell_hash(cell_of(p.x, stay), cell_of(p.y, stay), ZONE_BODY_BUCKETS);
+        e->bodyNext[i] = e->bodyHeads[h];
+        e->bodyHeads[h] = (int16_t)i;
+    }
+
+    // joint b of every body against joint a of the bodies in the cells around it
+    for (int i = 0; i < ZONE_MAX_BODIES; i++)
+    {
+        if (!e->bodies[i].active)
+            continue;
+        vec3_t p = e->bodies[i].joints[rule->jointB];
+        int32_t cx = cell_of(p.x, stay), cy = cell_of(p.y, stay);
+        for (int dy = -1; dy <= 1; dy++)
+        {
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                for (int k = e->bodyHeads[cell_hash(cx + dx, cy + dy, ZONE_BODY_BUCKETS)]; k >= 0; k = e->bodyNext[k])
+                {
+                    if (k == i)
+                        continue;
+                    float d = vec3_length(vec3_sub(p, e->bodies[k].joints[rule->jointA]));
+                    uint64_t bi = 1ull << i, bk = 1ull << k;
+                    if (d <= stay)
+                        stay_mask[i] |= bk, stay_mask[k] |= bi;
+                    if (d < rule->distanceMm)
+                        enter_mask[i] |= bk, enter_mask[k] |= bi;
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < ZONE_MAX_BODIES; i++)
+    {
+        uint64_t old = e->near[r][i];
+        uint64_t now = (old & stay_mask[i]) | enter_mask[i];
+        e->near[r][i] = now;
+        uint64_t changed = (old ^ now) & ~((2ull << i) - 1);// each pair once, from its lower index
+        for (int k = i + 1; changed != 0 && k < ZONE_MAX_BODIES; k++)
+        {
+            if (!(changed & (1ull << k)))
+                continue;
+            changed &= ~(1ull << k);
+            emit(e, (now & (1ull << k)) ? ZONE_NEAR : ZONE_APART, rule->id, e->bodies[i].bodyId,
+                 e->bodies[k].bodyId);
+        }
+    }
+}
+
+// Bodies not seen for lostUsec leave their zones and pairs
+static void expire_bodies(struct ZoneEngine* e, int64_t now_usec)
+{
+    for (int i = 0; i < ZONE_MAX_BODIES; i++)
+    {
+        struct ZoneBody* body = &e->bodies[i];
+        if (!body->active || now_usec - body->lastSeenUsec <= e->config.lostUsec)
+            continue;
+        for (int k = 0; k < body->insideCount; k++)
+            emit(e, ZONE_EXIT, e->zones[body->inside[k]].id, body->bodyId, 0);
+        for (int r = 0; r < e->ruleCount; r++)
+        {
+            for (int k = 0; k < ZONE_MAX_BODIES; k++)
+            {
+                if (!(e->near[r][i] & (1ull << k)))
+                    continue;
+                emit(e, ZONE_APART, e->rules[r].id, body->bodyId, e->bodies[k].bodyId);
+                e->near[r][k] &= ~(1ull << i);
+            }
+            e->near[r][i] = 0;
+        }
+        body->insideCount = 0;
+        body->active = false;
+    }
+}
+
+void zone_engine_update(struct ZoneEngine* e, const struct SkeletonFrame* frame)
+{
+    int64_t start_usec = monotonic_usec();
+    if (!e->built)
+        zone_engine_build(e);
+
+    uint32_t joint_mask = 0;
+    for (int i = 0; i < e->zoneCount; i++)
+        joint_mask |= e->zones[i].joint == ZONE_JOINT_ANY ? 0xFFFFFFFFu : 1u << e->zones[i].joint;
+
+    for (uint32_t b = 0; b < frame->bodyCount; b++)
+    {
+        struct ZoneBody* body = find_body(e, frame->bodyIds[b]);
+        if (body == NULL)
+        {
+            e->dropped++;
+            continue;
+        }
+        body->lastSeenUsec = frame->timestampUsec;
+        memcpy(body->joints, frame->positions[b], sizeof(body->joints));
+        if (e->zoneCount > 0)
+            update_zones(e, body, joint_mask);
+    }
+    expire_bodies(e, frame->timestampUsec);
+    for (int r = 0; r < e->ruleCount; r++)
+        update_rule(e, r);
+
+    e->updates++;
+    latency_stats_add(&e->updateTime, monotonic_usec() - start_usec);
+}
+
+int zone_engine_take_events(struct ZoneEngine* e, struct ZoneEvent* events, int max)
+{
+    int count = e->eventCount < max ? e->eventCount : max;
+    memcpy(events, e->events, (size_t)count * sizeof(events[0]));
+    memmove(e->events, e->events + count, (size_t)(e->eventCount - count) * sizeof(events[0]));
+    e->eventCount -= count;
+    return count;
+}
+
+void zone_engine_report(struct ZoneEngine* e, int64_t now_usec, int64_t interval_usec)
+{
+    if (now_usec - e->lastReportUsec < interval_usec)
+        return;
+    if (e->lastReportUsec != 0 && e->updates > 0)
+    {
+        printf("zones: %llu updates, %llu events, %llu dropped\n", (unsigned long long)e->updates,
+               (unsigned long long)e->emitted, (unsigned long long)e->dropped);
+        latency_stats_print(&e->updateTime);
+    }
+    e->updates = 0;
+    e->emitted = 0;
+    e->dropped = 0;
+    latency_stats_reset(&e->updateTime);
+    e->lastReportUsec = now_usec;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Zone file
+
+static bool parse_joint(const char* token, int* joint)
+{
+    if (token == NULL)
+        return true;// keep the default
+    if (strcmp(token, "any") == 0)
+    {
+        *joint = ZONE_JOINT_ANY;
+        return true;
+    }
+    char* end;
+    long j = strtol(token, &end, 10);
+    if (*token == '\0' || *end != '\0' || j < 0 || j >= SKELETON_JOINT_COUNT)
+        return false;
+    *joint = (int)j;
+    return true;
+}
+
+static bool parse_float(const char* token, float* v)
+{
+    if (token == NULL)
+        return false;
+    char* end;
+    *v = strtof(token, &end);
+    return *token != '\0' && *end == '\0';
+}
+
+static bool parse_line(struct ZoneEngine* e, char* line)
+{
+    static const char* separators = " \t\r\n";
+    char* kind = strtok(line, separators);
+    char* id_token = strtok(NULL, separators);
+    if (id_token == NULL)
+        return false;
+    char* end;
+    long id = strtol(id_token, &end, 10);
+    if (*end != '\0' || id < 0 || id > 0xFFFF)
+        return false;
+
+    if (strcmp(kind, "box") == 0)
+    {
+        float v[6];
+        for (int i = 0; i < 6; i++)
+        {
+            if (!parse_float(strtok(NULL, separators), &v[i]))
+                return false;
+        }
+        int joint = JOINT_PELVIS;
+        return parse_joint(strtok(NULL, separators), &joint) && strtok(NULL, separators) == NULL &&
+               zone_engine_add_box(e, (uint16_t)id, vec3_make(v[0], v[1], v[2]), vec3_make(v[3], v[4], v[5]), joint);
+    }
+    if (strcmp(kind, "polygon") == 0)
+    {
+        float z0, z1;
+        if (!parse_float(strtok(NULL, separators), &z0) || !parse_float(strtok(NULL, separators), &z1))
+            return false;
+        static float xy[ZONE_MAX_VERTICES][2];
+        int count = 0;
+        int joint = JOINT_PELVIS;
+        char* token;
+        while ((token = strtok(NULL, separators)) != NULL)
+        {
+            char* comma = strchr(token, ',');
+            if (comma == NULL)
+            {
+                // the joint ends the line
+                if (!parse_joint(token, &joint) || strtok(NULL, separators) != NULL)
+                    return false;
+                break;
+            }
+            *comma = '\0';
+            if (count == ZONE_MAX_VERTICES || !parse_float(token, &xy[count][0]) ||
+                !parse_float(comma + 1, &xy[count][1]))
+                return false;
+            count++;
+        }
+        return zone_engine_add_polygon(e, (uint16_t)id, z0, z1, (const float (*)[2])xy, count, joint);
+    }
+    if (strcmp(kind, "near") == 0)
+    {
+        float distance;
+        if (!parse_float(strtok(NULL, separators), &distance))
+            return false;
+        int joint_a = JOINT_PELVIS;
+        if (!parse_joint(strtok(NULL, separators), &joint_a) || joint_a == ZONE_JOINT_ANY)
+            return false;
+        int joint_b = joint_a;
+        if (!parse_joint(strtok(NULL, separators), &joint_b) || joint_b == ZONE_JOINT_ANY)
+            return false;
+        return strtok(NULL, separators) == NULL && zone_engine_add_rule(e, (uint16_t)id, distance, joint_a, joint_b);
+    }
+    return false;
+}
+
+int zone_engine_load(struct ZoneEngine* e, const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return -1;
+
+    static char line[ZONE_LINE_MAX];
+    int read = 0;
+    while (fgets(line, sizeof(line), f) != NULL)
+    {
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        char* p = line;
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+            p++;
+        if (*p == '\0')
+            continue;
+        if (!parse_line(e, p))
+        {
+            read = -1;
+            break;
+        }
+        read++;
+    }
+    fclose(f);
+    if (read >= 0 && !zone_engine_build(e))
+        read = -1;
+    return read;
+}
@@ -0,0 +1,168 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "skeleton.h"
+#include "latency_stats.h"
+
+// Zones and proximity rules evaluated in the tracker, so receivers get
+// enter/exit/near events instead of testing raw joints every tick.
+//
+// Zones are axis-aligned boxes or vertical prisms (a floor polygon with a
+// height range) in world space, mm, z up as the Marvelmind world. Each zone
+// watches one joint of every body (the pelvis unless configured), or any of
+// its joints. Proximity rules watch the distance between a joint of one body
+// and a joint of another.
+//
+// Lookups go through uniform grids on the floor plane. Zones are rasterized
+// once into a hashed grid of cellMm cells (zones covering more than
+// ZONE_MAX_CELLS_PER_ZONE cells are tested for every joint instead), so a
+// joint only tests the zones of its cell. For each rule the watched joints
+// of all bodies are hashed into a grid of cells as large as the rule's exit
+// distance, and only bodies in neighbouring cells are compared.
+//
+// Hysteresis: a body enters a zone when the joint is inside it and exits
+// once the joint is more than marginMm outside; a near pair starts below the
+// rule distance and ends beyond distance + marginMm. Bodies not seen for
+// lostUsec exit their zones and pairs. Bodies are tracked by id across
+// frames, so frames of several cameras may update different bodies.
+//
+// Zone file, one definition per line ('#' starts a comment):
+//   box <id> <x0> <y0> <z0> <x1> <y1> <z1> [<joint>|any]
+//   polygon <id> <z0> <z1> <x>,<y> <x>,<y> <x>,<y>... [<joint>|any]
+//   near <id> <mm> [<joint a> [<joint b>]]
+// Joints are k4abt joint indices. Zone and rule ids are the ids events carry.
+
+#define ZONE_MAX_ZONES 1024
+#define ZONE_MAX_VERTICES 8192      // polygon vertices of all zones
+#define ZONE_MAX_RULES 16
+#define ZONE_MAX_BODIES 64          // tracked at a time
+#define ZONE_MAX_INSIDE 32          // zones one body is in at a time
+#define ZONE_MAX_EVENTS 1024        // per update
+#define ZONE_GRID_BUCKETS 4096      // hashed cells of the zone grid
+#define ZONE_MAX_CELL_ENTRIES 65536 // zone references in the zone grid
+#define ZONE_MAX_CELLS_PER_ZONE 256
+#define ZONE_BODY_BUCKETS 256       // hashed cells of a rule's body grid
+#define ZONE_JOINT_ANY -1
+
+enum ZoneEventType
+{
+    ZONE_ENTER = 1,
+    ZONE_EXIT = 2,
+    ZONE_NEAR = 3,  // otherBodyId came within the rule distance
+    ZONE_APART = 4, // and left it again
+};
+
+struct ZoneEvent
+{
+    uint8_t type;// enum ZoneEventType
+    uint16_t id; // zone or rule id
+    uint32_t bodyId;
+    uint32_t otherBodyId;// near events only
+};
+
+enum ZoneShape
+{
+    ZONE_BOX,
+    ZONE_POLYGON,
+};
+
+struct Zone
+{
+    uint16_t id;
+    uint8_t shape;   // enum ZoneShape
+    int8_t joint;    // watched joint, ZONE_JOINT_ANY
+    float min[3];    // bounds, mm (the box itself for ZONE_BOX)
+    float max[3];
+    int firstVertex; // ZONE_POLYGON: x, y pairs in ZoneEngine.vertices
+    int vertexCount;
+};
+
+struct ZoneRule
+{
+    uint16_t id;
+    int8_t jointA;
+    int8_t jointB;
+    float distanceMm;
+};
+
+struct ZoneBody
+{
+    uint32_t bodyId;
+    bool active;
+    int64_t lastSeenUsec;
+    vec3_t joints[SKELETON_JOINT_COUNT];// newest world positions
+    uint16_t inside[ZONE_MAX_INSIDE];   // zone indices
+    int insideCount;
+};
+
+struct ZoneConfig
+{
+    float cellMm;      // zone grid cell size
+    float marginMm;    // exit hysteresis of zones and rules
+    int64_t lostUsec;  // a body not seen this long exits everything
+};
+
+struct ZoneEngine
+{
+    struct ZoneConfig config;
+
+    struct Zone zones[ZONE_MAX_ZONES];
+    int zoneCount;
+    float vertices[ZONE_MAX_VERTICES][2];
+    int vertexCount;
+    struct ZoneRule rules[ZONE_MAX_RULES];
+    int ruleCount;
+
+    // zone grid, built by zone_engine_build: zones of bucket h are
+    // cellZones[cellStart[h] .. cellStart[h + 1]]
+    uint32_t cellStart[ZONE_GRID_BUCKETS + 1];
+    uint16_t cellZones[ZONE_MAX_CELL_ENTRIES];
+    uint16_t largeZones[ZONE_MAX_ZONES];// tested everywhere
+    int largeCount;
+    bool built;
+
+    struct ZoneBody bodies[ZONE_MAX_BODIES];
+    uint64_t near[ZONE_MAX_RULES][ZONE_MAX_BODIES];// bit j of [r][i]: bodies i and j are near
+
+    // scratch of one update
+    uint32_t zoneMark[ZONE_MAX_ZONES];
+    uint32_t mark;
+    int16_t bodyHeads[ZONE_BODY_BUCKETS];
+    int16_t bodyNext[ZONE_MAX_BODIES];
+
+    struct ZoneEvent events[ZONE_MAX_EVENTS];
+    int eventCount;
+
+    uint64_t updates;
+    uint64_t emitted;
+    uint64_t dropped;// events beyond ZONE_MAX_EVENTS, or bodies beyond ZONE_MAX_BODIES
+    struct LatencyStats updateTime;// per update, us
+    int64_t lastReportUsec;
+};
+
+void zone_default_config(struct ZoneConfig* config);
+void zone_engine_init(struct ZoneEngine* engine, const struct ZoneConfig* config);
+
+// Definitions; false if a table is full or the definition is invalid.
+// Call zone_engine_build after the last one.
+bool zone_engine_add_box(struct ZoneEngine* engine, uint16_t id, vec3_t min, vec3_t max, int joint);
+bool zone_engine_add_polygon(struct ZoneEngine* engine, uint16_t id, float z0, float z1, const float (*xy)[2],
+                             int count, int joint);
+bool zone_engine_add_rule(struct ZoneEngine* engine, uint16_t id, float distance_mm, int joint_a, int joint_b);
+
+// Rasterize the zones into the grid; false if it overflows
+bool zone_engine_build(struct ZoneEngine* engine);
+
+// Read a zone file and build the grid. Returns the number of zones and
+// rules, or -1 if the file can not be read or a line is malformed.
+int zone_engine_load(struct ZoneEngine* engine, const char* path);
+
+// Update the bodies of a world-space frame and evaluate zones and rules;
+// events are queued until zone_engine_take_events
+void zone_engine_update(struct ZoneEngine* engine, const struct SkeletonFrame* frame);
+
+// Move up to max queued events to events; returns how many
+int zone_engine_take_events(struct ZoneEngine* engine, struct ZoneEvent* events, int max);
+
+// Print and reset the statistics every interval_usec
+void zone_engine_report(struct ZoneEngine* engine, int64_t now_usec, int64_t interval_usec);